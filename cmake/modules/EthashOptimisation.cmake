@@ -0,0 +1,79 @@
+# Optimised build configurations of ethash, shared by the library, the tests
+# and the benchmark.
+#
+#  ETHASH_NATIVE    optimise for the CPU of the build host (-march=native)
+#  ETHASH_ARCH      optimise for a -march profile, e.g. x86-64-v3 or haswell
+#  ETHASH_LTO       link time optimisation
+#  ETHASH_PGO       profile guided optimisation, GENERATE or USE:
+#                     cmake -DETHASH_PGO=GENERATE .. && make ethash_pgo_train
+#                     cmake -DETHASH_PGO=USE .. && make
+#                   With clang the profiles have to be merged in between:
+#                     llvm-profdata merge -o pgo/ethash.profdata pgo/*.profraw
+#  ETHASH_PGO_DIR   where the profiles are written and read
+#
+# The SIMD kernels are compiled for their own instruction sets whatever the
+# profile, and ethash_kernels() picks them at runtime, so a binary built
+# without ETHASH_NATIVE or ETHASH_ARCH still uses AVX2 or AVX-512 where the
+# CPU has them. ETHASH_NATIVE and ETHASH_ARCH also let the compiler use the
+# profile's instructions in the generic code, and such binaries only run on
+# CPUs that have them.
+
+option(ETHASH_NATIVE "Optimise for the CPU of the build host" OFF)
+set(ETHASH_ARCH "" CACHE STRING "Optimise for a -march profile, e.g. x86-64-v3")
+option(ETHASH_LTO "Build with link time optimisation" OFF)
+set(ETHASH_PGO "" CACHE STRING "Profile guided optimisation: GENERATE or USE")
+set(ETHASH_PGO_DIR "${CMAKE_BINARY_DIR}/pgo" CACHE PATH "Directory of the optimisation profiles")
+
+if (NOT CMAKE_BUILD_TYPE AND NOT CMAKE_CONFIGURATION_TYPES)
+	set(CMAKE_BUILD_TYPE Release CACHE STRING "Build type" FORCE)
+endif()
+
+set(ETHASH_LINK_FLAGS "")
+if (MSVC)
+	if (ETHASH_NATIVE OR ETHASH_ARCH OR ETHASH_PGO)
+		message(WARNING "ETHASH_NATIVE, ETHASH_ARCH and ETHASH_PGO are only supported by GCC and Clang")
+	endif()
+	if (ETHASH_LTO)
+		add_compile_options(/GL)
+		set(ETHASH_LINK_FLAGS "/LTCG")
+		set(CMAKE_STATIC_LINKER_FLAGS "${CMAKE_STATIC_LINKER_FLAGS} /LTCG")
+	endif()
+else()
+	if (ETHASH_NATIVE AND ETHASH_ARCH)
+		message(FATAL_ERROR "ETHASH_NATIVE and ETHASH_ARCH are exclusive")
+	elseif (ETHASH_NATIVE)
+		add_compile_options(-march=native)
+	elseif (ETHASH_ARCH)
+		add_compile_options(-march=${ETHASH_ARCH})
+	endif()
+
+	if (ETHASH_LTO)
+		add_compile_options(-flto)
+		set(ETHASH_LINK_FLAGS "${ETHASH_LINK_FLAGS} -flto")
+		# archives of GCC's LTO objects need the plugin aware ar and ranlib
+		if (CMAKE_C_COMPILER_ID STREQUAL "GNU" AND CMAKE_C_COMPILER_AR AND CMAKE_C_COMPILER_RANLIB)
+			set(CMAKE_AR "${CMAKE_C_COMPILER_AR}")
+			set(CMAKE_RANLIB "${CMAKE_C_COMPILER_RANLIB}")
+		endif()
+	endif()
+
+	if (ETHASH_PGO STREQUAL "GENERATE")
+		add_compile_options(-fprofile-generate=${ETHASH_PGO_DIR})
+		set(ETHASH_LINK_FLAGS "${ETHASH_LINK_FLAGS} -fprofile-generate=${ETHASH_PGO_DIR}")
+	elseif (ETHASH_PGO STREQUAL "USE")
+		if (CMAKE_C_COMPILER_ID MATCHES "Clang")
+			add_compile_options(-fprofile-use=${ETHASH_PGO_DIR}/ethash.profdata)
+			set(ETHASH_LINK_FLAGS "${ETHASH_LINK_FLAGS} -fprofile-use=${ETHASH_PGO_DIR}/ethash.profdata")
+		else()
+			# the tests and the benchmark are only partly trained, the
+			# library is what matters
+			add_compile_options(-fprofile-use=${ETHASH_PGO_DIR} -fprofile-correction -Wno-missing-profile)
+			set(ETHASH_LINK_FLAGS "${ETHASH_LINK_FLAGS} -fprofile-use=${ETHASH_PGO_DIR}")
+		endif()
+	elseif (ETHASH_PGO)
+		message(FATAL_ERROR "ETHASH_PGO must be GENERATE, USE or empty (was ${ETHASH_PGO})")
+	endif()
+endif()
+
+set(CMAKE_EXE_LINKER_FLAGS "${CMAKE_EXE_LINKER_FLAGS} ${ETHASH_LINK_FLAGS}")
+set(CMAKE_SHARED_LINKER_FLAGS "${CMAKE_SHARED_LINKER_FLAGS} ${ETHASH_LINK_FLAGS}")
@@ -19,9 +19,13 @@
 package ethash
 
 /*
+#include <stdlib.h>
 #include "src/libethash/internal.h"
 
 int ethashGoCallback_cgo(unsigned);
+void ethashGoEvent_cgo(ethash_event_t const*, void*);
+bool ethashGoSpawn_cgo(void*, void (*)(void*), void*, enum ethash_thread_priority);
+void ethashGoRunTask_cgo(void*, void*);
 */
 import "C"
 
@@ -41,7 +45,6 @@ import (
 	"unsafe"
 
 	"github.com/ethereum/go-ethereum/common"
-	"github.com/ethereum/go-ethereum/crypto"
 	"github.com/ethereum/go-ethereum/log"
 )
 
@@ -54,6 +57,16 @@ const (
 	epochLength         uint64     = 30000
 	cacheSizeForTesting C.uint64_t = 1024
 	dagSizeForTesting   C.uint64_t = 1024 * 32
+
+	// epochs whose sizes the C library knows, tabulated or computed
+	maxEpochs uint64 = C.ETHASH_MAX_EPOCHS
+
+	// how often Full.Search checks for a hit and updates the hash rate
+	searchPollInterval = 10 * time.Millisecond
+
+	// results of light hashes remembered for blocks verified again, see
+	// ResultCacheStats
+	resultCacheEntries = 4096
 )
 
 var DefaultDir = defaultDir()
@@ -69,52 +82,54 @@ func defaultDir() string {
 	return filepath.Join(home, ".ethash")
 }
 
-// cache wraps an ethash_light_t with some metadata
-// and automatic memory management.
-type cache struct {
-	epoch uint64
-	used  time.Time
-	test  bool
+// lightRegistries share the caches of all Light instances of the process,
+// one registry for the real and one for the testing cache size
+var lightRegistries struct {
+	sync.Mutex
+	real, test *C.struct_ethash_light_registry
+}
 
-	gen sync.Once // ensures cache is only generated once.
-	ptr *C.struct_ethash_light
+// the first Light to verify turns on the result cache of the library
+var resultCacheOnce sync.Once
+
+func lightRegistry(test bool) *C.struct_ethash_light_registry {
+	lightRegistries.Lock()
+	defer lightRegistries.Unlock()
+	registry := &lightRegistries.real
+	size := C.uint64_t(0)
+	if test {
+		registry = &lightRegistries.test
+		size = cacheSizeForTesting
+	}
+	if *registry == nil {
+		*registry = C.ethash_light_registry_new_internal(3, size)
+	}
+	resultCacheOnce.Do(func() { C.ethash_set_result_cache(resultCacheEntries) })
+	return *registry
 }
 
-// generate creates the actual cache. it can be called from multiple
-// goroutines. the first call will generate the cache, subsequent
-// calls wait until it is generated.
-func (cache *cache) generate() {
-	cache.gen.Do(func() {
-		started := time.Now()
-		seedHash := makeSeedHash(cache.epoch)
-		log.Debug(fmt.Sprintf("Generating cache for epoch %d (%x)", cache.epoch, seedHash))
-		size := C.ethash_get_cachesize(C.uint64_t(cache.epoch * epochLength))
-		if cache.test {
-			size = cacheSizeForTesting
-		}
-		cache.ptr = C.ethash_light_new_internal(size, (*C.ethash_h256_t)(unsafe.Pointer(&seedHash[0])))
-		runtime.SetFinalizer(cache, freeCache)
-		log.Debug(fmt.Sprintf("Done generating cache for epoch %d, it took %v", cache.epoch, time.Since(started)))
-	})
+// SetResultCache sets how many results of light hashes Light keeps for blocks
+// it is asked to verify again, 0 to compute every hash. Without a call it
+// keeps a few thousand.
+func SetResultCache(entries int) {
+	resultCacheOnce.Do(func() {})
+	C.ethash_set_result_cache(C.size_t(entries))
 }
 
-func freeCache(cache *cache) {
-	C.ethash_light_delete(cache.ptr)
-	cache.ptr = nil
+// ResultCacheStats tells how many light hashes of Light were answered from
+// the results of blocks verified before, and how many were computed.
+func ResultCacheStats() (hits, misses uint64) {
+	stats := C.ethash_get_result_cache_stats()
+	return uint64(stats.hits), uint64(stats.misses)
 }
 
-func (cache *cache) compute(dagSize uint64, hash common.Hash, nonce uint64) (ok bool, mixDigest, result common.Hash) {
-	ret := C.ethash_light_compute_internal(cache.ptr, C.uint64_t(dagSize), hashToH256(hash), C.uint64_t(nonce))
-	// Make sure cache is live until after the C call.
-	// This is important because a GC might happen and execute
-	// the finalizer before the call completes.
-	_ = cache
+func lightCompute(light *C.struct_ethash_light, dagSize uint64, hash common.Hash, nonce uint64) (ok bool, mixDigest, result common.Hash) {
+	ret := C.ethash_light_compute_internal(light, C.uint64_t(dagSize), hashToH256(hash), C.uint64_t(nonce))
 	return bool(ret.success), h256ToHash(ret.mix_hash), h256ToHash(ret.result)
 }
 
-func (cache *cache) computeProgpow(dagSize uint64, hash common.Hash, nonce uint64, block_number uint64) (ok bool, mixDigest, result common.Hash) {
-	ret := C.progpow_light_compute_internal(cache.ptr, C.uint64_t(dagSize), hashToH256(hash), C.uint64_t(nonce), C.uint64_t(block_number))
-	_ = cache
+func lightComputeProgpow(light *C.struct_ethash_light, dagSize uint64, hash common.Hash, nonce uint64, block_number uint64) (ok bool, mixDigest, result common.Hash) {
+	ret := C.progpow_light_compute_internal(light, C.uint64_t(dagSize), hashToH256(hash), C.uint64_t(nonce), C.uint64_t(block_number))
 	return bool(ret.success), h256ToHash(ret.mix_hash), h256ToHash(ret.result)
 }
 
@@ -123,11 +138,13 @@ func (cache *cache) computeProgpow(dagSize uint64, hash common.Hash, nonce uint6
 type Light struct {
 	test bool // If set, use a smaller cache size
 
-	mu     sync.Mutex        // Protects the per-epoch map of verification caches
-	caches map[uint64]*cache // Currently maintained verification caches
-	future *cache            // Pre-generated cache for the estimated future DAG
+	mu     sync.Mutex // Protects future
+	future uint64     // Latest epoch whose cache was pre-generated
 
-	NumCaches int // Maximum number of caches to keep before eviction (only init, don't modify)
+	// NumCaches is ignored. The caches of all Light instances are kept in the
+	// process wide registry, which evicts the least recently used ones that
+	// are no longer in use.
+	NumCaches int
 }
 
 // Verify checks whether the block's nonce is valid.
@@ -137,11 +154,9 @@ func (l *Light) Verify(block Block) bool {
 
 // Verify checks with given algorithm name
 func (l *Light) VerifyWithAlgo(block Block, algo string) bool {
-	// TODO: do ethash_quick_verify before getCache in order
-	// to prevent DOS attacks.
 	blockNum := block.NumberU64()
-	if blockNum >= epochLength*2048 {
-		log.Debug(fmt.Sprintf("block number %d too high, limit is %d", blockNum, epochLength*2048))
+	if blockNum >= epochLength*maxEpochs {
+		log.Debug(fmt.Sprintf("block number %d too high, limit is %d", blockNum, epochLength*maxEpochs))
 		return false
 	}
 
@@ -156,7 +171,14 @@ func (l *Light) VerifyWithAlgo(block Block, algo string) bool {
 		return false
 	}
 
-	cache := l.getCache(blockNum)
+	// Reject blocks whose mix digest does not even meet the difficulty
+	// before any cache is looked up or generated.
+	if !quickCheck(block, algo) {
+		return false
+	}
+
+	light := l.acquireCache(blockNum)
+	defer l.releaseCache(light)
 	dagSize := C.ethash_get_datasize(C.uint64_t(blockNum))
 	if l.test {
 		dagSize = dagSizeForTesting
@@ -166,10 +188,10 @@ func (l *Light) VerifyWithAlgo(block Block, algo string) bool {
 	var mixDigest, result common.Hash
 	switch algo {
 	case "progpow":
-		ok, mixDigest, result = cache.computeProgpow(uint64(dagSize), block.HashNoNonce(), block.Nonce(), blockNum)
+		ok, mixDigest, result = lightComputeProgpow(light, uint64(dagSize), block.HashNoNonce(), block.Nonce(), blockNum)
 		break
 	default:
-		ok, mixDigest, result = cache.compute(uint64(dagSize), block.HashNoNonce(), block.Nonce())
+		ok, mixDigest, result = lightCompute(light, uint64(dagSize), block.HashNoNonce(), block.Nonce())
 		break
 	}
 	if !ok {
@@ -182,8 +204,153 @@ func (l *Light) VerifyWithAlgo(block Block, algo string) bool {
 	}
 
 	// The actual check.
-	target := new(big.Int).Div(maxUint256, difficulty)
-	return result.Big().Cmp(target) <= 0
+	boundary, res := difficultyToBoundary(difficulty), hashToH256(result)
+	return bool(C.ethash_check_boundary(&res, &boundary))
+}
+
+// VerifyBatch checks the nonces of many blocks, setting the result of each
+// block at its index. The blocks of an epoch are verified concurrently by the
+// C library against their shared cache, without holding the cache lock.
+func (l *Light) VerifyBatch(blocks []Block) []bool {
+	results := make([]bool, len(blocks))
+	byEpoch := make(map[uint64][]int)
+	for i, block := range blocks {
+		blockNum := block.NumberU64()
+		if blockNum >= epochLength*maxEpochs {
+			log.Debug(fmt.Sprintf("block number %d too high, limit is %d", blockNum, epochLength*maxEpochs))
+			continue
+		}
+		if block.Difficulty().Cmp(common.Big0) == 0 {
+			log.Debug("invalid block difficulty")
+			continue
+		}
+		if !quickCheck(block, "ethash") {
+			continue
+		}
+		epoch := blockNum / epochLength
+		byEpoch[epoch] = append(byEpoch[epoch], i)
+	}
+	for epoch, indices := range byEpoch {
+		var (
+			n          = len(indices)
+			headers    = make([]C.ethash_h256_t, n)
+			nonces     = make([]C.uint64_t, n)
+			mixHashes  = make([]C.ethash_h256_t, n)
+			boundaries = make([]C.ethash_h256_t, n)
+		)
+		for j, i := range indices {
+			headers[j] = hashToH256(blocks[i].HashNoNonce())
+			nonces[j] = C.uint64_t(blocks[i].Nonce())
+			mixHashes[j] = hashToH256(blocks[i].MixDigest())
+			boundaries[j] = difficultyToBoundary(blocks[i].Difficulty())
+		}
+		valid := l.verifyEpoch(epoch, headers, nonces, mixHashes, boundaries)
+		for j, i := range indices {
+			results[i] = bool(valid[j])
+		}
+	}
+	return results
+}
+
+// VerifyHeaders checks the nonces of many RLP encoded block headers, like
+// VerifyBatch. The C library decodes the headers and computes their seal
+// hashes, so the batch crosses into C once for decoding and once per epoch,
+// without any hashing in Go. Headers that cannot be decoded are invalid.
+func (l *Light) VerifyHeaders(headers [][]byte) []bool {
+	results := make([]bool, len(headers))
+	if len(headers) == 0 {
+		return results
+	}
+	var (
+		n          = len(headers)
+		encoded    []byte
+		sizes      = make([]C.size_t, n)
+		numbers    = make([]C.uint64_t, n)
+		hashes     = make([]C.ethash_h256_t, n)
+		nonces     = make([]C.uint64_t, n)
+		mixHashes  = make([]C.ethash_h256_t, n)
+		boundaries = make([]C.ethash_h256_t, n)
+		decoded    = make([]C.bool, n)
+	)
+	for i, header := range headers {
+		encoded = append(encoded, header...)
+		sizes[i] = C.size_t(len(header))
+	}
+	if len(encoded) == 0 {
+		return results
+	}
+	C.ethash_header_decode_batch((*C.uint8_t)(unsafe.Pointer(&encoded[0])), &sizes[0], &numbers[0], &hashes[0],
+		&nonces[0], &mixHashes[0], &boundaries[0], &decoded[0], C.size_t(n))
+
+	byEpoch := make(map[uint64][]int)
+	for i := range headers {
+		// the quick check of the verification rejects the others before hashing
+		blockNum := uint64(numbers[i])
+		if !bool(decoded[i]) {
+			continue
+		}
+		if blockNum >= epochLength*maxEpochs {
+			log.Debug(fmt.Sprintf("block number %d too high, limit is %d", blockNum, epochLength*maxEpochs))
+			continue
+		}
+		epoch := blockNum / epochLength
+		byEpoch[epoch] = append(byEpoch[epoch], i)
+	}
+	for epoch, indices := range byEpoch {
+		var (
+			m               = len(indices)
+			epochHashes     = make([]C.ethash_h256_t, m)
+			epochNonces     = make([]C.uint64_t, m)
+			epochMixHashes  = make([]C.ethash_h256_t, m)
+			epochBoundaries = make([]C.ethash_h256_t, m)
+		)
+		for j, i := range indices {
+			epochHashes[j] = hashes[i]
+			epochNonces[j] = nonces[i]
+			epochMixHashes[j] = mixHashes[i]
+			epochBoundaries[j] = boundaries[i]
+		}
+		valid := l.verifyEpoch(epoch, epochHashes, epochNonces, epochMixHashes, epochBoundaries)
+		for j, i := range indices {
+			results[i] = bool(valid[j])
+		}
+	}
+	return results
+}
+
+// verifyEpoch checks headers of one epoch against its cache, returning
+// whether each is valid
+func (l *Light) verifyEpoch(epoch uint64, headers []C.ethash_h256_t, nonces []C.uint64_t,
+	mixHashes, boundaries []C.ethash_h256_t) []C.bool {
+	valid := make([]C.bool, len(headers))
+	light := l.acquireCache(epoch * epochLength)
+	defer l.releaseCache(light)
+	dagSize := C.ethash_get_datasize(C.uint64_t(epoch * epochLength))
+	if l.test {
+		dagSize = dagSizeForTesting
+	}
+	C.ethash_light_verify_batch_internal(light, dagSize, &headers[0], &nonces[0], &mixHashes[0],
+		&boundaries[0], &valid[0], C.size_t(len(headers)), 0)
+	return valid
+}
+
+// quickCheck tells whether the final hash computed from the block's claimed
+// mix digest meets its difficulty. It needs no cache, so it is cheap enough
+// to run on every block before the real verification. The difficulty must
+// not be zero.
+func quickCheck(block Block, algo string) bool {
+	var (
+		header   = hashToH256(block.HashNoNonce())
+		mix      = hashToH256(block.MixDigest())
+		boundary = difficultyToBoundary(block.Difficulty())
+		nonce    = C.uint64_t(block.Nonce())
+	)
+	switch algo {
+	case "progpow":
+		return bool(C.progpow_quick_check_difficulty(&header, nonce, &mix, &boundary))
+	default:
+		return bool(C.ethash_quick_check_difficulty(&header, nonce, &mix, &boundary))
+	}
 }
 
 // compute() to get mixhash and result
@@ -193,13 +360,17 @@ func (l *Light) Compute(blockNum uint64, hashNoNonce common.Hash, nonce uint64)
 
 // compute() to get mixhash and result with algo
 func (l *Light) ComputeWithAlgo(blockNum uint64, hashNoNonce common.Hash, nonce uint64, algo string) (ok bool, mixDigest common.Hash, result common.Hash) {
-	cache := l.getCache(blockNum)
+	light := l.acquireCache(blockNum)
+	defer l.releaseCache(light)
 	dagSize := C.ethash_get_datasize(C.uint64_t(blockNum))
+	if l.test {
+		dagSize = dagSizeForTesting
+	}
 	switch algo {
 	case "progpow":
-		return cache.computeProgpow(uint64(dagSize), hashNoNonce, nonce, blockNum)
+		return lightComputeProgpow(light, uint64(dagSize), hashNoNonce, nonce, blockNum)
 	default:
-		return cache.compute(uint64(dagSize), hashNoNonce, nonce)
+		return lightCompute(light, uint64(dagSize), hashNoNonce, nonce)
 	}
 }
 
@@ -211,62 +382,135 @@ func hashToH256(in common.Hash) C.ethash_h256_t {
 	return C.ethash_h256_t{b: *(*[32]C.uint8_t)(unsafe.Pointer(&in[0]))}
 }
 
-func (l *Light) getCache(blockNum uint64) *cache {
-	var c *cache
-	epoch := blockNum / epochLength
-
-	// If we have a PoW for that epoch, use that
-	l.mu.Lock()
-	if l.caches == nil {
-		l.caches = make(map[uint64]*cache)
-	}
-	if l.NumCaches == 0 {
-		l.NumCaches = 3
-	}
-	c = l.caches[epoch]
-	if c == nil {
-		// No cached DAG, evict the oldest if the cache limit was reached
-		if len(l.caches) >= l.NumCaches {
-			var evict *cache
-			for _, cache := range l.caches {
-				if evict == nil || evict.used.After(cache.used) {
-					evict = cache
-				}
-			}
-			log.Debug(fmt.Sprintf("Evicting DAG for epoch %d in favour of epoch %d", evict.epoch, epoch))
-			delete(l.caches, evict.epoch)
-		}
-		// If we have the new DAG pre-generated, use that, otherwise create a new one
-		if l.future != nil && l.future.epoch == epoch {
-			log.Debug(fmt.Sprintf("Using pre-generated DAG for epoch %d", epoch))
-			c, l.future = l.future, nil
-		} else {
-			log.Debug(fmt.Sprintf("No pre-generated DAG available, creating new for epoch %d", epoch))
-			c = &cache{epoch: epoch, test: l.test}
+// difficultyToBoundary computes the big endian boundary 2^256 / difficulty
+// expected by the C checks and searches, saturating at 2^256-1. It is called
+// once per block or job, the comparisons against it need no big.Int. The
+// difficulty must not be zero.
+func difficultyToBoundary(difficulty *big.Int) C.ethash_h256_t {
+	var out C.ethash_h256_t
+	if difficulty.BitLen() > 256 {
+		// only 2^256 itself leaves a boundary above zero
+		if difficulty.Cmp(maxUint256) == 0 {
+			out.b[31] = 1
 		}
-		l.caches[epoch] = c
+		return out
+	}
+	var d common.Hash
+	difficulty.FillBytes(d[:])
+	in := hashToH256(d)
+	C.ethash_boundary_from_difficulty(&out, &in)
+	return out
+}
+
+// acquireCache returns the verification cache of blockNum's epoch. The cache is
+// shared through the process wide registry, which builds every epoch once no
+// matter how many goroutines ask for it, without blocking the lookups of the
+// epochs already built, and never frees a cache before it is released with
+// releaseCache.
+func (l *Light) acquireCache(blockNum uint64) *C.struct_ethash_light {
+	light := C.ethash_light_registry_acquire(lightRegistry(l.test), C.uint64_t(blockNum))
+	if light == nil {
+		panic("ethash_light_registry_acquire failed")
+	}
+	l.pregenerate(blockNum/epochLength + 1)
+	return light
+}
+
+func (l *Light) releaseCache(light *C.struct_ethash_light) {
+	C.ethash_light_registry_release(lightRegistry(l.test), light)
+}
+
+// SetMemoryLock sets whether the caches and DAGs created from now on are locked
+// in physical memory once complete, so that memory pressure can't page them
+// out. Locking needs a large enough RLIMIT_MEMLOCK or CAP_IPC_LOCK. A handler
+// that can't be locked still works; MemoryInfo tells how much of it is locked.
+func SetMemoryLock(on bool) {
+	C.ethash_set_memory_lock(C.bool(on))
+}
 
-		// If we just used up the future cache, or need a refresh, regenerate
-		if l.future == nil || l.future.epoch <= epoch {
-			log.Debug(fmt.Sprintf("Pre-generating DAG for epoch %d", epoch+1))
-			l.future = &cache{epoch: epoch + 1, test: l.test}
-			go l.future.generate()
+// SetMemoryBudget caps the memory the verification caches and DAGs of the
+// process take together, 0 for no limit. A cache or DAG that does not fit
+// first evicts the least recently used caches Light does not hold, then waits
+// up to maxWait for others to be freed before its creation fails.
+func SetMemoryBudget(bytes uint64, maxWait time.Duration) {
+	C.ethash_set_memory_budget(C.uint64_t(bytes), C.uint64_t(maxWait/time.Millisecond))
+}
+
+// MemoryInfo tells what the memory of a verification cache or a DAG costs.
+type MemoryInfo struct {
+	Allocated    uint64   // bytes mapped, NUMA replicas included
+	Resident     uint64   // bytes of them in physical memory
+	HugePages    uint64   // bytes of them in explicit or transparent huge pages
+	FileBacked   bool     // whether it maps the DAG or cache file
+	Locked       uint64   // bytes of them locked in physical memory, see SetMemoryLock
+	NodeResident []uint64 // resident bytes per NUMA node, up to the highest one used
+}
+
+func memoryInfo(info *C.ethash_memory_info_t) MemoryInfo {
+	nodes := 1
+	for n := 1; n != C.ETHASH_MEMORY_INFO_NODES; n++ {
+		if info.node_resident[n] != 0 {
+			nodes = n + 1
 		}
 	}
-	c.used = time.Now()
-	l.mu.Unlock()
+	ret := MemoryInfo{
+		Allocated:    uint64(info.allocated),
+		Resident:     uint64(info.resident),
+		HugePages:    uint64(info.huge_pages),
+		FileBacked:   bool(info.file_backed),
+		Locked:       uint64(info.locked),
+		NodeResident: make([]uint64, nodes),
+	}
+	for n := range ret.NodeResident {
+		ret.NodeResident[n] = uint64(info.node_resident[n])
+	}
+	return ret
+}
 
-	// Wait for generation finish and return the cache
-	c.generate()
-	return c
+// MemoryInfo reports the memory of the verification cache of blockNum's
+// epoch. exact is false if the residency could not be queried, in which case
+// all of it is reported resident.
+func (l *Light) MemoryInfo(blockNum uint64) (info MemoryInfo, exact bool) {
+	light := l.acquireCache(blockNum)
+	defer l.releaseCache(light)
+	var cinfo C.ethash_memory_info_t
+	exact = bool(C.ethash_light_memory_info(light, &cinfo))
+	return memoryInfo(&cinfo), exact
+}
+
+// pregenerate builds the cache of the estimated future epoch in the
+// background, once per epoch.
+func (l *Light) pregenerate(epoch uint64) {
+	if epoch >= maxEpochs {
+		return
+	}
+	l.mu.Lock()
+	start := epoch > l.future
+	if start {
+		l.future = epoch
+	}
+	l.mu.Unlock()
+	if !start {
+		return
+	}
+	go func() {
+		started := time.Now()
+		log.Debug(fmt.Sprintf("Pre-generating cache for epoch %d", epoch))
+		registry := lightRegistry(l.test)
+		if light := C.ethash_light_registry_acquire(registry, C.uint64_t(epoch*epochLength)); light != nil {
+			C.ethash_light_registry_release(registry, light)
+		}
+		log.Debug(fmt.Sprintf("Done pre-generating cache for epoch %d, it took %v", epoch, time.Since(started)))
+	}()
 }
 
 // dag wraps an ethash_full_t with some metadata
 // and automatic memory management.
 type dag struct {
-	epoch uint64
-	test  bool
-	dir   string
+	epoch    uint64
+	test     bool
+	dir      string
+	inMemory bool
 
 	gen sync.Once // ensures DAG is only generated once.
 	ptr *C.struct_ethash_full
@@ -288,22 +532,33 @@ func (d *dag) generate() {
 			cacheSize = cacheSizeForTesting
 			dagSize = dagSizeForTesting
 		}
-		if d.dir == "" {
+		if d.dir == "" && !d.inMemory {
 			d.dir = DefaultDir
 		}
+		var dir *C.char
+		if !d.inMemory {
+			dir = C.CString(d.dir)
+			defer C.free(unsafe.Pointer(dir))
+			// share the pages of a DAG file another process has already generated
+			d.ptr = C.ethash_full_attach_internal(dir, hashToH256(seedHash), dagSize)
+			if d.ptr != nil {
+				runtime.SetFinalizer(d, freeDAG)
+				log.Info(fmt.Sprintf("Attached to the DAG file of epoch %d, it took %v", d.epoch, time.Since(started)))
+				return
+			}
+		}
 		log.Info(fmt.Sprintf("Generating DAG for epoch %d (size %d) (%x)", d.epoch, dagSize, seedHash))
 		// Generate a temporary cache.
 		// TODO: this could share the cache with Light
 		cache := C.ethash_light_new_internal(cacheSize, (*C.ethash_h256_t)(unsafe.Pointer(&seedHash[0])))
 		defer C.ethash_light_delete(cache)
 		// Generate the actual DAG.
-		d.ptr = C.ethash_full_new_internal(
-			C.CString(d.dir),
-			hashToH256(seedHash),
-			dagSize,
-			cache,
-			(C.ethash_callback_t)(unsafe.Pointer(C.ethashGoCallback_cgo)),
-		)
+		callback := (C.ethash_callback_t)(unsafe.Pointer(C.ethashGoCallback_cgo))
+		if d.inMemory {
+			d.ptr = C.ethash_full_new_memory_internal(dagSize, cache, 0, callback)
+		} else {
+			d.ptr = C.ethash_full_new_internal(dir, hashToH256(seedHash), dagSize, cache, callback)
+		}
 		if d.ptr == nil {
 			panic("ethash_full_new IO or memory error")
 		}
@@ -327,13 +582,98 @@ func ethashGoCallback(percent C.unsigned) C.int {
 	return 0
 }
 
+// DAGFile is what the library found when it looked for a DAG file.
+type DAGFile int
+
+const (
+	DAGFileNone         DAGFile = C.ETHASH_DAG_FILE_NONE          // not an EventDAGFileChecked event
+	DAGFileMatch        DAGFile = C.ETHASH_DAG_FILE_MATCH         // the DAG file is loaded
+	DAGFileMismatch     DAGFile = C.ETHASH_DAG_FILE_MISMATCH      // the DAG is generated
+	DAGFileSizeMismatch DAGFile = C.ETHASH_DAG_FILE_SIZE_MISMATCH // the DAG is resumed or generated again
+)
+
+// Event types, named as Event.Name reports them
+const (
+	EventCacheBuildStart = C.ETHASH_EVENT_CACHE_BUILD_START
+	EventCacheBuildEnd   = C.ETHASH_EVENT_CACHE_BUILD_END
+	EventDAGFileChecked  = C.ETHASH_EVENT_DAG_FILE_CHECKED
+	EventDAGMapped       = C.ETHASH_EVENT_DAG_MAPPED
+	EventDAGMagicWritten = C.ETHASH_EVENT_DAG_MAGIC_WRITTEN
+	EventDAGDeleted      = C.ETHASH_EVENT_DAG_DELETED
+	EventDAGFileRemoved  = C.ETHASH_EVENT_DAG_FILE_REMOVED
+)
+
+// NoEpoch is the Event.Epoch of caches and DAGs past the first 2048 epochs.
+const NoEpoch = uint64(C.ETHASH_EVENT_NO_EPOCH)
+
+// Event is a step in the life of a cache or DAG, see SetEventHandler.
+type Event struct {
+	Type     int           // one of the Event* constants
+	Name     string        // e.g. "cache_build_end"
+	TimeUs   uint64        // microseconds on the monotonic clock of the C library
+	Epoch    uint64        // or NoEpoch
+	Size     uint64        // bytes of the cache, DAG or mapping
+	Duration time.Duration // of builds and mappings, 0 for the other events
+	DAGFile  DAGFile
+}
+
+var eventHandler atomic.Value // func(Event)
+
+// SetEventHandler makes the C library report cache and DAG lifecycle events
+// to handler, or stops reporting them if handler is nil. handler runs on the
+// thread doing the work, so it should return quickly.
+func SetEventHandler(handler func(Event)) {
+	eventHandler.Store(handler)
+	if handler == nil {
+		C.ethash_set_event_callback(nil, nil)
+	} else {
+		C.ethash_set_event_callback((C.ethash_event_callback_t)(unsafe.Pointer(C.ethashGoEvent_cgo)), nil)
+	}
+}
+
+//export ethashGoEvent
+func ethashGoEvent(event *C.ethash_event_t) {
+	handler, _ := eventHandler.Load().(func(Event))
+	if handler == nil {
+		return
+	}
+	handler(Event{
+		Type:     int(event._type),
+		Name:     C.GoString(C.ethash_event_type_name(event._type)),
+		TimeUs:   uint64(event.time_us),
+		Epoch:    uint64(event.epoch),
+		Size:     uint64(event.size),
+		Duration: time.Duration(event.duration_us) * time.Microsecond,
+		DAGFile:  DAGFile(event.dag_file),
+	})
+}
+
+// SetGoExecutor makes the C library run the helper threads of DAG
+// generation, checksums and batch verification as goroutines instead of on
+// its own thread pools, or go back to the pools if on is false.
+func SetGoExecutor(on bool) {
+	if !on {
+		C.ethash_set_executor(nil)
+		return
+	}
+	executor := C.ethash_executor_t{spawn: (*[0]byte)(unsafe.Pointer(C.ethashGoSpawn_cgo))}
+	C.ethash_set_executor(&executor)
+}
+
+//export ethashGoSpawn
+func ethashGoSpawn(task, arg unsafe.Pointer) {
+	go func() {
+		C.ethashGoRunTask_cgo(task, arg)
+	}()
+}
+
 // MakeDAG pre-generates a DAG file for the given block number in the
 // given directory. If dir is the empty string, the default directory
 // is used.
 func MakeDAG(blockNum uint64, dir string) error {
 	d := &dag{epoch: blockNum / epochLength, dir: dir}
-	if blockNum >= epochLength*2048 {
-		return fmt.Errorf("block number too high, limit is %d", epochLength*2048)
+	if blockNum >= epochLength*maxEpochs {
+		return fmt.Errorf("block number too high, limit is %d", epochLength*maxEpochs)
 	}
 	d.generate()
 	if d.ptr == nil {
@@ -344,77 +684,119 @@ func MakeDAG(blockNum uint64, dir string) error {
 
 // Full implements the Search half of the proof of work.
 type Full struct {
-	Dir string // use this to specify a non-default DAG directory
+	Dir      string // use this to specify a non-default DAG directory
+	InMemory bool   // keep the DAG in anonymous memory only, without a DAG file
 
-	test     bool // if set use a smaller DAG size
-	turbo    bool
+	test     bool  // if set use a smaller DAG size
+	turbo    int32 // search on all hardware threads rather than one, atomic
 	hashRate int32
 
-	mu      sync.Mutex // protects dag
-	current *dag       // current full DAG
+	utilization uint32 // percentage of the time search threads hash, 0 for all of it, atomic
+	maxHashRate uint64 // nonces per second of a search, 0 for no limit, atomic
+
+	mu      sync.Mutex // protects manager
+	manager *C.struct_ethash_epoch_manager
 }
 
-func (pow *Full) getDAG(blockNum uint64) (d *dag) {
-	epoch := blockNum / epochLength
+// acquireDAG returns the DAG for blockNum. The epoch manager keeps the DAG
+// of the current epoch and builds the next one in the background shortly
+// before the epoch boundary, so most calls return immediately.
+func (pow *Full) acquireDAG(blockNum uint64) *C.struct_ethash_full {
 	pow.mu.Lock()
-	if pow.current != nil && pow.current.epoch == epoch {
-		d = pow.current
-	} else {
-		d = &dag{epoch: epoch, test: pow.test, dir: pow.Dir}
-		pow.current = d
+	if pow.manager == nil {
+		var (
+			dir       *C.char
+			cacheSize C.uint64_t
+			dagSize   C.uint64_t
+		)
+		if !pow.InMemory {
+			if pow.Dir == "" {
+				pow.Dir = DefaultDir
+			}
+			dir = C.CString(pow.Dir)
+			defer C.free(unsafe.Pointer(dir))
+		}
+		if pow.test {
+			cacheSize = cacheSizeForTesting
+			dagSize = dagSizeForTesting
+		}
+		callback := (C.ethash_callback_t)(unsafe.Pointer(C.ethashGoCallback_cgo))
+		pow.manager = C.ethash_epoch_manager_new_internal(dir, C.ETHASH_EPOCH_PREFETCH_BLOCKS, 0, cacheSize, dagSize, callback)
+		if pow.manager == nil {
+			panic("ethash_epoch_manager_new memory error")
+		}
+		runtime.SetFinalizer(pow, freeEpochManager)
 	}
 	pow.mu.Unlock()
-	// wait for it to finish generating.
-	d.generate()
-	return d
+	full := C.ethash_epoch_manager_acquire(pow.manager, C.uint64_t(blockNum))
+	if full == nil {
+		panic("ethash_full_new IO or memory error")
+	}
+	return full
+}
+
+func (pow *Full) releaseDAG(full *C.struct_ethash_full) {
+	C.ethash_epoch_manager_release(pow.manager, full)
+}
+
+// MemoryInfo reports the memory of the DAG of blockNum, building it if need
+// be, like Light.MemoryInfo.
+func (pow *Full) MemoryInfo(blockNum uint64) (info MemoryInfo, exact bool) {
+	full := pow.acquireDAG(blockNum)
+	defer pow.releaseDAG(full)
+	var cinfo C.ethash_memory_info_t
+	exact = bool(C.ethash_full_memory_info(full, &cinfo))
+	return memoryInfo(&cinfo), exact
 }
 
+func freeEpochManager(pow *Full) {
+	C.ethash_epoch_manager_delete(pow.manager)
+	pow.manager = nil
+}
+
+// Search hashes nonces on C threads until one meets the difficulty of block
+// or stop is closed. The threads split the nonces from a random start
+// between them, and their hash counter gives the hash rate.
 func (pow *Full) Search(block Block, stop <-chan struct{}, index int) (nonce uint64, mixDigest []byte) {
-	dag := pow.getDAG(block.NumberU64())
+	full := pow.acquireDAG(block.NumberU64())
+	defer pow.releaseDAG(full)
 
 	r := rand.New(rand.NewSource(time.Now().UnixNano()))
-	diff := block.Difficulty()
+	hash := hashToH256(block.HashNoNonce())
+	boundary := difficultyToBoundary(block.Difficulty())
+	threads := C.unsigned(1)
+	if atomic.LoadInt32(&pow.turbo) != 0 {
+		threads = 0
+	}
+	// TODO: disagrees with the spec https://github.com/ethereum/wiki/wiki/Ethash#mining
+	search := C.ethash_search_start(full, hash, C.uint64_t(r.Int63()), &boundary, threads)
+	if search == nil {
+		panic("ethash_search_start thread or memory error")
+	}
+	defer C.ethash_search_delete(search)
+	utilization, maxHashRate := atomic.LoadUint32(&pow.utilization), atomic.LoadUint64(&pow.maxHashRate)
+	if utilization != 0 || maxHashRate != 0 {
+		throttle := C.ethash_throttle_t{utilization: C.unsigned(utilization), max_hash_rate: C.uint64_t(maxHashRate)}
+		C.ethash_search_set_throttle(search, &throttle)
+	}
 
-	i := int64(0)
-	starti := i
-	start := time.Now().UnixNano()
+	start := time.Now()
 	previousHashrate := int32(0)
-
-	nonce = uint64(r.Int63())
-	hash := hashToH256(block.HashNoNonce())
-	target := new(big.Int).Div(maxUint256, diff)
+	defer func() { atomic.AddInt32(&pow.hashRate, -previousHashrate) }()
+	ticker := time.NewTicker(searchPollInterval)
+	defer ticker.Stop()
+	var hit C.ethash_search_hit_t
 	for {
 		select {
 		case <-stop:
-			atomic.AddInt32(&pow.hashRate, -previousHashrate)
 			return 0, nil
-		default:
-			i++
-
-			// we don't have to update hash rate on every nonce, so update after
-			// first nonce check and then after 2^X nonces
-			if i == 2 || ((i % (1 << 16)) == 0) {
-				elapsed := time.Now().UnixNano() - start
-				hashes := (float64(1e9) / float64(elapsed)) * float64(i-starti)
-				hashrateDiff := int32(hashes) - previousHashrate
-				previousHashrate = int32(hashes)
-				atomic.AddInt32(&pow.hashRate, hashrateDiff)
+		case <-ticker.C:
+			if C.ethash_search_result(search, &hit) {
+				return uint64(hit.nonce), C.GoBytes(unsafe.Pointer(&hit.mix_hash), C.int(32))
 			}
-
-			ret := C.ethash_full_compute(dag.ptr, hash, C.uint64_t(nonce))
-			result := h256ToHash(ret.result).Big()
-
-			// TODO: disagrees with the spec https://github.com/ethereum/wiki/wiki/Ethash#mining
-			if ret.success && result.Cmp(target) <= 0 {
-				mixDigest = C.GoBytes(unsafe.Pointer(&ret.mix_hash), C.int(32))
-				atomic.AddInt32(&pow.hashRate, -previousHashrate)
-				return nonce, mixDigest
-			}
-			nonce += 1
-		}
-
-		if !pow.turbo {
-			time.Sleep(20 * time.Microsecond)
+			hashes := int32(float64(C.ethash_search_hashes(search)) / time.Since(start).Seconds())
+			atomic.AddInt32(&pow.hashRate, hashes-previousHashrate)
+			previousHashrate = hashes
 		}
 	}
 }
@@ -423,9 +805,25 @@ func (pow *Full) GetHashrate() int64 {
 	return int64(atomic.LoadInt32(&pow.hashRate))
 }
 
+// Turbo makes searches started from now on use all hardware threads, or one.
 func (pow *Full) Turbo(on bool) {
-	// TODO: this needs to use an atomic operation.
-	pow.turbo = on
+	turbo := int32(0)
+	if on {
+		turbo = 1
+	}
+	atomic.StoreInt32(&pow.turbo, turbo)
+}
+
+// Throttle makes searches started from now on share the host. Their threads
+// hash utilization percent of the time, 0 or 100 for all of it, and at most
+// maxHashRate nonces per second between them, 0 for no limit. They pause
+// between bursts of a few milliseconds rather than after every nonce.
+func (pow *Full) Throttle(utilization uint, maxHashRate uint64) {
+	if utilization > 100 {
+		utilization = 100
+	}
+	atomic.StoreUint32(&pow.utilization, uint32(utilization))
+	atomic.StoreUint64(&pow.maxHashRate, maxHashRate)
 }
 
 // Ethash combines block verification with Light and
@@ -437,13 +835,13 @@ type Ethash struct {
 
 // New creates an instance of the proof of work.
 func New() *Ethash {
-	return &Ethash{new(Light), &Full{turbo: true}}
+	return &Ethash{new(Light), &Full{turbo: 1}}
 }
 
 // NewShared creates an instance of the proof of work., where a single instance
 // of the Light cache is shared across all instances created with NewShared.
 func NewShared() *Ethash {
-	return &Ethash{sharedLight, &Full{turbo: true}}
+	return &Ethash{sharedLight, &Full{turbo: 1}}
 }
 
 // NewForTesting creates a proof of work for use in unit tests.
@@ -461,16 +859,27 @@ func NewForTesting() (*Ethash, error) {
 }
 
 func GetSeedHash(blockNum uint64) ([]byte, error) {
-	if blockNum >= epochLength*2048 {
-		return nil, fmt.Errorf("block number too high, limit is %d", epochLength*2048)
+	if blockNum >= epochLength*maxEpochs {
+		return nil, fmt.Errorf("block number too high, limit is %d", epochLength*maxEpochs)
 	}
 	sh := makeSeedHash(blockNum / epochLength)
 	return sh[:], nil
 }
 
-func makeSeedHash(epoch uint64) (sh common.Hash) {
-	for ; epoch > 0; epoch-- {
-		sh = crypto.Sha3Hash(sh[:])
+// GetEpochFromSeedHash returns the epoch of a seedhash, as sent by pools
+// in stratum jobs.
+func GetEpochFromSeedHash(seedHash []byte) (uint64, error) {
+	if len(seedHash) != 32 {
+		return 0, fmt.Errorf("invalid seedhash length %d", len(seedHash))
 	}
-	return sh
+	var epoch C.uint64_t
+	if !C.ethash_get_epoch_from_seedhash(hashToH256(common.BytesToHash(seedHash)), &epoch) {
+		return 0, fmt.Errorf("unknown seedhash %x", seedHash)
+	}
+	return uint64(epoch), nil
+}
+
+func makeSeedHash(epoch uint64) (sh common.Hash) {
+	// the C library memoizes the seedhash chain
+	return h256ToHash(C.ethash_get_seedhash(C.uint64_t(epoch * epochLength)))
 }
@@ -26,9 +26,11 @@ import (
 	"os"
 	"sync"
 	"testing"
+	"time"
 
 	"github.com/ethereum/go-ethereum/common"
 	"github.com/ethereum/go-ethereum/crypto"
+	"github.com/ethereum/go-ethereum/rlp"
 )
 
 func init() {
@@ -137,6 +139,116 @@ func TestEthashVerifyInvalid(t *testing.T) {
 	}
 }
 
+func TestEthashVerifyBatch(t *testing.T) {
+	eth := New()
+	blocks := []Block{&invalidZeroDiffBlock}
+	for _, block := range validBlocks {
+		blocks = append(blocks, block)
+	}
+	wrongNonce := *validBlocks[0]
+	wrongNonce.nonce++
+	blocks = append(blocks, &wrongNonce)
+
+	results := eth.VerifyBatch(blocks)
+	for i, ok := range results {
+		if want := i != 0 && i != len(blocks)-1; ok != want {
+			t.Errorf("block %d: got %v, want %v", i, ok, want)
+		}
+	}
+}
+
+// testHeader has the fields of a go-ethereum block header in their RLP order
+type testHeader struct {
+	ParentHash  common.Hash
+	UncleHash   common.Hash
+	Coinbase    [20]byte
+	Root        common.Hash
+	TxHash      common.Hash
+	ReceiptHash common.Hash
+	Bloom       [256]byte
+	Difficulty  *big.Int
+	Number      *big.Int
+	GasLimit    uint64
+	GasUsed     uint64
+	Time        uint64
+	Extra       []byte
+	MixDigest   common.Hash
+	Nonce       [8]byte
+}
+
+func (h *testHeader) hashNoNonce(t *testing.T) common.Hash {
+	enc, err := rlp.EncodeToBytes([]interface{}{
+		h.ParentHash, h.UncleHash, h.Coinbase, h.Root, h.TxHash, h.ReceiptHash, h.Bloom,
+		h.Difficulty, h.Number, h.GasLimit, h.GasUsed, h.Time, h.Extra,
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+	return crypto.Keccak256Hash(enc)
+}
+
+func TestEthashVerifyHeaders(t *testing.T) {
+	eth, err := NewForTesting()
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(eth.Full.Dir)
+
+	header := &testHeader{Difficulty: big.NewInt(1), Number: big.NewInt(1), GasLimit: 5000, Extra: []byte("ethash")}
+	header.Nonce[7] = 0x42
+	ok, mixDigest, _ := eth.Compute(1, header.hashNoNonce(t), 0x42)
+	if !ok {
+		t.Fatal("could not hash header")
+	}
+	header.MixDigest = mixDigest
+	valid, err := rlp.EncodeToBytes(header)
+	if err != nil {
+		t.Fatal(err)
+	}
+	header.MixDigest[0] ^= 1
+	wrongMix, err := rlp.EncodeToBytes(header)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	results := eth.VerifyHeaders([][]byte{valid, []byte("not a header"), wrongMix})
+	for i, want := range []bool{true, false, false} {
+		if results[i] != want {
+			t.Errorf("header %d: got %v, want %v", i, results[i], want)
+		}
+	}
+}
+
+func TestResultCacheAnswersRepeatedVerify(t *testing.T) {
+	eth, err := NewForTesting()
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(eth.Full.Dir)
+	for _, algo := range []string{"ethash", "progpow"} {
+		block := &testBlock{number: 1, difficulty: big.NewInt(1)}
+		rand.Read(block.hashNoNonce[:])
+		ok, mixDigest, _ := eth.ComputeWithAlgo(block.number, block.hashNoNonce, block.nonce, algo)
+		if !ok {
+			t.Fatalf("%s: could not hash block", algo)
+		}
+		block.mixDigest = mixDigest
+		hits, _ := ResultCacheStats()
+		for i := 0; i != 3; i++ {
+			if !eth.VerifyWithAlgo(block, algo) {
+				t.Fatalf("%s: verification %d failed", algo, i)
+			}
+		}
+		if after, _ := ResultCacheStats(); after != hits+3 {
+			t.Errorf("%s: %d results came from the cache, want 3", algo, after-hits)
+		}
+		block.mixDigest[0] ^= 1
+		if eth.VerifyWithAlgo(block, algo) {
+			t.Errorf("%s: a cached result accepted the wrong mix digest", algo)
+		}
+	}
+}
+
 func TestEthashConcurrentVerify(t *testing.T) {
 	eth, err := NewForTesting()
 	if err != nil {
@@ -255,3 +367,152 @@ func TestGetSeedHash(t *testing.T) {
 	}
 
 }
+
+func TestGetEpochFromSeedHash(t *testing.T) {
+	for _, epoch := range []uint64{0, 1, 400, 2047} {
+		seed, err := GetSeedHash(epoch * epochLength)
+		if err != nil {
+			t.Fatal(err)
+		}
+		got, err := GetEpochFromSeedHash(seed)
+		if err != nil {
+			t.Fatalf("epoch %d: %v", epoch, err)
+		}
+		if got != epoch {
+			t.Errorf("epoch mismatch: got %d, want %d", got, epoch)
+		}
+	}
+	if _, err := GetEpochFromSeedHash(make([]byte, 31)); err == nil {
+		t.Error("expected an error for a short seedhash")
+	}
+	if _, err := GetEpochFromSeedHash(bytes.Repeat([]byte{0xff}, 32)); err == nil {
+		t.Error("expected an error for an unknown seedhash")
+	}
+}
+
+// benchBlock returns a block of blockNum that verifies with the testing cache,
+// hashing its nonce in full as its difficulty of 1 passes every boundary.
+func benchBlock(b *testing.B, eth *Ethash, blockNum uint64, algo string) *testBlock {
+	block := &testBlock{number: blockNum, difficulty: big.NewInt(1)}
+	rand.Read(block.hashNoNonce[:])
+	ok, mixDigest, _ := eth.ComputeWithAlgo(blockNum, block.hashNoNonce, block.nonce, algo)
+	if !ok {
+		b.Fatalf("could not hash block %d", blockNum)
+	}
+	block.mixDigest = mixDigest
+	return block
+}
+
+func benchmarkVerify(b *testing.B, algo string, parallel bool) {
+	eth, err := NewForTesting()
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer os.RemoveAll(eth.Full.Dir)
+	// every iteration verifies the same block, which the result cache would answer
+	SetResultCache(0)
+	defer SetResultCache(resultCacheEntries)
+	block := benchBlock(b, eth, 1, algo)
+
+	b.ReportAllocs()
+	b.ResetTimer()
+	if !parallel {
+		for i := 0; i < b.N; i++ {
+			if !eth.VerifyWithAlgo(block, algo) {
+				b.Fatal("block could not be verified")
+			}
+		}
+		return
+	}
+	// every goroutine goes through the registry lookup of the same cache
+	b.RunParallel(func(pb *testing.PB) {
+		for pb.Next() {
+			if !eth.VerifyWithAlgo(block, algo) {
+				b.Error("block could not be verified")
+				return
+			}
+		}
+	})
+}
+
+func BenchmarkVerify(b *testing.B)                { benchmarkVerify(b, "ethash", false) }
+func BenchmarkVerifyParallel(b *testing.B)        { benchmarkVerify(b, "ethash", true) }
+func BenchmarkVerifyProgpow(b *testing.B)         { benchmarkVerify(b, "progpow", false) }
+func BenchmarkVerifyProgpowParallel(b *testing.B) { benchmarkVerify(b, "progpow", true) }
+
+// BenchmarkVerifyEpochSwitch verifies blocks of more epochs than the light
+// registry keeps, so that every lookup misses and builds a cache.
+func BenchmarkVerifyEpochSwitch(b *testing.B) {
+	eth, err := NewForTesting()
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer os.RemoveAll(eth.Full.Dir)
+	SetResultCache(0)
+	defer SetResultCache(resultCacheEntries)
+	var blocks []*testBlock
+	for epoch := uint64(0); epoch < 8; epoch++ {
+		blocks = append(blocks, benchBlock(b, eth, epoch*epochLength, "ethash"))
+	}
+
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		if !eth.Verify(blocks[i%len(blocks)]) {
+			b.Fatal("block could not be verified")
+		}
+	}
+}
+
+func BenchmarkVerifyBatch(b *testing.B) {
+	eth, err := NewForTesting()
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer os.RemoveAll(eth.Full.Dir)
+	blocks := make([]Block, 256)
+	for i := range blocks {
+		blocks[i] = benchBlock(b, eth, 1, "ethash")
+	}
+
+	b.ReportAllocs()
+	b.ResetTimer()
+	start := time.Now()
+	for i := 0; i < b.N; i++ {
+		eth.VerifyBatch(blocks)
+	}
+	b.ReportMetric(float64(b.N*len(blocks))/time.Since(start).Seconds(), "blocks/s")
+}
+
+// BenchmarkHashToH256 measures the copy of every hash handed to the C library
+func BenchmarkHashToH256(b *testing.B) {
+	var hash common.Hash
+	rand.Read(hash[:])
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		hashToH256(hash)
+	}
+}
+
+// BenchmarkFullSearch searches the testing DAG on all hardware threads. Each
+// search needs difficulty hashes on average, dwarfing the polls for the hit.
+func BenchmarkFullSearch(b *testing.B) {
+	eth, err := NewForTesting()
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer os.RemoveAll(eth.Full.Dir)
+	eth.Turbo(true)
+	const difficulty = 1 << 18
+	block := &testBlock{difficulty: big.NewInt(difficulty)}
+	// the DAG is built before the timer starts
+	eth.Search(&testBlock{difficulty: big.NewInt(1)}, nil, 0)
+
+	b.ResetTimer()
+	start := time.Now()
+	for i := 0; i < b.N; i++ {
+		rand.Read(block.hashNoNonce[:])
+		eth.Search(block, nil, 0)
+	}
+	b.ReportMetric(float64(b.N)*difficulty/time.Since(start).Seconds(), "hashes/s")
+}
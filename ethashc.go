@@ -31,22 +31,69 @@ package ethash
 #cgo CFLAGS: -std=gnu99 -Wall
 #cgo windows CFLAGS: -mno-stack-arg-probe
 #cgo LDFLAGS: -lm
+#cgo !windows LDFLAGS: -lpthread
+#cgo linux LDFLAGS: -ldl
 
 #include "src/libethash/internal.c"
 #include "src/libethash/progpow-internal.c"
+#include "src/libethash/cpu_features.c"
+#include "src/libethash/fnv_kernels.c"
+#include "src/libethash/sha3_multi.c"
+#include "src/libethash/progpow_kernels.c"
+#include "src/libethash/progpow_jit.c"
+#include "src/libethash/progpow_source.c"
+#include "src/libethash/dispatch.c"
+#include "src/libethash/epoch_manager.c"
+#include "src/libethash/light_registry.c"
+#include "src/libethash/dag_memo.c"
+#include "src/libethash/dag_dir.c"
+#include "src/libethash/search.c"
+#include "src/libethash/threadpool.c"
+#include "src/libethash/miner.c"
+#include "src/libethash/throttle.c"
+#include "src/libethash/stats.c"
+#include "src/libethash/access_stats.c"
+#include "src/libethash/autotune.c"
+#include "src/libethash/merkle.c"
+#include "src/libethash/sync_verifier.c"
+#include "src/libethash/chain.c"
+#include "src/libethash/keccak_backends.c"
+#include "src/libethash/result_cache.c"
+#include "src/libethash/memory_budget.c"
+#include "src/libethash/header.c"
+#include "src/libethash/trace.c"
+#include "src/libethash/memory_pool.c"
+#include "src/libethash/memory_provider.c"
 #include "src/libethash/sha3.c"
 #include "src/libethash/io.c"
 
 #ifdef _WIN32
 #	include "src/libethash/io_win32.c"
 #	include "src/libethash/mmap_win32.c"
+#	include "src/libethash/threads_win32.c"
+#	include "src/libethash/memory_win32.c"
+#	include "src/libethash/numa_win32.c"
 #else
 #	include "src/libethash/io_posix.c"
+#	include "src/libethash/threads_posix.c"
+#	include "src/libethash/memory_posix.c"
+#	include "src/libethash/numa_posix.c"
 #endif
 
 // 'gateway function' for calling back into go.
 extern int ethashGoCallback(unsigned);
 int ethashGoCallback_cgo(unsigned percent) { return ethashGoCallback(percent); }
+extern void ethashGoEvent(ethash_event_t*);
+void ethashGoEvent_cgo(ethash_event_t const* event, void* user) { (void)user; ethashGoEvent((ethash_event_t*)event); }
+extern void ethashGoSpawn(void*, void*);
+bool ethashGoSpawn_cgo(void* user, void (*task)(void*), void* arg, enum ethash_thread_priority priority)
+{
+	(void)user;
+	(void)priority;
+	ethashGoSpawn((void*)task, arg);
+	return true;
+}
+void ethashGoRunTask_cgo(void* task, void* arg) { ((void (*)(void*))task)(arg); }
 
 */
 import "C"
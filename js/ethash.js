@@ -16,13 +16,14 @@ function mod32(x, n)
 
 function fnv(x, y)
 {
-	// js integer multiply by 0x01000193 will lose precision
-	return ((x*0x01000000 | 0) + (x*0x193 | 0)) ^ y;	
+	// a plain js multiply by 0x01000193 would lose precision
+	return Math.imul(x, 0x01000193) ^ y;
 }
 
-function computeCache(params, seedWords)
+// buffer may be a SharedArrayBuffer, so that workers can hash with the cache
+function computeCache(params, seedWords, buffer)
 {
-	var cache = new Uint32Array(params.cacheSize >> 2);
+	var cache = buffer ? new Uint32Array(buffer, 0, params.cacheSize >> 2) : new Uint32Array(params.cacheSize >> 2);
 	var cacheNodeCount = params.cacheSize >> 6;
 
 	// Initialize cache
@@ -137,11 +138,22 @@ exports.defaultParams = function()
 	};
 };
 
-exports.Ethash = function(params, seed)
+// Fills buffer, an ArrayBuffer or SharedArrayBuffer of at least
+// params.cacheSize bytes, with the cache of seed
+exports.computeCache = function(params, seed, buffer)
+{
+	computeCache(params, convertSeed(seed), buffer);
+};
+
+// If cache (a Uint32Array, e.g. over the SharedArrayBuffer filled by
+// computeCache) is given, the cache is not computed again from seed
+exports.Ethash = function(params, seed, cache)
 {
 	// precompute cache and related values
-	seed = convertSeed(seed);
-	var cache = computeCache(params, seed);
+	if (!cache)
+	{
+		cache = computeCache(params, convertSeed(seed));
+	}
 	
 	// preallocate buffers/etc
 	var initBuf = new ArrayBuffer(96);
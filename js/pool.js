@@ -0,0 +1,107 @@
+// pool.js
+// Spreads light hashing over Web Workers (or node worker threads) sharing one cache
+
+/*jslint node: true, shadow:true */
+"use strict";
+
+function spawn(script)
+{
+	if (typeof Worker !== 'undefined')
+	{
+		var worker = new Worker(script);
+		return {
+			post: function(msg) { worker.postMessage(msg); },
+			listen: function(fn) { worker.onmessage = function(e) { fn(e.data); }; },
+			terminate: function() { worker.terminate(); }
+		};
+	}
+	var worker = new (require('worker_threads').Worker)(script);
+	return {
+		post: function(msg) { worker.postMessage(msg); },
+		listen: function(fn) { worker.on('message', fn); },
+		terminate: function() { worker.terminate(); }
+	};
+}
+
+function defaultWorkerCount()
+{
+	if (typeof navigator !== 'undefined' && navigator.hardwareConcurrency)
+	{
+		return navigator.hardwareConcurrency;
+	}
+	return require('os').cpus().length;
+}
+
+// The cache is computed once, off the calling thread, into a SharedArrayBuffer
+// that all the workers hash with. Computing the cache itself is sequential by
+// construction (every node depends on the previous one), so it is not split.
+//
+// options.workers: number of workers, by default one per hardware thread
+// options.workerUrl: the script of the workers in a browser, by default 'worker.js'
+exports.EthashPool = function(params, seed, options)
+{
+	options = options || {};
+	var count = options.workers || defaultWorkerCount();
+	var script = options.workerUrl || (typeof __dirname !== 'undefined' ? require('path').join(__dirname, 'worker.js') : 'worker.js');
+	var buffer = new SharedArrayBuffer(params.cacheSize);
+	var workers = [];
+	var pending = {};
+	var nextId = 0;
+
+	function call(worker, msg)
+	{
+		return new Promise(function(resolve) {
+			msg.id = nextId++;
+			pending[msg.id] = resolve;
+			worker.post(msg);
+		});
+	}
+
+	function receive(msg)
+	{
+		var resolve = pending[msg.id];
+		delete pending[msg.id];
+		resolve(msg);
+	}
+
+	for (var i = 0; i < count; ++i)
+	{
+		var worker = spawn(script);
+		worker.listen(receive);
+		workers.push(worker);
+	}
+
+	// resolves once the cache is built and every worker uses it
+	this.ready = call(workers[0], { type: 'cache', params: params, seed: seed, buffer: buffer }).then(function() {
+		return Promise.all(workers.map(function(worker) {
+			return call(worker, { type: 'init', params: params, buffer: buffer });
+		}));
+	});
+
+	// resolves to the hashes (Uint8Arrays of 32 bytes) of header with each
+	// of nonces (Uint8Arrays of 8 bytes), split evenly between the workers
+	this.hash = function(header, nonces)
+	{
+		var per = Math.ceil(nonces.length / workers.length);
+		var jobs = [];
+		for (var w = 0; w * per < nonces.length; ++w)
+		{
+			jobs.push(call(workers[w], { type: 'hash', header: header, nonces: nonces.slice(w * per, (w + 1) * per) }));
+		}
+		return Promise.all(jobs).then(function(replies) {
+			var hashes = [];
+			replies.forEach(function(reply) {
+				for (var i = 0; i < reply.hashes.length; i += 32)
+				{
+					hashes.push(reply.hashes.subarray(i, i + 32));
+				}
+			});
+			return hashes;
+		});
+	};
+
+	this.terminate = function()
+	{
+		workers.forEach(function(worker) { worker.terminate(); });
+	};
+};
@@ -51,3 +51,32 @@ for (var i = 0; i < trials; ++i)
 }
 console.log("Light client hashes averaged: " + (new Date().getTime() - startTime)/trials + "ms");
 console.log("Hash = " + util.bytesToHexString(hash));
+
+// benchmark the worker pool against the single threaded hasher
+var EthashPool = require('./pool').EthashPool;
+var batch = 64;
+var nonces = [];
+for (var i = 0; i < batch; ++i)
+{
+	nonces.push(util.hexStringToBytes(util.uint32ToHexString(i) + "00000000"));
+}
+startTime = new Date().getTime();
+var expected = nonces.map(function(n) { return util.bytesToHexString(hasher.hash(header, n)); });
+var singleMs = new Date().getTime() - startTime;
+console.log("Single thread: " + (batch * 1000 / singleMs).toFixed(1) + " hashes/s");
+
+startTime = new Date().getTime();
+var pool = new EthashPool(ethashParams, seed);
+pool.ready.then(function() {
+	console.log("Pool startup took: " + (new Date().getTime() - startTime) + "ms");
+	startTime = new Date().getTime();
+	return pool.hash(header, nonces);
+}).then(function(hashes) {
+	var poolMs = new Date().getTime() - startTime;
+	console.log("Pool: " + (batch * 1000 / poolMs).toFixed(1) + " hashes/s");
+	for (var i = 0; i < batch; ++i)
+	{
+		if (util.bytesToHexString(hashes[i]) != expected[i]) throw Error("Pool hash " + i + " differs");
+	}
+	pool.terminate();
+});
@@ -0,0 +1,47 @@
+// worker.js
+// Runs an Ethash hasher of an EthashPool in a Web Worker or node worker thread
+
+/*jslint node: true, shadow:true */
+"use strict";
+
+var ethash = require('./ethash');
+
+var hasher = null;
+
+function handle(msg, reply)
+{
+	if (msg.type === 'cache')
+	{
+		// the cache is only computed by one worker, the others share it
+		ethash.computeCache(msg.params, msg.seed, msg.buffer);
+		reply({ id: msg.id });
+	}
+	else if (msg.type === 'init')
+	{
+		hasher = new ethash.Ethash(msg.params, null, new Uint32Array(msg.buffer, 0, msg.params.cacheSize >> 2));
+		reply({ id: msg.id });
+	}
+	else if (msg.type === 'hash')
+	{
+		var hashes = new Uint8Array(msg.nonces.length * 32);
+		for (var i = 0; i < msg.nonces.length; ++i)
+		{
+			hashes.set(hasher.hash(msg.header, msg.nonces[i]), i * 32);
+		}
+		reply({ id: msg.id, hashes: hashes }, [hashes.buffer]);
+	}
+}
+
+if (typeof self !== 'undefined' && typeof self.postMessage === 'function')
+{
+	self.onmessage = function(e) {
+		handle(e.data, function(data, transfer) { self.postMessage(data, transfer); });
+	};
+}
+else
+{
+	var parentPort = require('worker_threads').parentPort;
+	parentPort.on('message', function(msg) {
+		handle(msg, function(data, transfer) { parentPort.postMessage(data, transfer); });
+	});
+}
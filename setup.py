@@ -5,32 +5,81 @@ sources = [
     'src/python/core.c',
     'src/libethash/io.c',
     'src/libethash/internal.c',
+    'src/libethash/progpow-internal.c',
+    'src/libethash/cpu_features.c',
+    'src/libethash/fnv_kernels.c',
+    'src/libethash/sha3_multi.c',
+    'src/libethash/progpow_kernels.c',
+    'src/libethash/progpow_jit.c',
+    'src/libethash/progpow_source.c',
+    'src/libethash/dispatch.c',
+    'src/libethash/epoch_manager.c',
+    'src/libethash/light_registry.c',
+    'src/libethash/dag_memo.c',
+    'src/libethash/dag_dir.c',
+    'src/libethash/search.c',
+    'src/libethash/threadpool.c',
+    'src/libethash/miner.c',
+    'src/libethash/throttle.c',
+    'src/libethash/stats.c',
+    'src/libethash/access_stats.c',
+    'src/libethash/autotune.c',
+    'src/libethash/merkle.c',
+    'src/libethash/sync_verifier.c',
+    'src/libethash/chain.c',
+    'src/libethash/keccak_backends.c',
+    'src/libethash/result_cache.c',
+    'src/libethash/memory_budget.c',
+    'src/libethash/header.c',
+    'src/libethash/trace.c',
+    'src/libethash/memory_pool.c',
+    'src/libethash/memory_provider.c',
     'src/libethash/sha3.c']
 if os.name == 'nt':
     sources += [
         'src/libethash/util_win32.c',
         'src/libethash/io_win32.c',
         'src/libethash/mmap_win32.c',
+        'src/libethash/threads_win32.c',
+        'src/libethash/memory_win32.c',
+        'src/libethash/numa_win32.c',
     ]
 else:
     sources += [
-        'src/libethash/io_posix.c'
+        'src/libethash/io_posix.c',
+        'src/libethash/threads_posix.c',
+        'src/libethash/memory_posix.c',
+        'src/libethash/numa_posix.c',
     ]
 depends = [
     'src/libethash/ethash.h',
     'src/libethash/compiler.h',
+    'src/libethash/cpu_features.h',
     'src/libethash/data_sizes.h',
+    'src/libethash/dispatch.h',
     'src/libethash/endian.h',
     'src/libethash/ethash.h',
     'src/libethash/io.h',
+    'src/libethash/memory.h',
+    'src/libethash/numa.h',
+    'src/libethash/fastmod.h',
     'src/libethash/fnv.h',
+    'src/libethash/fnv_kernels.h',
     'src/libethash/internal.h',
     'src/libethash/sha3.h',
+    'src/libethash/sha3_multi.h',
+    'src/libethash/stats.h',
+    'src/libethash/trace.h',
+    'src/libethash/keccak_unrolled.h',
+    'src/libethash/progpow_kernels.h',
+    'src/libethash/progpow_jit.h',
+    'src/libethash/threads.h',
     'src/libethash/util.h',
 ]
 pyethash = Extension('pyethash',
                      sources=sources,
                      depends=depends,
+                     libraries=[] if os.name == 'nt' else ['dl'],
                      extra_compile_args=["-Isrc/", "-std=gnu99", "-Wall"])
 
 setup(
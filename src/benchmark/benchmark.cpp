@@ -17,262 +17,937 @@
 /** @file benchmark.cpp
  * @author Tim Hughes <tim@twistedfury.com>
  * @date 2015
+ *
+ * Measures building the light cache and the DAG, and the light and full hash
+ * rates of Ethash and ProgPoW, for a set of epochs and thread counts. Run with
+ * --help for the options. The full hashes are timed one nonce at a time, in
+ * batches of ETHASH_HASH_BATCH nonces and with the templates of ethash.hpp.
+ *
+ * The results can be written as JSON or CSV records, and compared against the
+ * CSV records of an earlier run to catch regressions.
+ *
+ * With --kernels it also times the primitive kernels one call at a time, with
+ * warm caches and right after evicting them, for every implementation the
+ * host supports.
+ *
+ * With --scaling it runs growing numbers of threads, each pinned to its own
+ * logical processor, against one shared DAG and reports the DAG bandwidth they
+ * reach, to show where hashing becomes bound by memory bandwidth.
+ *
+ * With --jit the ProgPoW hashes use the code generated for each period
+ * instead of the progpow_loop kernel. --no-prefetch turns the DAG prefetches
+ * of the full hashes off, to measure what they gain.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <chrono>
-#include <libethash/ethash.h>
-#include <libethash/util.h>
-#ifdef OPENCL
-#include <libethash-cl/ethash_cl_miner.h>
-#endif
+#include <thread>
 #include <vector>
+#include <string>
+#include <map>
+#include <fstream>
+#include <sstream>
 #include <algorithm>
-
+#include <libethash/ethash.h>
+#include <libethash/ethash.hpp>
+#include <libethash/internal.h>
+#include <libethash/threads.h>
+#include <libethash/dispatch.h>
+#include <libethash/progpow_jit.h>
 #ifdef WITH_CRYPTOPP
 #include <libethash/sha3_cryptopp.h>
-#include <string>
-
 #else
-#include "libethash/sha3.h"
-#endif // WITH_CRYPTOPP
+#include <libethash/sha3.h>
+#endif
 
 #undef min
 #undef max
 
-using std::chrono::high_resolution_clock;
+using std::chrono::steady_clock;
 
-#if defined(OPENCL)
-const unsigned trials = 1024*1024*32;
-#elif defined(FULL)
-const unsigned trials = 1024*1024/8;
-#else
-const unsigned trials = 1024*1024/1024;
-#endif
-uint8_t g_hashes[1024*32];
+namespace
+{
 
-static char nibbleToChar(unsigned nibble)
+enum algorithm { ALGO_ETHASH, ALGO_PROGPOW };
+
+struct options
 {
-	return (char) ((nibble >= 10 ? 'a'-10 : '0') + nibble);
-}
+	std::vector<uint64_t> epochs = {0};
+	std::vector<unsigned> threads = {1};
+	std::vector<algorithm> algorithms = {ALGO_ETHASH, ALGO_PROGPOW};
+	unsigned light_hashes = 200;     ///< per thread
+	unsigned full_hashes = 20000;    ///< per thread
+	uint64_t cache_size = 0;         ///< 0 for the size of the epoch
+	uint64_t full_size = 0;          ///< 0 for the size of the epoch
+	bool light = true;
+	bool full = true;
+	bool kernels = false;
+	bool scaling = false;
+	bool jit = false;                ///< use the generated ProgPoW code
+	bool prefetch = true;            ///< prefetch the DAG in full hashes
+	unsigned kernel_calls = 100000;  ///< warm calls per kernel
+	unsigned cold_calls = 200;       ///< calls per kernel after evicting the caches
+	std::string json_path;           ///< write the records as JSON here
+	std::string csv_path;            ///< write the records as CSV here
+	std::string baseline_path;       ///< CSV records to compare against
+	double threshold = 5;            ///< slowdown in percent that fails the comparison
+};
+
+/// Latencies of single hashes, in nanoseconds, and the wall time of the run
+struct run_result
+{
+	std::vector<uint64_t> latencies;
+	std::vector<double> thread_seconds;
+	double seconds = 0;
+};
 
-static uint8_t charToNibble(char chr)
+/// One result, as written by --json and --csv and read back by --baseline
+struct record
 {
-	if (chr >= '0' && chr <= '9')
+	uint64_t epoch = 0;
+	std::string algorithm;
+	std::string mode;                ///< cache, dag, light, full, batch or tmpl
+	unsigned threads = 1;
+	std::string kernel;              ///< the implementations of the kernels involved
+	double hashes_per_second = 0;
+	double bytes_per_second = 0;
+	double p50_us = 0;
+	double p99_us = 0;
+
+	bool is_build() const { return mode == "cache" || mode == "dag"; }
+	bool is_kernel() const { return mode == "warm" || mode == "cold"; }
+	/// What a comparison looks at, higher is better
+	double score() const { return is_build() ? bytes_per_second : hashes_per_second; }
+	std::string key() const
 	{
-		return (uint8_t) (chr - '0');
+		return algorithm + " " + mode + " epoch " + std::to_string(epoch) + " threads " + std::to_string(threads) +
+			(is_kernel() ? " " + kernel : "");
 	}
-	if (chr >= 'a' && chr <= 'z')
-	{
-		return (uint8_t) (chr - 'a' + 10);
-	}
-	if (chr >= 'A' && chr <= 'Z')
-	{
-		return (uint8_t) (chr - 'A' + 10);
+};
+
+std::vector<record> g_records;
+bool g_jit = false;
+
+double seconds_since(steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(steady_clock::now() - start).count();
+}
+
+ethash_h256_t header_hash()
+{
+	ethash_h256_t hash;
+	for (unsigned i = 0; i != sizeof(hash.b); ++i) {
+		hash.b[i] = (uint8_t)(i * 7 + 1);
 	}
-	return 0;
+	return hash;
 }
 
-static std::vector<uint8_t> hexStringToBytes(char const* str)
+std::string algorithm_name(algorithm algo)
 {
-	std::vector<uint8_t> bytes(strlen(str) >> 1);
-	for (unsigned i = 0; i != bytes.size(); ++i)
-	{
-		bytes[i] = charToNibble(str[i*2 | 0]) << 4;
-		bytes[i] |= charToNibble(str[i*2 | 1]);
+	return algo == ALGO_ETHASH ? "ethash" : "progpow";
+}
+
+std::string kernel_name(std::string const& mode, algorithm algo)
+{
+	ethash_kernels_t const* k = ethash_kernels();
+	if (mode == "cache") {
+		return k->keccakf1600->name;
+	}
+	if (mode == "dag") {
+		return std::string(k->sha3_multi->name) + "+" + k->fnv->name;
 	}
-	return bytes;
+	std::string const prefetch = mode != "light" && !ethash_get_prefetch() ? "+noprefetch" : "";
+	if (mode == "tmpl") {
+		return "ethash.hpp" + prefetch;
+	}
+	if (algo == ALGO_ETHASH) {
+		return std::string(k->keccakf1600->name) + "+" + k->fnv->name + prefetch;
+	}
+	return std::string(k->keccakf800->name) + "+" + (g_jit ? "jit" : k->progpow_loop->name) + prefetch;
 }
 
-static std::string bytesToHexString(uint8_t const* bytes, unsigned size)
+void add_build_record(char const* mode, uint64_t epoch, unsigned num_threads, uint64_t size, double seconds)
 {
-	std::string str;
-	for (unsigned i = 0; i != size; ++i)
-	{
-		str += nibbleToChar(bytes[i] >> 4);
-		str += nibbleToChar(bytes[i] & 0xf);
+	record r;
+	r.epoch = epoch;
+	r.algorithm = algorithm_name(ALGO_ETHASH);
+	r.mode = mode;
+	r.threads = num_threads;
+	r.kernel = kernel_name(mode, ALGO_ETHASH);
+	r.bytes_per_second = (double)size / seconds;
+	g_records.push_back(r);
+}
+
+// Hash @a hashes nonces on each of @a num_threads threads with @a fn(nonce).
+// With @a pin every thread is pinned to its own logical processor, and the
+// calling thread only waits.
+template <typename Fn>
+run_result run_hashes(unsigned num_threads, unsigned hashes, Fn fn, bool pin = false)
+{
+	std::vector<std::vector<uint64_t>> latencies(num_threads);
+	std::vector<double> thread_seconds(num_threads);
+	unsigned const cpus = ethash_hardware_concurrency();
+	auto worker = [&](unsigned t) {
+		if (pin && !ethash_thread_pin(t % cpus)) {
+			fprintf(stderr, "could not pin thread %u\n", t);
+		}
+		auto const thread_start = steady_clock::now();
+		latencies[t].reserve(hashes);
+		uint64_t const first = (uint64_t)t << 32;
+		for (uint64_t nonce = first; nonce != first + hashes; ++nonce) {
+			auto const start = steady_clock::now();
+			fn(nonce);
+			latencies[t].push_back((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				steady_clock::now() - start).count());
+		}
+		thread_seconds[t] = seconds_since(thread_start);
+	};
+	auto const start = steady_clock::now();
+	std::vector<std::thread> threads;
+	for (unsigned t = pin ? 0 : 1; t < num_threads; ++t) {
+		threads.emplace_back(worker, t);
+	}
+	if (!pin) {
+		worker(0);
+	}
+	for (auto& thread: threads) {
+		thread.join();
 	}
-	return str;
+	run_result result;
+	result.seconds = seconds_since(start);
+	result.thread_seconds = thread_seconds;
+	for (auto const& l: latencies) {
+		result.latencies.insert(result.latencies.end(), l.begin(), l.end());
+	}
+	std::sort(result.latencies.begin(), result.latencies.end());
+	return result;
 }
 
-static std::string bytesToHexString(ethash_h256_t const *hash, unsigned size)
+double percentile_us(std::vector<uint64_t> const& sorted, double p)
 {
-	return bytesToHexString((uint8_t*)hash, size);
+	if (sorted.empty()) {
+		return 0;
+	}
+	size_t const i = std::min(sorted.size() - 1, (size_t)(p / 100 * (double)sorted.size()));
+	return (double)sorted[i] / 1000;
 }
 
-extern "C" int main(void)
-{
-	// params for ethash
-	ethash_params params;
-	ethash_params_init(&params, 0);
-	//params.full_size = 262147 * 4096;	// 1GBish;
-	//params.full_size = 32771 * 4096;	// 128MBish;
-	//params.full_size = 8209 * 4096;	// 8MBish;
-	//params.cache_size = 8209*4096;
-	//params.cache_size = 2053*4096;
-	ethash_h256_t seed;
-	ethash_h256_t previous_hash;
-
-	memcpy(&seed, hexStringToBytes("9410b944535a83d9adf6bbdcc80e051f30676173c16ca0d32d6f1263fc246466").data(), 32);
-	memcpy(&previous_hash, hexStringToBytes("c5d2460186f7233c927e7db2dcc703c0e500b653ca82273b7bfad8045d85a470").data(), 32);
-
-	// allocate page aligned buffer for dataset
-#ifdef FULL
-	void* full_mem_buf = malloc(params.full_size + 4095);
-	void* full_mem = (void*)((uintptr_t(full_mem_buf) + 4095) & ~4095);
-#endif
-	void* cache_mem_buf = malloc(params.cache_size + 63);
-	void* cache_mem = (void*)((uintptr_t(cache_mem_buf) + 63) & ~63);
+// @a hashes_per_call is the number of hashes of one timed call, the
+// latencies are those of whole calls
+void report_hashes(
+	char const* what, algorithm algo, uint64_t epoch, unsigned num_threads, run_result const& r,
+	unsigned hashes_per_call = 1
+)
+{
+	double const hashes_per_second = (double)r.latencies.size() * hashes_per_call / r.seconds;
+	printf(
+		"%-7s %-5s epoch %4llu threads %3u: %12.1f H/s  p50 %9.1fus  p90 %9.1fus  p99 %9.1fus  max %9.1fus\n",
+		algorithm_name(algo).c_str(), what, (unsigned long long)epoch, num_threads,
+		hashes_per_second,
+		percentile_us(r.latencies, 50), percentile_us(r.latencies, 90),
+		percentile_us(r.latencies, 99), percentile_us(r.latencies, 100)
+	);
+	record rec;
+	rec.epoch = epoch;
+	rec.algorithm = algorithm_name(algo);
+	rec.mode = what;
+	rec.threads = num_threads;
+	rec.kernel = kernel_name(what, algo);
+	rec.hashes_per_second = hashes_per_second;
+	rec.p50_us = percentile_us(r.latencies, 50);
+	rec.p99_us = percentile_us(r.latencies, 99);
+	g_records.push_back(rec);
+}
 
-	ethash_cache cache;
-	cache.mem = cache_mem;
+ethash_return_value_t light_hash(algorithm algo, ethash_light_t light, uint64_t full_size, uint64_t block, uint64_t nonce)
+{
+	return algo == ALGO_ETHASH ?
+		ethash_light_compute_internal(light, full_size, header_hash(), nonce) :
+		progpow_light_compute_internal(light, full_size, header_hash(), nonce, block);
+}
 
-	// compute cache or full data
-	{
-		auto startTime = high_resolution_clock::now();
-		ethash_mkcache(&cache, &params, &seed);
-		auto time = std::chrono::duration_cast<std::chrono::milliseconds>(high_resolution_clock::now() - startTime).count();
-
-		ethash_h256_t cache_hash;
-		SHA3_256(&cache_hash, (uint8_t const*)cache_mem, params.cache_size);
-		debugf("ethash_mkcache: %ums, sha3: %s\n", (unsigned)((time*1000)/CLOCKS_PER_SEC), bytesToHexString(&cache_hash, sizeof(cache_hash)).data());
-
-		// print a couple of test hashes
-		{
-			auto startTime = high_resolution_clock::now();
-			ethash_return_value hash;
-			ethash_light(&hash, &cache, &params, &previous_hash, 0);
-			auto time = std::chrono::duration_cast<std::chrono::milliseconds>(high_resolution_clock::now() - startTime).count();
-			debugf("ethash_light test: %ums, %s\n", (unsigned)time, bytesToHexString(&hash.result, 32).data());
-		}
+ethash_return_value_t full_hash(algorithm algo, ethash_full_t full, uint64_t block, uint64_t nonce)
+{
+	return algo == ALGO_ETHASH ?
+		ethash_full_compute(full, header_hash(), nonce) :
+		progpow_full_compute(full, header_hash(), nonce, block);
+}
 
-		#ifdef FULL
-			startTime = high_resolution_clock::now();
-			ethash_compute_full_data(full_mem, &params, &cache);
-			time = std::chrono::duration_cast<std::chrono::milliseconds>(high_resolution_clock::now() - startTime).count();
-			debugf("ethash_compute_full_data: %ums\n", (unsigned)time);
-		#endif // FULL
+// Hash the ETHASH_HASH_BATCH nonces from @a first in one batch
+void full_hash_batch(algorithm algo, ethash_full_t full, uint64_t block, uint64_t first)
+{
+	uint64_t nonces[ETHASH_HASH_BATCH];
+	ethash_return_value_t results[ETHASH_HASH_BATCH];
+	for (unsigned k = 0; k != ETHASH_HASH_BATCH; ++k) {
+		nonces[k] = first + k;
+	}
+	if (algo == ALGO_ETHASH) {
+		ethash_full_compute_batch(full, header_hash(), nonces, results, ETHASH_HASH_BATCH);
+	} else {
+		progpow_full_compute_batch(full, header_hash(), nonces, results, ETHASH_HASH_BATCH, block);
 	}
+}
 
-#ifdef OPENCL
-	ethash_cl_miner miner;
-	{
-		auto startTime = high_resolution_clock::now();
-		if (!miner.init(params, &seed))
-			exit(-1);
-		auto time = std::chrono::duration_cast<std::chrono::milliseconds>(high_resolution_clock::now() - startTime).count();
-		debugf("ethash_cl_miner init: %ums\n", (unsigned)time);
+// A full hash with the templates of ethash.hpp and the default parameters
+ethash_return_value_t full_hash_templated(algorithm algo, ethash_full_t full, uint64_t block, uint64_t nonce)
+{
+	node const* const dag = ethash_full_local_data(full);
+	if (algo == ALGO_ETHASH) {
+		return ethash::ethash_hasher<ethash::ethash_default>(NULL, dag, full->file_size)(header_hash(), nonce);
 	}
-#endif
+	return ethash::progpow_hasher<ethash::progpow_default>(NULL, dag, full->file_size)(header_hash(), nonce, block);
+}
 
+// DAG bytes read by one hash
+uint64_t dag_bytes_per_hash(algorithm algo)
+{
+	return algo == ALGO_ETHASH ?
+		(uint64_t)ETHASH_ACCESSES * ETHASH_MIX_BYTES :
+		(uint64_t)PROGPOW_CNT_DAG * PROGPOW_MIX_BYTES;
+}
 
-#ifdef FULL
-	{
-		auto startTime = high_resolution_clock::now();
-		ethash_return_value hash;
-		ethash_full(&hash, full_mem, &params, &previous_hash, 0);
-		auto time = std::chrono::duration_cast<std::chrono::milliseconds>(high_resolution_clock::now() - startTime).count();
-		debugf("ethash_full test: %uns\n", (unsigned)time);
+// Thread counts of --scaling: the ones asked for, or powers of two up to all
+// hardware threads
+std::vector<unsigned> scaling_threads(options const& opts)
+{
+	std::vector<unsigned> counts = opts.threads;
+	if (counts.size() == 1) {
+		counts.clear();
+		unsigned const cpus = ethash_hardware_concurrency();
+		for (unsigned t = 1; t < cpus; t *= 2) {
+			counts.push_back(t);
+		}
+		counts.push_back(cpus);
 	}
-#endif
+	std::sort(counts.begin(), counts.end());
+	counts.erase(std::unique(counts.begin(), counts.end()), counts.end());
+	return counts;
+}
 
-#ifdef OPENCL
-	// validate 1024 hashes against CPU
-	miner.hash(g_hashes, (uint8_t*)&previous_hash, 0, 1024);
-	for (unsigned i = 0; i != 1024; ++i)
-	{
-		ethash_return_value hash;
-		ethash_light(&hash, &cache, &params, &previous_hash, i);
-		if (memcmp(&hash.result, g_hashes + 32*i, 32) != 0)
-		{
-			debugf("nonce %u failed: %s %s\n", i, bytesToHexString(g_hashes + 32*i, 32).c_str(), bytesToHexString(&hash.result, 32).c_str());
-			static unsigned c = 0;
-			if (++c == 16)
-			{
-				exit(-1);
+// Pinned threads hashing against one shared DAG. Reports the rate of every
+// count of threads, and the first count from which the added threads gain
+// less than a quarter of what the earlier ones did on average, i.e. where the
+// DAG bandwidth stops growing.
+void bench_scaling(options const& opts, uint64_t epoch, algorithm algo, ethash_full_t full, uint64_t block)
+{
+	uint64_t const bytes_per_hash = dag_bytes_per_hash(algo);
+	unsigned prev_threads = 0;
+	double prev_total = 0;
+	unsigned plateau = 0;
+	for (unsigned t: scaling_threads(opts)) {
+		run_result const r = run_hashes(t, opts.full_hashes, [&](uint64_t nonce) {
+			full_hash(algo, full, block, nonce);
+		}, true);
+		double const total = (double)r.latencies.size() / r.seconds;
+		double slowest = 0;
+		for (double seconds: r.thread_seconds) {
+			slowest = std::max(slowest, seconds);
+		}
+		double const per_thread = (double)opts.full_hashes / slowest;
+		double const bandwidth = total * (double)bytes_per_hash;
+		if (prev_threads && !plateau) {
+			double const gained = (total - prev_total) / (double)(t - prev_threads);
+			if (gained < prev_total / (double)prev_threads / 4) {
+				plateau = t;
 			}
 		}
+		printf(
+			"%-7s scaling epoch %4llu threads %3u: %12.1f H/s  %10.1f H/s per thread  %9.2f GB/s of DAG\n",
+			algorithm_name(algo).c_str(), (unsigned long long)epoch, t, total, per_thread, bandwidth / 1e9
+		);
+		record rec;
+		rec.epoch = epoch;
+		rec.algorithm = algorithm_name(algo);
+		rec.mode = "scaling";
+		rec.threads = t;
+		rec.kernel = kernel_name("full", algo);
+		rec.hashes_per_second = total;
+		rec.bytes_per_second = bandwidth;
+		rec.p50_us = percentile_us(r.latencies, 50);
+		rec.p99_us = percentile_us(r.latencies, 99);
+		g_records.push_back(rec);
+		prev_threads = t;
+		prev_total = total;
 	}
+	unsigned const cpus = ethash_hardware_concurrency();
+	if (plateau) {
+		printf("%-7s scaling epoch %4llu: plateau from %u threads%s\n",
+			algorithm_name(algo).c_str(), (unsigned long long)epoch, plateau,
+			plateau > cpus ? ", past the hardware threads" : ", memory bound");
+	} else {
+		printf("%-7s scaling epoch %4llu: no plateau up to %u threads\n",
+			algorithm_name(algo).c_str(), (unsigned long long)epoch, prev_threads);
+	}
+}
 
-	// ensure nothing else is going on
-	miner.finish();
-#endif
+// Keeps the results of the timed kernels alive
+uint64_t volatile g_sink;
 
-	auto startTime = high_resolution_clock::now();
-	unsigned hash_count = trials;
+// Larger than any last level cache, read through to evict the kernel's data
+size_t const evict_bytes = (size_t)64 << 20;
+std::vector<uint8_t> g_evict;
 
-	#ifdef OPENCL
-	{
-		struct search_hook : ethash_cl_miner::search_hook
-		{
-			unsigned hash_count;
-			std::vector<uint64_t> nonce_vec;
-
-			virtual bool found(uint64_t const* nonces, uint32_t count)
-			{
-				nonce_vec.insert(nonce_vec.end(), nonces, nonces + count);
-				return false;
+void evict_caches()
+{
+	uint64_t sum = 0;
+	for (size_t i = 0; i < g_evict.size(); i += 64) {
+		sum += g_evict[i];
+	}
+	g_sink = sum;
+}
+
+// Time @a fn(i) with warm caches, in batches of 64 calls, and then one call at
+// a time right after evicting the caches. Warm calls get i = 0 or 1 so the
+// kernel keeps touching the same data, cold ones a fresh pseudo random i.
+template <typename Fn>
+void bench_kernel(
+	options const& opts,
+	uint64_t epoch,
+	std::string const& name,
+	std::string const& implementation,
+	Fn fn
+)
+{
+	unsigned const batch = 64;
+	for (unsigned i = 0; i != batch; ++i) {
+		fn(i & 1);
+	}
+	run_result warm;
+	auto start = steady_clock::now();
+	for (unsigned done = 0; done < opts.kernel_calls; done += batch) {
+		auto const batch_start = steady_clock::now();
+		for (unsigned i = 0; i != batch; ++i) {
+			fn(i & 1);
+		}
+		warm.latencies.push_back((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			steady_clock::now() - batch_start).count() / batch);
+	}
+	warm.seconds = seconds_since(start);
+	std::sort(warm.latencies.begin(), warm.latencies.end());
+
+	run_result cold;
+	for (unsigned i = 0; i != opts.cold_calls; ++i) {
+		evict_caches();
+		start = steady_clock::now();
+		fn((i + 1) * 2654435761U);
+		cold.latencies.push_back((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			steady_clock::now() - start).count());
+		cold.seconds += seconds_since(start);
+	}
+	std::sort(cold.latencies.begin(), cold.latencies.end());
+
+	double const warm_calls = (double)warm.latencies.size() * batch;
+	printf(
+		"kernel  %-22s %-9s epoch %4llu: warm %10.1f ns  p99 %10.1f ns   cold p50 %10.1f ns  p99 %10.1f ns\n",
+		name.c_str(), implementation.c_str(), (unsigned long long)epoch,
+		warm.seconds * 1e9 / warm_calls, percentile_us(warm.latencies, 99) * 1000,
+		percentile_us(cold.latencies, 50) * 1000, percentile_us(cold.latencies, 99) * 1000
+	);
+	record r;
+	r.epoch = epoch;
+	r.algorithm = name;
+	r.kernel = implementation;
+	r.mode = "warm";
+	r.hashes_per_second = warm_calls / warm.seconds;
+	r.p50_us = percentile_us(warm.latencies, 50);
+	r.p99_us = percentile_us(warm.latencies, 99);
+	g_records.push_back(r);
+	r.mode = "cold";
+	r.hashes_per_second = (double)cold.latencies.size() / cold.seconds;
+	r.p50_us = percentile_us(cold.latencies, 50);
+	r.p99_us = percentile_us(cold.latencies, 99);
+	g_records.push_back(r);
+}
+
+// Micro-benchmarks of the primitive kernels on the data of one epoch
+bool bench_kernels(options const& opts, uint64_t epoch, ethash_light_t light)
+{
+	if (!light->progpow_cache && !progpow_light_compute_cache(light)) {
+		fprintf(stderr, "could not build the ProgPoW cache of epoch %llu\n", (unsigned long long)epoch);
+		return false;
+	}
+	if (g_evict.empty()) {
+		g_evict.resize(evict_bytes);
+		for (size_t i = 0; i < g_evict.size(); ++i) {
+			g_evict[i] = (uint8_t)(i * 2654435761U >> 24);
+		}
+	}
+	ethash_kernels_t const* selected = ethash_kernels();
+	std::string const sha3_name = selected->keccakf1600->name;
+
+	uint64_t state1600[25] = {0};
+	ethash_keccakf1600_kernel_t const* k1600;
+	for (unsigned k = 0; (k1600 = ethash_keccakf1600_kernel_at(k)); ++k) {
+		if (k1600->permute) {
+			bench_kernel(opts, epoch, "keccakf1600", k1600->name, [&](uint32_t i) {
+				state1600[0] ^= i;
+				k1600->permute(state1600);
+			});
+		}
+	}
+	g_sink = state1600[0];
+
+	uint8_t input[96] = {0};
+	uint8_t output[64];
+	bench_kernel(opts, epoch, "sha3_512_64", sha3_name, [&](uint32_t i) {
+		input[0] = (uint8_t)i;
+		SHA3_512(output, input, 64);
+	});
+	bench_kernel(opts, epoch, "sha3_256_96", sha3_name, [&](uint32_t i) {
+		input[0] = (uint8_t)i;
+		SHA3_256((ethash_h256_t const*)output, input, 96);
+	});
+
+	uint32_t state800[25] = {0};
+	ethash_keccakf800_kernel_t const* k800;
+	for (unsigned k = 0; (k800 = ethash_keccakf800_kernel_at(k)); ++k) {
+		bench_kernel(opts, epoch, "keccakf800", k800->name, [&](uint32_t i) {
+			state800[0] ^= i;
+			k800->permute(state800);
+		});
+	}
+	g_sink = state800[0];
+
+	// one call permutes a whole batch of states, reported per batch
+	uint32_t states800[ETHASH_HASH_BATCH][25] = {{0}};
+	ethash_keccakf800_multi_kernel_t const* k800m;
+	for (unsigned k = 0; (k800m = ethash_keccakf800_multi_kernel_at(k)); ++k) {
+		bench_kernel(opts, epoch, "keccakf800_x" + std::to_string(ETHASH_HASH_BATCH), k800m->name, [&](uint32_t i) {
+			states800[0][0] ^= i;
+			k800m->permute(states800, ETHASH_HASH_BATCH);
+		});
+	}
+	g_sink = states800[0][0];
+
+	hash32_t header;
+	hash32_t digest;
+	memset(&header, 0, sizeof(header));
+	memset(&digest, 0, sizeof(digest));
+	bench_kernel(opts, epoch, "keccak_f800_progpow", selected->keccakf800->name, [&](uint32_t i) {
+		header.uint32s[0] = keccak_f800_progpow(header, i, digest).uint32s[0];
+	});
+
+	uint32_t const num_nodes = (uint32_t)(ethash_get_datasize(light->block_number) / sizeof(node));
+	node item;
+	bench_kernel(opts, epoch, "calculate_dag_item", sha3_name + "+" + selected->fnv->name, [&](uint32_t i) {
+		ethash_calculate_dag_item(&item, i % num_nodes, light);
+	});
+	g_sink = item.words[0];
+
+	uint32_t a = 1;
+	uint32_t sel = 0;
+	bench_kernel(opts, epoch, "progpowMath", "generic", [&](uint32_t i) {
+		a = progpowMath(a, i ^ 0x9e3779b9U, sel++);
+	});
+	bench_kernel(opts, epoch, "merge", "generic", [&](uint32_t i) {
+		merge(&a, i ^ 0x9e3779b9U, sel++);
+	});
+	g_sink = a;
+
+	// a synthetic DAG the size of the eviction buffer, the values do not matter
+	progpow_program_t const* prog = progpow_program_get(light->block_number / PROGPOW_PERIOD);
+	uint32_t const* g_dag = (uint32_t const*)g_evict.data();
+	ethash_fastmod_t const dag_entries = progpow_dag_entries(g_evict.size());
+	uint32_t mix[PROGPOW_LANES][PROGPOW_REGS] = {{0}};
+	ethash_progpow_loop_kernel_t const* loop;
+	for (unsigned k = 0; (loop = ethash_progpow_loop_kernel_at(k)); ++k) {
+		bench_kernel(opts, epoch, "progPowLoop", loop->name, [&](uint32_t i) {
+			mix[0][0] ^= i;
+			loop->loop(prog, i % PROGPOW_CNT_DAG, light, mix, g_dag, light->progpow_cache, &dag_entries);
+		});
+	}
+	if (ethash_progpow_set_jit(true)) {
+		progpow_jit_t* const jit = progpow_jit_acquire(prog);
+		if (jit) {
+			bench_kernel(opts, epoch, "progPowLoop", "jit", [&](uint32_t i) {
+				mix[0][0] ^= i;
+				progpow_jit_loop(jit, i % PROGPOW_CNT_DAG, light, mix, g_dag, light->progpow_cache, &dag_entries);
+			});
+		}
+		progpow_jit_release(jit);
+		ethash_progpow_set_jit(g_jit);
+	}
+	g_sink = mix[0][0];
+	return true;
+}
+
+// Run every benchmark of one epoch, false if the full and light hashes differ
+bool bench_epoch(options const& opts, uint64_t epoch)
+{
+	uint64_t const block = epoch * ETHASH_EPOCH_LENGTH;
+	uint64_t const cache_size = opts.cache_size ? opts.cache_size : ethash_get_cachesize(block);
+	uint64_t const full_size = opts.full_size ? opts.full_size : ethash_get_datasize(block);
+	ethash_h256_t const seed = ethash_get_seedhash(block);
+	bool ok = true;
+
+	auto start = steady_clock::now();
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	if (!light) {
+		fprintf(stderr, "could not build the light cache of epoch %llu\n", (unsigned long long)epoch);
+		return false;
+	}
+	light->block_number = block;
+	double const cache_seconds = seconds_since(start);
+	printf(
+		"cache         epoch %4llu            : %12.1f ms   %9.1f MB/s  (%llu bytes)\n",
+		(unsigned long long)epoch, cache_seconds * 1000,
+		(double)cache_size / cache_seconds / 1e6, (unsigned long long)cache_size
+	);
+	add_build_record("cache", epoch, 1, cache_size, cache_seconds);
+
+	if (opts.kernels && !bench_kernels(opts, epoch, light)) {
+		ethash_light_delete(light);
+		return false;
+	}
+
+	// computes what ProgPoW caches lazily, so that the threads below share it
+	for (algorithm algo: opts.algorithms) {
+		light_hash(algo, light, full_size, block, 0);
+	}
+
+	if (opts.light) {
+		for (algorithm algo: opts.algorithms) {
+			for (unsigned t: opts.threads) {
+				run_result const r = run_hashes(t, opts.light_hashes, [&](uint64_t nonce) {
+					light_hash(algo, light, full_size, block, nonce);
+				});
+				report_hashes("light", algo, epoch, t, r);
 			}
+		}
+	}
 
-			virtual bool searched(uint64_t start_nonce, uint32_t count)
-			{
-				// do nothing
-				hash_count += count;
-				return hash_count >= trials;
+	if (opts.full) {
+		ethash_full_t full = nullptr;
+		for (unsigned t: opts.threads) {
+			if (full) {
+				ethash_full_delete(full);
+			}
+			start = steady_clock::now();
+			full = ethash_full_new_memory_internal(full_size, light, t, nullptr);
+			if (!full) {
+				fprintf(stderr, "could not build the DAG of epoch %llu\n", (unsigned long long)epoch);
+				ethash_light_delete(light);
+				return false;
 			}
-		};
-		search_hook hook;
-		hook.hash_count = 0;
-
-		miner.search((uint8_t*)&previous_hash, 0x000000ffffffffff, hook);
-
-		for (unsigned i = 0; i != hook.nonce_vec.size(); ++i)
-		{
-			uint64_t nonce = hook.nonce_vec[i];
-			ethash_return_value hash;
-			ethash_light(&hash, &cache, &params, &previous_hash, nonce);
-			debugf("found: %.8x%.8x -> %s\n", unsigned(nonce>>32), unsigned(nonce), bytesToHexString(&hash.result, 32).c_str());
+			double const dag_seconds = seconds_since(start);
+			printf(
+				"dag           epoch %4llu threads %3u: %12.1f ms   %9.1f MB/s  (%llu bytes, %s)\n",
+				(unsigned long long)epoch, t, dag_seconds * 1000,
+				(double)full_size / dag_seconds / 1e6, (unsigned long long)full_size,
+				ethash_page_mode_name(ethash_full_page_mode(full))
+			);
+			add_build_record("dag", epoch, t, full_size, dag_seconds);
 		}
+		for (algorithm algo: opts.algorithms) {
+			ethash_return_value_t const l = light_hash(algo, light, full_size, block, 1);
+			ethash_return_value_t const f = full_hash(algo, full, block, 1);
+			if (memcmp(&l.result, &f.result, sizeof(l.result)) != 0) {
+				fprintf(stderr, "%s full and light hashes differ in epoch %llu\n",
+					algorithm_name(algo).c_str(), (unsigned long long)epoch);
+				ok = false;
+				continue;
+			}
+			for (unsigned t: opts.threads) {
+				run_result const r = run_hashes(t, opts.full_hashes, [&](uint64_t nonce) {
+					full_hash(algo, full, block, nonce);
+				});
+				report_hashes("full", algo, epoch, t, r);
+				run_result const b = run_hashes(t, opts.full_hashes / ETHASH_HASH_BATCH, [&](uint64_t call) {
+					full_hash_batch(algo, full, block, call * ETHASH_HASH_BATCH);
+				});
+				report_hashes("batch", algo, epoch, t, b, ETHASH_HASH_BATCH);
+				run_result const c = run_hashes(t, opts.full_hashes, [&](uint64_t nonce) {
+					full_hash_templated(algo, full, block, nonce);
+				});
+				report_hashes("tmpl", algo, epoch, t, c);
+			}
+			if (opts.scaling) {
+				bench_scaling(opts, epoch, algo, full, block);
+			}
+		}
+		ethash_full_delete(full);
+	}
+	ethash_light_delete(light);
+	return ok;
+}
 
-		hash_count = hook.hash_count;
+std::vector<std::string> split_list(std::string const& s)
+{
+	std::vector<std::string> items;
+	size_t begin = 0;
+	while (begin <= s.size()) {
+		size_t end = s.find(',', begin);
+		if (end == std::string::npos) {
+			end = s.size();
+		}
+		items.push_back(s.substr(begin, end - begin));
+		begin = end + 1;
 	}
-	#else
-	{
-		//#pragma omp parallel for
-		for (int nonce = 0; nonce < trials; ++nonce)
-		{
-			ethash_return_value hash;
-			#ifdef FULL
-				ethash_full(&hash, full_mem, &params, &previous_hash, nonce);
-			#else
-				ethash_light(&hash, &cache, &params, &previous_hash, nonce);
-			#endif // FULL
+	return items;
+}
+
+template <typename T>
+bool parse_list(char const* arg, std::vector<T>& out)
+{
+	out.clear();
+	for (std::string const& item: split_list(arg)) {
+		char* item_end;
+		unsigned long long const value = strtoull(item.c_str(), &item_end, 10);
+		if (item.empty() || *item_end != '\0') {
+			return false;
+		}
+		out.push_back((T)value);
+	}
+	return !out.empty();
+}
+
+bool parse_algorithms(char const* arg, std::vector<algorithm>& out)
+{
+	out.clear();
+	for (std::string const& item: split_list(arg)) {
+		if (item == "ethash") {
+			out.push_back(ALGO_ETHASH);
+		} else if (item == "progpow") {
+			out.push_back(ALGO_PROGPOW);
+		} else {
+			return false;
 		}
 	}
-	#endif
-	auto time = std::chrono::duration_cast<std::chrono::microseconds>(high_resolution_clock::now() - startTime).count();
-	debugf("Search took: %ums\n", (unsigned)time/1000);
+	return !out.empty();
+}
 
-	unsigned read_size = ETHASH_ACCESSES * ETHASH_MIX_BYTES;
-#if defined(OPENCL) || defined(FULL)
-	debugf(
-		"hashrate: %8.2f Mh/s, bw: %8.2f GB/s\n",
-		(double)hash_count * (1000*1000)/time / (1000*1000),
-		(double)hash_count*read_size * (1000*1000)/time / (1024*1024*1024)
+bool write_json(std::string const& path)
+{
+	FILE* f = fopen(path.c_str(), "w");
+	if (!f) {
+		return false;
+	}
+	fprintf(f, "[\n");
+	for (size_t i = 0; i != g_records.size(); ++i) {
+		record const& r = g_records[i];
+		fprintf(
+			f,
+			"  {\"epoch\": %llu, \"algorithm\": \"%s\", \"mode\": \"%s\", \"threads\": %u, "
+			"\"kernel\": \"%s\", \"hashes_per_second\": %.1f, \"bytes_per_second\": %.1f, "
+			"\"p50_us\": %.2f, \"p99_us\": %.2f}%s\n",
+			(unsigned long long)r.epoch, r.algorithm.c_str(), r.mode.c_str(), r.threads,
+			r.kernel.c_str(), r.hashes_per_second, r.bytes_per_second,
+			r.p50_us, r.p99_us, i + 1 == g_records.size() ? "" : ","
 		);
-#else
-	debugf(
-		"hashrate: %8.2f Kh/s, bw: %8.2f MB/s\n",
-		(double)hash_count * (1000*1000)/time / (1000),
-		(double)hash_count*read_size * (1000*1000)/time / (1024*1024)
+	}
+	fprintf(f, "]\n");
+	return fclose(f) == 0;
+}
+
+char const csv_header[] = "epoch,algorithm,mode,threads,kernel,hashes_per_second,bytes_per_second,p50_us,p99_us";
+
+bool write_csv(std::string const& path)
+{
+	FILE* f = fopen(path.c_str(), "w");
+	if (!f) {
+		return false;
+	}
+	fprintf(f, "%s\n", csv_header);
+	for (record const& r: g_records) {
+		fprintf(
+			f, "%llu,%s,%s,%u,%s,%.1f,%.1f,%.2f,%.2f\n",
+			(unsigned long long)r.epoch, r.algorithm.c_str(), r.mode.c_str(), r.threads,
+			r.kernel.c_str(), r.hashes_per_second, r.bytes_per_second, r.p50_us, r.p99_us
 		);
-#endif
+	}
+	return fclose(f) == 0;
+}
 
-	free(cache_mem_buf);
-#ifdef FULL
-	free(full_mem_buf);
-#endif
+bool read_csv(std::string const& path, std::map<std::string, record>& out)
+{
+	std::ifstream in(path);
+	if (!in) {
+		return false;
+	}
+	std::string line;
+	if (!std::getline(in, line) || line != csv_header) {
+		return false;
+	}
+	while (std::getline(in, line)) {
+		std::vector<std::string> const fields = split_list(line);
+		if (fields.size() != 9) {
+			return false;
+		}
+		record r;
+		r.epoch = strtoull(fields[0].c_str(), nullptr, 10);
+		r.algorithm = fields[1];
+		r.mode = fields[2];
+		r.threads = (unsigned)strtoul(fields[3].c_str(), nullptr, 10);
+		r.kernel = fields[4];
+		r.hashes_per_second = strtod(fields[5].c_str(), nullptr);
+		r.bytes_per_second = strtod(fields[6].c_str(), nullptr);
+		r.p50_us = strtod(fields[7].c_str(), nullptr);
+		r.p99_us = strtod(fields[8].c_str(), nullptr);
+		out[r.key()] = r;
+	}
+	return true;
+}
+
+// Compare this run against @a baseline, false if anything got slower by more
+// than @a threshold percent
+bool compare(std::map<std::string, record> const& baseline, double threshold)
+{
+	bool ok = true;
+	printf("\ncompared to the baseline, failing below -%.1f%%:\n", threshold);
+	for (record const& r: g_records) {
+		auto const it = baseline.find(r.key());
+		if (it == baseline.end()) {
+			printf("  %-40s     new\n", r.key().c_str());
+			continue;
+		}
+		record const& base = it->second;
+		double const change = base.score() > 0 ? (r.score() / base.score() - 1) * 100 : 0;
+		bool const regressed = change < -threshold;
+		ok = ok && !regressed;
+		printf(
+			"  %-40s %+7.1f%%%s%s\n", r.key().c_str(), change, regressed ? "  REGRESSION" : "",
+			base.kernel != r.kernel ? ("  (kernel was " + base.kernel + ")").c_str() : ""
+		);
+	}
+	return ok;
+}
+
+void usage(char const* name)
+{
+	printf(
+		"usage: %s [options]\n"
+		"  --epochs LIST        epochs to run, e.g. 0,100 (default 0)\n"
+		"  --threads LIST       thread counts, 0 for all hardware threads (default 1)\n"
+		"  --algo LIST          ethash, progpow or both (default ethash,progpow)\n"
+		"  --light-hashes N     light hashes per thread (default 200)\n"
+		"  --full-hashes N      full hashes per thread (default 20000)\n"
+		"  --cache-size BYTES   override the cache size of the epochs\n"
+		"  --full-size BYTES    override the DAG size of the epochs\n"
+		"  --no-light           skip the light hash rates\n"
+		"  --no-full            skip the DAG build and the full hash rates\n"
+"  --kernels            also time the primitive kernels with warm and cold caches\n"
+		"  --kernel-calls N     warm calls per kernel (default 100000)\n"
+		"  --cold-calls N       cold calls per kernel (default 200)\n"
+		"  --scaling            run pinned threads against one DAG, for the thread\n"
+		"                       counts of --threads or 1, 2, 4.. up to all of them,\n"
+		"                       and report the DAG bandwidth they reach\n"
+		"  --jit                hash ProgPoW with the code generated for each period\n"
+		"  --no-prefetch        do not prefetch the DAG in full hashes\n"
+		"  --json FILE          write the results to FILE as JSON\n"
+		"  --csv FILE           write the results to FILE as CSV\n"
+		"  --baseline FILE      compare against the CSV results of an earlier run and\n"
+		"                       exit with 2 if anything got slower than the threshold\n"
+		"  --threshold PERCENT  allowed slowdown for --baseline (default 5)\n",
+		name
+	);
+}
+
+}
 
-	return 0;
+int main(int argc, char** argv)
+{
+	options opts;
+	for (int i = 1; i < argc; ++i) {
+		std::string const arg(argv[i]);
+		char const* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		bool valid = true;
+		if (arg == "--no-light") {
+			opts.light = false;
+			continue;
+		} else if (arg == "--no-full") {
+			opts.full = false;
+			continue;
+		} else if (arg == "--kernels") {
+			opts.kernels = true;
+			continue;
+		} else if (arg == "--scaling") {
+			opts.scaling = true;
+			continue;
+		} else if (arg == "--jit") {
+			opts.jit = true;
+			continue;
+		} else if (arg == "--no-prefetch") {
+			opts.prefetch = false;
+			continue;
+		} else if (arg == "--help" || arg == "-h") {
+			usage(argv[0]);
+			return 0;
+		} else if (!value) {
+			valid = false;
+		} else if (arg == "--epochs") {
+			valid = parse_list(value, opts.epochs);
+		} else if (arg == "--threads") {
+			valid = parse_list(value, opts.threads);
+		} else if (arg == "--algo") {
+			valid = parse_algorithms(value, opts.algorithms);
+		} else if (arg == "--light-hashes") {
+			opts.light_hashes = (unsigned)strtoul(value, nullptr, 10);
+		} else if (arg == "--full-hashes") {
+			opts.full_hashes = (unsigned)strtoul(value, nullptr, 10);
+		} else if (arg == "--cache-size") {
+			opts.cache_size = strtoull(value, nullptr, 10);
+		} else if (arg == "--full-size") {
+			opts.full_size = strtoull(value, nullptr, 10);
+		} else if (arg == "--kernel-calls") {
+			opts.kernel_calls = (unsigned)strtoul(value, nullptr, 10);
+		} else if (arg == "--cold-calls") {
+			opts.cold_calls = (unsigned)strtoul(value, nullptr, 10);
+		} else if (arg == "--json") {
+			opts.json_path = value;
+		} else if (arg == "--csv") {
+			opts.csv_path = value;
+		} else if (arg == "--baseline") {
+			opts.baseline_path = value;
+		} else if (arg == "--threshold") {
+			opts.threshold = strtod(value, nullptr);
+		} else {
+			valid = false;
+		}
+		if (!valid) {
+			usage(argv[0]);
+			return 1;
+		}
+		++i;
+	}
+	for (unsigned& t: opts.threads) {
+		if (t == 0) {
+			t = ethash_hardware_concurrency();
+		}
+	}
+	ethash_set_prefetch(opts.prefetch);
+	if (opts.jit) {
+		if (!ethash_progpow_set_jit(true)) {
+			fprintf(stderr, "the ProgPoW JIT is not supported on this host\n");
+			return 1;
+		}
+		g_jit = true;
+	}
+	std::map<std::string, record> baseline;
+	if (!opts.baseline_path.empty() && !read_csv(opts.baseline_path, baseline)) {
+		fprintf(stderr, "could not read the baseline \"%s\"\n", opts.baseline_path.c_str());
+		return 1;
+	}
+
+	bool ok = true;
+	for (uint64_t epoch: opts.epochs) {
+		if (epoch >= ETHASH_TABULATED_EPOCHS) {
+			fprintf(stderr, "epoch %llu is out of range\n", (unsigned long long)epoch);
+			return 1;
+		}
+		ok = bench_epoch(opts, epoch) && ok;
+	}
+	if (!opts.json_path.empty() && !write_json(opts.json_path)) {
+		fprintf(stderr, "could not write \"%s\"\n", opts.json_path.c_str());
+		ok = false;
+	}
+	if (!opts.csv_path.empty() && !write_csv(opts.csv_path)) {
+		fprintf(stderr, "could not write \"%s\"\n", opts.csv_path.c_str());
+		ok = false;
+	}
+	if (!ok) {
+		return 1;
+	}
+	return opts.baseline_path.empty() || compare(baseline, opts.threshold) ? 0 : 2;
 }
@@ -0,0 +1,574 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file ethash_cl.c
+ * @date 2018
+ *
+ * The host side of the OpenCL backend. The runtime is opened with dlopen()
+ * or LoadLibrary() and only the few entry points used here are declared, so
+ * neither the OpenCL headers nor its library are needed to build.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+#include <libethash/internal.h>
+#include <libethash/io.h>
+#include <libethash/threads.h>
+#include "ethash_cl.h"
+#include "ethash_cl_kernel.h"
+
+typedef int32_t cl_int;
+typedef uint32_t cl_uint;
+typedef uint32_t cl_bool;
+typedef uint64_t cl_ulong;
+typedef uint64_t cl_bitfield;
+typedef intptr_t cl_context_properties;
+typedef struct _cl_platform_id* cl_platform_id;
+typedef struct _cl_device_id* cl_device_id;
+typedef struct _cl_context* cl_context;
+typedef struct _cl_command_queue* cl_command_queue;
+typedef struct _cl_mem* cl_mem;
+typedef struct _cl_program* cl_program;
+typedef struct _cl_kernel* cl_kernel;
+typedef struct _cl_event* cl_event;
+
+#define CL_SUCCESS 0
+#define CL_TRUE 1
+#define CL_DEVICE_TYPE_GPU (1 << 2)
+#define CL_DEVICE_MAX_MEM_ALLOC_SIZE 0x1010
+#define CL_DEVICE_NAME 0x102B
+#define CL_MEM_READ_WRITE (1 << 0)
+#define CL_MEM_READ_ONLY (1 << 2)
+#define CL_MEM_COPY_HOST_PTR (1 << 5)
+#define CL_PROGRAM_BUILD_LOG 0x1183
+
+#if defined(_WIN32)
+#define CL_API_CALL __stdcall
+#else
+#define CL_API_CALL
+#endif
+
+/// The entry points of the OpenCL runtime, valid once ethash_cl_load() found them all
+static struct {
+	cl_int (CL_API_CALL* GetPlatformIDs)(cl_uint, cl_platform_id*, cl_uint*);
+	cl_int (CL_API_CALL* GetDeviceIDs)(cl_platform_id, cl_bitfield, cl_uint, cl_device_id*, cl_uint*);
+	cl_int (CL_API_CALL* GetDeviceInfo)(cl_device_id, cl_uint, size_t, void*, size_t*);
+	cl_context (CL_API_CALL* CreateContext)(cl_context_properties const*, cl_uint, cl_device_id const*, void*, void*, cl_int*);
+	cl_command_queue (CL_API_CALL* CreateCommandQueue)(cl_context, cl_device_id, cl_bitfield, cl_int*);
+	cl_mem (CL_API_CALL* CreateBuffer)(cl_context, cl_bitfield, size_t, void*, cl_int*);
+	cl_program (CL_API_CALL* CreateProgramWithSource)(cl_context, cl_uint, char const**, size_t const*, cl_int*);
+	cl_int (CL_API_CALL* BuildProgram)(cl_program, cl_uint, cl_device_id const*, char const*, void*, void*);
+	cl_int (CL_API_CALL* GetProgramBuildInfo)(cl_program, cl_device_id, cl_uint, size_t, void*, size_t*);
+	cl_kernel (CL_API_CALL* CreateKernel)(cl_program, char const*, cl_int*);
+	cl_int (CL_API_CALL* SetKernelArg)(cl_kernel, cl_uint, size_t, void const*);
+	cl_int (CL_API_CALL* EnqueueNDRangeKernel)(cl_command_queue, cl_kernel, cl_uint, size_t const*, size_t const*, size_t const*, cl_uint, cl_event const*, cl_event*);
+	cl_int (CL_API_CALL* EnqueueWriteBuffer)(cl_command_queue, cl_mem, cl_bool, size_t, size_t, void const*, cl_uint, cl_event const*, cl_event*);
+	cl_int (CL_API_CALL* EnqueueReadBuffer)(cl_command_queue, cl_mem, cl_bool, size_t, size_t, void*, cl_uint, cl_event const*, cl_event*);
+	cl_int (CL_API_CALL* Finish)(cl_command_queue);
+	cl_int (CL_API_CALL* ReleaseMemObject)(cl_mem);
+	cl_int (CL_API_CALL* ReleaseKernel)(cl_kernel);
+	cl_int (CL_API_CALL* ReleaseProgram)(cl_program);
+	cl_int (CL_API_CALL* ReleaseCommandQueue)(cl_command_queue);
+	cl_int (CL_API_CALL* ReleaseContext)(cl_context);
+} ocl;
+
+/// The most devices that are used, over all platforms
+#define ETHASH_CL_MAX_DEVICES 64
+/// The DAG items generated by one kernel launch, small enough for the
+/// watchdogs of display drivers
+#define ETHASH_CL_DAG_ITEMS (1U << 16)
+/// The nonces hashed by one search kernel launch
+#define ETHASH_CL_BATCH (1U << 20)
+/// The candidates one search kernel launch can report
+#define ETHASH_CL_CANDIDATES 64U
+
+static ethash_once_t ocl_once = ETHASH_ONCE_INIT;
+static cl_device_id ocl_devices[ETHASH_CL_MAX_DEVICES];
+static unsigned ocl_num_devices = 0;
+
+#if defined(_WIN32)
+static void* ethash_cl_open(void)
+{
+	return (void*)LoadLibraryA("OpenCL.dll");
+}
+
+static void* ethash_cl_symbol(void* lib, char const* name)
+{
+	return (void*)GetProcAddress((HMODULE)lib, name);
+}
+#else
+static void* ethash_cl_open(void)
+{
+#if defined(__APPLE__)
+	return dlopen("/System/Library/Frameworks/OpenCL.framework/OpenCL", RTLD_NOW);
+#else
+	void* lib = dlopen("libOpenCL.so.1", RTLD_NOW);
+	return lib ? lib : dlopen("libOpenCL.so", RTLD_NOW);
+#endif
+}
+
+static void* ethash_cl_symbol(void* lib, char const* name)
+{
+	return dlsym(lib, name);
+}
+#endif
+
+#define ETHASH_CL_LOAD(fn)											\
+	do {															\
+		*(void**)&ocl.fn = ethash_cl_symbol(lib, "cl" #fn);			\
+		if (!ocl.fn) {												\
+			ETHASH_CRITICAL("The OpenCL runtime has no cl" #fn ".");	\
+			return;													\
+		}															\
+	} while (0)
+
+// Open the runtime and list the GPUs of all its platforms. The library stays
+// loaded for the lifetime of the process.
+static void ethash_cl_load(void)
+{
+	void* const lib = ethash_cl_open();
+	if (!lib) {
+		return;
+	}
+	ETHASH_CL_LOAD(GetPlatformIDs);
+	ETHASH_CL_LOAD(GetDeviceIDs);
+	ETHASH_CL_LOAD(GetDeviceInfo);
+	ETHASH_CL_LOAD(CreateContext);
+	ETHASH_CL_LOAD(CreateCommandQueue);
+	ETHASH_CL_LOAD(CreateBuffer);
+	ETHASH_CL_LOAD(CreateProgramWithSource);
+	ETHASH_CL_LOAD(BuildProgram);
+	ETHASH_CL_LOAD(GetProgramBuildInfo);
+	ETHASH_CL_LOAD(CreateKernel);
+	ETHASH_CL_LOAD(SetKernelArg);
+	ETHASH_CL_LOAD(EnqueueNDRangeKernel);
+	ETHASH_CL_LOAD(EnqueueWriteBuffer);
+	ETHASH_CL_LOAD(EnqueueReadBuffer);
+	ETHASH_CL_LOAD(Finish);
+	ETHASH_CL_LOAD(ReleaseMemObject);
+	ETHASH_CL_LOAD(ReleaseKernel);
+	ETHASH_CL_LOAD(ReleaseProgram);
+	ETHASH_CL_LOAD(ReleaseCommandQueue);
+	ETHASH_CL_LOAD(ReleaseContext);
+
+	cl_platform_id platforms[16];
+	cl_uint num_platforms = 0;
+	if (ocl.GetPlatformIDs(16, platforms, &num_platforms) != CL_SUCCESS) {
+		return;
+	}
+	for (cl_uint p = 0; p < num_platforms && p < 16; ++p) {
+		cl_uint found = 0;
+		cl_uint const room = ETHASH_CL_MAX_DEVICES - ocl_num_devices;
+		if (room && ocl.GetDeviceIDs(platforms[p], CL_DEVICE_TYPE_GPU, room, &ocl_devices[ocl_num_devices], &found) == CL_SUCCESS) {
+			ocl_num_devices += found < room ? found : room;
+		}
+	}
+}
+
+#undef ETHASH_CL_LOAD
+
+unsigned ethash_cl_device_count(void)
+{
+	ethash_call_once(&ocl_once, ethash_cl_load);
+	return ocl_num_devices;
+}
+
+struct ethash_cl {
+	ethash_light_t light;
+	uint64_t full_size;
+	cl_device_id device;
+	char name[256];
+	cl_context context;
+	cl_command_queue queue;
+	cl_program ethash_program;
+	cl_kernel search_kernel;
+	/// The program of progpow_period, NULL until the first ProgPoW search
+	cl_program progpow_program;
+	cl_kernel progpow_kernel;
+	uint64_t progpow_period;
+	cl_mem dag;
+	cl_mem header;
+	cl_mem boundary;
+	/// A counter followed by ETHASH_CL_CANDIDATES nonces, see record_candidate()
+	cl_mem candidates;
+	/// The buffers and kernels are shared by all searches
+	ethash_mutex_t mutex;
+};
+
+// The -D options giving the kernels the constants of ethash.h and internal.h
+static void ethash_cl_options(char* options, size_t size, bool progpow)
+{
+	snprintf(
+		options, size,
+		"-D ETHASH_DATASET_PARENTS=%u -D ETHASH_ACCESSES=%u"
+		" -D PROGPOW_LANES=%u -D PROGPOW_REGS=%u -D PROGPOW_DAG_LOADS=%u"
+		" -D PROGPOW_CACHE_WORDS=%u -D PROGPOW_CNT_DAG=%u%s",
+		(unsigned)ETHASH_DATASET_PARENTS, (unsigned)ETHASH_ACCESSES,
+		(unsigned)PROGPOW_LANES, (unsigned)PROGPOW_REGS, (unsigned)PROGPOW_DAG_LOADS,
+		(unsigned)PROGPOW_CACHE_WORDS, (unsigned)PROGPOW_CNT_DAG,
+		progpow ? " -D ETHASH_CL_PROGPOW" : ""
+	);
+}
+
+// Build a program from the kernel source and @a extra, which may be NULL
+static cl_program ethash_cl_build(ethash_cl_t cl, char const* extra, bool progpow)
+{
+	char const* sources[2] = { ethash_cl_kernel_source, extra };
+	char options[512];
+	ethash_cl_options(options, sizeof(options), progpow);
+	cl_int err;
+	cl_program program = ocl.CreateProgramWithSource(cl->context, extra ? 2 : 1, sources, NULL, &err);
+	if (!program) {
+		return NULL;
+	}
+	if (ocl.BuildProgram(program, 1, &cl->device, options, NULL, NULL) != CL_SUCCESS) {
+		char log[4096];
+		log[0] = '\0';
+		ocl.GetProgramBuildInfo(program, cl->device, CL_PROGRAM_BUILD_LOG, sizeof(log) - 1, log, NULL);
+		log[sizeof(log) - 1] = '\0';
+		ETHASH_CRITICAL("Could not build the OpenCL kernels for %s: %s", cl->name, log);
+		ocl.ReleaseProgram(program);
+		return NULL;
+	}
+	return program;
+}
+
+// Make the kernel of the program of @a period current
+static bool ethash_cl_progpow_period(ethash_cl_t cl, uint64_t period)
+{
+	if (cl->progpow_program && cl->progpow_period == period) {
+		return true;
+	}
+	if (cl->progpow_kernel) {
+		ocl.ReleaseKernel(cl->progpow_kernel);
+		cl->progpow_kernel = NULL;
+	}
+	if (cl->progpow_program) {
+		ocl.ReleaseProgram(cl->progpow_program);
+		cl->progpow_program = NULL;
+	}
+	size_t const length = progpow_get_kernel_source(period, PROGPOW_SOURCE_OPENCL, NULL, 0);
+	char* const loop = malloc(length + 1);
+	if (!loop) {
+		return false;
+	}
+	progpow_get_kernel_source(period, PROGPOW_SOURCE_OPENCL, loop, length + 1);
+	cl->progpow_program = ethash_cl_build(cl, loop, true);
+	free(loop);
+	if (!cl->progpow_program) {
+		return false;
+	}
+	cl_int err;
+	cl->progpow_kernel = ocl.CreateKernel(cl->progpow_program, "progpow_search", &err);
+	if (!cl->progpow_kernel) {
+		return false;
+	}
+	cl->progpow_period = period;
+	return true;
+}
+
+// Generate the DAG from the cache of the light handler
+static bool ethash_cl_generate(ethash_cl_t cl)
+{
+	bool ret = false;
+	cl_int err;
+	cl_kernel kernel = NULL;
+	cl_mem cache = ocl.CreateBuffer(
+		cl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+		(size_t)cl->light->cache_size, cl->light->cache, &err
+	);
+	if (!cache) {
+		goto cleanup;
+	}
+	kernel = ocl.CreateKernel(cl->ethash_program, "ethash_dag", &err);
+	if (!kernel) {
+		goto cleanup;
+	}
+	cl_uint const cache_nodes = (cl_uint)(cl->light->cache_size / sizeof(node));
+	cl_uint const dag_nodes = (cl_uint)(cl->full_size / sizeof(node));
+	if (ocl.SetKernelArg(kernel, 0, sizeof(cl_mem), &cache) != CL_SUCCESS ||
+		ocl.SetKernelArg(kernel, 1, sizeof(cl_uint), &cache_nodes) != CL_SUCCESS ||
+		ocl.SetKernelArg(kernel, 2, sizeof(cl_mem), &cl->dag) != CL_SUCCESS) {
+		goto cleanup;
+	}
+	for (cl_uint first = 0; first < dag_nodes; first += ETHASH_CL_DAG_ITEMS) {
+		size_t const items = dag_nodes - first < ETHASH_CL_DAG_ITEMS ? dag_nodes - first : ETHASH_CL_DAG_ITEMS;
+		if (ocl.SetKernelArg(kernel, 3, sizeof(cl_uint), &first) != CL_SUCCESS ||
+			ocl.EnqueueNDRangeKernel(cl->queue, kernel, 1, NULL, &items, NULL, 0, NULL, NULL) != CL_SUCCESS ||
+			ocl.Finish(cl->queue) != CL_SUCCESS) {
+			goto cleanup;
+		}
+	}
+	ret = true;
+
+cleanup:
+	if (kernel) {
+		ocl.ReleaseKernel(kernel);
+	}
+	if (cache) {
+		ocl.ReleaseMemObject(cache);
+	}
+	return ret;
+}
+
+ethash_cl_t ethash_cl_new(ethash_light_t light, uint64_t full_size, unsigned device)
+{
+	if (device >= ethash_cl_device_count()) {
+		return NULL;
+	}
+	if (full_size == 0) {
+		full_size = ethash_get_datasize(light->block_number);
+	}
+	if (full_size % ETHASH_MIX_BYTES != 0 || full_size / sizeof(node) > UINT32_MAX) {
+		return NULL;
+	}
+	ethash_cl_t cl = calloc(1, sizeof(*cl));
+	if (!cl) {
+		return NULL;
+	}
+	if (!ethash_mutex_init(&cl->mutex)) {
+		free(cl);
+		return NULL;
+	}
+	cl->light = light;
+	cl->full_size = full_size;
+	cl->device = ocl_devices[device];
+	if (ocl.GetDeviceInfo(cl->device, CL_DEVICE_NAME, sizeof(cl->name) - 1, cl->name, NULL) != CL_SUCCESS) {
+		snprintf(cl->name, sizeof(cl->name), "OpenCL device %u", device);
+	}
+	cl_ulong max_alloc = 0;
+	ocl.GetDeviceInfo(cl->device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(max_alloc), &max_alloc, NULL);
+	if (max_alloc < full_size) {
+		ETHASH_CRITICAL("%s can not allocate a DAG of %" PRIu64 " bytes.", cl->name, full_size);
+		goto fail;
+	}
+
+	cl_int err;
+	cl->context = ocl.CreateContext(NULL, 1, &cl->device, NULL, NULL, &err);
+	if (!cl->context) {
+		goto fail;
+	}
+	cl->queue = ocl.CreateCommandQueue(cl->context, cl->device, 0, &err);
+	if (!cl->queue) {
+		goto fail;
+	}
+	cl->ethash_program = ethash_cl_build(cl, NULL, false);
+	if (!cl->ethash_program) {
+		goto fail;
+	}
+	cl->search_kernel = ocl.CreateKernel(cl->ethash_program, "ethash_search", &err);
+	cl->dag = ocl.CreateBuffer(cl->context, CL_MEM_READ_WRITE, (size_t)full_size, NULL, &err);
+	cl->header = ocl.CreateBuffer(cl->context, CL_MEM_READ_ONLY, sizeof(ethash_h256_t), NULL, &err);
+	cl->boundary = ocl.CreateBuffer(cl->context, CL_MEM_READ_ONLY, 4 * sizeof(cl_ulong), NULL, &err);
+	cl->candidates = ocl.CreateBuffer(cl->context, CL_MEM_READ_WRITE, (1 + 2 * ETHASH_CL_CANDIDATES) * sizeof(cl_uint), NULL, &err);
+	if (!cl->search_kernel || !cl->dag || !cl->header || !cl->boundary || !cl->candidates) {
+		goto fail;
+	}
+	if (!ethash_cl_generate(cl)) {
+		ETHASH_CRITICAL("Could not generate the DAG on %s.", cl->name);
+		goto fail;
+	}
+	return cl;
+
+fail:
+	ethash_cl_delete(cl);
+	return NULL;
+}
+
+void ethash_cl_delete(ethash_cl_t cl)
+{
+	if (!cl) {
+		return;
+	}
+	if (cl->progpow_kernel) {
+		ocl.ReleaseKernel(cl->progpow_kernel);
+	}
+	if (cl->progpow_program) {
+		ocl.ReleaseProgram(cl->progpow_program);
+	}
+	if (cl->search_kernel) {
+		ocl.ReleaseKernel(cl->search_kernel);
+	}
+	if (cl->ethash_program) {
+		ocl.ReleaseProgram(cl->ethash_program);
+	}
+	cl_mem const buffers[] = { cl->dag, cl->header, cl->boundary, cl->candidates };
+	for (size_t i = 0; i != sizeof(buffers) / sizeof(buffers[0]); ++i) {
+		if (buffers[i]) {
+			ocl.ReleaseMemObject(buffers[i]);
+		}
+	}
+	if (cl->queue) {
+		ocl.ReleaseCommandQueue(cl->queue);
+	}
+	if (cl->context) {
+		ocl.ReleaseContext(cl->context);
+	}
+	ethash_mutex_destroy(&cl->mutex);
+	free(cl);
+}
+
+char const* ethash_cl_device_name(ethash_cl_t cl)
+{
+	return cl->name;
+}
+
+// A search of ethash_cl_search() or progpow_cl_search()
+typedef struct ethash_cl_search {
+	ethash_cl_t cl;
+	cl_kernel kernel;
+	ethash_h256_t header_hash;
+	ethash_h256_t const* boundary;
+	/// UINT64_MAX for Ethash, otherwise the block number of the ProgPoW search
+	uint64_t block_number;
+	ethash_search_hit_t* hits;
+	size_t max_hits;
+	size_t num_hits;
+} ethash_cl_search_t;
+
+static int ethash_cl_compare_nonces(void const* a, void const* b)
+{
+	uint64_t const x = *(uint64_t const*)a;
+	uint64_t const y = *(uint64_t const*)b;
+	return x < y ? -1 : x > y;
+}
+
+// Hash a candidate on the host and record it if it really is a hit
+static void ethash_cl_verify(ethash_cl_search_t* search, uint64_t nonce)
+{
+	ethash_cl_t const cl = search->cl;
+	ethash_return_value_t const ret = search->block_number == UINT64_MAX ?
+		ethash_light_compute_internal(cl->light, cl->full_size, search->header_hash, nonce) :
+		progpow_light_compute_internal(cl->light, cl->full_size, search->header_hash, nonce, search->block_number);
+	if (!ret.success || !ethash_check_difficulty(&ret.result, search->boundary)) {
+		ETHASH_CRITICAL("%s found nonce %" PRIu64 " which is no hit.", cl->name, nonce);
+		return;
+	}
+	ethash_search_hit_t* const hit = &search->hits[search->num_hits++];
+	hit->nonce = nonce;
+	hit->result = ret.result;
+	hit->mix_hash = ret.mix_hash;
+}
+
+// Search @a count nonces from @a start_nonce in one launch, splitting the
+// range when it has more candidates than a launch can report
+static bool ethash_cl_search_range(ethash_cl_search_t* search, uint64_t start_nonce, size_t count)
+{
+	ethash_cl_t const cl = search->cl;
+	cl_uint candidates[1 + 2 * ETHASH_CL_CANDIDATES];
+	candidates[0] = 0;
+	if (ocl.EnqueueWriteBuffer(cl->queue, cl->candidates, CL_TRUE, 0, sizeof(cl_uint), candidates, 0, NULL, NULL) != CL_SUCCESS ||
+		ocl.SetKernelArg(search->kernel, 3, sizeof(cl_ulong), &start_nonce) != CL_SUCCESS ||
+		ocl.EnqueueNDRangeKernel(cl->queue, search->kernel, 1, NULL, &count, NULL, 0, NULL, NULL) != CL_SUCCESS ||
+		ocl.EnqueueReadBuffer(cl->queue, cl->candidates, CL_TRUE, 0, sizeof(candidates), candidates, 0, NULL, NULL) != CL_SUCCESS) {
+		return false;
+	}
+	if (candidates[0] > ETHASH_CL_CANDIDATES) {
+		size_t const half = count / 2;
+		return ethash_cl_search_range(search, start_nonce, half) &&
+			(search->num_hits == search->max_hits || ethash_cl_search_range(search, start_nonce + half, count - half));
+	}
+	uint64_t nonces[ETHASH_CL_CANDIDATES];
+	for (cl_uint i = 0; i != candidates[0]; ++i) {
+		nonces[i] = (uint64_t)candidates[2 + 2 * i] << 32 | candidates[1 + 2 * i];
+	}
+	qsort(nonces, candidates[0], sizeof(nonces[0]), ethash_cl_compare_nonces);
+	for (cl_uint i = 0; i != candidates[0] && search->num_hits != search->max_hits; ++i) {
+		ethash_cl_verify(search, nonces[i]);
+	}
+	return true;
+}
+
+// Run the search kernel whose DAG size argument is @a size over the range of nonces
+static size_t ethash_cl_run(ethash_cl_search_t* search, cl_uint size, uint64_t start_nonce, uint64_t count)
+{
+	ethash_cl_t const cl = search->cl;
+	cl_ulong boundary[4];
+	for (int i = 0; i < 4; i++) {
+		boundary[i] = 0;
+		for (int j = 0; j < 8; j++) {
+			boundary[i] = boundary[i] << 8 | search->boundary->b[8 * i + j];
+		}
+	}
+	cl_uint const max_candidates = ETHASH_CL_CANDIDATES;
+	if (ocl.EnqueueWriteBuffer(cl->queue, cl->header, CL_TRUE, 0, sizeof(ethash_h256_t), &search->header_hash, 0, NULL, NULL) != CL_SUCCESS ||
+		ocl.EnqueueWriteBuffer(cl->queue, cl->boundary, CL_TRUE, 0, sizeof(boundary), boundary, 0, NULL, NULL) != CL_SUCCESS ||
+		ocl.SetKernelArg(search->kernel, 0, sizeof(cl_mem), &cl->dag) != CL_SUCCESS ||
+		ocl.SetKernelArg(search->kernel, 1, sizeof(cl_uint), &size) != CL_SUCCESS ||
+		ocl.SetKernelArg(search->kernel, 2, sizeof(cl_mem), &cl->header) != CL_SUCCESS ||
+		ocl.SetKernelArg(search->kernel, 4, sizeof(cl_mem), &cl->boundary) != CL_SUCCESS ||
+		ocl.SetKernelArg(search->kernel, 5, sizeof(cl_mem), &cl->candidates) != CL_SUCCESS ||
+		ocl.SetKernelArg(search->kernel, 6, sizeof(cl_uint), &max_candidates) != CL_SUCCESS) {
+		return search->num_hits;
+	}
+	while (count && search->num_hits != search->max_hits) {
+		size_t const batch = count < ETHASH_CL_BATCH ? (size_t)count : ETHASH_CL_BATCH;
+		if (!ethash_cl_search_range(search, start_nonce, batch)) {
+			ETHASH_CRITICAL("The search on %s failed.", cl->name);
+			break;
+		}
+		start_nonce += batch;
+		count -= batch;
+	}
+	return search->num_hits;
+}
+
+size_t ethash_cl_search(
+	ethash_cl_t cl,
+	ethash_h256_t const header_hash,
+	uint64_t start_nonce,
+	uint64_t count,
+	ethash_h256_t const* boundary,
+	ethash_search_hit_t* hits,
+	size_t max_hits
+)
+{
+	ethash_cl_search_t search = { cl, cl->search_kernel, header_hash, boundary, UINT64_MAX, hits, max_hits, 0 };
+	ethash_mutex_lock(&cl->mutex);
+	size_t const ret = ethash_cl_run(&search, (cl_uint)(cl->full_size / ETHASH_MIX_BYTES), start_nonce, count);
+	ethash_mutex_unlock(&cl->mutex);
+	return ret;
+}
+
+size_t progpow_cl_search(
+	ethash_cl_t cl,
+	ethash_h256_t const header_hash,
+	uint64_t block_number,
+	uint64_t start_nonce,
+	uint64_t count,
+	ethash_h256_t const* boundary,
+	ethash_search_hit_t* hits,
+	size_t max_hits
+)
+{
+	size_t ret = 0;
+	ethash_mutex_lock(&cl->mutex);
+	if (ethash_cl_progpow_period(cl, block_number / PROGPOW_PERIOD)) {
+		ethash_cl_search_t search = { cl, cl->progpow_kernel, header_hash, boundary, block_number, hits, max_hits, 0 };
+		ret = ethash_cl_run(&search, progpow_dag_entries(cl->full_size).divisor, start_nonce, count);
+	} else {
+		ETHASH_CRITICAL("Could not build the ProgPoW program of block %" PRIu64 " for %s.", block_number, cl->name);
+	}
+	ethash_mutex_unlock(&cl->mutex);
+	return ret;
+}
@@ -0,0 +1,107 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file ethash_cl.h
+ * @date 2018
+ *
+ * DAG generation and nonce search on OpenCL GPUs. The OpenCL runtime is
+ * loaded when first needed, so programs linking this library also run on
+ * hosts without one, and just see no devices.
+ */
+#pragma once
+#include <libethash/ethash.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ethash_cl* ethash_cl_t;
+
+/**
+ * Get the number of OpenCL GPUs of all platforms
+ *
+ * @return       The number of devices, 0 if there is no OpenCL runtime
+ */
+unsigned ethash_cl_device_count(void);
+
+/**
+ * Generate the DAG of an epoch on a GPU
+ *
+ * The cache of @a light is copied to the device and the DAG is computed
+ * there, it never goes through host memory.
+ *
+ * @param light          The light handler of the epoch. It must outlive the
+ *                       returned handler, the hits of the searches are
+ *                       verified with it.
+ * @param full_size      The size of the DAG in bytes, 0 for the size of the
+ *                       epoch of @a light
+ * @param device         The device, less than @ref ethash_cl_device_count()
+ * @return               The handler, or NULL if there is no such device or
+ *                       the DAG could not be generated on it
+ */
+ethash_cl_t ethash_cl_new(ethash_light_t light, uint64_t full_size, unsigned device);
+
+/**
+ * Free a handler from @ref ethash_cl_new(). Does nothing for NULL.
+ */
+void ethash_cl_delete(ethash_cl_t cl);
+
+/**
+ * Get the name of the device of a handler
+ */
+char const* ethash_cl_device_name(ethash_cl_t cl);
+
+/**
+ * Search a range of nonces for results below a boundary on the GPU
+ *
+ * Same as @ref ethash_full_search() with the DAG of the device. The GPU only
+ * reports candidate nonces, every hit is hashed again on the host before it
+ * is returned.
+ *
+ * @return               The number of hits written to @a hits, which are in
+ *                       nonce order
+ */
+size_t ethash_cl_search(
+	ethash_cl_t cl,
+	ethash_h256_t const header_hash,
+	uint64_t start_nonce,
+	uint64_t count,
+	ethash_h256_t const* boundary,
+	ethash_search_hit_t* hits,
+	size_t max_hits
+);
+
+/**
+ * Search a range of nonces for ProgPoW results below a boundary on the GPU
+ *
+ * Same as @ref ethash_cl_search() for ProgPoW at @a block_number. The program
+ * of the period of @a block_number is compiled for the device the first time
+ * it is searched.
+ */
+size_t progpow_cl_search(
+	ethash_cl_t cl,
+	ethash_h256_t const header_hash,
+	uint64_t block_number,
+	uint64_t start_nonce,
+	uint64_t count,
+	ethash_h256_t const* boundary,
+	ethash_search_hit_t* hits,
+	size_t max_hits
+);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,352 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file ethash_cl_kernel.cl
+ * @date 2018
+ *
+ * The OpenCL kernels of ethash_cl.c: DAG generation, the Ethash search and
+ * the ProgPoW search. ethash_cl.c defines ETHASH_DATASET_PARENTS,
+ * ETHASH_ACCESSES and the PROGPOW_* constants with -D options. The programs of
+ * the ProgPoW periods also define ETHASH_CL_PROGPOW and have the main loop
+ * iteration of their period appended to this source.
+ *
+ * Only scalar OpenCL C is used, so the kernels also compile as C99 with a few
+ * macros for the address spaces and the builtins.
+ */
+
+#define FNV_PRIME 0x01000193U
+#define fnv(x, y) ((x) * FNV_PRIME ^ (y))
+#define fnv1a(h, d) ((h) = ((h) ^ (d)) * FNV_PRIME)
+
+#define ROTL64(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
+// rotations by a multiple of 32 leave the word unchanged
+#define ROTL32(x, n) (((x) << ((n) & 31)) | ((x) >> ((32 - ((n) & 31)) & 31)))
+#define ROTR32(x, n) (((x) >> ((n) & 31)) | ((x) << ((32 - ((n) & 31)) & 31)))
+
+#define SWAP32(x) (((x) >> 24) | (((x) >> 8) & 0xff00U) | (((x) << 8) & 0xff0000U) | ((x) << 24))
+#define SWAP64(x) ((ulong)SWAP32((uint)(x)) << 32 | SWAP32((uint)((x) >> 32)))
+
+#define NODE_WORDS 16
+#define MIX_WORDS 32
+
+__constant ulong keccakf1600_rndc[24] = {
+	0x0000000000000001UL, 0x0000000000008082UL, 0x800000000000808aUL,
+	0x8000000080008000UL, 0x000000000000808bUL, 0x0000000080000001UL,
+	0x8000000080008081UL, 0x8000000000008009UL, 0x000000000000008aUL,
+	0x0000000000000088UL, 0x0000000080008009UL, 0x000000008000000aUL,
+	0x000000008000808bUL, 0x800000000000008bUL, 0x8000000000008089UL,
+	0x8000000000008003UL, 0x8000000000008002UL, 0x8000000000000080UL,
+	0x000000000000800aUL, 0x800000008000000aUL, 0x8000000080008081UL,
+	0x8000000000008080UL, 0x0000000080000001UL, 0x8000000080008008UL
+};
+
+__constant uint keccakf800_rndc[22] = {
+	0x00000001U, 0x00008082U, 0x0000808aU, 0x80008000U, 0x0000808bU, 0x80000001U,
+	0x80008081U, 0x00008009U, 0x0000008aU, 0x00000088U, 0x80008009U, 0x8000000aU,
+	0x8000808bU, 0x0000008bU, 0x00008089U, 0x00008003U, 0x00008002U, 0x00000080U,
+	0x0000800aU, 0x8000000aU, 0x80008081U, 0x00008080U
+};
+
+__constant uint keccakf_rotc[24] = {
+	1,  3,  6,  10, 15, 21, 28, 36, 45, 55, 2,  14,
+	27, 41, 56, 8,  25, 43, 62, 18, 39, 61, 20, 44
+};
+
+__constant uint keccakf_piln[24] = {
+	10, 7,  11, 17, 18, 3, 5,  16, 8,  21, 24, 4,
+	15, 23, 19, 13, 12, 2, 20, 14, 22, 9,  6,  1
+};
+
+void keccak_f1600(ulong st[25])
+{
+	ulong t, bc[5];
+	for (int r = 0; r < 24; r++) {
+		for (int i = 0; i < 5; i++)
+			bc[i] = st[i] ^ st[i + 5] ^ st[i + 10] ^ st[i + 15] ^ st[i + 20];
+		for (int i = 0; i < 5; i++) {
+			t = bc[(i + 4) % 5] ^ ROTL64(bc[(i + 1) % 5], 1);
+			for (int j = 0; j < 25; j += 5)
+				st[j + i] ^= t;
+		}
+		t = st[1];
+		for (int i = 0; i < 24; i++) {
+			uint const j = keccakf_piln[i];
+			bc[0] = st[j];
+			st[j] = ROTL64(t, keccakf_rotc[i]);
+			t = bc[0];
+		}
+		for (int j = 0; j < 25; j += 5) {
+			for (int i = 0; i < 5; i++)
+				bc[i] = st[j + i];
+			for (int i = 0; i < 5; i++)
+				st[j + i] ^= (~bc[(i + 1) % 5]) & bc[(i + 2) % 5];
+		}
+		st[0] ^= keccakf1600_rndc[r];
+	}
+}
+
+void keccak_f800(uint st[25])
+{
+	uint t, bc[5];
+	for (int r = 0; r < 22; r++) {
+		for (int i = 0; i < 5; i++)
+			bc[i] = st[i] ^ st[i + 5] ^ st[i + 10] ^ st[i + 15] ^ st[i + 20];
+		for (int i = 0; i < 5; i++) {
+			t = bc[(i + 4) % 5] ^ ROTL32(bc[(i + 1) % 5], 1);
+			for (int j = 0; j < 25; j += 5)
+				st[j + i] ^= t;
+		}
+		t = st[1];
+		for (int i = 0; i < 24; i++) {
+			uint const j = keccakf_piln[i];
+			bc[0] = st[j];
+			st[j] = ROTL32(t, keccakf_rotc[i]);
+			t = bc[0];
+		}
+		for (int j = 0; j < 25; j += 5) {
+			for (int i = 0; i < 5; i++)
+				bc[i] = st[j + i];
+			for (int i = 0; i < 5; i++)
+				st[j + i] ^= (~bc[(i + 1) % 5]) & bc[(i + 2) % 5];
+		}
+		st[0] ^= keccakf800_rndc[r];
+	}
+}
+
+// Keccak-512 of the 64 bytes of a node, in place
+void keccak512_node(uint node[NODE_WORDS])
+{
+	ulong st[25];
+	for (int i = 0; i < 8; i++)
+		st[i] = (ulong)node[2 * i] | (ulong)node[2 * i + 1] << 32;
+	for (int i = 8; i < 25; i++)
+		st[i] = 0;
+	st[8] = 0x8000000000000001UL;
+	keccak_f1600(st);
+	for (int i = 0; i < 8; i++) {
+		node[2 * i] = (uint)st[i];
+		node[2 * i + 1] = (uint)(st[i] >> 32);
+	}
+}
+
+// Whether the 256 bit big endian number of the four lanes is at most boundary
+int below_boundary(ulong const h[4], __global ulong const* boundary)
+{
+	for (int i = 0; i < 4; i++) {
+		if (h[i] != boundary[i])
+			return h[i] < boundary[i];
+	}
+	return 1;
+}
+
+// Record a candidate nonce in out, a counter followed by max_out nonces as
+// pairs of words. The counter keeps counting past max_out so that the host
+// knows candidates were dropped.
+void record_candidate(__global uint* out, uint max_out, ulong nonce)
+{
+	uint const slot = atomic_inc(&out[0]);
+	if (slot < max_out) {
+		out[1 + 2 * slot] = (uint)nonce;
+		out[2 + 2 * slot] = (uint)(nonce >> 32);
+	}
+}
+
+/**
+ * Compute DAG items first, first + 1, ... from the cache of cache_nodes nodes
+ */
+__kernel void ethash_dag(
+	__global uint const* cache,
+	uint cache_nodes,
+	__global uint* dag,
+	uint first
+)
+{
+	uint const index = first + (uint)get_global_id(0);
+	uint item[NODE_WORDS];
+	uint const init = index % cache_nodes;
+	for (int w = 0; w < NODE_WORDS; w++)
+		item[w] = cache[init * NODE_WORDS + w];
+	item[0] ^= index;
+	keccak512_node(item);
+	for (uint i = 0; i < ETHASH_DATASET_PARENTS; i++) {
+		uint const parent = fnv(index ^ i, item[i % NODE_WORDS]) % cache_nodes;
+		for (int w = 0; w < NODE_WORDS; w++)
+			item[w] = fnv(item[w], cache[parent * NODE_WORDS + w]);
+	}
+	keccak512_node(item);
+	for (int w = 0; w < NODE_WORDS; w++)
+		dag[index * NODE_WORDS + w] = item[w];
+}
+
+/**
+ * Hash the nonce start_nonce + id of a DAG of pages ETHASH_MIX_BYTES pages
+ * and record it in out if the result is at most boundary
+ */
+__kernel void ethash_search(
+	__global uint const* dag,
+	uint pages,
+	__global uint const* header,
+	ulong start_nonce,
+	__global ulong const* boundary,
+	__global uint* out,
+	uint max_out
+)
+{
+	ulong const nonce = start_nonce + get_global_id(0);
+	ulong st[25];
+	for (int i = 0; i < 4; i++)
+		st[i] = (ulong)header[2 * i] | (ulong)header[2 * i + 1] << 32;
+	st[4] = nonce;
+	st[5] = 0x01;
+	for (int i = 6; i < 25; i++)
+		st[i] = 0;
+	st[8] = 0x8000000000000000UL;
+	keccak_f1600(st);
+
+	uint seed[NODE_WORDS];
+	for (int i = 0; i < 8; i++) {
+		seed[2 * i] = (uint)st[i];
+		seed[2 * i + 1] = (uint)(st[i] >> 32);
+	}
+	uint mix[MIX_WORDS];
+	for (int w = 0; w < MIX_WORDS; w++)
+		mix[w] = seed[w % NODE_WORDS];
+
+	for (uint i = 0; i < ETHASH_ACCESSES; i++) {
+		uint const page = fnv(seed[0] ^ i, mix[i % MIX_WORDS]) % pages;
+		for (int w = 0; w < MIX_WORDS; w++)
+			mix[w] = fnv(mix[w], dag[page * MIX_WORDS + w]);
+	}
+
+	// Keccak-256 of the seed and the compressed mix
+	for (int i = 0; i < 8; i++)
+		st[i] = (ulong)seed[2 * i] | (ulong)seed[2 * i + 1] << 32;
+	for (int i = 0; i < 4; i++) {
+		uint const* const lo = &mix[8 * i];
+		uint const* const hi = &mix[8 * i + 4];
+		uint const c_lo = fnv(fnv(fnv(lo[0], lo[1]), lo[2]), lo[3]);
+		uint const c_hi = fnv(fnv(fnv(hi[0], hi[1]), hi[2]), hi[3]);
+		st[8 + i] = (ulong)c_lo | (ulong)c_hi << 32;
+	}
+	st[12] = 0x01;
+	for (int i = 13; i < 25; i++)
+		st[i] = 0;
+	st[16] = 0x8000000000000000UL;
+	keccak_f1600(st);
+
+	ulong h[4];
+	for (int i = 0; i < 4; i++)
+		h[i] = SWAP64(st[i]);
+	if (below_boundary(h, boundary))
+		record_candidate(out, max_out, nonce);
+}
+
+#ifdef ETHASH_CL_PROGPOW
+
+/**
+ * One iteration of the ProgPoW main loop of the period the program was built
+ * for, from progpow_get_kernel_source(). The first PROGPOW_CACHE_WORDS words
+ * of the DAG are the cache.
+ */
+void progpow_period_loop(
+	uint loop,
+	uint mix[PROGPOW_LANES][PROGPOW_REGS],
+	__global uint const* dag,
+	uint dag_entries
+);
+
+// Keccak-f[800] of the header, a 64 bit word and the digest
+void keccak_f800_progpow(uint st[25], __global uint const* header, ulong word, uint const digest[8])
+{
+	for (int i = 0; i < 8; i++)
+		st[i] = header[i];
+	st[8] = (uint)word;
+	st[9] = (uint)(word >> 32);
+	for (int i = 0; i < 8; i++)
+		st[10 + i] = digest[i];
+	for (int i = 18; i < 25; i++)
+		st[i] = 0;
+	keccak_f800(st);
+}
+
+uint kiss99(uint st[4])
+{
+	st[0] = 36969 * (st[0] & 65535) + (st[0] >> 16);
+	st[1] = 18000 * (st[1] & 65535) + (st[1] >> 16);
+	uint const mwc = (st[0] << 16) + st[1];
+	st[2] ^= st[2] << 17;
+	st[2] ^= st[2] >> 13;
+	st[2] ^= st[2] << 5;
+	st[3] = 69069 * st[3] + 1234567;
+	return (mwc ^ st[3]) + st[2];
+}
+
+/**
+ * Hash the nonce start_nonce + id with the ProgPoW program of the period over
+ * a DAG of dag_entries PROGPOW_MIX_BYTES entries and record it in out if the
+ * result is at most boundary. The lanes are run one after the other.
+ */
+__kernel void progpow_search(
+	__global uint const* dag,
+	uint dag_entries,
+	__global uint const* header,
+	ulong start_nonce,
+	__global ulong const* boundary,
+	__global uint* out,
+	uint max_out
+)
+{
+	ulong const nonce = start_nonce + get_global_id(0);
+	uint st[25];
+	uint digest[8];
+	for (int i = 0; i < 8; i++)
+		digest[i] = 0;
+	keccak_f800_progpow(st, header, nonce, digest);
+	ulong const seed = (ulong)SWAP32(st[0]) << 32 | SWAP32(st[1]);
+
+	uint mix[PROGPOW_LANES][PROGPOW_REGS];
+	for (uint l = 0; l < PROGPOW_LANES; l++) {
+		uint fnv_hash = 0x811c9dc5U;
+		uint rnd[4];
+		rnd[0] = fnv1a(fnv_hash, (uint)seed);
+		rnd[1] = fnv1a(fnv_hash, (uint)(seed >> 32));
+		rnd[2] = fnv1a(fnv_hash, l);
+		rnd[3] = fnv1a(fnv_hash, l);
+		for (int i = 0; i < PROGPOW_REGS; i++)
+			mix[l][i] = kiss99(rnd);
+	}
+
+	for (uint loop = 0; loop < PROGPOW_CNT_DAG; loop++)
+		progpow_period_loop(loop, mix, dag, dag_entries);
+
+	for (int i = 0; i < 8; i++)
+		digest[i] = 0x811c9dc5U;
+	for (uint l = 0; l < PROGPOW_LANES; l++) {
+		uint lane_hash = 0x811c9dc5U;
+		for (int i = 0; i < PROGPOW_REGS; i++)
+			fnv1a(lane_hash, mix[l][i]);
+		fnv1a(digest[l % 8], lane_hash);
+	}
+	keccak_f800_progpow(st, header, seed, digest);
+
+	ulong h[4];
+	for (int i = 0; i < 4; i++)
+		h[i] = (ulong)SWAP32(st[2 * i]) << 32 | SWAP32(st[2 * i + 1]);
+	if (below_boundary(h, boundary))
+		record_candidate(out, max_out, nonce);
+}
+
+#endif // ETHASH_CL_PROGPOW
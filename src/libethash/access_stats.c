@@ -0,0 +1,187 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file access_stats.c
+ * @date 2018
+ *
+ * Like the counters of stats.c, every thread records into one of
+ * ETHASH_ACCESS_SLOTS sets of histograms, picked round robin on its first
+ * record. A histogram is allocated on the first access of its kind, as it is
+ * ETHASH_ACCESS_BUCKETS counters large.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "access_stats.h"
+#include "compiler.h"
+#include "threads.h"
+
+#if defined(ETHASH_ACCESS_STATS)
+
+#define ETHASH_ACCESS_SLOTS 64
+
+static uint32_t volatile* volatile access_histograms[ETHASH_ACCESS_SLOTS][ETHASH_ACCESS_KIND_COUNT];
+static uint32_t volatile access_next_slot = 0;
+static ethash_once_t access_once = ETHASH_ONCE_INIT;
+static ethash_mutex_t access_lock;      ///< taken to allocate histograms
+// one past the slot of the calling thread, 0 before its first record
+static ETHASH_THREAD_LOCAL uint32_t access_slot = 0;
+static ETHASH_THREAD_LOCAL uint32_t access_ticks[ETHASH_ACCESS_KIND_COUNT];
+
+static char const* const access_kind_names[ETHASH_ACCESS_KIND_COUNT] = { "dag", "progpow_dag", "cache" };
+
+static void ethash_access_init(void)
+{
+	ethash_mutex_init(&access_lock);
+}
+
+static uint32_t volatile* ethash_access_histogram(uint32_t slot, enum ethash_access_kind kind)
+{
+	uint32_t volatile* histogram = access_histograms[slot][kind];
+	if (!histogram) {
+		ethash_call_once(&access_once, ethash_access_init);
+		ethash_mutex_lock(&access_lock);
+		histogram = access_histograms[slot][kind];
+		if (!histogram) {
+			histogram = calloc(ETHASH_ACCESS_BUCKETS, sizeof(uint32_t));
+			// zeroed before the exporters can see it
+			ethash_atomic_fence();
+			access_histograms[slot][kind] = histogram;
+		}
+		ethash_mutex_unlock(&access_lock);
+	}
+	return histogram;
+}
+
+void ethash_access_record(enum ethash_access_kind kind, uint64_t offset)
+{
+	// every kind is sampled on its own, so that none falls into the gaps of another
+	if (++access_ticks[kind] % ETHASH_ACCESS_SAMPLE != 0) {
+		return;
+	}
+	uint32_t slot = access_slot;
+	if (slot == 0) {
+		slot = ethash_atomic_fetch_add_u32(&access_next_slot, 1) % ETHASH_ACCESS_SLOTS + 1;
+		access_slot = slot;
+	}
+	uint32_t volatile* const histogram = ethash_access_histogram(slot - 1, kind);
+	if (!histogram) {
+		return;
+	}
+	uint64_t bucket = offset / ETHASH_ACCESS_BUCKET_BYTES;
+	if (bucket >= ETHASH_ACCESS_BUCKETS) {
+		bucket = ETHASH_ACCESS_BUCKETS - 1;
+	}
+	// slots are only shared once there are more threads than slots
+	ethash_atomic_fetch_add_u32(&histogram[bucket], 1);
+}
+
+bool ethash_access_stats_enabled(void)
+{
+	return true;
+}
+
+size_t ethash_access_stats_get(enum ethash_access_kind kind, uint64_t* counts, size_t max_buckets)
+{
+	size_t used = 0;
+	size_t const buckets = max_buckets < ETHASH_ACCESS_BUCKETS ? max_buckets : ETHASH_ACCESS_BUCKETS;
+	for (unsigned slot = 0; slot != ETHASH_ACCESS_SLOTS; ++slot) {
+		uint32_t volatile const* const histogram = access_histograms[slot][kind];
+		if (!histogram) {
+			continue;
+		}
+		for (size_t i = 0; i != ETHASH_ACCESS_BUCKETS; ++i) {
+			uint32_t const count = histogram[i];
+			if (count == 0) {
+				continue;
+			}
+			if (i < buckets) {
+				counts[i] += count;
+			}
+			used = i + 1 > used ? i + 1 : used;
+		}
+	}
+	return used;
+}
+
+bool ethash_access_stats_export(char const* path)
+{
+	FILE* f = fopen(path, "w");
+	if (!f) {
+		return false;
+	}
+	fprintf(f, "# bucket_bytes %u\n# sample %u\n", (unsigned)ETHASH_ACCESS_BUCKET_BYTES, (unsigned)ETHASH_ACCESS_SAMPLE);
+	fprintf(f, "thread,kind,bucket,count\n");
+	for (unsigned slot = 0; slot != ETHASH_ACCESS_SLOTS; ++slot) {
+		for (unsigned kind = 0; kind != ETHASH_ACCESS_KIND_COUNT; ++kind) {
+			uint32_t volatile const* const histogram = access_histograms[slot][kind];
+			if (!histogram) {
+				continue;
+			}
+			for (uint32_t i = 0; i != ETHASH_ACCESS_BUCKETS; ++i) {
+				uint32_t const count = histogram[i];
+				if (count) {
+					fprintf(f, "%u,%s,%" PRIu32 ",%" PRIu32 "\n", slot, access_kind_names[kind], i, count);
+				}
+			}
+		}
+	}
+	bool const ok = !ferror(f);
+	return fclose(f) == 0 && ok;
+}
+
+void ethash_access_stats_reset(void)
+{
+	for (unsigned slot = 0; slot != ETHASH_ACCESS_SLOTS; ++slot) {
+		for (unsigned kind = 0; kind != ETHASH_ACCESS_KIND_COUNT; ++kind) {
+			uint32_t volatile* const histogram = access_histograms[slot][kind];
+			if (!histogram) {
+				continue;
+			}
+			for (uint32_t i = 0; i != ETHASH_ACCESS_BUCKETS; ++i) {
+				ethash_atomic_store_u32(&histogram[i], 0);
+			}
+		}
+	}
+}
+
+#else
+
+bool ethash_access_stats_enabled(void)
+{
+	return false;
+}
+
+size_t ethash_access_stats_get(enum ethash_access_kind kind, uint64_t* counts, size_t max_buckets)
+{
+	(void)kind;
+	(void)counts;
+	(void)max_buckets;
+	return 0;
+}
+
+bool ethash_access_stats_export(char const* path)
+{
+	(void)path;
+	return false;
+}
+
+void ethash_access_stats_reset(void)
+{
+}
+
+#endif
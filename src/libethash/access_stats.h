@@ -0,0 +1,44 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file access_stats.h
+ * @date 2018
+ *
+ * The access histograms of ethash_access_stats_get(), recorded by builds
+ * defining ETHASH_ACCESS_STATS. Other builds compile the records away.
+ */
+#pragma once
+#include <stdint.h>
+#include "ethash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(ETHASH_ACCESS_STATS)
+/**
+ * Count a read at byte @a offset of the DAG or cache into the histogram of
+ * @a kind of the calling thread, if it is the one sampled
+ */
+void ethash_access_record(enum ethash_access_kind kind, uint64_t offset);
+#define ETHASH_ACCESS_RECORD(kind, offset) ethash_access_record((kind), (offset))
+#else
+#define ETHASH_ACCESS_RECORD(kind, offset) do {} while (0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
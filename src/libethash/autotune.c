@@ -0,0 +1,335 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file autotune.c
+ * @date 2018
+ *
+ * The trials of ethash_autotune() hash the live DAG with one setting changed
+ * at a time, in the order the settings matter most: the fnv kernel, the hash
+ * batch, the progpow_loop kernel and last the number of search threads. The
+ * tuning file holds one line per host: its key, then the settings, tab
+ * separated.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "internal.h"
+#include "cpu_features.h"
+#include "dispatch.h"
+#include "fnv_kernels.h"
+#include "io.h"
+
+#define ETHASH_AUTOTUNE_FILE "autotune"
+#define ETHASH_AUTOTUNE_BATCHES 4
+// nonces hashed between two looks at the clock
+#define ETHASH_AUTOTUNE_CHUNK 16
+// a thread count is taken only for this many percent more hashes than fewer threads give
+#define ETHASH_AUTOTUNE_THREAD_GAIN 3
+
+static unsigned const autotune_batches[ETHASH_AUTOTUNE_BATCHES] = { 1, 2, 4, ETHASH_MAX_HASH_BATCH };
+static ethash_h256_t const autotune_boundary;   ///< all zero: no nonce of a trial is a hit
+static ethash_h256_t const autotune_header;
+
+// the host and library a tuning was measured with, so other ones tune again
+static void ethash_autotune_key(char* key, size_t size)
+{
+	char model[64];
+	if (!ethash_cpu_model(model, sizeof(model))) {
+		snprintf(model, sizeof(model), "unknown");
+	}
+	for (char* c = model; *c; ++c) {
+		if (*c == '\t' || *c == '\n') {
+			*c = ' ';
+		}
+	}
+	snprintf(
+		key,
+		size,
+		"%s|features=%x|threads=%u|revision=%u",
+		model,
+		(unsigned)ethash_cpu_features(),
+		ethash_hardware_concurrency(),
+		(unsigned)ETHASH_REVISION
+	);
+}
+
+static bool ethash_autotune_apply(ethash_tuning_t const* tuning)
+{
+	if (!ethash_set_kernel("fnv", tuning->fnv_kernel) ||
+		!ethash_set_kernel("progpow_loop", tuning->progpow_loop_kernel)) {
+		return false;
+	}
+	ethash_set_hash_batch(tuning->hash_batch);
+	return true;
+}
+
+// nonces per second of ethash_full_search(), or progpow_full_search() for @a progpow, on this thread
+static uint64_t ethash_autotune_rate(ethash_full_t full, bool progpow, uint64_t trial_us)
+{
+	ethash_search_hit_t hit;
+	uint64_t hashes = 0;
+	uint64_t const start = ethash_time_us();
+	uint64_t elapsed;
+	do {
+		if (progpow) {
+			progpow_full_search(
+				full, autotune_header, 0, hashes, ETHASH_AUTOTUNE_CHUNK, &autotune_boundary, &hit, 1
+			);
+		} else {
+			ethash_full_search(full, autotune_header, hashes, ETHASH_AUTOTUNE_CHUNK, &autotune_boundary, &hit, 1);
+		}
+		hashes += ETHASH_AUTOTUNE_CHUNK;
+		elapsed = ethash_time_us() - start;
+	} while (elapsed < trial_us);
+	return elapsed ? hashes * 1000000 / elapsed : 0;
+}
+
+// nonces per second of an ethash_search_t of @a num_threads threads
+static uint64_t ethash_autotune_threads_rate(ethash_full_t full, unsigned num_threads, uint64_t trial_us)
+{
+	ethash_mutex_t lock;
+	ethash_cond_t never;
+	if (!ethash_mutex_init(&lock)) {
+		return 0;
+	}
+	if (!ethash_cond_init(&never)) {
+		ethash_mutex_destroy(&lock);
+		return 0;
+	}
+	uint64_t rate = 0;
+	uint64_t const start = ethash_time_us();
+	ethash_search_t search = ethash_search_start(full, autotune_header, 0, &autotune_boundary, num_threads);
+	if (search) {
+		uint64_t elapsed;
+		ethash_mutex_lock(&lock);
+		while ((elapsed = ethash_time_us() - start) < trial_us) {
+			ethash_cond_timed_wait(&never, &lock, trial_us - elapsed);
+		}
+		ethash_mutex_unlock(&lock);
+		rate = elapsed ? ethash_search_hashes(search) * 1000000 / elapsed : 0;
+		ethash_search_delete(search);
+	}
+	ethash_cond_destroy(&never);
+	ethash_mutex_destroy(&lock);
+	return rate;
+}
+
+static bool ethash_autotune_load(char const* path, char const* key, ethash_tuning_t* tuning)
+{
+	FILE* f = ethash_fopen(path, "r");
+	if (!f) {
+		return false;
+	}
+	char line[512];
+	size_t const key_length = strlen(key);
+	bool found = false;
+	while (!found && fgets(line, sizeof(line), f)) {
+		if (strncmp(line, key, key_length) != 0 || line[key_length] != '\t') {
+			continue;
+		}
+		ethash_tuning_t loaded;
+		memset(&loaded, 0, sizeof(loaded));
+		found = sscanf(
+			line + key_length,
+			"\t%u\t%u\t%15s\t%15s",
+			&loaded.num_threads,
+			&loaded.hash_batch,
+			loaded.fnv_kernel,
+			loaded.progpow_loop_kernel
+		) == 4 && loaded.num_threads != 0 && ethash_autotune_apply(&loaded);
+		if (found) {
+			*tuning = loaded;
+		}
+	}
+	fclose(f);
+	return found;
+}
+
+// rewrite the tuning file with the line of @a key replaced
+static bool ethash_autotune_save(char const* path, char const* key, ethash_tuning_t const* tuning)
+{
+	size_t const path_length = strlen(path);
+	size_t const key_length = strlen(key);
+	char* tmpfile = malloc(path_length + 5);
+	if (!tmpfile) {
+		return false;
+	}
+	memcpy(tmpfile, path, path_length);
+	memcpy(tmpfile + path_length, ".tmp", 5);
+	FILE* out = ethash_fopen(tmpfile, "w");
+	if (!out) {
+		goto fail_free;
+	}
+	FILE* in = ethash_fopen(path, "r");
+	if (in) {
+		char line[512];
+		while (fgets(line, sizeof(line), in)) {
+			if (strncmp(line, key, key_length) != 0 || line[key_length] != '\t') {
+				fputs(line, out);
+			}
+		}
+		fclose(in);
+	}
+	fprintf(
+		out,
+		"%s\t%u\t%u\t%s\t%s\n",
+		key,
+		tuning->num_threads,
+		tuning->hash_batch,
+		tuning->fnv_kernel,
+		tuning->progpow_loop_kernel
+	);
+	bool const written = !ferror(out);
+	if (fclose(out) != 0 || !written) {
+		goto fail_remove;
+	}
+#if defined(_WIN32)
+	// rename() does not replace existing files on Windows
+	remove(path);
+#endif
+	if (rename(tmpfile, path) != 0) {
+		goto fail_remove;
+	}
+	free(tmpfile);
+	return true;
+
+fail_remove:
+	remove(tmpfile);
+fail_free:
+	free(tmpfile);
+	return false;
+}
+
+static void ethash_autotune_measure(ethash_full_t full, unsigned budget_ms, ethash_tuning_t* tuning)
+{
+	unsigned fnv_count = 0;
+	unsigned progpow_count = 0;
+	unsigned thread_count = 0;
+	unsigned const max_threads = ethash_hardware_concurrency();
+	while (ethash_fnv_kernel_at(fnv_count)) {
+		++fnv_count;
+	}
+	while (ethash_progpow_loop_kernel_at(progpow_count)) {
+		++progpow_count;
+	}
+	// 1, 2, 4 and so on threads, then all of them
+	for (unsigned t = 1; t < max_threads; t *= 2) {
+		++thread_count;
+	}
+	++thread_count;
+	uint64_t const trial_us = (uint64_t)budget_ms * 1000 / (fnv_count + ETHASH_AUTOTUNE_BATCHES + progpow_count + thread_count);
+
+	// the first trial would pay for the cold caches
+	ethash_autotune_rate(full, false, 0);
+
+	uint64_t best = 0;
+	for (unsigned i = 0; i != fnv_count; ++i) {
+		ethash_fnv_kernel_t const* kernel = ethash_fnv_kernel_at(i);
+		ethash_set_kernel("fnv", kernel->name);
+		uint64_t const rate = ethash_autotune_rate(full, false, trial_us);
+		if (rate > best) {
+			best = rate;
+			snprintf(tuning->fnv_kernel, sizeof(tuning->fnv_kernel), "%s", kernel->name);
+		}
+	}
+	ethash_set_kernel("fnv", tuning->fnv_kernel);
+
+	best = 0;
+	for (unsigned i = 0; i != ETHASH_AUTOTUNE_BATCHES; ++i) {
+		ethash_set_hash_batch(autotune_batches[i]);
+		uint64_t const rate = ethash_autotune_rate(full, false, trial_us);
+		if (rate > best) {
+			best = rate;
+			tuning->hash_batch = autotune_batches[i];
+		}
+	}
+	ethash_set_hash_batch(tuning->hash_batch);
+
+	best = 0;
+	for (unsigned i = 0; i != progpow_count; ++i) {
+		ethash_progpow_loop_kernel_t const* kernel = ethash_progpow_loop_kernel_at(i);
+		ethash_set_kernel("progpow_loop", kernel->name);
+		uint64_t const rate = ethash_autotune_rate(full, true, trial_us);
+		if (rate > best) {
+			best = rate;
+			snprintf(tuning->progpow_loop_kernel, sizeof(tuning->progpow_loop_kernel), "%s", kernel->name);
+		}
+	}
+	ethash_set_kernel("progpow_loop", tuning->progpow_loop_kernel);
+
+	best = 0;
+	for (unsigned i = 0, t = 1; i != thread_count; ++i, t *= 2) {
+		unsigned const num_threads = i + 1 == thread_count ? max_threads : t;
+		uint64_t const rate = ethash_autotune_threads_rate(full, num_threads, trial_us);
+		if (rate * 100 > best * (100 + ETHASH_AUTOTUNE_THREAD_GAIN)) {
+			best = rate;
+			tuning->num_threads = num_threads;
+		}
+	}
+	tuning->hash_rate = best;
+}
+
+bool ethash_autotune_internal(
+	ethash_full_t full,
+	unsigned budget_ms,
+	char const* dirname,
+	ethash_tuning_t* tuning
+)
+{
+	char key[256];
+	char* path = NULL;
+	ethash_autotune_key(key, sizeof(key));
+	if (dirname) {
+		if (!ethash_mkdir(dirname)) {
+			ETHASH_CRITICAL("Could not create the ethash directory");
+			return false;
+		}
+		path = ethash_io_create_filename(dirname, ETHASH_AUTOTUNE_FILE, strlen(ETHASH_AUTOTUNE_FILE));
+		if (!path) {
+			ETHASH_CRITICAL("Could not create the autotune pathname");
+			return false;
+		}
+		if (ethash_autotune_load(path, key, tuning)) {
+			tuning->hash_rate = 0;
+			free(path);
+			return true;
+		}
+	}
+	// the defaults stand when no trial finishes a chunk
+	memset(tuning, 0, sizeof(*tuning));
+	tuning->num_threads = 1;
+	tuning->hash_batch = ETHASH_MAX_HASH_BATCH;
+	snprintf(tuning->fnv_kernel, sizeof(tuning->fnv_kernel), "%s", ethash_fnv_kernel_at(0)->name);
+	snprintf(tuning->progpow_loop_kernel, sizeof(tuning->progpow_loop_kernel), "%s", ethash_progpow_loop_kernel_at(0)->name);
+	ethash_autotune_measure(full, budget_ms ? budget_ms : ETHASH_AUTOTUNE_BUDGET_MS, tuning);
+	bool ret = true;
+	if (path) {
+		ret = ethash_autotune_save(path, key, tuning);
+		if (!ret) {
+			ETHASH_CRITICAL("Could not write the autotune file \"%s\"", path);
+		}
+		free(path);
+	}
+	return ret;
+}
+
+bool ethash_autotune(ethash_full_t full, unsigned budget_ms, ethash_tuning_t* tuning)
+{
+	char strbuf[256];
+	bool const has_dirname = ethash_get_default_dirname(strbuf, 256);
+	return ethash_autotune_internal(full, budget_ms, has_dirname ? strbuf : NULL, tuning);
+}
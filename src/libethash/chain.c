@@ -0,0 +1,277 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file chain.c
+ * @date 2018
+ *
+ * Cache and DAG sizes of chains with other parameters than the tables of
+ * data_sizes.h, see @ref ethash_chain_new(). The sizes are the ones of the
+ * GetCacheSizes and GetDataSizes functions quoted there.
+ */
+
+#include <stdlib.h>
+#include "ethash.h"
+#include "internal.h"
+#include "threads.h"
+
+/// Epochs whose sizes a chain remembers, indexed by the epoch modulo this
+#define ETHASH_CHAIN_MEMO_EPOCHS 64
+/// The largest sizes the 32-bit node indices of the cache and DAG address
+#define ETHASH_CHAIN_MAX_BYTES ((uint64_t)UINT32_MAX * ETHASH_HASH_BYTES)
+
+struct ethash_chain_epoch {
+	uint64_t epoch;                  ///< UINT64_MAX for an empty entry
+	uint64_t cache_size;
+	uint64_t full_size;
+};
+
+struct ethash_chain {
+	ethash_chain_params_t params;
+	ethash_mutex_t lock;             ///< protects @a memo
+	struct ethash_chain_epoch memo[ETHASH_CHAIN_MEMO_EPOCHS];
+};
+
+static uint64_t ethash_chain_mulmod(uint64_t a, uint64_t b, uint64_t m)
+{
+	if (m <= UINT32_MAX) {
+		return a * b % m;
+	}
+#if defined(__SIZEOF_INT128__)
+	return (uint64_t)((unsigned __int128)a * b % m);
+#else
+	uint64_t ret = 0;
+	for (a %= m; b; b >>= 1) {
+		if (b & 1) {
+			ret = ret >= m - a ? ret - (m - a) : ret + a;
+		}
+		a = a >= m - a ? a - (m - a) : a + a;
+	}
+	return ret;
+#endif
+}
+
+static uint64_t ethash_chain_powmod(uint64_t base, uint64_t exponent, uint64_t m)
+{
+	uint64_t ret = 1;
+	for (base %= m; exponent; exponent >>= 1) {
+		if (exponent & 1) {
+			ret = ethash_chain_mulmod(ret, base, m);
+		}
+		base = ethash_chain_mulmod(base, base, m);
+	}
+	return ret;
+}
+
+// Miller-Rabin with the first 12 primes as witnesses, deterministic for every 64-bit n
+static bool ethash_chain_is_prime(uint64_t n)
+{
+	static uint64_t const witnesses[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37 };
+	unsigned const count = sizeof(witnesses) / sizeof(witnesses[0]);
+	if (n < 2) {
+		return false;
+	}
+	for (unsigned i = 0; i != count; ++i) {
+		if (n % witnesses[i] == 0) {
+			return n == witnesses[i];
+		}
+	}
+	uint64_t d = n - 1;
+	unsigned s = 0;
+	while (d % 2 == 0) {
+		d /= 2;
+		++s;
+	}
+	for (unsigned i = 0; i != count; ++i) {
+		uint64_t x = ethash_chain_powmod(witnesses[i], d, n);
+		if (x == 1 || x == n - 1) {
+			continue;
+		}
+		unsigned r = 1;
+		for (; r < s; ++r) {
+			x = ethash_chain_mulmod(x, x, n);
+			if (x == n - 1) {
+				break;
+			}
+		}
+		if (r == s) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// the largest size below init + growth * epoch bytes that is a prime number of units, 0 if too large
+static uint64_t ethash_chain_size(uint64_t init, uint64_t growth, uint64_t epoch, uint64_t unit)
+{
+	if (growth && epoch > (ETHASH_CHAIN_MAX_BYTES - init) / growth) {
+		return 0;
+	}
+	uint64_t size = init + growth * epoch - unit;
+	while (!ethash_chain_is_prime(size / unit)) {
+		size -= 2 * unit;
+	}
+	return size;
+}
+
+static void ethash_chain_sizes(ethash_chain_t chain, uint64_t epoch, uint64_t* cache_size, uint64_t* full_size)
+{
+	struct ethash_chain_epoch* const entry = &chain->memo[epoch % ETHASH_CHAIN_MEMO_EPOCHS];
+	ethash_mutex_lock(&chain->lock);
+	bool const found = entry->epoch == epoch;
+	if (found) {
+		*cache_size = entry->cache_size;
+		*full_size = entry->full_size;
+	}
+	ethash_mutex_unlock(&chain->lock);
+	if (found) {
+		return;
+	}
+	// searched without the lock, another thread asking for the same epoch just searches too
+	ethash_chain_params_t const* const params = &chain->params;
+	*cache_size = ethash_chain_size(params->cache_bytes_init, params->cache_bytes_growth, epoch, ETHASH_HASH_BYTES);
+	*full_size = ethash_chain_size(params->dataset_bytes_init, params->dataset_bytes_growth, epoch, ETHASH_MIX_BYTES);
+	ethash_mutex_lock(&chain->lock);
+	entry->epoch = epoch;
+	entry->cache_size = *cache_size;
+	entry->full_size = *full_size;
+	ethash_mutex_unlock(&chain->lock);
+}
+
+ethash_chain_params_t ethash_chain_params_ethereum(void)
+{
+	ethash_chain_params_t ret;
+	ret.epoch_length = ETHASH_EPOCH_LENGTH;
+	ret.cache_bytes_init = ETHASH_CACHE_BYTES_INIT;
+	ret.cache_bytes_growth = ETHASH_CACHE_BYTES_GROWTH;
+	ret.dataset_bytes_init = ETHASH_DATASET_BYTES_INIT;
+	ret.dataset_bytes_growth = ETHASH_DATASET_BYTES_GROWTH;
+	ret.progpow_period = PROGPOW_PERIOD;
+	return ret;
+}
+
+static bool ethash_chain_init(struct ethash_chain* chain, ethash_chain_params_t const* params)
+{
+	if (!ethash_mutex_init(&chain->lock)) {
+		return false;
+	}
+	chain->params = *params;
+	for (unsigned i = 0; i != ETHASH_CHAIN_MEMO_EPOCHS; ++i) {
+		chain->memo[i].epoch = UINT64_MAX;
+	}
+	return true;
+}
+
+// the sizes of Ethereum past data_sizes.h, for the whole process
+static ethash_once_t ethereum_chain_once = ETHASH_ONCE_INIT;
+static struct ethash_chain ethereum_chain;
+static bool ethereum_chain_ready;
+
+static void ethash_ethereum_chain_init(void)
+{
+	ethash_chain_params_t const params = ethash_chain_params_ethereum();
+	ethereum_chain_ready = ethash_chain_init(&ethereum_chain, &params);
+}
+
+void ethash_ethereum_sizes(uint64_t epoch, uint64_t* cache_size, uint64_t* full_size)
+{
+	*cache_size = 0;
+	*full_size = 0;
+	if (epoch >= ETHASH_MAX_EPOCHS) {
+		return;
+	}
+	ethash_call_once(&ethereum_chain_once, ethash_ethereum_chain_init);
+	if (ethereum_chain_ready) {
+		ethash_chain_sizes(&ethereum_chain, epoch, cache_size, full_size);
+	}
+}
+
+ethash_chain_t ethash_chain_new(ethash_chain_params_t const* params)
+{
+	// even numbers of units make the prime search try odd counts only, down to 3 at worst
+	if (params->epoch_length == 0 || params->progpow_period == 0 ||
+		params->cache_bytes_init < 4 * ETHASH_HASH_BYTES ||
+		params->cache_bytes_init > ETHASH_CHAIN_MAX_BYTES ||
+		params->cache_bytes_init % (2 * ETHASH_HASH_BYTES) != 0 ||
+		params->cache_bytes_growth % (2 * ETHASH_HASH_BYTES) != 0 ||
+		params->dataset_bytes_init < 4 * ETHASH_MIX_BYTES ||
+		params->dataset_bytes_init > ETHASH_CHAIN_MAX_BYTES ||
+		params->dataset_bytes_init % (2 * ETHASH_MIX_BYTES) != 0 ||
+		params->dataset_bytes_growth % (2 * ETHASH_MIX_BYTES) != 0) {
+		return NULL;
+	}
+	struct ethash_chain* ret = calloc(1, sizeof(*ret));
+	if (!ret) {
+		return NULL;
+	}
+	if (!ethash_chain_init(ret, params)) {
+		free(ret);
+		return NULL;
+	}
+	return ret;
+}
+
+void ethash_chain_delete(ethash_chain_t chain)
+{
+	ethash_mutex_destroy(&chain->lock);
+	free(chain);
+}
+
+uint64_t ethash_chain_get_epoch(ethash_chain_t chain, uint64_t block_number)
+{
+	return block_number / chain->params.epoch_length;
+}
+
+uint64_t ethash_chain_get_cachesize(ethash_chain_t chain, uint64_t block_number)
+{
+	uint64_t cache_size;
+	uint64_t full_size;
+	ethash_chain_sizes(chain, ethash_chain_get_epoch(chain, block_number), &cache_size, &full_size);
+	return cache_size;
+}
+
+uint64_t ethash_chain_get_datasize(ethash_chain_t chain, uint64_t block_number)
+{
+	uint64_t cache_size;
+	uint64_t full_size;
+	ethash_chain_sizes(chain, ethash_chain_get_epoch(chain, block_number), &cache_size, &full_size);
+	return full_size;
+}
+
+ethash_h256_t ethash_chain_get_seedhash(ethash_chain_t chain, uint64_t block_number)
+{
+	// the seeds of all chains are the same Keccak chain, one link per epoch
+	return ethash_get_seedhash(ethash_chain_get_epoch(chain, block_number) * ETHASH_EPOCH_LENGTH);
+}
+
+ethash_light_t ethash_light_new_for_chain(ethash_chain_t chain, uint64_t block_number)
+{
+	uint64_t cache_size;
+	uint64_t full_size;
+	uint64_t const epoch = ethash_chain_get_epoch(chain, block_number);
+	ethash_chain_sizes(chain, epoch, &cache_size, &full_size);
+	if (cache_size == 0 || full_size == 0) {
+		return NULL;
+	}
+	ethash_h256_t const seedhash = ethash_get_seedhash(epoch * ETHASH_EPOCH_LENGTH);
+	ethash_light_t ret = ethash_light_new_internal(cache_size, &seedhash);
+	if (ret) {
+		ret->block_number = block_number;
+		ret->full_size = full_size;
+		ret->seedhash = seedhash;
+		ret->progpow_period = chain->params.progpow_period;
+	}
+	return ret;
+}
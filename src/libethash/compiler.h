@@ -31,3 +31,47 @@
 #define restrict __restrict__
 #endif
 
+// thread local storage for small per-thread caches
+#if defined(_MSC_VER)
+#define ETHASH_THREAD_LOCAL __declspec(thread)
+#else
+#define ETHASH_THREAD_LOCAL __thread
+#endif
+
+// x86 hosts get runtime dispatched SIMD kernels
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define ETHASH_X86 1
+#endif
+
+// so do 64 bit ARM hosts, with the Advanced SIMD (NEON) of every ARMv8-A CPU
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define ETHASH_ARM64 1
+#endif
+
+// align a variable, e.g. node buffers on a cache line
+#if defined(_MSC_VER)
+#define ETHASH_ALIGNED(n) __declspec(align(n))
+#else
+#define ETHASH_ALIGNED(n) __attribute__((aligned(n)))
+#endif
+
+// compile a single function for an instruction set extension. MSVC accepts
+// the intrinsics everywhere so there is nothing to do there
+#if defined(_MSC_VER)
+#define ETHASH_TARGET(isa)
+#else
+#define ETHASH_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+// hint that the cache line holding an address will be read soon, unless the
+// build defines ETHASH_NO_PREFETCH
+#if defined(ETHASH_NO_PREFETCH)
+#define ETHASH_PREFETCH(addr) ((void)(addr))
+#elif defined(_MSC_VER) && defined(ETHASH_X86)
+#include <xmmintrin.h>
+#define ETHASH_PREFETCH(addr) _mm_prefetch((char const*)(addr), _MM_HINT_T0)
+#elif defined(__GNUC__)
+#define ETHASH_PREFETCH(addr) __builtin_prefetch((addr))
+#else
+#define ETHASH_PREFETCH(addr) ((void)(addr))
+#endif
@@ -0,0 +1,212 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file cpu_features.c
+ * @date 2018
+ */
+
+#include "cpu_features.h"
+#include "compiler.h"
+#include "threads.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(ETHASH_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+
+static uint32_t ethash_cpu_detect(void)
+{
+	int info[4];
+	uint32_t features = 0;
+	__cpuid(info, 0);
+	int const max_leaf = info[0];
+
+	__cpuid(info, 1);
+	if (info[2] & (1 << 19)) {
+		features |= ETHASH_CPU_SSE41;
+	}
+	if (info[2] & (1 << 23)) {
+		features |= ETHASH_CPU_POPCNT;
+	}
+	int const avx_enabled = (info[2] & (1 << 27)) != 0;
+	if (max_leaf < 7) {
+		return features;
+	}
+	__cpuidex(info, 7, 0);
+	// the BMI extensions work on general purpose registers only
+	if (info[1] & (1 << 3)) {
+		features |= ETHASH_CPU_BMI1;
+	}
+	if (info[1] & (1 << 8)) {
+		features |= ETHASH_CPU_BMI2;
+	}
+	// AVX state has to be enabled by the OS (OSXSAVE and XCR0)
+	if (!avx_enabled) {
+		return features;
+	}
+	unsigned long long const xcr0 = _xgetbv(0);
+	if ((xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5))) {
+		features |= ETHASH_CPU_AVX2;
+	}
+	if ((xcr0 & 0xe6) == 0xe6 && (info[1] & (1 << 16))) {
+		features |= ETHASH_CPU_AVX512F;
+	}
+	return features;
+}
+#elif defined(ETHASH_X86) && defined(__GNUC__)
+static uint32_t ethash_cpu_detect(void)
+{
+	uint32_t features = 0;
+	// the builtins check the OS support for the wider registers as well
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.1")) {
+		features |= ETHASH_CPU_SSE41;
+	}
+	if (__builtin_cpu_supports("popcnt")) {
+		features |= ETHASH_CPU_POPCNT;
+	}
+	if (__builtin_cpu_supports("bmi")) {
+		features |= ETHASH_CPU_BMI1;
+	}
+	if (__builtin_cpu_supports("bmi2")) {
+		features |= ETHASH_CPU_BMI2;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		features |= ETHASH_CPU_AVX2;
+	}
+	if (__builtin_cpu_supports("avx512f")) {
+		features |= ETHASH_CPU_AVX512F;
+	}
+	return features;
+}
+#elif defined(ETHASH_ARM64) && defined(__linux__)
+#include <sys/auxv.h>
+#ifndef HWCAP_ASIMD
+#define HWCAP_ASIMD (1 << 1)
+#endif
+
+static uint32_t ethash_cpu_detect(void)
+{
+	// part of ARMv8-A, but the kernel has the final say
+	return (getauxval(AT_HWCAP) & HWCAP_ASIMD) ? ETHASH_CPU_NEON : 0;
+}
+#elif defined(ETHASH_ARM64)
+static uint32_t ethash_cpu_detect(void)
+{
+	return ETHASH_CPU_NEON;
+}
+#else
+static uint32_t ethash_cpu_detect(void)
+{
+	return 0;
+}
+#endif
+
+// bit 31 marks the cached value as valid
+#define ETHASH_CPU_FEATURES_VALID (1u << 31)
+
+static uint32_t volatile ethash_cpu_features_cache = 0;
+
+uint32_t ethash_cpu_features(void)
+{
+	uint32_t features = ethash_atomic_load_u32(&ethash_cpu_features_cache);
+	if (!(features & ETHASH_CPU_FEATURES_VALID)) {
+		// detection is idempotent so racing threads store the same value
+		features = ethash_cpu_detect() | ETHASH_CPU_FEATURES_VALID;
+		ethash_atomic_store_u32(&ethash_cpu_features_cache, features);
+	}
+	return features & ~ETHASH_CPU_FEATURES_VALID;
+}
+
+#if defined(ETHASH_X86) && (defined(_MSC_VER) || defined(__GNUC__))
+#if defined(__GNUC__)
+#include <cpuid.h>
+#endif
+
+// the brand string of the extended CPUID leaves, e.g. "Intel(R) Core(TM) i7-8700K CPU @ 3.70GHz"
+static bool ethash_cpu_model_query(char* buf, size_t size)
+{
+	uint32_t brand[12];
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0x80000000);
+	if ((uint32_t)info[0] < 0x80000004) {
+		return false;
+	}
+	for (unsigned i = 0; i != 3; ++i) {
+		__cpuid(info, 0x80000002 + i);
+		memcpy(brand + 4 * i, info, sizeof(info));
+	}
+#else
+	if (__get_cpuid_max(0x80000000, NULL) < 0x80000004) {
+		return false;
+	}
+	for (unsigned i = 0; i != 3; ++i) {
+		__get_cpuid(0x80000002 + i, &brand[4 * i], &brand[4 * i + 1], &brand[4 * i + 2], &brand[4 * i + 3]);
+	}
+#endif
+	char const* model = (char const*)brand;
+	size_t length = strnlen(model, sizeof(brand));
+	while (length && *model == ' ') {
+		++model;
+		--length;
+	}
+	snprintf(buf, size, "%.*s", (int)length, model);
+	return length != 0;
+}
+#elif defined(__linux__)
+// the first line of /proc/cpuinfo naming the CPU, ARM kernels only tell the part number
+static bool ethash_cpu_model_query(char* buf, size_t size)
+{
+	static char const* const keys[] = { "model name", "Hardware", "CPU part" };
+	FILE* f = fopen("/proc/cpuinfo", "r");
+	if (!f) {
+		return false;
+	}
+	char line[256];
+	bool found = false;
+	while (!found && fgets(line, sizeof(line), f)) {
+		for (unsigned k = 0; k != sizeof(keys) / sizeof(keys[0]) && !found; ++k) {
+			char const* value = strchr(line, ':');
+			if (strncmp(line, keys[k], strlen(keys[k])) != 0 || !value) {
+				continue;
+			}
+			value += strspn(value + 1, " \t") + 1;
+			snprintf(buf, size, "%.*s", (int)strcspn(value, "\r\n"), value);
+			found = buf[0] != '\0';
+		}
+	}
+	fclose(f);
+	return found;
+}
+#else
+static bool ethash_cpu_model_query(char* buf, size_t size)
+{
+	(void)buf;
+	(void)size;
+	return false;
+}
+#endif
+
+bool ethash_cpu_model(char* buf, size_t size)
+{
+	if (size == 0) {
+		return false;
+	}
+	buf[0] = '\0';
+	return ethash_cpu_model_query(buf, size);
+}
@@ -0,0 +1,62 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file cpu_features.h
+ * @date 2018
+ *
+ * Runtime detection of the instruction set extensions the SIMD kernels use
+ */
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum ethash_cpu_feature {
+	ETHASH_CPU_SSE41 = 1 << 0,
+	ETHASH_CPU_AVX2 = 1 << 1,
+	ETHASH_CPU_AVX512F = 1 << 2,
+	ETHASH_CPU_POPCNT = 1 << 3,
+	ETHASH_CPU_BMI1 = 1 << 4,
+	ETHASH_CPU_BMI2 = 1 << 5,
+	ETHASH_CPU_NEON = 1 << 6      ///< ARM Advanced SIMD
+};
+
+/**
+ * Get the instruction set extensions usable on the host
+ *
+ * Both the CPU and the operating system have to support an extension for it
+ * to be reported. The result is computed once and cached.
+ *
+ * @return         A bitmask of @ref ethash_cpu_feature values
+ */
+uint32_t ethash_cpu_features(void);
+
+/**
+ * Get the model name of the host CPU, e.g. from the CPUID brand string
+ *
+ * @param[out] buf Receives the null terminated name, truncated to @a size
+ * @param size     Size of @a buf in bytes
+ * @return         false if the name could not be queried, which leaves @a buf empty
+ */
+bool ethash_cpu_model(char* buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
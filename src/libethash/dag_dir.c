@@ -0,0 +1,214 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file dag_dir.c
+ * @date 2018
+ *
+ * Removal of the DAG files of old epochs and revisions. The files of a DAG
+ * directory are grouped by seed, a DAG file with its checkpoints, and the
+ * groups kept newest epoch first while they fit in the limits.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ethash.h"
+#include "internal.h"
+#include "io.h"
+#include "threads.h"
+#include "trace.h"
+
+// The number of epochs whose seeds are recognised in DAG file names
+#define ETHASH_DAG_DIR_EPOCHS 2048
+
+static uint32_t volatile dag_keep_epochs = 0;
+static uint64_t volatile dag_disk_budget = 0;
+
+void ethash_set_dag_keep_epochs(unsigned epochs)
+{
+	ethash_atomic_store_u32(&dag_keep_epochs, epochs);
+}
+
+unsigned ethash_get_dag_keep_epochs(void)
+{
+	return ethash_atomic_load_u32(&dag_keep_epochs);
+}
+
+void ethash_set_dag_disk_budget(uint64_t bytes)
+{
+	ethash_atomic_store_u64(&dag_disk_budget, bytes);
+}
+
+uint64_t ethash_get_dag_disk_budget(void)
+{
+	return ethash_atomic_load_u64(&dag_disk_budget);
+}
+
+struct ethash_dag_dir_file {
+	char* name;
+	uint64_t size;
+	uint64_t hash;               ///< of the seed, see ethash_io_seed_name_hash()
+	uint64_t epoch;              ///< ETHASH_EVENT_NO_EPOCH if the seed was not recognised
+	uint64_t rank;               ///< the order in which groups are kept, see ethash_dag_dir_rank()
+};
+
+struct ethash_dag_dir_listing {
+	struct ethash_dag_dir_file* files;
+	size_t count;
+	size_t capacity;
+	bool failed;                 ///< a file could not be listed, nothing is removed
+	uint64_t keep_hash;
+	uint64_t const* epoch_hashes;
+};
+
+// 0 for the DAG to keep, then the newest epochs, the unrecognised seeds and
+// last the other revisions, which are always removed
+static uint64_t ethash_dag_dir_rank(uint32_t revision, uint64_t hash, uint64_t epoch, uint64_t keep_hash)
+{
+	if (revision != ETHASH_REVISION) {
+		return UINT64_MAX;
+	}
+	if (hash == keep_hash) {
+		return 0;
+	}
+	return epoch == ETHASH_EVENT_NO_EPOCH ? ETHASH_DAG_DIR_EPOCHS + 1 : ETHASH_DAG_DIR_EPOCHS - epoch;
+}
+
+static void ethash_dag_dir_add(char const* name, uint64_t size, void* arg)
+{
+	struct ethash_dag_dir_listing* listing = (struct ethash_dag_dir_listing*)arg;
+	uint32_t revision;
+	uint64_t hash;
+	if (sscanf(name, ETHASH_DAG_FILE_PREFIX "%u-%16" SCNx64, &revision, &hash) != 2) {
+		return;
+	}
+	// a DAG file or its checkpoint, and not a name that happens to start alike
+	char expected[DAG_MUTABLE_NAME_MAX_SIZE];
+	snprintf(expected, sizeof(expected), ETHASH_DAG_FILE_PREFIX "%u-%016" PRIx64, revision, hash);
+	size_t const length = strlen(expected);
+	if (strncmp(name, expected, length) != 0 || (name[length] != '\0' && strncmp(name + length, ".checkpoint", 11) != 0)) {
+		return;
+	}
+	if (listing->count == listing->capacity) {
+		size_t const capacity = listing->capacity ? listing->capacity * 2 : 16;
+		struct ethash_dag_dir_file* files = realloc(listing->files, capacity * sizeof(*files));
+		if (!files) {
+			listing->failed = true;
+			return;
+		}
+		listing->files = files;
+		listing->capacity = capacity;
+	}
+	struct ethash_dag_dir_file* file = &listing->files[listing->count];
+	size_t const name_size = strlen(name) + 1;
+	file->name = malloc(name_size);
+	if (!file->name) {
+		listing->failed = true;
+		return;
+	}
+	memcpy(file->name, name, name_size);
+	file->size = size;
+	file->hash = hash;
+	file->epoch = ETHASH_EVENT_NO_EPOCH;
+	for (uint32_t i = 0; i != ETHASH_DAG_DIR_EPOCHS; ++i) {
+		if (listing->epoch_hashes[i] == hash) {
+			file->epoch = i;
+			break;
+		}
+	}
+	file->rank = ethash_dag_dir_rank(revision, hash, file->epoch, listing->keep_hash);
+	++listing->count;
+}
+
+static int ethash_dag_dir_compare(void const* a, void const* b)
+{
+	struct ethash_dag_dir_file const* x = (struct ethash_dag_dir_file const*)a;
+	struct ethash_dag_dir_file const* y = (struct ethash_dag_dir_file const*)b;
+	if (x->rank != y->rank) {
+		return x->rank < y->rank ? -1 : 1;
+	}
+	return x->hash < y->hash ? -1 : x->hash > y->hash;
+}
+
+uint64_t ethash_dag_dir_collect(char const* dirname, ethash_h256_t const seedhash)
+{
+	uint64_t removed = 0;
+	uint64_t* epoch_hashes = malloc(ETHASH_DAG_DIR_EPOCHS * sizeof(uint64_t));
+	if (!epoch_hashes) {
+		return 0;
+	}
+	for (uint32_t i = 0; i != ETHASH_DAG_DIR_EPOCHS; ++i) {
+		ethash_h256_t const seed = ethash_get_seedhash((uint64_t)i * ETHASH_EPOCH_LENGTH);
+		epoch_hashes[i] = ethash_io_seed_name_hash(&seed);
+	}
+	struct ethash_dag_dir_listing listing = { NULL, 0, 0, false, ethash_io_seed_name_hash(&seedhash), epoch_hashes };
+	if (!ethash_io_list_dir(dirname, ethash_dag_dir_add, &listing) || listing.failed) {
+		ETHASH_CRITICAL("Could not list the DAG directory \"%s\", no DAG file is removed.", dirname);
+		goto free_listing;
+	}
+	qsort(listing.files, listing.count, sizeof(*listing.files), ethash_dag_dir_compare);
+
+	unsigned const keep_epochs = ethash_get_dag_keep_epochs();
+	uint64_t const budget = ethash_get_dag_disk_budget();
+	unsigned kept_epochs = 0;
+	uint64_t kept_bytes = 0;
+	bool full = false;           ///< a group did not fit, the older ones are removed too
+	for (size_t begin = 0, end; begin != listing.count; begin = end) {
+		struct ethash_dag_dir_file const* group = &listing.files[begin];
+		uint64_t bytes = 0;
+		for (end = begin; end != listing.count && listing.files[end].rank == group->rank &&
+			listing.files[end].hash == group->hash; ++end) {
+			bytes += listing.files[end].size;
+		}
+		if (group->rank == 0 || (group->rank != UINT64_MAX && !full &&
+			(keep_epochs == 0 || kept_epochs < keep_epochs) && (budget == 0 || kept_bytes + bytes <= budget))) {
+			++kept_epochs;
+			kept_bytes += bytes;
+			continue;
+		}
+		if (group->rank != UINT64_MAX) {
+			full = true;
+		}
+		uint64_t group_removed = 0;
+		for (size_t i = begin; i != end; ++i) {
+			char* path = ethash_io_create_filename(dirname, listing.files[i].name, strlen(listing.files[i].name));
+			if (path && remove(path) == 0) {
+				group_removed += listing.files[i].size;
+			} else {
+				ETHASH_CRITICAL("Could not remove the old DAG file \"%s\".", listing.files[i].name);
+			}
+			free(path);
+		}
+		if (group_removed) {
+			ethash_trace(ETHASH_EVENT_DAG_FILE_REMOVED, group->epoch, group_removed, 0, ETHASH_DAG_FILE_NONE);
+			removed += group_removed;
+		}
+	}
+
+free_listing:
+	for (size_t i = 0; i != listing.count; ++i) {
+		free(listing.files[i].name);
+	}
+	free(listing.files);
+	free(epoch_hashes);
+	return removed;
+}
+
+void ethash_dag_dir_generated(char const* dirname, ethash_h256_t const seedhash)
+{
+	if (ethash_get_dag_keep_epochs() != 0 || ethash_get_dag_disk_budget() != 0) {
+		ethash_dag_dir_collect(dirname, seedhash);
+	}
+}
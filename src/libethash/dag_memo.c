@@ -0,0 +1,260 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file dag_memo.c
+ * @date 2018
+ *
+ * A direct mapped table of DAG items, split into stripes that are locked
+ * independently so that threads verifying with the same light handler rarely
+ * wait for each other.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ethash.h"
+#include "internal.h"
+#include "dag_memo.h"
+#include "memory_budget.h"
+#include "threads.h"
+
+// Must be a power of two
+#define ETHASH_DAG_MEMO_STRIPES 64
+
+struct ethash_dag_memo_entry {
+	uint32_t tag;                ///< the index of the DAG item plus one, 0 if empty
+	node item;
+};
+
+// padded so that the stripes do not share cache lines
+union ethash_dag_memo_stripe {
+	struct {
+		ethash_mutex_t lock;
+		uint64_t hits;
+		uint64_t misses;
+	} s;
+	char pad[128];
+};
+
+struct ethash_dag_memo {
+	struct ethash_dag_memo_entry* entries;
+	uint32_t mask;               ///< number of entries minus one
+	union ethash_dag_memo_stripe stripes[ETHASH_DAG_MEMO_STRIPES];
+};
+
+// The entries of a memo of at most @a max_bytes, 0 if that is too small
+static uint64_t ethash_dag_memo_entries(size_t max_bytes)
+{
+	size_t const max_entries = max_bytes / sizeof(struct ethash_dag_memo_entry);
+	if (max_entries < ETHASH_DAG_MEMO_STRIPES) {
+		return 0;
+	}
+	// a DAG has fewer than 2^32 items, so more entries would never be used
+	uint64_t entries = ETHASH_DAG_MEMO_STRIPES;
+	while (entries * 2 <= max_entries && entries * 2 <= ((uint64_t)1 << 31)) {
+		entries *= 2;
+	}
+	return entries;
+}
+
+// The bytes of a memo of @a entries counted against the memory budget
+static uint64_t ethash_dag_memo_bytes(uint64_t entries)
+{
+	return entries ? sizeof(struct ethash_dag_memo) + entries * sizeof(struct ethash_dag_memo_entry) : 0;
+}
+
+struct ethash_dag_memo* ethash_dag_memo_new(size_t max_bytes)
+{
+	uint64_t const entries = ethash_dag_memo_entries(max_bytes);
+	if (!entries) {
+		return NULL;
+	}
+	struct ethash_dag_memo* ret = calloc(1, sizeof(*ret));
+	if (!ret) {
+		return NULL;
+	}
+	ret->entries = calloc((size_t)entries, sizeof(struct ethash_dag_memo_entry));
+	if (!ret->entries) {
+		free(ret);
+		return NULL;
+	}
+	ret->mask = (uint32_t)(entries - 1);
+	unsigned i = 0;
+	for (; i != ETHASH_DAG_MEMO_STRIPES; ++i) {
+		if (!ethash_mutex_init(&ret->stripes[i].s.lock)) {
+			goto fail;
+		}
+	}
+	return ret;
+
+fail:
+	while (i--) {
+		ethash_mutex_destroy(&ret->stripes[i].s.lock);
+	}
+	free(ret->entries);
+	free(ret);
+	return NULL;
+}
+
+void ethash_dag_memo_delete(struct ethash_dag_memo* memo)
+{
+	if (!memo) {
+		return;
+	}
+	for (unsigned i = 0; i != ETHASH_DAG_MEMO_STRIPES; ++i) {
+		ethash_mutex_destroy(&memo->stripes[i].s.lock);
+	}
+	free(memo->entries);
+	free(memo);
+}
+
+// consecutive DAG items land in different stripes
+static inline uint32_t ethash_dag_memo_slot(struct ethash_dag_memo const* memo, uint32_t index)
+{
+	return (index * 2654435761U) & memo->mask;
+}
+
+static bool ethash_dag_memo_get(struct ethash_dag_memo* memo, uint32_t index, node* ret)
+{
+	uint32_t const slot = ethash_dag_memo_slot(memo, index);
+	union ethash_dag_memo_stripe* const stripe = &memo->stripes[slot & (ETHASH_DAG_MEMO_STRIPES - 1)];
+	ethash_mutex_lock(&stripe->s.lock);
+	bool const hit = memo->entries[slot].tag == index + 1;
+	if (hit) {
+		*ret = memo->entries[slot].item;
+		++stripe->s.hits;
+	} else {
+		++stripe->s.misses;
+	}
+	ethash_mutex_unlock(&stripe->s.lock);
+	return hit;
+}
+
+static void ethash_dag_memo_put(struct ethash_dag_memo* memo, uint32_t index, node const* item)
+{
+	uint32_t const slot = ethash_dag_memo_slot(memo, index);
+	union ethash_dag_memo_stripe* const stripe = &memo->stripes[slot & (ETHASH_DAG_MEMO_STRIPES - 1)];
+	ethash_mutex_lock(&stripe->s.lock);
+	memo->entries[slot].tag = index + 1;
+	memo->entries[slot].item = *item;
+	ethash_mutex_unlock(&stripe->s.lock);
+}
+
+void ethash_light_dag_items(
+	node* ret,
+	uint32_t first_index,
+	uint32_t count,
+	ethash_light_t const light
+)
+{
+	if (first_index + (uint64_t)count <= light->dag_prefix_nodes) {
+		memcpy(ret, (node const*)light->dag_prefix.base + first_index, count * sizeof(node));
+		return;
+	}
+	struct ethash_dag_memo* const memo = light->memo;
+	// the light hashes ask for 2 or 4 items at a time
+	if (!memo || count > 32) {
+		ethash_calculate_dag_items(ret, first_index, count, light);
+		return;
+	}
+	uint32_t missed = 0;         // bit i set if item first_index + i is not in the memo
+	for (uint32_t i = 0; i != count; ++i) {
+		if (!ethash_dag_memo_get(memo, first_index + i, &ret[i])) {
+			missed |= 1U << i;
+		}
+	}
+	if (!missed) {
+		return;
+	}
+	// the batch kernel hashes a few items in about the time of one
+	ethash_calculate_dag_items(ret, first_index, count, light);
+	for (uint32_t i = 0; i != count; ++i) {
+		if (missed & 1U << i) {
+			ethash_dag_memo_put(memo, first_index + i, &ret[i]);
+		}
+	}
+}
+
+void ethash_light_dag_items_at(
+	node* ret,
+	uint32_t const* indices,
+	uint32_t count,
+	ethash_light_t const light
+)
+{
+	struct ethash_dag_memo* const memo = light->memo;
+	// the items neither in the prefix nor in the memo, computed together
+	ETHASH_ALIGNED(64) node missed_items[ETHASH_MAX_LIGHT_INTERLEAVE * MIX_NODES];
+	uint32_t missed_indices[ETHASH_MAX_LIGHT_INTERLEAVE * MIX_NODES];
+	uint32_t missed_at[ETHASH_MAX_LIGHT_INTERLEAVE * MIX_NODES];
+	uint32_t missed = 0;
+	for (uint32_t i = 0; i != count; ++i) {
+		if (indices[i] < light->dag_prefix_nodes) {
+			ret[i] = ((node const*)light->dag_prefix.base)[indices[i]];
+		} else if (!memo || !ethash_dag_memo_get(memo, indices[i], &ret[i])) {
+			missed_indices[missed] = indices[i];
+			missed_at[missed++] = i;
+		}
+	}
+	if (!missed) {
+		return;
+	}
+	ethash_calculate_dag_items_at(missed_items, missed_indices, missed, light);
+	for (uint32_t m = 0; m != missed; ++m) {
+		ret[missed_at[m]] = missed_items[m];
+		if (memo) {
+			ethash_dag_memo_put(memo, missed_indices[m], &missed_items[m]);
+		}
+	}
+}
+
+bool ethash_light_set_memo(ethash_light_t light, size_t max_bytes)
+{
+	struct ethash_dag_memo* memo = NULL;
+	uint64_t const bytes = ethash_dag_memo_bytes(ethash_dag_memo_entries(max_bytes));
+	if (max_bytes) {
+		if (!bytes || !ethash_budget_reserve(bytes)) {
+			return false;
+		}
+		memo = ethash_dag_memo_new(max_bytes);
+		if (!memo) {
+			ethash_budget_release(bytes);
+			return false;
+		}
+	}
+	uint64_t const old_bytes = light->memo ? ethash_dag_memo_bytes((uint64_t)light->memo->mask + 1) : 0;
+	ethash_dag_memo_delete(light->memo);
+	ethash_budget_release(old_bytes);
+	light->budget_bytes += bytes - old_bytes;
+	light->memo = memo;
+	return true;
+}
+
+ethash_light_memo_stats_t ethash_light_memo_stats(ethash_light_t light)
+{
+	ethash_light_memo_stats_t ret = {0, 0, 0};
+	struct ethash_dag_memo* const memo = light->memo;
+	if (!memo) {
+		return ret;
+	}
+	ret.entries = (uint64_t)memo->mask + 1;
+	for (unsigned i = 0; i != ETHASH_DAG_MEMO_STRIPES; ++i) {
+		ethash_mutex_lock(&memo->stripes[i].s.lock);
+		ret.hits += memo->stripes[i].s.hits;
+		ret.misses += memo->stripes[i].s.misses;
+		ethash_mutex_unlock(&memo->stripes[i].s.lock);
+	}
+	return ret;
+}
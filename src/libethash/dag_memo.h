@@ -0,0 +1,77 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file dag_memo.h
+ * @date 2018
+ *
+ * Memo of the DAG items computed by the light hashes of a light handler, see
+ * @ref ethash_light_set_memo(), and the lookup of the DAG items of light
+ * hashes in it and in the DAG prefix of @ref ethash_light_set_dag_prefix()
+ */
+#pragma once
+#include "internal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ethash_dag_memo;
+
+/**
+ * Allocate a memo of as many DAG items as fit in @a max_bytes, rounded down
+ * to a power of two
+ *
+ * @return               The memo or NULL if @a max_bytes is too small or the
+ *                       memory could not be allocated
+ */
+struct ethash_dag_memo* ethash_dag_memo_new(size_t max_bytes);
+
+/**
+ * Free a memo from @ref ethash_dag_memo_new(). NULL is ignored
+ */
+void ethash_dag_memo_delete(struct ethash_dag_memo* memo);
+
+/**
+ * Calculate the consecutive DAG items first_index, ..., first_index + count - 1
+ * for a light hash
+ *
+ * Same as @ref ethash_calculate_dag_items(), but reads the DAG prefix and
+ * goes through the memo of @a light if it has them.
+ */
+void ethash_light_dag_items(
+	node* ret,
+	uint32_t first_index,
+	uint32_t count,
+	ethash_light_t const light
+);
+
+/**
+ * Calculate the DAG items at @a indices for interleaved light hashes
+ *
+ * Same as @ref ethash_calculate_dag_items_at(), but reads the DAG prefix and
+ * goes through the memo of @a light if it has them. @a count is at most
+ * ETHASH_MAX_LIGHT_INTERLEAVE * MIX_NODES.
+ */
+void ethash_light_dag_items_at(
+	node* ret,
+	uint32_t const* indices,
+	uint32_t count,
+	ethash_light_t const light
+);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,192 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file dispatch.c
+ * @date 2018
+ */
+
+#include "dispatch.h"
+#include "cpu_features.h"
+#include "threads.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(WITH_CRYPTOPP)
+void ethash_cryptopp_sha3_256(uint8_t* out, uint8_t const* in, size_t size);
+void ethash_cryptopp_sha3_512(uint8_t* out, uint8_t const* in, size_t size);
+
+static ethash_keccakf1600_kernel_t const keccakf1600_kernels[] = {
+	{ "cryptopp", 0, NULL, ethash_cryptopp_sha3_256, ethash_cryptopp_sha3_512, NULL }
+};
+#else
+void ethash_keccakf1600(uint64_t state[25]);
+void ethash_keccakf1600_opt64(uint64_t state[25]);
+#if defined(ETHASH_X86)
+void ethash_keccakf1600_bmi2(uint64_t state[25]);
+#endif
+#if defined(ETHASH_WITH_OPENSSL)
+void ethash_openssl_sha3_256(uint8_t* out, uint8_t const* in, size_t size);
+void ethash_openssl_sha3_512(uint8_t* out, uint8_t const* in, size_t size);
+bool ethash_openssl_available(void);
+#endif
+#if defined(ETHASH_WITH_XKCP)
+void ethash_xkcp_sha3_256(uint8_t* out, uint8_t const* in, size_t size);
+void ethash_xkcp_sha3_512(uint8_t* out, uint8_t const* in, size_t size);
+bool ethash_xkcp_available(void);
+#endif
+
+// the library backends come after the permutations they seldom beat on the
+// short inputs of ethash, so only ethash_set_kernel() or
+// ethash_keccak_benchmark() picks them
+static ethash_keccakf1600_kernel_t const keccakf1600_kernels[] = {
+#if defined(ETHASH_X86)
+	{ "bmi2", ETHASH_CPU_BMI1 | ETHASH_CPU_BMI2, ethash_keccakf1600_bmi2, NULL, NULL, NULL },
+#endif
+	{ "opt64", 0, ethash_keccakf1600_opt64, NULL, NULL, NULL },
+#if defined(ETHASH_WITH_OPENSSL)
+	{ "openssl", 0, ethash_keccakf1600_opt64, ethash_openssl_sha3_256, ethash_openssl_sha3_512, ethash_openssl_available },
+#endif
+#if defined(ETHASH_WITH_XKCP)
+	{ "xkcp", 0, ethash_keccakf1600_opt64, ethash_xkcp_sha3_256, ethash_xkcp_sha3_512, ethash_xkcp_available },
+#endif
+	{ "generic", 0, ethash_keccakf1600, NULL, NULL, NULL }
+};
+#endif
+
+static ethash_keccakf800_kernel_t const keccakf800_kernels[] = {
+#if defined(ETHASH_X86)
+	{ "bmi2", ETHASH_CPU_BMI1 | ETHASH_CPU_BMI2, keccak_f800_bmi2 },
+#endif
+	{ "unrolled", 0, keccak_f800_unrolled },
+	{ "generic", 0, keccak_f800 }
+};
+
+static ethash_progpow_loop_kernel_t const progpow_loop_kernels[] = {
+#if defined(ETHASH_PROGPOW_SIMD)
+	{ "avx512", ETHASH_CPU_AVX512F, progPowLoop_avx512, progPowFillMix_avx512, progPowReduceMix_avx512 },
+	{ "avx2", ETHASH_CPU_AVX2, progPowLoop_avx2, progPowFillMix_avx2, progPowReduceMix_avx2 },
+#endif
+#if defined(ETHASH_PROGPOW_NEON)
+	{ "neon", ETHASH_CPU_NEON, progPowLoop_neon, progPowFillMix_neon, progPowReduceMix_neon },
+#endif
+	{ "generic", 0, progPowLoop, progPowFillMix, progPowReduceMix }
+};
+
+#define KERNEL_COUNT(list) (sizeof(list) / sizeof(list[0]))
+
+// the i-th entry of a kernel list whose required features are all present
+#define KERNEL_AT(list, i)												\
+	do {																\
+		uint32_t const features = ethash_cpu_features();				\
+		for (unsigned k = 0; k != KERNEL_COUNT(list); ++k) {			\
+			uint32_t const required = list[k].required_features;		\
+			if ((required & features) == required && i-- == 0) {		\
+				return &list[k];										\
+			}															\
+		}																\
+		return NULL;													\
+	} while (0)
+
+ethash_keccakf1600_kernel_t const* ethash_keccakf1600_kernel_at(unsigned i)
+{
+	// KERNEL_AT, skipping the backends whose library cannot hash
+	uint32_t const features = ethash_cpu_features();
+	for (unsigned k = 0; k != KERNEL_COUNT(keccakf1600_kernels); ++k) {
+		ethash_keccakf1600_kernel_t const* kernel = &keccakf1600_kernels[k];
+		uint32_t const required = kernel->required_features;
+		if ((required & features) == required && (!kernel->available || kernel->available()) && i-- == 0) {
+			return kernel;
+		}
+	}
+	return NULL;
+}
+
+ethash_keccakf800_kernel_t const* ethash_keccakf800_kernel_at(unsigned i)
+{
+	KERNEL_AT(keccakf800_kernels, i);
+}
+
+ethash_progpow_loop_kernel_t const* ethash_progpow_loop_kernel_at(unsigned i)
+{
+	KERNEL_AT(progpow_loop_kernels, i);
+}
+
+static ethash_once_t kernels_once = ETHASH_ONCE_INIT;
+static ethash_kernels_t kernels;
+static char kernels_description[256];
+
+static void kernels_describe(void)
+{
+	snprintf(
+		kernels_description,
+		sizeof(kernels_description),
+		"keccakf1600=%s sha3_multi=%s keccakf800=%s keccakf800_multi=%s fnv=%s progpow_loop=%s",
+		kernels.keccakf1600->name,
+		kernels.sha3_multi->name,
+		kernels.keccakf800->name,
+		kernels.keccakf800_multi->name,
+		kernels.fnv->name,
+		kernels.progpow_loop->name
+	);
+}
+
+static void kernels_init(void)
+{
+	kernels.keccakf1600 = ethash_keccakf1600_kernel_at(0);
+	kernels.sha3_multi = ethash_sha3_multi_kernel_at(0);
+	kernels.keccakf800 = ethash_keccakf800_kernel_at(0);
+	kernels.keccakf800_multi = ethash_keccakf800_multi_kernel_at(0);
+	kernels.fnv = ethash_fnv_kernel_at(0);
+	kernels.progpow_loop = ethash_progpow_loop_kernel_at(0);
+	kernels_describe();
+}
+
+ethash_kernels_t const* ethash_kernels(void)
+{
+	ethash_call_once(&kernels_once, kernels_init);
+	return &kernels;
+}
+
+char const* ethash_get_active_kernels(void)
+{
+	ethash_kernels();
+	return kernels_description;
+}
+
+// select the kernel of family field named name, or the first one for NULL
+#define KERNEL_SET(field, at)											\
+	if (strcmp(family, #field) == 0) {									\
+		for (unsigned i = 0; at(i); ++i) {								\
+			if (!name || strcmp(at(i)->name, name) == 0) {				\
+				kernels.field = at(i);									\
+				kernels_describe();										\
+				return true;											\
+			}															\
+		}																\
+		return false;													\
+	}
+
+bool ethash_set_kernel(char const* family, char const* name)
+{
+	ethash_kernels();
+	KERNEL_SET(keccakf1600, ethash_keccakf1600_kernel_at);
+	KERNEL_SET(sha3_multi, ethash_sha3_multi_kernel_at);
+	KERNEL_SET(keccakf800, ethash_keccakf800_kernel_at);
+	KERNEL_SET(keccakf800_multi, ethash_keccakf800_multi_kernel_at);
+	KERNEL_SET(fnv, ethash_fnv_kernel_at);
+	KERNEL_SET(progpow_loop, ethash_progpow_loop_kernel_at);
+	return false;
+}
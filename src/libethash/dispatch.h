@@ -0,0 +1,112 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file dispatch.h
+ * @date 2018
+ *
+ * Runtime selection of the hot kernels of libethash. Every kernel family has
+ * a list of implementations, fastest first, ending with a portable one that
+ * is always available. The first implementation whose instruction set
+ * extensions are supported by the host is picked once, on first use.
+ */
+#pragma once
+#include "internal.h"
+#include "fnv_kernels.h"
+#include "sha3_multi.h"
+#include "progpow_kernels.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*ethash_keccakf1600_fn)(uint64_t state[25]);
+typedef void (*ethash_sha3_fn)(uint8_t* out, uint8_t const* in, size_t size);
+typedef void (*ethash_keccakf800_fn)(uint32_t state[25]);
+typedef void (*ethash_progpow_loop_fn)(
+	progpow_program_t const* prog,
+	const uint32_t loop,
+	ethash_light_t const light,
+	uint32_t mix[PROGPOW_LANES][PROGPOW_REGS],
+	const uint32_t* g_dag,
+	const uint32_t* c_dag,
+	ethash_fastmod_t const* dag_entries
+);
+typedef void (*ethash_progpow_fill_mix_fn)(uint64_t seed, uint32_t mix[PROGPOW_LANES][PROGPOW_REGS]);
+typedef void (*ethash_progpow_reduce_mix_fn)(uint32_t mix[PROGPOW_LANES][PROGPOW_REGS], uint32_t digest[8]);
+
+/**
+ * A Keccak-f[1600] permutation, or a library backend that hashes whole
+ * inputs. The sponge of sha3.c calls sha3_256 and sha3_512 when they are set
+ * and keeps @a permute for the truncated outputs.
+ */
+typedef struct ethash_keccakf1600_kernel {
+	char const* name;
+	uint32_t required_features;    ///< Mask of @ref ethash_cpu_feature values
+	ethash_keccakf1600_fn permute; ///< NULL when SHA3 comes from CryptoPP
+	ethash_sha3_fn sha3_256;       ///< Keccak-256 into 32 bytes, NULL for permutations
+	ethash_sha3_fn sha3_512;       ///< Keccak-512 into 64 bytes, NULL for permutations
+	bool (*available)(void);       ///< false when the library lacks Keccak, NULL if always there
+} ethash_keccakf1600_kernel_t;
+
+typedef struct ethash_keccakf800_kernel {
+	char const* name;
+	uint32_t required_features;
+	ethash_keccakf800_fn permute;  ///< All 22 rounds of Keccak-f[800]
+} ethash_keccakf800_kernel_t;
+
+typedef struct ethash_progpow_loop_kernel {
+	char const* name;
+	uint32_t required_features;
+	ethash_progpow_loop_fn loop;   ///< One iteration of the ProgPoW main loop
+	ethash_progpow_fill_mix_fn fill_mix;     ///< The mix of all lanes before the first iteration
+	ethash_progpow_reduce_mix_fn reduce_mix; ///< The mix hash after the last iteration
+} ethash_progpow_loop_kernel_t;
+
+typedef struct ethash_kernels {
+	ethash_keccakf1600_kernel_t const* keccakf1600;
+	ethash_sha3_multi_kernel_t const* sha3_multi;
+	ethash_keccakf800_kernel_t const* keccakf800;
+	ethash_keccakf800_multi_kernel_t const* keccakf800_multi;
+	ethash_fnv_kernel_t const* fnv;
+	ethash_progpow_loop_kernel_t const* progpow_loop;
+} ethash_kernels_t;
+
+/**
+ * Get the kernels selected for the host
+ *
+ * The selection is made once, on the first call from any thread.
+ */
+ethash_kernels_t const* ethash_kernels(void);
+
+/**
+ * Enumerate the implementations of a kernel family supported by the host,
+ * fastest first. They return NULL once @a i is past the last one, which is
+ * always the portable implementation.
+ */
+ethash_keccakf1600_kernel_t const* ethash_keccakf1600_kernel_at(unsigned i);
+ethash_keccakf800_kernel_t const* ethash_keccakf800_kernel_at(unsigned i);
+ethash_progpow_loop_kernel_t const* ethash_progpow_loop_kernel_at(unsigned i);
+
+/**
+ * Check the Keccak-256 and Keccak-512 of a keccakf1600 kernel against known
+ * answers and, where sha3.c is built, against the portable sponge for inputs
+ * of up to three blocks
+ */
+bool ethash_keccakf1600_kernel_check(ethash_keccakf1600_kernel_t const* kernel);
+
+#ifdef __cplusplus
+}
+#endif
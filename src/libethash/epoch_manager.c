@@ -0,0 +1,342 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file epoch_manager.c
+ * @date 2018
+ *
+ * Keeps the DAG of the current epoch and builds the one of the next epoch in
+ * the background, see @ref ethash_epoch_manager_new()
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ethash.h"
+#include "internal.h"
+#include "io.h"
+#include "threads.h"
+
+// a DAG handed out by the manager, alive for as long as it is referenced
+struct ethash_epoch_entry {
+	uint64_t epoch;
+	ethash_full_t full;
+	unsigned refs;
+	struct ethash_epoch_entry* next;
+};
+
+struct ethash_epoch_manager {
+	char* dirname;               ///< the DAG directory or NULL for DAGs in memory only
+	uint64_t prefetch_blocks;
+	unsigned num_threads;
+	uint64_t cache_size;         ///< fixed cache size or 0 for the size of each epoch
+	uint64_t full_size;          ///< fixed DAG size or 0 for the size of each epoch
+	ethash_callback_t callback;
+
+	ethash_mutex_t lock;         ///< protects everything below
+	ethash_cond_t built;         ///< signalled whenever a build finishes
+	struct ethash_epoch_entry* entries;
+	struct ethash_epoch_entry* current;  ///< holds one reference
+	struct ethash_epoch_entry* upcoming; ///< the last DAG built, holds one reference
+
+	bool building;
+	bool building_low_priority;
+	uint64_t building_epoch;
+	bool last_build_failed;
+	uint64_t last_build_epoch;
+	bool builder_started;        ///< whether @a builder still has to be joined
+	ethash_thread_t builder;
+};
+
+static bool ethash_epoch_manager_valid_epoch(ethash_epoch_manager_t manager, uint64_t epoch)
+{
+	return manager->full_size != 0 || epoch < ETHASH_MAX_EPOCHS;
+}
+
+static ethash_full_t ethash_epoch_manager_generate(ethash_epoch_manager_t manager, uint64_t epoch)
+{
+	uint64_t const block_number = epoch * ETHASH_EPOCH_LENGTH;
+	ethash_h256_t const seedhash = ethash_get_seedhash(block_number);
+	uint64_t const cache_size = manager->cache_size ? manager->cache_size : ethash_get_cachesize(block_number);
+	uint64_t const full_size = manager->full_size ? manager->full_size : ethash_get_datasize(block_number);
+	ethash_full_t full;
+	if (manager->dirname && ethash_get_huge_pages() == ETHASH_HUGE_PAGES_OFF &&
+		ethash_get_numa_mode() == ETHASH_NUMA_OFF) {
+		// another process may have generated the DAG file already, share its pages
+		full = ethash_full_attach_internal(manager->dirname, seedhash, full_size);
+		if (full) {
+			return full;
+		}
+	}
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seedhash);
+	if (!light) {
+		return NULL;
+	}
+	if (manager->dirname) {
+		full = ethash_full_new_parallel_internal(
+			manager->dirname,
+			seedhash,
+			full_size,
+			light,
+			manager->num_threads,
+			manager->callback
+		);
+	} else {
+		full = ethash_full_new_memory_internal(full_size, light, manager->num_threads, manager->callback);
+	}
+	ethash_light_delete(light);
+	return full;
+}
+
+// drop a reference to @a entry, the lock must be held
+static void ethash_epoch_manager_unref(ethash_epoch_manager_t manager, struct ethash_epoch_entry* entry)
+{
+	if (--entry->refs != 0) {
+		return;
+	}
+	struct ethash_epoch_entry** link = &manager->entries;
+	while (*link != entry) {
+		link = &(*link)->next;
+	}
+	*link = entry->next;
+	ethash_full_delete(entry->full);
+	free(entry);
+}
+
+static void ethash_epoch_manager_build(void* arg)
+{
+	ethash_epoch_manager_t manager = (ethash_epoch_manager_t)arg;
+	ethash_mutex_lock(&manager->lock);
+	uint64_t const epoch = manager->building_epoch;
+	bool const low_priority = manager->building_low_priority;
+	ethash_mutex_unlock(&manager->lock);
+
+	if (low_priority) {
+		ethash_thread_lower_priority();
+	}
+	ethash_full_t full = ethash_epoch_manager_generate(manager, epoch);
+	struct ethash_epoch_entry* entry = NULL;
+	if (full) {
+		entry = calloc(1, sizeof(*entry));
+		if (!entry) {
+			ethash_full_delete(full);
+		}
+	}
+
+	ethash_mutex_lock(&manager->lock);
+	if (entry) {
+		entry->epoch = epoch;
+		entry->full = full;
+		entry->refs = 1;
+		entry->next = manager->entries;
+		manager->entries = entry;
+		if (manager->upcoming) {
+			ethash_epoch_manager_unref(manager, manager->upcoming);
+		}
+		manager->upcoming = entry;
+	}
+	manager->last_build_failed = !entry;
+	manager->last_build_epoch = epoch;
+	manager->building = false;
+	ethash_cond_broadcast(&manager->built);
+	ethash_mutex_unlock(&manager->lock);
+}
+
+// start building the DAG of @a epoch, the lock must be held and no build running
+static bool ethash_epoch_manager_start(ethash_epoch_manager_t manager, uint64_t epoch, bool low_priority)
+{
+	if (manager->builder_started) {
+		// the previous builder is done, apart from returning
+		ethash_thread_join(manager->builder);
+		manager->builder_started = false;
+	}
+	manager->building = true;
+	manager->building_epoch = epoch;
+	manager->building_low_priority = low_priority;
+	if (!ethash_thread_create(&manager->builder, ethash_epoch_manager_build, manager)) {
+		ETHASH_CRITICAL("Could not start the DAG builder thread.");
+		manager->building = false;
+		return false;
+	}
+	manager->builder_started = true;
+	return true;
+}
+
+ethash_epoch_manager_t ethash_epoch_manager_new_internal(
+	char const* dirname,
+	uint64_t prefetch_blocks,
+	unsigned num_threads,
+	uint64_t cache_size,
+	uint64_t full_size,
+	ethash_callback_t callback
+)
+{
+	struct ethash_epoch_manager* ret = calloc(1, sizeof(*ret));
+	if (!ret) {
+		return NULL;
+	}
+	if (dirname) {
+		size_t const length = strlen(dirname);
+		ret->dirname = malloc(length + 1);
+		if (!ret->dirname) {
+			goto fail_free_manager;
+		}
+		memcpy(ret->dirname, dirname, length + 1);
+	}
+	ret->prefetch_blocks = prefetch_blocks;
+	ret->num_threads = num_threads;
+	ret->cache_size = cache_size;
+	ret->full_size = full_size;
+	ret->callback = callback;
+	if (!ethash_mutex_init(&ret->lock)) {
+		goto fail_free_dirname;
+	}
+	if (!ethash_cond_init(&ret->built)) {
+		goto fail_destroy_lock;
+	}
+	return ret;
+
+fail_destroy_lock:
+	ethash_mutex_destroy(&ret->lock);
+fail_free_dirname:
+	free(ret->dirname);
+fail_free_manager:
+	free(ret);
+	return NULL;
+}
+
+ethash_epoch_manager_t ethash_epoch_manager_new(
+	bool in_memory,
+	uint64_t prefetch_blocks,
+	unsigned num_threads,
+	ethash_callback_t callback
+)
+{
+	char strbuf[256];
+	if (!in_memory && !ethash_get_default_dirname(strbuf, 256)) {
+		return NULL;
+	}
+	return ethash_epoch_manager_new_internal(
+		in_memory ? NULL : strbuf,
+		prefetch_blocks,
+		num_threads,
+		0,
+		0,
+		callback
+	);
+}
+
+void ethash_epoch_manager_delete(ethash_epoch_manager_t manager)
+{
+	ethash_epoch_manager_wait(manager);
+	if (manager->builder_started) {
+		ethash_thread_join(manager->builder);
+	}
+	// DAGs the caller did not release are freed as well
+	while (manager->entries) {
+		struct ethash_epoch_entry* entry = manager->entries;
+		manager->entries = entry->next;
+		ethash_full_delete(entry->full);
+		free(entry);
+	}
+	ethash_cond_destroy(&manager->built);
+	ethash_mutex_destroy(&manager->lock);
+	free(manager->dirname);
+	free(manager);
+}
+
+ethash_full_t ethash_epoch_manager_acquire(ethash_epoch_manager_t manager, uint64_t block_number)
+{
+	uint64_t const epoch = block_number / ETHASH_EPOCH_LENGTH;
+	if (!ethash_epoch_manager_valid_epoch(manager, epoch)) {
+		return NULL;
+	}
+	struct ethash_epoch_entry* entry = NULL;
+	bool waited = false;
+	ethash_mutex_lock(&manager->lock);
+	for (;;) {
+		if (manager->current && manager->current->epoch == epoch) {
+			entry = manager->current;
+			break;
+		}
+		if (manager->upcoming && manager->upcoming->epoch == epoch) {
+			// the swap: holders of the old DAG keep it until they release it
+			if (manager->current) {
+				ethash_epoch_manager_unref(manager, manager->current);
+			}
+			manager->current = manager->upcoming;
+			manager->upcoming = NULL;
+			entry = manager->current;
+			break;
+		}
+		if (!manager->building) {
+			if (waited && manager->last_build_failed && manager->last_build_epoch == epoch) {
+				break;
+			}
+			if (!ethash_epoch_manager_start(manager, epoch, false)) {
+				break;
+			}
+		}
+		waited = waited || manager->building_epoch == epoch;
+		ethash_cond_wait(&manager->built, &manager->lock);
+	}
+	if (!entry) {
+		ethash_mutex_unlock(&manager->lock);
+		return NULL;
+	}
+	entry->refs++;
+
+	uint64_t const next_epoch = epoch + 1;
+	if (manager->prefetch_blocks != 0 &&
+		block_number % ETHASH_EPOCH_LENGTH + manager->prefetch_blocks >= ETHASH_EPOCH_LENGTH &&
+		ethash_epoch_manager_valid_epoch(manager, next_epoch) &&
+		!manager->building &&
+		!(manager->upcoming && manager->upcoming->epoch == next_epoch) &&
+		!(manager->last_build_failed && manager->last_build_epoch == next_epoch)) {
+		ethash_epoch_manager_start(manager, next_epoch, true);
+	}
+	ethash_mutex_unlock(&manager->lock);
+	return entry->full;
+}
+
+void ethash_epoch_manager_release(ethash_epoch_manager_t manager, ethash_full_t full)
+{
+	ethash_mutex_lock(&manager->lock);
+	for (struct ethash_epoch_entry* entry = manager->entries; entry; entry = entry->next) {
+		if (entry->full == full) {
+			ethash_epoch_manager_unref(manager, entry);
+			break;
+		}
+	}
+	ethash_mutex_unlock(&manager->lock);
+}
+
+bool ethash_epoch_manager_wait(ethash_epoch_manager_t manager)
+{
+	ethash_mutex_lock(&manager->lock);
+	while (manager->building) {
+		ethash_cond_wait(&manager->built, &manager->lock);
+	}
+	bool const ok = !manager->last_build_failed;
+	ethash_mutex_unlock(&manager->lock);
+	return ok;
+}
+
+uint64_t ethash_epoch_manager_upcoming_epoch(ethash_epoch_manager_t manager)
+{
+	ethash_mutex_lock(&manager->lock);
+	uint64_t const epoch = manager->upcoming ? manager->upcoming->epoch : UINT64_MAX;
+	ethash_mutex_unlock(&manager->lock);
+	return epoch;
+}
@@ -29,9 +29,10 @@
 #define ETHASH_REVISION 23
 #define ETHASH_DATASET_BYTES_INIT 1073741824U // 2**30
 #define ETHASH_DATASET_BYTES_GROWTH 8388608U  // 2**23
-#define ETHASH_CACHE_BYTES_INIT 1073741824U // 2**24
+#define ETHASH_CACHE_BYTES_INIT 16777216U // 2**24
 #define ETHASH_CACHE_BYTES_GROWTH 131072U  // 2**17
 #define ETHASH_EPOCH_LENGTH 30000U
+#define ETHASH_MAX_EPOCHS 32640   // the epochs of Ethereum whose DAG pages 32-bit indices address
 #define ETHASH_MIX_BYTES 128
 #define ETHASH_HASH_BYTES 64
 #define ETHASH_DATASET_PARENTS 512
@@ -39,9 +40,21 @@
 #define ETHASH_ACCESSES 64
 #define ETHASH_DAG_MAGIC_NUM_SIZE 8
 #define ETHASH_DAG_MAGIC_NUM 0xFEE1DEADBADDCAFE
+#define ETHASH_DAG_HEADER_SIZE 4096 // the header of a DAG file padded to a page, so mapped nodes are page aligned
+#define ETHASH_CACHE_MAGIC_NUM_SIZE 8
+#define ETHASH_CACHE_MAGIC_NUM 0xFEE1DEADCACEC0DE
+#define ETHASH_CACHE_HEADER_SIZE 4096 // the magic number of a light cache file padded to a page
+#define ETHASH_DAG_CHECKPOINT_MAGIC_NUM 0xFEE1DEAD5AFEC0DE
+#define ETHASH_DAG_SLICE_MAGIC_NUM 0xFEE1DEAD511CEC0D
+#define ETHASH_SEED_PACKAGE_MAGIC_NUM 0xFEE1DEAD5EEDCA5E
+#define ETHASH_DAG_CHECKSUM_BYTES 16777216U // 2**24, DAG bytes covered by one checksum
 
 #define PROGPOW_MIX_BYTES 256
 
+/// Default number of blocks before an epoch boundary at which an
+/// @ref ethash_epoch_manager_t starts to build the DAG of the next epoch
+#define ETHASH_EPOCH_PREFETCH_BLOCKS 3000U
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -67,6 +80,18 @@ typedef struct ethash_light* ethash_light_t;
 struct ethash_full;
 typedef struct ethash_full* ethash_full_t;
 typedef int(*ethash_callback_t)(unsigned);
+struct ethash_epoch_manager;
+typedef struct ethash_epoch_manager* ethash_epoch_manager_t;
+struct ethash_light_registry;
+typedef struct ethash_light_registry* ethash_light_registry_t;
+struct ethash_light_future;
+typedef struct ethash_light_future* ethash_light_future_t;
+struct ethash_full_future;
+typedef struct ethash_full_future* ethash_full_future_t;
+struct ethash_sync_verifier;
+typedef struct ethash_sync_verifier* ethash_sync_verifier_t;
+struct ethash_chain;
+typedef struct ethash_chain* ethash_chain_t;
 
 typedef struct ethash_return_value {
 	ethash_h256_t result;
@@ -74,14 +99,694 @@ typedef struct ethash_return_value {
 	bool success;
 } ethash_return_value_t;
 
+/// Huge page policy for the light cache and the DAG, see @ref ethash_set_huge_pages()
+enum ethash_huge_pages {
+	ETHASH_HUGE_PAGES_OFF = 0,     ///< Regular pages. The DAG is used straight from its file mapping
+	ETHASH_HUGE_PAGES_TRANSPARENT, ///< Ask for transparent huge pages with madvise(MADV_HUGEPAGE)
+	ETHASH_HUGE_PAGES_2MB,         ///< Explicit 2 MB pages (MAP_HUGETLB), else transparent ones
+	ETHASH_HUGE_PAGES_1GB          ///< Explicit 1 GB pages, else the same as ETHASH_HUGE_PAGES_2MB
+};
+
+/// How the memory of a light cache or a DAG is actually backed
+enum ethash_page_mode {
+	ETHASH_PAGES_DEFAULT = 0,      ///< Anonymous memory with regular pages
+	ETHASH_PAGES_FILE,             ///< Shared mapping of the DAG file with regular pages
+	ETHASH_PAGES_TRANSPARENT,      ///< Anonymous memory advised to use transparent huge pages
+	ETHASH_PAGES_HUGETLB_2MB,      ///< Anonymous memory with explicit 2 MB pages
+	ETHASH_PAGES_HUGETLB_1GB       ///< Anonymous memory with explicit 1 GB pages
+};
+
+/// The NUMA nodes @ref ethash_memory_info_t tells apart, pages on higher ones are not counted per node
+#define ETHASH_MEMORY_INFO_NODES 64
+
+/// What the memory of a light cache or a DAG costs, see @ref ethash_full_memory_info()
+typedef struct ethash_memory_info {
+	uint64_t allocated;          ///< bytes mapped for the handler, NUMA replicas included
+	uint64_t resident;           ///< bytes of them in physical memory
+	uint64_t huge_pages;         ///< bytes of them backed by explicit or transparent huge pages
+	bool file_backed;            ///< whether it maps the DAG or cache file
+	uint64_t locked;             ///< bytes of them locked in physical memory, see ethash_set_memory_lock()
+	/// The resident bytes on each NUMA node
+	uint64_t node_resident[ETHASH_MEMORY_INFO_NODES];
+} ethash_memory_info_t;
+
+/**
+ * Set the huge page policy used by handlers created from now on
+ *
+ * The default is ETHASH_HUGE_PAGES_OFF. With any other policy the DAG
+ * generated for or loaded from the DAG file is kept in anonymous memory
+ * instead of the file mapping, so that it can be backed by huge pages. Every
+ * policy falls back to the next smaller page size when the larger pages are
+ * not available, down to regular pages. On Windows ETHASH_HUGE_PAGES_2MB and
+ * ETHASH_HUGE_PAGES_1GB use large pages if the account holds the
+ * SeLockMemoryPrivilege ("Lock pages in memory"), and nothing else does.
+ */
+void ethash_set_huge_pages(enum ethash_huge_pages policy);
+enum ethash_huge_pages ethash_get_huge_pages(void);
+
+/// NUMA placement of the DAG, see @ref ethash_set_numa_mode()
+enum ethash_numa_mode {
+	ETHASH_NUMA_OFF = 0,    ///< Leave the placement to the operating system
+	ETHASH_NUMA_INTERLEAVE, ///< Interleave the pages of the DAG over all NUMA nodes
+	ETHASH_NUMA_REPLICATE   ///< Keep a copy of the DAG on every NUMA node
+};
+
+/**
+ * Set the NUMA placement used by DAGs created from now on
+ *
+ * The default is ETHASH_NUMA_OFF. Like a huge page policy, any other mode
+ * keeps the DAG in anonymous memory instead of the file mapping. With
+ * ETHASH_NUMA_REPLICATE hashing reads the copy on the node of the calling
+ * thread, at the cost of one DAG worth of memory per node. On hosts with a
+ * single node, or where the placement is not supported, the modes have no
+ * effect beyond that.
+ */
+void ethash_set_numa_mode(enum ethash_numa_mode mode);
+enum ethash_numa_mode ethash_get_numa_mode(void);
+
+/**
+ * Set whether handlers created from now on lock their memory in place
+ *
+ * Disabled by default. Once a handler is complete its memory is locked with
+ * mlock(), VirtualLock() on Windows, so that memory pressure can neither swap
+ * it out nor evict the pages of a DAG file mapping: the light cache with its
+ * ProgPoW cache and DAG prefix, and the DAG with its NUMA replicas and
+ * ProgPoW cache. Locking a DAG file mapping reads all of the file. When the
+ * limit of the process on locked memory (RLIMIT_MEMLOCK, the working set
+ * size on Windows) is in the way it is raised as far as allowed.
+ *
+ * A handler whose memory can't be locked is still created. The failure is
+ * logged and counted in ethash_stats_t::memory_lock_failures, and the
+ * memory info of the handler tells how much of it is locked.
+ */
+void ethash_set_memory_lock(bool enable);
+bool ethash_get_memory_lock(void);
+
+/**
+ * Cap the memory the light caches and DAGs of the process take together
+ *
+ * Every light and full handler counts its cache or DAG size, as given by
+ * ethash_get_cachesize() and ethash_get_datasize() for its epoch, against
+ * the budget from its creation until it is freed, whether its memory is
+ * anonymous or a mapped file. So do the copies made of them: the ProgPoW
+ * caches, the DAG replicas of ETHASH_NUMA_REPLICATE, the DAG prefix of
+ * ethash_light_set_dag_prefix() and the memo of ethash_light_set_memo().
+ * Those of a full handler are left out when they do not fit, the hashes then
+ * read the DAG itself, while setting a prefix or memo fails.
+ *
+ * A creation that does not fit first frees the least recently used caches
+ * nobody holds in the light cache registries of the process, also with a
+ * @a max_wait_ms of 0, then waits up to @a max_wait_ms for other handlers to
+ * be freed. If it still does not fit, or is larger than the whole budget, it
+ * fails as out of memory instead of pushing the process over its limit, and
+ * is counted in ethash_memory_budget_stats_t::rejected.
+ *
+ * Unlimited by default. Handlers created before the budget was set count
+ * against it as well.
+ *
+ * @param max_bytes      The budget, 0 for no limit
+ * @param max_wait_ms    How long a creation waits for other handlers to be freed
+ */
+void ethash_set_memory_budget(uint64_t max_bytes, uint64_t max_wait_ms);
+uint64_t ethash_get_memory_budget(void);
+
+typedef struct ethash_memory_budget_stats {
+	uint64_t reserved;           ///< bytes of the handlers alive now
+	uint64_t peak;               ///< the most bytes reserved at once
+	uint64_t waits;              ///< creations that waited for other handlers to be freed
+	uint64_t evictions;          ///< registry caches freed to make room
+	uint64_t rejected;           ///< creations that failed for lack of memory
+} ethash_memory_budget_stats_t;
+
+/**
+ * Get the counters of the memory budget, summed since the process started
+ */
+ethash_memory_budget_stats_t ethash_get_memory_budget_stats(void);
+
+/// The priority parallel work of libethash runs at, see @ref ethash_set_thread_pool()
+enum ethash_thread_priority {
+	ETHASH_THREAD_PRIORITY_NORMAL = 0, ///< Verification and loading of DAGs
+	ETHASH_THREAD_PRIORITY_LOW         ///< Generation and checksumming of DAGs
+};
+
+/**
+ * Configure the threads all parallel work of libethash shares
+ *
+ * DAG generation, checksums, prefaulting, NUMA replication and batch
+ * verification run on the calling thread plus helpers from one of two pools,
+ * one of normal priority and one of the lowest priority. The pools are
+ * started on first use and stopped before this function returns, to be
+ * started again with the new settings. The calling thread always does its
+ * share, so the work still completes if no helper is free. The long running
+ * threads of @ref ethash_search_start() and @ref ethash_miner_new() are not
+ * taken from the pools.
+ *
+ * @param num_threads    The number of threads of each pool. 0, the
+ *                       default, means one per hardware thread.
+ * @param affinity_mask  The logical processors the threads of the pools may run
+ *                       on, bit n standing for processor n. 0, the default,
+ *                       leaves them unrestricted.
+ */
+void ethash_set_thread_pool(unsigned num_threads, uint64_t affinity_mask);
+
+/**
+ * An executor of the host application running the helpers of parallel work
+ * instead of the pools of @ref ethash_set_thread_pool()
+ *
+ * @a spawn runs @a task(@a arg) on a thread of its own, soon and concurrently
+ * with the caller, and returns true, or returns false if it can't. @a priority
+ * is a hint. A task may start after the work it helps with is complete and
+ * then returns at once.
+ */
+typedef struct ethash_executor {
+	bool (*spawn)(void* user, void (*task)(void* arg), void* arg, enum ethash_thread_priority priority);
+	void* user;
+} ethash_executor_t;
+
+/**
+ * Run the helpers of all parallel work from now on with @a executor, or with
+ * the pools again if it is NULL. The executor is copied.
+ */
+void ethash_set_executor(ethash_executor_t const* executor);
+
+/**
+ * Set how many bytes of the memory of deleted light caches and DAGs are kept
+ * for the handles created next
+ *
+ * Deleting a handle normally unmaps its anonymous memory, and the handle of
+ * the next epoch maps a fresh buffer and faults every page of it in again.
+ * With a pool the buffers of deleted light caches and in memory DAGs are kept
+ * instead, and a new cache or DAG that fits one takes it over. Buffers are
+ * allocated a sixty-fourth larger than asked for while the pool is on, so
+ * that the slightly bigger cache and DAG of the next epochs still fit. DAG
+ * file mappings are never kept. 0, the default, keeps nothing, and lowering
+ * the limit releases kept buffers until the rest fits.
+ */
+void ethash_set_memory_pool(uint64_t bytes);
+uint64_t ethash_get_memory_pool(void);
+
+/**
+ * Get the number of bytes the pool of @ref ethash_set_memory_pool() holds
+ * right now
+ */
+uint64_t ethash_memory_pool_size(void);
+
+/// What a buffer of an @ref ethash_memory_provider_t is for
+enum ethash_memory_use {
+	ETHASH_MEMORY_LIGHT_CACHE = 0, ///< The light cache of an epoch
+	ETHASH_MEMORY_DAG             ///< The DAG of an epoch
+};
+
+/// How the memory of a DAG is about to be used, see @ref ethash_memory_provider_t
+enum ethash_memory_advice {
+	ETHASH_MEMORY_ADVICE_WILLNEED = 0, ///< All of it is read right away
+	ETHASH_MEMORY_ADVICE_RANDOM        ///< Hashing reads it at random from now on
+};
+
+/**
+ * Memory of light caches and DAGs supplied by the application, e.g. from a
+ * shared memory segment, a device or an allocator of its own
+ *
+ * Every function may be NULL to keep what the library does by default. @a alloc
+ * returns @a size bytes aligned to at least 64 bytes, or NULL on failure, and
+ * @a map_file maps @a size bytes of the DAG file @a fd from offset 0,
+ * or returns NULL. @a free releases what either of them returned. @a advise
+ * only gets hints and may ignore them. All of them get @a user as their first
+ * argument. The provider must outlive every handle created with it.
+ */
+typedef struct ethash_memory_provider {
+	void* (*alloc)(void* user, size_t size, enum ethash_memory_use use);
+	void (*free)(void* user, void* base, size_t size);
+	void* (*map_file)(void* user, int fd, size_t size, bool writable);
+	void (*advise)(void* user, void* base, size_t size, enum ethash_memory_advice advice);
+	void* user;
+} ethash_memory_provider_t;
+
+/// How a DAG generated into its file gets there, see @ref ethash_set_dag_write_mode()
+enum ethash_dag_write_mode {
+	ETHASH_DAG_WRITE_MMAP = 0, ///< Compute the DAG straight into a writable shared mapping of the file
+	ETHASH_DAG_WRITE_STREAM    ///< Compute chunks into a buffer and write them with pwrite()
+};
+
+/**
+ * Set how DAG files generated from now on are written
+ *
+ * The default is ETHASH_DAG_WRITE_MMAP, which leaves it to the kernel to
+ * write the dirty pages of the mapping back whenever it sees fit. With
+ * ETHASH_DAG_WRITE_STREAM each 64 MB chunk of the DAG is computed into a
+ * buffer, written with O_DIRECT where the file system supports it, synced and
+ * dropped from the page cache before the next one is computed. The finished
+ * file is then mapped read-only. Huge page and NUMA modes keep writing the
+ * whole DAG from memory once it is complete.
+ */
+void ethash_set_dag_write_mode(enum ethash_dag_write_mode mode);
+enum ethash_dag_write_mode ethash_get_dag_write_mode(void);
+
+/// How an existing DAG file is brought into memory, see @ref ethash_set_dag_load_mode()
+enum ethash_dag_load_mode {
+	ETHASH_DAG_LOAD_LAZY = 0, ///< Fault the pages of the mapping in as hashing first reads them
+	ETHASH_DAG_LOAD_PREFAULT, ///< Read the whole mapping in before the handler is returned
+	ETHASH_DAG_LOAD_READ      ///< Read the file into anonymous memory and close it
+};
+
+/**
+ * Set how DAG files found complete on disk are loaded from now on
+ *
+ * Existing DAG files are mapped read-only unless read. The default is
+ * ETHASH_DAG_LOAD_LAZY, which returns right away but hashes at a fraction of
+ * the normal rate while the pages are read in at random. With
+ * ETHASH_DAG_LOAD_PREFAULT the kernel is asked to read the file ahead and every
+ * page is touched once, on as many threads as given to
+ * ethash_full_new_parallel() or one per hardware thread for 0, so that hashing
+ * runs at full speed from the first hash. See @ref ethash_full_load_time_us().
+ *
+ * ETHASH_DAG_LOAD_READ does not map the file: it is read into anonymous
+ * memory, bypassing the page cache where the file system allows, with as many
+ * reads in flight as there are threads, and closed. The memory is on huge
+ * pages as @ref ethash_set_huge_pages() allows, which file mappings seldom
+ * get, so hashing misses the TLB less. Huge page and NUMA modes always load
+ * DAG files like this, as do memory providers without map_file.
+ */
+void ethash_set_dag_load_mode(enum ethash_dag_load_mode mode);
+enum ethash_dag_load_mode ethash_get_dag_load_mode(void);
+
+/**
+ * Set how many epochs of DAG files a DAG directory keeps
+ *
+ * After a DAG file has been generated the files of the older epochs in its
+ * directory are removed, so that at most @a epochs remain including the new
+ * one, see @ref ethash_dag_dir_collect(). 0, the default, sets no limit.
+ */
+void ethash_set_dag_keep_epochs(unsigned epochs);
+unsigned ethash_get_dag_keep_epochs(void);
+
+/**
+ * Set how many bytes the DAG files of a DAG directory may take
+ *
+ * Like @ref ethash_set_dag_keep_epochs(), the files of the older epochs are
+ * removed after a DAG file has been generated until the rest fits in @a bytes.
+ * The new DAG file is kept even if it alone does not fit. 0, the default,
+ * sets no limit.
+ */
+void ethash_set_dag_disk_budget(uint64_t bytes);
+uint64_t ethash_get_dag_disk_budget(void);
+
+/**
+ * Set whether full hashes prefetch the DAG data they are about to read
+ *
+ * Enabled by default. Ethash hints each page as soon as its index is known,
+ * ProgPoW starts loading the DAG entry of an iteration before running the
+ * cache and math ops of that iteration, and the batch functions prefetch for
+ * the whole batch. Builds defining ETHASH_NO_PREFETCH never prefetch.
+ */
+void ethash_set_prefetch(bool enable);
+bool ethash_get_prefetch(void);
+
+/// The most nonces the batch and search functions hash in lockstep
+#define ETHASH_MAX_HASH_BATCH 8
+
+/**
+ * Set how many nonces @ref ethash_full_search() and @ref progpow_full_search()
+ * hash in lockstep
+ *
+ * More nonces hide more of the latency of the DAG reads, fewer keep the mixes
+ * in fewer registers and cache lines. The best count depends on the host, see
+ * @ref ethash_autotune(). @a count is clamped to 1 to ETHASH_MAX_HASH_BATCH,
+ * the default.
+ */
+void ethash_set_hash_batch(unsigned count);
+unsigned ethash_get_hash_batch(void);
+
+/// The most light hashes @ref ethash_light_verify_batch() interleaves on one thread
+#define ETHASH_MAX_LIGHT_INTERLEAVE 16
+
+/**
+ * Set how many light hashes a thread of @ref ethash_light_verify_batch()
+ * interleaves
+ *
+ * The hashes take turns at every access: each computes the parents of its
+ * DAG items one round at a time, prefetching them, so the cache misses of
+ * all of them are in flight together instead of one after the other.
+ * @a count is clamped to 1 to ETHASH_MAX_LIGHT_INTERLEAVE, 1 hashing the
+ * headers one at a time. The default is 8.
+ */
+void ethash_set_light_interleave(unsigned count);
+unsigned ethash_get_light_interleave(void);
+
+typedef struct ethash_stats {
+	uint64_t light_hashes;         ///< ethash hashes computed from a light cache
+	uint64_t full_hashes;          ///< ethash hashes computed from a full DAG
+	uint64_t progpow_light_hashes; ///< ProgPoW hashes computed from a light cache
+	uint64_t progpow_full_hashes;  ///< ProgPoW hashes computed from a full DAG
+	uint64_t dag_items;            ///< DAG items generated in bulk: full DAGs, light DAG prefixes and memos, ProgPoW caches
+	uint64_t cache_builds;         ///< light caches computed rather than loaded
+	uint64_t cache_build_us;       ///< time spent computing them
+	uint64_t dag_build_us;         ///< wall-clock time spent generating full DAGs and light DAG prefixes
+	uint64_t mapped_bytes;         ///< bytes of DAG and cache files mapped into memory
+	uint64_t read_bytes;           ///< bytes of cache and DAG files read into memory
+	uint64_t written_bytes;        ///< bytes of DAG and cache files written
+	uint64_t verify_failures;      ///< headers rejected by ethash_light_verify_batch() and ethash_full_verify_batch()
+	uint64_t memory_lock_failures; ///< regions of handlers ethash_set_memory_lock() could not lock
+} ethash_stats_t;
+
+/**
+ * Set whether libethash counts the work it does, see ethash_get_stats()
+ *
+ * Disabled by default. A disabled counter costs a load of the flag, an
+ * enabled one an uncontended atomic add of the calling thread's own counter.
+ */
+void ethash_set_stats_enabled(bool enable);
+bool ethash_get_stats_enabled(void);
+
+/**
+ * Get the counters of all threads, summed over the whole process lifetime
+ *
+ * The counters only ever grow while they are enabled, so rates come from
+ * the difference of two calls. Counts done by other threads while this runs
+ * may or may not be included.
+ *
+ * @param[out] stats     The current values
+ */
+void ethash_get_stats(ethash_stats_t* stats);
+
+/// What an access histogram of ethash_access_stats_get() counts
+enum ethash_access_kind {
+	ETHASH_ACCESS_DAG,             ///< DAG pages read by ethash hashes
+	ETHASH_ACCESS_PROGPOW_DAG,     ///< DAG entries read by the ProgPoW loop
+	ETHASH_ACCESS_CACHE,           ///< light cache parents read while computing DAG items
+	ETHASH_ACCESS_KIND_COUNT
+};
+
+/// The bytes of DAG or cache one bucket of an access histogram stands for, a 4 KiB page
+#define ETHASH_ACCESS_BUCKET_BYTES 4096
+/// The buckets of an access histogram, accesses past the last one count towards it
+#define ETHASH_ACCESS_BUCKETS (1U << 21)
+/// One access in this many of every thread is recorded, unless the build sets it
+#ifndef ETHASH_ACCESS_SAMPLE
+#define ETHASH_ACCESS_SAMPLE 64
+#endif
+
+/**
+ * Get whether this build records access histograms, which builds defining
+ * ETHASH_ACCESS_STATS (cmake -DWANT_ACCESS_STATS=ON) do
+ *
+ * Every thread samples its DAG and light cache reads into histograms of its
+ * own, one per ethash_access_kind, for working out offline whether huge
+ * pages, NUMA replicas or caching a hot set would pay off.
+ */
+bool ethash_access_stats_enabled(void);
+
+/**
+ * Add the access histogram of @a kind of every thread to @a counts
+ *
+ * @param kind           What to get the histogram of
+ * @param[in,out] counts Bucket n, the sampled accesses to bytes
+ *                       [n * ETHASH_ACCESS_BUCKET_BYTES, (n + 1) * ETHASH_ACCESS_BUCKET_BYTES),
+ *                       gets the count of the threads added
+ * @param max_buckets    The size of @a counts, buckets past it are left out
+ * @return               The number of buckets up to the last one with any
+ *                       access, 0 for none or if the build records nothing
+ */
+size_t ethash_access_stats_get(enum ethash_access_kind kind, uint64_t* counts, size_t max_buckets);
+
+/**
+ * Write the access histograms of all threads to a CSV file
+ *
+ * Every line is "thread,kind,bucket,count" for a bucket with sampled
+ * accesses, kind being "dag", "progpow_dag" or "cache". Comment lines
+ * starting with '#' give the bucket size and the sampling period first.
+ *
+ * @return               true on success, false if the file could not be
+ *                       written or the build records nothing
+ */
+bool ethash_access_stats_export(char const* path);
+
+/**
+ * Clear the access histograms of all threads
+ */
+void ethash_access_stats_reset(void);
+
+enum ethash_event_type {
+	ETHASH_EVENT_CACHE_BUILD_START, ///< a light cache starts being computed
+	ETHASH_EVENT_CACHE_BUILD_END,   ///< a light cache has been computed
+	ETHASH_EVENT_DAG_FILE_CHECKED,  ///< the DAG file was looked at, see ethash_event::dag_file
+	ETHASH_EVENT_DAG_MAPPED,        ///< a DAG file has been mapped or read into memory
+	ETHASH_EVENT_DAG_MAGIC_WRITTEN, ///< a generated DAG file has been completed with its header
+	ETHASH_EVENT_DAG_DELETED,       ///< a full handler and its DAG have been freed
+	ETHASH_EVENT_DAG_FILE_REMOVED   ///< an old DAG file has been removed, see ethash_dag_dir_collect()
+};
+
+/// What ETHASH_EVENT_DAG_FILE_CHECKED found, and so whether the DAG is loaded or generated
+enum ethash_dag_file {
+	ETHASH_DAG_FILE_NONE,           ///< not an ETHASH_EVENT_DAG_FILE_CHECKED event
+	ETHASH_DAG_FILE_MATCH,          ///< a complete DAG file of the epoch, it is loaded
+	ETHASH_DAG_FILE_MISMATCH,       ///< no usable DAG file, the DAG is generated
+	ETHASH_DAG_FILE_SIZE_MISMATCH   ///< a DAG file of the wrong size, resumed from its checkpoint or generated again
+};
+
+/// The ethash_event::epoch of caches and DAGs whose seed is not one of the first 2048 epochs
+#define ETHASH_EVENT_NO_EPOCH UINT64_MAX
+
+typedef struct ethash_event {
+	enum ethash_event_type type;
+	uint64_t time_us;              ///< when it happened, on the process' monotonic clock
+	uint64_t epoch;                ///< the epoch of the cache or DAG, or ETHASH_EVENT_NO_EPOCH
+	uint64_t size;                 ///< the bytes of the cache, or those of the DAG or its mapping
+	uint64_t duration_us;          ///< how long a build or mapping took, 0 for instant events
+	enum ethash_dag_file dag_file;
+} ethash_event_t;
+
+/**
+ * Called for every ethash_event on the thread the event happened on
+ *
+ * Events can come from any thread, including the background threads of the
+ * async and epoch manager APIs, so the callback must be thread safe.
+ */
+typedef void (*ethash_event_callback_t)(ethash_event_t const* event, void* user);
+
+/**
+ * Set the function receiving the lifecycle events of caches and DAGs
+ *
+ * Unrelated to the progress callback of the DAG generation functions. There
+ * is none by default. The previous callback may still receive the events
+ * being delivered while it is replaced.
+ *
+ * @param callback     The function to call, or NULL to stop the events
+ * @param user         Passed to every call of @a callback
+ */
+void ethash_set_event_callback(ethash_event_callback_t callback, void* user);
+
+/**
+ * Get a short name for an event type, e.g. "dag_mapped", for logging
+ */
+char const* ethash_event_type_name(enum ethash_event_type type);
+
+/**
+ * Remove the DAG files a DAG directory should no longer hold
+ *
+ * Removes the DAG files of other ETHASH_REVISIONs, then those of the oldest
+ * epochs beyond ethash_get_dag_keep_epochs() or ethash_get_dag_disk_budget(),
+ * with their checkpoints. DAGs whose seed is not one of the first 2048 epochs
+ * count as the oldest. Done after generating a DAG file whenever one of the
+ * limits is set. DAG files of the original layout, named "full-R", are left
+ * alone.
+ *
+ * @param dirname      The DAG directory
+ * @param seedhash     The DAG to keep whatever the limits, usually the one in use
+ * @return             The number of bytes removed
+ */
+uint64_t ethash_dag_dir_collect(char const* dirname, ethash_h256_t const seedhash);
+
+/**
+ * Get a short name for a page mode, e.g. "hugetlb-2mb", for logging
+ */
+char const* ethash_page_mode_name(enum ethash_page_mode mode);
+
 /**
  * Allocate and initialize a new ethash_light handler
  *
+ * The cache is loaded from its cache-R<revision>-<seedhash> file in the
+ * default DAG directory when there is a valid one. Otherwise it is computed
+ * and the file is written for the next time.
+ *
  * @param block_number   The block number for which to create the handler
  * @return               Newly allocated ethash_light handler or NULL in case of
  *                       ERRNOMEM or invalid parameters used for @ref ethash_compute_cache_nodes()
  */
 ethash_light_t ethash_light_new(uint64_t block_number);
+/**
+ * Allocate and initialize a new ethash_light handler with its cache in memory
+ * of @a provider
+ *
+ * The cache is always computed and no cache file is read or written.
+ *
+ * @param block_number   The block number for which to create the handler
+ * @param provider       Where the memory of the cache comes from, see @ref ethash_memory_provider_t
+ * @return               Newly allocated ethash_light handler or NULL in case of
+ *                       ERRNOMEM or invalid parameters used for @ref ethash_compute_cache_nodes()
+ */
+ethash_light_t ethash_light_new_with_provider(uint64_t block_number, ethash_memory_provider_t const* provider);
+
+/// The sizes and lengths of a chain of the ethash family, see @ref ethash_chain_new()
+typedef struct ethash_chain_params {
+	uint64_t epoch_length;          ///< blocks per epoch
+	uint64_t cache_bytes_init;      ///< cache bytes of epoch 0, a multiple of 2 * ETHASH_HASH_BYTES
+	uint64_t cache_bytes_growth;    ///< cache bytes added every epoch, a multiple of 2 * ETHASH_HASH_BYTES
+	uint64_t dataset_bytes_init;    ///< DAG bytes of epoch 0, a multiple of 2 * ETHASH_MIX_BYTES
+	uint64_t dataset_bytes_growth;  ///< DAG bytes added every epoch, a multiple of 2 * ETHASH_MIX_BYTES
+	uint64_t progpow_period;        ///< blocks per ProgPoW program
+} ethash_chain_params_t;
+
+/**
+ * Get the parameters of Ethereum, whose sizes are the ones of @ref ethash_get_datasize()
+ * and @ref ethash_get_cachesize(). A starting point for the parameters of other chains.
+ */
+ethash_chain_params_t ethash_chain_params_ethereum(void);
+
+/**
+ * Allocate a new chain of the given parameters
+ *
+ * The cache and DAG sizes of an epoch are the largest ones below
+ * init + growth * epoch bytes that are a prime number of hashes or mix pages,
+ * as for Ethereum. They are computed with a Miller-Rabin test on first use
+ * and remembered for the most recent epochs, so one process can serve the
+ * handlers of several chains without size tables.
+ *
+ * @param params         The parameters of the chain
+ * @return               Newly allocated chain, or NULL in case of ERRNOMEM or
+ *                       parameters that give no valid size
+ */
+ethash_chain_t ethash_chain_new(ethash_chain_params_t const* params);
+/**
+ * Frees a chain. Handlers created for it stay valid
+ */
+void ethash_chain_delete(ethash_chain_t chain);
+/**
+ * Get the epoch of a block of @a chain
+ */
+uint64_t ethash_chain_get_epoch(ethash_chain_t chain, uint64_t block_number);
+/**
+ * Get the cache size of the epoch of a block of @a chain, 0 if it is too
+ * large to address
+ */
+uint64_t ethash_chain_get_cachesize(ethash_chain_t chain, uint64_t block_number);
+/**
+ * Get the DAG size of the epoch of a block of @a chain, 0 if it is too
+ * large to address
+ */
+uint64_t ethash_chain_get_datasize(ethash_chain_t chain, uint64_t block_number);
+/**
+ * Get the seedhash of the epoch of a block of @a chain
+ */
+ethash_h256_t ethash_chain_get_seedhash(ethash_chain_t chain, uint64_t block_number);
+/**
+ * Allocate and initialize a new ethash_light handler of a block of @a chain
+ *
+ * The handler and the full handlers made from it hash with the DAG size and
+ * ProgPoW period of @a chain. Its cache is computed in memory, as the cache
+ * files are named after the seedhash only, which chains share. DAG files are
+ * named the same way, so full handlers of several chains should use
+ * separate directories or @ref ethash_full_new_memory().
+ *
+ * @param chain          The chain of the block
+ * @param block_number   The block number for which to create the handler
+ * @return               Newly allocated ethash_light handler or NULL in case of
+ *                       ERRNOMEM or a block whose sizes are too large
+ */
+ethash_light_t ethash_light_new_for_chain(ethash_chain_t chain, uint64_t block_number);
+/**
+ * Attach to the light cache another process already wrote, without computing anything
+ *
+ * The cache-R<revision>-<seedhash> file in the default DAG directory is mapped
+ * read-only and shared, whatever @ref ethash_set_huge_pages() asks for, so
+ * that all processes of the host use the same pages. It is read once to check
+ * it against the seedhash and checksum of its header.
+ *
+ * @param block_number   The block number for which to create the handler
+ * @return               Newly allocated ethash_light handler, or NULL if there
+ *                       is no valid cache file, e.g. because no process has
+ *                       written it yet. Use @ref ethash_light_new() then.
+ */
+ethash_light_t ethash_light_attach(uint64_t block_number);
+/**
+ * Allocate a new ethash_light handler whose cache is the light cache file, mapped
+ *
+ * The cache-R<revision>-<seedhash> file in the default DAG directory is
+ * computed and written first if there is none, then mapped read-only and
+ * shared like with @ref ethash_light_attach(), and advised as read at random.
+ * The cache then lives in the page cache, shared by all processes of the host
+ * and paged in and out by the kernel as the hashes touch it, instead of
+ * counting in full against the anonymous memory of each process, e.g. of a
+ * memory capped container holding several epochs. Hashing may wait on disk
+ * reads when the kernel has dropped the pages.
+ *
+ * @param block_number   The block number for which to create the handler
+ * @return               Newly allocated ethash_light handler or NULL in case of
+ *                       ERRNOMEM. Without a default DAG directory, or if the
+ *                       file can not be written, the cache is kept in memory.
+ */
+ethash_light_t ethash_light_new_mapped(uint64_t block_number);
+/**
+ * Write the seed package of a light cache, to provision other hosts with
+ *
+ * A seed package holds the light cache and the epoch it belongs to, and is
+ * some 64 times smaller than the DAG generated from it. Shipping the package
+ * and generating the DAG on the receiving host, see
+ * @ref ethash_full_import_seed_package_async(), saves the bandwidth of
+ * shipping the DAG itself.
+ *
+ * @param light          The light handler containing the cache
+ * @param path           The path of the package file
+ * @return               true if the package was written and false otherwise
+ */
+bool ethash_light_export_seed_package(ethash_light_t light, char const* path);
+/**
+ * Load the light cache of a seed package written by
+ * @ref ethash_light_export_seed_package()
+ *
+ * The cache is checked against the SHA3-256 in the package and the sizes of
+ * its epoch, and written to the default DAG directory for
+ * @ref ethash_light_new() to find.
+ *
+ * @param path           The path of the package file
+ * @return               Newly allocated ethash_light handler, or NULL if there
+ *                       is no valid package at @a path
+ */
+ethash_light_t ethash_light_import_seed_package(char const* path);
+/**
+ * Start allocating and initializing a new ethash_light handler in the background
+ *
+ * Does the same as @ref ethash_light_new() on a thread of its own, so that the
+ * caller can keep serving other epochs and check on the cache with
+ * @ref ethash_light_future_poll() meanwhile.
+ *
+ * @param block_number   The block number for which to create the handler
+ * @return               A future to be consumed by either @ref ethash_light_future_wait()
+ *                       or @ref ethash_light_future_cancel(), or NULL in case of ERRNOMEM
+ */
+ethash_light_future_t ethash_light_new_async(uint64_t block_number);
+/**
+ * Check whether the handler of a future is ready, so that
+ * @ref ethash_light_future_wait() returns at once
+ */
+bool ethash_light_future_poll(ethash_light_future_t future);
+/**
+ * Get the progress of a future in percent
+ */
+unsigned ethash_light_future_progress(ethash_light_future_t future);
+/**
+ * Wait for the handler of a future and free the future
+ *
+ * @return               The new ethash_light handler, owned by the caller, or
+ *                       NULL in the same cases as @ref ethash_light_new()
+ */
+ethash_light_t ethash_light_future_wait(ethash_light_future_t future);
+/**
+ * Stop the computation of a future and free it
+ *
+ * Returns once the background thread has stopped.
+ */
+void ethash_light_future_cancel(ethash_light_future_t future);
 /**
  * Frees a previously allocated ethash_light handler
  * @param light        The light handler to free
@@ -102,60 +807,830 @@ ethash_return_value_t ethash_light_compute(
 );
 
 /**
- * Allocate and initialize a new ethash_full handler
+ * Remember the DAG items computed by the light hashes of @a light
  *
- * @param light         The light handler containing the cache.
- * @param callback      A callback function with signature of @ref ethash_callback_t
- *                      It accepts an unsigned with which a progress of DAG calculation
- *                      can be displayed. If all goes well the callback should return 0.
- *                      If a non-zero value is returned then DAG generation will stop.
- *                      Be advised. A progress value of 100 means that DAG creation is
- *                      almost complete and that this function will soon return succesfully.
- *                      It does not mean that the function has already had a succesfull return.
- * @return              Newly allocated ethash_full handler or NULL in case of
- *                      ERRNOMEM or invalid parameters used for @ref ethash_compute_full_data()
+ * Hashing the same headers again, e.g. uncles checked repeatedly or blocks
+ * broadcast more than once, then reads most DAG items back instead of
+ * computing them. The memo is shared by all threads hashing with @a light
+ * and split into independently locked stripes, which costs a little on
+ * hashes that miss it.
+ *
+ * Must not be called while other threads hash with @a light. The memo is
+ * freed with @a light.
+ *
+ * @param light          The light client handler
+ * @param max_bytes      The most memory the memo may use, rounded down to a
+ *                       power of two number of DAG items. 0 removes the memo
+ * @return               true on success, false if @a max_bytes is too small or
+ *                       the memory could not be allocated, leaving any
+ *                       previous memo in place
  */
-ethash_full_t ethash_full_new(ethash_light_t light, ethash_callback_t callback);
+bool ethash_light_set_memo(ethash_light_t light, size_t max_bytes);
+
+typedef struct ethash_light_memo_stats {
+	uint64_t hits;               ///< DAG items read from the memo
+	uint64_t misses;             ///< DAG items that were computed
+	uint64_t entries;            ///< DAG items the memo can hold
+} ethash_light_memo_stats_t;
 
 /**
- * Frees a previously allocated ethash_full handler
- * @param full    The light handler to free
+ * Get the hit counters of the memo of @a light, all zero if it has none
  */
-void ethash_full_delete(ethash_full_t full);
+ethash_light_memo_stats_t ethash_light_memo_stats(ethash_light_t light);
+
 /**
- * Calculate the full client data
+ * Keep the results of up to @a entries light hashes for all light handlers
  *
- * @param full           The full client handler
- * @param header_hash    The header hash to pack into the mix
- * @param nonce          The nonce to pack into the mix
- * @return               An object of ethash_return_value to hold the return value
+ * Nodes verify the same header and nonce several times, from gossip, uncle
+ * inclusion and re-orgs. With a result cache, ethash_light_compute() and
+ * progpow_light_compute() return the mix and result of a hash they already
+ * computed, keyed by the algorithm, the epoch of the cache, the ProgPoW
+ * period, the header hash and the nonce. A new result replaces the one in its
+ * slot. Disabled by default. Safe to call while other threads hash, the
+ * cached results are dropped.
+ *
+ * @param entries        The number of results, rounded down to a power of two
+ *                       and at least 64, 0 to disable the cache
  */
-ethash_return_value_t ethash_full_compute(
-	ethash_full_t full,
-	ethash_h256_t const header_hash,
-	uint64_t nonce
-);
+void ethash_set_result_cache(size_t entries);
+
+typedef struct ethash_result_cache_stats {
+	uint64_t hits;               ///< light hashes answered from the cache
+	uint64_t misses;             ///< light hashes computed while there was a cache
+	uint64_t entries;            ///< results the cache can hold
+} ethash_result_cache_stats_t;
 
 /**
- * Calculate the light client data of the ProgPow
- *
- * @param light          The light client handler
- * @param header_hash    The header hash to pack into the mix
- * @param nonce          The nonce to pack into the mix
- * @param block_number   The block_number
- * @return               an object of ethash_return_value_t holding the return values
+ * Get the counters of the result cache, summed since the process started
  */
-ethash_return_value_t progpow_light_compute(
-	ethash_light_t light,
-	ethash_h256_t const header_hash,
-	uint64_t nonce,
-	uint64_t block_number
-);
+ethash_result_cache_stats_t ethash_get_result_cache_stats(void);
 
 /**
- * Calculate the full client data of the ProgPoW
+ * Keep the first @a max_bytes of the DAG of @a light in memory
  *
- * @param full           The full client handler
+ * Light hashes read the DAG items of this prefix instead of computing them,
+ * so their rate grows with the share of the DAG that is kept. This sits
+ * between light and full mode for verifiers that can not afford the whole
+ * DAG. The prefix holds the ProgPoW cache as well. Items past it are computed,
+ * or come from the memo of @ref ethash_light_set_memo() if there is one.
+ *
+ * Must not be called while other threads hash with @a light. The prefix is
+ * freed with @a light and uses huge pages as set by @ref ethash_set_huge_pages().
+ *
+ * @param light          The light client handler
+ * @param max_bytes      The size of the prefix, rounded down to whole DAG items
+ *                       and capped at the DAG size of the epoch. 0 drops it
+ * @param num_threads    The number of threads computing the prefix, 0 for all
+ *                       hardware threads
+ * @return               true on success, false if the memory could not be
+ *                       allocated, leaving any previous prefix in place
+ */
+bool ethash_light_set_dag_prefix(ethash_light_t light, uint64_t max_bytes, unsigned num_threads);
+
+/**
+ * Get the size in bytes of the DAG prefix kept by @a light
+ */
+uint64_t ethash_light_dag_prefix_size(ethash_light_t light);
+
+/**
+ * Compute the boundary (2^256 / difficulty) hashes are checked against
+ *
+ * Meant to be called once per job, so that verifying and searching never
+ * divide 256 bit numbers.
+ *
+ * @param[out] boundary    The boundary as a big endian number, 2^256 - 1 for
+ *                         a difficulty of 1
+ * @param difficulty       The difficulty as a big endian number
+ * @return                 true on success, false for a difficulty of 0
+ */
+bool ethash_boundary_from_difficulty(ethash_h256_t* boundary, ethash_h256_t const* difficulty);
+
+/**
+ * Check a result against a boundary from @ref ethash_boundary_from_difficulty()
+ *
+ * @param result           The final hash of a nonce
+ * @param boundary         The boundary as a big endian number
+ * @return                 true if @a result is less than or equal to @a boundary
+ */
+bool ethash_check_boundary(ethash_h256_t const* result, ethash_h256_t const* boundary);
+
+/**
+ * Difficulty quick check for POW preverification
+ *
+ * Computes the final hash from the claimed mix hash alone, so a header
+ * can be rejected without building or touching any cache. Passing it does
+ * not prove the mix hash right, only a light or full hash does.
+ *
+ * @param header_hash      The hash of the header
+ * @param nonce            The block's nonce
+ * @param mix_hash         The mix digest hash
+ * @param boundary         The boundary is defined as (2^256 / difficulty)
+ * @return                 true for succesful pre-verification and false otherwise
+ */
+bool ethash_quick_check_difficulty(
+	ethash_h256_t const* header_hash,
+	uint64_t const nonce,
+	ethash_h256_t const* mix_hash,
+	ethash_h256_t const* boundary
+);
+
+/**
+ * Compute the hash of a block header the proof of work is computed on
+ *
+ * This is the Keccak-256 hash of the header's RLP list without its mix hash
+ * and nonce, HashNoNonce() of go-ethereum. Fields after the nonce are hashed
+ * as well, so a header with a base fee gets its SealHash().
+ *
+ * @param[out] seal_hash   The header hash to pass to the compute and verify functions
+ * @param rlp              The RLP encoding of the header
+ * @param size             The size of @a rlp in bytes
+ * @return                 false if @a rlp is not a header of at least 15 fields
+ *                         whose mix hash has 32 and whose nonce has 8 bytes
+ */
+bool ethash_header_seal_hash(ethash_h256_t* seal_hash, uint8_t const* rlp, size_t size);
+
+/**
+ * Decode many RLP encoded block headers for batch verification
+ *
+ * Gives the inputs of @ref ethash_light_verify_batch() and
+ * @ref ethash_sync_verifier_push() for each header, with the header hash
+ * from @ref ethash_header_seal_hash() and the boundary from the difficulty.
+ * Headers that cannot be decoded, or have a difficulty of 0, get all zeros,
+ * which verification rejects.
+ *
+ * @param headers          The RLP encodings of the headers, back to back
+ * @param sizes            The size in bytes of each encoding
+ * @param[out] block_numbers  The block numbers of the headers
+ * @param[out] header_hashes  The seal hashes of the headers
+ * @param[out] nonces         The nonces of the headers
+ * @param[out] mix_hashes     The mix hashes claimed by the headers
+ * @param[out] boundaries     The boundaries (2^256 / difficulty) of the headers
+ * @param[out] decoded        Set to whether each header was decoded
+ * @param count            The number of headers
+ * @return                 The number of headers decoded
+ */
+size_t ethash_header_decode_batch(
+	uint8_t const* headers,
+	size_t const* sizes,
+	uint64_t* block_numbers,
+	ethash_h256_t* header_hashes,
+	uint64_t* nonces,
+	ethash_h256_t* mix_hashes,
+	ethash_h256_t* boundaries,
+	bool* decoded,
+	size_t count
+);
+
+/**
+ * Verify the proofs of work of many headers of the epoch of @a light
+ *
+ * The headers are checked concurrently, all threads sharing the cache of
+ * @a light read-only. Every header first gets the cheap check of its mix
+ * hash against its boundary, and only the ones passing it are hashed.
+ *
+ * @param light          The light client handler
+ * @param header_hashes  The header hashes, without the nonces
+ * @param nonces         The nonces of the headers
+ * @param mix_hashes     The mix hashes claimed by the headers
+ * @param boundaries     The boundaries (2^256 / difficulty) of the headers
+ * @param[out] results   Set to whether each header is valid
+ * @param count          The number of headers
+ * @param num_threads    The number of threads to use, 0 for all hardware threads
+ * @return               The number of valid headers
+ */
+size_t ethash_light_verify_batch(
+	ethash_light_t light,
+	ethash_h256_t const* header_hashes,
+	uint64_t const* nonces,
+	ethash_h256_t const* mix_hashes,
+	ethash_h256_t const* boundaries,
+	bool* results,
+	size_t count,
+	unsigned num_threads
+);
+
+/**
+ * Allocate and initialize a new ethash_full handler
+ *
+ * @param light         The light handler containing the cache.
+ * @param callback      A callback function with signature of @ref ethash_callback_t
+ *                      It accepts an unsigned with which a progress of DAG calculation
+ *                      can be displayed. If all goes well the callback should return 0.
+ *                      If a non-zero value is returned then DAG generation will stop.
+ *                      Be advised. A progress value of 100 means that DAG creation is
+ *                      almost complete and that this function will soon return succesfully.
+ *                      It does not mean that the function has already had a succesfull return.
+ * @return              Newly allocated ethash_full handler or NULL in case of
+ *                      ERRNOMEM or invalid parameters used for @ref ethash_compute_full_data()
+ */
+ethash_full_t ethash_full_new(ethash_light_t light, ethash_callback_t callback);
+
+/**
+ * Allocate and initialize a new ethash_full handler, generating the DAG on
+ * several threads
+ *
+ * @param light         The light handler containing the cache.
+ * @param num_threads   The number of threads to generate the DAG with. Pass 0
+ *                      to use one thread per hardware thread of the host.
+ * @param callback      Same as for @ref ethash_full_new(). The callback may be
+ *                      invoked from any of the worker threads but never concurrently,
+ *                      and a non-zero return value stops all of them.
+ * @return              Newly allocated ethash_full handler or NULL in case of
+ *                      ERRNOMEM or invalid parameters used for @ref ethash_compute_full_data()
+ */
+ethash_full_t ethash_full_new_parallel(ethash_light_t light, unsigned num_threads, ethash_callback_t callback);
+
+/**
+ * Allocate and initialize a new ethash_full handler with its DAG in memory of
+ * @a provider
+ *
+ * Does the same as @ref ethash_full_new_parallel(). An existing or new DAG
+ * file is mapped with the @a map_file of @a provider. A provider with @a alloc
+ * but no @a map_file gets the DAG computed or loaded into its memory and the
+ * DAG file only read or written once, as in the huge page modes. NUMA
+ * placement is left to the provider.
+ *
+ * @param light         The light handler containing the cache.
+ * @param num_threads   Same as for @ref ethash_full_new_parallel()
+ * @param callback      Same as for @ref ethash_full_new()
+ * @param provider      Where the memory of the DAG comes from, see @ref ethash_memory_provider_t
+ * @return              Newly allocated ethash_full handler or NULL in case of
+ *                      ERRNOMEM or invalid parameters used for @ref ethash_compute_full_data()
+ */
+ethash_full_t ethash_full_new_with_provider(
+	ethash_light_t light,
+	unsigned num_threads,
+	ethash_callback_t callback,
+	ethash_memory_provider_t const* provider
+);
+
+/**
+ * Allocate and initialize a new ethash_full handler without a DAG file
+ *
+ * The DAG is generated straight into anonymous memory, huge pages if so
+ * requested with @ref ethash_set_huge_pages(), and the file system is never
+ * touched. Nothing is reused between processes, so every call generates the
+ * whole DAG.
+ *
+ * @param light         The light handler containing the cache.
+ * @param callback      Same as for @ref ethash_full_new()
+ * @return              Newly allocated ethash_full handler or NULL in case of
+ *                      ERRNOMEM or invalid parameters used for @ref ethash_compute_full_data()
+ */
+ethash_full_t ethash_full_new_memory(ethash_light_t light, ethash_callback_t callback);
+
+/**
+ * Allocate a DAG in memory that is generated while it is used
+ *
+ * Returns as soon as the memory of the DAG is reserved. Background threads of
+ * the lowest priority generate it in order, while the hashes of
+ * @ref ethash_full_compute(), @ref ethash_full_compute_batch() and
+ * @ref ethash_full_search() compute the pages still missing from the light
+ * cache and store them for the hashes after them. Mining hence starts at
+ * about the speed of @ref ethash_light_compute() and approaches the full
+ * speed as the DAG fills. @ref ethash_full_dag(), @ref ethash_full_verify()
+ * and the ProgPoW hashes wait for the whole DAG.
+ *
+ * @param light         The light handler containing the cache. It must stay
+ *                      alive until the handler is deleted.
+ * @param num_threads   The number of background threads, 0 for one per
+ *                      hardware thread
+ * @return              Newly allocated ethash_full handler or NULL in case of ERRNOMEM
+ */
+ethash_full_t ethash_full_new_lazy(ethash_light_t light, unsigned num_threads);
+
+/**
+ * Attach to the DAG another process already generated, without a light cache
+ *
+ * The complete DAG file in the default DAG directory is mapped read-only,
+ * whatever @ref ethash_set_huge_pages() and @ref ethash_set_numa_mode() ask
+ * for, so that all processes of the host share its pages. Its size, magic
+ * number and checksum trailer are checked, and the first chunk against its
+ * checksum. @ref ethash_full_verify() checks the rest.
+ *
+ * @param block_number  The block number of the DAG
+ * @return              Newly allocated ethash_full handler, or NULL if there is
+ *                      no valid complete DAG file, e.g. because it is still
+ *                      being generated. Use @ref ethash_full_new() then.
+ */
+ethash_full_t ethash_full_attach(uint64_t block_number);
+
+/**
+ * Compute one slice of the DAG, for hosts sharing a directory to generate a
+ * DAG together
+ *
+ * Each of @a num_ranks hosts computes the slice of its @a rank, about
+ * 1 / @a num_ranks of the DAG nodes, into a slice file in @a slice_dirname,
+ * typically on a network file system. Once all of them are there every host
+ * gathers them into its own DAG file with @ref ethash_full_new_from_slices().
+ *
+ * @param light          The light handler containing the cache
+ * @param slice_dirname  The directory all hosts share. It is created if needed.
+ * @param rank           The index of the slice, below @a num_ranks
+ * @param num_ranks      The number of slices the DAG is split into
+ * @param num_threads    The number of threads to compute the slice with, 0 for
+ *                       one per hardware thread
+ * @param callback       Same as for @ref ethash_full_new_parallel(), may be NULL.
+ *                       The progress is that of the whole DAG, as if the
+ *                       slices before this one had just been computed.
+ * @return               true if the slice file was written and false otherwise
+ */
+bool ethash_full_generate_slice(
+	ethash_light_t light,
+	char const* slice_dirname,
+	unsigned rank,
+	unsigned num_ranks,
+	unsigned num_threads,
+	ethash_callback_t callback
+);
+/**
+ * Gather the slices of @ref ethash_full_generate_slice() into the DAG file in
+ * the default DAG directory and load it
+ *
+ * Every slice is checked against the SHA3-256 its host recorded, and a few of
+ * its nodes are recomputed from @a light, so that a slice of another DAG or
+ * with a flipped bit is refused. The DAG file then gets checksums of its own
+ * as if it had been generated here. If the DAG file is already complete the
+ * slices are not looked at.
+ *
+ * @param light          The light handler containing the cache
+ * @param slice_dirname  The directory all hosts share
+ * @param num_ranks      The number of slices the DAG is split into
+ * @param num_threads    The number of threads to checksum and load the DAG with,
+ *                       0 for one per hardware thread
+ * @return               Newly allocated ethash_full handler, or NULL if a slice
+ *                       is missing, e.g. because its host is not done yet, or
+ *                       does not check out
+ */
+ethash_full_t ethash_full_new_from_slices(
+	ethash_light_t light,
+	char const* slice_dirname,
+	unsigned num_ranks,
+	unsigned num_threads
+);
+
+/**
+ * Start allocating and initializing a new ethash_full handler in the background
+ *
+ * Does the same as @ref ethash_full_new_parallel() or @ref ethash_full_new_memory()
+ * on a thread of its own. The caller keeps running, for example on the DAG of
+ * the previous epoch, and can check on the build with @ref ethash_full_future_poll()
+ * and @ref ethash_full_future_progress().
+ *
+ * @param light         The light handler containing the cache. It must stay
+ *                      alive until the future has been consumed.
+ * @param in_memory     Keep the DAG in memory only instead of in a DAG file in
+ *                      the default directory
+ * @param num_threads   The number of threads to generate the DAG with, 0 for
+ *                      one per hardware thread
+ * @param callback      Same as for @ref ethash_full_new_parallel(), may be NULL
+ * @return              A future to be consumed by either @ref ethash_full_future_wait()
+ *                      or @ref ethash_full_future_cancel(), or NULL in case of ERRNOMEM
+ */
+ethash_full_future_t ethash_full_new_async(
+	ethash_light_t light,
+	bool in_memory,
+	unsigned num_threads,
+	ethash_callback_t callback
+);
+/**
+ * Provision the DAG of a seed package in the background
+ *
+ * The light cache is loaded at once, see @ref ethash_light_import_seed_package(),
+ * so that @ref ethash_full_future_light() can verify blocks while the DAG is
+ * being built. The DAG is then built like with @ref ethash_full_new_async():
+ * loaded if its file is already there and generated on @a num_threads
+ * threads otherwise, with @ref ethash_full_future_progress() following it.
+ *
+ * @param path          The path of the package file
+ * @param in_memory     Keep the DAG in memory only instead of in a DAG file in
+ *                      the default directory
+ * @param num_threads   The number of threads to generate the DAG with, 0 for
+ *                      one per hardware thread
+ * @param callback      Same as for @ref ethash_full_new_parallel(), may be NULL
+ * @return              A future owning the light handler, or NULL if there is
+ *                      no valid package at @a path or in case of ERRNOMEM
+ */
+ethash_full_future_t ethash_full_import_seed_package_async(
+	char const* path,
+	bool in_memory,
+	unsigned num_threads,
+	ethash_callback_t callback
+);
+/**
+ * Get the light handler a future builds the DAG from
+ *
+ * The light handler of @ref ethash_full_import_seed_package_async() is owned
+ * by the future and freed once it is consumed.
+ */
+ethash_light_t ethash_full_future_light(ethash_full_future_t future);
+/**
+ * Check whether the handler of a future is ready, so that
+ * @ref ethash_full_future_wait() returns at once
+ */
+bool ethash_full_future_poll(ethash_full_future_t future);
+/**
+ * Get the number of DAG bytes generated so far, out of @ref ethash_full_dag_size()
+ * of the finished DAG
+ */
+uint64_t ethash_full_future_progress(ethash_full_future_t future);
+/**
+ * Get the handler a future is still building in memory, to hash with it already
+ *
+ * Hashes of @ref ethash_full_compute(), @ref progpow_full_compute() and their
+ * batch and search variants read the nodes generated so far from the DAG and
+ * compute the others from the light cache of the future, so they are the same
+ * as with the finished DAG and get faster as it grows.
+ *
+ * @return              The handler @ref ethash_full_future_wait() returns, or NULL
+ *                      for DAG files and before the DAG memory is allocated. It
+ *                      must not be used any more once the future is consumed
+ *                      unless @ref ethash_full_future_wait() returned it.
+ */
+ethash_full_t ethash_full_future_partial(ethash_full_future_t future);
+/**
+ * Wait for the handler of a future and free the future
+ *
+ * @return              The new ethash_full handler, owned by the caller, or
+ *                      NULL in the same cases as @ref ethash_full_new()
+ */
+ethash_full_t ethash_full_future_wait(ethash_full_future_t future);
+/**
+ * Stop the build of a future and free it
+ *
+ * The worker threads stop after the chunk of nodes they are working on.
+ * Returns once they all have. A partially written DAG file is recreated by
+ * the next build of the same epoch.
+ */
+void ethash_full_future_cancel(ethash_full_future_t future);
+
+/**
+ * Frees a previously allocated ethash_full handler
+ * @param full    The light handler to free
+ */
+void ethash_full_delete(ethash_full_t full);
+/**
+ * Calculate the full client data
+ *
+ * @param full           The full client handler
+ * @param header_hash    The header hash to pack into the mix
+ * @param nonce          The nonce to pack into the mix
+ * @return               An object of ethash_return_value to hold the return value
+ */
+ethash_return_value_t ethash_full_compute(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	uint64_t nonce
+);
+
+/**
+ * Calculate the full client data of many nonces
+ *
+ * The nonces are hashed in groups that advance in lockstep. Each DAG access
+ * prefetches the pages of the whole group before mixing any of them, so the
+ * memory reads of the group overlap instead of waiting on each other. The
+ * results are the same as those of @ref ethash_full_compute().
+ *
+ * @param full           The full client handler
+ * @param header_hash    The header hash to pack into the mix
+ * @param nonces         The @a count nonces to hash
+ * @param results        Caller provided buffer of @a count results
+ * @param count          The number of nonces
+ * @return               true if all the results were computed, false if
+ *                       none were because the DAG size is invalid
+ */
+bool ethash_full_compute_batch(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	uint64_t const* nonces,
+	ethash_return_value_t* results,
+	size_t count
+);
+
+/**
+ * The share of the host the threads of a search or miner take, see
+ * @ref ethash_search_set_throttle() and @ref ethash_miner_set_throttle()
+ *
+ * Throttled threads hash in bursts of a few milliseconds and pause between
+ * them for as long as the strictest of the limits asks. Their batch sizes
+ * follow the measured hash speed, so pauses fall at batch boundaries and
+ * not after every hash.
+ */
+typedef struct ethash_throttle {
+	/// The percentage of wall-clock time each thread hashes, 0 or 100 for all of it
+	unsigned utilization;
+	/// The most nonces per second all threads together hash, a proxy for a
+	/// power budget. 0 for no limit
+	uint64_t max_hash_rate;
+	/// If not NULL, asked for the utilization to use every burst instead of
+	/// @a utilization. Lets a co-located latency sensitive workload take the
+	/// host back as its load rises. Called concurrently on the hashing threads
+	unsigned (*utilization_fn)(void* user);
+	/// Passed to @a utilization_fn
+	void* user;
+} ethash_throttle_t;
+
+typedef struct ethash_search_hit {
+	uint64_t nonce;
+	ethash_h256_t result;
+	ethash_h256_t mix_hash;
+} ethash_search_hit_t;
+
+/**
+ * Search a range of nonces for results below a boundary
+ *
+ * The nonces start_nonce, start_nonce + 1, ..., start_nonce + count - 1 are
+ * hashed in order and every result that is less than or equal to the boundary
+ * is recorded. The search stops early once @a max_hits results have been found,
+ * so with @a max_hits equal to 1 it returns on the first hit.
+ *
+ * @param full           The full client handler
+ * @param header_hash    The header hash to pack into the mix
+ * @param start_nonce    The first nonce to try
+ * @param count          The number of nonces to try
+ * @param boundary       The boundary (2^256 / difficulty) as a big endian number
+ * @param hits           Caller provided buffer of at least @a max_hits entries
+ * @param max_hits       The maximum number of hits to record
+ * @return               The number of hits written to @a hits
+ */
+size_t ethash_full_search(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	uint64_t start_nonce,
+	uint64_t count,
+	ethash_h256_t const* boundary,
+	ethash_search_hit_t* hits,
+	size_t max_hits
+);
+
+/// A boundary of @ref ethash_full_search_multi() and the hits found below it
+typedef struct ethash_search_target {
+	ethash_h256_t boundary;      ///< 2^256 / difficulty as a big endian number
+	ethash_search_hit_t* hits;   ///< caller provided buffer of at least @a max_hits entries
+	size_t max_hits;
+	size_t found;                ///< set to the number of hits written to @a hits
+} ethash_search_target_t;
+
+/**
+ * Search a range of nonces for results below several boundaries at once
+ *
+ * Like @ref ethash_full_search(), but every result is compared against the
+ * boundary of each target and recorded in the hits of each one it meets, in
+ * nonce order. A pool miner passes the share and the block boundary and gets
+ * the shares to submit and the block solutions among them from one pass. A
+ * target stops recording once @a max_hits of its hits have been found, and
+ * the search stops early once every target has.
+ *
+ * @param full           The full client handler
+ * @param header_hash    The header hash to pack into the mix
+ * @param start_nonce    The first nonce to try
+ * @param count          The number of nonces to try
+ * @param targets        The boundaries and their hit buffers, @a found is set on return
+ * @param num_targets    The number of targets
+ * @return               The number of nonces hashed, less than @a count if the
+ *                       search stopped early, so that the next one can resume
+ *                       at start_nonce plus it
+ */
+uint64_t ethash_full_search_multi(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	uint64_t start_nonce,
+	uint64_t count,
+	ethash_search_target_t* targets,
+	size_t num_targets
+);
+
+/**
+ * Verify the proofs of work of many headers of the epoch of @a full
+ *
+ * Same as @ref ethash_light_verify_batch() with the DAG of @a full, for
+ * services that check many shares of the current epoch. The headers passing
+ * the quick check are hashed in batches of @ref ethash_get_hash_batch()
+ * in lockstep, see @ref ethash_full_compute_batch().
+ *
+ * @param full           The full client handler
+ * @param header_hashes  The header hashes, without the nonces
+ * @param nonces         The nonces of the headers
+ * @param mix_hashes     The mix hashes claimed by the headers
+ * @param boundaries     The boundaries (2^256 / difficulty) of the headers
+ * @param[out] results   Set to whether each header is valid
+ * @param count          The number of headers
+ * @param num_threads    The number of threads to use, 0 for all hardware threads
+ * @return               The number of valid headers
+ */
+size_t ethash_full_verify_batch(
+	ethash_full_t full,
+	ethash_h256_t const* header_hashes,
+	uint64_t const* nonces,
+	ethash_h256_t const* mix_hashes,
+	ethash_h256_t const* boundaries,
+	bool* results,
+	size_t count,
+	unsigned num_threads
+);
+
+/// The nonces a thread of an ethash_search_t hashes at a time
+#define ETHASH_SEARCH_CHUNK 1024
+
+struct ethash_search;
+typedef struct ethash_search* ethash_search_t;
+
+/**
+ * Start searching for a nonce whose result is below a boundary on background threads
+ *
+ * Thread t of @a num_threads hashes chunk t, t + num_threads, t + 2 * num_threads
+ * and so on of ETHASH_SEARCH_CHUNK nonces from @a start_nonce, wrapping
+ * around, so all nonces are tried exactly once in a deterministic split. The
+ * threads stop at the first hit or when the search is deleted.
+ *
+ * @param full           The full client handler, which must outlive the search
+ * @param header_hash    The header hash to pack into the mix
+ * @param start_nonce    The first nonce of the first chunk
+ * @param boundary       The boundary (2^256 / difficulty) as a big endian number
+ * @param num_threads    The number of threads to use. 0 means one per hardware thread
+ * @return               The search, or NULL if it could not be started
+ */
+ethash_search_t ethash_search_start(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	uint64_t start_nonce,
+	ethash_h256_t const* boundary,
+	unsigned num_threads
+);
+
+/**
+ * Limit the share of the host the threads of a search take from now on
+ *
+ * @param search         The search
+ * @param throttle       The limits, NULL to hash at full speed again
+ */
+void ethash_search_set_throttle(ethash_search_t search, ethash_throttle_t const* throttle);
+
+/**
+ * Get the hit of a search, without waiting for one
+ *
+ * @param search         The search
+ * @param[out] hit       Receives the hit, if there is one
+ * @return               true if a hit was found and false if the threads are still searching
+ */
+bool ethash_search_result(ethash_search_t search, ethash_search_hit_t* hit);
+
+/**
+ * Get the number of nonces a search has hashed so far, for hash rates
+ */
+uint64_t ethash_search_hashes(ethash_search_t search);
+
+/**
+ * Stop a search, wait for its threads to return and free it
+ */
+void ethash_search_delete(ethash_search_t search);
+
+/// The nonces a thread of an ethash_miner_t takes from its range at a time
+#define ETHASH_MINER_CHUNK 256
+/// The most nonces one work of an ethash_miner_t spans
+#define ETHASH_MINER_MAX_NONCES ((uint64_t)0xFFFFFF * ETHASH_MINER_CHUNK)
+
+struct ethash_miner;
+typedef struct ethash_miner* ethash_miner_t;
+
+/**
+ * Receives a hit of an ethash_miner_t, on one of its threads
+ *
+ * @param work_id        The id given to @ref ethash_miner_set_work() with the work of the hit
+ * @param hit            The nonce and its hashes
+ * @param user           The pointer given to @ref ethash_miner_new()
+ */
+typedef void (*ethash_miner_callback_t)(uint64_t work_id, ethash_search_hit_t const* hit, void* user);
+
+/**
+ * Start threads that keep hashing whatever work @ref ethash_miner_set_work() gave them last
+ *
+ * Unlike @ref ethash_search_start() the threads outlive their work. Each of
+ * them owns a range of the chunks of ETHASH_MINER_CHUNK nonces of the work and
+ * a thread that is done with its own takes half of what another one has
+ * left, so fast and slow threads finish together. The threads look for new
+ * work before every iteration of the hashing loop and hash without taking
+ * any locks.
+ *
+ * @param num_threads    The number of threads to use. 0 means one per hardware thread
+ * @param callback       Called with every hit, never concurrently
+ * @param user           Passed to @a callback
+ * @return               The miner without any work, or NULL if it could not be started
+ */
+ethash_miner_t ethash_miner_new(unsigned num_threads, ethash_miner_callback_t callback, void* user);
+
+/**
+ * Replace the work of a miner
+ *
+ * Returns right away, the threads drop the nonces left of the previous work
+ * before the next iteration of their hashing loop, a handful of nonces, and
+ * drop the hits of it they have not started reporting yet. Every nonce of a
+ * work is hashed at most once.
+ *
+ * @param miner          The miner
+ * @param full           The DAG of the epoch of the work, NULL to leave the threads idle
+ * @param header_hash    The header hash to pack into the mix
+ * @param boundary       The boundary (2^256 / difficulty) as a big endian number
+ * @param start_nonce    The first nonce of the work
+ * @param count          The number of nonces from @a start_nonce, at most
+ *                       ETHASH_MINER_MAX_NONCES. 0 means as many as that.
+ * @param work_id        Passed to the callback with the hits of this work
+ */
+void ethash_miner_set_work(
+	ethash_miner_t miner,
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	ethash_h256_t const* boundary,
+	uint64_t start_nonce,
+	uint64_t count,
+	uint64_t work_id
+);
+
+/**
+ * Replace the header of the work of a miner, keeping its DAG, boundary and nonces
+ *
+ * Like @ref ethash_miner_set_work() for a new job of the same pool. The
+ * threads keep their state and just restart their share of the nonces with
+ * the new header before the next iteration of their hashing loop. Hits of the
+ * old header found meanwhile are dropped, see @ref ethash_miner_stale_hits().
+ *
+ * @param miner          The miner
+ * @param header_hash    The new header hash to pack into the mix
+ * @param work_id        Passed to the callback with the hits of the new header
+ */
+void ethash_miner_set_header(ethash_miner_t miner, ethash_h256_t const header_hash, uint64_t work_id);
+
+/**
+ * Limit the share of the host the threads of a miner take from now on
+ *
+ * Paused threads pick up new work and stop right away.
+ *
+ * @param miner          The miner
+ * @param throttle       The limits, NULL to hash at full speed again
+ */
+void ethash_miner_set_throttle(ethash_miner_t miner, ethash_throttle_t const* throttle);
+
+/**
+ * Get the generation of the work of a miner, which each call of
+ * @ref ethash_miner_set_work() or @ref ethash_miner_set_header() increments
+ */
+uint32_t ethash_miner_generation(ethash_miner_t miner);
+
+/**
+ * Get the number of hits a miner dropped because their work had already been
+ * replaced when they were found
+ */
+uint64_t ethash_miner_stale_hits(ethash_miner_t miner);
+
+/**
+ * Wait until no thread of a miner uses works given before the current one,
+ * after which their full handlers may be deleted
+ */
+void ethash_miner_sync(ethash_miner_t miner);
+
+/**
+ * Get the number of nonces a miner has hashed so far, for hash rates
+ */
+uint64_t ethash_miner_hashes(ethash_miner_t miner);
+
+/**
+ * Stop the threads of a miner, wait for them to return and free it
+ */
+void ethash_miner_delete(ethash_miner_t miner);
+
+/**
+ * Calculate the light client data of the ProgPow
+ *
+ * @param light          The light client handler
+ * @param header_hash    The header hash to pack into the mix
+ * @param nonce          The nonce to pack into the mix
+ * @param block_number   The block_number
+ * @return               an object of ethash_return_value_t holding the return values
+ */
+ethash_return_value_t progpow_light_compute(
+	ethash_light_t light,
+	ethash_h256_t const header_hash,
+	uint64_t nonce,
+	uint64_t block_number
+);
+
+/**
+ * Difficulty quick check for ProgPoW preverification
+ *
+ * Same as @ref ethash_quick_check_difficulty() for ProgPoW, whose final hash
+ * is the Keccak-f[800] of the header, the seed and the mix hash.
+ */
+bool progpow_quick_check_difficulty(
+	ethash_h256_t const* header_hash,
+	uint64_t const nonce,
+	ethash_h256_t const* mix_hash,
+	ethash_h256_t const* boundary
+);
+
+/**
+ * Calculate the full client data of the ProgPoW
+ *
+ * @param full           The full client handler
  * @param header_hash    The header hash to pack into the mix
  * @param nonce          The nonce to pack into the mix
  * @param block_number   The current block_number
@@ -168,6 +1643,51 @@ ethash_return_value_t progpow_full_compute(
 	uint64_t block_number
 );
 
+/**
+ * Calculate the full client data of the ProgPoW for many nonces
+ *
+ * Same as @ref ethash_full_compute_batch() for ProgPoW at @a block_number
+ */
+bool progpow_full_compute_batch(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	uint64_t const* nonces,
+	ethash_return_value_t* results,
+	size_t count,
+	uint64_t block_number
+);
+
+/**
+ * Search a range of nonces for ProgPoW results below a boundary
+ *
+ * Same as @ref ethash_full_search() but for ProgPoW at @a block_number
+ */
+size_t progpow_full_search(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	uint64_t block_number,
+	uint64_t start_nonce,
+	uint64_t count,
+	ethash_h256_t const* boundary,
+	ethash_search_hit_t* hits,
+	size_t max_hits
+);
+
+/**
+ * Search a range of nonces for ProgPoW results below several boundaries at once
+ *
+ * Same as @ref ethash_full_search_multi() but for ProgPoW at @a block_number
+ */
+uint64_t progpow_full_search_multi(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	uint64_t block_number,
+	uint64_t start_nonce,
+	uint64_t count,
+	ethash_search_target_t* targets,
+	size_t num_targets
+);
+
 /**
  * Get a pointer to the full DAG data
  */
@@ -176,12 +1696,507 @@ void const* ethash_full_dag(ethash_full_t full);
  * Get the size of the DAG data
  */
 uint64_t ethash_full_dag_size(ethash_full_t full);
+/**
+ * Get the number of DAG bytes generated so far, out of @ref ethash_full_dag_size().
+ * Only a DAG of @ref ethash_full_new_lazy() is ever short of it.
+ */
+uint64_t ethash_full_generated_size(ethash_full_t full);
+/**
+ * Get how the memory of the DAG is backed
+ */
+enum ethash_page_mode ethash_full_page_mode(ethash_full_t full);
+/**
+ * Get the number of copies of the DAG, one per NUMA node it was replicated to
+ */
+unsigned ethash_full_replica_count(ethash_full_t full);
+/**
+ * Get how long creating the handler took to make the DAG usable, in
+ * microseconds: loading and prefaulting an existing DAG file, or generating it
+ */
+uint64_t ethash_full_load_time_us(ethash_full_t full);
+/**
+ * Check the DAG, and every NUMA replica of it, against the checksums taken
+ * when it was generated
+ *
+ * DAG files keep the SHA3-256 of every ETHASH_DAG_CHECKSUM_BYTES of the DAG in
+ * a trailer, so a DAG loaded from disk is checked against what was written
+ * when the file was generated, without recomputing any of it.
+ *
+ * @param full          The full handler to check
+ * @param num_threads   The number of threads to hash on, 0 for one per hardware thread
+ * @return              true if the DAG is intact, false if any part of it changed
+ */
+bool ethash_full_verify(ethash_full_t full, unsigned num_threads);
+
+/**
+ * Hashes the leaves and inner nodes of a @ref ethash_full_merkle_t
+ *
+ * @param[out] out       Receives the hash of the @a size bytes at @a data
+ * @param user           The pointer given to @ref ethash_full_merkle_build()
+ */
+typedef void (*ethash_merkle_hash_fn)(ethash_h256_t* out, void const* data, size_t size, void* user);
+
+/// The most levels above the leaves an ethash_full_merkle_t has
+#define ETHASH_MERKLE_MAX_DEPTH 64
+
+struct ethash_full_merkle;
+typedef struct ethash_full_merkle* ethash_full_merkle_t;
+
+/**
+ * Build the Merkle tree of a DAG, for proofs of its elements
+ *
+ * Leaf i is the hash of bytes [i * leaf_size, (i + 1) * leaf_size) of the
+ * DAG, an inner node the hash of its two children, 64 bytes. A node without a
+ * sibling is paired with itself. Each level is hashed on @a num_threads
+ * threads of the low priority pool, and the whole tree is kept to answer
+ * @ref ethash_full_merkle_proof() without any hashing.
+ *
+ * With a @a path, usually beside the DAG file, the tree is written there and
+ * a later build finding the tree of the same DAG, leaf size and hash
+ * function maps the file instead of hashing again.
+ *
+ * @param full           The full handler of the DAG, which may be deleted before the tree
+ * @param leaf_size      The DAG bytes of a leaf, dividing the DAG size.
+ *                       0 for ETHASH_MIX_BYTES, one page of the hashimoto loop
+ * @param hash_fn        The hash function, NULL for Keccak-256
+ * @param user           Passed on to @a hash_fn
+ * @param path           The file to keep the tree in, NULL to keep it in memory only
+ * @param num_threads    The number of threads to hash on, 0 for one per hardware thread
+ * @return               The tree, or NULL if @a leaf_size does not divide the
+ *                       DAG or the memory or file could not be had
+ */
+ethash_full_merkle_t ethash_full_merkle_build(
+	ethash_full_t full,
+	uint64_t leaf_size,
+	ethash_merkle_hash_fn hash_fn,
+	void* user,
+	char const* path,
+	unsigned num_threads
+);
+
+/**
+ * Get the root of a tree of @ref ethash_full_merkle_build()
+ */
+ethash_h256_t ethash_full_merkle_root(ethash_full_merkle_t merkle);
+/**
+ * Get the number of leaves of a tree
+ */
+uint64_t ethash_full_merkle_leaf_count(ethash_full_merkle_t merkle);
+/**
+ * Get the number of levels above the leaves, the length of every proof
+ */
+unsigned ethash_full_merkle_depth(ethash_full_merkle_t merkle);
+
+/**
+ * Get the proof of a leaf, in O(log n) reads of the stored tree
+ *
+ * @param merkle         The tree
+ * @param index          The index of the leaf
+ * @param[out] leaf      Receives the hash of the leaf
+ * @param[out] siblings  Receives the sibling of the leaf and then of each
+ *                       node on the path to the root, at least
+ *                       @ref ethash_full_merkle_depth() entries
+ * @return               false if @a index is not a leaf of the tree
+ */
+bool ethash_full_merkle_proof(
+	ethash_full_merkle_t merkle,
+	uint64_t index,
+	ethash_h256_t* leaf,
+	ethash_h256_t* siblings
+);
+
+/**
+ * Check a proof of @ref ethash_full_merkle_proof() against a root
+ *
+ * @param depth          The number of @a siblings
+ * @param hash_fn        The hash function of the tree, NULL for Keccak-256
+ * @return               true if @a leaf is leaf @a index of the tree of @a root
+ */
+bool ethash_full_merkle_verify(
+	ethash_h256_t const* root,
+	ethash_h256_t const* leaf,
+	uint64_t index,
+	ethash_h256_t const* siblings,
+	unsigned depth,
+	ethash_merkle_hash_fn hash_fn,
+	void* user
+);
+
+/**
+ * Free a tree, unmapping its file if it has one
+ */
+void ethash_full_merkle_delete(ethash_full_merkle_t merkle);
+/**
+ * Get how the memory of the light cache is backed
+ */
+enum ethash_page_mode ethash_light_page_mode(ethash_light_t light);
+/**
+ * Tell how much memory a light cache holds and where it is, like
+ * @ref ethash_full_memory_info(). Counts the cache and its DAG prefix.
+ */
+bool ethash_light_memory_info(ethash_light_t light, ethash_memory_info_t* info);
+/**
+ * Tell how much memory a DAG holds and where it is
+ *
+ * Asks the operating system which pages are resident (mincore() on POSIX,
+ * QueryWorkingSetEx() on Windows), which are in transparent huge pages and
+ * on which NUMA node each is, so it takes a while for a large DAG. Counts the
+ * DAG, its NUMA replicas and its ProgPoW cache.
+ *
+ * @param[out] info     The memory of the handler
+ * @return              false if the residency could not be queried, in which case
+ *                      every mapped byte is reported resident on node 0
+ */
+bool ethash_full_memory_info(ethash_full_t full, ethash_memory_info_t* info);
+
+/**
+ * Allocate a new light cache registry
+ *
+ * The registry hands out shared light handlers per epoch, so that all users of
+ * a process share one cache per epoch. Each cache is built only once, even
+ * when several threads ask for it at the same time. Caches nobody holds are
+ * kept for reuse, up to @a capacity caches in total, and the least recently
+ * used one is freed first.
+ *
+ * @param capacity       The number of caches to keep
+ * @return               Newly allocated registry or NULL in case of ERRNOMEM
+ */
+ethash_light_registry_t ethash_light_registry_new(unsigned capacity);
+/**
+ * Frees a registry and the caches it holds
+ *
+ * All light handlers acquired from the registry must have been released before.
+ */
+void ethash_light_registry_delete(ethash_light_registry_t registry);
+/**
+ * Get the light handler for a block
+ *
+ * Waits for the cache to be built if it is not in the registry yet. The
+ * handler must not be freed with @ref ethash_light_delete().
+ *
+ * @param registry       The light cache registry
+ * @param block_number   The block to get the light handler for
+ * @return               The light handler, to be handed back with
+ *                       @ref ethash_light_registry_release(), or NULL in case of ERRNOMEM
+ *                       or a block from epoch ETHASH_MAX_EPOCHS on
+ */
+ethash_light_t ethash_light_registry_acquire(ethash_light_registry_t registry, uint64_t block_number);
+/**
+ * Release a light handler returned by @ref ethash_light_registry_acquire()
+ */
+void ethash_light_registry_release(ethash_light_registry_t registry, ethash_light_t light);
+/**
+ * Get the number of caches in the registry, including the ones in use or being built
+ */
+unsigned ethash_light_registry_size(ethash_light_registry_t registry);
+
+/// The most epochs an @ref ethash_sync_verifier_t builds the caches of ahead of time
+#define ETHASH_SYNC_MAX_LOOKAHEAD 8
+
+/**
+ * Allocate a new verifier of the headers of a chain sync
+ *
+ * The verifier takes the headers in chain order and checks those of the
+ * same epoch together with @ref ethash_light_verify_batch(). Every time it
+ * enters an epoch it starts building the caches of the @a lookahead epochs
+ * after it on background threads, so that the stream arrives at the next
+ * epoch boundary with its cache already built. The cache of the previous
+ * epoch is freed on entering the next one.
+ *
+ * @param lookahead      The number of epochs to build ahead, at most
+ *                       ETHASH_SYNC_MAX_LOOKAHEAD. 0 builds every cache when
+ *                       its first header comes
+ * @param num_threads    The number of threads verifying each batch, 0 for all
+ *                       hardware threads
+ * @return               Newly allocated verifier or NULL in case of ERRNOMEM
+ */
+ethash_sync_verifier_t ethash_sync_verifier_new(unsigned lookahead, unsigned num_threads);
+/**
+ * Frees a verifier, cancelling the builds still in progress
+ */
+void ethash_sync_verifier_delete(ethash_sync_verifier_t verifier);
+/**
+ * Verify the next headers of the stream
+ *
+ * The headers should come in order of their block numbers, as a stream
+ * going back to an epoch it left has to build that cache again. Headers of
+ * epochs whose cache could not be built are reported invalid.
+ *
+ * @param verifier       The verifier
+ * @param block_numbers  The block numbers of the headers
+ * @param header_hashes  The header hashes, without the nonces
+ * @param nonces         The nonces of the headers
+ * @param mix_hashes     The mix hashes claimed by the headers
+ * @param boundaries     The boundaries (2^256 / difficulty) of the headers
+ * @param[out] results   Set to whether each header is valid
+ * @param count          The number of headers
+ * @return               The number of valid headers
+ */
+size_t ethash_sync_verifier_push(
+	ethash_sync_verifier_t verifier,
+	uint64_t const* block_numbers,
+	ethash_h256_t const* header_hashes,
+	uint64_t const* nonces,
+	ethash_h256_t const* mix_hashes,
+	ethash_h256_t const* boundaries,
+	bool* results,
+	size_t count
+);
+/**
+ * Verify the next headers of the stream from their RLP encodings
+ *
+ * Same as @ref ethash_sync_verifier_push() with the fields decoded by
+ * @ref ethash_header_decode_batch(). Headers that cannot be decoded are
+ * reported invalid without affecting the epoch of the stream.
+ *
+ * @param verifier       The verifier
+ * @param headers        The RLP encodings of the headers, back to back
+ * @param sizes          The size in bytes of each encoding
+ * @param[out] results   Set to whether each header is valid
+ * @param count          The number of headers
+ * @return               The number of valid headers
+ */
+size_t ethash_sync_verifier_push_headers(
+	ethash_sync_verifier_t verifier,
+	uint8_t const* headers,
+	size_t const* sizes,
+	bool* results,
+	size_t count
+);
+/**
+ * Get the number of caches being built or built ahead of the current epoch
+ */
+unsigned ethash_sync_verifier_pending(ethash_sync_verifier_t verifier);
+
+/**
+ * Allocate a new epoch manager
+ *
+ * The manager owns the DAG of the current epoch. Once the chain gets within
+ * @a prefetch_blocks blocks of the next epoch it builds the DAG of that epoch
+ * on a thread of the lowest priority, so that the switch at the epoch
+ * boundary does not have to wait for it. DAGs are built the same way
+ * as with @ref ethash_full_new_parallel() or @ref ethash_full_new_memory().
+ *
+ * @param in_memory        Keep DAGs in memory only instead of in DAG files in the
+ *                         default directory
+ * @param prefetch_blocks  How many blocks ahead of an epoch boundary to start
+ *                         building the DAG of the next epoch, for example
+ *                         ETHASH_EPOCH_PREFETCH_BLOCKS. 0 disables prefetching
+ * @param num_threads      The number of threads to build each DAG with, 0 for
+ *                         one per hardware thread
+ * @param callback         Progress callback of the builds, see @ref ethash_full_new_parallel().
+ *                         It is invoked from background threads.
+ * @return                 Newly allocated manager or NULL in case of ERRNOMEM
+ */
+ethash_epoch_manager_t ethash_epoch_manager_new(
+	bool in_memory,
+	uint64_t prefetch_blocks,
+	unsigned num_threads,
+	ethash_callback_t callback
+);
+/**
+ * Frees a manager, after waiting for a build in progress to finish
+ *
+ * All DAGs acquired from the manager must have been released before.
+ */
+void ethash_epoch_manager_delete(ethash_epoch_manager_t manager);
+/**
+ * Get the DAG for a block
+ *
+ * Returns at once if the DAG of the block's epoch is the current one or has
+ * been prefetched, in which case it becomes the current one. Otherwise waits
+ * until it has been built. May start prefetching the next epoch.
+ *
+ * @param manager        The epoch manager
+ * @param block_number   The block to get the DAG for
+ * @return               The DAG, to be handed back with @ref ethash_epoch_manager_release(),
+ *                       or NULL if it could not be built
+ */
+ethash_full_t ethash_epoch_manager_acquire(ethash_epoch_manager_t manager, uint64_t block_number);
+/**
+ * Release a DAG returned by @ref ethash_epoch_manager_acquire()
+ *
+ * A DAG that is neither the current nor the prefetched one any more is
+ * freed with its last release.
+ */
+void ethash_epoch_manager_release(ethash_epoch_manager_t manager, ethash_full_t full);
+/**
+ * Wait for a build in progress to finish
+ *
+ * @return         false if the last build of the manager failed and true otherwise
+ */
+bool ethash_epoch_manager_wait(ethash_epoch_manager_t manager);
+/**
+ * Get the epoch of the DAG built ahead of time, or UINT64_MAX if there is none
+ */
+uint64_t ethash_epoch_manager_upcoming_epoch(ethash_epoch_manager_t manager);
 
 /**
  * Calculate the seedhash for a given block number
  */
 ethash_h256_t ethash_get_seedhash(uint64_t block_number);
 
+/**
+ * Find the epoch a seedhash belongs to
+ *
+ * Only the 2048 epochs with tabulated cache and DAG sizes are searched.
+ *
+ * @param seedhash       The seedhash to look up
+ * @param[out] epoch     The epoch of @a seedhash, written on success
+ * @return               true if @a seedhash is the seedhash of one of the
+ *                       first 2048 epochs and false otherwise
+ */
+bool ethash_get_epoch_from_seedhash(ethash_h256_t const seedhash, uint64_t* epoch);
+
+/**
+ * Describe the kernel implementations selected for the host CPU
+ *
+ * The selection is made once, on first use, from the instruction set
+ * extensions supported by the CPU and the operating system.
+ *
+ * @return         A static string of space separated family=implementation
+ *                 pairs, e.g. "keccakf1600=generic sha3_multi=avx2x4
+ *                 keccakf800=generic fnv=avx2 progpow_loop=generic"
+ */
+char const* ethash_get_active_kernels(void);
+
+/**
+ * Replace the kernel implementation selected for one family
+ *
+ * The hashes are the same with every implementation, only their speed
+ * differs. The kernels are swapped without synchronization, so this is meant
+ * for start up or @ref ethash_autotune(), before other threads hash.
+ *
+ * @param family   A family of @ref ethash_get_active_kernels(), e.g. "fnv"
+ * @param name     An implementation of @a family, e.g. "avx2", or NULL for
+ *                 the one selected by default
+ * @return         true if @a name is now used and false if the family is
+ *                 unknown or the host does not support the implementation
+ */
+bool ethash_set_kernel(char const* family, char const* name);
+
+typedef struct ethash_keccak_backend {
+	char name[16];        ///< for ethash_set_kernel("keccakf1600", ...)
+	bool passed;          ///< its hashes matched the known answers and the portable sponge
+	uint64_t hash_rate;   ///< 64 byte Keccak-512 hashes per second on this thread, 0 if not passed
+} ethash_keccak_backend_t;
+
+/**
+ * Self-test and time every keccakf1600 backend the host can use
+ *
+ * Besides the built in permutations these are the OpenSSL, XKCP and CryptoPP
+ * hashes of builds that found the library, and that are left out when the
+ * library it was linked with has no Keccak. Each backend hashes the known
+ * answers and, unless SHA3 comes from CryptoPP, inputs of up to three blocks
+ * against the portable sponge, then hashes 64 byte inputs as the DAG does for
+ * an equal share of @a budget_ms. The fastest backend that passed is set for
+ * the whole process, so like @ref ethash_set_kernel() this should run before
+ * other threads hash.
+ *
+ * @param budget_ms        The time to spend timing, 0 for ETHASH_AUTOTUNE_BUDGET_MS / 4
+ * @param[out] results     Filled with up to @a max_results backends, in dispatch order
+ * @param max_results      The size of @a results
+ * @return                 The number of backends, which may exceed @a max_results
+ */
+size_t ethash_keccak_benchmark(unsigned budget_ms, ethash_keccak_backend_t* results, size_t max_results);
+
+/// The time ethash_autotune() takes for a budget of 0
+#define ETHASH_AUTOTUNE_BUDGET_MS 2000
+
+typedef struct ethash_tuning {
+	unsigned num_threads;          ///< for ethash_search_start() and ethash_miner_new()
+	unsigned hash_batch;           ///< set with ethash_set_hash_batch()
+	char fnv_kernel[16];           ///< set with ethash_set_kernel("fnv", ...)
+	char progpow_loop_kernel[16];  ///< set with ethash_set_kernel("progpow_loop", ...)
+	uint64_t hash_rate;            ///< ethash nonces per second measured on all threads, 0 if loaded
+} ethash_tuning_t;
+
+/**
+ * Pick the kernels, hash batch and search threads that hash fastest on the host
+ *
+ * Short trials hash the DAG of @a full with each fnv and progpow_loop kernel,
+ * each hash batch and a doubling number of search threads, one setting at a
+ * time. The kernels and hash batch found are set for the whole process, the
+ * number of threads is for the caller to pass on. The tuning is kept in the
+ * file "autotune" of the default DAG directory, keyed by the CPU model, its
+ * features and ETHASH_REVISION, and later calls load it instead of measuring.
+ * Like @ref ethash_set_kernel() this should run before other threads hash.
+ *
+ * @param full       The full client handler whose DAG to hash
+ * @param budget_ms  About how long the trials may take, 0 for
+ *                   ETHASH_AUTOTUNE_BUDGET_MS
+ * @param[out] tuning Receives the settings chosen
+ * @return           false if the tuning file could not be written, the
+ *                   settings are still chosen and set
+ */
+bool ethash_autotune(ethash_full_t full, unsigned budget_ms, ethash_tuning_t* tuning);
+
+/**
+ * Run the ProgPoW main loop with machine code generated for each period
+ * instead of the progpow_loop kernel
+ *
+ * The code of a period is generated the first time one of its blocks is
+ * hashed and kept for the few most recent periods. The hashes are the same
+ * either way. It is disabled by default.
+ *
+ * @param enable   Whether to use the generated code
+ * @return         true if the generated code is now used or @a enable is false,
+ *                 false if the host is not x86-64 with POPCNT and no compiler
+ *                 is set with @ref ethash_progpow_set_jit_compiler()
+ */
+bool ethash_progpow_set_jit(bool enable);
+
+/**
+ * Generate the code of @ref ethash_progpow_set_jit() by compiling C source
+ * of each period with a C compiler and loading it as a shared library,
+ * instead of from the x86-64 templates
+ *
+ * This also brings the generated code to hosts other than x86-64. Periods
+ * whose source does not compile fall back to the templates, or on other
+ * hosts to the progpow_loop kernel.
+ *
+ * @param compiler The command of a C compiler that takes the options of gcc,
+ *                 such as "cc", or NULL to go back to the templates
+ * @return         false if the host can not load shared libraries or the
+ *                 command is too long
+ */
+bool ethash_progpow_set_jit_compiler(char const* compiler);
+
+/// The languages of @ref progpow_get_kernel_source()
+enum progpow_source_target {
+	PROGPOW_SOURCE_OPENCL = 0, ///< OpenCL C: progpow_period_loop(loop, mix, dag, dag_entries) running all lanes
+	PROGPOW_SOURCE_CUDA,       ///< CUDA: a __device__ progpow_period_loop() with the same arguments
+	PROGPOW_SOURCE_C           ///< C99: progpow_period_lane(mix, c_dag, lane_dag) running one lane
+};
+
+/**
+ * Generate the source of the main loop iteration of a ProgPoW period
+ *
+ * The random program of the period is unrolled into straight-line code with
+ * its selectors folded into the statements, for the compiler of a GPU or of
+ * the host. The GPU functions take the mix of all lanes, the DAG, whose
+ * first PROGPOW_CACHE_BYTES are the cache, and the number of
+ * PROGPOW_MIX_BYTES entries of the DAG. The C function takes the mix words
+ * of one lane, the cache and the PROGPOW_DAG_LOADS words of the DAG entry the
+ * lane merges, the same as the code of @ref ethash_progpow_set_jit(). The
+ * source defines the PROGPOW_* constants and the rotations it uses unless
+ * they are already defined.
+ *
+ * @param prog_seed  The program seed, i.e. block_number / PROGPOW_PERIOD
+ * @param target     The language to generate
+ * @param buf        Where to write the source, may be NULL if @a size is 0
+ * @param size       The size of @a buf. The source is written with its
+ *                   terminating NUL only if it fits.
+ * @return           The length of the source without the terminating NUL, as
+ *                   snprintf(). It is complete if this is less than @a size.
+ */
+size_t progpow_get_kernel_source(
+	uint64_t prog_seed,
+	enum progpow_source_target target,
+	char* buf,
+	size_t size
+);
+
 #ifdef __cplusplus
 }
 #endif
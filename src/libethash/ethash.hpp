@@ -0,0 +1,836 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file ethash.hpp
+ * @date 2018
+ *
+ * Header only C++ versions of the ethash and ProgPoW hashes with the sizes of
+ * the algorithms as template parameters, and owning wrappers of the C
+ * handlers. With MIX_BYTES, ACCESSES, the lane
+ * and register counts and the program lengths known at compile time the
+ * loops over them are fully unrolled, and the modulo by the number of DAG
+ * pages becomes a multiplication by a reciprocal computed once per handler.
+ *
+ * The default parameters give exactly the hashes of the C functions, other
+ * parameter sets (smaller test configurations, ProgPoW 0.9.2) only need a
+ * different instantiation. The light and full handlers and their DAGs are
+ * the ones of the C library.
+ *
+ * The ethash::light and ethash::full wrappers free their handler when they
+ * go out of scope and can be moved but not copied. Their batch calls take the
+ * nonces as a span and write into results the caller provides, so hashing
+ * allocates nothing per call. An epoch_context shares one light and full
+ * handler pair between all its owners.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "ethash.h"
+#include "internal.h"
+#include "fnv.h"
+#include "fastmod.h"
+#include "dag_memo.h"
+
+#ifdef WITH_CRYPTOPP
+#include "sha3_cryptopp.h"
+#else
+#include "sha3.h"
+#endif // WITH_CRYPTOPP
+
+namespace ethash {
+
+/// x % d for 32-bit values of x and a divisor fixed at construction, see fastmod.h
+class fast_mod32 {
+public:
+	explicit fast_mod32(uint32_t d): m_mod(ethash_fastmod_init(d)) {}
+
+	uint32_t operator()(uint32_t x) const { return ethash_fastmod(&m_mod, x); }
+
+	uint32_t divisor() const { return m_mod.divisor; }
+
+private:
+	ethash_fastmod_t m_mod;
+};
+
+/// Sizes of an ethash variant
+template <unsigned MixBytes, unsigned Accesses>
+struct ethash_params {
+	static_assert(MixBytes >= 64 && MixBytes % 64 == 0, "the mix is made of whole DAG nodes");
+	static unsigned const mix_bytes = MixBytes;
+	static unsigned const accesses = Accesses;
+	static unsigned const mix_words = MixBytes / 4;
+	static unsigned const mix_nodes = mix_words / NODE_WORDS;
+};
+
+/// The sizes of ethash.h, the ones of @ref ethash_light_compute()
+typedef ethash_params<ETHASH_MIX_BYTES, ETHASH_ACCESSES> ethash_default;
+
+/// Parameters of a ProgPoW variant, named after the PROGPOW_* macros
+template <
+	unsigned Period,
+	unsigned Lanes,
+	unsigned Regs,
+	unsigned DagLoads,
+	unsigned CacheBytes,
+	unsigned CntDag,
+	unsigned CntCache,
+	unsigned CntMath
+>
+struct progpow_params {
+	static_assert(Lanes * DagLoads % NODE_WORDS == 0, "a DAG entry is made of whole DAG nodes");
+	static_assert(Regs > 1 && Regs <= 256, "math ops need two registers an instruction can name");
+	static_assert(CacheBytes % sizeof(node) == 0, "the cache is made of whole DAG nodes");
+	static unsigned const period = Period;
+	static unsigned const lanes = Lanes;
+	static unsigned const regs = Regs;
+	static unsigned const dag_loads = DagLoads;
+	static unsigned const cache_bytes = CacheBytes;
+	static unsigned const cache_words = CacheBytes / 4;
+	static unsigned const cnt_dag = CntDag;
+	static unsigned const cnt_cache = CntCache;
+	static unsigned const cnt_math = CntMath;
+	static unsigned const program_length = CntCache + CntMath;
+	static unsigned const entry_words = Lanes * DagLoads;
+	static unsigned const entry_nodes = entry_words / NODE_WORDS;
+};
+
+/// ProgPoW 0.9.2 of EIP-1057
+typedef progpow_params<50, 16, 32, 4, 16 * 1024, 64, 12, 20> progpow_0_9_2;
+/// ProgPoW 0.9.3 of EIP-1057, a shorter period and program than 0.9.2
+typedef progpow_params<10, 16, 32, 4, 16 * 1024, 64, 11, 18> progpow_0_9_3;
+/// The parameters of internal.h, the ones of @ref progpow_light_compute()
+typedef progpow_params<
+	PROGPOW_PERIOD,
+	PROGPOW_LANES,
+	PROGPOW_REGS,
+	PROGPOW_DAG_LOADS,
+	PROGPOW_CACHE_BYTES,
+	PROGPOW_CNT_DAG,
+	PROGPOW_CNT_CACHE,
+	PROGPOW_CNT_MATH
+> progpow_default;
+
+/**
+ * Ethash of a light or full handler with the sizes of @a P
+ *
+ * Reads the DAG from @a full_nodes, or computes the items of every access
+ * from @a light if it is NULL. The handlers must outlive the hasher.
+ */
+template <class P>
+class ethash_hasher {
+public:
+	ethash_hasher(ethash_light_t light, node const* full_nodes, uint64_t full_size):
+		m_light(light),
+		m_full_nodes(full_nodes),
+		m_pages((uint32_t)(full_size / P::mix_bytes)),
+		m_valid(full_size % P::mix_bytes == 0 && full_size / P::mix_bytes != 0),
+		m_prefetch(full_nodes && ethash_get_prefetch())
+	{}
+
+	/// False if the DAG size is not a positive multiple of the mix size
+	bool valid() const { return m_valid; }
+
+	ethash_return_value_t operator()(ethash_h256_t const& header_hash, uint64_t nonce) const
+	{
+		ethash_return_value_t ret;
+		memset(&ret, 0, sizeof(ret));
+		if (!m_valid) {
+			ret.success = false;
+			return ret;
+		}
+
+		// s_mix[0] is the seed, followed by the mix
+		node s_mix[P::mix_nodes + 1];
+		memcpy(s_mix[0].bytes, &header_hash, 32);
+		fix_endian64(s_mix[0].double_words[4], nonce);
+		SHA3_512(s_mix[0].bytes, s_mix[0].bytes, 40);
+		fix_endian_arr32(s_mix[0].words, NODE_WORDS);
+
+		node* const mix = s_mix + 1;
+		for (unsigned w = 0; w != P::mix_words; ++w) {
+			mix[w / NODE_WORDS].words[w % NODE_WORDS] = s_mix[0].words[w % NODE_WORDS];
+		}
+
+		for (unsigned i = 0; i != P::accesses; ++i) {
+			uint32_t const word = mix[(i % P::mix_words) / NODE_WORDS].words[i % NODE_WORDS];
+			uint32_t const index = m_pages(fnv_hash(s_mix[0].words[0] ^ i, word));
+			node tmp_nodes[P::mix_nodes];
+			node const* page;
+			if (m_full_nodes) {
+				page = &m_full_nodes[(size_t)P::mix_nodes * index];
+				for (unsigned n = 0; m_prefetch && n != P::mix_nodes; ++n) {
+					ETHASH_PREFETCH(&page[n]);
+				}
+			} else {
+				ethash_light_dag_items(tmp_nodes, index * P::mix_nodes, P::mix_nodes, m_light);
+				page = tmp_nodes;
+			}
+			for (unsigned n = 0; n != P::mix_nodes; ++n) {
+				for (unsigned w = 0; w != NODE_WORDS; ++w) {
+					mix[n].words[w] = fnv_hash(mix[n].words[w], page[n].words[w]);
+				}
+			}
+		}
+
+		// compress the mix in place, the groups of 4 words never straddle two
+		// nodes, and hash it after the seed
+		for (unsigned w = 0; w != P::mix_words; w += 4) {
+			uint32_t const* const group = &mix[w / NODE_WORDS].words[w % NODE_WORDS];
+			uint32_t reduction = group[0];
+			reduction = reduction * FNV_PRIME ^ group[1];
+			reduction = reduction * FNV_PRIME ^ group[2];
+			reduction = reduction * FNV_PRIME ^ group[3];
+			mix[w / 4 / NODE_WORDS].words[w / 4 % NODE_WORDS] = reduction;
+		}
+		unsigned const compressed_bytes = P::mix_bytes / 4;
+		for (unsigned w = 0; w != compressed_bytes / 4; ++w) {
+			fix_endian32_same(mix[w / NODE_WORDS].words[w % NODE_WORDS]);
+		}
+		memcpy(&ret.mix_hash, mix, compressed_bytes < 32 ? compressed_bytes : 32);
+		SHA3_256(&ret.result, s_mix[0].bytes, 64 + compressed_bytes);
+		ret.success = true;
+		return ret;
+	}
+
+private:
+	ethash_light_t m_light;
+	node const* m_full_nodes;
+	fast_mod32 m_pages;
+	bool m_valid;
+	bool m_prefetch;
+};
+
+namespace detail {
+
+inline uint32_t fnv1a(uint32_t& h, uint32_t d)
+{
+	return h = (h ^ d) * 0x1000193;
+}
+
+struct kiss99 {
+	uint32_t z, w, jsr, jcong;
+
+	uint32_t operator()()
+	{
+		z = 36969 * (z & 65535) + (z >> 16);
+		w = 18000 * (w & 65535) + (w >> 16);
+		uint32_t const mwc = (z << 16) + w;
+		jsr ^= jsr << 17;
+		jsr ^= jsr >> 13;
+		jsr ^= jsr << 5;
+		jcong = 69069 * jcong + 1234567;
+		return (mwc ^ jcong) + jsr;
+	}
+};
+
+// rotations by a multiple of 32 leave the value alone, as the C macros do on x86
+inline uint32_t rotl32(uint32_t x, uint32_t n)
+{
+	n %= 32;
+	return n ? (x << n) | (x >> (32 - n)) : x;
+}
+
+inline uint32_t rotr32(uint32_t x, uint32_t n)
+{
+	n %= 32;
+	return n ? (x >> n) | (x << (32 - n)) : x;
+}
+
+inline uint32_t clz32(uint32_t x)
+{
+#if defined(__GNUC__)
+	return x ? (uint32_t)__builtin_clz(x) : 32;
+#else
+	uint32_t n = 0;
+	for (uint32_t bit = 0x80000000; bit && !(x & bit); bit >>= 1) {
+		++n;
+	}
+	return n;
+#endif
+}
+
+inline uint32_t popcount32(uint32_t x)
+{
+#if defined(__GNUC__)
+	return (uint32_t)__builtin_popcount(x);
+#else
+	uint32_t n = 0;
+	for (; x; x &= x - 1) {
+		++n;
+	}
+	return n;
+#endif
+}
+
+// merge() and progpowMath() of progpow-internal.c for @a N lanes at a time.
+// The selector is the same for all of them, so the switch is taken once and
+// each case is a loop the compiler can vectorize
+template <unsigned N>
+inline void merge_lanes(uint32_t* a, uint32_t const* b, uint32_t r)
+{
+	uint32_t const n = ((r >> 16) % 31) + 1;
+	switch (r % 4) {
+	case 0:
+		for (unsigned l = 0; l != N; ++l) a[l] = (a[l] * 33) + b[l];
+		break;
+	case 1:
+		for (unsigned l = 0; l != N; ++l) a[l] = (a[l] ^ b[l]) * 33;
+		break;
+	case 2:
+		for (unsigned l = 0; l != N; ++l) a[l] = ((a[l] << n) | (a[l] >> (32 - n))) ^ b[l];
+		break;
+	default:
+		for (unsigned l = 0; l != N; ++l) a[l] = ((a[l] >> n) | (a[l] << (32 - n))) ^ b[l];
+		break;
+	}
+}
+
+template <unsigned N>
+inline void math_lanes(uint32_t* ret, uint32_t const* a, uint32_t const* b, uint32_t r)
+{
+	switch (r % 11) {
+	default:
+	case 0: for (unsigned l = 0; l != N; ++l) ret[l] = a[l] + b[l]; break;
+	case 1: for (unsigned l = 0; l != N; ++l) ret[l] = a[l] * b[l]; break;
+	case 2: for (unsigned l = 0; l != N; ++l) ret[l] = (uint32_t)(((uint64_t)a[l] * b[l]) >> 32); break;
+	case 3: for (unsigned l = 0; l != N; ++l) ret[l] = a[l] < b[l] ? a[l] : b[l]; break;
+	case 4: for (unsigned l = 0; l != N; ++l) ret[l] = rotl32(a[l], b[l]); break;
+	case 5: for (unsigned l = 0; l != N; ++l) ret[l] = rotr32(a[l], b[l]); break;
+	case 6: for (unsigned l = 0; l != N; ++l) ret[l] = a[l] & b[l]; break;
+	case 7: for (unsigned l = 0; l != N; ++l) ret[l] = a[l] | b[l]; break;
+	case 8: for (unsigned l = 0; l != N; ++l) ret[l] = a[l] ^ b[l]; break;
+	case 9: for (unsigned l = 0; l != N; ++l) ret[l] = clz32(a[l]) + clz32(b[l]); break;
+	case 10: for (unsigned l = 0; l != N; ++l) ret[l] = popcount32(a[l]) + popcount32(b[l]); break;
+	}
+}
+
+} // namespace detail
+
+/**
+ * The random program of a ProgPoW period, the counterpart of
+ * progpow_program_t for the parameters @a P
+ */
+template <class P>
+struct progpow_program {
+	explicit progpow_program(uint64_t prog_seed)
+	{
+		uint32_t fnv_hash = 0x811c9dc5;
+		detail::kiss99 rnd;
+		rnd.z = detail::fnv1a(fnv_hash, (uint32_t)prog_seed);
+		rnd.w = detail::fnv1a(fnv_hash, (uint32_t)(prog_seed >> 32));
+		rnd.jsr = detail::fnv1a(fnv_hash, (uint32_t)prog_seed);
+		rnd.jcong = detail::fnv1a(fnv_hash, (uint32_t)(prog_seed >> 32));
+
+		// Fisher-Yates shuffles of the merge destinations and cache sources
+		uint32_t mix_seq_dst[P::regs];
+		uint32_t mix_seq_src[P::regs];
+		for (unsigned i = 0; i != P::regs; ++i) {
+			mix_seq_dst[i] = i;
+			mix_seq_src[i] = i;
+		}
+		for (unsigned i = P::regs - 1; i > 0; --i) {
+			uint32_t j = rnd() % (i + 1);
+			std::swap(mix_seq_dst[i], mix_seq_dst[j]);
+			j = rnd() % (i + 1);
+			std::swap(mix_seq_src[i], mix_seq_src[j]);
+		}
+
+		unsigned dst_cnt = 0;
+		unsigned src_cnt = 0;
+		unsigned const max_i = P::cnt_cache > P::cnt_math ? P::cnt_cache : P::cnt_math;
+		progpow_instruction_t* ins = instructions;
+		for (unsigned i = 0; i != max_i; ++i) {
+			if (i < P::cnt_cache) {
+				ins->op = PROGPOW_OP_CACHE;
+				ins->src1 = (uint8_t)mix_seq_src[src_cnt++ % P::regs];
+				ins->src2 = 0;
+				ins->dst = (uint8_t)mix_seq_dst[dst_cnt++ % P::regs];
+				ins->sel1 = 0;
+				ins->sel2 = rnd();
+				ins++;
+			}
+			if (i < P::cnt_math) {
+				uint32_t const src_rnd = rnd() % (P::regs * (P::regs - 1));
+				uint32_t const src1 = src_rnd % P::regs;
+				uint32_t src2 = src_rnd / P::regs;
+				if (src2 >= src1) {
+					++src2;
+				}
+				ins->op = PROGPOW_OP_MATH;
+				ins->src1 = (uint8_t)src1;
+				ins->src2 = (uint8_t)src2;
+				ins->sel1 = rnd();
+				ins->dst = (uint8_t)mix_seq_dst[dst_cnt++ % P::regs];
+				ins->sel2 = rnd();
+				ins++;
+			}
+		}
+
+		// the first global load always feeds mix[0], the offset of the next one
+		for (unsigned i = 0; i != P::dag_loads; ++i) {
+			dag_dst[i] = i == 0 ? 0 : mix_seq_dst[dst_cnt++ % P::regs];
+			dag_sel[i] = rnd();
+		}
+	}
+
+	progpow_instruction_t instructions[P::program_length];
+	uint32_t dag_dst[P::dag_loads];
+	uint32_t dag_sel[P::dag_loads];
+};
+
+/**
+ * ProgPoW of a light or full handler with the parameters of @a P
+ *
+ * The cache of the hashes is the first P::cache_bytes of the DAG. It is taken
+ * from the DAG of a full handler, from the precomputed cache of a light
+ * handler of the default size, or computed once here otherwise. The handlers
+ * must outlive the hasher.
+ */
+template <class P>
+class progpow_hasher {
+public:
+	progpow_hasher(ethash_light_t light, node const* full_nodes, uint64_t full_size):
+		m_light(light),
+		m_g_dag((uint32_t const*)full_nodes),
+		m_c_dag(NULL),
+		// the C code truncates the DAG size to 32 bits first
+		m_entries(64 * ((uint32_t)full_size / (P::entry_words * 4)) / P::entry_words),
+		m_valid(m_entries.divisor() != 0),
+		m_prefetch(full_nodes && ethash_get_prefetch())
+	{
+		if (m_g_dag) {
+			m_c_dag = m_g_dag;
+		} else if (light->progpow_cache && P::cache_bytes == PROGPOW_CACHE_BYTES) {
+			m_c_dag = light->progpow_cache;
+		} else {
+			m_cache.resize(P::cache_bytes / sizeof(node));
+			ethash_calculate_dag_items(m_cache.data(), 0, (uint32_t)m_cache.size(), light);
+			m_c_dag = m_cache.data()->words;
+		}
+	}
+
+	/// False if the DAG is too small for a single entry
+	bool valid() const { return m_valid; }
+
+	ethash_return_value_t operator()(ethash_h256_t const& header_hash, uint64_t nonce, uint64_t block_number) const
+	{
+		return (*this)(progpow_program<P>(block_number / P::period), header_hash, nonce);
+	}
+
+	/// The hash with the program of the period of the block, for callers hashing many nonces of a period
+	ethash_return_value_t operator()(progpow_program<P> const& prog, ethash_h256_t const& header_hash, uint64_t nonce) const
+	{
+		ethash_return_value_t ret;
+		memset(&ret, 0, sizeof(ret));
+		if (!m_valid) {
+			ret.success = false;
+			return ret;
+		}
+
+		hash32_t header;
+		memcpy(&header, &header_hash, sizeof(header));
+		hash32_t digest;
+		memset(&digest, 0, sizeof(digest));
+		hash32_t const seed_256 = keccak_f800_progpow(header, nonce, digest);
+		uint64_t const seed = (uint64_t)ethash_swap_u32(seed_256.uint32s[0]) << 32 | ethash_swap_u32(seed_256.uint32s[1]);
+
+		// register major, so that an instruction works on consecutive lanes
+		uint32_t mix[P::regs][P::lanes];
+		for (unsigned l = 0; l != P::lanes; ++l) {
+			uint32_t fnv_hash = 0x811c9dc5;
+			detail::kiss99 rnd;
+			rnd.z = detail::fnv1a(fnv_hash, (uint32_t)seed);
+			rnd.w = detail::fnv1a(fnv_hash, (uint32_t)(seed >> 32));
+			rnd.jsr = detail::fnv1a(fnv_hash, l);
+			rnd.jcong = detail::fnv1a(fnv_hash, l);
+			for (unsigned r = 0; r != P::regs; ++r) {
+				mix[r][l] = rnd();
+			}
+		}
+
+		for (uint32_t loop = 0; loop != P::cnt_dag; ++loop) {
+			iteration(prog, loop, mix);
+		}
+
+		// reduce every lane and then all the lanes to 256 bits
+		uint32_t lane_hash[P::lanes];
+		for (unsigned l = 0; l != P::lanes; ++l) {
+			lane_hash[l] = 0x811c9dc5;
+		}
+		for (unsigned r = 0; r != P::regs; ++r) {
+			for (unsigned l = 0; l != P::lanes; ++l) {
+				detail::fnv1a(lane_hash[l], mix[r][l]);
+			}
+		}
+		for (unsigned i = 0; i != 8; ++i) {
+			digest.uint32s[i] = 0x811c9dc5;
+		}
+		for (unsigned l = 0; l != P::lanes; ++l) {
+			detail::fnv1a(digest.uint32s[l % 8], lane_hash[l]);
+		}
+
+		memcpy(&ret.mix_hash, &digest, sizeof(digest));
+		digest = keccak_f800_progpow(header, seed, digest);
+		memcpy(&ret.result, &digest, sizeof(ret.result));
+		ret.success = true;
+		return ret;
+	}
+
+private:
+	void iteration(progpow_program<P> const& prog, uint32_t loop, uint32_t mix[P::regs][P::lanes]) const
+	{
+		// all lanes read the same entry, known before the program runs
+		uint32_t const entry = m_entries(mix[0][loop % P::lanes]);
+		uint32_t tmp_entry[P::entry_words];
+		uint32_t const* dag_data;
+		if (m_g_dag) {
+			dag_data = &m_g_dag[(size_t)entry * P::entry_words];
+			for (unsigned line = 0; m_prefetch && line != P::entry_words / NODE_WORDS; ++line) {
+				ETHASH_PREFETCH(&dag_data[line * NODE_WORDS]);
+			}
+		} else {
+			node tmp_nodes[P::entry_nodes];
+			ethash_light_dag_items(tmp_nodes, entry * P::entry_nodes, P::entry_nodes, m_light);
+			memcpy(tmp_entry, tmp_nodes, sizeof(tmp_entry));
+			dag_data = tmp_entry;
+		}
+
+		uint32_t data[P::lanes];
+		for (unsigned i = 0; i != P::program_length; ++i) {
+			progpow_instruction_t const ins = prog.instructions[i];
+			if (ins.op == PROGPOW_OP_CACHE) {
+				for (unsigned l = 0; l != P::lanes; ++l) {
+					data[l] = m_c_dag[mix[ins.src1][l] % P::cache_words];
+				}
+			} else {
+				detail::math_lanes<P::lanes>(data, mix[ins.src1], mix[ins.src2], ins.sel1);
+			}
+			detail::merge_lanes<P::lanes>(mix[ins.dst], data, ins.sel2);
+		}
+
+		// every lane reads its own DAG_LOADS words of the entry, consumed at
+		// the very end for full latency hiding
+		for (unsigned i = 0; i != P::dag_loads; ++i) {
+			for (unsigned l = 0; l != P::lanes; ++l) {
+				data[l] = dag_data[((l ^ loop) % P::lanes) * P::dag_loads + i];
+			}
+			detail::merge_lanes<P::lanes>(mix[prog.dag_dst[i]], data, prog.dag_sel[i]);
+		}
+	}
+
+	ethash_light_t m_light;
+	uint32_t const* m_g_dag;
+	uint32_t const* m_c_dag;
+	std::vector<node> m_cache;
+	fast_mod32 m_entries;
+	bool m_valid;
+	bool m_prefetch;
+};
+
+/**
+ * A view of @a size contiguous elements owned by someone else
+ *
+ * A stand-in for the std::span of C++20 with the few members the batch calls
+ * of the handlers need.
+ */
+template <class T>
+class span {
+public:
+	span(): m_data(NULL), m_size(0) {}
+	span(T* data, size_t size): m_data(data), m_size(size) {}
+	template <size_t N>
+	span(T (&array)[N]): m_data(array), m_size(N) {}
+	/// Any container with contiguous data(), e.g. a std::vector or another span
+	template <class C, class = decltype(std::declval<C&>().data())>
+	span(C& container): m_data(container.data()), m_size(container.size()) {}
+
+	T* data() const { return m_data; }
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+	T* begin() const { return m_data; }
+	T* end() const { return m_data + m_size; }
+	T& operator[](size_t i) const { return m_data[i]; }
+
+private:
+	T* m_data;
+	size_t m_size;
+};
+
+/**
+ * Owner of an ethash_light_t, freed by the destructor
+ *
+ * Test for a handler with operator bool, the constructors leave the wrapper
+ * empty where the C functions return NULL.
+ */
+class light {
+public:
+	light(): m_light(NULL) {}
+	/// The cache of the epoch of @a block_number, see @ref ethash_light_new()
+	explicit light(uint64_t block_number): m_light(ethash_light_new(block_number)) {}
+	/// Take ownership of @a handle
+	static light adopt(ethash_light_t handle) { light ret; ret.m_light = handle; return ret; }
+
+	light(light&& other): m_light(other.release()) {}
+	light& operator=(light&& other)
+	{
+		if (this != &other) {
+			reset(other.release());
+		}
+		return *this;
+	}
+	light(light const&) = delete;
+	light& operator=(light const&) = delete;
+	~light() { reset(NULL); }
+
+	explicit operator bool() const { return m_light != NULL; }
+	ethash_light_t get() const { return m_light; }
+	/// Give up ownership of the handler, leaving the wrapper empty
+	ethash_light_t release() { ethash_light_t ret = m_light; m_light = NULL; return ret; }
+	void reset(ethash_light_t handle)
+	{
+		if (m_light) {
+			ethash_light_delete(m_light);
+		}
+		m_light = handle;
+	}
+
+	uint64_t block_number() const { return m_light->block_number; }
+	uint64_t cache_size() const { return m_light->cache_size; }
+
+	/// @ref ethash_light_compute() into @a ret
+	void compute(ethash_h256_t const& header_hash, uint64_t nonce, ethash_return_value_t& ret) const
+	{
+		ret = ethash_light_compute(m_light, header_hash, nonce);
+	}
+	/// @ref progpow_light_compute() into @a ret
+	void progpow_compute(
+		ethash_h256_t const& header_hash,
+		uint64_t nonce,
+		uint64_t block_number,
+		ethash_return_value_t& ret
+	) const
+	{
+		ret = progpow_light_compute(m_light, header_hash, nonce, block_number);
+	}
+
+	/**
+	 * @ref ethash_light_verify_batch() of the headers of the spans, which
+	 * must all be as long as @a results
+	 * @return  The number of valid headers, 0 without checking any if the
+	 *          spans differ in length
+	 */
+	size_t verify_batch(
+		span<ethash_h256_t const> header_hashes,
+		span<uint64_t const> nonces,
+		span<ethash_h256_t const> mix_hashes,
+		span<ethash_h256_t const> boundaries,
+		span<bool> results,
+		unsigned num_threads = 0
+	) const
+	{
+		size_t const count = results.size();
+		if (header_hashes.size() != count || nonces.size() != count ||
+			mix_hashes.size() != count || boundaries.size() != count) {
+			return 0;
+		}
+		return ethash_light_verify_batch(
+			m_light,
+			header_hashes.data(),
+			nonces.data(),
+			mix_hashes.data(),
+			boundaries.data(),
+			results.data(),
+			count,
+			num_threads
+		);
+	}
+
+private:
+	ethash_light_t m_light;
+};
+
+/**
+ * Owner of an ethash_full_t, freed by the destructor
+ *
+ * Like the C handler it needs the light handler it was made from only while
+ * it is constructed, unless it is a lazy DAG which must not outlive it.
+ */
+class full {
+public:
+	full(): m_full(NULL) {}
+	/// The DAG of @a l, see @ref ethash_full_new()
+	explicit full(light const& l, ethash_callback_t callback = NULL):
+		m_full(ethash_full_new(l.get(), callback))
+	{}
+	/// Take ownership of @a handle
+	static full adopt(ethash_full_t handle) { full ret; ret.m_full = handle; return ret; }
+
+	full(full&& other): m_full(other.release()) {}
+	full& operator=(full&& other)
+	{
+		if (this != &other) {
+			reset(other.release());
+		}
+		return *this;
+	}
+	full(full const&) = delete;
+	full& operator=(full const&) = delete;
+	~full() { reset(NULL); }
+
+	explicit operator bool() const { return m_full != NULL; }
+	ethash_full_t get() const { return m_full; }
+	/// Give up ownership of the handler, leaving the wrapper empty
+	ethash_full_t release() { ethash_full_t ret = m_full; m_full = NULL; return ret; }
+	void reset(ethash_full_t handle)
+	{
+		if (m_full) {
+			ethash_full_delete(m_full);
+		}
+		m_full = handle;
+	}
+
+	void const* dag() const { return ethash_full_dag(m_full); }
+	uint64_t dag_size() const { return ethash_full_dag_size(m_full); }
+
+	/// @ref ethash_full_compute() into @a ret
+	void compute(ethash_h256_t const& header_hash, uint64_t nonce, ethash_return_value_t& ret) const
+	{
+		ret = ethash_full_compute(m_full, header_hash, nonce);
+	}
+	/// @ref progpow_full_compute() into @a ret
+	void progpow_compute(
+		ethash_h256_t const& header_hash,
+		uint64_t nonce,
+		uint64_t block_number,
+		ethash_return_value_t& ret
+	) const
+	{
+		ret = progpow_full_compute(m_full, header_hash, nonce, block_number);
+	}
+
+	/**
+	 * @ref ethash_full_compute_batch() of @a nonces
+	 * @param results   Caller provided buffer of as many results as nonces
+	 */
+	bool compute_batch(
+		ethash_h256_t const& header_hash,
+		span<uint64_t const> nonces,
+		ethash_return_value_t* results
+	) const
+	{
+		return ethash_full_compute_batch(m_full, header_hash, nonces.data(), results, nonces.size());
+	}
+	/// @ref progpow_full_compute_batch() of @a nonces
+	bool progpow_compute_batch(
+		ethash_h256_t const& header_hash,
+		span<uint64_t const> nonces,
+		ethash_return_value_t* results,
+		uint64_t block_number
+	) const
+	{
+		return progpow_full_compute_batch(
+			m_full, header_hash, nonces.data(), results, nonces.size(), block_number
+		);
+	}
+
+	/**
+	 * @ref ethash_full_search() of @a count nonces from @a start_nonce, up to
+	 * as many hits as @a hits holds
+	 * @return  The number of hits written to @a hits
+	 */
+	size_t search(
+		ethash_h256_t const& header_hash,
+		uint64_t start_nonce,
+		uint64_t count,
+		ethash_h256_t const& boundary,
+		span<ethash_search_hit_t> hits
+	) const
+	{
+		return ethash_full_search(m_full, header_hash, start_nonce, count, &boundary, hits.data(), hits.size());
+	}
+	/// @ref progpow_full_search() at @a block_number
+	size_t progpow_search(
+		ethash_h256_t const& header_hash,
+		uint64_t block_number,
+		uint64_t start_nonce,
+		uint64_t count,
+		ethash_h256_t const& boundary,
+		span<ethash_search_hit_t> hits
+	) const
+	{
+		return progpow_full_search(
+			m_full, header_hash, block_number, start_nonce, count, &boundary, hits.data(), hits.size()
+		);
+	}
+
+private:
+	ethash_full_t m_full;
+};
+
+/**
+ * The handlers of one epoch, shared by everyone holding its epoch_context_ptr
+ *
+ * The full handler is empty for contexts made only to verify. The handlers
+ * are freed, the DAG before the cache, with the last owner.
+ */
+struct epoch_context {
+	epoch_context(ethash::light&& l, ethash::full&& f): light(std::move(l)), full(std::move(f)) {}
+
+	ethash::light const light;
+	ethash::full const full;
+};
+
+typedef std::shared_ptr<epoch_context const> epoch_context_ptr;
+
+/// A context owning @a l and @a f, or NULL if @a l is empty
+inline epoch_context_ptr make_epoch_context(light&& l, full&& f = full())
+{
+	if (!l) {
+		return epoch_context_ptr();
+	}
+	return std::make_shared<epoch_context const>(std::move(l), std::move(f));
+}
+
+/**
+ * A context of the epoch of @a block_number, with its DAG if @a with_full
+ * @return  NULL if a handler could not be created
+ */
+inline epoch_context_ptr make_epoch_context(
+	uint64_t block_number,
+	bool with_full,
+	ethash_callback_t callback = NULL
+)
+{
+	light l(block_number);
+	if (!l) {
+		return epoch_context_ptr();
+	}
+	full f;
+	if (with_full) {
+		f = full(l, callback);
+		if (!f) {
+			return epoch_context_ptr();
+		}
+	}
+	return make_epoch_context(std::move(l), std::move(f));
+}
+
+} // namespace ethash
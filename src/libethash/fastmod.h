@@ -0,0 +1,72 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file fastmod.h
+ * @date 2018
+ *
+ * Remainders by a divisor fixed for an epoch, such as the number of light
+ * cache nodes or of DAG pages, computed with two multiplications instead of
+ * a hardware division (D. Lemire, Faster Remainder by Direct Computation,
+ * 2019). The reciprocal is computed once when the handler is created.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "compiler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ethash_fastmod {
+	uint64_t reciprocal;  ///< ceil(2^64 / divisor), 0 for a divisor of 1
+	uint32_t divisor;
+} ethash_fastmod_t;
+
+/**
+ * Precompute the reciprocal of @a divisor for @ref ethash_fastmod()
+ *
+ * A divisor of 0 gives a value that must not be used for remainders, it keeps
+ * handlers of invalid sizes constructible.
+ */
+static inline ethash_fastmod_t ethash_fastmod_init(uint32_t divisor)
+{
+	ethash_fastmod_t ret;
+	ret.divisor = divisor;
+	ret.reciprocal = divisor ? UINT64_C(0xFFFFFFFFFFFFFFFF) / divisor + 1 : 0;
+	return ret;
+}
+
+/**
+ * @a x % @a m->divisor, exact for every 32-bit @a x
+ */
+static inline uint32_t ethash_fastmod(ethash_fastmod_t const* m, uint32_t x)
+{
+	// the fractional part of x / divisor, scaled back by the divisor
+	uint64_t const fraction = m->reciprocal * x;
+#if defined(__SIZEOF_INT128__)
+	return (uint32_t)(((unsigned __int128)fraction * m->divisor) >> 64);
+#else
+	uint64_t const hi = (fraction >> 32) * m->divisor;
+	uint64_t const lo = (fraction & 0xFFFFFFFF) * m->divisor;
+	return (uint32_t)((hi + (lo >> 32)) >> 32);
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
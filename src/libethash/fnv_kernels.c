@@ -0,0 +1,382 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file fnv_kernels.c
+ * @date 2018
+ */
+
+#include "fnv_kernels.h"
+#include "cpu_features.h"
+#include "fnv.h"
+#include "access_stats.h"
+
+#if defined(ETHASH_X86)
+#define ETHASH_FNV_SIMD 1
+#include <immintrin.h>
+#endif
+
+#if defined(ETHASH_ARM64)
+#define ETHASH_FNV_NEON 1
+#include <arm_neon.h>
+#endif
+
+static void fnv_dag_item_parents_generic(
+	node* ret,
+	uint32_t node_index,
+	node const* cache_nodes,
+	ethash_fastmod_t const* num_parent_nodes
+)
+{
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) {
+		uint32_t parent_index = ethash_fastmod(num_parent_nodes, fnv_hash(node_index ^ i, ret->words[i % NODE_WORDS]));
+		ETHASH_ACCESS_RECORD(ETHASH_ACCESS_CACHE, (uint64_t)parent_index * sizeof(node));
+		node const* parent = &cache_nodes[parent_index];
+		for (unsigned w = 0; w != NODE_WORDS; ++w) {
+			ret->words[w] = fnv_hash(ret->words[w], parent->words[w]);
+		}
+	}
+}
+
+static void fnv_dag_items_parents_generic(
+	node* ret,
+	uint32_t first_index,
+	unsigned count,
+	node const* cache_nodes,
+	ethash_fastmod_t const* num_parent_nodes
+)
+{
+	node const* parents[ETHASH_FNV_CHAINS];
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) {
+		// all the parent reads of the round are issued before any is used
+		for (unsigned k = 0; k != count; ++k) {
+			uint32_t const parent_index = ethash_fastmod(num_parent_nodes, fnv_hash((first_index + k) ^ i, ret[k].words[i % NODE_WORDS]));
+			ETHASH_ACCESS_RECORD(ETHASH_ACCESS_CACHE, (uint64_t)parent_index * sizeof(node));
+			parents[k] = &cache_nodes[parent_index];
+		}
+		for (unsigned k = 0; k != count; ++k) {
+			for (unsigned w = 0; w != NODE_WORDS; ++w) {
+				ret[k].words[w] = fnv_hash(ret[k].words[w], parents[k]->words[w]);
+			}
+		}
+	}
+}
+
+static void fnv_mix_generic(node* mix, node const* data, unsigned count)
+{
+	for (unsigned n = 0; n != count; ++n) {
+		for (unsigned w = 0; w != NODE_WORDS; ++w) {
+			mix[n].words[w] = fnv_hash(mix[n].words[w], data[n].words[w]);
+		}
+	}
+}
+
+#if defined(ETHASH_FNV_SIMD)
+
+// the light cache, the DAG and the internal node buffers are cache line
+// aligned, but callers of ethash_calculate_dag_item() may pass any node, so
+// all kernels use unaligned loads and stores. They cost nothing on aligned data
+
+ETHASH_TARGET("sse4.1")
+static void fnv_dag_item_parents_sse41(
+	node* ret,
+	uint32_t node_index,
+	node const* cache_nodes,
+	ethash_fastmod_t const* num_parent_nodes
+)
+{
+	__m128i const fnv_prime = _mm_set1_epi32(FNV_PRIME);
+	__m128i* const out = (__m128i*)ret->words;
+	__m128i x0 = _mm_loadu_si128(out + 0);
+	__m128i x1 = _mm_loadu_si128(out + 1);
+	__m128i x2 = _mm_loadu_si128(out + 2);
+	__m128i x3 = _mm_loadu_si128(out + 3);
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) {
+		uint32_t parent_index = ethash_fastmod(num_parent_nodes, fnv_hash(node_index ^ i, ret->words[i % NODE_WORDS]));
+		ETHASH_ACCESS_RECORD(ETHASH_ACCESS_CACHE, (uint64_t)parent_index * sizeof(node));
+		__m128i const* parent = (__m128i const*)cache_nodes[parent_index].words;
+		x0 = _mm_xor_si128(_mm_mullo_epi32(x0, fnv_prime), _mm_loadu_si128(parent + 0));
+		x1 = _mm_xor_si128(_mm_mullo_epi32(x1, fnv_prime), _mm_loadu_si128(parent + 1));
+		x2 = _mm_xor_si128(_mm_mullo_epi32(x2, fnv_prime), _mm_loadu_si128(parent + 2));
+		x3 = _mm_xor_si128(_mm_mullo_epi32(x3, fnv_prime), _mm_loadu_si128(parent + 3));
+
+		// have to write to ret as values are used to compute index
+		_mm_storeu_si128(out + 0, x0);
+		_mm_storeu_si128(out + 1, x1);
+		_mm_storeu_si128(out + 2, x2);
+		_mm_storeu_si128(out + 3, x3);
+	}
+}
+
+ETHASH_TARGET("sse4.1")
+static void fnv_dag_items_parents_sse41(
+	node* ret,
+	uint32_t first_index,
+	unsigned count,
+	node const* cache_nodes,
+	ethash_fastmod_t const* num_parent_nodes
+)
+{
+	__m128i const fnv_prime = _mm_set1_epi32(FNV_PRIME);
+	__m128i const* parents[ETHASH_FNV_CHAINS];
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) {
+		for (unsigned k = 0; k != count; ++k) {
+			uint32_t const parent_index = ethash_fastmod(num_parent_nodes, fnv_hash((first_index + k) ^ i, ret[k].words[i % NODE_WORDS]));
+			ETHASH_ACCESS_RECORD(ETHASH_ACCESS_CACHE, (uint64_t)parent_index * sizeof(node));
+			parents[k] = (__m128i const*)cache_nodes[parent_index].words;
+		}
+		for (unsigned k = 0; k != count; ++k) {
+			__m128i* const out = (__m128i*)ret[k].words;
+			for (unsigned v = 0; v != NODE_WORDS / 4; ++v) {
+				__m128i const x = _mm_mullo_epi32(_mm_loadu_si128(out + v), fnv_prime);
+				_mm_storeu_si128(out + v, _mm_xor_si128(x, _mm_loadu_si128(parents[k] + v)));
+			}
+		}
+	}
+}
+
+ETHASH_TARGET("sse4.1")
+static void fnv_mix_sse41(node* mix, node const* data, unsigned count)
+{
+	__m128i const fnv_prime = _mm_set1_epi32(FNV_PRIME);
+	for (unsigned n = 0; n != count; ++n) {
+		__m128i* const m = (__m128i*)mix[n].words;
+		__m128i const* d = (__m128i const*)data[n].words;
+		for (unsigned v = 0; v != NODE_WORDS / 4; ++v) {
+			__m128i const x = _mm_mullo_epi32(_mm_loadu_si128(m + v), fnv_prime);
+			_mm_storeu_si128(m + v, _mm_xor_si128(x, _mm_loadu_si128(d + v)));
+		}
+	}
+}
+
+ETHASH_TARGET("avx2")
+static void fnv_dag_item_parents_avx2(
+	node* ret,
+	uint32_t node_index,
+	node const* cache_nodes,
+	ethash_fastmod_t const* num_parent_nodes
+)
+{
+	__m256i const fnv_prime = _mm256_set1_epi32(FNV_PRIME);
+	__m256i* const out = (__m256i*)ret->words;
+	__m256i y0 = _mm256_loadu_si256(out + 0);
+	__m256i y1 = _mm256_loadu_si256(out + 1);
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) {
+		uint32_t parent_index = ethash_fastmod(num_parent_nodes, fnv_hash(node_index ^ i, ret->words[i % NODE_WORDS]));
+		ETHASH_ACCESS_RECORD(ETHASH_ACCESS_CACHE, (uint64_t)parent_index * sizeof(node));
+		__m256i const* parent = (__m256i const*)cache_nodes[parent_index].words;
+		y0 = _mm256_xor_si256(_mm256_mullo_epi32(y0, fnv_prime), _mm256_loadu_si256(parent + 0));
+		y1 = _mm256_xor_si256(_mm256_mullo_epi32(y1, fnv_prime), _mm256_loadu_si256(parent + 1));
+
+		// have to write to ret as values are used to compute index
+		_mm256_storeu_si256(out + 0, y0);
+		_mm256_storeu_si256(out + 1, y1);
+	}
+}
+
+ETHASH_TARGET("avx2")
+static void fnv_dag_items_parents_avx2(
+	node* ret,
+	uint32_t first_index,
+	unsigned count,
+	node const* cache_nodes,
+	ethash_fastmod_t const* num_parent_nodes
+)
+{
+	__m256i const fnv_prime = _mm256_set1_epi32(FNV_PRIME);
+	__m256i const* parents[ETHASH_FNV_CHAINS];
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) {
+		for (unsigned k = 0; k != count; ++k) {
+			uint32_t const parent_index = ethash_fastmod(num_parent_nodes, fnv_hash((first_index + k) ^ i, ret[k].words[i % NODE_WORDS]));
+			ETHASH_ACCESS_RECORD(ETHASH_ACCESS_CACHE, (uint64_t)parent_index * sizeof(node));
+			parents[k] = (__m256i const*)cache_nodes[parent_index].words;
+		}
+		for (unsigned k = 0; k != count; ++k) {
+			__m256i* const out = (__m256i*)ret[k].words;
+			__m256i const y0 = _mm256_mullo_epi32(_mm256_loadu_si256(out + 0), fnv_prime);
+			__m256i const y1 = _mm256_mullo_epi32(_mm256_loadu_si256(out + 1), fnv_prime);
+			_mm256_storeu_si256(out + 0, _mm256_xor_si256(y0, _mm256_loadu_si256(parents[k] + 0)));
+			_mm256_storeu_si256(out + 1, _mm256_xor_si256(y1, _mm256_loadu_si256(parents[k] + 1)));
+		}
+	}
+}
+
+ETHASH_TARGET("avx2")
+static void fnv_mix_avx2(node* mix, node const* data, unsigned count)
+{
+	__m256i const fnv_prime = _mm256_set1_epi32(FNV_PRIME);
+	for (unsigned n = 0; n != count; ++n) {
+		__m256i* const m = (__m256i*)mix[n].words;
+		__m256i const* d = (__m256i const*)data[n].words;
+		__m256i const y0 = _mm256_mullo_epi32(_mm256_loadu_si256(m + 0), fnv_prime);
+		__m256i const y1 = _mm256_mullo_epi32(_mm256_loadu_si256(m + 1), fnv_prime);
+		_mm256_storeu_si256(m + 0, _mm256_xor_si256(y0, _mm256_loadu_si256(d + 0)));
+		_mm256_storeu_si256(m + 1, _mm256_xor_si256(y1, _mm256_loadu_si256(d + 1)));
+	}
+}
+
+ETHASH_TARGET("avx512f")
+static void fnv_dag_item_parents_avx512(
+	node* ret,
+	uint32_t node_index,
+	node const* cache_nodes,
+	ethash_fastmod_t const* num_parent_nodes
+)
+{
+	__m512i const fnv_prime = _mm512_set1_epi32(FNV_PRIME);
+	__m512i z0 = _mm512_loadu_si512(ret->words);
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) {
+		uint32_t parent_index = ethash_fastmod(num_parent_nodes, fnv_hash(node_index ^ i, ret->words[i % NODE_WORDS]));
+		ETHASH_ACCESS_RECORD(ETHASH_ACCESS_CACHE, (uint64_t)parent_index * sizeof(node));
+		z0 = _mm512_xor_si512(_mm512_mullo_epi32(z0, fnv_prime), _mm512_loadu_si512(cache_nodes[parent_index].words));
+
+		// have to write to ret as values are used to compute index
+		_mm512_storeu_si512(ret->words, z0);
+	}
+}
+
+ETHASH_TARGET("avx512f")
+static void fnv_dag_items_parents_avx512(
+	node* ret,
+	uint32_t first_index,
+	unsigned count,
+	node const* cache_nodes,
+	ethash_fastmod_t const* num_parent_nodes
+)
+{
+	__m512i const fnv_prime = _mm512_set1_epi32(FNV_PRIME);
+	uint32_t const* parents[ETHASH_FNV_CHAINS];
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) {
+		for (unsigned k = 0; k != count; ++k) {
+			uint32_t const parent_index = ethash_fastmod(num_parent_nodes, fnv_hash((first_index + k) ^ i, ret[k].words[i % NODE_WORDS]));
+			ETHASH_ACCESS_RECORD(ETHASH_ACCESS_CACHE, (uint64_t)parent_index * sizeof(node));
+			parents[k] = cache_nodes[parent_index].words;
+		}
+		for (unsigned k = 0; k != count; ++k) {
+			__m512i const z = _mm512_mullo_epi32(_mm512_loadu_si512(ret[k].words), fnv_prime);
+			_mm512_storeu_si512(ret[k].words, _mm512_xor_si512(z, _mm512_loadu_si512(parents[k])));
+		}
+	}
+}
+
+ETHASH_TARGET("avx512f")
+static void fnv_mix_avx512(node* mix, node const* data, unsigned count)
+{
+	__m512i const fnv_prime = _mm512_set1_epi32(FNV_PRIME);
+	for (unsigned n = 0; n != count; ++n) {
+		__m512i const z = _mm512_mullo_epi32(_mm512_loadu_si512(mix[n].words), fnv_prime);
+		_mm512_storeu_si512(mix[n].words, _mm512_xor_si512(z, _mm512_loadu_si512(data[n].words)));
+	}
+}
+
+#endif // ETHASH_FNV_SIMD
+
+#if defined(ETHASH_FNV_NEON)
+
+static void fnv_dag_item_parents_neon(
+	node* ret,
+	uint32_t node_index,
+	node const* cache_nodes,
+	ethash_fastmod_t const* num_parent_nodes
+)
+{
+	uint32x4_t const fnv_prime = vdupq_n_u32(FNV_PRIME);
+	uint32x4_t x0 = vld1q_u32(ret->words + 0);
+	uint32x4_t x1 = vld1q_u32(ret->words + 4);
+	uint32x4_t x2 = vld1q_u32(ret->words + 8);
+	uint32x4_t x3 = vld1q_u32(ret->words + 12);
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) {
+		uint32_t parent_index = ethash_fastmod(num_parent_nodes, fnv_hash(node_index ^ i, ret->words[i % NODE_WORDS]));
+		ETHASH_ACCESS_RECORD(ETHASH_ACCESS_CACHE, (uint64_t)parent_index * sizeof(node));
+		uint32_t const* parent = cache_nodes[parent_index].words;
+		x0 = veorq_u32(vmulq_u32(x0, fnv_prime), vld1q_u32(parent + 0));
+		x1 = veorq_u32(vmulq_u32(x1, fnv_prime), vld1q_u32(parent + 4));
+		x2 = veorq_u32(vmulq_u32(x2, fnv_prime), vld1q_u32(parent + 8));
+		x3 = veorq_u32(vmulq_u32(x3, fnv_prime), vld1q_u32(parent + 12));
+
+		// have to write to ret as values are used to compute index
+		vst1q_u32(ret->words + 0, x0);
+		vst1q_u32(ret->words + 4, x1);
+		vst1q_u32(ret->words + 8, x2);
+		vst1q_u32(ret->words + 12, x3);
+	}
+}
+
+static void fnv_dag_items_parents_neon(
+	node* ret,
+	uint32_t first_index,
+	unsigned count,
+	node const* cache_nodes,
+	ethash_fastmod_t const* num_parent_nodes
+)
+{
+	uint32x4_t const fnv_prime = vdupq_n_u32(FNV_PRIME);
+	uint32_t const* parents[ETHASH_FNV_CHAINS];
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) {
+		for (unsigned k = 0; k != count; ++k) {
+			uint32_t const parent_index = ethash_fastmod(num_parent_nodes, fnv_hash((first_index + k) ^ i, ret[k].words[i % NODE_WORDS]));
+			ETHASH_ACCESS_RECORD(ETHASH_ACCESS_CACHE, (uint64_t)parent_index * sizeof(node));
+			parents[k] = cache_nodes[parent_index].words;
+		}
+		for (unsigned k = 0; k != count; ++k) {
+			for (unsigned v = 0; v != NODE_WORDS; v += 4) {
+				uint32x4_t const x = vmulq_u32(vld1q_u32(ret[k].words + v), fnv_prime);
+				vst1q_u32(ret[k].words + v, veorq_u32(x, vld1q_u32(parents[k] + v)));
+			}
+		}
+	}
+}
+
+static void fnv_mix_neon(node* mix, node const* data, unsigned count)
+{
+	uint32x4_t const fnv_prime = vdupq_n_u32(FNV_PRIME);
+	for (unsigned n = 0; n != count; ++n) {
+		for (unsigned v = 0; v != NODE_WORDS; v += 4) {
+			uint32x4_t const x = vmulq_u32(vld1q_u32(mix[n].words + v), fnv_prime);
+			vst1q_u32(mix[n].words + v, veorq_u32(x, vld1q_u32(data[n].words + v)));
+		}
+	}
+}
+
+#endif // ETHASH_FNV_NEON
+
+// fastest first, the portable kernel has to stay last
+static ethash_fnv_kernel_t const fnv_kernels[] = {
+#if defined(ETHASH_FNV_SIMD)
+	{ "avx512", ETHASH_CPU_AVX512F, fnv_dag_item_parents_avx512, fnv_dag_items_parents_avx512, fnv_mix_avx512 },
+	{ "avx2", ETHASH_CPU_AVX2, fnv_dag_item_parents_avx2, fnv_dag_items_parents_avx2, fnv_mix_avx2 },
+	{ "sse4.1", ETHASH_CPU_SSE41, fnv_dag_item_parents_sse41, fnv_dag_items_parents_sse41, fnv_mix_sse41 },
+#endif
+#if defined(ETHASH_FNV_NEON)
+	{ "neon", ETHASH_CPU_NEON, fnv_dag_item_parents_neon, fnv_dag_items_parents_neon, fnv_mix_neon },
+#endif
+	{ "generic", 0, fnv_dag_item_parents_generic, fnv_dag_items_parents_generic, fnv_mix_generic }
+};
+
+#define FNV_KERNEL_COUNT (sizeof(fnv_kernels) / sizeof(fnv_kernels[0]))
+
+ethash_fnv_kernel_t const* ethash_fnv_kernel_at(unsigned i)
+{
+	uint32_t const features = ethash_cpu_features();
+	for (unsigned k = 0; k != FNV_KERNEL_COUNT; ++k) {
+		if ((fnv_kernels[k].required_features & features) != fnv_kernels[k].required_features) {
+			continue;
+		}
+		if (i-- == 0) {
+			return &fnv_kernels[k];
+		}
+	}
+	return NULL;
+}
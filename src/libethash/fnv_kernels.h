@@ -0,0 +1,87 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file fnv_kernels.h
+ * @date 2018
+ *
+ * Node wide FNV kernels shared by the DAG item generation and the hashimoto
+ * mix loop. The implementation used is picked at runtime by dispatch.c
+ */
+#pragma once
+#include "internal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// The most DAG items ethash_fnv_kernel_t::dag_items_parents() computes together
+#define ETHASH_FNV_CHAINS 4
+
+typedef struct ethash_fnv_kernel {
+	/// Short name identifying the implementation, e.g. "avx2"
+	char const* name;
+	/// Mask of @ref ethash_cpu_feature values the implementation needs
+	uint32_t required_features;
+	/**
+	 * Run the ETHASH_DATASET_PARENTS parent rounds of a DAG item
+	 *
+	 * @param ret              The node being computed, already seeded with its
+	 *                         first SHA3-512 round
+	 * @param node_index       The index of the DAG item
+	 * @param cache_nodes      The light cache
+	 * @param num_parent_nodes The number of nodes in the light cache
+	 */
+	void (*dag_item_parents)(
+		node* ret,
+		uint32_t node_index,
+		node const* cache_nodes,
+		ethash_fastmod_t const* num_parent_nodes
+	);
+	/**
+	 * Run the parent rounds of @a count consecutive DAG items at once, like
+	 * @ref dag_item_parents() for each of them. The rounds of the items are
+	 * interleaved, so that the light cache misses of their independent
+	 * chains of parents overlap.
+	 *
+	 * @param ret              The nodes being computed, already seeded
+	 * @param first_index      The index of the DAG item in ret[0]
+	 * @param count            The number of items, 1 to ETHASH_FNV_CHAINS
+	 */
+	void (*dag_items_parents)(
+		node* ret,
+		uint32_t first_index,
+		unsigned count,
+		node const* cache_nodes,
+		ethash_fastmod_t const* num_parent_nodes
+	);
+	/**
+	 * Set mix[n] = fnv(mix[n], data[n]) word by word for n < @a count
+	 */
+	void (*mix)(node* mix, node const* data, unsigned count);
+} ethash_fnv_kernel_t;
+
+/**
+ * Enumerate the FNV kernels supported by the host, fastest first
+ *
+ * @param i        The index of the kernel
+ * @return         The kernel or NULL if @a i is past the last supported one.
+ *                 The last kernel is always the portable one.
+ */
+ethash_fnv_kernel_t const* ethash_fnv_kernel_at(unsigned i);
+
+#ifdef __cplusplus
+}
+#endif
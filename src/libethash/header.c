@@ -0,0 +1,253 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file header.c
+ * @date 2018
+ *
+ * Block headers in their RLP encoding, see @ref ethash_header_seal_hash().
+ * Only the fields the proof of work needs are decoded, the others are
+ * hashed as they are, so headers with fields after the nonce, like the base
+ * fee, get the seal hash of their chain too.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ethash.h"
+#include "internal.h"
+
+#ifdef WITH_CRYPTOPP
+#include "sha3_cryptopp.h"
+#else
+#include "sha3.h"
+#endif // WITH_CRYPTOPP
+
+/// The fields of a header up to the ones of the seal
+enum ethash_header_field {
+	ETHASH_HEADER_DIFFICULTY = 7,
+	ETHASH_HEADER_NUMBER = 8,
+	ETHASH_HEADER_MIX_HASH = 13,
+	ETHASH_HEADER_NONCE = 14,
+	ETHASH_HEADER_FIELDS = 15
+};
+
+/// Headers are about 540 bytes, so only the ones with a lot of extra data allocate
+#define ETHASH_HEADER_STACK_BYTES 1024
+
+// An item of an RLP encoding
+typedef struct ethash_rlp_item {
+	uint8_t const* begin;        ///< the first byte of the prefix
+	uint8_t const* payload;
+	size_t length;               ///< of the payload
+	bool list;
+} ethash_rlp_item_t;
+
+// Decode the item at the start of [p, end), false if it does not fit
+static bool ethash_rlp_next(ethash_rlp_item_t* item, uint8_t const* p, uint8_t const* end)
+{
+	if (p == end) {
+		return false;
+	}
+	size_t const avail = (size_t)(end - p);
+	uint8_t const b = *p;
+	size_t prefix = 1;
+	size_t length;
+	item->begin = p;
+	item->list = b >= 0xc0;
+	if (b < 0x80) {
+		// a single byte is its own encoding
+		prefix = 0;
+		length = 1;
+	} else if (b < 0xb8) {
+		length = b - 0x80;
+	} else if (b < 0xc0 || b >= 0xf8) {
+		size_t const bytes = b - (b < 0xc0 ? 0xb7 : 0xf7);
+		if (bytes > sizeof(size_t) || avail - 1 < bytes) {
+			return false;
+		}
+		length = 0;
+		for (size_t i = 0; i != bytes; ++i) {
+			length = (length << 8) | p[1 + i];
+		}
+		prefix += bytes;
+	} else {
+		length = b - 0xc0;
+	}
+	if (avail - prefix < length) {
+		return false;
+	}
+	item->payload = p + prefix;
+	item->length = length;
+	return true;
+}
+
+// Split a header into its list and the fields up to the nonce, checking
+// that the fields the proof of work needs have their sizes
+static bool ethash_header_split(
+	ethash_rlp_item_t* header,
+	ethash_rlp_item_t fields[ETHASH_HEADER_FIELDS],
+	uint8_t const* rlp,
+	size_t size
+)
+{
+	uint8_t const* const end = rlp + size;
+	if (!ethash_rlp_next(header, rlp, end) || !header->list || header->payload + header->length != end) {
+		return false;
+	}
+	uint8_t const* p = header->payload;
+	for (unsigned i = 0; i != ETHASH_HEADER_FIELDS; ++i) {
+		if (!ethash_rlp_next(&fields[i], p, end)) {
+			return false;
+		}
+		p = fields[i].payload + fields[i].length;
+	}
+	// the fields after the nonce are only hashed, but must be items too
+	for (ethash_rlp_item_t extra; p != end; p = extra.payload + extra.length) {
+		if (!ethash_rlp_next(&extra, p, end)) {
+			return false;
+		}
+	}
+	ethash_rlp_item_t const* const difficulty = &fields[ETHASH_HEADER_DIFFICULTY];
+	ethash_rlp_item_t const* const number = &fields[ETHASH_HEADER_NUMBER];
+	ethash_rlp_item_t const* const mix_hash = &fields[ETHASH_HEADER_MIX_HASH];
+	ethash_rlp_item_t const* const nonce = &fields[ETHASH_HEADER_NONCE];
+	return !difficulty->list && difficulty->length <= 32 &&
+		!number->list && number->length <= 8 &&
+		!mix_hash->list && mix_hash->length == 32 &&
+		!nonce->list && nonce->length == 8;
+}
+
+// The hash of the list of all fields but the mix hash and the nonce
+static bool ethash_header_hash_seal(
+	ethash_h256_t* ret,
+	ethash_rlp_item_t const* header,
+	ethash_rlp_item_t const fields[ETHASH_HEADER_FIELDS]
+)
+{
+	ethash_rlp_item_t const* const nonce = &fields[ETHASH_HEADER_NONCE];
+	uint8_t const* const end = header->payload + header->length;
+	uint8_t const* const tail = nonce->payload + nonce->length;
+	size_t const head_length = (size_t)(fields[ETHASH_HEADER_MIX_HASH].begin - header->payload);
+	size_t const tail_length = (size_t)(end - tail);
+	size_t const length = head_length + tail_length;
+
+	uint8_t prefix[1 + sizeof(size_t)];
+	size_t prefix_length = 1;
+	if (length < 56) {
+		prefix[0] = (uint8_t)(0xc0 + length);
+	} else {
+		for (size_t l = length; l; l >>= 8) {
+			prefix_length++;
+		}
+		prefix[0] = (uint8_t)(0xf7 + prefix_length - 1);
+		for (size_t i = 1, l = length; i != prefix_length; ++i, l >>= 8) {
+			prefix[prefix_length - i] = (uint8_t)l;
+		}
+	}
+
+	uint8_t stack[ETHASH_HEADER_STACK_BYTES];
+	size_t const total = prefix_length + length;
+	uint8_t* const buffer = total <= sizeof(stack) ? stack : malloc(total);
+	if (!buffer) {
+		return false;
+	}
+	memcpy(buffer, prefix, prefix_length);
+	memcpy(buffer + prefix_length, header->payload, head_length);
+	memcpy(buffer + prefix_length + head_length, tail, tail_length);
+	SHA3_256(ret, buffer, total);
+	if (buffer != stack) {
+		free(buffer);
+	}
+	return true;
+}
+
+// A big endian number of at most 8 bytes
+static uint64_t ethash_rlp_u64(ethash_rlp_item_t const* item)
+{
+	uint64_t ret = 0;
+	for (size_t i = 0; i != item->length; ++i) {
+		ret = (ret << 8) | item->payload[i];
+	}
+	return ret;
+}
+
+bool ethash_header_seal_hash(ethash_h256_t* seal_hash, uint8_t const* rlp, size_t size)
+{
+	ethash_rlp_item_t header;
+	ethash_rlp_item_t fields[ETHASH_HEADER_FIELDS];
+	return ethash_header_split(&header, fields, rlp, size) && ethash_header_hash_seal(seal_hash, &header, fields);
+}
+
+static bool ethash_header_decode(
+	uint8_t const* rlp,
+	size_t size,
+	uint64_t* block_number,
+	ethash_h256_t* header_hash,
+	uint64_t* nonce,
+	ethash_h256_t* mix_hash,
+	ethash_h256_t* boundary
+)
+{
+	ethash_rlp_item_t header;
+	ethash_rlp_item_t fields[ETHASH_HEADER_FIELDS];
+	if (!ethash_header_split(&header, fields, rlp, size)) {
+		return false;
+	}
+	ethash_rlp_item_t const* const difficulty_item = &fields[ETHASH_HEADER_DIFFICULTY];
+	ethash_h256_t difficulty;
+	memset(&difficulty, 0, sizeof(difficulty));
+	memcpy(difficulty.b + 32 - difficulty_item->length, difficulty_item->payload, difficulty_item->length);
+	if (!ethash_boundary_from_difficulty(boundary, &difficulty)) {
+		return false;
+	}
+	if (!ethash_header_hash_seal(header_hash, &header, fields)) {
+		return false;
+	}
+	*block_number = ethash_rlp_u64(&fields[ETHASH_HEADER_NUMBER]);
+	*nonce = ethash_rlp_u64(&fields[ETHASH_HEADER_NONCE]);
+	memcpy(mix_hash, fields[ETHASH_HEADER_MIX_HASH].payload, 32);
+	return true;
+}
+
+size_t ethash_header_decode_batch(
+	uint8_t const* headers,
+	size_t const* sizes,
+	uint64_t* block_numbers,
+	ethash_h256_t* header_hashes,
+	uint64_t* nonces,
+	ethash_h256_t* mix_hashes,
+	ethash_h256_t* boundaries,
+	bool* decoded,
+	size_t count
+)
+{
+	size_t ret = 0;
+	for (size_t i = 0; i != count; headers += sizes[i], ++i) {
+		decoded[i] = ethash_header_decode(
+			headers, sizes[i], &block_numbers[i], &header_hashes[i], &nonces[i], &mix_hashes[i], &boundaries[i]
+		);
+		if (decoded[i]) {
+			ret++;
+		} else {
+			// a boundary of 0 that verifying rejects
+			block_numbers[i] = 0;
+			nonces[i] = 0;
+			memset(&header_hashes[i], 0, sizeof(header_hashes[i]));
+			memset(&mix_hashes[i], 0, sizeof(mix_hashes[i]));
+			memset(&boundaries[i], 0, sizeof(boundaries[i]));
+		}
+	}
+	return ret;
+}
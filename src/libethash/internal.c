@@ -28,10 +28,21 @@
 #include "mmap.h"
 #include "ethash.h"
 #include "fnv.h"
+#include "dispatch.h"
+#include "dag_memo.h"
+#include "memory_budget.h"
+#include "result_cache.h"
 #include "endian.h"
 #include "internal.h"
 #include "data_sizes.h"
 #include "io.h"
+#include "threads.h"
+#include "threadpool.h"
+#include "stats.h"
+#include "trace.h"
+#include "util.h"
+#include "probes.h"
+#include "access_stats.h"
 
 #ifdef WITH_CRYPTOPP
 
@@ -43,47 +54,97 @@
 
 uint64_t ethash_get_datasize(uint64_t const block_number)
 {
-	assert(block_number / ETHASH_EPOCH_LENGTH < 2048);
-	return dag_sizes[block_number / ETHASH_EPOCH_LENGTH];
+	uint64_t const epoch = block_number / ETHASH_EPOCH_LENGTH;
+	if (epoch < ETHASH_TABULATED_EPOCHS) {
+		return dag_sizes[epoch];
+	}
+	uint64_t cache_size;
+	uint64_t full_size;
+	ethash_ethereum_sizes(epoch, &cache_size, &full_size);
+	return full_size;
 }
 
 uint64_t ethash_get_cachesize(uint64_t const block_number)
 {
-	assert(block_number / ETHASH_EPOCH_LENGTH < 2048);
-	return cache_sizes[block_number / ETHASH_EPOCH_LENGTH];
+	uint64_t const epoch = block_number / ETHASH_EPOCH_LENGTH;
+	if (epoch < ETHASH_TABULATED_EPOCHS) {
+		return cache_sizes[epoch];
+	}
+	uint64_t cache_size;
+	uint64_t full_size;
+	ethash_ethereum_sizes(epoch, &cache_size, &full_size);
+	return cache_size;
+}
+
+// Number of cache nodes computed between two looks at an ethash_cache_job
+#define ETHASH_CACHE_JOB_NODES 4096
+
+/// Progress and cancellation of a cache computation shared with another thread
+struct ethash_cache_job {
+	uint32_t volatile done;      ///< nodes computed so far, over all passes
+	uint32_t volatile total;     ///< num_nodes * (1 + ETHASH_CACHE_ROUNDS), 0 until known
+	uint32_t volatile cancelled; ///< set to stop the computation
+};
+
+// account for the nodes computed since the last call, false if cancelled
+static bool ethash_cache_job_step(struct ethash_cache_job* job, uint32_t pass, uint32_t num_nodes, uint32_t i)
+{
+	if (!job) {
+		return true;
+	}
+	ethash_atomic_store_u32(&job->done, pass * num_nodes + i);
+	return !ethash_atomic_load_u32(&job->cancelled);
 }
 
 // Follows Sergio's "STRICT MEMORY HARD HASHING FUNCTIONS" (2014)
 // https://bitslog.files.wordpress.com/2013/12/memohash-v0-3.pdf
 // SeqMemoHash(s, R, N)
+//
+// Every node depends on the one computed right before it, in the first pass
+// as well as in the rounds, so there is nothing to spread over threads. What
+// can be done is computing the cache in the background, see ethash_light_new_async()
 static bool ethash_compute_cache_nodes(
 	node* const nodes,
 	uint64_t cache_size,
-	ethash_h256_t const* seed
+	ethash_h256_t const* seed,
+	struct ethash_cache_job* job
 )
 {
 	if (cache_size % sizeof(node) != 0) {
 		return false;
 	}
 	uint32_t const num_nodes = (uint32_t) (cache_size / sizeof(node));
+	if (job) {
+		ethash_atomic_store_u32(&job->total, num_nodes * (1 + ETHASH_CACHE_ROUNDS));
+	}
 
 	SHA3_512(nodes[0].bytes, (uint8_t*)seed, 32);
 
 	for (uint32_t i = 1; i != num_nodes; ++i) {
 		SHA3_512(nodes[i].bytes, nodes[i - 1].bytes, 64);
+		if (i % ETHASH_CACHE_JOB_NODES == 0 && !ethash_cache_job_step(job, 0, num_nodes, i)) {
+			return false;
+		}
 	}
 
 	for (uint32_t j = 0; j != ETHASH_CACHE_ROUNDS; j++) {
-		for (uint32_t i = 0; i != num_nodes; i++) {
+		// the predecessor of node 0 is the last node
+		uint32_t prev = num_nodes - 1;
+		for (uint32_t i = 0; i != num_nodes; prev = i++) {
 			uint32_t const idx = nodes[i].words[0] % num_nodes;
 			node data;
-			data = nodes[(num_nodes - 1 + i) % num_nodes];
 			for (uint32_t w = 0; w != NODE_WORDS; ++w) {
-				data.words[w] ^= nodes[idx].words[w];
+				data.words[w] = nodes[prev].words[w] ^ nodes[idx].words[w];
 			}
 			SHA3_512(nodes[i].bytes, data.bytes, sizeof(data));
+			if (i % ETHASH_CACHE_JOB_NODES == 0 && !ethash_cache_job_step(job, 1 + j, num_nodes, i)) {
+				return false;
+			}
 		}
 	}
+	if (job) {
+		ethash_atomic_store_u32(&job->done, job->total);
+	}
 
 	// now perform endian conversion
 	fix_endian_arr32(nodes->words, num_nodes * NODE_WORDS);
@@ -96,61 +157,83 @@ void ethash_calculate_dag_item(
 	ethash_light_t const light
 )
 {
-	uint32_t num_parent_nodes = (uint32_t) (light->cache_size / sizeof(node));
 	node const* cache_nodes = (node const *) light->cache;
-	node const* init = &cache_nodes[node_index % num_parent_nodes];
+	node const* init = &cache_nodes[ethash_fastmod(&light->num_parent_nodes, node_index)];
 	memcpy(ret, init, sizeof(node));
 	ret->words[0] ^= node_index;
 	SHA3_512(ret->bytes, ret->bytes, sizeof(node));
-#if defined(_M_X64) && ENABLE_SSE
-	__m128i const fnv_prime = _mm_set1_epi32(FNV_PRIME);
-	__m128i xmm0 = ret->xmm[0];
-	__m128i xmm1 = ret->xmm[1];
-	__m128i xmm2 = ret->xmm[2];
-	__m128i xmm3 = ret->xmm[3];
-#elif defined(__MIC__)
-	__m512i const fnv_prime = _mm512_set1_epi32(FNV_PRIME);
-	__m512i zmm0 = ret->zmm[0];
-#endif
+	ethash_kernels()->fnv->dag_item_parents(ret, node_index, cache_nodes, &light->num_parent_nodes);
+	SHA3_512(ret->bytes, ret->bytes, sizeof(node));
+}
 
-	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) {
-		uint32_t parent_index = fnv_hash(node_index ^ i, ret->words[i % NODE_WORDS]) % num_parent_nodes;
-		node const *parent = &cache_nodes[parent_index];
-
-#if defined(_M_X64) && ENABLE_SSE
-		{
-			xmm0 = _mm_mullo_epi32(xmm0, fnv_prime);
-			xmm1 = _mm_mullo_epi32(xmm1, fnv_prime);
-			xmm2 = _mm_mullo_epi32(xmm2, fnv_prime);
-			xmm3 = _mm_mullo_epi32(xmm3, fnv_prime);
-			xmm0 = _mm_xor_si128(xmm0, parent->xmm[0]);
-			xmm1 = _mm_xor_si128(xmm1, parent->xmm[1]);
-			xmm2 = _mm_xor_si128(xmm2, parent->xmm[2]);
-			xmm3 = _mm_xor_si128(xmm3, parent->xmm[3]);
-
-			// have to write to ret as values are used to compute index
-			ret->xmm[0] = xmm0;
-			ret->xmm[1] = xmm1;
-			ret->xmm[2] = xmm2;
-			ret->xmm[3] = xmm3;
-		}
-		#elif defined(__MIC__)
-		{
-			zmm0 = _mm512_mullo_epi32(zmm0, fnv_prime);
-
-			// have to write to ret as values are used to compute index
-			zmm0 = _mm512_xor_si512(zmm0, parent->zmm[0]);
-			ret->zmm[0] = zmm0;
-		}
-		#else
-		{
-			for (unsigned w = 0; w != NODE_WORDS; ++w) {
-				ret->words[w] = fnv_hash(ret->words[w], parent->words[w]);
-			}
+// Number of DAG items computed together by ethash_calculate_dag_items(),
+// a multiple of the widest multi-buffer Keccak kernel
+#define ETHASH_DAG_ITEMS_BATCH 8
+
+void ethash_calculate_dag_items(
+	node* ret,
+	uint32_t first_index,
+	uint32_t count,
+	ethash_light_t const light
+)
+{
+	node const* cache_nodes = (node const *) light->cache;
+	ethash_kernels_t const* const kernels = ethash_kernels();
+	ethash_stats_add(ETHASH_STAT_DAG_ITEMS, count);
+	while (count) {
+		uint32_t const batch = min_u32(count, ETHASH_DAG_ITEMS_BATCH);
+		for (uint32_t i = 0; i != batch; ++i) {
+			uint32_t const node_index = first_index + i;
+			memcpy(&ret[i], &cache_nodes[ethash_fastmod(&light->num_parent_nodes, node_index)], sizeof(node));
+			ret[i].words[0] ^= node_index;
 		}
-#endif
+		kernels->sha3_multi->sha3_512_nodes(ret, batch);
+		// the parent chains of the items are independent, their misses overlap
+		for (uint32_t i = 0; i < batch; i += ETHASH_FNV_CHAINS) {
+			unsigned const chains = min_u32(batch - i, ETHASH_FNV_CHAINS);
+			kernels->fnv->dag_items_parents(&ret[i], first_index + i, chains, cache_nodes, &light->num_parent_nodes);
+		}
+		kernels->sha3_multi->sha3_512_nodes(ret, batch);
+		ret += batch;
+		first_index += batch;
+		count -= batch;
+	}
+}
+
+void ethash_calculate_dag_items_at(
+	node* ret,
+	uint32_t const* indices,
+	uint32_t count,
+	ethash_light_t const light
+)
+{
+	node const* cache_nodes = (node const *) light->cache;
+	ethash_kernels_t const* const kernels = ethash_kernels();
+	ethash_stats_add(ETHASH_STAT_DAG_ITEMS, count);
+	for (uint32_t i = 0; i != count; ++i) {
+		memcpy(&ret[i], &cache_nodes[ethash_fastmod(&light->num_parent_nodes, indices[i])], sizeof(node));
+		ret[i].words[0] ^= indices[i];
+	}
+	for (uint32_t i = 0; i < count; i += ETHASH_DAG_ITEMS_BATCH) {
+		kernels->sha3_multi->sha3_512_nodes(&ret[i], min_u32(count - i, ETHASH_DAG_ITEMS_BATCH));
+	}
+	// every item takes its turn at each parent, whose read was prefetched by
+	// the turn of the item before, instead of waiting for it
+	for (uint32_t p = 0; p != ETHASH_DATASET_PARENTS; ++p) {
+		node const* parents[ETHASH_MAX_LIGHT_INTERLEAVE * MIX_NODES];
+		for (uint32_t i = 0; i != count; ++i) {
+			uint32_t const parent_index = ethash_fastmod(&light->num_parent_nodes, fnv_hash(indices[i] ^ p, ret[i].words[p % NODE_WORDS]));
+			ETHASH_ACCESS_RECORD(ETHASH_ACCESS_CACHE, (uint64_t)parent_index * sizeof(node));
+			parents[i] = &cache_nodes[parent_index];
+			ETHASH_PREFETCH(parents[i]);
+		}
+		for (uint32_t i = 0; i != count; ++i) {
+			kernels->fnv->mix(&ret[i], parents[i], 1);
+		}
+	}
+	for (uint32_t i = 0; i < count; i += ETHASH_DAG_ITEMS_BATCH) {
+		kernels->sha3_multi->sha3_512_nodes(&ret[i], min_u32(count - i, ETHASH_DAG_ITEMS_BATCH));
 	}
-	SHA3_512(ret->bytes, ret->bytes, sizeof(node));
 }
 
 bool ethash_compute_full_data(
@@ -168,37 +251,222 @@ bool ethash_compute_full_data(
 	node* full_nodes = mem;
 	double const progress_change = 1.0f / max_n;
 	double progress = 0.0f;
-	// now compute full nodes
-	for (uint32_t n = 0; n != max_n; ++n) {
-		if (callback &&
-			n % (max_n / 100) == 0 &&
-			callback((unsigned int)(ceil(progress * 100.0f))) != 0) {
+	uint64_t const start = ethash_time_us();
+	bool aborted = false;
+	ETHASH_PROBE2(dag__start, 0, max_n);
+	// now compute full nodes, a batch at a time
+	for (uint32_t n = 0; n != max_n && !aborted; ) {
+		uint32_t const count = min_u32(ETHASH_DAG_ITEMS_BATCH, max_n - n);
+		for (uint32_t i = n; i != n + count; ++i) {
+			if (callback &&
+				i % (max_n / 100) == 0 &&
+				callback((unsigned int)(ceil(progress * 100.0f))) != 0) {
 
-			return false;
+				aborted = true;
+				break;
+			}
+			progress += progress_change;
+		}
+		if (!aborted) {
+			ethash_calculate_dag_items(&(full_nodes[n]), n, count, light);
+			n += count;
 		}
-		progress += progress_change;
-		ethash_calculate_dag_item(&(full_nodes[n]), n, light);
 	}
-	return true;
+	ETHASH_PROBE3(dag__done, 0, max_n, !aborted);
+	ethash_stats_add(ETHASH_STAT_DAG_BUILD_US, ethash_time_us() - start);
+	return !aborted;
 }
 
-static bool ethash_hash(
-	ethash_return_value_t* ret,
-	node const* full_nodes,
+// Number of DAG nodes a worker claims at a time in @ref ethash_compute_full_data_parallel()
+#define ETHASH_DAG_CHUNK_NODES 4096
+
+/// Progress and cancellation of a DAG computation shared with another thread
+struct ethash_dag_control {
+	uint32_t volatile nodes;     ///< DAG nodes computed so far
+	uint32_t volatile cancelled; ///< set to stop the computation
+	/// Advanced over the nodes computed in order from the first one, may be NULL
+	uint64_t volatile* watermark;
+	/// The handler being computed, valid once has_partial is set
+	ethash_full_t partial;
+	uint32_t volatile has_partial;
+};
+
+struct ethash_dag_job {
+	node* nodes;                 ///< holds the nodes from first on
+	uint32_t first;
+	uint32_t begin;              ///< first node to compute
+	uint32_t max_n;              ///< number of nodes of the whole DAG
+	uint32_t end;                ///< one past the last node to compute
+	uint32_t chunk;
+	ethash_light_t light;
+	ethash_callback_t callback;
+	struct ethash_dag_control* control; ///< may be NULL
+
+	uint32_t volatile next;      ///< first node of the next unclaimed chunk
+	uint32_t volatile done;      ///< number of nodes computed so far, including the skipped ones
+	uint32_t volatile aborted;   ///< set once the callback asked us to stop
+	unsigned reported;           ///< last progress given to the callback, protected by lock
+	ethash_mutex_t lock;         ///< serializes calls to the callback
+	uint32_t volatile* settled;  ///< one per chunk set once computed, if control has a watermark
+};
+
+static void ethash_dag_job_report(struct ethash_dag_job* job, uint32_t done)
+{
+	unsigned const progress = (unsigned)(((uint64_t)done * 100) / job->max_n);
+	ethash_mutex_lock(&job->lock);
+	if (progress > job->reported && !ethash_atomic_load_u32(&job->aborted)) {
+		job->reported = progress;
+		if (job->callback(progress) != 0) {
+			ethash_atomic_store_u32(&job->aborted, 1);
+		}
+	}
+	ethash_mutex_unlock(&job->lock);
+}
+
+// Mark the chunk at @a begin computed and advance the watermark over the
+// chunks computed in order by now
+static void ethash_dag_job_settle(struct ethash_dag_job* job, uint32_t begin)
+{
+	uint64_t volatile* const watermark = job->control->watermark;
+	ethash_atomic_store_u32(&job->settled[(begin - job->begin) / job->chunk], 1);
+	uint64_t mark = ethash_atomic_load_u64(watermark);
+	while (mark < job->end && ethash_atomic_load_u32(&job->settled[(mark - job->begin) / job->chunk])) {
+		uint64_t const next = min_u32((uint32_t)mark + job->chunk, job->end);
+		if (ethash_atomic_compare_exchange_u64(watermark, &mark, next)) {
+			mark = next;
+		}
+	}
+}
+
+static void ethash_dag_job_worker(void* arg)
+{
+	struct ethash_dag_job* job = (struct ethash_dag_job*)arg;
+	while (!ethash_atomic_load_u32(&job->aborted)) {
+		if (job->control && ethash_atomic_load_u32(&job->control->cancelled)) {
+			ethash_atomic_store_u32(&job->aborted, 1);
+			break;
+		}
+		uint32_t const begin = ethash_atomic_fetch_add_u32(&job->next, job->chunk);
+		if (begin >= job->end) {
+			break;
+		}
+		uint32_t const end = min_u32(begin + job->chunk, job->end);
+		ETHASH_PROBE2(dag_chunk__start, begin, end - begin);
+		ethash_calculate_dag_items(&(job->nodes[begin - job->first]), begin, end - begin, job->light);
+		ETHASH_PROBE2(dag_chunk__done, begin, end - begin);
+		uint32_t const done = ethash_atomic_fetch_add_u32(&job->done, end - begin) + (end - begin);
+		if (job->control) {
+			ethash_atomic_fetch_add_u32(&job->control->nodes, end - begin);
+			if (job->control->watermark) {
+				ethash_dag_job_settle(job, begin);
+			}
+		}
+		if (job->callback) {
+			ethash_dag_job_report(job, done);
+		}
+	}
+}
+
+// Compute the DAG nodes [begin, end) of a DAG of @a full_size bytes into @a mem,
+// which holds the nodes from @a first on, on @a num_threads threads. Progress is
+// given to @a callback relative to the whole DAG, as if the nodes before
+// @a begin had just been computed
+static bool ethash_compute_full_range(
+	void* mem,
+	uint32_t first,
+	uint64_t full_size,
+	uint32_t begin,
+	uint32_t end,
 	ethash_light_t const light,
+	unsigned num_threads,
+	ethash_callback_t callback,
+	struct ethash_dag_control* control
+)
+{
+	struct ethash_dag_job job;
+	memset(&job, 0, sizeof(job));
+	job.nodes = (node*)mem;
+	job.first = first;
+	job.begin = begin;
+	job.max_n = (uint32_t)(full_size / sizeof(node));
+	job.end = end;
+	job.chunk = clamp_u32(job.max_n / 256, 1, ETHASH_DAG_CHUNK_NODES);
+	job.light = light;
+	job.callback = callback;
+	job.control = control;
+	job.next = begin;
+	job.done = begin;
+	job.reported = (unsigned)(((uint64_t)begin * 100) / job.max_n);
+	if (control && control->watermark) {
+		job.settled = calloc((end - begin) / job.chunk + 1, sizeof(uint32_t));
+		if (!job.settled) {
+			return false;
+		}
+		ethash_atomic_store_u64(control->watermark, begin);
+	}
+	if (!ethash_mutex_init(&job.lock)) {
+		free((void*)job.settled);
+		return false;
+	}
+	if (callback && begin == 0 && callback(0) != 0) {
+		ethash_mutex_destroy(&job.lock);
+		free((void*)job.settled);
+		return false;
+	}
+
+	uint64_t const start = ethash_time_us();
+	ETHASH_PROBE2(dag__start, begin, end);
+	ethash_parallel_run(ethash_dag_job_worker, &job, num_threads, ETHASH_THREAD_PRIORITY_LOW);
+	bool const ok = !job.aborted && job.done == job.end;
+	ETHASH_PROBE3(dag__done, begin, end, ok);
+	ethash_stats_add(ETHASH_STAT_DAG_BUILD_US, ethash_time_us() - start);
+	ethash_mutex_destroy(&job.lock);
+	free((void*)job.settled);
+	return ok;
+}
+
+// @ref ethash_compute_full_data_parallel() reporting to an optional @a control
+static bool ethash_compute_full_data_job(
+	void* mem,
 	uint64_t full_size,
-	ethash_h256_t const header_hash,
-	uint64_t const nonce
+	ethash_light_t const light,
+	unsigned num_threads,
+	ethash_callback_t callback,
+	struct ethash_dag_control* control
 )
 {
-	if (full_size % MIX_WORDS != 0) {
+	if (full_size % (sizeof(uint32_t) * MIX_WORDS) != 0 ||
+		(full_size % sizeof(node)) != 0) {
 		return false;
 	}
+	if (num_threads == 0) {
+		num_threads = ethash_hardware_concurrency();
+	}
+	if (num_threads == 1 && !control) {
+		return ethash_compute_full_data(mem, full_size, light, callback);
+	}
+	uint32_t const max_n = (uint32_t)(full_size / sizeof(node));
+	return ethash_compute_full_range(mem, 0, full_size, 0, max_n, light, num_threads, callback, control);
+}
+
+bool ethash_compute_full_data_parallel(
+	void* mem,
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned num_threads,
+	ethash_callback_t callback
+)
+{
+	return ethash_compute_full_data_job(mem, full_size, light, num_threads, callback, NULL);
+}
 
+// Pack the header hash and the nonce into s_mix[0] and hash them, then
+// replicate the hash across the mix in s_mix[1..MIX_NODES]
+static void ethash_hash_init(node s_mix[MIX_NODES + 1], ethash_h256_t const* header_hash, uint64_t const nonce)
+{
 	// pack hash and nonce together into first 40 bytes of s_mix
 	assert(sizeof(node) * 8 == 512);
-	node s_mix[MIX_NODES + 1];
-	memcpy(s_mix[0].bytes, &header_hash, 32);
+	memcpy(s_mix[0].bytes, header_hash, 32);
 	fix_endian64(s_mix[0].double_words[4], nonce);
 
 	// compute sha3-512 hash and replicate across mix
@@ -209,53 +477,20 @@ static bool ethash_hash(
 	for (uint32_t w = 0; w != MIX_WORDS; ++w) {
 		mix->words[w] = s_mix[0].words[w % NODE_WORDS];
 	}
+}
 
-	unsigned const page_size = sizeof(uint32_t) * MIX_WORDS;
-	unsigned const num_full_pages = (unsigned) (full_size / page_size);
-
-	for (unsigned i = 0; i != ETHASH_ACCESSES; ++i) {
-		uint32_t const index = fnv_hash(s_mix->words[0] ^ i, mix->words[i % MIX_WORDS]) % num_full_pages;
-
-		for (unsigned n = 0; n != MIX_NODES; ++n) {
-			node const* dag_node;
-			node tmp_node;
-			if (full_nodes) {
-				dag_node = &full_nodes[MIX_NODES * index + n];
-			} else {
-				ethash_calculate_dag_item(&tmp_node, index * MIX_NODES + n, light);
-				dag_node = &tmp_node;
-			}
-
-#if defined(_M_X64) && ENABLE_SSE
-			{
-				__m128i fnv_prime = _mm_set1_epi32(FNV_PRIME);
-				__m128i xmm0 = _mm_mullo_epi32(fnv_prime, mix[n].xmm[0]);
-				__m128i xmm1 = _mm_mullo_epi32(fnv_prime, mix[n].xmm[1]);
-				__m128i xmm2 = _mm_mullo_epi32(fnv_prime, mix[n].xmm[2]);
-				__m128i xmm3 = _mm_mullo_epi32(fnv_prime, mix[n].xmm[3]);
-				mix[n].xmm[0] = _mm_xor_si128(xmm0, dag_node->xmm[0]);
-				mix[n].xmm[1] = _mm_xor_si128(xmm1, dag_node->xmm[1]);
-				mix[n].xmm[2] = _mm_xor_si128(xmm2, dag_node->xmm[2]);
-				mix[n].xmm[3] = _mm_xor_si128(xmm3, dag_node->xmm[3]);
-			}
-			#elif defined(__MIC__)
-			{
-				// __m512i implementation via union
-				//	Each vector register (zmm) can store sixteen 32-bit integer numbers
-				__m512i fnv_prime = _mm512_set1_epi32(FNV_PRIME);
-				__m512i zmm0 = _mm512_mullo_epi32(fnv_prime, mix[n].zmm[0]);
-				mix[n].zmm[0] = _mm512_xor_si512(zmm0, dag_node->zmm[0]);
-			}
-			#else
-			{
-				for (unsigned w = 0; w != NODE_WORDS; ++w) {
-					mix[n].words[w] = fnv_hash(mix[n].words[w], dag_node->words[w]);
-				}
-			}
-#endif
-		}
+// The DAG page read by access @a i of a hash
+static inline uint32_t ethash_hash_page(node const s_mix[MIX_NODES + 1], unsigned i, ethash_fastmod_t const* num_full_pages)
+{
+	uint32_t const page = ethash_fastmod(num_full_pages, fnv_hash(s_mix->words[0] ^ i, s_mix[1].words[i % MIX_WORDS]));
+	ETHASH_ACCESS_RECORD(ETHASH_ACCESS_DAG, (uint64_t)page * ETHASH_MIX_BYTES);
+	return page;
+}
 
-	}
+// Compress the mix after the last access and compute the final hash
+static void ethash_hash_finish(ethash_return_value_t* ret, node s_mix[MIX_NODES + 1])
+{
+	node* const mix = s_mix + 1;
 
 // Workaround for a GCC regression which causes a bogus -Warray-bounds warning.
 // The regression was introduced in GCC 4.8.4, fixed in GCC 5.0.0 and backported to GCC 4.9.3 but
@@ -273,12 +508,13 @@ static bool ethash_hash(
 #pragma GCC diagnostic ignored "-Warray-bounds"
 #endif // define (__GNUC__)
 
-	// compress mix
+	// compress mix, the groups of 4 words never straddle two nodes
 	for (uint32_t w = 0; w != MIX_WORDS; w += 4) {
-		uint32_t reduction = mix->words[w + 0];
-		reduction = reduction * FNV_PRIME ^ mix->words[w + 1];
-		reduction = reduction * FNV_PRIME ^ mix->words[w + 2];
-		reduction = reduction * FNV_PRIME ^ mix->words[w + 3];
+		uint32_t const* const group = &mix[w / NODE_WORDS].words[w % NODE_WORDS];
+		uint32_t reduction = group[0];
+		reduction = reduction * FNV_PRIME ^ group[1];
+		reduction = reduction * FNV_PRIME ^ group[2];
+		reduction = reduction * FNV_PRIME ^ group[3];
 		mix->words[w / 4] = reduction;
 	}
 
@@ -290,9 +526,145 @@ static bool ethash_hash(
 	memcpy(&ret->mix_hash, mix->bytes, 32);
 	// final Keccak hash
 	SHA3_256(&ret->result, s_mix->bytes, 64 + 32); // Keccak-256(s + compressed_mix)
+}
+
+// The number of ETHASH_MIX_BYTES pages of a DAG, false if @a full_size is not
+// a valid DAG size
+static bool ethash_full_pages(ethash_fastmod_t* num_full_pages, uint64_t full_size)
+{
+	if (full_size % MIX_WORDS != 0) {
+		return false;
+	}
+	unsigned const page_size = sizeof(uint32_t) * MIX_WORDS;
+	*num_full_pages = ethash_fastmod_init((unsigned) (full_size / page_size));
 	return true;
 }
 
+static void ethash_hash(
+	ethash_return_value_t* ret,
+	node const* full_nodes,
+	ethash_light_t const light,
+	ethash_fastmod_t const* num_full_pages,
+	ethash_h256_t const header_hash,
+	uint64_t const nonce
+)
+{
+	ETHASH_ALIGNED(64) node s_mix[MIX_NODES + 1];
+	ethash_hash_init(s_mix, &header_hash, nonce);
+	node* const mix = s_mix + 1;
+
+	ethash_fnv_kernel_t const* const fnv = ethash_kernels()->fnv;
+
+	bool const prefetch = full_nodes && ethash_get_prefetch();
+
+	for (unsigned i = 0; i != ETHASH_ACCESSES; ++i) {
+		uint32_t const index = ethash_hash_page(s_mix, i, num_full_pages);
+
+		node const* dag_nodes;
+		ETHASH_ALIGNED(64) node tmp_nodes[MIX_NODES];
+		if (full_nodes) {
+			dag_nodes = &full_nodes[MIX_NODES * index];
+			// all the lines of the page at once, before the mix reads the first
+			if (prefetch) {
+				for (unsigned n = 0; n != MIX_NODES; ++n) {
+					ETHASH_PREFETCH(&dag_nodes[n]);
+				}
+			}
+		} else {
+			ethash_light_dag_items(tmp_nodes, index * MIX_NODES, MIX_NODES, light);
+			dag_nodes = tmp_nodes;
+		}
+		fnv->mix(mix, dag_nodes, MIX_NODES);
+	}
+
+	ethash_hash_finish(ret, s_mix);
+	ethash_stats_add(full_nodes ? ETHASH_STAT_FULL_HASHES : ETHASH_STAT_LIGHT_HASHES, 1);
+}
+
+// Hash up to ETHASH_HASH_BATCH nonces of a full DAG in lockstep. Every access
+// first prefetches the pages of all the nonces and only then mixes them, so
+// the DRAM reads of the batch are in flight at the same time. Nonce k is
+// hashed with header_hashes[k * header_step]
+static void ethash_hash_batch(
+	ethash_return_value_t* results,
+	node const* full_nodes,
+	ethash_fastmod_t const* num_full_pages,
+	ethash_h256_t const* header_hashes,
+	unsigned header_step,
+	uint64_t const* nonces,
+	unsigned count
+)
+{
+	ETHASH_ALIGNED(64) node s_mix[ETHASH_HASH_BATCH][MIX_NODES + 1];
+	for (unsigned k = 0; k != count; ++k) {
+		ethash_hash_init(s_mix[k], &header_hashes[k * header_step], nonces[k]);
+	}
+
+	ethash_fnv_kernel_t const* const fnv = ethash_kernels()->fnv;
+
+	bool const prefetch = ethash_get_prefetch();
+	node const* pages[ETHASH_HASH_BATCH];
+	for (unsigned i = 0; i != ETHASH_ACCESSES; ++i) {
+		for (unsigned k = 0; k != count; ++k) {
+			pages[k] = &full_nodes[MIX_NODES * ethash_hash_page(s_mix[k], i, num_full_pages)];
+			for (unsigned n = 0; prefetch && n != MIX_NODES; ++n) {
+				ETHASH_PREFETCH(&pages[k][n]);
+			}
+		}
+		for (unsigned k = 0; k != count; ++k) {
+			fnv->mix(s_mix[k] + 1, pages[k], MIX_NODES);
+		}
+	}
+
+	for (unsigned k = 0; k != count; ++k) {
+		ethash_hash_finish(&results[k], s_mix[k]);
+		results[k].success = true;
+	}
+	ethash_stats_add(ETHASH_STAT_FULL_HASHES, count);
+}
+
+// Hash up to ETHASH_MAX_LIGHT_INTERLEAVE nonces of a light cache in lockstep.
+// Each hash is a state machine stepped by one access at a time: the pages of
+// all of them are picked first, then their DAG items are computed together
+// so that the misses of their parent reads overlap
+static void ethash_hash_interleaved(
+	ethash_return_value_t* results,
+	ethash_light_t const light,
+	ethash_fastmod_t const* num_full_pages,
+	ethash_h256_t const* header_hashes,
+	uint64_t const* nonces,
+	unsigned count
+)
+{
+	ETHASH_ALIGNED(64) node s_mix[ETHASH_MAX_LIGHT_INTERLEAVE][MIX_NODES + 1];
+	for (unsigned k = 0; k != count; ++k) {
+		ethash_hash_init(s_mix[k], &header_hashes[k], nonces[k]);
+	}
+
+	ethash_fnv_kernel_t const* const fnv = ethash_kernels()->fnv;
+
+	ETHASH_ALIGNED(64) node items[ETHASH_MAX_LIGHT_INTERLEAVE * MIX_NODES];
+	uint32_t indices[ETHASH_MAX_LIGHT_INTERLEAVE * MIX_NODES];
+	for (unsigned i = 0; i != ETHASH_ACCESSES; ++i) {
+		for (unsigned k = 0; k != count; ++k) {
+			uint32_t const page = ethash_hash_page(s_mix[k], i, num_full_pages);
+			for (unsigned n = 0; n != MIX_NODES; ++n) {
+				indices[k * MIX_NODES + n] = page * MIX_NODES + n;
+			}
+		}
+		ethash_light_dag_items_at(items, indices, count * MIX_NODES, light);
+		for (unsigned k = 0; k != count; ++k) {
+			fnv->mix(s_mix[k] + 1, &items[k * MIX_NODES], MIX_NODES);
+		}
+	}
+
+	for (unsigned k = 0; k != count; ++k) {
+		ethash_hash_finish(&results[k], s_mix[k]);
+		results[k].success = true;
+	}
+	ethash_stats_add(ETHASH_STAT_LIGHT_HASHES, count);
+}
+
 void ethash_quick_hash(
 	ethash_h256_t* return_hash,
 	ethash_h256_t const* header_hash,
@@ -309,16 +681,129 @@ void ethash_quick_hash(
 	SHA3_256(return_hash, buf, 64 + 32);
 }
 
+// Seedhashes of the epochs with a DAG size, filled lazily in order.
+// Entries below seedhashes_filled are final and can be read without the lock
+#define ETHASH_SEEDHASH_EPOCHS ETHASH_MAX_EPOCHS
+
+static ethash_h256_t seedhashes[ETHASH_SEEDHASH_EPOCHS];
+static uint32_t volatile seedhashes_filled = 1; // epoch 0 is all zeroes
+static ethash_mutex_t seedhashes_lock;
+static ethash_once_t seedhashes_once = ETHASH_ONCE_INIT;
+
+static void ethash_seedhashes_init(void)
+{
+	ethash_mutex_init(&seedhashes_lock);
+}
+
+// make sure the seedhashes of epochs [0, epochs) are in the table
+static void ethash_seedhashes_fill(uint32_t epochs)
+{
+	if (ethash_atomic_load_u32(&seedhashes_filled) >= epochs) {
+		return;
+	}
+	ethash_call_once(&seedhashes_once, ethash_seedhashes_init);
+	ethash_mutex_lock(&seedhashes_lock);
+	uint32_t filled = ethash_atomic_load_u32(&seedhashes_filled);
+	for (; filled < epochs; ++filled) {
+		SHA3_256(&seedhashes[filled], (uint8_t*)&seedhashes[filled - 1], 32);
+	}
+	// publish the new entries only once they are written
+	ethash_atomic_store_u32(&seedhashes_filled, filled);
+	ethash_mutex_unlock(&seedhashes_lock);
+}
+
 ethash_h256_t ethash_get_seedhash(uint64_t block_number)
 {
-	ethash_h256_t ret;
-	ethash_h256_reset(&ret);
-	uint64_t const epochs = block_number / ETHASH_EPOCH_LENGTH;
-	for (uint32_t i = 0; i < epochs; ++i)
+	uint64_t const epoch = block_number / ETHASH_EPOCH_LENGTH;
+	if (epoch < ETHASH_SEEDHASH_EPOCHS) {
+		ethash_seedhashes_fill((uint32_t)epoch + 1);
+		return seedhashes[epoch];
+	}
+	// past the table, continue the chain from its last entry
+	ethash_seedhashes_fill(ETHASH_SEEDHASH_EPOCHS);
+	ethash_h256_t ret = seedhashes[ETHASH_SEEDHASH_EPOCHS - 1];
+	for (uint64_t i = ETHASH_SEEDHASH_EPOCHS - 1; i < epoch; ++i) {
 		SHA3_256(&ret, (uint8_t*)&ret, 32);
+	}
 	return ret;
 }
 
+bool ethash_get_epoch_from_seedhash(ethash_h256_t const seedhash, uint64_t* epoch)
+{
+	ethash_seedhashes_fill(ETHASH_TABULATED_EPOCHS);
+	for (uint32_t i = 0; i != ETHASH_TABULATED_EPOCHS; ++i) {
+		if (memcmp(&seedhashes[i], &seedhash, sizeof(ethash_h256_t)) == 0) {
+			*epoch = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// The epoch of @a seed for the events of ethash_set_event_callback()
+static uint64_t ethash_seed_epoch(ethash_h256_t const* seed)
+{
+	uint64_t epoch;
+	return ethash_get_epoch_from_seedhash(*seed, &epoch) ? epoch : ETHASH_EVENT_NO_EPOCH;
+}
+
+bool ethash_boundary_from_difficulty(ethash_h256_t* boundary, ethash_h256_t const* difficulty)
+{
+	uint64_t d[4];
+	for (unsigned i = 0; i != 4; ++i) {
+		d[i] = ethash_h256_word(difficulty, i);
+	}
+	if (!(d[0] | d[1] | d[2] | d[3])) {
+		return false;
+	}
+	if (!(d[0] | d[1] | d[2]) && d[3] == 1) {
+		// 2^256 itself does not fit
+		memset(boundary, 0xff, sizeof(*boundary));
+		return true;
+	}
+	// long division of 2^256 one bit at a time, the remainder staying below
+	// the difficulty but needing a 257th bit while it is shifted
+	uint64_t q[4] = {0, 0, 0, 0};
+	uint64_t r[4] = {0, 0, 0, 1};
+	for (int bit = 255; bit >= 0; --bit) {
+		uint64_t const carry = r[0] >> 63;
+		r[0] = (r[0] << 1) | (r[1] >> 63);
+		r[1] = (r[1] << 1) | (r[2] >> 63);
+		r[2] = (r[2] << 1) | (r[3] >> 63);
+		r[3] <<= 1;
+		bool subtract = carry != 0;
+		for (unsigned i = 0; !subtract && i != 4; ++i) {
+			if (r[i] != d[i]) {
+				subtract = r[i] > d[i];
+				break;
+			}
+			subtract = i == 3;
+		}
+		if (subtract) {
+			uint64_t borrow = 0;
+			for (int i = 3; i >= 0; --i) {
+				uint64_t const diff = r[i] - d[i] - borrow;
+				borrow = (r[i] < d[i]) || (r[i] - d[i] < borrow);
+				r[i] = diff;
+			}
+			q[3 - bit / 64] |= (uint64_t)1 << (bit % 64);
+		}
+	}
+	for (unsigned i = 0; i != 4; ++i) {
+		uint64_t word = q[i];
+#if LITTLE_ENDIAN == BYTE_ORDER
+		word = ethash_swap_u64(word);
+#endif
+		memcpy(&boundary->b[i * 8], &word, 8);
+	}
+	return true;
+}
+
+bool ethash_check_boundary(ethash_h256_t const* result, ethash_h256_t const* boundary)
+{
+	return ethash_check_difficulty(result, boundary);
+}
+
 bool ethash_quick_check_difficulty(
 	ethash_h256_t const* header_hash,
 	uint64_t const nonce,
@@ -332,214 +817,2647 @@ bool ethash_quick_check_difficulty(
 	return ethash_check_difficulty(&return_hash, boundary);
 }
 
-ethash_light_t ethash_light_new_internal(uint64_t cache_size, ethash_h256_t const* seed)
+static uint32_t volatile huge_pages_policy = ETHASH_HUGE_PAGES_OFF;
+static uint32_t volatile numa_mode = ETHASH_NUMA_OFF;
+static uint32_t volatile dag_write_mode = ETHASH_DAG_WRITE_MMAP;
+static uint32_t volatile dag_load_mode = ETHASH_DAG_LOAD_LAZY;
+static uint32_t volatile prefetch_enabled = 1;
+static uint32_t volatile hash_batch = ETHASH_HASH_BATCH;
+static uint32_t volatile light_interleave = ETHASH_LIGHT_INTERLEAVE;
+static uint32_t volatile memory_lock_enabled = 0;
+
+void ethash_set_prefetch(bool enable)
 {
-	struct ethash_light *ret;
-	ret = calloc(sizeof(*ret), 1);
-	if (!ret) {
-		return NULL;
-	}
-#if defined(__MIC__)
-	ret->cache = _mm_malloc((size_t)cache_size, 64);
-#else
-	ret->cache = malloc((size_t)cache_size);
-#endif
-	if (!ret->cache) {
-		goto fail_free_light;
-	}
-	node* nodes = (node*)ret->cache;
-	if (!ethash_compute_cache_nodes(nodes, cache_size, seed)) {
-		goto fail_free_cache_mem;
-	}
-	ret->cache_size = cache_size;
-	return ret;
+	ethash_atomic_store_u32(&prefetch_enabled, enable ? 1 : 0);
+}
 
-fail_free_cache_mem:
-#if defined(__MIC__)
-	_mm_free(ret->cache);
-#else
-	free(ret->cache);
-#endif
-fail_free_light:
-	free(ret);
-	return NULL;
+bool ethash_get_prefetch(void)
+{
+	return ethash_atomic_load_u32(&prefetch_enabled) != 0;
 }
 
-ethash_light_t ethash_light_new(uint64_t block_number)
+void ethash_set_hash_batch(unsigned count)
 {
-	ethash_h256_t seedhash = ethash_get_seedhash(block_number);
-	ethash_light_t ret;
-	ret = ethash_light_new_internal(ethash_get_cachesize(block_number), &seedhash);
-	ret->block_number = block_number;
-	return ret;
+	count = count < 1 ? 1 : count > ETHASH_HASH_BATCH ? ETHASH_HASH_BATCH : count;
+	ethash_atomic_store_u32(&hash_batch, count);
 }
 
-void ethash_light_delete(ethash_light_t light)
+unsigned ethash_get_hash_batch(void)
 {
-	if (light->cache) {
-		free(light->cache);
-	}
-	free(light);
+	return ethash_atomic_load_u32(&hash_batch);
 }
 
-ethash_return_value_t ethash_light_compute_internal(
-	ethash_light_t light,
-	uint64_t full_size,
-	ethash_h256_t const header_hash,
-	uint64_t nonce
-)
+void ethash_set_light_interleave(unsigned count)
 {
-  	ethash_return_value_t ret;
-	ret.success = true;
-	if (!ethash_hash(&ret, NULL, light, full_size, header_hash, nonce)) {
-		ret.success = false;
-	}
-	return ret;
+	count = count < 1 ? 1 : count > ETHASH_MAX_LIGHT_INTERLEAVE ? ETHASH_MAX_LIGHT_INTERLEAVE : count;
+	ethash_atomic_store_u32(&light_interleave, count);
+}
+
+unsigned ethash_get_light_interleave(void)
+{
+	return ethash_atomic_load_u32(&light_interleave);
+}
+
+void ethash_set_memory_lock(bool enable)
+{
+	ethash_atomic_store_u32(&memory_lock_enabled, enable ? 1 : 0);
+}
+
+bool ethash_get_memory_lock(void)
+{
+	return ethash_atomic_load_u32(&memory_lock_enabled) != 0;
+}
+
+// Lock one region of a handler, adding its size to @a locked on success
+static void ethash_memory_lock_region(void const* base, size_t size, char const* what, uint64_t* locked)
+{
+	if (!base || !size) {
+		return;
+	}
+	if (ethash_memory_lock(base, size)) {
+		*locked += size;
+		return;
+	}
+	ethash_stats_add(ETHASH_STAT_MEMORY_LOCK_FAILURES, 1);
+	ETHASH_CRITICAL("Could not lock the %s in memory, it may be paged out.", what);
+}
+
+static void ethash_light_lock(struct ethash_light* light)
+{
+	if (!ethash_get_memory_lock()) {
+		return;
+	}
+	ethash_memory_lock_region(light->cache_memory.base, light->cache_memory.size, "light cache", &light->locked_bytes);
+	ethash_memory_lock_region(light->progpow_cache, PROGPOW_CACHE_BYTES, "ProgPoW cache", &light->locked_bytes);
+	ethash_memory_lock_region(light->dag_prefix.base, light->dag_prefix.size, "DAG prefix", &light->locked_bytes);
+}
+
+// Unlocks everything that may be locked, as a region that failed to lock is not remembered
+static void ethash_light_unlock(struct ethash_light* light)
+{
+	if (!light->locked_bytes) {
+		return;
+	}
+	ethash_memory_unlock(light->cache_memory.base, light->cache_memory.size);
+	ethash_memory_unlock(light->progpow_cache, PROGPOW_CACHE_BYTES);
+	if (light->dag_prefix.base) {
+		ethash_memory_unlock(light->dag_prefix.base, light->dag_prefix.size);
+	}
+	light->locked_bytes = 0;
+}
+
+static void ethash_full_lock(struct ethash_full* full)
+{
+	if (!ethash_get_memory_lock()) {
+		return;
+	}
+	ethash_memory_lock_region(full->memory.base, full->memory.size, "DAG", &full->locked_bytes);
+	for (unsigned n = 1; n != ETHASH_NUMA_MAX_NODES; ++n) {
+		ethash_memory_lock_region(full->replicas[n].base, full->replicas[n].size, "DAG replica", &full->locked_bytes);
+	}
+	ethash_memory_lock_region(full->progpow_cache.base, full->progpow_cache.size, "ProgPoW cache", &full->locked_bytes);
+}
+
+static void ethash_full_unlock(struct ethash_full* full)
+{
+	if (!full->locked_bytes) {
+		return;
+	}
+	ethash_memory_unlock(full->memory.base, full->memory.size);
+	for (unsigned n = 1; n != ETHASH_NUMA_MAX_NODES; ++n) {
+		if (full->replicas[n].base) {
+			ethash_memory_unlock(full->replicas[n].base, full->replicas[n].size);
+		}
+	}
+	if (full->progpow_cache.base) {
+		ethash_memory_unlock(full->progpow_cache.base, full->progpow_cache.size);
+	}
+	full->locked_bytes = 0;
+}
+
+void ethash_set_dag_load_mode(enum ethash_dag_load_mode mode)
+{
+	ethash_atomic_store_u32(&dag_load_mode, (uint32_t)mode);
+}
+
+enum ethash_dag_load_mode ethash_get_dag_load_mode(void)
+{
+	return (enum ethash_dag_load_mode)ethash_atomic_load_u32(&dag_load_mode);
+}
+
+void ethash_set_dag_write_mode(enum ethash_dag_write_mode mode)
+{
+	ethash_atomic_store_u32(&dag_write_mode, (uint32_t)mode);
+}
+
+enum ethash_dag_write_mode ethash_get_dag_write_mode(void)
+{
+	return (enum ethash_dag_write_mode)ethash_atomic_load_u32(&dag_write_mode);
+}
+
+void ethash_set_numa_mode(enum ethash_numa_mode mode)
+{
+	ethash_atomic_store_u32(&numa_mode, (uint32_t)mode);
+}
+
+enum ethash_numa_mode ethash_get_numa_mode(void)
+{
+	return (enum ethash_numa_mode)ethash_atomic_load_u32(&numa_mode);
+}
+
+void ethash_set_huge_pages(enum ethash_huge_pages policy)
+{
+	ethash_atomic_store_u32(&huge_pages_policy, (uint32_t)policy);
+}
+
+enum ethash_huge_pages ethash_get_huge_pages(void)
+{
+	return (enum ethash_huge_pages)ethash_atomic_load_u32(&huge_pages_policy);
+}
+
+char const* ethash_page_mode_name(enum ethash_page_mode mode)
+{
+	switch (mode) {
+	case ETHASH_PAGES_DEFAULT:
+		return "default";
+	case ETHASH_PAGES_FILE:
+		return "file";
+	case ETHASH_PAGES_TRANSPARENT:
+		return "transparent";
+	case ETHASH_PAGES_HUGETLB_2MB:
+		return "hugetlb-2mb";
+	case ETHASH_PAGES_HUGETLB_1GB:
+		return "hugetlb-1gb";
+	}
+	return "unknown";
+}
+
+// Allocate a light handler whose cache of @a cache_size bytes and ProgPoW
+// cache count against the memory budget, freed with ethash_light_handle_free()
+static struct ethash_light* ethash_light_handle_new(uint64_t cache_size)
+{
+	uint64_t const bytes = cache_size + PROGPOW_CACHE_BYTES;
+	if (!ethash_budget_reserve(bytes)) {
+		return NULL;
+	}
+	struct ethash_light* ret = calloc(sizeof(*ret), 1);
+	if (!ret) {
+		ethash_budget_release(bytes);
+		return NULL;
+	}
+	ret->budget_bytes = bytes;
+	return ret;
+}
+
+static void ethash_light_handle_free(struct ethash_light* light)
+{
+	ethash_budget_release(light->budget_bytes);
+	free(light);
+}
+
+static void ethash_light_cache_free(struct ethash_light* light)
+{
+	ethash_memory_pool_free(&light->cache_memory);
+	light->cache = NULL;
+}
+
+// Allocate the memory of the cache of @a ret, from @a provider if it has an
+// alloc function, else in huge pages if so requested. Even regular pages are
+// page aligned, so no node of the cache straddles two cache lines and the 512
+// bit kernels never split a load.
+static bool ethash_light_alloc_cache(
+	struct ethash_light* ret,
+	uint64_t cache_size,
+	ethash_memory_provider_t const* provider
+)
+{
+	bool const allocated = provider && provider->alloc ?
+		ethash_memory_provider_alloc(&ret->cache_memory, provider, (size_t)cache_size, ETHASH_MEMORY_LIGHT_CACHE) :
+		ethash_memory_pool_alloc(&ret->cache_memory, (size_t)cache_size, ethash_get_huge_pages());
+	if (allocated) {
+		ret->cache = ret->cache_memory.base;
+	}
+	return ret->cache != NULL;
+}
+
+static ethash_light_t ethash_light_compute_new(
+	uint64_t cache_size,
+	ethash_h256_t const* seed,
+	struct ethash_cache_job* job,
+	ethash_memory_provider_t const* provider
+)
+{
+	uint64_t const epoch = ethash_seed_epoch(seed);
+	ethash_trace(ETHASH_EVENT_CACHE_BUILD_START, epoch, cache_size, 0, ETHASH_DAG_FILE_NONE);
+	ETHASH_PROBE1(cache__start, cache_size);
+	uint64_t const start = ethash_time_us();
+	struct ethash_light *ret;
+	ret = ethash_light_handle_new(cache_size);
+	if (!ret) {
+		ETHASH_PROBE2(cache__done, cache_size, NULL);
+		return NULL;
+	}
+	ret->epoch = epoch;
+	if (!ethash_light_alloc_cache(ret, cache_size, provider)) {
+		goto fail_free_light;
+	}
+	node* nodes = (node*)ret->cache;
+	if (!ethash_compute_cache_nodes(nodes, cache_size, seed, job)) {
+		goto fail_free_cache_mem;
+	}
+	ret->cache_size = cache_size;
+	ret->num_parent_nodes = ethash_fastmod_init((uint32_t)(cache_size / sizeof(node)));
+	if (!progpow_light_compute_cache(ret)) {
+		goto fail_free_cache_mem;
+	}
+	ethash_light_lock(ret);
+	uint64_t const duration = ethash_time_us() - start;
+	ethash_stats_add(ETHASH_STAT_CACHE_BUILDS, 1);
+	ethash_stats_add(ETHASH_STAT_CACHE_BUILD_US, duration);
+	ethash_trace(ETHASH_EVENT_CACHE_BUILD_END, ret->epoch, cache_size, duration, ETHASH_DAG_FILE_NONE);
+	ETHASH_PROBE2(cache__done, cache_size, ret);
+	return ret;
+
+fail_free_cache_mem:
+	ethash_light_cache_free(ret);
+fail_free_light:
+	ethash_light_handle_free(ret);
+	ETHASH_PROBE2(cache__done, cache_size, NULL);
+	return NULL;
+}
+
+// Load a light cache file opened with ethash_io_open_cache(), failing if its
+// nodes do not match @a checksum. With @a shared it is always mapped, so that
+// all processes share its pages
+static ethash_light_t ethash_light_load(FILE* f, uint64_t cache_size, ethash_h256_t const* checksum, bool shared)
+{
+	struct ethash_light *ret;
+	ret = ethash_light_handle_new(cache_size);
+	if (!ret) {
+		return NULL;
+	}
+	size_t const file_size = (size_t)cache_size + ETHASH_CACHE_HEADER_SIZE;
+	enum ethash_huge_pages const policy = ethash_get_huge_pages();
+	if (policy != ETHASH_HUGE_PAGES_OFF && !shared) {
+		// read instead of mapping the file so that the cache can use huge pages
+		if (!ethash_memory_pool_alloc(&ret->cache_memory, (size_t)cache_size, policy)) {
+			goto fail_free_light;
+		}
+		ret->cache = ret->cache_memory.base;
+		if (fread(ret->cache, (size_t)cache_size, 1, f) != 1) {
+			goto fail_free_cache_mem;
+		}
+		ethash_stats_add(ETHASH_STAT_READ_BYTES, cache_size);
+	} else {
+		int const fd = ethash_fileno(f);
+		char* mmapped_data = fd == -1 ? MAP_FAILED : mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (mmapped_data == MAP_FAILED) {
+			goto fail_free_light;
+		}
+		ret->cache_memory.base = mmapped_data;
+		ret->cache_memory.size = file_size;
+		ret->cache_memory.mode = ETHASH_PAGES_FILE;
+		ret->cache = mmapped_data + ETHASH_CACHE_HEADER_SIZE;
+		// the hashes read scattered nodes, readahead would only bring in pages nobody uses
+		madvise(mmapped_data, file_size, MADV_RANDOM);
+		ethash_stats_add(ETHASH_STAT_MAPPED_BYTES, file_size);
+	}
+	ethash_h256_t found;
+	SHA3_256(&found, (uint8_t const*)ret->cache, (size_t)cache_size);
+	if (memcmp(&found, checksum, sizeof(found)) != 0) {
+		ETHASH_CRITICAL("The light cache file does not match its checksum.");
+		goto fail_free_cache_mem;
+	}
+	ret->cache_size = cache_size;
+	ret->num_parent_nodes = ethash_fastmod_init((uint32_t)(cache_size / sizeof(node)));
+	if (!progpow_light_compute_cache(ret)) {
+		goto fail_free_cache_mem;
+	}
+	ethash_light_lock(ret);
+	return ret;
+
+fail_free_cache_mem:
+	ethash_light_cache_free(ret);
+fail_free_light:
+	ethash_light_handle_free(ret);
+	return NULL;
+}
+
+ethash_light_t ethash_light_new_internal(uint64_t cache_size, ethash_h256_t const* seed)
+{
+	return ethash_light_compute_new(cache_size, seed, NULL, NULL);
+}
+
+ethash_light_t ethash_light_new_provided_internal(
+	uint64_t cache_size,
+	ethash_h256_t const* seed,
+	ethash_memory_provider_t const* provider
+)
+{
+	return ethash_light_compute_new(cache_size, seed, NULL, provider);
+}
+
+// @a dirname may be NULL to neither load nor write a light cache file
+static ethash_light_t ethash_light_new_from_dir(
+	char const* dirname,
+	uint64_t cache_size,
+	ethash_h256_t const* seed,
+	struct ethash_cache_job* job
+)
+{
+	if (!dirname) {
+		return ethash_light_compute_new(cache_size, seed, job, NULL);
+	}
+	ethash_light_t ret = NULL;
+	ethash_h256_t checksum;
+	FILE* f = ethash_io_open_cache(dirname, *seed, cache_size, &checksum);
+	if (f) {
+		ret = ethash_light_load(f, cache_size, &checksum, false);
+		fclose(f);
+		if (ret) {
+			ret->epoch = ethash_seed_epoch(seed);
+			return ret;
+		}
+		ETHASH_CRITICAL("Could not load the light cache file, recomputing it.");
+	}
+	ret = ethash_light_compute_new(cache_size, seed, job, NULL);
+	if (ret && !ethash_io_write_cache(dirname, *seed, ret->cache, cache_size)) {
+		// not fatal, the cache is just computed again next time
+		ETHASH_CRITICAL("Could not write the light cache file.");
+	}
+	return ret;
+}
+
+ethash_light_t ethash_light_attach_internal(
+	char const* dirname,
+	uint64_t cache_size,
+	ethash_h256_t const* seed
+)
+{
+	ethash_h256_t checksum;
+	FILE* f = ethash_io_open_cache(dirname, *seed, cache_size, &checksum);
+	if (!f) {
+		return NULL;
+	}
+	ethash_light_t ret = ethash_light_load(f, cache_size, &checksum, true);
+	fclose(f);
+	if (ret) {
+		ret->epoch = ethash_seed_epoch(seed);
+	}
+	return ret;
+}
+
+ethash_light_t ethash_light_attach(uint64_t block_number)
+{
+	char strbuf[256];
+	if (!ethash_get_default_dirname(strbuf, 256)) {
+		return NULL;
+	}
+	ethash_h256_t const seedhash = ethash_get_seedhash(block_number);
+	ethash_light_t ret = ethash_light_attach_internal(strbuf, ethash_get_cachesize(block_number), &seedhash);
+	if (ret) {
+		ret->block_number = block_number;
+	}
+	return ret;
+}
+
+ethash_light_t ethash_light_new_persistent_internal(
+	char const* dirname,
+	uint64_t cache_size,
+	ethash_h256_t const* seed
+)
+{
+	return ethash_light_new_from_dir(dirname, cache_size, seed, NULL);
+}
+
+ethash_light_t ethash_light_new_mapped_internal(
+	char const* dirname,
+	uint64_t cache_size,
+	ethash_h256_t const* seed
+)
+{
+	ethash_light_t ret = ethash_light_attach_internal(dirname, cache_size, seed);
+	if (ret) {
+		return ret;
+	}
+	ret = ethash_light_compute_new(cache_size, seed, NULL, NULL);
+	if (!ret) {
+		return NULL;
+	}
+	// another process may have written the file meanwhile, the rename keeps either copy whole
+	if (ethash_io_write_cache(dirname, *seed, ret->cache, cache_size)) {
+		ethash_light_t const mapped = ethash_light_attach_internal(dirname, cache_size, seed);
+		if (mapped) {
+			ethash_light_delete(ret);
+			return mapped;
+		}
+	}
+	ETHASH_CRITICAL("Could not map the light cache file, keeping the cache in memory.");
+	return ret;
+}
+
+ethash_light_t ethash_light_new_mapped(uint64_t block_number)
+{
+	char strbuf[256];
+	ethash_h256_t const seedhash = ethash_get_seedhash(block_number);
+	uint64_t const cache_size = ethash_get_cachesize(block_number);
+	ethash_light_t ret;
+	if (ethash_get_default_dirname(strbuf, 256)) {
+		ret = ethash_light_new_mapped_internal(strbuf, cache_size, &seedhash);
+	} else {
+		ret = ethash_light_new_internal(cache_size, &seedhash);
+	}
+	if (ret) {
+		ret->block_number = block_number;
+	}
+	return ret;
+}
+
+ethash_light_t ethash_light_new(uint64_t block_number)
+{
+	ETHASH_PROBE1(light_new__start, block_number);
+	char strbuf[256];
+	ethash_h256_t seedhash = ethash_get_seedhash(block_number);
+	uint64_t const cache_size = ethash_get_cachesize(block_number);
+	ethash_light_t ret;
+	if (ethash_get_default_dirname(strbuf, 256)) {
+		ret = ethash_light_new_persistent_internal(strbuf, cache_size, &seedhash);
+	} else {
+		ret = ethash_light_new_internal(cache_size, &seedhash);
+	}
+	if (ret) {
+		ret->block_number = block_number;
+	}
+	ETHASH_PROBE2(light_new__done, block_number, ret);
+	return ret;
+}
+
+ethash_light_t ethash_light_new_with_provider(uint64_t block_number, ethash_memory_provider_t const* provider)
+{
+	ethash_h256_t seedhash = ethash_get_seedhash(block_number);
+	ethash_light_t ret = ethash_light_new_provided_internal(ethash_get_cachesize(block_number), &seedhash, provider);
+	if (ret) {
+		ret->block_number = block_number;
+	}
+	return ret;
+}
+
+bool ethash_light_export_seed_package_internal(
+	ethash_light_t light,
+	ethash_h256_t const* seed,
+	uint64_t full_size,
+	char const* path
+)
+{
+	struct ethash_io_seed_package header;
+	memset(&header, 0, sizeof(header));
+	header.block_number = light->block_number;
+	header.cache_size = light->cache_size;
+	header.full_size = full_size;
+	header.seed_hash = *seed;
+	SHA3_256(&header.checksum, (uint8_t const*)light->cache, (size_t)light->cache_size);
+	return ethash_io_write_seed_package(path, &header, light->cache);
+}
+
+bool ethash_light_export_seed_package(ethash_light_t light, char const* path)
+{
+	ethash_h256_t const seedhash = ethash_light_seedhash(light);
+	return ethash_light_export_seed_package_internal(light, &seedhash, ethash_light_full_size(light), path);
+}
+
+ethash_light_t ethash_light_import_seed_package_internal(
+	char const* path,
+	char const* dirname,
+	ethash_h256_t* seed,
+	uint64_t* full_size
+)
+{
+	struct ethash_io_seed_package header;
+	FILE* f = ethash_io_open_seed_package(path, &header);
+	if (!f) {
+		ETHASH_CRITICAL("No valid seed package at \"%s\".", path);
+		return NULL;
+	}
+	struct ethash_light* ret = ethash_light_handle_new(header.cache_size);
+	if (!ret) {
+		goto fail_close_file;
+	}
+	if (!ethash_light_alloc_cache(ret, header.cache_size, NULL)) {
+		goto fail_free_light;
+	}
+	if (fread(ret->cache, (size_t)header.cache_size, 1, f) != 1) {
+		ETHASH_CRITICAL("Could not read the seed package.");
+		goto fail_free_cache_mem;
+	}
+	ethash_stats_add(ETHASH_STAT_READ_BYTES, header.cache_size);
+	ethash_h256_t checksum;
+	SHA3_256(&checksum, (uint8_t const*)ret->cache, (size_t)header.cache_size);
+	if (memcmp(&checksum, &header.checksum, sizeof(checksum)) != 0) {
+		ETHASH_CRITICAL("The seed package does not match its checksum.");
+		goto fail_free_cache_mem;
+	}
+	ret->cache_size = header.cache_size;
+	ret->num_parent_nodes = ethash_fastmod_init((uint32_t)(header.cache_size / sizeof(node)));
+	ret->block_number = header.block_number;
+	ret->epoch = ethash_seed_epoch(&header.seed_hash);
+	if (!progpow_light_compute_cache(ret)) {
+		goto fail_free_cache_mem;
+	}
+	ethash_light_lock(ret);
+	fclose(f);
+	if (dirname && !ethash_io_write_cache(dirname, header.seed_hash, ret->cache, header.cache_size)) {
+		// not fatal, the cache is just computed again next time
+		ETHASH_CRITICAL("Could not write the light cache file.");
+	}
+	*seed = header.seed_hash;
+	*full_size = header.full_size;
+	return ret;
+
+fail_free_cache_mem:
+	ethash_light_cache_free(ret);
+fail_free_light:
+	ethash_light_handle_free(ret);
+fail_close_file:
+	fclose(f);
+	return NULL;
+}
+
+// @ref ethash_light_import_seed_package_internal() of a package that must be
+// of the cache and DAG sizes of its block, written to @a dirname once checked
+static ethash_light_t ethash_light_import_seed_package_checked(
+	char const* path,
+	char const* dirname,
+	ethash_h256_t* seed,
+	uint64_t* full_size
+)
+{
+	ethash_light_t ret = ethash_light_import_seed_package_internal(path, NULL, seed, full_size);
+	if (!ret) {
+		return NULL;
+	}
+	ethash_h256_t const seedhash = ethash_get_seedhash(ret->block_number);
+	if (memcmp(&seedhash, seed, sizeof(seedhash)) != 0 ||
+		ret->cache_size != ethash_get_cachesize(ret->block_number) ||
+		*full_size != ethash_get_datasize(ret->block_number)) {
+		ETHASH_CRITICAL("The seed package does not match the epoch of its block.");
+		ethash_light_delete(ret);
+		return NULL;
+	}
+	if (dirname && !ethash_io_write_cache(dirname, *seed, ret->cache, ret->cache_size)) {
+		// not fatal, the cache is just computed again next time
+		ETHASH_CRITICAL("Could not write the light cache file.");
+	}
+	return ret;
+}
+
+ethash_light_t ethash_light_import_seed_package(char const* path)
+{
+	char strbuf[256];
+	ethash_h256_t seedhash;
+	uint64_t full_size;
+	bool const has_dirname = ethash_get_default_dirname(strbuf, 256);
+	return ethash_light_import_seed_package_checked(path, has_dirname ? strbuf : NULL, &seedhash, &full_size);
+}
+
+struct ethash_light_future {
+	char* dirname;
+	uint64_t cache_size;
+	uint64_t block_number;
+	ethash_h256_t seed;
+	struct ethash_cache_job job;
+	ethash_light_t result;
+	uint32_t volatile finished;
+	bool started;                ///< whether @a thread has to be joined
+	ethash_thread_t thread;
+};
+
+static void ethash_light_future_run(void* arg)
+{
+	struct ethash_light_future* future = (struct ethash_light_future*)arg;
+	future->result = ethash_light_new_from_dir(future->dirname, future->cache_size, &future->seed, &future->job);
+	if (future->result) {
+		future->result->block_number = future->block_number;
+	}
+	ethash_atomic_store_u32(&future->finished, 1);
+}
+
+static ethash_light_future_t ethash_light_future_start(
+	char const* dirname,
+	uint64_t cache_size,
+	ethash_h256_t const* seed,
+	uint64_t block_number
+)
+{
+	struct ethash_light_future* ret = calloc(1, sizeof(*ret));
+	if (!ret) {
+		return NULL;
+	}
+	if (dirname) {
+		size_t const length = strlen(dirname);
+		ret->dirname = malloc(length + 1);
+		if (!ret->dirname) {
+			free(ret);
+			return NULL;
+		}
+		memcpy(ret->dirname, dirname, length + 1);
+	}
+	ret->cache_size = cache_size;
+	ret->block_number = block_number;
+	ret->seed = *seed;
+	ret->started = ethash_thread_create(&ret->thread, ethash_light_future_run, ret);
+	if (!ret->started) {
+		// no thread to spare, the future is then ready from the start
+		ethash_light_future_run(ret);
+	}
+	return ret;
+}
+
+ethash_light_future_t ethash_light_new_async_internal(
+	char const* dirname,
+	uint64_t cache_size,
+	ethash_h256_t const* seed
+)
+{
+	return ethash_light_future_start(dirname, cache_size, seed, 0);
+}
+
+ethash_light_future_t ethash_light_new_async(uint64_t block_number)
+{
+	char strbuf[256];
+	ethash_h256_t const seedhash = ethash_get_seedhash(block_number);
+	bool const persistent = ethash_get_default_dirname(strbuf, 256);
+	return ethash_light_future_start(
+		persistent ? strbuf : NULL,
+		ethash_get_cachesize(block_number),
+		&seedhash,
+		block_number
+	);
+}
+
+bool ethash_light_future_poll(ethash_light_future_t future)
+{
+	return ethash_atomic_load_u32(&future->finished) != 0;
+}
+
+unsigned ethash_light_future_progress(ethash_light_future_t future)
+{
+	uint32_t const total = ethash_atomic_load_u32(&future->job.total);
+	if (total == 0) {
+		return ethash_light_future_poll(future) ? 100 : 0;
+	}
+	return (unsigned)((uint64_t)ethash_atomic_load_u32(&future->job.done) * 100 / total);
+}
+
+// wait for the worker and free the future, giving back its result
+static ethash_light_t ethash_light_future_join(ethash_light_future_t future)
+{
+	if (future->started) {
+		ethash_thread_join(future->thread);
+	}
+	ethash_light_t const result = future->result;
+	free(future->dirname);
+	free(future);
+	return result;
+}
+
+ethash_light_t ethash_light_future_wait(ethash_light_future_t future)
+{
+	return ethash_light_future_join(future);
+}
+
+void ethash_light_future_cancel(ethash_light_future_t future)
+{
+	ethash_atomic_store_u32(&future->job.cancelled, 1);
+	ethash_light_t const result = ethash_light_future_join(future);
+	if (result) {
+		// finished before noticing the cancellation
+		ethash_light_delete(result);
+	}
+}
+
+void ethash_light_delete(ethash_light_t light)
+{
+	ethash_light_unlock(light);
+	if (light->cache) {
+		ethash_light_cache_free(light);
+	}
+	free(light->progpow_cache);
+	ethash_dag_memo_delete(light->memo);
+	ethash_memory_free(&light->dag_prefix);
+	ethash_light_handle_free(light);
+}
+
+bool ethash_light_set_dag_prefix(ethash_light_t light, uint64_t max_bytes, unsigned num_threads)
+{
+	uint64_t const full_size = ethash_light_full_size(light);
+	uint32_t const nodes = (uint32_t)((max_bytes < full_size ? max_bytes : full_size) / sizeof(node));
+	uint64_t const bytes = (uint64_t)nodes * sizeof(node);
+	struct ethash_memory prefix = {NULL, 0, ETHASH_PAGES_DEFAULT};
+	if (!ethash_budget_reserve(bytes)) {
+		return false;
+	}
+	if (nodes) {
+		if (!ethash_memory_alloc(&prefix, (size_t)bytes, ethash_get_huge_pages())) {
+			goto fail;
+		}
+		if (!ethash_compute_full_range(prefix.base, 0, full_size, 0, nodes, light, num_threads, NULL, NULL)) {
+			ethash_memory_free(&prefix);
+			goto fail;
+		}
+	}
+	// locked again with the new prefix, the locks of the other regions are only counted anew
+	uint64_t const old_bytes = (uint64_t)light->dag_prefix_nodes * sizeof(node);
+	ethash_light_unlock(light);
+	ethash_memory_free(&light->dag_prefix);
+	ethash_budget_release(old_bytes);
+	light->budget_bytes += bytes - old_bytes;
+	light->dag_prefix = prefix;
+	light->dag_prefix_nodes = nodes;
+	ethash_light_lock(light);
+	return true;
+
+fail:
+	ethash_budget_release(bytes);
+	return false;
+}
+
+uint64_t ethash_light_dag_prefix_size(ethash_light_t light)
+{
+	return (uint64_t)light->dag_prefix_nodes * sizeof(node);
+}
+
+ethash_return_value_t ethash_light_compute_internal(
+	ethash_light_t light,
+	uint64_t full_size,
+	ethash_h256_t const header_hash,
+	uint64_t nonce
+)
+{
+  	ethash_return_value_t ret;
+	if (ethash_result_cache_lookup(light, full_size, ETHASH_RESULT_CACHE_ETHASH, &header_hash, nonce, &ret)) {
+		return ret;
+	}
+	ethash_fastmod_t num_full_pages;
+	ret.success = ethash_full_pages(&num_full_pages, full_size);
+	if (ret.success) {
+		ethash_hash(&ret, NULL, light, &num_full_pages, header_hash, nonce);
+	}
+	ethash_result_cache_store(light, full_size, ETHASH_RESULT_CACHE_ETHASH, &header_hash, nonce, &ret);
+	return ret;
+}
+
+void ethash_light_compute_interleaved_internal(
+	ethash_light_t light,
+	uint64_t full_size,
+	ethash_h256_t const* header_hashes,
+	uint64_t const* nonces,
+	ethash_return_value_t* results,
+	size_t count
+)
+{
+	ethash_fastmod_t num_full_pages;
+	if (!ethash_full_pages(&num_full_pages, full_size)) {
+		for (size_t i = 0; i != count; ++i) {
+			results[i].success = false;
+		}
+		return;
+	}
+	unsigned const lanes = ethash_get_light_interleave();
+	ethash_h256_t lane_headers[ETHASH_MAX_LIGHT_INTERLEAVE];
+	uint64_t lane_nonces[ETHASH_MAX_LIGHT_INTERLEAVE];
+	ethash_return_value_t lane_results[ETHASH_MAX_LIGHT_INTERLEAVE];
+	size_t lane_of[ETHASH_MAX_LIGHT_INTERLEAVE];
+	size_t i = 0;
+	while (i != count) {
+		// the lanes are refilled with the nonces missing from the result cache
+		unsigned filled = 0;
+		for (; i != count && filled != lanes; ++i) {
+			if (ethash_result_cache_lookup(light, full_size, ETHASH_RESULT_CACHE_ETHASH, &header_hashes[i], nonces[i], &results[i])) {
+				continue;
+			}
+			lane_headers[filled] = header_hashes[i];
+			lane_nonces[filled] = nonces[i];
+			lane_of[filled++] = i;
+		}
+		if (!filled) {
+			continue;
+		}
+		ethash_hash_interleaved(lane_results, light, &num_full_pages, lane_headers, lane_nonces, filled);
+		for (unsigned k = 0; k != filled; ++k) {
+			results[lane_of[k]] = lane_results[k];
+			ethash_result_cache_store(light, full_size, ETHASH_RESULT_CACHE_ETHASH, &lane_headers[k], lane_nonces[k], &lane_results[k]);
+		}
+	}
 }
 
 ethash_return_value_t ethash_light_compute(
 	ethash_light_t light,
-	ethash_h256_t const header_hash,
-	uint64_t nonce
+	ethash_h256_t const header_hash,
+	uint64_t nonce
+)
+{
+	uint64_t full_size = ethash_light_full_size(light);
+	return ethash_light_compute_internal(light, full_size, header_hash, nonce);
+}
+
+struct ethash_verify_job {
+	ethash_light_t light;
+	uint64_t full_size;
+	ethash_h256_t const* header_hashes;
+	uint64_t const* nonces;
+	ethash_h256_t const* mix_hashes;
+	ethash_h256_t const* boundaries;
+	bool* results;
+	uint64_t count;
+	uint64_t volatile next;      ///< the next header to claim
+	uint64_t volatile valid;
+};
+
+static void ethash_verify_worker(void* arg)
+{
+	struct ethash_verify_job* job = (struct ethash_verify_job*)arg;
+	unsigned const lanes = ethash_get_light_interleave();
+	uint64_t first;
+	// a thread claims as many headers as it interleaves
+	while ((first = ethash_atomic_fetch_add_u64(&job->next, lanes)) < job->count) {
+		uint64_t const end = job->count - first < lanes ? job->count : first + lanes;
+		ethash_h256_t header_hashes[ETHASH_MAX_LIGHT_INTERLEAVE];
+		uint64_t nonces[ETHASH_MAX_LIGHT_INTERLEAVE];
+		ethash_return_value_t rets[ETHASH_MAX_LIGHT_INTERLEAVE];
+		size_t hashed[ETHASH_MAX_LIGHT_INTERLEAVE];
+		unsigned count = 0;
+		for (uint64_t i = first; i != end; ++i) {
+			job->results[i] = false;
+			// rejects headers with a made up mix hash without touching the cache
+			if (ethash_quick_check_difficulty(&job->header_hashes[i], job->nonces[i], &job->mix_hashes[i], &job->boundaries[i])) {
+				header_hashes[count] = job->header_hashes[i];
+				nonces[count] = job->nonces[i];
+				hashed[count++] = (size_t)i;
+			}
+		}
+		ethash_light_compute_interleaved_internal(job->light, job->full_size, header_hashes, nonces, rets, count);
+		for (unsigned k = 0; k != count; ++k) {
+			size_t const i = hashed[k];
+			job->results[i] = rets[k].success &&
+				memcmp(&rets[k].mix_hash, &job->mix_hashes[i], sizeof(ethash_h256_t)) == 0 &&
+				ethash_check_difficulty(&rets[k].result, &job->boundaries[i]);
+		}
+		for (uint64_t i = first; i != end; ++i) {
+			if (job->results[i]) {
+				ethash_atomic_fetch_add_u64(&job->valid, 1);
+			} else {
+				ethash_stats_add(ETHASH_STAT_VERIFY_FAILURES, 1);
+			}
+		}
+	}
+}
+
+size_t ethash_light_verify_batch_internal(
+	ethash_light_t light,
+	uint64_t full_size,
+	ethash_h256_t const* header_hashes,
+	uint64_t const* nonces,
+	ethash_h256_t const* mix_hashes,
+	ethash_h256_t const* boundaries,
+	bool* results,
+	size_t count,
+	unsigned num_threads
+)
+{
+	struct ethash_verify_job job = {
+		light, full_size, header_hashes, nonces, mix_hashes, boundaries, results, count, 0, 0
+	};
+	if (count == 0) {
+		return 0;
+	}
+	if (num_threads == 0) {
+		num_threads = ethash_hardware_concurrency();
+	}
+	if (num_threads > count) {
+		num_threads = (unsigned)count;
+	}
+	ethash_parallel_run(ethash_verify_worker, &job, num_threads, ETHASH_THREAD_PRIORITY_NORMAL);
+	return (size_t)job.valid;
+}
+
+size_t ethash_light_verify_batch(
+	ethash_light_t light,
+	ethash_h256_t const* header_hashes,
+	uint64_t const* nonces,
+	ethash_h256_t const* mix_hashes,
+	ethash_h256_t const* boundaries,
+	bool* results,
+	size_t count,
+	unsigned num_threads
+)
+{
+	uint64_t full_size = ethash_light_full_size(light);
+	return ethash_light_verify_batch_internal(
+		light, full_size, header_hashes, nonces, mix_hashes, boundaries, results, count, num_threads
+	);
+}
+
+static bool ethash_mmap(struct ethash_full* ret, FILE* f, bool writable)
+{
+	int fd;
+	char* mmapped_data;
+	errno = 0;
+	ret->file = f;
+	if ((fd = ethash_fileno(ret->file)) == -1) {
+		return false;
+	}
+	uint64_t const start = ethash_time_us();
+	size_t const size = (size_t)ret->file_size + ETHASH_DAG_HEADER_SIZE;
+	if (ret->provider && ret->provider->map_file) {
+		if (!ethash_memory_provider_map_file(&ret->memory, ret->provider, fd, size, writable)) {
+			return false;
+		}
+		mmapped_data = (char*)ret->memory.base;
+	} else {
+		mmapped_data = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+		if (mmapped_data == MAP_FAILED) {
+			return false;
+		}
+		ret->memory.base = mmapped_data;
+		ret->memory.size = size;
+		ret->memory.mode = ETHASH_PAGES_FILE;
+		ret->memory.provider = NULL;
+	}
+	ret->data = (node*)(mmapped_data + ETHASH_DAG_HEADER_SIZE);
+	ethash_stats_add(ETHASH_STAT_MAPPED_BYTES, ret->memory.size);
+	ethash_trace(
+		ETHASH_EVENT_DAG_MAPPED, ret->epoch, ret->memory.size, ethash_time_us() - start, ETHASH_DAG_FILE_NONE
+	);
+	return true;
+}
+
+// Bytes of a DAG mapping a thread of ethash_full_prefault() claims at a time
+#define ETHASH_PREFAULT_CHUNK (16U << 20)
+// Stride of the reads that fault the pages of a mapping in
+#define ETHASH_PREFAULT_STRIDE 4096
+
+struct ethash_prefault_job {
+	uint8_t const volatile* base;
+	size_t size;
+	uint32_t volatile next;      ///< index of the next unclaimed chunk
+};
+
+static void ethash_prefault_worker(void* arg)
+{
+	struct ethash_prefault_job* job = (struct ethash_prefault_job*)arg;
+	for (;;) {
+		size_t const begin = (size_t)ethash_atomic_fetch_add_u32(&job->next, 1) * ETHASH_PREFAULT_CHUNK;
+		if (begin >= job->size) {
+			break;
+		}
+		size_t const end = job->size - begin > ETHASH_PREFAULT_CHUNK ? begin + ETHASH_PREFAULT_CHUNK : job->size;
+		for (size_t i = begin; i < end; i += ETHASH_PREFAULT_STRIDE) {
+			(void)job->base[i];
+		}
+	}
+}
+
+// Fault every page of a DAG file mapping in on @a num_threads threads, after
+// asking the kernel to read the whole file ahead. Many page faults in flight
+// keep the disk busy, where hashing would take them one at a time at random
+static void ethash_full_prefault(struct ethash_full* ret, unsigned num_threads)
+{
+	ethash_memory_advise(&ret->memory, ret->provider, ETHASH_MEMORY_ADVICE_WILLNEED);
+	struct ethash_prefault_job job;
+	job.base = (uint8_t const volatile*)ret->memory.base;
+	job.size = ret->memory.size;
+	job.next = 0;
+	ethash_parallel_run(ethash_prefault_worker, &job, num_threads, ETHASH_THREAD_PRIORITY_NORMAL);
+}
+
+// Record how long @a ret took to become usable, see ethash_full_load_time_us()
+static ethash_full_t ethash_full_loaded(ethash_full_t ret, uint64_t start)
+{
+	if (ret) {
+		progpow_full_compute_cache(ret);
+		ethash_full_lock(ret);
+		ret->load_time_us = ethash_time_us() - start;
+		// the library itself leaves the read ahead of DAG files as it is
+		if (ret->provider) {
+			ethash_memory_advise(&ret->memory, ret->provider, ETHASH_MEMORY_ADVICE_RANDOM);
+		}
+	}
+	return ret;
+}
+
+struct ethash_checksum_job {
+	uint8_t const* data;         ///< the DAG from chunk first on
+	uint64_t full_size;
+	uint32_t first;
+	uint32_t last;               ///< one past the last chunk
+	ethash_h256_t* checksums;    ///< of all chunks, filled in or compared against
+	bool verify;
+	uint32_t volatile next;      ///< next unclaimed chunk
+	uint32_t volatile mismatches;
+};
+
+static void ethash_checksum_worker(void* arg)
+{
+	struct ethash_checksum_job* job = (struct ethash_checksum_job*)arg;
+	for (;;) {
+		uint32_t const c = ethash_atomic_fetch_add_u32(&job->next, 1);
+		if (c >= job->last) {
+			break;
+		}
+		uint64_t const begin = (uint64_t)c * ETHASH_DAG_CHECKSUM_BYTES;
+		uint64_t const size = job->full_size - begin < ETHASH_DAG_CHECKSUM_BYTES ? job->full_size - begin : ETHASH_DAG_CHECKSUM_BYTES;
+		ethash_h256_t checksum;
+		SHA3_256(&checksum, job->data + (begin - (uint64_t)job->first * ETHASH_DAG_CHECKSUM_BYTES), (size_t)size);
+		if (!job->verify) {
+			job->checksums[c] = checksum;
+		} else if (memcmp(&checksum, &job->checksums[c], sizeof(checksum)) != 0) {
+			ETHASH_CRITICAL("DAG chunk %u does not match its checksum.", c);
+			ethash_atomic_fetch_add_u32(&job->mismatches, 1);
+		}
+	}
+}
+
+// Compute the checksums of the chunks [first, last) of a DAG of @a full_size
+// bytes, or with @a verify count how many of them differ from @a checksums.
+// @a data holds the DAG from chunk @a first on
+static uint32_t ethash_dag_checksums(
+	void const* data,
+	uint64_t full_size,
+	uint32_t first,
+	uint32_t last,
+	ethash_h256_t* checksums,
+	bool verify,
+	unsigned num_threads
+)
+{
+	struct ethash_checksum_job job;
+	job.data = (uint8_t const*)data;
+	job.full_size = full_size;
+	job.first = first;
+	job.last = last;
+	job.checksums = checksums;
+	job.verify = verify;
+	job.next = first;
+	job.mismatches = 0;
+	if (num_threads == 0) {
+		num_threads = ethash_hardware_concurrency();
+	}
+	if (first < last) {
+		ethash_parallel_run(ethash_checksum_worker, &job, min_u32(num_threads, last - first), ETHASH_THREAD_PRIORITY_LOW);
+	}
+	return job.mismatches;
+}
+
+// Allocate a full handler whose DAG of @a full_size bytes counts against the
+// memory budget, freed with ethash_full_handle_free()
+static struct ethash_full* ethash_full_handle_new(uint64_t full_size)
+{
+	if (!ethash_budget_reserve(full_size)) {
+		return NULL;
+	}
+	struct ethash_full* ret = calloc(sizeof(*ret), 1);
+	if (!ret) {
+		ethash_budget_release(full_size);
+		return NULL;
+	}
+	ret->budget_bytes = full_size;
+	return ret;
+}
+
+static void ethash_full_handle_free(struct ethash_full* full)
+{
+	ethash_budget_release(full->budget_bytes);
+	free(full);
+}
+
+static bool ethash_full_alloc_checksums(struct ethash_full* ret)
+{
+	ret->checksums = calloc(ethash_io_dag_checksum_count(ret->file_size), sizeof(ethash_h256_t));
+	return ret->checksums != NULL;
+}
+
+// Checksum the whole DAG of @a ret, see @ref ethash_full_verify()
+static void ethash_full_checksum(struct ethash_full* ret, unsigned num_threads)
+{
+	uint32_t const count = ethash_io_dag_checksum_count(ret->file_size);
+	ethash_dag_checksums(ret->data, ret->file_size, 0, count, ret->checksums, false, num_threads);
+}
+
+// Allocate the anonymous memory of a DAG and apply the NUMA mode to it. The
+// pages must not have been touched yet for the placement to take effect.
+// Memory of a provider is placed by the provider
+static bool ethash_full_alloc_anonymous(struct ethash_full* ret, enum ethash_huge_pages policy)
+{
+	if (ret->provider && ret->provider->alloc) {
+		if (!ethash_memory_provider_alloc(&ret->memory, ret->provider, (size_t)ret->file_size, ETHASH_MEMORY_DAG)) {
+			ETHASH_CRITICAL("The memory provider could not allocate the DAG.");
+			return false;
+		}
+		ret->data = (node*)ret->memory.base;
+		return true;
+	}
+	enum ethash_numa_mode const numa = ethash_get_numa_mode();
+	// pooled memory stays where its pages are, so only placement by the
+	// operating system can take it
+	bool const allocated = numa == ETHASH_NUMA_OFF ?
+		ethash_memory_pool_alloc(&ret->memory, (size_t)ret->file_size, policy) :
+		ethash_memory_alloc(&ret->memory, (size_t)ret->file_size, policy);
+	if (!allocated) {
+		ETHASH_CRITICAL("Could not allocate memory for the DAG.");
+		return false;
+	}
+	switch (numa) {
+	case ETHASH_NUMA_INTERLEAVE:
+		ethash_numa_interleave(ret->memory.base, ret->memory.size);
+		break;
+	case ETHASH_NUMA_REPLICATE:
+		// the primary copy serves node 0, the others get theirs in ethash_full_replicate()
+		if (ethash_numa_node_count() > 1) {
+			ethash_numa_bind(ret->memory.base, ret->memory.size, 0);
+		}
+		break;
+	case ETHASH_NUMA_OFF:
+		break;
+	}
+	ret->data = (node*)ret->memory.base;
+	return true;
+}
+
+struct ethash_replica_job {
+	void const* src;
+	size_t size;
+	void* dsts[ETHASH_NUMA_MAX_NODES];
+	uint32_t count;
+	uint32_t volatile next;      ///< index of the next replica to copy to
+};
+
+static void ethash_replica_worker(void* arg)
+{
+	struct ethash_replica_job* job = (struct ethash_replica_job*)arg;
+	uint32_t i;
+	while ((i = ethash_atomic_fetch_add_u32(&job->next, 1)) < job->count) {
+		memcpy(job->dsts[i], job->src, job->size);
+	}
+}
+
+// In ETHASH_NUMA_REPLICATE mode give every other NUMA node its own copy of
+// the finished DAG, copying to all of them at the same time. Failing to
+// replicate is not fatal, threads on the other nodes then use the primary copy
+static void ethash_full_replicate(struct ethash_full* ret, enum ethash_huge_pages policy)
+{
+	unsigned const nodes = min_u32(ethash_numa_node_count(), ETHASH_NUMA_MAX_NODES);
+	if (ethash_get_numa_mode() != ETHASH_NUMA_REPLICATE || nodes < 2) {
+		return;
+	}
+	struct ethash_replica_job job;
+	job.src = ret->data;
+	job.size = (size_t)ret->file_size;
+	job.count = 0;
+	job.next = 0;
+	for (unsigned n = 1; n != nodes; ++n) {
+		struct ethash_memory* replica = &ret->replicas[n];
+		if (!ethash_budget_reserve(ret->file_size)) {
+			// the nodes left read the primary copy
+			break;
+		}
+		if (!ethash_memory_alloc(replica, (size_t)ret->file_size, policy)) {
+			ethash_budget_release(ret->file_size);
+			ETHASH_CRITICAL("Could not allocate the DAG replica of NUMA node %u.", n);
+			continue;
+		}
+		ret->budget_bytes += ret->file_size;
+		ethash_numa_bind(replica->base, replica->size, n);
+		job.dsts[job.count++] = replica->base;
+	}
+	if (job.count) {
+		ethash_parallel_run(ethash_replica_worker, &job, job.count, ETHASH_THREAD_PRIORITY_LOW);
+		ret->replicated = true;
+	}
+}
+
+// Bytes of a DAG file a thread of ethash_full_load_anonymous() reads at a time
+#define ETHASH_LOAD_CHUNK (16U << 20)
+
+struct ethash_load_job {
+	FILE* f;
+	uint8_t* data;
+	uint64_t size;               ///< bytes to read, from ETHASH_DAG_HEADER_SIZE on
+	uint32_t volatile next;      ///< index of the next unclaimed chunk
+	uint32_t volatile failed;
+};
+
+static void ethash_load_worker(void* arg)
+{
+	struct ethash_load_job* job = (struct ethash_load_job*)arg;
+	while (!ethash_atomic_load_u32(&job->failed)) {
+		uint64_t const begin = (uint64_t)ethash_atomic_fetch_add_u32(&job->next, 1) * ETHASH_LOAD_CHUNK;
+		if (begin >= job->size) {
+			break;
+		}
+		size_t const size = job->size - begin > ETHASH_LOAD_CHUNK ? ETHASH_LOAD_CHUNK : (size_t)(job->size - begin);
+		if (!ethash_io_pread(job->f, job->data + begin, size, ETHASH_DAG_HEADER_SIZE + begin)) {
+			ethash_atomic_store_u32(&job->failed, 1);
+		}
+	}
+}
+
+// Read the nodes of a complete DAG file into anonymous memory allocated with
+// @a policy, on @a num_threads threads. The reads bypass the page cache where the file
+// system allows, so the DAG is not held twice; the tail that is no multiple
+// of ETHASH_IO_DIRECT_ALIGNMENT is read through it.
+static bool ethash_full_load_anonymous(
+	struct ethash_full* ret,
+	FILE* f,
+	enum ethash_huge_pages policy,
+	unsigned num_threads
+)
+{
+	if (!ethash_full_alloc_anonymous(ret, policy)) {
+		return false;
+	}
+	uint64_t const start = ethash_time_us();
+	bool const direct = ethash_io_set_direct(f, true);
+	struct ethash_load_job job;
+	job.f = f;
+	job.data = (uint8_t*)ret->data;
+	job.size = direct ? ret->file_size / ETHASH_IO_DIRECT_ALIGNMENT * ETHASH_IO_DIRECT_ALIGNMENT : ret->file_size;
+	job.next = 0;
+	job.failed = 0;
+	ethash_parallel_run(ethash_load_worker, &job, num_threads, ETHASH_THREAD_PRIORITY_NORMAL);
+	if (direct) {
+		ethash_io_set_direct(f, false);
+	}
+	if (job.failed || (job.size != ret->file_size && !ethash_io_pread(
+			f, job.data + job.size, (size_t)(ret->file_size - job.size), ETHASH_DAG_HEADER_SIZE + job.size))) {
+		ETHASH_CRITICAL("Could not read the DAG file.");
+		ethash_memory_free(&ret->memory);
+		return false;
+	}
+	ethash_stats_add(ETHASH_STAT_READ_BYTES, ret->file_size);
+	ethash_trace(ETHASH_EVENT_DAG_MAPPED, ret->epoch, ret->file_size, ethash_time_us() - start, ETHASH_DAG_FILE_NONE);
+	if (!ethash_io_read_checksums(f, ret->file_size, ret->checksums)) {
+		ETHASH_CRITICAL("Could not read the checksums of the DAG file.");
+		ethash_memory_free(&ret->memory);
+		return false;
+	}
+	return true;
+}
+
+// Write a DAG held in anonymous memory and its checksums to its file
+static bool ethash_full_write_file(struct ethash_full* ret, FILE* f)
+{
+	if (fseek(f, ETHASH_DAG_HEADER_SIZE, SEEK_SET) != 0 ||
+		fwrite(ret->data, (size_t)ret->file_size, 1, f) != 1 ||
+		!ethash_io_write_checksums(f, ret->file_size, ret->checksums)) {
+		ETHASH_CRITICAL("Could not write DAG data to DAG file. Insufficient space?");
+		return false;
+	}
+	ethash_stats_add(ETHASH_STAT_WRITTEN_BYTES, ret->file_size);
+	return true;
+}
+
+// Complete the header of a DAG file, once its nodes and trailer are written
+static bool ethash_full_write_header(struct ethash_full const* ret, FILE* f, ethash_h256_t const seed_hash)
+{
+	if (!ethash_io_write_dag_header(f, seed_hash, ret->file_size, ret->checksums)) {
+		ETHASH_CRITICAL("Could not write the header of the DAG file. Insufficient space?");
+		return false;
+	}
+	ethash_trace(ETHASH_EVENT_DAG_MAGIC_WRITTEN, ret->epoch, ret->file_size, 0, ETHASH_DAG_FILE_NONE);
+	return true;
+}
+
+// Number of DAG nodes between two checkpoints of a DAG file, 64 MB
+#define ETHASH_DAG_CHECKPOINT_NODES (1U << 20)
+
+// The number of nodes of an unfinished DAG that can be trusted, out of the
+// @a checkpoint ones recorded. The last node of every checkpoint interval is
+// recomputed and the DAG is trusted up to the first one that differs
+static uint32_t ethash_full_verify_checkpoint(node const* nodes, uint32_t checkpoint, ethash_light_t const light)
+{
+	uint32_t verified = 0;
+	while (verified < checkpoint) {
+		uint32_t const end = min_u32(verified + ETHASH_DAG_CHECKPOINT_NODES, checkpoint);
+		node expected;
+		ethash_calculate_dag_item(&expected, end - 1, light);
+		if (memcmp(&expected, &nodes[end - 1], sizeof(node)) != 0) {
+			break;
+		}
+		verified = end;
+	}
+	return verified;
+}
+
+// Compute the DAG into its file mapping, starting at a verified @a checkpoint.
+// Every ETHASH_DAG_CHECKPOINT_NODES nodes the computed part is synced to the
+// file and recorded in the checkpoint file, so that a crash does not lose it
+static bool ethash_full_compute_checkpointed(
+	struct ethash_full* ret,
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	ethash_light_t const light,
+	uint32_t checkpoint,
+	unsigned num_threads,
+	ethash_callback_t callback,
+	struct ethash_dag_control* control
+)
+{
+	if (ret->file_size % (sizeof(uint32_t) * MIX_WORDS) != 0 ||
+		(ret->file_size % sizeof(node)) != 0) {
+		return false;
+	}
+	uint32_t const max_n = (uint32_t)(ret->file_size / sizeof(node));
+	uint32_t begin = ethash_full_verify_checkpoint(ret->data, min_u32(checkpoint, max_n), light);
+	if (begin == 0 && max_n <= ETHASH_DAG_CHECKPOINT_NODES) {
+		// too small to be worth a checkpoint
+		return ethash_compute_full_data_job(ret->data, ret->file_size, light, num_threads, callback, control);
+	}
+	if (control) {
+		ethash_atomic_fetch_add_u32(&control->nodes, begin);
+	}
+	while (begin != max_n) {
+		uint32_t const end = min_u32(begin + ETHASH_DAG_CHECKPOINT_NODES, max_n);
+		if (!ethash_compute_full_range(ret->data, 0, ret->file_size, begin, end, light, num_threads, callback, control)) {
+			return false;
+		}
+		if (end != max_n &&
+			(msync(ret->memory.base, ETHASH_DAG_HEADER_SIZE + (size_t)end * sizeof(node), MS_SYNC) != 0 ||
+			 !ethash_io_write_checkpoint(dirname, seed_hash, ret->file_size, end))) {
+			// not fatal, a crash from here on just resumes from an earlier checkpoint
+			ETHASH_CRITICAL("Could not checkpoint the DAG file.");
+		}
+		begin = end;
+	}
+	return true;
+}
+
+// Write @a size bytes at @a offset of a DAG file, as much of them with O_DIRECT
+// as the alignment allows while @a direct is set. @a direct is cleared for good
+// if the file system turns out not to take direct writes
+static bool ethash_full_stream_write(FILE* f, uint8_t const* data, size_t size, uint64_t offset, bool* direct)
+{
+	size_t aligned = 0;
+	if (*direct && offset % ETHASH_IO_DIRECT_ALIGNMENT == 0) {
+		aligned = size - size % ETHASH_IO_DIRECT_ALIGNMENT;
+	}
+	if (aligned != 0 && !ethash_io_pwrite(f, data, aligned, offset)) {
+		*direct = false;
+		ethash_io_set_direct(f, false);
+		aligned = 0;
+	}
+	if (aligned == size) {
+		ethash_stats_add(ETHASH_STAT_WRITTEN_BYTES, size);
+		return true;
+	}
+	// the unaligned tail goes through the page cache
+	if (*direct) {
+		ethash_io_set_direct(f, false);
+	}
+	bool const written = ethash_io_pwrite(f, data + aligned, size - aligned, offset + aligned);
+	if (*direct) {
+		*direct = ethash_io_set_direct(f, true);
+	}
+	if (written) {
+		ethash_stats_add(ETHASH_STAT_WRITTEN_BYTES, size);
+	}
+	return written;
+}
+
+// ETHASH_DAG_WRITE_STREAM variant of @ref ethash_full_compute_checkpointed().
+// Each chunk of ETHASH_DAG_CHECKPOINT_NODES nodes is computed into a buffer,
+// written, synced and checkpointed before the next one. The finished DAG file
+// is mapped read-only
+static bool ethash_full_stream_file(
+	struct ethash_full* ret,
+	FILE* f,
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	ethash_light_t const light,
+	uint32_t checkpoint,
+	unsigned num_threads,
+	ethash_callback_t callback,
+	struct ethash_dag_control* control
+)
+{
+	if (ret->file_size % (sizeof(uint32_t) * MIX_WORDS) != 0 ||
+		(ret->file_size % sizeof(node)) != 0) {
+		return false;
+	}
+	uint32_t const max_n = (uint32_t)(ret->file_size / sizeof(node));
+	uint32_t begin = 0;
+	if (checkpoint != 0) {
+		if (!ethash_mmap(ret, f, false)) {
+			ETHASH_CRITICAL("mmap failure()");
+			return false;
+		}
+		begin = ethash_full_verify_checkpoint(ret->data, min_u32(checkpoint, max_n), light);
+		ethash_memory_free(&ret->memory);
+	}
+	if (control) {
+		ethash_atomic_fetch_add_u32(&control->nodes, begin);
+	}
+	// checksums of the chunks starting before that are taken from the finished file
+	uint32_t const streamed = (uint32_t)(((uint64_t)begin * sizeof(node) + ETHASH_DAG_CHECKSUM_BYTES - 1) / ETHASH_DAG_CHECKSUM_BYTES);
+
+	uint32_t const chunk_nodes = min_u32(ETHASH_DAG_CHECKPOINT_NODES, max_n);
+	struct ethash_memory buffer;
+	if (!ethash_memory_alloc(&buffer, (size_t)chunk_nodes * sizeof(node), ETHASH_HUGE_PAGES_OFF)) {
+		ETHASH_CRITICAL("Could not allocate the DAG write buffer.");
+		return false;
+	}
+	uint8_t* const chunk = (uint8_t*)buffer.base;
+	bool direct = ethash_io_set_direct(f, true);
+	bool ok = true;
+	while (begin != max_n) {
+		// after resuming from an odd checkpoint the first chunk is shorter, so
+		// that every checksum covers nodes of a single chunk
+		uint32_t const end = min_u32((begin / chunk_nodes + 1) * chunk_nodes, max_n);
+		if (!ethash_compute_full_range(chunk, begin, ret->file_size, begin, end, light, num_threads, callback, control)) {
+			ok = false;
+			break;
+		}
+		uint64_t const data_begin = (uint64_t)begin * sizeof(node);
+		uint32_t const first = (uint32_t)((data_begin + ETHASH_DAG_CHECKSUM_BYTES - 1) / ETHASH_DAG_CHECKSUM_BYTES);
+		uint32_t const last = end == max_n ?
+			ethash_io_dag_checksum_count(ret->file_size) :
+			(uint32_t)((uint64_t)end * sizeof(node) / ETHASH_DAG_CHECKSUM_BYTES);
+		ethash_dag_checksums(
+			chunk + ((uint64_t)first * ETHASH_DAG_CHECKSUM_BYTES - data_begin),
+			ret->file_size, first, last, ret->checksums, false, num_threads
+		);
+		// the header is page sized, so chunks starting on a page of nodes
+		// can be written directly
+		size_t const size = (size_t)(end - begin) * sizeof(node);
+		uint64_t const offset = ETHASH_DAG_HEADER_SIZE + data_begin;
+		if (!ethash_full_stream_write(f, chunk, size, offset, &direct)) {
+			ETHASH_CRITICAL("Could not write DAG data to DAG file. Insufficient space?");
+			ok = false;
+			break;
+		}
+		if (!ethash_io_sync(f, offset, size)) {
+			ETHASH_CRITICAL("Could not sync the DAG file.");
+			ok = false;
+			break;
+		}
+		if (end != max_n && !ethash_io_write_checkpoint(dirname, seed_hash, ret->file_size, end)) {
+			// not fatal, a crash from here on just resumes from an earlier checkpoint
+			ETHASH_CRITICAL("Could not checkpoint the DAG file.");
+		}
+		begin = end;
+	}
+	if (direct) {
+		ethash_io_set_direct(f, false);
+	}
+	ethash_memory_free(&buffer);
+	if (!ok) {
+		return false;
+	}
+	if (!ethash_mmap(ret, f, false)) {
+		ETHASH_CRITICAL("mmap failure()");
+		return false;
+	}
+	ethash_dag_checksums(ret->data, ret->file_size, 0, streamed, ret->checksums, false, num_threads);
+	if (!ethash_io_write_checksums(f, ret->file_size, ret->checksums) ||
+		!ethash_io_sync(f, ETHASH_DAG_HEADER_SIZE + ret->file_size, ethash_io_dag_file_size(ret->file_size)) ||
+		!ethash_full_write_header(ret, f, seed_hash)) {
+		ETHASH_CRITICAL("Could not finalize the DAG file. Insufficient space?");
+		ethash_memory_free(&ret->memory);
+		return false;
+	}
+	return true;
+}
+
+// Huge page and NUMA variant of @ref ethash_full_new_parallel_internal(). The
+// DAG lives in anonymous memory and the file is only read or written once
+static ethash_full_t ethash_full_new_anonymous(
+	struct ethash_full* ret,
+	FILE* f,
+	ethash_h256_t const seed_hash,
+	enum ethash_io_rc err,
+	ethash_light_t const light,
+	unsigned num_threads,
+	ethash_callback_t callback,
+	enum ethash_huge_pages policy,
+	struct ethash_dag_control* control
+)
+{
+	if (err == ETHASH_IO_MEMO_MATCH) {
+		if (!ethash_full_load_anonymous(ret, f, policy, num_threads)) {
+			goto fail_close_file;
+		}
+	} else {
+		if (!ethash_full_alloc_anonymous(ret, policy)) {
+			goto fail_close_file;
+		}
+		if (!ethash_compute_full_data_job(ret->data, ret->file_size, light, num_threads, callback, control)) {
+			ETHASH_CRITICAL("Failure at computing DAG data.");
+			goto fail_free_full_data;
+		}
+		ethash_full_checksum(ret, num_threads);
+		if (!ethash_full_write_file(ret, f) || !ethash_full_write_header(ret, f, seed_hash)) {
+			goto fail_free_full_data;
+		}
+	}
+	fclose(f);
+	ret->file = NULL;
+	ethash_full_replicate(ret, policy);
+	return ret;
+
+fail_free_full_data:
+	ethash_memory_free(&ret->memory);
+fail_close_file:
+	fclose(f);
+	free(ret->checksums);
+	ethash_full_handle_free(ret);
+	return NULL;
+}
+
+ethash_full_t ethash_full_new_internal(
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size,
+	ethash_light_t const light,
+	ethash_callback_t callback
+)
+{
+	return ethash_full_new_parallel_internal(dirname, seed_hash, full_size, light, 1, callback);
+}
+
+static ethash_full_t ethash_full_build_file(
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned num_threads,
+	ethash_callback_t callback,
+	struct ethash_dag_control* control,
+	ethash_memory_provider_t const* provider
+)
+{
+	uint64_t const start = ethash_time_us();
+	struct ethash_full* ret;
+	FILE *f = NULL;
+	ret = ethash_full_handle_new(full_size);
+	if (!ret) {
+		return NULL;
+	}
+	ret->provider = provider;
+	ret->file_size = (size_t)full_size;
+	ret->num_full_pages = ethash_fastmod_init((uint32_t)(full_size / ETHASH_MIX_BYTES));
+	ret->progpow_entries = progpow_dag_entries(full_size);
+	ret->epoch = ethash_seed_epoch(&seed_hash);
+	ret->progpow_period = light->progpow_period;
+	if (!ethash_full_alloc_checksums(ret)) {
+		goto fail_free_full;
+	}
+
+	enum ethash_io_rc err = ethash_io_prepare(dirname, seed_hash, &f, (size_t)full_size, false);
+	if (err == ETHASH_IO_FAIL)
+		goto fail_free_full;
+	ethash_trace(
+		ETHASH_EVENT_DAG_FILE_CHECKED, ret->epoch, full_size, 0,
+		err == ETHASH_IO_MEMO_MATCH ? ETHASH_DAG_FILE_MATCH :
+		err == ETHASH_IO_MEMO_MISMATCH ? ETHASH_DAG_FILE_MISMATCH : ETHASH_DAG_FILE_SIZE_MISMATCH
+	);
+
+	uint32_t checkpoint = 0;
+	bool resumed = false;
+	if (err == ETHASH_IO_MEMO_SIZE_MISMATCH) {
+		// an unfinished DAG file with a checkpoint is completed rather than started over
+		f = ethash_io_open_checkpoint(dirname, seed_hash, full_size, &checkpoint);
+		resumed = f != NULL;
+		// if a DAG of same filename but unexpected size is found, silently force new file creation
+		if (!resumed && ethash_io_prepare(dirname, seed_hash, &f, (size_t)full_size, true) != ETHASH_IO_MEMO_MISMATCH) {
+			ETHASH_CRITICAL("Could not recreate DAG file after finding existing DAG with unexpected size.");
+			goto fail_free_full;
+		}
+		// we now need to go through the mismatch case, NOT the match case
+		err = ETHASH_IO_MEMO_MISMATCH;
+	}
+
+	enum ethash_huge_pages const policy = ethash_get_huge_pages();
+	bool const provided_memory = provider && provider->alloc && !provider->map_file;
+	bool const read_file = err == ETHASH_IO_MEMO_MATCH && ethash_get_dag_load_mode() == ETHASH_DAG_LOAD_READ &&
+		!(provider && provider->map_file);
+	if (provided_memory || read_file || policy != ETHASH_HUGE_PAGES_OFF || ethash_get_numa_mode() != ETHASH_NUMA_OFF) {
+		// the DAG is computed in memory and written in one go, once complete
+		ret = ethash_full_new_anonymous(ret, f, seed_hash, err, light, num_threads, callback, policy, control);
+		if (ret && resumed) {
+			ethash_io_remove_checkpoint(dirname, seed_hash);
+		}
+		if (ret && err == ETHASH_IO_MEMO_MISMATCH) {
+			ethash_dag_dir_generated(dirname, seed_hash);
+		}
+		return ethash_full_loaded(ret, start);
+	}
+
+	if (err == ETHASH_IO_MEMO_MISMATCH && ethash_get_dag_write_mode() == ETHASH_DAG_WRITE_STREAM) {
+		if (!ethash_full_stream_file(ret, f, dirname, seed_hash, light, checkpoint, num_threads, callback, control)) {
+			ETHASH_CRITICAL("Failure at computing DAG data.");
+			goto fail_close_file;
+		}
+		ethash_io_remove_checkpoint(dirname, seed_hash);
+		ethash_dag_dir_generated(dirname, seed_hash);
+		return ethash_full_loaded(ret, start);
+	}
+
+	if (err == ETHASH_IO_MEMO_MISMATCH || err == ETHASH_IO_MEMO_MATCH) {
+		// a complete DAG file is never written to again
+		if (!ethash_mmap(ret, f, err == ETHASH_IO_MEMO_MISMATCH)) {
+			ETHASH_CRITICAL("mmap failure()");
+			goto fail_close_file;
+		}
+
+		if (err == ETHASH_IO_MEMO_MATCH) {
+			if (!ethash_io_read_checksums(f, ret->file_size, ret->checksums)) {
+				ETHASH_CRITICAL("Could not read the checksums of the DAG file.");
+				goto fail_free_full_data;
+			}
+			if (ethash_get_dag_load_mode() == ETHASH_DAG_LOAD_PREFAULT) {
+				ethash_full_prefault(ret, num_threads);
+			}
+			return ethash_full_loaded(ret, start);
+		}
+	}
+
+	if (!ethash_full_compute_checkpointed(ret, dirname, seed_hash, light, checkpoint, num_threads, callback, control)) {
+		ETHASH_CRITICAL("Failure at computing DAG data.");
+		goto fail_free_full_data;
+	}
+	ethash_full_checksum(ret, num_threads);
+	if (!ethash_io_write_checksums(f, ret->file_size, ret->checksums)) {
+		ETHASH_CRITICAL("Could not write the checksums to the DAG file. Insufficient space?");
+		goto fail_free_full_data;
+	}
+
+	// after the DAG has been filled then we finalize it by completing the header at the beginning
+	if (!ethash_full_write_header(ret, f, seed_hash)) {
+		goto fail_free_full_data;
+	}
+	ethash_io_remove_checkpoint(dirname, seed_hash);
+	ethash_dag_dir_generated(dirname, seed_hash);
+	return ethash_full_loaded(ret, start);
+
+fail_free_full_data:
+	ethash_memory_free(&ret->memory);
+fail_close_file:
+	fclose(f);
+fail_free_full:
+	free(ret->checksums);
+	ethash_full_handle_free(ret);
+	return NULL;
+}
+
+// ethash_full_build_file() between the full_new probes of probes.h
+static ethash_full_t ethash_full_new_file_job(
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned num_threads,
+	ethash_callback_t callback,
+	struct ethash_dag_control* control,
+	ethash_memory_provider_t const* provider
+)
+{
+	ETHASH_PROBE2(full_new__start, full_size, 0);
+	ethash_full_t const ret = ethash_full_build_file(dirname, seed_hash, full_size, light, num_threads, callback, control, provider);
+	ETHASH_PROBE2(full_new__done, full_size, ret);
+	return ret;
+}
+
+ethash_full_t ethash_full_new_parallel_internal(
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned num_threads,
+	ethash_callback_t callback
+)
+{
+	return ethash_full_new_file_job(dirname, seed_hash, full_size, light, num_threads, callback, NULL, NULL);
+}
+
+ethash_full_t ethash_full_new_provided_internal(
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned num_threads,
+	ethash_callback_t callback,
+	ethash_memory_provider_t const* provider
+)
+{
+	return ethash_full_new_file_job(dirname, seed_hash, full_size, light, num_threads, callback, NULL, provider);
+}
+
+ethash_full_t ethash_full_new(ethash_light_t light, ethash_callback_t callback)
+{
+	char strbuf[256];
+	if (!ethash_get_default_dirname(strbuf, 256)) {
+		return NULL;
+	}
+	uint64_t full_size = ethash_light_full_size(light);
+	ethash_h256_t seedhash = ethash_light_seedhash(light);
+	return ethash_full_new_internal(strbuf, seedhash, full_size, light, callback);
+}
+
+ethash_full_t ethash_full_new_parallel(ethash_light_t light, unsigned num_threads, ethash_callback_t callback)
+{
+	char strbuf[256];
+	if (!ethash_get_default_dirname(strbuf, 256)) {
+		return NULL;
+	}
+	uint64_t full_size = ethash_light_full_size(light);
+	ethash_h256_t seedhash = ethash_light_seedhash(light);
+	return ethash_full_new_parallel_internal(strbuf, seedhash, full_size, light, num_threads, callback);
+}
+
+ethash_full_t ethash_full_new_with_provider(
+	ethash_light_t light,
+	unsigned num_threads,
+	ethash_callback_t callback,
+	ethash_memory_provider_t const* provider
+)
+{
+	char strbuf[256];
+	if (!ethash_get_default_dirname(strbuf, 256)) {
+		return NULL;
+	}
+	uint64_t full_size = ethash_light_full_size(light);
+	ethash_h256_t seedhash = ethash_light_seedhash(light);
+	return ethash_full_new_provided_internal(strbuf, seedhash, full_size, light, num_threads, callback, provider);
+}
+
+ethash_full_t ethash_full_attach_internal(
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size
+)
+{
+	uint64_t const start = ethash_time_us();
+	FILE* f = ethash_io_open_dag(dirname, seed_hash, full_size);
+	if (!f) {
+		return NULL;
+	}
+	struct ethash_full* ret = ethash_full_handle_new(full_size);
+	if (!ret) {
+		goto fail_close_file;
+	}
+	ret->file_size = (size_t)full_size;
+	ret->num_full_pages = ethash_fastmod_init((uint32_t)(full_size / ETHASH_MIX_BYTES));
+	ret->progpow_entries = progpow_dag_entries(full_size);
+	ret->epoch = ethash_seed_epoch(&seed_hash);
+	ethash_trace(ETHASH_EVENT_DAG_FILE_CHECKED, ret->epoch, full_size, 0, ETHASH_DAG_FILE_MATCH);
+	if (!ethash_full_alloc_checksums(ret)) {
+		goto fail_free_full;
+	}
+	if (!ethash_mmap(ret, f, false)) {
+		ETHASH_CRITICAL("mmap failure()");
+		goto fail_free_full;
+	}
+	// the first chunk holds the ProgPoW cache, the rest is left to ethash_full_verify()
+	if (!ethash_io_read_checksums(f, ret->file_size, ret->checksums) ||
+		ethash_dag_checksums(ret->data, ret->file_size, 0, 1, ret->checksums, true, 1) != 0) {
+		ETHASH_CRITICAL("The DAG file does not match its checksums.");
+		goto fail_free_full_data;
+	}
+	if (ethash_get_dag_load_mode() == ETHASH_DAG_LOAD_PREFAULT) {
+		ethash_full_prefault(ret, 0);
+	}
+	return ethash_full_loaded(ret, start);
+
+fail_free_full_data:
+	ethash_memory_free(&ret->memory);
+fail_free_full:
+	free(ret->checksums);
+	ethash_full_handle_free(ret);
+fail_close_file:
+	fclose(f);
+	return NULL;
+}
+
+ethash_full_t ethash_full_attach(uint64_t block_number)
+{
+	char strbuf[256];
+	if (!ethash_get_default_dirname(strbuf, 256)) {
+		return NULL;
+	}
+	return ethash_full_attach_internal(strbuf, ethash_get_seedhash(block_number), ethash_get_datasize(block_number));
+}
+
+// The nodes of slice @a rank of @a num_ranks of a DAG of @a max_n nodes
+static void ethash_dag_slice_range(uint32_t max_n, unsigned rank, unsigned num_ranks, uint32_t* first, uint32_t* nodes)
+{
+	*first = (uint32_t)((uint64_t)max_n * rank / num_ranks);
+	*nodes = (uint32_t)((uint64_t)max_n * (rank + 1) / num_ranks) - *first;
+}
+
+// Whether a slice computed by another host holds the nodes of @a light. The
+// last node of every ETHASH_DAG_CHECKPOINT_NODES of the slice is recomputed
+static bool ethash_dag_slice_matches(node const* nodes, uint32_t first, uint32_t count, ethash_light_t const light)
+{
+	for (uint32_t checked = 0; checked != count;) {
+		checked = min_u32(checked + ETHASH_DAG_CHECKPOINT_NODES, count);
+		node expected;
+		ethash_calculate_dag_item(&expected, first + checked - 1, light);
+		if (memcmp(&expected, &nodes[checked - 1], sizeof(node)) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ethash_full_generate_slice_internal(
+	char const* slice_dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned rank,
+	unsigned num_ranks,
+	unsigned num_threads,
+	ethash_callback_t callback
+)
+{
+	if (full_size % (sizeof(uint32_t) * MIX_WORDS) != 0 ||
+		(full_size % sizeof(node)) != 0) {
+		return false;
+	}
+	uint32_t const max_n = (uint32_t)(full_size / sizeof(node));
+	if (num_ranks == 0 || num_ranks > max_n || rank >= num_ranks) {
+		return false;
+	}
+	uint32_t first;
+	uint32_t nodes;
+	ethash_dag_slice_range(max_n, rank, num_ranks, &first, &nodes);
+	struct ethash_memory buffer;
+	if (!ethash_memory_alloc(&buffer, (size_t)nodes * sizeof(node), ETHASH_HUGE_PAGES_OFF)) {
+		ETHASH_CRITICAL("Could not allocate memory for the DAG slice.");
+		return false;
+	}
+	if (num_threads == 0) {
+		num_threads = ethash_hardware_concurrency();
+	}
+	bool ret = false;
+	if (!ethash_compute_full_range(buffer.base, first, full_size, first, first + nodes, light, num_threads, callback, NULL)) {
+		ETHASH_CRITICAL("Failure at computing the DAG slice.");
+		goto free_buffer;
+	}
+	ethash_h256_t checksum;
+	SHA3_256(&checksum, (uint8_t const*)buffer.base, (size_t)nodes * sizeof(node));
+	ret = ethash_io_write_slice(slice_dirname, seed_hash, full_size, rank, num_ranks, first, nodes, &checksum, buffer.base);
+free_buffer:
+	ethash_memory_free(&buffer);
+	return ret;
+}
+
+bool ethash_full_generate_slice(
+	ethash_light_t light,
+	char const* slice_dirname,
+	unsigned rank,
+	unsigned num_ranks,
+	unsigned num_threads,
+	ethash_callback_t callback
+)
+{
+	return ethash_full_generate_slice_internal(
+		slice_dirname,
+		ethash_light_seedhash(light),
+		ethash_light_full_size(light),
+		light, rank, num_ranks, num_threads, callback
+	);
+}
+
+// Read slice @a rank of @a num_ranks into the DAG of @a ret and check it
+static bool ethash_full_gather_slice(
+	struct ethash_full* ret,
+	char const* slice_dirname,
+	ethash_h256_t const seed_hash,
+	ethash_light_t const light,
+	unsigned rank,
+	unsigned num_ranks
+)
+{
+	uint32_t first;
+	uint32_t nodes;
+	ethash_dag_slice_range((uint32_t)(ret->file_size / sizeof(node)), rank, num_ranks, &first, &nodes);
+	ethash_h256_t expected;
+	FILE* f = ethash_io_open_slice(slice_dirname, seed_hash, ret->file_size, rank, num_ranks, first, nodes, &expected);
+	if (!f) {
+		ETHASH_CRITICAL("DAG slice %u of %u is missing.", rank, num_ranks);
+		return false;
+	}
+	bool const read = fread(&ret->data[first], sizeof(node), nodes, f) == nodes;
+	fclose(f);
+	if (!read) {
+		ETHASH_CRITICAL("Could not read DAG slice %u of %u.", rank, num_ranks);
+		return false;
+	}
+	ethash_stats_add(ETHASH_STAT_READ_BYTES, (uint64_t)nodes * sizeof(node));
+	ethash_h256_t checksum;
+	SHA3_256(&checksum, (uint8_t const*)&ret->data[first], (size_t)nodes * sizeof(node));
+	if (memcmp(&checksum, &expected, sizeof(checksum)) != 0 ||
+		!ethash_dag_slice_matches(&ret->data[first], first, nodes, light)) {
+		ETHASH_CRITICAL("DAG slice %u of %u is corrupt or of another DAG.", rank, num_ranks);
+		return false;
+	}
+	return true;
+}
+
+ethash_full_t ethash_full_new_from_slices_internal(
+	char const* dirname,
+	char const* slice_dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned num_ranks,
+	unsigned num_threads
+)
+{
+	if (full_size % (sizeof(uint32_t) * MIX_WORDS) != 0 ||
+		(full_size % sizeof(node)) != 0 ||
+		num_ranks == 0 || num_ranks > full_size / sizeof(node)) {
+		return NULL;
+	}
+	FILE* f = NULL;
+	enum ethash_io_rc err = ethash_io_prepare(dirname, seed_hash, &f, full_size, false);
+	if (err == ETHASH_IO_FAIL) {
+		return NULL;
+	}
+	if (err == ETHASH_IO_MEMO_MATCH) {
+		// gathered before, just load it
+		fclose(f);
+		return ethash_full_new_parallel_internal(dirname, seed_hash, full_size, light, num_threads, NULL);
+	}
+	if (err == ETHASH_IO_MEMO_SIZE_MISMATCH &&
+		ethash_io_prepare(dirname, seed_hash, &f, full_size, true) != ETHASH_IO_MEMO_MISMATCH) {
+		ETHASH_CRITICAL("Could not recreate DAG file after finding existing DAG with unexpected size.");
+		return NULL;
+	}
+
+	struct ethash_full gather;
+	memset(&gather, 0, sizeof(gather));
+	gather.file_size = (size_t)full_size;
+	gather.epoch = ethash_seed_epoch(&seed_hash);
+	bool ok = false;
+	if (!ethash_full_alloc_checksums(&gather)) {
+		goto close_file;
+	}
+	if (!ethash_mmap(&gather, f, true)) {
+		ETHASH_CRITICAL("mmap failure()");
+		goto free_checksums;
+	}
+	for (unsigned rank = 0; rank != num_ranks; ++rank) {
+		if (!ethash_full_gather_slice(&gather, slice_dirname, seed_hash, light, rank, num_ranks)) {
+			goto free_data;
+		}
+	}
+	ethash_full_checksum(&gather, num_threads);
+	if (!ethash_io_write_checksums(f, gather.file_size, gather.checksums)) {
+		ETHASH_CRITICAL("Could not write the checksums to the DAG file. Insufficient space?");
+		goto free_data;
+	}
+	ok = ethash_full_write_header(&gather, f, seed_hash);
+free_data:
+	ethash_memory_free(&gather.memory);
+free_checksums:
+	free(gather.checksums);
+close_file:
+	fclose(f);
+	if (!ok) {
+		return NULL;
+	}
+	ethash_dag_dir_generated(dirname, seed_hash);
+	return ethash_full_new_parallel_internal(dirname, seed_hash, full_size, light, num_threads, NULL);
+}
+
+ethash_full_t ethash_full_new_from_slices(
+	ethash_light_t light,
+	char const* slice_dirname,
+	unsigned num_ranks,
+	unsigned num_threads
+)
+{
+	char strbuf[256];
+	if (!ethash_get_default_dirname(strbuf, 256)) {
+		return NULL;
+	}
+	return ethash_full_new_from_slices_internal(
+		strbuf,
+		slice_dirname,
+		ethash_light_seedhash(light),
+		ethash_light_full_size(light),
+		light, num_ranks, num_threads
+	);
+}
+
+static ethash_full_t ethash_full_build_memory(
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned num_threads,
+	ethash_callback_t callback,
+	struct ethash_dag_control* control
+)
+{
+	uint64_t const start = ethash_time_us();
+	struct ethash_full* ret;
+	ret = ethash_full_handle_new(full_size);
+	if (!ret) {
+		return NULL;
+	}
+	ret->file_size = (size_t)full_size;
+	ret->num_full_pages = ethash_fastmod_init((uint32_t)(full_size / ETHASH_MIX_BYTES));
+	ret->progpow_entries = progpow_dag_entries(full_size);
+	ret->epoch = light->epoch;
+	ret->progpow_period = light->progpow_period;
+	enum ethash_huge_pages const policy = ethash_get_huge_pages();
+	if (!ethash_full_alloc_checksums(ret) || !ethash_full_alloc_anonymous(ret, policy)) {
+		goto fail_free_full;
+	}
+	if (control) {
+		// the future hands it out for hashing while it is computed
+		ret->partial_light = light;
+		ret->partial = 1;
+		control->watermark = &ret->partial_nodes;
+		control->partial = ret;
+		ethash_atomic_store_u32(&control->has_partial, 1);
+	}
+	if (!ethash_compute_full_data_job(ret->data, full_size, light, num_threads, callback, control)) {
+		ETHASH_CRITICAL("Failure at computing DAG data.");
+		if (control) {
+			// still in use, the future frees it
+			return NULL;
+		}
+		goto fail_free_full_data;
+	}
+	ethash_full_checksum(ret, num_threads);
+	ethash_full_replicate(ret, policy);
+	ethash_full_loaded(ret, start);
+	ethash_atomic_store_u32(&ret->partial, 0);
+	return ret;
+
+fail_free_full_data:
+	ethash_memory_free(&ret->memory);
+fail_free_full:
+	free(ret->checksums);
+	ethash_full_handle_free(ret);
+	return NULL;
+}
+
+// ethash_full_build_memory() between the full_new probes of probes.h
+static ethash_full_t ethash_full_new_memory_job(
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned num_threads,
+	ethash_callback_t callback,
+	struct ethash_dag_control* control
+)
+{
+	ETHASH_PROBE2(full_new__start, full_size, 1);
+	ethash_full_t const ret = ethash_full_build_memory(full_size, light, num_threads, callback, control);
+	ETHASH_PROBE2(full_new__done, full_size, ret);
+	return ret;
+}
+
+ethash_full_t ethash_full_new_memory_internal(
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned num_threads,
+	ethash_callback_t callback
+)
+{
+	return ethash_full_new_memory_job(full_size, light, num_threads, callback, NULL);
+}
+
+ethash_full_t ethash_full_new_memory(ethash_light_t light, ethash_callback_t callback)
+{
+	uint64_t full_size = ethash_light_full_size(light);
+	return ethash_full_new_memory_internal(full_size, light, 1, callback);
+}
+
+// Generation state of a DAG of ethash_full_new_lazy(), one bit per
+// ETHASH_MIX_BYTES page in each of the bitmaps. A page is written by whoever
+// sets its claimed bit and may be read by anyone once its ready bit is set
+struct ethash_full_lazy {
+	ethash_light_t light;
+	uint32_t num_pages;
+	uint32_t num_words;          ///< of each bitmap
+	uint64_t volatile* claimed;  ///< pages being or already generated
+	uint64_t volatile* ready;    ///< pages generated
+	uint32_t volatile next;      ///< next bitmap word the background threads claim
+	uint32_t volatile pages_ready;
+	uint32_t volatile complete;  ///< set once all pages are ready
+	uint32_t volatile cancelled;
+	unsigned num_threads;
+	ethash_mutex_t lock;
+	ethash_cond_t changed;       ///< signalled once complete and once filled
+	bool filled;                 ///< set once checksums and ProgPoW cache are done too, protected by lock
+	bool started;                ///< whether @a thread has to be joined
+	ethash_thread_t thread;
+};
+
+// Set @a bits in word @a w of @a bitmap, giving back the ones that were not set yet
+static uint64_t ethash_full_lazy_set(uint64_t volatile* bitmap, uint32_t w, uint64_t bits)
+{
+	uint64_t old = ethash_atomic_load_u64(&bitmap[w]);
+	while (!ethash_atomic_compare_exchange_u64(&bitmap[w], &old, old | bits)) {
+	}
+	return bits & ~old;
+}
+
+// Publish the pages of @a bits in word @a w, once their nodes are written
+static void ethash_full_lazy_publish(struct ethash_full_lazy* lazy, uint32_t w, uint64_t bits, uint32_t count)
+{
+	ethash_full_lazy_set(lazy->ready, w, bits);
+	if (ethash_atomic_fetch_add_u32(&lazy->pages_ready, count) + count == lazy->num_pages) {
+		ethash_mutex_lock(&lazy->lock);
+		ethash_atomic_store_u32(&lazy->complete, 1);
+		ethash_cond_broadcast(&lazy->changed);
+		ethash_mutex_unlock(&lazy->lock);
+	}
+}
+
+static void ethash_full_lazy_worker(void* arg)
+{
+	struct ethash_full* full = (struct ethash_full*)arg;
+	struct ethash_full_lazy* lazy = full->lazy;
+	while (!ethash_atomic_load_u32(&lazy->cancelled)) {
+		uint32_t const w = ethash_atomic_fetch_add_u32(&lazy->next, 1);
+		if (w >= lazy->num_words) {
+			break;
+		}
+		uint64_t const mine = ethash_full_lazy_set(lazy->claimed, w, ~(uint64_t)0);
+		// the pages hashes did not claim yet, in runs of consecutive ones
+		uint32_t count = 0;
+		for (uint32_t bit = 0; bit != 64; ) {
+			if (!(mine >> bit & 1)) {
+				bit++;
+				continue;
+			}
+			uint32_t end = bit + 1;
+			while (end != 64 && (mine >> end & 1)) {
+				end++;
+			}
+			uint32_t const page = w * 64 + bit;
+			ethash_calculate_dag_items(&full->data[page * MIX_NODES], page * MIX_NODES, (end - bit) * MIX_NODES, lazy->light);
+			count += end - bit;
+			bit = end;
+		}
+		if (count) {
+			ethash_full_lazy_publish(lazy, w, mine, count);
+		}
+	}
+}
+
+// Generate the DAG in the background and finish it once the hashes wrote
+// the pages they claimed
+static void ethash_full_lazy_run(void* arg)
+{
+	struct ethash_full* full = (struct ethash_full*)arg;
+	struct ethash_full_lazy* lazy = full->lazy;
+	ethash_thread_lower_priority();
+	ethash_parallel_run(ethash_full_lazy_worker, full, lazy->num_threads, ETHASH_THREAD_PRIORITY_LOW);
+	ethash_mutex_lock(&lazy->lock);
+	while (!ethash_atomic_load_u32(&lazy->complete) && !ethash_atomic_load_u32(&lazy->cancelled)) {
+		ethash_cond_wait(&lazy->changed, &lazy->lock);
+	}
+	ethash_mutex_unlock(&lazy->lock);
+	if (ethash_atomic_load_u32(&lazy->cancelled)) {
+		return;
+	}
+	ethash_full_checksum(full, lazy->num_threads);
+	progpow_full_compute_cache(full);
+	ethash_full_lock(full);
+	ethash_mutex_lock(&lazy->lock);
+	lazy->filled = true;
+	ethash_cond_broadcast(&lazy->changed);
+	ethash_mutex_unlock(&lazy->lock);
+}
+
+// The page @a index of a lazy DAG, generated into @a tmp if it is not there yet
+static node const* ethash_full_lazy_page(struct ethash_full* full, uint32_t index, node* tmp)
+{
+	struct ethash_full_lazy* lazy = full->lazy;
+	node* const page = &full->data[MIX_NODES * index];
+	uint32_t const w = index / 64;
+	uint64_t const bit = (uint64_t)1 << (index % 64);
+	if (ethash_atomic_load_u64(&lazy->ready[w]) & bit) {
+		return page;
+	}
+	ethash_light_dag_items(tmp, index * MIX_NODES, MIX_NODES, lazy->light);
+	// keep it for the next hashes unless someone else is already at it
+	if (ethash_full_lazy_set(lazy->claimed, w, bit)) {
+		memcpy(page, tmp, sizeof(node) * MIX_NODES);
+		ethash_full_lazy_publish(lazy, w, bit, 1);
+	}
+	return tmp;
+}
+
+// ethash_hash() of a lazy DAG that is not complete yet
+static void ethash_hash_lazy(
+	ethash_return_value_t* ret,
+	struct ethash_full* full,
+	ethash_h256_t const* header_hash,
+	uint64_t const nonce
 )
 {
-	uint64_t full_size = ethash_get_datasize(light->block_number);
-	return ethash_light_compute_internal(light, full_size, header_hash, nonce);
+	ETHASH_ALIGNED(64) node s_mix[MIX_NODES + 1];
+	ethash_hash_init(s_mix, header_hash, nonce);
+	ethash_fnv_kernel_t const* const fnv = ethash_kernels()->fnv;
+	for (unsigned i = 0; i != ETHASH_ACCESSES; ++i) {
+		ETHASH_ALIGNED(64) node tmp_nodes[MIX_NODES];
+		uint32_t const index = ethash_hash_page(s_mix, i, &full->num_full_pages);
+		fnv->mix(s_mix + 1, ethash_full_lazy_page(full, index, tmp_nodes), MIX_NODES);
+	}
+	ethash_hash_finish(ret, s_mix);
+	ret->success = true;
+	ethash_stats_add(ETHASH_STAT_FULL_HASHES, 1);
+}
+
+// Whether the hashes of @a full have to look out for missing pages
+static inline bool ethash_full_lazy_pending(ethash_full_t full)
+{
+	return full->lazy && !ethash_atomic_load_u32(&full->lazy->complete);
+}
+
+static void ethash_full_lazy_free(struct ethash_full* full)
+{
+	struct ethash_full_lazy* lazy = full->lazy;
+	ethash_atomic_store_u32(&lazy->cancelled, 1);
+	ethash_mutex_lock(&lazy->lock);
+	ethash_cond_broadcast(&lazy->changed);
+	ethash_mutex_unlock(&lazy->lock);
+	if (lazy->started) {
+		ethash_thread_join(lazy->thread);
+	}
+	ethash_cond_destroy(&lazy->changed);
+	ethash_mutex_destroy(&lazy->lock);
+	free((void*)lazy->claimed);
+	free((void*)lazy->ready);
+	free(lazy);
+	full->lazy = NULL;
+}
+
+void ethash_full_lazy_wait(ethash_full_t full)
+{
+	struct ethash_full_lazy* lazy = full->lazy;
+	ethash_mutex_lock(&lazy->lock);
+	while (!lazy->filled) {
+		ethash_cond_wait(&lazy->changed, &lazy->lock);
+	}
+	ethash_mutex_unlock(&lazy->lock);
 }
 
-static bool ethash_mmap(struct ethash_full* ret, FILE* f)
+ethash_full_t ethash_full_new_lazy_internal(
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned num_threads
+)
 {
-	int fd;
-	char* mmapped_data;
-	errno = 0;
-	ret->file = f;
-	if ((fd = ethash_fileno(ret->file)) == -1) {
-		return false;
+	if (full_size % ETHASH_MIX_BYTES != 0 || full_size == 0) {
+		return NULL;
 	}
-	mmapped_data= mmap(
-		NULL,
-		(size_t)ret->file_size + ETHASH_DAG_MAGIC_NUM_SIZE,
-		PROT_READ | PROT_WRITE,
-		MAP_SHARED,
-		fd,
-		0
-	);
-	if (mmapped_data == MAP_FAILED) {
-		return false;
+	struct ethash_full* ret = ethash_full_handle_new(full_size);
+	if (!ret) {
+		return NULL;
 	}
-	ret->data = (node*)(mmapped_data + ETHASH_DAG_MAGIC_NUM_SIZE);
-	return true;
+	ret->file_size = full_size;
+	ret->num_full_pages = ethash_fastmod_init((uint32_t)(full_size / ETHASH_MIX_BYTES));
+	ret->progpow_entries = progpow_dag_entries(full_size);
+	ret->epoch = light->epoch;
+	ret->progpow_period = light->progpow_period;
+	struct ethash_full_lazy* lazy = calloc(1, sizeof(*lazy));
+	if (!lazy) {
+		goto fail_free_full;
+	}
+	ret->lazy = lazy;
+	lazy->light = light;
+	lazy->num_pages = (uint32_t)(full_size / ETHASH_MIX_BYTES);
+	lazy->num_words = (lazy->num_pages + 63) / 64;
+	lazy->num_threads = num_threads ? num_threads : ethash_hardware_concurrency();
+	lazy->claimed = calloc(lazy->num_words, sizeof(uint64_t));
+	lazy->ready = calloc(lazy->num_words, sizeof(uint64_t));
+	if (!lazy->claimed || !lazy->ready) {
+		goto fail_free_lazy;
+	}
+	if (!ethash_mutex_init(&lazy->lock)) {
+		goto fail_free_lazy;
+	}
+	if (!ethash_cond_init(&lazy->changed)) {
+		goto fail_destroy_lock;
+	}
+	// the bits past the last page are never generated
+	if (lazy->num_pages % 64) {
+		uint64_t const past = ~(uint64_t)0 << (lazy->num_pages % 64);
+		lazy->claimed[lazy->num_words - 1] = past;
+		lazy->ready[lazy->num_words - 1] = past;
+	}
+	// no replicas, they would have to be filled in page by page as well
+	if (!ethash_full_alloc_checksums(ret) || !ethash_full_alloc_anonymous(ret, ethash_get_huge_pages())) {
+		goto fail_destroy_cond;
+	}
+	lazy->started = ethash_thread_create(&lazy->thread, ethash_full_lazy_run, ret);
+	if (!lazy->started) {
+		// no thread to spare, the DAG is then complete from the start
+		ethash_full_lazy_run(ret);
+	}
+	return ret;
+
+fail_destroy_cond:
+	free(ret->checksums);
+	ethash_cond_destroy(&lazy->changed);
+fail_destroy_lock:
+	ethash_mutex_destroy(&lazy->lock);
+fail_free_lazy:
+	free((void*)lazy->claimed);
+	free((void*)lazy->ready);
+	free(lazy);
+fail_free_full:
+	ethash_full_handle_free(ret);
+	return NULL;
 }
 
-ethash_full_t ethash_full_new_internal(
+ethash_full_t ethash_full_new_lazy(ethash_light_t light, unsigned num_threads)
+{
+	return ethash_full_new_lazy_internal(ethash_light_full_size(light), light, num_threads);
+}
+
+struct ethash_full_future {
+	char* dirname;               ///< NULL for a DAG in memory only
+	ethash_h256_t seed_hash;
+	uint64_t full_size;
+	ethash_light_t light;
+	unsigned num_threads;
+	ethash_callback_t callback;
+	struct ethash_dag_control control;
+	ethash_full_t result;
+	uint32_t volatile finished;
+	bool started;                ///< whether @a thread has to be joined
+	bool owns_light;             ///< whether @a light is freed with the future
+	ethash_thread_t thread;
+};
+
+static void ethash_full_future_run(void* arg)
+{
+	struct ethash_full_future* future = (struct ethash_full_future*)arg;
+	if (future->dirname) {
+		future->result = ethash_full_new_file_job(
+			future->dirname,
+			future->seed_hash,
+			future->full_size,
+			future->light,
+			future->num_threads,
+			future->callback,
+			&future->control,
+			NULL
+		);
+	} else {
+		future->result = ethash_full_new_memory_job(
+			future->full_size,
+			future->light,
+			future->num_threads,
+			future->callback,
+			&future->control
+		);
+	}
+	ethash_atomic_store_u32(&future->finished, 1);
+}
+
+static ethash_full_future_t ethash_full_future_start(
 	char const* dirname,
 	ethash_h256_t const seed_hash,
 	uint64_t full_size,
 	ethash_light_t const light,
+	bool owns_light,
+	unsigned num_threads,
 	ethash_callback_t callback
 )
 {
-	struct ethash_full* ret;
-	FILE *f = NULL;
-	ret = calloc(sizeof(*ret), 1);
+	struct ethash_full_future* ret = calloc(1, sizeof(*ret));
 	if (!ret) {
 		return NULL;
 	}
-	ret->file_size = (size_t)full_size;
+	if (dirname) {
+		size_t const length = strlen(dirname);
+		ret->dirname = malloc(length + 1);
+		if (!ret->dirname) {
+			free(ret);
+			return NULL;
+		}
+		memcpy(ret->dirname, dirname, length + 1);
+	}
+	ret->seed_hash = seed_hash;
+	ret->full_size = full_size;
+	ret->light = light;
+	ret->owns_light = owns_light;
+	ret->num_threads = num_threads;
+	ret->callback = callback;
+	ret->started = ethash_thread_create(&ret->thread, ethash_full_future_run, ret);
+	if (!ret->started) {
+		// no thread to spare, the future is then ready from the start
+		ethash_full_future_run(ret);
+	}
+	return ret;
+}
 
-	enum ethash_io_rc err = ethash_io_prepare(dirname, seed_hash, &f, (size_t)full_size, false);
-	if (err == ETHASH_IO_FAIL)
-		goto fail_free_full;
+ethash_full_future_t ethash_full_new_async_internal(
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned num_threads,
+	ethash_callback_t callback
+)
+{
+	return ethash_full_future_start(dirname, seed_hash, full_size, light, false, num_threads, callback);
+}
 
-	if (err == ETHASH_IO_MEMO_SIZE_MISMATCH) {
-		// if a DAG of same filename but unexpected size is found, silently force new file creation
-		if (ethash_io_prepare(dirname, seed_hash, &f, (size_t)full_size, true) != ETHASH_IO_MEMO_MISMATCH) {
-			ETHASH_CRITICAL("Could not recreate DAG file after finding existing DAG with unexpected size.");
-			goto fail_free_full;
-		}
-		// we now need to go through the mismatch case, NOT the match case
-		err = ETHASH_IO_MEMO_MISMATCH;
+ethash_full_future_t ethash_full_new_async(
+	ethash_light_t light,
+	bool in_memory,
+	unsigned num_threads,
+	ethash_callback_t callback
+)
+{
+	char strbuf[256];
+	if (!in_memory && !ethash_get_default_dirname(strbuf, 256)) {
+		return NULL;
 	}
+	return ethash_full_new_async_internal(
+		in_memory ? NULL : strbuf,
+		ethash_light_seedhash(light),
+		ethash_light_full_size(light),
+		light,
+		num_threads,
+		callback
+	);
+}
 
-	if (err == ETHASH_IO_MEMO_MISMATCH || err == ETHASH_IO_MEMO_MATCH) {
-		if (!ethash_mmap(ret, f)) {
-			ETHASH_CRITICAL("mmap failure()");
-			goto fail_close_file;
-		}
+// Start generating the DAG of an imported seed package, the future taking
+// over @a light
+static ethash_full_future_t ethash_full_future_adopt(
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size,
+	ethash_light_t light,
+	unsigned num_threads,
+	ethash_callback_t callback
+)
+{
+	if (!light) {
+		return NULL;
+	}
+	ethash_full_future_t ret = ethash_full_future_start(dirname, seed_hash, full_size, light, true, num_threads, callback);
+	if (!ret) {
+		ethash_light_delete(light);
+	}
+	return ret;
+}
 
-		if (err == ETHASH_IO_MEMO_MATCH) {
-#if defined(__MIC__)
-			node* tmp_nodes = _mm_malloc((size_t)full_size, 64);
-			//copy all nodes from ret->data
-			//mmapped_nodes are not aligned properly
-			uint32_t const countnodes = (uint32_t) ((size_t)ret->file_size / sizeof(node));
-			//fprintf(stderr,"ethash_full_new_internal:countnodes:%d",countnodes);
-			for (uint32_t i = 1; i != countnodes; ++i) {
-				tmp_nodes[i] = ret->data[i];
-			}
-			ret->data = tmp_nodes;
-#endif
-			return ret;
-		}
+ethash_full_future_t ethash_full_import_seed_package_async_internal(
+	char const* path,
+	char const* dirname,
+	unsigned num_threads,
+	ethash_callback_t callback
+)
+{
+	ethash_h256_t seedhash;
+	uint64_t full_size;
+	ethash_light_t const light = ethash_light_import_seed_package_internal(path, dirname, &seedhash, &full_size);
+	return ethash_full_future_adopt(dirname, seedhash, full_size, light, num_threads, callback);
+}
+
+ethash_full_future_t ethash_full_import_seed_package_async(
+	char const* path,
+	bool in_memory,
+	unsigned num_threads,
+	ethash_callback_t callback
+)
+{
+	char strbuf[256];
+	if (!in_memory && !ethash_get_default_dirname(strbuf, 256)) {
+		return NULL;
 	}
+	char const* const dirname = in_memory ? NULL : strbuf;
+	ethash_h256_t seedhash;
+	uint64_t full_size;
+	ethash_light_t const light = ethash_light_import_seed_package_checked(path, dirname, &seedhash, &full_size);
+	return ethash_full_future_adopt(dirname, seedhash, full_size, light, num_threads, callback);
+}
 
+ethash_light_t ethash_full_future_light(ethash_full_future_t future)
+{
+	return future->light;
+}
 
-#if defined(__MIC__)
-	ret->data = _mm_malloc((size_t)full_size, 64);
-#endif
-	if (!ethash_compute_full_data(ret->data, full_size, light, callback)) {
-		ETHASH_CRITICAL("Failure at computing DAG data.");
-		goto fail_free_full_data;
+bool ethash_full_future_poll(ethash_full_future_t future)
+{
+	return ethash_atomic_load_u32(&future->finished) != 0;
+}
+
+uint64_t ethash_full_future_progress(ethash_full_future_t future)
+{
+	if (ethash_full_future_poll(future) && future->result) {
+		// also covers DAGs loaded from their file instead of computed
+		return future->full_size;
 	}
+	return (uint64_t)ethash_atomic_load_u32(&future->control.nodes) * sizeof(node);
+}
 
-	// after the DAG has been filled then we finalize it by writting the magic number at the beginning
-	if (fseek(f, 0, SEEK_SET) != 0) {
-		ETHASH_CRITICAL("Could not seek to DAG file start to write magic number.");
-		goto fail_free_full_data;
+ethash_full_t ethash_full_future_partial(ethash_full_future_t future)
+{
+	return ethash_atomic_load_u32(&future->control.has_partial) ? future->control.partial : NULL;
+}
+
+// wait for the worker and free the future, giving back its result
+static ethash_full_t ethash_full_future_join(ethash_full_future_t future)
+{
+	if (future->started) {
+		ethash_thread_join(future->thread);
 	}
-	uint64_t const magic_num = ETHASH_DAG_MAGIC_NUM;
-	if (fwrite(&magic_num, ETHASH_DAG_MAGIC_NUM_SIZE, 1, f) != 1) {
-		ETHASH_CRITICAL("Could not write magic number to DAG's beginning.");
-		goto fail_free_full_data;
+	ethash_full_t const result = future->result;
+	if (!result && future->control.has_partial) {
+		ethash_full_delete(future->control.partial);
 	}
-	if (fflush(f) != 0) {// make sure the magic number IS there
-		ETHASH_CRITICAL("Could not flush memory mapped data to DAG file. Insufficient space?");
-		goto fail_free_full_data;
+	if (future->owns_light) {
+		ethash_light_delete(future->light);
 	}
-	return ret;
+	free(future->dirname);
+	free(future);
+	return result;
+}
 
-fail_free_full_data:
-	// could check that munmap(..) == 0 but even if it did not can't really do anything here
-	munmap(ret->data, (size_t)full_size);
-#if defined(__MIC__)
-	_mm_free(ret->data);
-#endif
-fail_close_file:
-	fclose(ret->file);
-fail_free_full:
-	free(ret);
-	return NULL;
+ethash_full_t ethash_full_future_wait(ethash_full_future_t future)
+{
+	return ethash_full_future_join(future);
 }
 
-ethash_full_t ethash_full_new(ethash_light_t light, ethash_callback_t callback)
+void ethash_full_future_cancel(ethash_full_future_t future)
 {
-	char strbuf[256];
-	if (!ethash_get_default_dirname(strbuf, 256)) {
-		return NULL;
+	ethash_atomic_store_u32(&future->control.cancelled, 1);
+	ethash_full_t const result = ethash_full_future_join(future);
+	if (result) {
+		// finished before noticing the cancellation
+		ethash_full_delete(result);
 	}
-	uint64_t full_size = ethash_get_datasize(light->block_number);
-	ethash_h256_t seedhash = ethash_get_seedhash(light->block_number);
-	return ethash_full_new_internal(strbuf, seedhash, full_size, light, callback);
 }
 
 void ethash_full_delete(ethash_full_t full)
 {
-	// could check that munmap(..) == 0 but even if it did not can't really do anything here
-	munmap(full->data, (size_t)full->file_size);
+	ethash_trace(ETHASH_EVENT_DAG_DELETED, full->epoch, full->file_size, 0, ETHASH_DAG_FILE_NONE);
+	if (full->lazy) {
+		ethash_full_lazy_free(full);
+	}
+	ethash_full_unlock(full);
+	ethash_memory_pool_free(&full->memory);
+	for (unsigned n = 0; n != ETHASH_NUMA_MAX_NODES; ++n) {
+		ethash_memory_free(&full->replicas[n]);
+	}
 	if (full->file) {
 		fclose(full->file);
 	}
-	free(full);
+	ethash_memory_free(&full->progpow_cache);
+	free(full->checksums);
+	ethash_full_handle_free(full);
+}
+
+void ethash_full_partial_view(ethash_full_t full, struct ethash_light* view)
+{
+	*view = *full->partial_light;
+	uint64_t const nodes = ethash_atomic_load_u64(&full->partial_nodes);
+	// the prefix of the light handler may still be the longer one
+	if (nodes > view->dag_prefix_nodes) {
+		view->dag_prefix.base = full->data;
+		view->dag_prefix_nodes = (uint32_t)nodes;
+	}
+}
+
+// Hash a batch of nonces, one by one while the DAG may still miss nodes
+// Same as ethash_hash_batch() for any state of the DAG of @a full
+static void ethash_full_hash_batch(
+	ethash_return_value_t* results,
+	ethash_full_t full,
+	node const* dag,
+	ethash_h256_t const* header_hashes,
+	unsigned header_step,
+	uint64_t const* nonces,
+	unsigned count
+)
+{
+	if (ethash_full_lazy_pending(full)) {
+		for (unsigned k = 0; k != count; ++k) {
+			ethash_hash_lazy(&results[k], full, &header_hashes[k * header_step], nonces[k]);
+		}
+	} else if (ethash_full_is_partial(full)) {
+		struct ethash_light view;
+		ethash_full_partial_view(full, &view);
+		for (unsigned k = 0; k != count; ++k) {
+			ethash_hash(&results[k], NULL, &view, &full->num_full_pages, header_hashes[k * header_step], nonces[k]);
+			results[k].success = true;
+		}
+	} else {
+		ethash_hash_batch(results, dag, &full->num_full_pages, header_hashes, header_step, nonces, count);
+	}
 }
 
 ethash_return_value_t ethash_full_compute(
@@ -549,21 +3467,228 @@ ethash_return_value_t ethash_full_compute(
 )
 {
 	ethash_return_value_t ret;
-	ret.success = true;
-	if (!ethash_hash(
-		&ret,
-		(node const*)full->data,
-		NULL,
-		full->file_size,
-		header_hash,
-		nonce)) {
-		ret.success = false;
+	ret.success = full->file_size % MIX_WORDS == 0;
+	if (ret.success && ethash_full_lazy_pending(full)) {
+		ethash_hash_lazy(&ret, full, &header_hash, nonce);
+	} else if (ret.success && ethash_full_is_partial(full)) {
+		struct ethash_light view;
+		ethash_full_partial_view(full, &view);
+		ethash_hash(&ret, NULL, &view, &full->num_full_pages, header_hash, nonce);
+	} else if (ret.success) {
+		ethash_hash(&ret, ethash_full_local_data(full), NULL, &full->num_full_pages, header_hash, nonce);
 	}
 	return ret;
 }
 
+bool ethash_full_compute_batch(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	uint64_t const* nonces,
+	ethash_return_value_t* results,
+	size_t count
+)
+{
+	if (full->file_size % MIX_WORDS != 0) {
+		for (size_t i = 0; i != count; ++i) {
+			results[i].success = false;
+		}
+		return false;
+	}
+	node const* const dag = ethash_full_local_data(full);
+	for (size_t first = 0; first < count; first += ETHASH_HASH_BATCH) {
+		unsigned const n = count - first < ETHASH_HASH_BATCH ? (unsigned)(count - first) : ETHASH_HASH_BATCH;
+		ethash_full_hash_batch(results + first, full, dag, &header_hash, 0, nonces + first, n);
+	}
+	return true;
+}
+
+bool ethash_search_targets_reset(ethash_search_target_t* targets, size_t num_targets)
+{
+	for (size_t t = 0; t != num_targets; ++t) {
+		targets[t].found = 0;
+	}
+	return ethash_search_targets_open(targets, num_targets);
+}
+
+bool ethash_search_targets_open(ethash_search_target_t const* targets, size_t num_targets)
+{
+	for (size_t t = 0; t != num_targets; ++t) {
+		if (targets[t].found != targets[t].max_hits) {
+			return true;
+		}
+	}
+	return false;
+}
+
+unsigned ethash_search_targets_record(
+	ethash_search_target_t* targets,
+	size_t num_targets,
+	uint64_t const* nonces,
+	ethash_return_value_t const* results,
+	unsigned count
+)
+{
+	for (unsigned k = 0; k != count; ++k) {
+		bool open = false;
+		for (size_t t = 0; t != num_targets; ++t) {
+			ethash_search_target_t* const target = &targets[t];
+			if (target->found == target->max_hits) {
+				continue;
+			}
+			if (ethash_check_difficulty(&results[k].result, &target->boundary)) {
+				ethash_search_hit_t* const hit = &target->hits[target->found++];
+				hit->nonce = nonces[k];
+				hit->result = results[k].result;
+				hit->mix_hash = results[k].mix_hash;
+			}
+			open = open || target->found != target->max_hits;
+		}
+		if (!open) {
+			return k + 1;
+		}
+	}
+	return count;
+}
+
+uint64_t ethash_full_search_multi(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	uint64_t start_nonce,
+	uint64_t count,
+	ethash_search_target_t* targets,
+	size_t num_targets
+)
+{
+	uint64_t hashed = 0;
+	bool open = ethash_search_targets_reset(targets, num_targets);
+	if (full->file_size % MIX_WORDS != 0) {
+		return 0;
+	}
+	node const* const dag = ethash_full_local_data(full);
+	uint64_t nonces[ETHASH_HASH_BATCH];
+	ethash_return_value_t results[ETHASH_HASH_BATCH];
+	unsigned const batch = ethash_get_hash_batch();
+	// hash a batch at a time, the hits are still recorded in nonce order
+	while (open && hashed < count) {
+		unsigned const n = count - hashed < batch ? (unsigned)(count - hashed) : batch;
+		for (unsigned k = 0; k != n; ++k) {
+			nonces[k] = start_nonce + hashed + k;
+		}
+		ethash_full_hash_batch(results, full, dag, &header_hash, 0, nonces, n);
+		hashed += ethash_search_targets_record(targets, num_targets, nonces, results, n);
+		open = ethash_search_targets_open(targets, num_targets);
+	}
+	return hashed;
+}
+
+size_t ethash_full_search(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	uint64_t start_nonce,
+	uint64_t count,
+	ethash_h256_t const* boundary,
+	ethash_search_hit_t* hits,
+	size_t max_hits
+)
+{
+	ethash_search_target_t target;
+	target.boundary = *boundary;
+	target.hits = hits;
+	target.max_hits = max_hits;
+	ethash_full_search_multi(full, header_hash, start_nonce, count, &target, 1);
+	return target.found;
+}
+
+struct ethash_full_verify_job {
+	ethash_full_t full;
+	ethash_h256_t const* header_hashes;
+	uint64_t const* nonces;
+	ethash_h256_t const* mix_hashes;
+	ethash_h256_t const* boundaries;
+	bool* results;
+	uint64_t count;
+	uint64_t volatile next;      ///< the next header to claim
+	uint64_t volatile valid;
+};
+
+static void ethash_full_verify_worker(void* arg)
+{
+	struct ethash_full_verify_job* job = (struct ethash_full_verify_job*)arg;
+	node const* const dag = ethash_full_local_data(job->full);
+	unsigned const batch = ethash_get_hash_batch();
+	uint64_t first;
+	// a thread claims a batch of headers at a time and hashes the ones passing the quick check in lockstep
+	while ((first = ethash_atomic_fetch_add_u64(&job->next, batch)) < job->count) {
+		uint64_t const end = job->count - first < batch ? job->count : first + batch;
+		ethash_h256_t header_hashes[ETHASH_HASH_BATCH];
+		uint64_t nonces[ETHASH_HASH_BATCH];
+		ethash_return_value_t rets[ETHASH_HASH_BATCH];
+		size_t hashed[ETHASH_HASH_BATCH];
+		unsigned count = 0;
+		for (uint64_t i = first; i != end; ++i) {
+			job->results[i] = false;
+			if (ethash_quick_check_difficulty(&job->header_hashes[i], job->nonces[i], &job->mix_hashes[i], &job->boundaries[i])) {
+				header_hashes[count] = job->header_hashes[i];
+				nonces[count] = job->nonces[i];
+				hashed[count++] = (size_t)i;
+			}
+		}
+		if (count) {
+			ethash_full_hash_batch(rets, job->full, dag, header_hashes, 1, nonces, count);
+		}
+		for (unsigned k = 0; k != count; ++k) {
+			size_t const i = hashed[k];
+			job->results[i] = memcmp(&rets[k].mix_hash, &job->mix_hashes[i], sizeof(ethash_h256_t)) == 0 &&
+				ethash_check_difficulty(&rets[k].result, &job->boundaries[i]);
+		}
+		for (uint64_t i = first; i != end; ++i) {
+			if (job->results[i]) {
+				ethash_atomic_fetch_add_u64(&job->valid, 1);
+			} else {
+				ethash_stats_add(ETHASH_STAT_VERIFY_FAILURES, 1);
+			}
+		}
+	}
+}
+
+size_t ethash_full_verify_batch(
+	ethash_full_t full,
+	ethash_h256_t const* header_hashes,
+	uint64_t const* nonces,
+	ethash_h256_t const* mix_hashes,
+	ethash_h256_t const* boundaries,
+	bool* results,
+	size_t count,
+	unsigned num_threads
+)
+{
+	struct ethash_full_verify_job job = {
+		full, header_hashes, nonces, mix_hashes, boundaries, results, count, 0, 0
+	};
+	if (full->file_size % MIX_WORDS != 0) {
+		for (size_t i = 0; i != count; ++i) {
+			results[i] = false;
+		}
+		return 0;
+	}
+	if (count == 0) {
+		return 0;
+	}
+	if (num_threads == 0) {
+		num_threads = ethash_hardware_concurrency();
+	}
+	// no thread gets less than a batch
+	uint64_t const batches = (count + ETHASH_HASH_BATCH - 1) / ETHASH_HASH_BATCH;
+	if (num_threads > batches) {
+		num_threads = (unsigned)batches;
+	}
+	ethash_parallel_run(ethash_full_verify_worker, &job, num_threads, ETHASH_THREAD_PRIORITY_NORMAL);
+	return (size_t)job.valid;
+}
+
 void const* ethash_full_dag(ethash_full_t full)
 {
+	ethash_full_wait_generated(full);
 	return full->data;
 }
 
@@ -571,3 +3696,80 @@ uint64_t ethash_full_dag_size(ethash_full_t full)
 {
 	return full->file_size;
 }
+
+unsigned ethash_full_replica_count(ethash_full_t full)
+{
+	unsigned count = 1;
+	for (unsigned n = 1; n != ETHASH_NUMA_MAX_NODES; ++n) {
+		count += full->replicas[n].base != NULL;
+	}
+	return count;
+}
+
+uint64_t ethash_full_generated_size(ethash_full_t full)
+{
+	if (ethash_full_is_partial(full)) {
+		return ethash_atomic_load_u64(&full->partial_nodes) * sizeof(node);
+	}
+	if (!full->lazy || ethash_atomic_load_u32(&full->lazy->complete)) {
+		return full->file_size;
+	}
+	return (uint64_t)ethash_atomic_load_u32(&full->lazy->pages_ready) * ETHASH_MIX_BYTES;
+}
+
+uint64_t ethash_full_load_time_us(ethash_full_t full)
+{
+	return full->load_time_us;
+}
+
+bool ethash_full_verify(ethash_full_t full, unsigned num_threads)
+{
+	ethash_full_wait_generated(full);
+	uint32_t const count = ethash_io_dag_checksum_count(full->file_size);
+	if (ethash_dag_checksums(full->data, full->file_size, 0, count, full->checksums, true, num_threads) != 0) {
+		return false;
+	}
+	for (unsigned n = 1; n != ETHASH_NUMA_MAX_NODES; ++n) {
+		if (full->replicas[n].base &&
+			ethash_dag_checksums(full->replicas[n].base, full->file_size, 0, count, full->checksums, true, num_threads) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+enum ethash_page_mode ethash_full_page_mode(ethash_full_t full)
+{
+	return full->memory.mode;
+}
+
+enum ethash_page_mode ethash_light_page_mode(ethash_light_t light)
+{
+	return light->cache_memory.base ? light->cache_memory.mode : ETHASH_PAGES_DEFAULT;
+}
+
+static bool ethash_memory_info_add(struct ethash_memory const* mem, ethash_memory_info_t* info)
+{
+	return ethash_memory_add_info(mem->base, mem->size, mem->mode, info);
+}
+
+bool ethash_light_memory_info(ethash_light_t light, ethash_memory_info_t* info)
+{
+	memset(info, 0, sizeof(*info));
+	bool ok = ethash_memory_add_info(light->cache, (size_t)light->cache_size, ethash_light_page_mode(light), info);
+	ok = ethash_memory_info_add(&light->dag_prefix, info) && ok;
+	info->locked = light->locked_bytes;
+	return ok;
+}
+
+bool ethash_full_memory_info(ethash_full_t full, ethash_memory_info_t* info)
+{
+	memset(info, 0, sizeof(*info));
+	bool ok = ethash_memory_info_add(&full->memory, info);
+	for (unsigned n = 1; n != ETHASH_NUMA_MAX_NODES; ++n) {
+		ok = ethash_memory_info_add(&full->replicas[n], info) && ok;
+	}
+	ok = ethash_memory_info_add(&full->progpow_cache, info) && ok;
+	info->locked = full->locked_bytes;
+	return ok;
+}
@@ -2,16 +2,12 @@
 #include "compiler.h"
 #include "endian.h"
 #include "ethash.h"
+#include "fastmod.h"
+#include "memory.h"
+#include "numa.h"
+#include "threads.h"
 #include <stdio.h>
 
-#define ENABLE_SSE 0
-
-#if defined(_M_X64) && ENABLE_SSE
-#include <smmintrin.h>
-#elif defined(__MIC__)
-#include <immintrin.h>
-#endif
-
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -20,19 +16,16 @@ extern "C" {
 #define NODE_WORDS (64/4)
 #define MIX_WORDS (ETHASH_MIX_BYTES/4)
 #define MIX_NODES (MIX_WORDS / NODE_WORDS)
+// number of nonces the batch functions hash in lockstep
+#define ETHASH_HASH_BATCH ETHASH_MAX_HASH_BATCH
+// default number of light hashes a verifying thread interleaves
+#define ETHASH_LIGHT_INTERLEAVE 8
 #include <stdint.h>
 
 typedef union node {
 	uint8_t bytes[NODE_WORDS * 4];
 	uint32_t words[NODE_WORDS];
 	uint64_t double_words[NODE_WORDS / 2];
-
-#if defined(_M_X64) && ENABLE_SSE
-	__m128i xmm[NODE_WORDS/4];
-#elif defined(__MIC__)
-	__m512i zmm[NODE_WORDS/16];
-#endif
-
 } node;
 
 static inline uint8_t ethash_h256_get(ethash_h256_t const* hash, unsigned int i)
@@ -50,42 +43,73 @@ static inline void ethash_h256_reset(ethash_h256_t* hash)
 	memset(hash, 0, 32);
 }
 
+// The @a i th most significant 64 bit word of a big endian hash
+static inline uint64_t ethash_h256_word(ethash_h256_t const* hash, unsigned int i)
+{
+	uint64_t word;
+	memcpy(&word, &hash->b[i * 8], 8);
+#if LITTLE_ENDIAN == BYTE_ORDER
+	word = ethash_swap_u64(word);
+#endif
+	return word;
+}
+
 // Returns if hash is less than or equal to boundary (2^256/difficulty)
 static inline bool ethash_check_difficulty(
 	ethash_h256_t const* hash,
 	ethash_h256_t const* boundary
 )
 {
-	// Boundary is big endian
-	for (int i = 0; i < 32; i++) {
-		if (ethash_h256_get(hash, i) == ethash_h256_get(boundary, i)) {
-			continue;
+	// Boundary is big endian, nearly every result differs in the first word
+	for (unsigned i = 0; i != 4; ++i) {
+		uint64_t const h = ethash_h256_word(hash, i);
+		uint64_t const b = ethash_h256_word(boundary, i);
+		if (h != b) {
+			return h < b;
 		}
-		return ethash_h256_get(hash, i) < ethash_h256_get(boundary, i);
 	}
 	return true;
 }
 
-/**
- *  Difficulty quick check for POW preverification
- *
- * @param header_hash      The hash of the header
- * @param nonce            The block's nonce
- * @param mix_hash         The mix digest hash
- * @param boundary         The boundary is defined as (2^256 / difficulty)
- * @return                 true for succesful pre-verification and false otherwise
- */
-bool ethash_quick_check_difficulty(
-	ethash_h256_t const* header_hash,
-	uint64_t const nonce,
-	ethash_h256_t const* mix_hash,
-	ethash_h256_t const* boundary
-);
+
+#define PROGPOW_LANES                   16
+#define PROGPOW_REGS                    32
+#define PROGPOW_DAG_LOADS                4
+#define PROGPOW_CACHE_BYTES             (16*1024)
+#define PROGPOW_CNT_DAG                 ETHASH_ACCESSES
+#define PROGPOW_CNT_CACHE               11
+#define PROGPOW_CNT_MATH                18
+#define PROGPOW_CACHE_WORDS  (PROGPOW_CACHE_BYTES / sizeof(uint32_t))
+#define PROGPOW_PERIOD                  10
 
 struct ethash_light {
 	void* cache;
 	uint64_t cache_size;
+	/// The number of nodes of @a cache, the parents of the DAG items
+	ethash_fastmod_t num_parent_nodes;
+	/// The mapping holding @a cache. If its base is NULL @a cache came from malloc
+	struct ethash_memory cache_memory;
 	uint64_t block_number;
+	/// The epoch of the seed, ETHASH_EVENT_NO_EPOCH if past the known ones
+	uint64_t epoch;
+	/// The first PROGPOW_CACHE_BYTES of the DAG, used as the ProgPoW cache in
+	/// light mode. May be NULL, in which case it's computed for every hash.
+	uint32_t* progpow_cache;
+	/// DAG items remembered from earlier light hashes, NULL if not enabled
+	struct ethash_dag_memo* memo;
+	/// The first dag_prefix_nodes items of the DAG, see @ref ethash_light_set_dag_prefix()
+	struct ethash_memory dag_prefix;
+	uint32_t dag_prefix_nodes;
+	/// The bytes of the regions above locked by @ref ethash_set_memory_lock()
+	uint64_t locked_bytes;
+	/// The DAG size, seedhash and ProgPoW period of a handler of
+	/// @ref ethash_light_new_for_chain(). A full_size of 0 stands for the ones
+	/// of Ethereum at @a block_number
+	uint64_t full_size;
+	ethash_h256_t seedhash;
+	uint64_t progpow_period;
+	/// The bytes reserved for the cache, see @ref ethash_set_memory_budget()
+	uint64_t budget_bytes;
 };
 
 /**
@@ -99,6 +123,120 @@ struct ethash_light {
  */
 ethash_light_t ethash_light_new_internal(uint64_t cache_size, ethash_h256_t const* seed);
 
+/**
+ * Allocate and initialize a new ethash_light handler with its cache in memory
+ * of @a provider. Internal version of @ref ethash_light_new_with_provider().
+ */
+ethash_light_t ethash_light_new_provided_internal(
+	uint64_t cache_size,
+	ethash_h256_t const* seed,
+	ethash_memory_provider_t const* provider
+);
+
+/**
+ * Map the light cache file in @a dirname. Internal version of @ref ethash_light_attach().
+ *
+ * @param dirname       The directory holding the light cache files
+ * @param cache_size    The size of the cache in bytes
+ * @param seed          Block seedhash of the cache, used in the file naming
+ * @return              Newly allocated ethash_light handler, or NULL if there is
+ *                      no valid cache file
+ */
+ethash_light_t ethash_light_attach_internal(
+	char const* dirname,
+	uint64_t cache_size,
+	ethash_h256_t const* seed
+);
+
+/**
+ * Allocate and initialize a new ethash_light handler, reusing the light cache
+ * file in @a dirname or writing it for the next time
+ *
+ * A valid cache file is mapped into memory instead of computing the cache, or
+ * read into huge pages if so requested with @ref ethash_set_huge_pages().
+ *
+ * @param dirname       The directory holding the light cache files
+ * @param cache_size    The size of the cache in bytes
+ * @param seed          Block seedhash to be used during the computation of the
+ *                      cache nodes
+ * @return              Newly allocated ethash_light handler or NULL in case of
+ *                      ERRNOMEM or invalid parameters used for @ref ethash_compute_cache_nodes()
+ */
+ethash_light_t ethash_light_new_persistent_internal(
+	char const* dirname,
+	uint64_t cache_size,
+	ethash_h256_t const* seed
+);
+
+/**
+ * Map the light cache file in @a dirname, computing and writing it first if
+ * there is none. Internal version of @ref ethash_light_new_mapped().
+ *
+ * @param dirname       The directory holding the light cache files
+ * @param cache_size    The size of the cache in bytes
+ * @param seed          Block seedhash to be used during the computation of the
+ *                      cache nodes
+ * @return              Newly allocated ethash_light handler or NULL in case of
+ *                      ERRNOMEM or invalid parameters used for @ref ethash_compute_cache_nodes()
+ */
+ethash_light_t ethash_light_new_mapped_internal(
+	char const* dirname,
+	uint64_t cache_size,
+	ethash_h256_t const* seed
+);
+
+/**
+ * Write the seed package of a light cache. Internal version of
+ * @ref ethash_light_export_seed_package().
+ *
+ * @param light         The light handler containing the cache
+ * @param seed          Block seedhash of the cache
+ * @param full_size     The size of the DAG generated from the cache
+ * @param path          The path of the package file
+ * @return              true if the package was written and false otherwise
+ */
+bool ethash_light_export_seed_package_internal(
+	ethash_light_t light,
+	ethash_h256_t const* seed,
+	uint64_t full_size,
+	char const* path
+);
+
+/**
+ * Load the light cache of a seed package. Internal version of
+ * @ref ethash_light_import_seed_package(), taking any cache and DAG sizes.
+ *
+ * @param path           The path of the package file
+ * @param dirname        The directory to write the light cache file to, or NULL
+ * @param[out] seed      The seedhash of the cache
+ * @param[out] full_size The size of the DAG generated from the cache
+ * @return               Newly allocated ethash_light handler, or NULL if there is
+ *                       no valid package
+ */
+ethash_light_t ethash_light_import_seed_package_internal(
+	char const* path,
+	char const* dirname,
+	ethash_h256_t* seed,
+	uint64_t* full_size
+);
+
+/**
+ * Start allocating and initializing a new ethash_light handler in the
+ * background. Internal version of @ref ethash_light_new_async().
+ *
+ * @param dirname       The directory holding the light cache files, or NULL to
+ *                      always compute the cache without writing a file
+ * @param cache_size    The size of the cache in bytes
+ * @param seed          Block seedhash to be used during the computation of the
+ *                      cache nodes
+ * @return              A future, see @ref ethash_light_new_async()
+ */
+ethash_light_future_t ethash_light_new_async_internal(
+	char const* dirname,
+	uint64_t cache_size,
+	ethash_h256_t const* seed
+);
+
 /**
  * Calculate the light client data. Internal version.
  *
@@ -116,10 +254,182 @@ ethash_return_value_t ethash_light_compute_internal(
 	uint64_t nonce
 );
 
+/**
+ * Calculate the light client data of many nonces, interleaving up to
+ * @ref ethash_get_light_interleave() hashes at a time
+ *
+ * Gives the same results as calling @ref ethash_light_compute_internal() for
+ * each of them, and goes through the result cache the same way.
+ *
+ * @param light          The light client handler
+ * @param full_size      The size of the full data in bytes.
+ * @param header_hashes  The header hash of each nonce
+ * @param nonces         The nonces to hash
+ * @param[out] results   The result of each nonce
+ * @param count          The number of nonces
+ */
+void ethash_light_compute_interleaved_internal(
+	ethash_light_t light,
+	uint64_t full_size,
+	ethash_h256_t const* header_hashes,
+	uint64_t const* nonces,
+	ethash_return_value_t* results,
+	size_t count
+);
+
+/**
+ * Verify the proofs of work of many headers. Internal version of
+ * @ref ethash_light_verify_batch() taking the size of the full data.
+ */
+size_t ethash_light_verify_batch_internal(
+	ethash_light_t light,
+	uint64_t full_size,
+	ethash_h256_t const* header_hashes,
+	uint64_t const* nonces,
+	ethash_h256_t const* mix_hashes,
+	ethash_h256_t const* boundaries,
+	bool* results,
+	size_t count,
+	unsigned num_threads
+);
+
+/**
+ * Compute the ProgPoW cache of a light handler
+ *
+ * Fills @a light->progpow_cache with the first PROGPOW_CACHE_BYTES of the DAG
+ * so that @ref progpow_light_compute() does not have to recompute them for
+ * every hash.
+ *
+ * @param light          The light client handler
+ * @return               true for success and false if memory could not be allocated
+ */
+bool progpow_light_compute_cache(ethash_light_t light);
+
+/**
+ * Compute the ProgPoW cache of a full handler, once its DAG is complete
+ *
+ * Copies the first PROGPOW_CACHE_BYTES of the DAG to @a full->progpow_cache,
+ * where every full hash of the epoch finds them. If the copy can't be
+ * allocated the hashes read them from the DAG itself.
+ *
+ * @param full           The full client handler
+ * @return               true for success and false if memory could not be allocated
+ */
+bool progpow_full_compute_cache(ethash_full_t full);
+
+#define PROGPOW_PROGRAM_LENGTH          (PROGPOW_CNT_CACHE + PROGPOW_CNT_MATH)
+
+enum progpow_op {
+	PROGPOW_OP_CACHE = 0, ///< mix[dst] = merge(mix[dst], c_dag[mix[src1] % CACHE_WORDS], sel2)
+	PROGPOW_OP_MATH,      ///< mix[dst] = merge(mix[dst], progpowMath(mix[src1], mix[src2], sel1), sel2)
+};
+
+typedef struct progpow_instruction {
+	uint8_t op;           ///< One of @ref progpow_op
+	uint8_t src1;
+	uint8_t src2;
+	uint8_t dst;
+	uint32_t sel1;
+	uint32_t sel2;
+} progpow_instruction_t;
+
+/**
+ * The random program of a ProgPoW period, i.e. the KISS99 sequence of
+ * @ref progPowInit() replayed once and flattened into instructions
+ */
+typedef struct progpow_program {
+	uint64_t prog_seed;
+	uint32_t mix_seq_dst[PROGPOW_REGS];
+	uint32_t mix_seq_src[PROGPOW_REGS];
+	progpow_instruction_t instructions[PROGPOW_PROGRAM_LENGTH];
+	uint32_t dag_dst[PROGPOW_DAG_LOADS]; ///< Merge destinations of the global loads
+	uint32_t dag_sel[PROGPOW_DAG_LOADS]; ///< Merge selectors of the global loads
+} progpow_program_t;
+
+/**
+ * Compile the random program of a ProgPoW period
+ *
+ * @param prog           The program to fill
+ * @param prog_seed      The program seed, i.e. block_number / PROGPOW_PERIOD
+ */
+void progpow_program_init(progpow_program_t* prog, uint64_t prog_seed);
+
+/**
+ * Get the compiled program for @a prog_seed from the calling thread's cache,
+ * compiling it if needed. The returned pointer is valid until the next call
+ * from the same thread.
+ */
+progpow_program_t const* progpow_program_get(uint64_t prog_seed);
+
+/**
+ * Generate the source of a program, see @ref progpow_get_kernel_source()
+ */
+size_t progpow_program_source(
+	progpow_program_t const* prog,
+	enum progpow_source_target target,
+	char* buf,
+	size_t size
+);
+
+/// The round constants of Keccak-f[800]
+extern const uint32_t keccakf_rndc[24];
 void keccak_f800_round(uint32_t st[25], const int r);
+void keccak_f800(uint32_t st[25]);
+void keccak_f800_unrolled(uint32_t st[25]);
+#if defined(ETHASH_X86)
+void keccak_f800_bmi2(uint32_t st[25]);
+#endif
 hash32_t keccak_f800_progpow(hash32_t header, uint64_t seed, hash32_t digest);
 uint32_t progpowMath(uint32_t a, uint32_t b, uint32_t r);
 void merge(uint32_t *a, uint32_t b, uint32_t r);
+/**
+ * The number of PROGPOW_MIX_BYTES entries the ProgPoW main loop reads from a
+ * DAG of @a full_size bytes, with its reciprocal for @ref progpow_dag_entry()
+ */
+ethash_fastmod_t progpow_dag_entries(uint64_t full_size);
+/**
+ * The index of the PROGPOW_MIX_BYTES DAG entry read by one iteration of the
+ * ProgPoW main loop, out of the @a dag_entries of @ref progpow_dag_entries()
+ */
+uint32_t progpow_dag_entry(
+	const uint32_t loop,
+	uint32_t mix[PROGPOW_LANES][PROGPOW_REGS],
+	ethash_fastmod_t const* dag_entries
+);
+/**
+ * Start reading DAG entry @a entry of @a g_dag into the cache, unless
+ * @a g_dag is NULL or prefetching is disabled, see @ref ethash_set_prefetch()
+ */
+void progpow_prefetch_dag(const uint32_t* g_dag, const uint32_t entry);
+/**
+ * Read DAG entry @a entry, from @a g_dag or computed from @a light if it is
+ * NULL. The entry of an iteration of the ProgPoW main loop has to be taken
+ * with @ref progpow_dag_entry() before @a mix is changed by the iteration, as
+ * its first word selects the entry.
+ */
+void progpow_load_dag(
+	uint32_t dag_data[PROGPOW_LANES*PROGPOW_DAG_LOADS],
+	const uint32_t entry,
+	ethash_light_t const light,
+	const uint32_t* g_dag
+);
+void progPowLoop(
+	progpow_program_t const* prog,
+	const uint32_t loop,
+	ethash_light_t const light,
+	uint32_t mix[PROGPOW_LANES][PROGPOW_REGS],
+	const uint32_t* g_dag,
+	const uint32_t* c_dag,
+	ethash_fastmod_t const* dag_entries
+);
+/**
+ * Fill the mix of all lanes from the seed of a hash, lane by lane with fill_mix()
+ */
+void progPowFillMix(uint64_t seed, uint32_t mix[PROGPOW_LANES][PROGPOW_REGS]);
+/**
+ * Reduce the mix of all lanes after the last iteration to the 8 words of the mix hash
+ */
+void progPowReduceMix(uint32_t mix[PROGPOW_LANES][PROGPOW_REGS], uint32_t digest[8]);
 
 /**
  * Calculate the light client data of the ProgPow. Internal version.
@@ -142,9 +452,85 @@ ethash_return_value_t progpow_light_compute_internal(
 struct ethash_full {
 	FILE* file;
 	uint64_t file_size;
+	/// The number of ETHASH_MIX_BYTES pages of the DAG
+	ethash_fastmod_t num_full_pages;
+	/// The number of PROGPOW_MIX_BYTES entries of the DAG, see @ref progpow_dag_entries()
+	ethash_fastmod_t progpow_entries;
 	node* data;
+	/// The mapping holding @a data, either the DAG file or anonymous memory
+	struct ethash_memory memory;
+	/// Copies of @a data bound to the other NUMA nodes in ETHASH_NUMA_REPLICATE
+	/// mode. Node 0 uses @a data itself so the first entry is never allocated
+	struct ethash_memory replicas[ETHASH_NUMA_MAX_NODES];
+	/// Whether any of @a replicas holds the DAG, so hashes look up their node
+	bool replicated;
+	/// What @ref ethash_full_load_time_us() reports
+	uint64_t load_time_us;
+	/// The epoch reported to the event callback, see @ref ethash_set_event_callback()
+	uint64_t epoch;
+	/// One per ETHASH_DAG_CHECKSUM_BYTES of @a data, see @ref ethash_full_verify()
+	ethash_h256_t* checksums;
+	/// The ProgPoW cache of the epoch, see @ref progpow_full_compute_cache()
+	struct ethash_memory progpow_cache;
+	/// Where @a memory comes from, see @ref ethash_full_new_with_provider(). May be NULL
+	ethash_memory_provider_t const* provider;
+	/// How far a DAG of @ref ethash_full_new_lazy() is generated, NULL for all others
+	struct ethash_full_lazy* lazy;
+	/// The light handler a DAG of @ref ethash_full_future_partial() is computed
+	/// from, NULL if the handler was never published before it was complete
+	ethash_light_t partial_light;
+	/// Set while hashes have to fall back to @a partial_light for the nodes
+	/// from @a partial_nodes on
+	uint32_t volatile partial;
+	uint64_t volatile partial_nodes;
+	/// The bytes of @a memory, @a replicas and @a progpow_cache locked by
+	/// @ref ethash_set_memory_lock(), written once the DAG is complete
+	uint64_t locked_bytes;
+	/// The ProgPoW period of the light handler of the DAG, 0 for PROGPOW_PERIOD
+	uint64_t progpow_period;
+	/// The bytes reserved for the DAG, see @ref ethash_set_memory_budget()
+	uint64_t budget_bytes;
 };
 
+/// Whether the hashes of @a full have to compute some nodes from the light cache
+static inline bool ethash_full_is_partial(ethash_full_t full)
+{
+	return full->partial_light && ethash_atomic_load_u32(&full->partial);
+}
+
+/**
+ * Make @a view a copy of the light handler of a partial DAG that reads the
+ * nodes computed so far from the DAG, see @ref ethash_full_future_partial()
+ */
+void ethash_full_partial_view(ethash_full_t full, struct ethash_light* view);
+
+/**
+ * Wait until a DAG of @ref ethash_full_new_lazy() is generated completely,
+ * checksummed and has its ProgPoW cache
+ */
+void ethash_full_lazy_wait(ethash_full_t full);
+
+/// Make sure all of @a data is there before reading it other than by the Ethash hashes
+static inline void ethash_full_wait_generated(ethash_full_t full)
+{
+	if (full->lazy) {
+		ethash_full_lazy_wait(full);
+	}
+}
+
+/// The copy of the DAG closest to the NUMA node the calling thread runs on
+static inline node const* ethash_full_local_data(ethash_full_t full)
+{
+	if (!full->replicated) {
+		return (node const*)full->data;
+	}
+	unsigned const n = ethash_numa_current_node();
+	if (n < ETHASH_NUMA_MAX_NODES && full->replicas[n].base) {
+		return (node const*)full->replicas[n].base;
+	}
+	return (node const*)full->data;
+}
+
 /**
  * Allocate and initialize a new ethash_full handler. Internal version.
  *
@@ -170,12 +556,309 @@ ethash_full_t ethash_full_new_internal(
 	ethash_callback_t callback
 );
 
+/**
+ * Allocate and initialize a new ethash_full handler, computing the DAG on
+ * several threads. Internal version.
+ *
+ * Same as @ref ethash_full_new_internal() but with @a num_threads workers.
+ * See @ref ethash_full_new_parallel() for the semantics of @a num_threads
+ * and @a callback.
+ */
+ethash_full_t ethash_full_new_parallel_internal(
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned num_threads,
+	ethash_callback_t callback
+);
+
+/**
+ * Same as @ref ethash_full_new_parallel_internal() with the DAG in memory of
+ * @a provider. Internal version of @ref ethash_full_new_with_provider().
+ */
+ethash_full_t ethash_full_new_provided_internal(
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned num_threads,
+	ethash_callback_t callback,
+	ethash_memory_provider_t const* provider
+);
+
+/**
+ * Map the complete DAG file of another process or an earlier run.
+ * Internal version of @ref ethash_full_attach().
+ *
+ * @param dirname        The directory holding the DAG file
+ * @param seed_hash      The seed hash of the DAG, used in the DAG file naming
+ * @param full_size      The size of the full data in bytes
+ * @return               Newly allocated ethash_full handler, or NULL if there is
+ *                       no valid complete DAG file
+ */
+ethash_full_t ethash_full_attach_internal(
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size
+);
+
+/**
+ * Compute a slice of a DAG into the shared directory of several hosts.
+ * Internal version of @ref ethash_full_generate_slice().
+ *
+ * @param slice_dirname  The directory all hosts share
+ * @param seed_hash      The seed hash of the DAG
+ * @param full_size      The size of the full data in bytes
+ * @param light          The light handler containing the cache
+ * @param rank           The index of the slice
+ * @param num_ranks      The number of slices the DAG is split into
+ * @param num_threads    The number of threads to compute the slice with, 0 for
+ *                       one per hardware thread
+ * @param callback       Same as for @ref ethash_full_new_parallel(), may be NULL
+ * @return               true if the slice file was written and false otherwise
+ */
+bool ethash_full_generate_slice_internal(
+	char const* slice_dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned rank,
+	unsigned num_ranks,
+	unsigned num_threads,
+	ethash_callback_t callback
+);
+
+/**
+ * Same as @ref ethash_autotune() with the tuning file kept in @a dirname, or
+ * in no file for NULL
+ */
+bool ethash_autotune_internal(
+	ethash_full_t full,
+	unsigned budget_ms,
+	char const* dirname,
+	ethash_tuning_t* tuning
+);
+
+/**
+ * Gather the slices of a DAG into a DAG file and load it.
+ * Internal version of @ref ethash_full_new_from_slices().
+ *
+ * @param dirname        The directory of the DAG file
+ * @param slice_dirname  The directory all hosts share
+ * @param seed_hash      The seed hash of the DAG
+ * @param full_size      The size of the full data in bytes
+ * @param light          The light handler containing the cache
+ * @param num_ranks      The number of slices the DAG is split into
+ * @param num_threads    The number of threads to checksum and load the DAG with,
+ *                       0 for one per hardware thread
+ * @return               Newly allocated ethash_full handler, or NULL if a slice
+ *                       is missing or does not check out
+ */
+ethash_full_t ethash_full_new_from_slices_internal(
+	char const* dirname,
+	char const* slice_dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned num_ranks,
+	unsigned num_threads
+);
+
+/**
+ * Allocate and initialize a new ethash_full handler without a DAG file.
+ * Internal version of @ref ethash_full_new_memory().
+ *
+ * @param full_size      The size of the full data in bytes.
+ * @param light          The light handler containing the cache.
+ * @param num_threads    The number of threads to generate the DAG with, 0 for
+ *                       one per hardware thread
+ * @param callback       Same as for @ref ethash_full_new_internal()
+ * @return               Newly allocated ethash_full handler or NULL in case of
+ *                       ERRNOMEM or invalid parameters used for @ref ethash_compute_full_data()
+ */
+ethash_full_t ethash_full_new_memory_internal(
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned num_threads,
+	ethash_callback_t callback
+);
+
+/**
+ * Allocate a DAG generated while it is used. Internal version of @ref ethash_full_new_lazy().
+ *
+ * @param full_size      The size of the full data in bytes.
+ * @param light          The light handler to generate the DAG from. It must stay
+ *                       alive until the handler is deleted.
+ * @param num_threads    The number of background threads, 0 for one per hardware thread
+ * @return               Newly allocated ethash_full handler or NULL in case of
+ *                       ERRNOMEM or an invalid @a full_size
+ */
+ethash_full_t ethash_full_new_lazy_internal(
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned num_threads
+);
+
+/**
+ * Allocate a new light cache registry. Internal version of @ref ethash_light_registry_new().
+ *
+ * @param capacity       The number of caches to keep
+ * @param cache_size     The cache size of every epoch, or 0 for the real ones
+ * @return               Newly allocated registry or NULL in case of ERRNOMEM
+ */
+ethash_light_registry_t ethash_light_registry_new_internal(unsigned capacity, uint64_t cache_size);
+
+/**
+ * Allocate a new chain sync verifier. Internal version of @ref ethash_sync_verifier_new().
+ *
+ * @param lookahead      Same as for @ref ethash_sync_verifier_new()
+ * @param num_threads    Same as for @ref ethash_sync_verifier_new()
+ * @param cache_size     The cache size of every epoch, or 0 for the real ones
+ * @param full_size      The DAG size of every epoch, or 0 for the real ones
+ * @return               Newly allocated verifier or NULL in case of ERRNOMEM
+ */
+ethash_sync_verifier_t ethash_sync_verifier_new_internal(
+	unsigned lookahead,
+	unsigned num_threads,
+	uint64_t cache_size,
+	uint64_t full_size
+);
+
+/**
+ * Allocate a new epoch manager. Internal version of @ref ethash_epoch_manager_new().
+ *
+ * @param dirname          The directory in which to put the DAG files, or NULL
+ *                         to keep the DAGs in memory only
+ * @param prefetch_blocks  Same as for @ref ethash_epoch_manager_new()
+ * @param num_threads      Same as for @ref ethash_epoch_manager_new()
+ * @param cache_size       The cache size of every epoch, or 0 for the real ones
+ * @param full_size        The DAG size of every epoch, or 0 for the real ones
+ * @param callback         Same as for @ref ethash_epoch_manager_new()
+ * @return                 Newly allocated manager or NULL in case of ERRNOMEM
+ */
+ethash_epoch_manager_t ethash_epoch_manager_new_internal(
+	char const* dirname,
+	uint64_t prefetch_blocks,
+	unsigned num_threads,
+	uint64_t cache_size,
+	uint64_t full_size,
+	ethash_callback_t callback
+);
+
+/**
+ * Start allocating and initializing a new ethash_full handler in the
+ * background. Internal version of @ref ethash_full_new_async().
+ *
+ * @param dirname        The directory in which to put the DAG file, or NULL to
+ *                       keep the DAG in memory only
+ * @param seed_hash      The seed hash of the block. Used in the DAG file naming.
+ * @param full_size      The size of the full data in bytes.
+ * @param light          The light handler containing the cache
+ * @param num_threads    The number of threads to generate the DAG with, 0 for
+ *                       one per hardware thread
+ * @param callback       Same as for @ref ethash_full_new_internal()
+ * @return               A future, see @ref ethash_full_new_async()
+ */
+ethash_full_future_t ethash_full_new_async_internal(
+	char const* dirname,
+	ethash_h256_t const seed_hash,
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned num_threads,
+	ethash_callback_t callback
+);
+
+/**
+ * Start generating the DAG of a seed package in the background. Internal
+ * version of @ref ethash_full_import_seed_package_async(), taking any cache
+ * and DAG sizes.
+ *
+ * @param path           The path of the package file
+ * @param dirname        The directory in which to put the light cache and DAG
+ *                       files, or NULL to keep the DAG in memory only
+ * @param num_threads    The number of threads to generate the DAG with, 0 for
+ *                       one per hardware thread
+ * @param callback       Same as for @ref ethash_full_new_internal()
+ * @return               A future, see @ref ethash_full_import_seed_package_async()
+ */
+ethash_full_future_t ethash_full_import_seed_package_async_internal(
+	char const* path,
+	char const* dirname,
+	unsigned num_threads,
+	ethash_callback_t callback
+);
+
 void ethash_calculate_dag_item(
 	node* const ret,
 	uint32_t node_index,
 	ethash_light_t const cache
 );
 
+/**
+ * Calculate the consecutive DAG items first_index, ..., first_index + count - 1
+ *
+ * Gives the same results as calling @ref ethash_calculate_dag_item() for each
+ * of them, but hashes as many items at a time as the multi-buffer Keccak
+ * kernel of the host allows.
+ *
+ * @param ret            Buffer of at least @a count nodes for the results
+ * @param first_index    The index of the first DAG item
+ * @param count          The number of DAG items to compute
+ * @param light          The light client handler
+ */
+void ethash_calculate_dag_items(
+	node* ret,
+	uint32_t first_index,
+	uint32_t count,
+	ethash_light_t const light
+);
+
+/**
+ * Calculate the DAG items at @a indices, which need not be consecutive
+ *
+ * All the parent reads of a round of every item are prefetched before any
+ * of them is mixed in, so the items of several light hashes can share the
+ * wait for the cache.
+ *
+ * @param ret            Buffer of at least @a count nodes for the results
+ * @param indices        The index of each DAG item
+ * @param count          The number of DAG items to compute
+ * @param light          The light client handler
+ */
+void ethash_calculate_dag_items_at(
+	node* ret,
+	uint32_t const* indices,
+	uint32_t count,
+	ethash_light_t const light
+);
+
+/**
+ * Clear the hits of the targets of a multi-boundary search
+ *
+ * @return               Whether any target has room for hits, see @ref ethash_search_targets_open()
+ */
+bool ethash_search_targets_reset(ethash_search_target_t* targets, size_t num_targets);
+
+/**
+ * Tell whether any target of a multi-boundary search has room for more hits
+ */
+bool ethash_search_targets_open(ethash_search_target_t const* targets, size_t num_targets);
+
+/**
+ * Record the hashes of @a count consecutive nonces in the targets they meet
+ *
+ * @return               The number of nonces taken, fewer than @a count if the
+ *                       last target became full before the end
+ */
+unsigned ethash_search_targets_record(
+	ethash_search_target_t* targets,
+	size_t num_targets,
+	uint64_t const* nonces,
+	ethash_return_value_t const* results,
+	unsigned count
+);
+
 void ethash_quick_hash(
 	ethash_h256_t* return_hash,
 	ethash_h256_t const* header_hash,
@@ -183,9 +866,50 @@ void ethash_quick_hash(
 	ethash_h256_t const* mix_hash
 );
 
+/// Number of epochs covered by the cache and DAG size tables of data_sizes.h
+#define ETHASH_TABULATED_EPOCHS 2048
+
+/**
+ * Get the DAG and cache sizes of Ethereum at a block
+ *
+ * The epochs past the tables of data_sizes.h are computed with the prime
+ * search of @ref ethash_chain_new() on first use and remembered.
+ *
+ * @return               The size in bytes, 0 from epoch ETHASH_MAX_EPOCHS on
+ */
 uint64_t ethash_get_datasize(uint64_t const block_number);
 uint64_t ethash_get_cachesize(uint64_t const block_number);
 
+/**
+ * Compute the sizes of an Ethereum epoch past the tables of data_sizes.h.
+ * Both are 0 from epoch ETHASH_MAX_EPOCHS on.
+ */
+void ethash_ethereum_sizes(uint64_t epoch, uint64_t* cache_size, uint64_t* full_size);
+
+/// The DAG size of @a light, the one of its chain or of Ethereum at its block
+static inline uint64_t ethash_light_full_size(ethash_light_t light)
+{
+	return light->full_size ? light->full_size : ethash_get_datasize(light->block_number);
+}
+
+/// The seedhash of @a light, the one of its chain or of Ethereum at its block
+static inline ethash_h256_t ethash_light_seedhash(ethash_light_t light)
+{
+	return light->full_size ? light->seedhash : ethash_get_seedhash(light->block_number);
+}
+
+/// The blocks per ProgPoW program of the chain of @a light
+static inline uint64_t ethash_light_progpow_period(ethash_light_t light)
+{
+	return light->progpow_period ? light->progpow_period : PROGPOW_PERIOD;
+}
+
+/// The blocks per ProgPoW program of the chain of @a full
+static inline uint64_t ethash_full_progpow_period(ethash_full_t full)
+{
+	return full->progpow_period ? full->progpow_period : PROGPOW_PERIOD;
+}
+
 /**
  * Compute the memory data for a full node's memory
  *
@@ -202,6 +926,36 @@ bool ethash_compute_full_data(
 	ethash_callback_t callback
 );
 
+/**
+ * Compute the memory data for a full node's memory using several threads
+ *
+ * The node range is split in chunks which are claimed by the workers, the
+ * calling thread being one of them. The callback is never invoked concurrently
+ * and sees monotonically increasing progress values.
+ *
+ * @param mem          A pointer to an ethash full's memory
+ * @param full_size    The size of the full data in bytes
+ * @param cache        A cache object to use in the calculation
+ * @param num_threads  The number of threads to use. 0 means one per hardware thread
+ * @param callback     The callback function. Check @ref ethash_full_new() for details.
+ * @return             true if all went fine and false for invalid parameters
+ *                     or if the callback requested cancellation
+ */
+bool ethash_compute_full_data_parallel(
+	void* mem,
+	uint64_t full_size,
+	ethash_light_t const light,
+	unsigned num_threads,
+	ethash_callback_t callback
+);
+
+/**
+ * Apply the limits of @ref ethash_set_dag_keep_epochs() and
+ * @ref ethash_set_dag_disk_budget() to a DAG directory, if any, once the DAG
+ * file of @a seedhash has been generated in it
+ */
+void ethash_dag_dir_generated(char const* dirname, ethash_h256_t const seedhash);
+
 #ifdef __cplusplus
 }
 #endif
@@ -19,10 +19,104 @@
  * @date 2015
  */
 #include "io.h"
+#include "sha3.h"
+#include "stats.h"
+#include "probes.h"
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
 
+// Check that an open DAG file is complete, closing it if it is not
+static enum ethash_io_rc ethash_io_check_dag(FILE* f, char const* filename, ethash_h256_t const seedhash, uint64_t file_size)
+{
+	size_t found_size;
+	if (!ethash_file_size(f, &found_size)) {
+		fclose(f);
+		ETHASH_CRITICAL("Could not query size of DAG file: \"%s\"", filename);
+		return ETHASH_IO_FAIL;
+	}
+	if (found_size != ethash_io_dag_file_size(file_size)) {
+		fclose(f);
+		return ETHASH_IO_MEMO_SIZE_MISMATCH;
+	}
+	// a stale or unfinished file is told apart by the header alone
+	if (ethash_io_read_dag_header(f, seedhash, file_size, NULL) != ETHASH_IO_DAG_COMPLETE) {
+		fclose(f);
+		return ETHASH_IO_MEMO_SIZE_MISMATCH;
+	}
+	return ETHASH_IO_MEMO_MATCH;
+}
+
+bool ethash_io_write_dag_header(
+	FILE* f,
+	ethash_h256_t const seedhash,
+	uint64_t file_size,
+	ethash_h256_t const* checksums
+)
+{
+	union {
+		struct ethash_io_dag_header header;
+		uint8_t bytes[ETHASH_DAG_HEADER_SIZE];
+	} page;
+	memset(&page, 0, sizeof(page));
+	page.header.magic_num = ETHASH_DAG_MAGIC_NUM;
+	page.header.version = ETHASH_DAG_HEADER_VERSION;
+	page.header.revision = ETHASH_REVISION;
+	page.header.endian_check = ETHASH_DAG_ENDIAN_CHECK;
+	page.header.dataset_parents = ETHASH_DATASET_PARENTS;
+	page.header.node_bytes = ETHASH_HASH_BYTES;
+	page.header.header_size = ETHASH_DAG_HEADER_SIZE;
+	if (!ethash_get_epoch_from_seedhash(seedhash, &page.header.epoch)) {
+		page.header.epoch = ETHASH_EVENT_NO_EPOCH;
+	}
+	page.header.file_size = file_size;
+	page.header.seed_hash = seedhash;
+	page.header.checksum_count = ethash_io_dag_checksum_count(file_size);
+	if (checksums) {
+		page.header.complete = 1;
+		SHA3_256(
+			&page.header.checksums_hash,
+			(uint8_t const*)checksums,
+			page.header.checksum_count * sizeof(ethash_h256_t)
+		);
+	}
+	return
+		ethash_fseek(f, 0, SEEK_SET) == 0 &&
+		fwrite(&page, sizeof(page), 1, f) == 1 &&
+		fflush(f) == 0;
+}
+
+enum ethash_io_dag_state ethash_io_read_dag_header(
+	FILE* f,
+	ethash_h256_t const seedhash,
+	uint64_t file_size,
+	struct ethash_io_dag_header* header
+)
+{
+	struct ethash_io_dag_header found;
+	if (ethash_fseek(f, 0, SEEK_SET) != 0 ||
+		fread(&found, sizeof(found), 1, f) != 1 ||
+		ethash_fseek(f, ETHASH_DAG_HEADER_SIZE, SEEK_SET) != 0) {
+		return ETHASH_IO_DAG_INVALID;
+	}
+	if (header) {
+		*header = found;
+	}
+	if (found.magic_num != ETHASH_DAG_MAGIC_NUM ||
+		found.version != ETHASH_DAG_HEADER_VERSION ||
+		found.revision != ETHASH_REVISION ||
+		found.endian_check != ETHASH_DAG_ENDIAN_CHECK ||
+		found.dataset_parents != ETHASH_DATASET_PARENTS ||
+		found.node_bytes != ETHASH_HASH_BYTES ||
+		found.header_size != ETHASH_DAG_HEADER_SIZE ||
+		found.file_size != file_size ||
+		found.checksum_count != ethash_io_dag_checksum_count(file_size) ||
+		memcmp(&found.seed_hash, &seedhash, sizeof(seedhash)) != 0) {
+		return ETHASH_IO_DAG_INVALID;
+	}
+	return found.complete ? ETHASH_IO_DAG_COMPLETE : ETHASH_IO_DAG_UNFINISHED;
+}
+
 enum ethash_io_rc ethash_io_prepare(
 	char const* dirname,
 	ethash_h256_t const seedhash,
@@ -33,6 +127,7 @@ enum ethash_io_rc ethash_io_prepare(
 {
 	char mutable_name[DAG_MUTABLE_NAME_MAX_SIZE];
 	enum ethash_io_rc ret = ETHASH_IO_FAIL;
+	ETHASH_PROBE2(io_prepare__start, dirname, file_size);
 	// reset errno before io calls
 	errno = 0;
 
@@ -54,56 +149,44 @@ enum ethash_io_rc ethash_io_prepare(
 		// try to open the file
 		f = ethash_fopen(tmpfile, "rb+");
 		if (f) {
-			size_t found_size;
-			if (!ethash_file_size(f, &found_size)) {
-				fclose(f);
-				ETHASH_CRITICAL("Could not query size of DAG file: \"%s\"", tmpfile);
-				goto free_memo;
-			}
-			if (file_size != found_size - ETHASH_DAG_MAGIC_NUM_SIZE) {
-				fclose(f);
-				ret = ETHASH_IO_MEMO_SIZE_MISMATCH;
-				goto free_memo;
-			}
-			// compare the magic number, no need to care about endianess since it's local
-			uint64_t magic_num;
-			if (fread(&magic_num, ETHASH_DAG_MAGIC_NUM_SIZE, 1, f) != 1) {
-				// I/O error
-				fclose(f);
-				ETHASH_CRITICAL("Could not read from DAG file: \"%s\"", tmpfile);
-				ret = ETHASH_IO_MEMO_SIZE_MISMATCH;
-				goto free_memo;
-			}
-			if (magic_num != ETHASH_DAG_MAGIC_NUM) {
-				fclose(f);
-				ret = ETHASH_IO_MEMO_SIZE_MISMATCH;
-				goto free_memo;
+			ret = ethash_io_check_dag(f, tmpfile, seedhash, file_size);
+			ETHASH_PROBE1(io_prepare__found, ret);
+			if (ret == ETHASH_IO_MEMO_MATCH) {
+				goto set_file;
 			}
-			ret = ETHASH_IO_MEMO_MATCH;
-			goto set_file;
+			goto free_memo;
 		}
 	}
 	
 	// file does not exist, will need to be created
+	ETHASH_PROBE1(io_prepare__create, tmpfile);
 	f = ethash_fopen(tmpfile, "wb+");
 	if (!f) {
 		ETHASH_CRITICAL("Could not create DAG file: \"%s\"", tmpfile);
 		goto free_memo;
 	}
-	// make sure it's of the proper size
-	if (ethash_fseek(f, file_size + ETHASH_DAG_MAGIC_NUM_SIZE - 1, SEEK_SET) != 0) {
-		fclose(f);
-		ETHASH_CRITICAL("Could not seek to the end of DAG file: \"%s\". Insufficient space?", tmpfile);
-		goto free_memo;
+	// make sure it's of the proper size, in one allocation where supported
+	uint64_t const dag_file_size = ethash_io_dag_file_size(file_size);
+	if (!ethash_io_preallocate(f, dag_file_size)) {
+		if (ethash_fseek(f, dag_file_size - 1, SEEK_SET) != 0) {
+			fclose(f);
+			ETHASH_CRITICAL("Could not seek to the end of DAG file: \"%s\". Insufficient space?", tmpfile);
+			goto free_memo;
+		}
+		if (fputc('\n', f) == EOF) {
+			fclose(f);
+			ETHASH_CRITICAL("Could not write in the end of DAG file: \"%s\". Insufficient space?", tmpfile);
+			goto free_memo;
+		}
 	}
-	if (fputc('\n', f) == EOF) {
+	if (fflush(f) != 0) {
 		fclose(f);
-		ETHASH_CRITICAL("Could not write in the end of DAG file: \"%s\". Insufficient space?", tmpfile);
+		ETHASH_CRITICAL("Could not flush at end of DAG file: \"%s\". Insufficient space?", tmpfile);
 		goto free_memo;
 	}
-	if (fflush(f) != 0) {
+	if (!ethash_io_write_dag_header(f, seedhash, file_size, NULL)) {
 		fclose(f);
-		ETHASH_CRITICAL("Could not flush at end of DAG file: \"%s\". Insufficient space?", tmpfile);
+		ETHASH_CRITICAL("Could not write the header of DAG file: \"%s\". Insufficient space?", tmpfile);
 		goto free_memo;
 	}
 	ret = ETHASH_IO_MEMO_MISMATCH;
@@ -115,5 +198,425 @@ set_file:
 free_memo:
 	free(tmpfile);
 end:
+	ETHASH_PROBE1(io_prepare__done, ret);
+	return ret;
+}
+
+FILE* ethash_io_open_dag(char const* dirname, ethash_h256_t const seedhash, uint64_t file_size)
+{
+	char mutable_name[DAG_MUTABLE_NAME_MAX_SIZE];
+	ethash_io_mutable_name(ETHASH_REVISION, &seedhash, mutable_name);
+	char* filename = ethash_io_create_filename(dirname, mutable_name, strlen(mutable_name));
+	if (!filename) {
+		return NULL;
+	}
+	FILE* f = ethash_fopen(filename, "rb");
+	if (f && ethash_io_check_dag(f, filename, seedhash, file_size) != ETHASH_IO_MEMO_MATCH) {
+		f = NULL;
+	}
+	free(filename);
+	return f;
+}
+
+bool ethash_io_read_checksums(FILE* f, uint64_t file_size, ethash_h256_t* checksums)
+{
+	uint32_t const count = ethash_io_dag_checksum_count(file_size);
+	struct ethash_io_dag_header header;
+	if (ethash_fseek(f, 0, SEEK_SET) != 0 ||
+		fread(&header, sizeof(header), 1, f) != 1 ||
+		ethash_fseek(f, (size_t)(ETHASH_DAG_HEADER_SIZE + file_size), SEEK_SET) != 0 ||
+		fread(checksums, sizeof(ethash_h256_t), count, f) != count) {
+		return false;
+	}
+	ethash_h256_t hash;
+	SHA3_256(&hash, (uint8_t const*)checksums, count * sizeof(ethash_h256_t));
+	return memcmp(&hash, &header.checksums_hash, sizeof(hash)) == 0;
+}
+
+bool ethash_io_write_checksums(FILE* f, uint64_t file_size, ethash_h256_t const* checksums)
+{
+	uint32_t const count = ethash_io_dag_checksum_count(file_size);
+	return
+		ethash_fseek(f, (size_t)(ETHASH_DAG_HEADER_SIZE + file_size), SEEK_SET) == 0 &&
+		fwrite(checksums, sizeof(ethash_h256_t), count, f) == count &&
+		fflush(f) == 0;
+}
+
+// Move a completely written temporary file over its final name
+static bool ethash_io_replace(char const* tmpfile, char const* filename)
+{
+#if defined(_WIN32)
+	// rename() does not replace existing files on Windows
+	remove(filename);
+#endif
+	if (rename(tmpfile, filename) != 0) {
+		remove(tmpfile);
+		return false;
+	}
+	return true;
+}
+
+struct ethash_io_checkpoint {
+	uint64_t magic_num;
+	uint64_t file_size;
+	uint64_t nodes;
+};
+
+// The name of the checkpoint file of a DAG, plus @a suffix. User must deallocate.
+static char* ethash_io_checkpoint_filename(char const* dirname, ethash_h256_t const* seedhash, char const* suffix)
+{
+	char mutable_name[DAG_MUTABLE_NAME_MAX_SIZE + 16];
+	ethash_io_mutable_name(ETHASH_REVISION, seedhash, mutable_name);
+	if (!ethash_strncat(mutable_name, sizeof(mutable_name), ".checkpoint", 11) ||
+		!ethash_strncat(mutable_name, sizeof(mutable_name), suffix, strlen(suffix))) {
+		return NULL;
+	}
+	return ethash_io_create_filename(dirname, mutable_name, strlen(mutable_name));
+}
+
+bool ethash_io_write_checkpoint(
+	char const* dirname,
+	ethash_h256_t const seedhash,
+	uint64_t file_size,
+	uint32_t nodes
+)
+{
+	bool ret = false;
+	char* filename = ethash_io_checkpoint_filename(dirname, &seedhash, "");
+	char* tmpfile = ethash_io_checkpoint_filename(dirname, &seedhash, ".tmp");
+	if (!filename || !tmpfile) {
+		goto free_names;
+	}
+	FILE* f = ethash_fopen(tmpfile, "wb");
+	if (!f) {
+		goto free_names;
+	}
+	struct ethash_io_checkpoint const checkpoint = { ETHASH_DAG_CHECKPOINT_MAGIC_NUM, file_size, nodes };
+	bool const written = fwrite(&checkpoint, sizeof(checkpoint), 1, f) == 1;
+	if (fclose(f) != 0 || !written) {
+		remove(tmpfile);
+		goto free_names;
+	}
+	ret = ethash_io_replace(tmpfile, filename);
+free_names:
+	free(tmpfile);
+	free(filename);
+	return ret;
+}
+
+FILE* ethash_io_open_checkpoint(
+	char const* dirname,
+	ethash_h256_t const seedhash,
+	uint64_t file_size,
+	uint32_t* nodes
+)
+{
+	char* filename = ethash_io_checkpoint_filename(dirname, &seedhash, "");
+	if (!filename) {
+		return NULL;
+	}
+	FILE* f = ethash_fopen(filename, "rb");
+	free(filename);
+	if (!f) {
+		return NULL;
+	}
+	struct ethash_io_checkpoint checkpoint;
+	bool const read = fread(&checkpoint, sizeof(checkpoint), 1, f) == 1;
+	fclose(f);
+	if (!read ||
+		checkpoint.magic_num != ETHASH_DAG_CHECKPOINT_MAGIC_NUM ||
+		checkpoint.file_size != file_size ||
+		checkpoint.nodes > file_size / ETHASH_HASH_BYTES) {
+		return NULL;
+	}
+
+	char mutable_name[DAG_MUTABLE_NAME_MAX_SIZE];
+	ethash_io_mutable_name(ETHASH_REVISION, &seedhash, mutable_name);
+	filename = ethash_io_create_filename(dirname, mutable_name, strlen(mutable_name));
+	if (!filename) {
+		return NULL;
+	}
+	f = ethash_fopen(filename, "rb+");
+	free(filename);
+	size_t found_size;
+	if (!f) {
+		return NULL;
+	}
+	if (!ethash_file_size(f, &found_size) || found_size != ethash_io_dag_file_size(file_size) ||
+		ethash_io_read_dag_header(f, seedhash, file_size, NULL) != ETHASH_IO_DAG_UNFINISHED) {
+		fclose(f);
+		return NULL;
+	}
+	*nodes = (uint32_t)checkpoint.nodes;
+	return f;
+}
+
+void ethash_io_remove_checkpoint(char const* dirname, ethash_h256_t const seedhash)
+{
+	char* filename = ethash_io_checkpoint_filename(dirname, &seedhash, "");
+	if (filename) {
+		remove(filename);
+		free(filename);
+	}
+}
+
+struct ethash_io_slice {
+	uint64_t magic_num;
+	uint64_t file_size;
+	uint64_t first;
+	uint64_t nodes;
+	ethash_h256_t checksum;
+};
+
+// The name of the file of a DAG slice, plus @a suffix. User must deallocate.
+static char* ethash_io_slice_filename(
+	char const* dirname,
+	ethash_h256_t const* seedhash,
+	unsigned rank,
+	unsigned num_ranks,
+	char const* suffix
+)
+{
+	char mutable_name[DAG_MUTABLE_NAME_MAX_SIZE + 48];
+	ethash_io_mutable_name(ETHASH_REVISION, seedhash, mutable_name);
+	size_t const length = strlen(mutable_name);
+	int const n = snprintf(
+		mutable_name + length, sizeof(mutable_name) - length, ".slice-%u-of-%u%s", rank, num_ranks, suffix
+	);
+	if (n < 0 || (size_t)n >= sizeof(mutable_name) - length) {
+		return NULL;
+	}
+	return ethash_io_create_filename(dirname, mutable_name, strlen(mutable_name));
+}
+
+bool ethash_io_write_slice(
+	char const* dirname,
+	ethash_h256_t const seedhash,
+	uint64_t file_size,
+	unsigned rank,
+	unsigned num_ranks,
+	uint32_t first,
+	uint32_t nodes,
+	ethash_h256_t const* checksum,
+	void const* data
+)
+{
+	bool ret = false;
+	if (!ethash_mkdir(dirname)) {
+		ETHASH_CRITICAL("Could not create the DAG slice directory");
+		return false;
+	}
+	char* filename = ethash_io_slice_filename(dirname, &seedhash, rank, num_ranks, "");
+	char* tmpfile = ethash_io_slice_filename(dirname, &seedhash, rank, num_ranks, ".tmp");
+	if (!filename || !tmpfile) {
+		ETHASH_CRITICAL("Could not create the DAG slice pathname");
+		goto free_names;
+	}
+	FILE* f = ethash_fopen(tmpfile, "wb");
+	if (!f) {
+		ETHASH_CRITICAL("Could not create DAG slice file: \"%s\"", tmpfile);
+		goto free_names;
+	}
+	struct ethash_io_slice const slice = { ETHASH_DAG_SLICE_MAGIC_NUM, file_size, first, nodes, *checksum };
+	size_t const size = (size_t)nodes * ETHASH_HASH_BYTES;
+	bool const written = fwrite(&slice, sizeof(slice), 1, f) == 1 &&
+		(size == 0 || fwrite(data, size, 1, f) == 1);
+	if (written) {
+		ethash_stats_add(ETHASH_STAT_WRITTEN_BYTES, sizeof(slice) + size);
+	}
+	if (fclose(f) != 0 || !written) {
+		ETHASH_CRITICAL("Could not write DAG slice file: \"%s\". Insufficient space?", tmpfile);
+		remove(tmpfile);
+		goto free_names;
+	}
+	ret = ethash_io_replace(tmpfile, filename);
+free_names:
+	free(tmpfile);
+	free(filename);
+	return ret;
+}
+
+FILE* ethash_io_open_slice(
+	char const* dirname,
+	ethash_h256_t const seedhash,
+	uint64_t file_size,
+	unsigned rank,
+	unsigned num_ranks,
+	uint32_t first,
+	uint32_t nodes,
+	ethash_h256_t* checksum
+)
+{
+	char* filename = ethash_io_slice_filename(dirname, &seedhash, rank, num_ranks, "");
+	if (!filename) {
+		return NULL;
+	}
+	FILE* f = ethash_fopen(filename, "rb");
+	free(filename);
+	if (!f) {
+		return NULL;
+	}
+	size_t found_size;
+	struct ethash_io_slice slice;
+	if (!ethash_file_size(f, &found_size) ||
+		found_size != sizeof(slice) + (uint64_t)nodes * ETHASH_HASH_BYTES ||
+		fread(&slice, sizeof(slice), 1, f) != 1 ||
+		slice.magic_num != ETHASH_DAG_SLICE_MAGIC_NUM ||
+		slice.file_size != file_size ||
+		slice.first != first ||
+		slice.nodes != nodes) {
+		fclose(f);
+		return NULL;
+	}
+	*checksum = slice.checksum;
+	return f;
+}
+
+bool ethash_io_write_seed_package(char const* path, struct ethash_io_seed_package const* header, void const* cache)
+{
+	bool ret = false;
+	size_t const length = strlen(path);
+	char* tmpfile = malloc(length + 5);
+	if (!tmpfile) {
+		return false;
+	}
+	memcpy(tmpfile, path, length);
+	memcpy(tmpfile + length, ".tmp", 5);
+	FILE* f = ethash_fopen(tmpfile, "wb");
+	if (!f) {
+		ETHASH_CRITICAL("Could not create seed package file: \"%s\"", tmpfile);
+		goto free_name;
+	}
+	struct ethash_io_seed_package package = *header;
+	package.magic_num = ETHASH_SEED_PACKAGE_MAGIC_NUM;
+	package.revision = ETHASH_REVISION;
+	bool const written = fwrite(&package, sizeof(package), 1, f) == 1 &&
+		fwrite(cache, (size_t)package.cache_size, 1, f) == 1;
+	if (written) {
+		ethash_stats_add(ETHASH_STAT_WRITTEN_BYTES, sizeof(package) + package.cache_size);
+	}
+	if (fclose(f) != 0 || !written) {
+		ETHASH_CRITICAL("Could not write seed package file: \"%s\". Insufficient space?", tmpfile);
+		remove(tmpfile);
+		goto free_name;
+	}
+	ret = ethash_io_replace(tmpfile, path);
+free_name:
+	free(tmpfile);
+	return ret;
+}
+
+FILE* ethash_io_open_seed_package(char const* path, struct ethash_io_seed_package* header)
+{
+	FILE* f = ethash_fopen(path, "rb");
+	if (!f) {
+		return NULL;
+	}
+	size_t found_size;
+	if (!ethash_file_size(f, &found_size) ||
+		found_size < sizeof(*header) ||
+		fread(header, sizeof(*header), 1, f) != 1 ||
+		header->magic_num != ETHASH_SEED_PACKAGE_MAGIC_NUM ||
+		header->revision != ETHASH_REVISION ||
+		header->cache_size == 0 ||
+		header->cache_size % ETHASH_HASH_BYTES != 0 ||
+		header->full_size == 0 ||
+		header->full_size % ETHASH_MIX_BYTES != 0 ||
+		found_size - sizeof(*header) != header->cache_size) {
+		fclose(f);
+		return NULL;
+	}
+	return f;
+}
+
+FILE* ethash_io_open_cache(
+	char const* dirname,
+	ethash_h256_t const seedhash,
+	uint64_t cache_size,
+	ethash_h256_t* checksum
+)
+{
+	char mutable_name[CACHE_MUTABLE_NAME_MAX_SIZE];
+	ethash_io_cache_name(ETHASH_REVISION, &seedhash, mutable_name);
+	char* filename = ethash_io_create_filename(dirname, mutable_name, strlen(mutable_name));
+	if (!filename) {
+		return NULL;
+	}
+	FILE* f = ethash_fopen(filename, "rb");
+	free(filename);
+	if (!f) {
+		return NULL;
+	}
+	size_t found_size;
+	struct ethash_io_cache_header header;
+	// files of older libraries only hold the magic number, their zero seedhash never matches
+	if (!ethash_file_size(f, &found_size) ||
+		found_size != cache_size + ETHASH_CACHE_HEADER_SIZE ||
+		fread(&header, sizeof(header), 1, f) != 1 ||
+		header.magic_num != ETHASH_CACHE_MAGIC_NUM ||
+		memcmp(&header.seed_hash, &seedhash, sizeof(seedhash)) != 0 ||
+		ethash_fseek(f, ETHASH_CACHE_HEADER_SIZE, SEEK_SET) != 0) {
+		fclose(f);
+		return NULL;
+	}
+	*checksum = header.checksum;
+	return f;
+}
+
+bool ethash_io_write_cache(
+	char const* dirname,
+	ethash_h256_t const seedhash,
+	void const* cache,
+	uint64_t cache_size
+)
+{
+	char mutable_name[CACHE_MUTABLE_NAME_MAX_SIZE + 4];
+	bool ret = false;
+	if (!ethash_mkdir(dirname)) {
+		ETHASH_CRITICAL("Could not create the ethash directory");
+		return false;
+	}
+	ethash_io_cache_name(ETHASH_REVISION, &seedhash, mutable_name);
+	char* filename = ethash_io_create_filename(dirname, mutable_name, strlen(mutable_name));
+	ethash_strncat(mutable_name, sizeof(mutable_name), ".tmp", 4);
+	char* tmpfile = ethash_io_create_filename(dirname, mutable_name, strlen(mutable_name));
+	if (!filename || !tmpfile) {
+		ETHASH_CRITICAL("Could not create the light cache pathname");
+		goto free_names;
+	}
+	FILE* f = ethash_fopen(tmpfile, "wb");
+	if (!f) {
+		ETHASH_CRITICAL("Could not create light cache file: \"%s\"", tmpfile);
+		goto free_names;
+	}
+	uint8_t header[ETHASH_CACHE_HEADER_SIZE] = { 0 };
+	struct ethash_io_cache_header fields;
+	memset(&fields, 0, sizeof(fields));
+	fields.magic_num = ETHASH_CACHE_MAGIC_NUM;
+	fields.seed_hash = seedhash;
+	SHA3_256(&fields.checksum, (uint8_t const*)cache, (size_t)cache_size);
+	memcpy(header, &fields, sizeof(fields));
+	// synced before the rename, or a crash could leave the final name on data never written out,
+	// kept in memory as it is usually loaded right away
+	bool const written = fwrite(header, sizeof(header), 1, f) == 1 &&
+		fwrite(cache, (size_t)cache_size, 1, f) == 1 &&
+		fflush(f) == 0 &&
+		ethash_io_sync(f, 0, 0);
+	if (written) {
+		ethash_stats_add(ETHASH_STAT_WRITTEN_BYTES, ETHASH_CACHE_HEADER_SIZE + cache_size);
+	}
+	if (fclose(f) != 0 || !written) {
+		ETHASH_CRITICAL("Could not write light cache file: \"%s\". Insufficient space?", tmpfile);
+		remove(tmpfile);
+		goto free_names;
+	}
+	if (!ethash_io_replace(tmpfile, filename)) {
+		ETHASH_CRITICAL("Could not rename light cache file: \"%s\"", tmpfile);
+		goto free_names;
+	}
+	ret = true;
+free_names:
+	free(tmpfile);
+	free(filename);
 	return ret;
 }
@@ -33,13 +33,19 @@
 #ifdef __cplusplus
 extern "C" {
 #endif
+// The start of DAG file names. Files of the original layout, without header
+// and trailer, are named "full-R" in the same directory; other programs still
+// read those, so they are neither opened nor removed here.
+#define ETHASH_DAG_FILE_PREFIX "dag-R"
 // Maximum size for mutable part of DAG file name
-// 6 is for "full-R", the suffix of the filename
+// 5 is for "dag-R", the suffix of the filename
 // 10 is for maximum number of digits of a uint32_t (for REVISION)
 // 1 is for - and 16 is for the first 16 hex digits for first 8 bytes of
 // the seedhash and last 1 is for the null terminating character
 // Reference: https://github.com/ethereum/wiki/wiki/Ethash-DAG
-#define DAG_MUTABLE_NAME_MAX_SIZE (6 + 10 + 1 + 16 + 1)
+#define DAG_MUTABLE_NAME_MAX_SIZE (5 + 10 + 1 + 16 + 1)
+// Same for the light cache files, with 7 for "cache-R"
+#define CACHE_MUTABLE_NAME_MAX_SIZE (7 + 10 + 1 + 16 + 1)
 /// Possible return values of @see ethash_io_prepare
 enum ethash_io_rc {
 	ETHASH_IO_FAIL = 0,           ///< There has been an IO failure
@@ -86,7 +92,8 @@ enum ethash_io_rc {
  *                           In the case of memo match then the file is open on read
  *                           mode, while on the case of mismatch a new file is created
  *                           on write mode
- * @param[in] file_size      The size that the DAG file should have on disk
+ * @param[in] file_size      The size of the DAG. The file on disk has the size
+ *                           given by @ref ethash_io_dag_file_size()
  * @param[out] force_create  If true then there is no check to see if the file
  *                           already exists
  * @return                   For possible return values @see enum ethash_io_rc
@@ -99,6 +106,314 @@ enum ethash_io_rc ethash_io_prepare(
 	bool force_create
 );
 
+/**
+ * Open the DAG file for a seedhash if it is complete, without creating anything
+ *
+ * @param[in] dirname        The path of the ethash data directory
+ * @param[in] seedhash       The seedhash of the DAG, used in the naming of the file
+ * @param[in] file_size      The size of the DAG, without the magic number
+ * @return                   The file opened for reading, positioned after the
+ *                           header, or NULL if there is no file of the
+ *                           right size with the magic number. User is
+ *                           responsible for closing it.
+ */
+FILE* ethash_io_open_dag(char const* dirname, ethash_h256_t const seedhash, uint64_t file_size);
+
+/**
+ * Get the number of checksums in the trailer of a DAG file
+ *
+ * DAG files hold a struct ethash_io_dag_header zero padded to
+ * ETHASH_DAG_HEADER_SIZE bytes, the DAG and then a trailer with the SHA3-256 of every
+ * ETHASH_DAG_CHECKSUM_BYTES of the DAG, the last one covering what is left.
+ */
+static inline uint32_t ethash_io_dag_checksum_count(uint64_t file_size)
+{
+	return (uint32_t)((file_size + ETHASH_DAG_CHECKSUM_BYTES - 1) / ETHASH_DAG_CHECKSUM_BYTES);
+}
+
+/**
+ * Get the size on disk of a DAG file for a DAG of @a file_size bytes
+ */
+static inline uint64_t ethash_io_dag_file_size(uint64_t file_size)
+{
+	return ETHASH_DAG_HEADER_SIZE + file_size +
+		(uint64_t)ethash_io_dag_checksum_count(file_size) * sizeof(ethash_h256_t);
+}
+
+/// Version of the layout of DAG files, see struct ethash_io_dag_header
+#define ETHASH_DAG_HEADER_VERSION 1
+/// Written in the byte order of the writer, so that DAG files of hosts of the
+/// other byte order are not taken for valid ones
+#define ETHASH_DAG_ENDIAN_CHECK 0x01020304U
+
+/**
+ * The header at the start of a DAG file, zero padded to ETHASH_DAG_HEADER_SIZE
+ *
+ * It is written unfinished when the file is created and complete once the
+ * DAG and its checksum trailer are on disk, so that the state of a DAG file is
+ * known from its first page. All fields are in the byte order of the writer.
+ */
+struct ethash_io_dag_header {
+	uint64_t magic_num;           ///< ETHASH_DAG_MAGIC_NUM
+	uint32_t version;             ///< ETHASH_DAG_HEADER_VERSION
+	uint32_t revision;            ///< ETHASH_REVISION of the algorithm
+	uint32_t endian_check;        ///< ETHASH_DAG_ENDIAN_CHECK
+	uint32_t dataset_parents;     ///< ETHASH_DATASET_PARENTS of the DAG items
+	uint32_t node_bytes;          ///< the size of a DAG node
+	uint32_t header_size;         ///< ETHASH_DAG_HEADER_SIZE, the offset of the first node
+	uint64_t epoch;               ///< the epoch of the seedhash, or ETHASH_EVENT_NO_EPOCH
+	uint64_t file_size;           ///< the size of the DAG, without header and trailer
+	ethash_h256_t seed_hash;
+	uint32_t complete;            ///< 1 once the nodes and the trailer are written, 0 before
+	uint32_t checksum_count;      ///< the number of checksums in the trailer
+	ethash_h256_t checksums_hash; ///< SHA3-256 of the trailer, once complete
+};
+
+/// What the header of a DAG file says about it, see @ref ethash_io_read_dag_header()
+enum ethash_io_dag_state {
+	ETHASH_IO_DAG_INVALID = 0, ///< no header of this DAG, a stale or foreign file
+	ETHASH_IO_DAG_UNFINISHED,  ///< the DAG is still being generated
+	ETHASH_IO_DAG_COMPLETE     ///< the DAG and its trailer are complete
+};
+
+/**
+ * Write the header of a DAG file and flush it
+ *
+ * @param f                  The DAG file
+ * @param[in] seedhash       The seedhash of the DAG
+ * @param[in] file_size      The size of the DAG, without header and trailer
+ * @param[in] checksums      The checksums of the trailer for a complete header,
+ *                           or NULL for an unfinished one
+ * @return                   true if the header was written and false otherwise
+ */
+bool ethash_io_write_dag_header(
+	FILE* f,
+	ethash_h256_t const seedhash,
+	uint64_t file_size,
+	ethash_h256_t const* checksums
+);
+
+/**
+ * Read the header of a DAG file and check that it describes the DAG of
+ * @a seedhash of @a file_size bytes in the layout of this build
+ *
+ * @param f                  The DAG file, left positioned after the header
+ * @param[in] seedhash       The seedhash of the DAG
+ * @param[in] file_size      The size of the DAG, without header and trailer
+ * @param[out] header        Receives the header as read, may be NULL
+ * @return                   The state of the file
+ */
+enum ethash_io_dag_state ethash_io_read_dag_header(
+	FILE* f,
+	ethash_h256_t const seedhash,
+	uint64_t file_size,
+	struct ethash_io_dag_header* header
+);
+
+/**
+ * Read the checksums from the trailer of a DAG file
+ *
+ * @param f                  The DAG file
+ * @param file_size          The size of the DAG, without the magic number
+ * @param[out] checksums     Receives ethash_io_dag_checksum_count() checksums
+ * @return                   true if they were read and match the hash of them
+ *                           in the header, false otherwise
+ */
+bool ethash_io_read_checksums(FILE* f, uint64_t file_size, ethash_h256_t* checksums);
+
+/**
+ * Write the checksums to the trailer of a DAG file, see @ref ethash_io_read_checksums()
+ */
+bool ethash_io_write_checksums(FILE* f, uint64_t file_size, ethash_h256_t const* checksums);
+
+/**
+ * Record how much of an unfinished DAG file is already on disk
+ *
+ * The checkpoint is kept in a "<DAG file name>.checkpoint" file next to the
+ * DAG file, holding ETHASH_DAG_CHECKPOINT_MAGIC_NUM, the DAG size and the
+ * number of nodes.
+ *
+ * @param[in] dirname        The path of the ethash data directory
+ * @param[in] seedhash       The seedhash of the DAG
+ * @param[in] file_size      The size of the DAG, without the magic number
+ * @param[in] nodes          The number of nodes at the start of the DAG file
+ *                           that reached the disk
+ * @return                   true if the checkpoint was written and false otherwise
+ */
+bool ethash_io_write_checkpoint(
+	char const* dirname,
+	ethash_h256_t const seedhash,
+	uint64_t file_size,
+	uint32_t nodes
+);
+
+/**
+ * Open an unfinished DAG file to resume its generation from its checkpoint
+ *
+ * @param[in] dirname        The path of the ethash data directory
+ * @param[in] seedhash       The seedhash of the DAG
+ * @param[in] file_size      The size of the DAG, without the magic number
+ * @param[out] nodes         The number of nodes recorded by the checkpoint
+ * @return                   The DAG file opened for reading and writing, or NULL if
+ *                           there is no checkpoint for a DAG of this size.
+ *                           User is responsible for closing it.
+ */
+FILE* ethash_io_open_checkpoint(
+	char const* dirname,
+	ethash_h256_t const seedhash,
+	uint64_t file_size,
+	uint32_t* nodes
+);
+
+/**
+ * Remove the checkpoint of a DAG file, if there is one
+ */
+void ethash_io_remove_checkpoint(char const* dirname, ethash_h256_t const seedhash);
+
+/**
+ * Write a slice of a DAG, the nodes one of several hosts computed
+ *
+ * Slice @a rank of @a num_ranks is kept in a
+ * "<DAG file name>.slice-<rank>-of-<num_ranks>" file, holding
+ * ETHASH_DAG_SLICE_MAGIC_NUM, the DAG size, the first node and the number of
+ * nodes of the slice, their SHA3-256 and then the nodes. The file is written
+ * under a temporary name and renamed once complete, so that other hosts never
+ * pick up a partially written slice.
+ *
+ * @param[in] dirname        The path of the directory all hosts share. If it
+ *                           does not exist it's created.
+ * @param[in] seedhash       The seedhash of the DAG
+ * @param[in] file_size      The size of the DAG, without the magic number
+ * @param[in] rank           The index of the slice
+ * @param[in] num_ranks      The number of slices the DAG is split into
+ * @param[in] first          The first node of the slice
+ * @param[in] nodes          The number of nodes of the slice
+ * @param[in] checksum       The SHA3-256 of the nodes
+ * @param[in] data           The nodes
+ * @return                   true if the slice was written and false otherwise
+ */
+bool ethash_io_write_slice(
+	char const* dirname,
+	ethash_h256_t const seedhash,
+	uint64_t file_size,
+	unsigned rank,
+	unsigned num_ranks,
+	uint32_t first,
+	uint32_t nodes,
+	ethash_h256_t const* checksum,
+	void const* data
+);
+/**
+ * Open a slice of a DAG written by @ref ethash_io_write_slice()
+ *
+ * @param[in] dirname        The path of the directory all hosts share
+ * @param[in] seedhash       The seedhash of the DAG
+ * @param[in] file_size      The size of the DAG, without the magic number
+ * @param[in] rank           The index of the slice
+ * @param[in] num_ranks      The number of slices the DAG is split into
+ * @param[in] first          The first node the slice should have
+ * @param[in] nodes          The number of nodes the slice should have
+ * @param[out] checksum      The SHA3-256 of the nodes recorded in the file
+ * @return                   The file opened for reading, positioned at the
+ *                           first node, or NULL if there is no complete slice
+ *                           of these nodes. User is responsible for closing it.
+ */
+FILE* ethash_io_open_slice(
+	char const* dirname,
+	ethash_h256_t const seedhash,
+	uint64_t file_size,
+	unsigned rank,
+	unsigned num_ranks,
+	uint32_t first,
+	uint32_t nodes,
+	ethash_h256_t* checksum
+);
+
+/// The header of a seed package, followed by the light cache
+struct ethash_io_seed_package {
+	uint64_t magic_num;          ///< ETHASH_SEED_PACKAGE_MAGIC_NUM
+	uint64_t revision;           ///< ETHASH_REVISION of the exporting library
+	uint64_t block_number;       ///< a block of the epoch
+	uint64_t cache_size;
+	uint64_t full_size;          ///< of the DAG generated from the cache
+	ethash_h256_t seed_hash;
+	ethash_h256_t checksum;      ///< SHA3-256 of the cache
+};
+
+/**
+ * Write a seed package, the light cache of an epoch with what it takes to
+ * generate the DAG from it on another host
+ *
+ * The package is written under a temporary name and renamed once complete.
+ *
+ * @param[in] path           The path of the package file
+ * @param[in] header         The header, filled in but for the magic number
+ *                           and the revision
+ * @param[in] cache          The cache nodes, header->cache_size bytes
+ * @return                   true if the package was written and false otherwise
+ */
+bool ethash_io_write_seed_package(char const* path, struct ethash_io_seed_package const* header, void const* cache);
+/**
+ * Open a seed package written by @ref ethash_io_write_seed_package()
+ *
+ * @param[in] path           The path of the package file
+ * @param[out] header        The header of the package
+ * @return                   The file opened for reading, positioned at the
+ *                           cache, or NULL if there is no complete package of
+ *                           this revision. User is responsible for closing it.
+ */
+FILE* ethash_io_open_seed_package(char const* path, struct ethash_io_seed_package* header);
+
+/// The start of the header of a light cache file
+struct ethash_io_cache_header {
+	uint64_t magic_num;          ///< ETHASH_CACHE_MAGIC_NUM
+	ethash_h256_t seed_hash;     ///< the whole seedhash, the file name only holds 8 bytes of it
+	ethash_h256_t checksum;      ///< SHA3-256 of the cache
+};
+
+/**
+ * Open the light cache file for a seedhash if it exists and is valid
+ *
+ * A light cache file holds a @ref ethash_io_cache_header zero padded to
+ * ETHASH_CACHE_HEADER_SIZE bytes, followed by the cache nodes. The nodes are
+ * not read here, the caller compares them against @a checksum once loaded.
+ *
+ * @param[in] dirname        The path of the ethash data directory
+ * @param[in] seedhash       The seedhash of the cache, used in the naming of the file
+ * @param[in] cache_size     The size the cache should have
+ * @param[out] checksum      The SHA3-256 of the cache nodes stored in the header
+ * @return                   The file opened for reading, positioned after the
+ *                           header, or NULL if there is no valid file.
+ *                           User is responsible for closing it.
+ */
+FILE* ethash_io_open_cache(
+	char const* dirname,
+	ethash_h256_t const seedhash,
+	uint64_t cache_size,
+	ethash_h256_t* checksum
+);
+
+/**
+ * Write the light cache file for a seedhash
+ *
+ * The file is written under a temporary name, synced and renamed once
+ * complete, so that a partially written file is never picked up by
+ * @ref ethash_io_open_cache(), not even after a crash.
+ *
+ * @param[in] dirname        The path of the ethash data directory. If it does not
+ *                           exist it's created.
+ * @param[in] seedhash       The seedhash of the cache, used in the naming of the file
+ * @param[in] cache          The cache nodes
+ * @param[in] cache_size     The size of the cache in bytes
+ * @return                   true if the file was written and false otherwise
+ */
+bool ethash_io_write_cache(
+	char const* dirname,
+	ethash_h256_t const seedhash,
+	void const* cache,
+	uint64_t cache_size
+);
+
 /**
  * An fopen wrapper for no-warnings crossplatform fopen.
  *
@@ -167,6 +482,81 @@ bool ethash_file_size(FILE* f, size_t* ret_size);
  */
 int ethash_fileno(FILE* f);
 
+/// Alignment of the file offset, length and memory of a write bypassing the page cache
+#define ETHASH_IO_DIRECT_ALIGNMENT 4096
+
+/**
+ * Make writes with @ref ethash_io_pwrite() and reads with @ref ethash_io_pread()
+ * bypass the page cache, or stop it
+ *
+ * While enabled the file offset, the length and the address of every write
+ * and read must be multiples of ETHASH_IO_DIRECT_ALIGNMENT.
+ *
+ * @param f            The file stream, with no buffered output
+ * @param enable       true to bypass the page cache, false to use it again
+ * @return             true if the file is now in the requested mode. Bypassing
+ *                     the page cache is not available on every platform and
+ *                     file system.
+ */
+bool ethash_io_set_direct(FILE* f, bool enable);
+
+/**
+ * Write to a file at an offset, without moving its stream position
+ *
+ * @param f            The file stream, with no buffered output
+ * @param data         The bytes to write
+ * @param size         The number of bytes to write
+ * @param offset       The file offset to write them at
+ * @return             true if all bytes were written and false otherwise
+ */
+bool ethash_io_pwrite(FILE* f, void const* data, size_t size, uint64_t offset);
+
+/**
+ * Read from a file at an offset, without moving its stream position, so that
+ * several threads can read one file at once
+ *
+ * @param f            The file stream, with no buffered input
+ * @param data         Where to read the bytes to
+ * @param size         The number of bytes to read
+ * @param offset       The file offset to read them from
+ * @return             true if all bytes were read and false on an error or
+ *                     the end of the file
+ */
+bool ethash_io_pread(FILE* f, void* data, size_t size, uint64_t offset);
+
+/**
+ * Wait until everything written to a file reached the disk, then drop the
+ * given range of it from the page cache where supported
+ *
+ * @param f            The file stream, with no buffered output
+ * @param offset       The start of the range that is no longer needed in memory
+ * @param size         The length of that range, 0 to keep the whole file in
+ *                     memory
+ * @return             true if the file was synced and false otherwise
+ */
+bool ethash_io_sync(FILE* f, uint64_t offset, uint64_t size);
+
+/**
+ * Give a file the given size, allocating its blocks at once where the file
+ * system supports it so that a DAG written out of order is not fragmented
+ *
+ * @param f            The file stream, empty and with no buffered output
+ * @param size         The size the file should have
+ * @return             true if the space was allocated. If not the file is
+ *                     unchanged and can be extended some other way.
+ */
+bool ethash_io_preallocate(FILE* f, uint64_t size);
+
+/**
+ * Call @a fn for every regular file of a directory, in no particular order
+ *
+ * @param dirname      The directory to list
+ * @param fn           Called with the name of the file, without @a dirname, and its size
+ * @param arg          Passed to every call of @a fn
+ * @return             true if the directory could be read
+ */
+bool ethash_io_list_dir(char const* dirname, void (*fn)(char const* name, uint64_t size, void* arg), void* arg);
+
 /**
  * Create the filename for the DAG.
  *
@@ -194,17 +584,34 @@ char* ethash_io_create_filename(
  */
 bool ethash_get_default_dirname(char* strbuf, size_t buffsize);
 
+/// The hex number that identifies a seed in DAG and cache file names: its first 8 bytes, big endian
+static inline uint64_t ethash_io_seed_name_hash(ethash_h256_t const* seed_hash)
+{
+	uint64_t hash = *((uint64_t*)seed_hash);
+#if LITTLE_ENDIAN == BYTE_ORDER
+	hash = ethash_swap_u64(hash);
+#endif
+	return hash;
+}
+
 static inline bool ethash_io_mutable_name(
 	uint32_t revision,
 	ethash_h256_t const* seed_hash,
 	char* output
 )
 {
-    uint64_t hash = *((uint64_t*)seed_hash);
-#if LITTLE_ENDIAN == BYTE_ORDER
-    hash = ethash_swap_u64(hash);
-#endif
-    return snprintf(output, DAG_MUTABLE_NAME_MAX_SIZE, "full-R%u-%016" PRIx64, revision, hash) >= 0;
+	uint64_t const hash = ethash_io_seed_name_hash(seed_hash);
+	return snprintf(output, DAG_MUTABLE_NAME_MAX_SIZE, ETHASH_DAG_FILE_PREFIX "%u-%016" PRIx64, revision, hash) >= 0;
+}
+
+static inline bool ethash_io_cache_name(
+	uint32_t revision,
+	ethash_h256_t const* seed_hash,
+	char* output
+)
+{
+	uint64_t const hash = ethash_io_seed_name_hash(seed_hash);
+	return snprintf(output, CACHE_MUTABLE_NAME_MAX_SIZE, "cache-R%u-%016" PRIx64, revision, hash) >= 0;
 }
 
 #ifdef __cplusplus
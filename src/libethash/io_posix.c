@@ -19,6 +19,9 @@
  * @date 2015
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // O_DIRECT
+#endif
 #include "io.h"
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -26,7 +29,9 @@
 #include <libgen.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <stdlib.h>
+#include <dirent.h>
 #include <pwd.h>
 
 FILE* ethash_fopen(char const* file_name, char const* mode)
@@ -41,7 +46,18 @@ int ethash_fseek(FILE* f, size_t offset, int origin)
 
 char* ethash_strncat(char* dest, size_t dest_size, char const* src, size_t count)
 {
-	return strlen(dest) + count + 1 <= dest_size ? strncat(dest, src, count) : NULL;
+	// copied by hand, strncat bounded by the source length upsets GCC's overflow checks
+	size_t const length = strlen(dest);
+	size_t n = 0;
+	while (n != count && src[n]) {
+		++n;
+	}
+	if (length >= dest_size || n > dest_size - length - 1) {
+		return NULL;
+	}
+	memcpy(dest + length, src, n);
+	dest[length + n] = '\0';
+	return dest;
 }
 
 bool ethash_mkdir(char const* dirname)
@@ -55,6 +71,120 @@ int ethash_fileno(FILE *f)
 	return fileno(f);
 }
 
+bool ethash_io_set_direct(FILE* f, bool enable)
+{
+#ifdef O_DIRECT
+	int const fd = fileno(f);
+	int const flags = fd == -1 ? -1 : fcntl(fd, F_GETFL);
+	if (flags == -1) {
+		return false;
+	}
+	return fcntl(fd, F_SETFL, enable ? flags | O_DIRECT : flags & ~O_DIRECT) == 0;
+#else
+	(void)f;
+	return !enable;
+#endif
+}
+
+bool ethash_io_pwrite(FILE* f, void const* data, size_t size, uint64_t offset)
+{
+	int const fd = fileno(f);
+	char const* p = (char const*)data;
+	if (fd == -1) {
+		return false;
+	}
+	while (size != 0) {
+		ssize_t const written = pwrite(fd, p, size, (off_t)offset);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		p += written;
+		size -= (size_t)written;
+		offset += (uint64_t)written;
+	}
+	return true;
+}
+
+bool ethash_io_pread(FILE* f, void* data, size_t size, uint64_t offset)
+{
+	int const fd = fileno(f);
+	char* p = (char*)data;
+	if (fd == -1) {
+		return false;
+	}
+	while (size != 0) {
+		ssize_t const got = pread(fd, p, size, (off_t)offset);
+		if (got <= 0) {
+			if (got < 0 && errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		p += got;
+		size -= (size_t)got;
+		offset += (uint64_t)got;
+	}
+	return true;
+}
+
+bool ethash_io_sync(FILE* f, uint64_t offset, uint64_t size)
+{
+	int const fd = fileno(f);
+#if defined(__APPLE__)
+	if (fd == -1 || fsync(fd) != 0) {
+		return false;
+	}
+#else
+	if (fd == -1 || fdatasync(fd) != 0) {
+		return false;
+	}
+#endif
+#ifdef POSIX_FADV_DONTNEED
+	// a length of 0 would mean up to the end of the file for posix_fadvise()
+	if (size) {
+		posix_fadvise(fd, (off_t)offset, (off_t)size, POSIX_FADV_DONTNEED);
+	}
+#else
+	(void)offset;
+	(void)size;
+#endif
+	return true;
+}
+
+bool ethash_io_preallocate(FILE* f, uint64_t size)
+{
+#if defined(__linux__)
+	int const fd = fileno(f);
+	return fd != -1 && posix_fallocate(fd, 0, (off_t)size) == 0;
+#else
+	(void)f;
+	(void)size;
+	return false;
+#endif
+}
+
+bool ethash_io_list_dir(char const* dirname, void (*fn)(char const* name, uint64_t size, void* arg), void* arg)
+{
+	DIR* dir = opendir(dirname);
+	if (!dir) {
+		return false;
+	}
+	// the entries are looked up relative to the open directory, without building their paths
+	int const fd = dirfd(dir);
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL) {
+		struct stat st;
+		if (fd != -1 && fstatat(fd, entry->d_name, &st, 0) == 0 && S_ISREG(st.st_mode)) {
+			fn(entry->d_name, (uint64_t)st.st_size, arg);
+		}
+	}
+	closedir(dir);
+	return true;
+}
+
 char* ethash_io_create_filename(
 	char const* dirname,
 	char const* filename,
@@ -27,6 +27,7 @@
 #include <sys/types.h>
 #include <shlobj.h>
 #include <io.h>
+#include <windows.h>
 
 FILE* ethash_fopen(char const* file_name, char const* mode)
 {
@@ -55,6 +56,98 @@ int ethash_fileno(FILE* f)
 	return _fileno(f);
 }
 
+bool ethash_io_set_direct(FILE* f, bool enable)
+{
+	// FILE_FLAG_NO_BUFFERING can only be given when a file is opened
+	(void)f;
+	return !enable;
+}
+
+bool ethash_io_pwrite(FILE* f, void const* data, size_t size, uint64_t offset)
+{
+	HANDLE const h = (HANDLE)_get_osfhandle(_fileno(f));
+	char const* p = (char const*)data;
+	if (h == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	while (size != 0) {
+		OVERLAPPED ov;
+		DWORD written;
+		DWORD const chunk = size > 0x40000000 ? 0x40000000 : (DWORD)size;
+		memset(&ov, 0, sizeof(ov));
+		ov.Offset = (DWORD)offset;
+		ov.OffsetHigh = (DWORD)(offset >> 32);
+		if (!WriteFile(h, p, chunk, &written, &ov) || written == 0) {
+			return false;
+		}
+		p += written;
+		size -= written;
+		offset += written;
+	}
+	return true;
+}
+
+bool ethash_io_pread(FILE* f, void* data, size_t size, uint64_t offset)
+{
+	HANDLE const h = (HANDLE)_get_osfhandle(_fileno(f));
+	char* p = (char*)data;
+	if (h == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	while (size != 0) {
+		OVERLAPPED ov;
+		DWORD got;
+		DWORD const chunk = size > 0x40000000 ? 0x40000000 : (DWORD)size;
+		memset(&ov, 0, sizeof(ov));
+		ov.Offset = (DWORD)offset;
+		ov.OffsetHigh = (DWORD)(offset >> 32);
+		if (!ReadFile(h, p, chunk, &got, &ov) || got == 0) {
+			return false;
+		}
+		p += got;
+		size -= got;
+		offset += got;
+	}
+	return true;
+}
+
+bool ethash_io_sync(FILE* f, uint64_t offset, uint64_t size)
+{
+	HANDLE const h = (HANDLE)_get_osfhandle(_fileno(f));
+	(void)offset;
+	(void)size;
+	return h != INVALID_HANDLE_VALUE && FlushFileBuffers(h);
+}
+
+bool ethash_io_preallocate(FILE* f, uint64_t size)
+{
+	// not implemented, the caller extends the file by writing its last byte
+	(void)f;
+	(void)size;
+	return false;
+}
+
+bool ethash_io_list_dir(char const* dirname, void (*fn)(char const* name, uint64_t size, void* arg), void* arg)
+{
+	char* pattern = ethash_io_create_filename(dirname, "*", 1);
+	if (!pattern) {
+		return false;
+	}
+	WIN32_FIND_DATAA data;
+	HANDLE const h = FindFirstFileA(pattern, &data);
+	free(pattern);
+	if (h == INVALID_HANDLE_VALUE) {
+		return GetLastError() == ERROR_FILE_NOT_FOUND;
+	}
+	do {
+		if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+			fn(data.cFileName, ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow, arg);
+		}
+	} while (FindNextFileA(h, &data));
+	FindClose(h);
+	return true;
+}
+
 char* ethash_io_create_filename(
 	char const* dirname,
 	char const* filename,
@@ -0,0 +1,264 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file keccak_backends.c
+ * @date 2018
+ *
+ * The keccakf1600 backends of dispatch.c that hash with a library: OpenSSL
+ * for builds defining ETHASH_WITH_OPENSSL, XKCP for ETHASH_WITH_XKCP and
+ * CryptoPP for WITH_CRYPTOPP. All of them are the Keccak of Ethereum, padded
+ * with 0x01 and not the 0x06 of FIPS 202. The OpenSSL and XKCP backends are
+ * only enumerated once they passed ethash_keccakf1600_kernel_check().
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include "dispatch.h"
+#include "threads.h"
+#if defined(WITH_CRYPTOPP)
+#include "sha3_cryptopp.h"
+#else
+#include "sha3.h"
+#endif
+#if defined(ETHASH_WITH_OPENSSL)
+#include <openssl/evp.h>
+#endif
+#if defined(ETHASH_WITH_XKCP)
+#include <KeccakHash.h>
+#endif
+
+#if !defined(WITH_CRYPTOPP)
+void ethash_keccakf1600(uint64_t state[25]);
+#endif
+
+// hashes timed between two looks at the clock
+#define ETHASH_KECCAK_CHUNK 256
+
+typedef struct keccak_known_answer {
+	unsigned bits;
+	uint8_t input_byte;      ///< repeated over the whole input
+	size_t input_size;
+	char const* hex;
+} keccak_known_answer_t;
+
+static keccak_known_answer_t const keccak_known_answers[] = {
+	{ 256, 0, 0, "c5d2460186f7233c927e7db2dcc703c0e500b653ca82273b7bfad8045d85a470" },
+	{ 256, '~', 32, "2b5ddf6f4d21c23de216f44d5e4bdc68e044b71897837ea74c83908be7037cd7" },
+	{
+		512, '~', 64,
+		"0be8a1d334b4655fe58c6b38789f984bb13225684e86b20517a55ab2386c7b61"
+		"c306f25e0627c60064cecd6d80cd67a82b3890bd1289b7ceb473aad56a359405"
+	}
+};
+
+static void keccak_hash(
+	ethash_keccakf1600_kernel_t const* kernel,
+	unsigned bits,
+	uint8_t* out,
+	uint8_t const* in,
+	size_t size
+)
+{
+	ethash_sha3_fn const whole = bits == 256 ? kernel->sha3_256 : kernel->sha3_512;
+	if (whole) {
+		whole(out, in, size);
+		return;
+	}
+#if !defined(WITH_CRYPTOPP)
+	ethash_sha3_permute(kernel->permute, bits, out, bits / 8, in, size);
+#endif
+}
+
+bool ethash_keccakf1600_kernel_check(ethash_keccakf1600_kernel_t const* kernel)
+{
+	if (!kernel->permute && (!kernel->sha3_256 || !kernel->sha3_512)) {
+		return false;
+	}
+	uint8_t input[3 * 136 + 1];
+	uint8_t actual[64];
+	for (unsigned i = 0; i != sizeof(keccak_known_answers) / sizeof(keccak_known_answers[0]); ++i) {
+		keccak_known_answer_t const* answer = &keccak_known_answers[i];
+		char hex[129];
+		memset(input, answer->input_byte, answer->input_size);
+		keccak_hash(kernel, answer->bits, actual, input, answer->input_size);
+		for (unsigned b = 0; b != answer->bits / 8; ++b) {
+			snprintf(hex + 2 * b, 3, "%02x", actual[b]);
+		}
+		if (strcmp(hex, answer->hex) != 0) {
+			return false;
+		}
+	}
+#if !defined(WITH_CRYPTOPP)
+	// every length up to three blocks of Keccak-256, so each padding case of both rates
+	for (unsigned i = 0; i != sizeof(input); ++i) {
+		input[i] = (uint8_t)(i * 167 + 13);
+	}
+	for (size_t size = 0; size <= sizeof(input); ++size) {
+		for (unsigned bits = 256; bits <= 512; bits += 256) {
+			uint8_t expected[64];
+			ethash_sha3_permute(ethash_keccakf1600, bits, expected, bits / 8, input, size);
+			keccak_hash(kernel, bits, actual, input, size);
+			if (memcmp(expected, actual, bits / 8) != 0) {
+				return false;
+			}
+		}
+	}
+#endif
+	return true;
+}
+
+#if defined(WITH_CRYPTOPP)
+
+void ethash_cryptopp_sha3_256(uint8_t* out, uint8_t const* in, size_t size)
+{
+	SHA3_256((struct ethash_h256 const*)out, in, size);
+}
+
+void ethash_cryptopp_sha3_512(uint8_t* out, uint8_t const* in, size_t size)
+{
+	SHA3_512(out, in, size);
+}
+
+#endif
+
+#if defined(ETHASH_WITH_OPENSSL)
+
+static ethash_once_t openssl_once = ETHASH_ONCE_INIT;
+static EVP_MD* openssl_keccak256;
+static EVP_MD* openssl_keccak512;
+static bool openssl_passed;
+
+void ethash_openssl_sha3_256(uint8_t* out, uint8_t const* in, size_t size)
+{
+	unsigned int length = 32;
+	EVP_Digest(in, size, out, &length, openssl_keccak256, NULL);
+}
+
+void ethash_openssl_sha3_512(uint8_t* out, uint8_t const* in, size_t size)
+{
+	unsigned int length = 64;
+	EVP_Digest(in, size, out, &length, openssl_keccak512, NULL);
+}
+
+static void ethash_openssl_init(void)
+{
+	// only the default provider of OpenSSL 3.2 and later has these
+	openssl_keccak256 = EVP_MD_fetch(NULL, "KECCAK-256", NULL);
+	openssl_keccak512 = EVP_MD_fetch(NULL, "KECCAK-512", NULL);
+	if (!openssl_keccak256 || !openssl_keccak512) {
+		return;
+	}
+	ethash_keccakf1600_kernel_t const kernel = {
+		"openssl", 0, NULL, ethash_openssl_sha3_256, ethash_openssl_sha3_512, NULL
+	};
+	openssl_passed = ethash_keccakf1600_kernel_check(&kernel);
+}
+
+bool ethash_openssl_available(void)
+{
+	ethash_call_once(&openssl_once, ethash_openssl_init);
+	return openssl_passed;
+}
+
+#endif
+
+#if defined(ETHASH_WITH_XKCP)
+
+static ethash_once_t xkcp_once = ETHASH_ONCE_INIT;
+static bool xkcp_passed;
+
+// a capacity of twice the output bits and the 0x01 delimiter of Keccak
+static void ethash_xkcp_hash(unsigned bits, uint8_t* out, uint8_t const* in, size_t size)
+{
+	Keccak_HashInstance instance;
+	Keccak_HashInitialize(&instance, 1600 - 2 * bits, 2 * bits, bits, 0x01);
+	Keccak_HashUpdate(&instance, in, (BitLength)size * 8);
+	Keccak_HashFinal(&instance, out);
+}
+
+void ethash_xkcp_sha3_256(uint8_t* out, uint8_t const* in, size_t size)
+{
+	ethash_xkcp_hash(256, out, in, size);
+}
+
+void ethash_xkcp_sha3_512(uint8_t* out, uint8_t const* in, size_t size)
+{
+	ethash_xkcp_hash(512, out, in, size);
+}
+
+static void ethash_xkcp_init(void)
+{
+	ethash_keccakf1600_kernel_t const kernel = {
+		"xkcp", 0, NULL, ethash_xkcp_sha3_256, ethash_xkcp_sha3_512, NULL
+	};
+	xkcp_passed = ethash_keccakf1600_kernel_check(&kernel);
+}
+
+bool ethash_xkcp_available(void)
+{
+	ethash_call_once(&xkcp_once, ethash_xkcp_init);
+	return xkcp_passed;
+}
+
+#endif
+
+// 64 byte Keccak-512 hashes per second of @a kernel on this thread
+static uint64_t ethash_keccak_rate(ethash_keccakf1600_kernel_t const* kernel, uint64_t trial_us)
+{
+	uint8_t node[64];
+	memset(node, 0x5a, sizeof(node));
+	uint64_t hashes = 0;
+	uint64_t const start = ethash_time_us();
+	uint64_t elapsed;
+	do {
+		// every hash is the input of the next one, so none can be skipped
+		for (unsigned i = 0; i != ETHASH_KECCAK_CHUNK; ++i) {
+			keccak_hash(kernel, 512, node, node, sizeof(node));
+		}
+		hashes += ETHASH_KECCAK_CHUNK;
+		elapsed = ethash_time_us() - start;
+	} while (elapsed < trial_us);
+	return elapsed ? hashes * 1000000 / elapsed : 0;
+}
+
+size_t ethash_keccak_benchmark(unsigned budget_ms, ethash_keccak_backend_t* results, size_t max_results)
+{
+	size_t count = 0;
+	while (ethash_keccakf1600_kernel_at((unsigned)count)) {
+		++count;
+	}
+	uint64_t const trial_us = (uint64_t)(budget_ms ? budget_ms : ETHASH_AUTOTUNE_BUDGET_MS / 4) * 1000 / count;
+	char best_name[16] = "";
+	uint64_t best = 0;
+	for (size_t i = 0; i != count; ++i) {
+		ethash_keccakf1600_kernel_t const* kernel = ethash_keccakf1600_kernel_at((unsigned)i);
+		bool const passed = ethash_keccakf1600_kernel_check(kernel);
+		uint64_t const rate = passed ? ethash_keccak_rate(kernel, trial_us) : 0;
+		if (i < max_results) {
+			snprintf(results[i].name, sizeof(results[i].name), "%s", kernel->name);
+			results[i].passed = passed;
+			results[i].hash_rate = rate;
+		}
+		if (passed && rate > best) {
+			best = rate;
+			snprintf(best_name, sizeof(best_name), "%s", kernel->name);
+		}
+	}
+	if (best_name[0]) {
+		ethash_set_kernel("keccakf1600", best_name);
+	}
+	return count;
+}
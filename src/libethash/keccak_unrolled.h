@@ -0,0 +1,121 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file keccak_unrolled.h
+ * @date 2018
+ *
+ * The rounds of Keccak-f[1600] and Keccak-f[800] fully unrolled over lanes
+ * kept in locals. The includer defines XOR(x, y), ANDNOT(x, y) = ~x & y and
+ * ROL(x, s) for its lane type, for a scalar word or a vector of words of
+ * independent states alike. The rotation offsets are those of Keccak-f[1600],
+ * a 32 bit ROL has to reduce them modulo 32.
+ *
+ * The lanes are named after XKCP: the row b, g, k, m or s (y = 0..4) and the
+ * column a, e, i, o or u (x = 0..4) of lane x + 5 * y of the state.
+ */
+#pragma once
+
+#define KECCAK_DECLARE_LANES(T, X) \
+	T X##ba, X##be, X##bi, X##bo, X##bu; \
+	T X##ga, X##ge, X##gi, X##go, X##gu; \
+	T X##ka, X##ke, X##ki, X##ko, X##ku; \
+	T X##ma, X##me, X##mi, X##mo, X##mu; \
+	T X##sa, X##se, X##si, X##so, X##su
+
+#define KECCAK_COPY_LANES(X, a, OP) \
+	OP(X##ba, a[0]); OP(X##be, a[1]); OP(X##bi, a[2]); OP(X##bo, a[3]); OP(X##bu, a[4]); \
+	OP(X##ga, a[5]); OP(X##ge, a[6]); OP(X##gi, a[7]); OP(X##go, a[8]); OP(X##gu, a[9]); \
+	OP(X##ka, a[10]); OP(X##ke, a[11]); OP(X##ki, a[12]); OP(X##ko, a[13]); OP(X##ku, a[14]); \
+	OP(X##ma, a[15]); OP(X##me, a[16]); OP(X##mi, a[17]); OP(X##mo, a[18]); OP(X##mu, a[19]); \
+	OP(X##sa, a[20]); OP(X##se, a[21]); OP(X##si, a[22]); OP(X##so, a[23]); OP(X##su, a[24])
+
+#define KECCAK_LOAD(lane, word) lane = (word)
+#define KECCAK_STORE(lane, word) (word) = lane
+
+// Theta, rho and pi of the lanes of A, leaving the rows of the result in B
+#define KECCAK_THETA_RHO_PI(A) \
+	Ca = XOR(XOR(XOR(A##ba, A##ga), XOR(A##ka, A##ma)), A##sa); \
+	Ce = XOR(XOR(XOR(A##be, A##ge), XOR(A##ke, A##me)), A##se); \
+	Ci = XOR(XOR(XOR(A##bi, A##gi), XOR(A##ki, A##mi)), A##si); \
+	Co = XOR(XOR(XOR(A##bo, A##go), XOR(A##ko, A##mo)), A##so); \
+	Cu = XOR(XOR(XOR(A##bu, A##gu), XOR(A##ku, A##mu)), A##su); \
+	Da = XOR(Cu, ROL(Ce, 1)); \
+	De = XOR(Ca, ROL(Ci, 1)); \
+	Di = XOR(Ce, ROL(Co, 1)); \
+	Do = XOR(Ci, ROL(Cu, 1)); \
+	Du = XOR(Co, ROL(Ca, 1)); \
+	Bba = XOR(A##ba, Da);          Bbe = ROL(XOR(A##ge, De), 44); Bbi = ROL(XOR(A##ki, Di), 43); \
+	Bbo = ROL(XOR(A##mo, Do), 21); Bbu = ROL(XOR(A##su, Du), 14); \
+	Bga = ROL(XOR(A##bo, Do), 28); Bge = ROL(XOR(A##gu, Du), 20); Bgi = ROL(XOR(A##ka, Da), 3); \
+	Bgo = ROL(XOR(A##me, De), 45); Bgu = ROL(XOR(A##si, Di), 61); \
+	Bka = ROL(XOR(A##be, De), 1);  Bke = ROL(XOR(A##gi, Di), 6);  Bki = ROL(XOR(A##ko, Do), 25); \
+	Bko = ROL(XOR(A##mu, Du), 8);  Bku = ROL(XOR(A##sa, Da), 18); \
+	Bma = ROL(XOR(A##bu, Du), 27); Bme = ROL(XOR(A##ga, Da), 36); Bmi = ROL(XOR(A##ke, De), 10); \
+	Bmo = ROL(XOR(A##mi, Di), 15); Bmu = ROL(XOR(A##so, Do), 56); \
+	Bsa = ROL(XOR(A##bi, Di), 62); Bse = ROL(XOR(A##go, Do), 55); Bsi = ROL(XOR(A##ku, Du), 39); \
+	Bso = ROL(XOR(A##ma, Da), 41); Bsu = ROL(XOR(A##se, De), 2)
+
+#define KECCAK_CHI_ROW(E, r) \
+	E##r##a = XOR(B##r##a, ANDNOT(B##r##e, B##r##i)); \
+	E##r##e = XOR(B##r##e, ANDNOT(B##r##i, B##r##o)); \
+	E##r##i = XOR(B##r##i, ANDNOT(B##r##o, B##r##u)); \
+	E##r##o = XOR(B##r##o, ANDNOT(B##r##u, B##r##a)); \
+	E##r##u = XOR(B##r##u, ANDNOT(B##r##a, B##r##e))
+
+// Chi and iota into the lanes of E, as written in the specification
+#define KECCAK_CHI_IOTA(E, rc) \
+	KECCAK_CHI_ROW(E, b); KECCAK_CHI_ROW(E, g); KECCAK_CHI_ROW(E, k); \
+	KECCAK_CHI_ROW(E, m); KECCAK_CHI_ROW(E, s); \
+	E##ba = XOR(E##ba, (rc))
+
+// Chi and iota of scalar lanes with be, bi, go, ki, mi and sa kept
+// complemented across rounds, which leaves a single NOT per row for hosts
+// without andn (the "lane complementing" transform of the Keccak
+// implementation overview)
+#define KECCAK_CHI_IOTA_COMPLEMENTED(E, rc) \
+	E##ba = Bba ^ (Bbe | Bbi) ^ (rc); E##be = Bbe ^ (~Bbi | Bbo); E##bi = Bbi ^ (Bbo & Bbu); \
+	E##bo = Bbo ^ (Bbu | Bba); E##bu = Bbu ^ (Bba & Bbe); \
+	E##ga = Bga ^ (Bge | Bgi); E##ge = Bge ^ (Bgi & Bgo); E##gi = Bgi ^ (Bgo | ~Bgu); \
+	E##go = Bgo ^ (Bgu | Bga); E##gu = Bgu ^ (Bga & Bge); \
+	E##ka = Bka ^ (Bke | Bki); E##ke = Bke ^ (Bki & Bko); E##ki = Bki ^ (~Bko & Bku); \
+	E##ko = ~Bko ^ (Bku | Bka); E##ku = Bku ^ (Bka & Bke); \
+	E##ma = Bma ^ (Bme & Bmi); E##me = Bme ^ (Bmi | Bmo); E##mi = Bmi ^ (~Bmo | Bmu); \
+	E##mo = ~Bmo ^ (Bmu & Bma); E##mu = Bmu ^ (Bma | Bme); \
+	E##sa = Bsa ^ (~Bse & Bsi); E##se = ~Bse ^ (Bsi | Bso); E##si = Bsi ^ (Bso & Bsu); \
+	E##so = Bso ^ (Bsu | Bsa); E##su = Bsu ^ (Bsa & Bse)
+
+// the lanes of a state array KECCAK_CHI_IOTA_COMPLEMENTED expects inverted
+#define KECCAK_COMPLEMENT_LANES(a) \
+	a[1] = ~a[1]; a[2] = ~a[2]; a[8] = ~a[8]; a[12] = ~a[12]; a[17] = ~a[17]; a[20] = ~a[20]
+
+/**
+ * An even number of rounds of the lanes of type T of the state a with the
+ * round constants RC(0) .. RC(rounds - 1), two at a time so the lanes go back
+ * and forth between A and E
+ */
+#define KECCAK_PERMUTE(T, a, rounds, RC, CHI) \
+	KECCAK_DECLARE_LANES(T, A); \
+	KECCAK_DECLARE_LANES(T, E); \
+	T Ca, Ce, Ci, Co, Cu, Da, De, Di, Do, Du; \
+	KECCAK_DECLARE_LANES(T, B); \
+	KECCAK_COPY_LANES(A, a, KECCAK_LOAD); \
+	for (int round = 0; round < (rounds); round += 2) { \
+		KECCAK_THETA_RHO_PI(A); \
+		CHI(E, RC(round)); \
+		KECCAK_THETA_RHO_PI(E); \
+		CHI(A, RC(round + 1)); \
+	} \
+	KECCAK_COPY_LANES(A, a, KECCAK_STORE)
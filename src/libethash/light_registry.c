@@ -0,0 +1,258 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file light_registry.c
+ * @date 2018
+ *
+ * Shares light caches between the users of a process, see
+ * @ref ethash_light_registry_new(). The caches nobody holds are offered to
+ * the memory budget for eviction, ordered by the clock of memory_budget.h so
+ * that the least recently used one of all registries goes first.
+ */
+
+#include <stdlib.h>
+#include "ethash.h"
+#include "internal.h"
+#include "memory_budget.h"
+#include "threads.h"
+
+struct ethash_light_entry {
+	uint64_t epoch;
+	ethash_light_t light;        ///< NULL while being built or if the build failed
+	unsigned refs;               ///< holders, including the callers waiting for the build
+	bool building;
+	uint64_t last_used;          ///< from ethash_budget_tick()
+	struct ethash_light_entry* next;
+};
+
+struct ethash_light_registry {
+	unsigned capacity;
+	uint64_t cache_size;         ///< fixed cache size or 0 for the size of each epoch
+	struct ethash_budget_reclaimer reclaimer;
+
+	ethash_mutex_t lock;         ///< protects everything below
+	ethash_cond_t built;         ///< signalled whenever a build finishes
+	struct ethash_light_entry* entries;
+	unsigned count;
+};
+
+static void ethash_light_registry_unlink(struct ethash_light_registry* registry, struct ethash_light_entry* entry)
+{
+	struct ethash_light_entry** link = &registry->entries;
+	while (*link != entry) {
+		link = &(*link)->next;
+	}
+	*link = entry->next;
+	registry->count--;
+}
+
+// the least recently used cache nobody holds, the lock must be held
+static struct ethash_light_entry* ethash_light_registry_lru(struct ethash_light_registry* registry)
+{
+	struct ethash_light_entry* lru = NULL;
+	for (struct ethash_light_entry* entry = registry->entries; entry; entry = entry->next) {
+		if (entry->refs == 0 && (!lru || entry->last_used < lru->last_used)) {
+			lru = entry;
+		}
+	}
+	return lru;
+}
+
+static void ethash_light_registry_free_entry(struct ethash_light_registry* registry, struct ethash_light_entry* entry)
+{
+	ethash_light_registry_unlink(registry, entry);
+	ethash_light_delete(entry->light);
+	free(entry);
+}
+
+// evict the least recently used caches nobody holds, the lock must be held
+static void ethash_light_registry_evict(struct ethash_light_registry* registry)
+{
+	while (registry->count > registry->capacity) {
+		struct ethash_light_entry* lru = ethash_light_registry_lru(registry);
+		if (!lru) {
+			// every cache is in use, the registry shrinks again as they are released
+			return;
+		}
+		ethash_light_registry_free_entry(registry, lru);
+	}
+}
+
+static uint64_t ethash_light_registry_oldest(void* ctx)
+{
+	struct ethash_light_registry* registry = ctx;
+	ethash_mutex_lock(&registry->lock);
+	struct ethash_light_entry const* lru = ethash_light_registry_lru(registry);
+	uint64_t const ret = lru ? lru->last_used : UINT64_MAX;
+	ethash_mutex_unlock(&registry->lock);
+	return ret;
+}
+
+static bool ethash_light_registry_reclaim(void* ctx)
+{
+	struct ethash_light_registry* registry = ctx;
+	ethash_mutex_lock(&registry->lock);
+	struct ethash_light_entry* lru = ethash_light_registry_lru(registry);
+	if (lru) {
+		ethash_light_registry_free_entry(registry, lru);
+	}
+	ethash_mutex_unlock(&registry->lock);
+	return lru != NULL;
+}
+
+static ethash_light_t ethash_light_registry_generate(struct ethash_light_registry* registry, uint64_t epoch)
+{
+	uint64_t const block_number = epoch * ETHASH_EPOCH_LENGTH;
+	if (registry->cache_size == 0) {
+		// goes through the light cache files
+		return ethash_light_new(block_number);
+	}
+	ethash_h256_t const seedhash = ethash_get_seedhash(block_number);
+	ethash_light_t light = ethash_light_new_internal(registry->cache_size, &seedhash);
+	if (light) {
+		light->block_number = block_number;
+	}
+	return light;
+}
+
+ethash_light_registry_t ethash_light_registry_new_internal(unsigned capacity, uint64_t cache_size)
+{
+	struct ethash_light_registry* ret = calloc(1, sizeof(*ret));
+	if (!ret) {
+		return NULL;
+	}
+	ret->capacity = capacity;
+	ret->cache_size = cache_size;
+	if (!ethash_mutex_init(&ret->lock)) {
+		goto fail_free_registry;
+	}
+	if (!ethash_cond_init(&ret->built)) {
+		goto fail_destroy_lock;
+	}
+	ret->reclaimer.oldest = ethash_light_registry_oldest;
+	ret->reclaimer.evict = ethash_light_registry_reclaim;
+	ret->reclaimer.ctx = ret;
+	ethash_budget_add_reclaimer(&ret->reclaimer);
+	return ret;
+
+fail_destroy_lock:
+	ethash_mutex_destroy(&ret->lock);
+fail_free_registry:
+	free(ret);
+	return NULL;
+}
+
+ethash_light_registry_t ethash_light_registry_new(unsigned capacity)
+{
+	return ethash_light_registry_new_internal(capacity, 0);
+}
+
+void ethash_light_registry_delete(ethash_light_registry_t registry)
+{
+	ethash_budget_remove_reclaimer(&registry->reclaimer);
+	while (registry->entries) {
+		struct ethash_light_entry* entry = registry->entries;
+		registry->entries = entry->next;
+		if (entry->light) {
+			ethash_light_delete(entry->light);
+		}
+		free(entry);
+	}
+	ethash_cond_destroy(&registry->built);
+	ethash_mutex_destroy(&registry->lock);
+	free(registry);
+}
+
+ethash_light_t ethash_light_registry_acquire(ethash_light_registry_t registry, uint64_t block_number)
+{
+	uint64_t const epoch = block_number / ETHASH_EPOCH_LENGTH;
+	if (registry->cache_size == 0 && epoch >= ETHASH_MAX_EPOCHS) {
+		return NULL;
+	}
+	ethash_mutex_lock(&registry->lock);
+	struct ethash_light_entry* entry = registry->entries;
+	while (entry && entry->epoch != epoch) {
+		entry = entry->next;
+	}
+	if (entry) {
+		entry->refs++;
+		while (entry->building) {
+			ethash_cond_wait(&registry->built, &registry->lock);
+		}
+	} else {
+		entry = calloc(1, sizeof(*entry));
+		if (!entry) {
+			ethash_mutex_unlock(&registry->lock);
+			return NULL;
+		}
+		entry->epoch = epoch;
+		entry->refs = 1;
+		entry->building = true;
+		entry->next = registry->entries;
+		registry->entries = entry;
+		registry->count++;
+
+		// build without the lock so that other epochs can be served meanwhile,
+		// callers asking for this one wait for us instead of building it again
+		ethash_mutex_unlock(&registry->lock);
+		ethash_light_t light = ethash_light_registry_generate(registry, epoch);
+		ethash_mutex_lock(&registry->lock);
+		entry->light = light;
+		entry->building = false;
+		if (!light) {
+			// later callers retry, the ones waiting now give up with us
+			ethash_light_registry_unlink(registry, entry);
+		}
+		ethash_cond_broadcast(&registry->built);
+	}
+
+	ethash_light_t const light = entry->light;
+	if (light) {
+		entry->last_used = ethash_budget_tick();
+		ethash_light_registry_evict(registry);
+	} else if (--entry->refs == 0) {
+		free(entry);
+	}
+	ethash_mutex_unlock(&registry->lock);
+	return light;
+}
+
+void ethash_light_registry_release(ethash_light_registry_t registry, ethash_light_t light)
+{
+	bool idle = false;
+	ethash_mutex_lock(&registry->lock);
+	for (struct ethash_light_entry* entry = registry->entries; entry; entry = entry->next) {
+		if (entry->light == light) {
+			idle = --entry->refs == 0;
+			entry->last_used = ethash_budget_tick();
+			break;
+		}
+	}
+	ethash_light_registry_evict(registry);
+	ethash_mutex_unlock(&registry->lock);
+	if (idle) {
+		// builds waiting for memory can evict it now
+		ethash_budget_notify();
+	}
+}
+
+unsigned ethash_light_registry_size(ethash_light_registry_t registry)
+{
+	ethash_mutex_lock(&registry->lock);
+	unsigned const count = registry->count;
+	ethash_mutex_unlock(&registry->lock);
+	return count;
+}
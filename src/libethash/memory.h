@@ -0,0 +1,159 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file memory.h
+ * @date 2018
+ *
+ * Allocation of the large anonymous buffers holding the light cache and the
+ * DAG, optionally backed by huge pages. The implementations live in
+ * memory_posix.c and memory_win32.c
+ */
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+#include "ethash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ethash_memory {
+	void* base;                 ///< Start of the mapping, NULL if nothing is allocated
+	size_t size;                ///< Length of the mapping, at least the requested size
+	enum ethash_page_mode mode; ///< How the mapping is backed
+	/// Where @a base came from, NULL for memory of the library itself
+	ethash_memory_provider_t const* provider;
+};
+
+/**
+ * Allocate zero initialised anonymous memory
+ *
+ * Huge pages are tried in the order allowed by @a policy: explicit 1 GB
+ * pages, explicit 2 MB pages, then transparent huge pages. A huge page size
+ * is skipped when rounding @a size up to it would waste more than an eighth
+ * of the allocation. Regular pages are used if none of them are available.
+ *
+ * @param[out] mem       The allocated memory and the mode actually in use
+ * @param size           The number of bytes to allocate
+ * @param policy         The huge page policy
+ * @return               true on success, false if no memory could be allocated
+ */
+bool ethash_memory_alloc(struct ethash_memory* mem, size_t size, enum ethash_huge_pages policy);
+
+/**
+ * Make memory from @ref ethash_memory_alloc() read only and executable, once
+ * machine code has been written to it
+ *
+ * @return               true on success, false if the protection could not be changed
+ */
+bool ethash_memory_protect_exec(struct ethash_memory* mem);
+
+/**
+ * Release memory from @ref ethash_memory_alloc(), a DAG file mapping
+ * recorded with mode ETHASH_PAGES_FILE or @ref ethash_memory_provider_alloc().
+ * Does nothing if @a mem->base is NULL.
+ */
+void ethash_memory_free(struct ethash_memory* mem);
+
+/**
+ * Keep the pages of the @a size bytes at @a base in physical memory
+ *
+ * If the limit of the process on locked memory is in the way, it is raised
+ * as far as the operating system allows and the lock tried once more.
+ *
+ * @return               false if the pages could not be locked
+ */
+bool ethash_memory_lock(void const* base, size_t size);
+
+/**
+ * Undo @ref ethash_memory_lock(), before the memory is freed or pooled
+ */
+void ethash_memory_unlock(void const* base, size_t size);
+
+/**
+ * Allocate memory like @ref ethash_memory_alloc(), taking over a buffer of the
+ * pool of @ref ethash_set_memory_pool() if one fits
+ *
+ * Only fresh memory is zero initialised, a buffer from the pool keeps what
+ * it held.
+ */
+bool ethash_memory_pool_alloc(struct ethash_memory* mem, size_t size, enum ethash_huge_pages policy);
+
+/**
+ * Release memory from @ref ethash_memory_pool_alloc() or any other source
+ * @ref ethash_memory_free() takes, keeping anonymous memory in the pool while
+ * it fits in the limit of @ref ethash_set_memory_pool()
+ */
+void ethash_memory_pool_free(struct ethash_memory* mem);
+
+/**
+ * Allocate memory for @a use with the alloc function of @a provider
+ *
+ * @return               true on success, false if the provider had no memory
+ */
+bool ethash_memory_provider_alloc(
+	struct ethash_memory* mem,
+	ethash_memory_provider_t const* provider,
+	size_t size,
+	enum ethash_memory_use use
+);
+
+/**
+ * Map the first @a size bytes of the file @a fd with the map_file function of
+ * @a provider, recorded with mode ETHASH_PAGES_FILE
+ *
+ * @return               true on success, false if the provider could not map it
+ */
+bool ethash_memory_provider_map_file(
+	struct ethash_memory* mem,
+	ethash_memory_provider_t const* provider,
+	int fd,
+	size_t size,
+	bool writable
+);
+
+/**
+ * Pass @a advice about @a mem to the advise function of @a provider. Without
+ * one ETHASH_MEMORY_ADVICE_WILLNEED reads the memory ahead and anything else
+ * is ignored.
+ *
+ * @param provider       The provider of the handle, may be NULL
+ */
+void ethash_memory_advise(
+	struct ethash_memory const* mem,
+	ethash_memory_provider_t const* provider,
+	enum ethash_memory_advice advice
+);
+
+/**
+ * Add what the @a size bytes at @a base cost to @a info: the mapped and
+ * resident bytes, and the ones in huge pages according to @a mode or, for
+ * transparent huge pages, to the operating system. Memory of malloc() is
+ * counted from the pages it spans.
+ *
+ * @return               false if the residency could not be queried, in which
+ *                       case the whole range is counted resident
+ */
+bool ethash_memory_add_info(
+	void const* base,
+	size_t size,
+	enum ethash_page_mode mode,
+	ethash_memory_info_t* info
+);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,192 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file memory_budget.c
+ * @date 2018
+ *
+ * The process wide budget of @ref ethash_set_memory_budget(). Reservations
+ * are few, one per cache or DAG, so one lock guards the counters. Evictions
+ * take the reclaimers lock and then the lock of the reclaimer, which frees
+ * handlers and so takes the budget lock last. Nothing waits for the reclaimers
+ * lock or a reclaimer while holding the budget lock.
+ */
+
+#include <stdlib.h>
+#include "ethash.h"
+#include "memory_budget.h"
+#include "io.h"
+#include "threads.h"
+
+static ethash_once_t budget_once = ETHASH_ONCE_INIT;
+static ethash_mutex_t budget_lock;           ///< protects the counters below
+static ethash_cond_t budget_released;        ///< signalled whenever bytes are released or reclaimable
+static uint64_t budget_max_bytes = 0;
+static uint64_t budget_max_wait_us = 0;
+static ethash_memory_budget_stats_t budget_stats;
+static ethash_mutex_t reclaimers_lock;       ///< protects the list, held during evictions
+static struct ethash_budget_reclaimer* reclaimers;
+static uint64_t volatile budget_clock = 0;
+
+static void ethash_budget_init(void)
+{
+	ethash_mutex_init(&budget_lock);
+	ethash_cond_init(&budget_released);
+	ethash_mutex_init(&reclaimers_lock);
+}
+
+uint64_t ethash_budget_tick(void)
+{
+	return ethash_atomic_fetch_add_u64(&budget_clock, 1) + 1;
+}
+
+void ethash_set_memory_budget(uint64_t max_bytes, uint64_t max_wait_ms)
+{
+	ethash_call_once(&budget_once, ethash_budget_init);
+	ethash_mutex_lock(&budget_lock);
+	budget_max_bytes = max_bytes;
+	budget_max_wait_us = max_wait_ms * 1000;
+	// waiters may fit now
+	ethash_cond_broadcast(&budget_released);
+	ethash_mutex_unlock(&budget_lock);
+}
+
+uint64_t ethash_get_memory_budget(void)
+{
+	ethash_call_once(&budget_once, ethash_budget_init);
+	ethash_mutex_lock(&budget_lock);
+	uint64_t const ret = budget_max_bytes;
+	ethash_mutex_unlock(&budget_lock);
+	return ret;
+}
+
+ethash_memory_budget_stats_t ethash_get_memory_budget_stats(void)
+{
+	ethash_call_once(&budget_once, ethash_budget_init);
+	ethash_mutex_lock(&budget_lock);
+	ethash_memory_budget_stats_t const ret = budget_stats;
+	ethash_mutex_unlock(&budget_lock);
+	return ret;
+}
+
+// free the least recently used handler of all reclaimers, false if none has one
+static bool ethash_budget_reclaim(void)
+{
+	ethash_mutex_lock(&reclaimers_lock);
+	struct ethash_budget_reclaimer* lru = NULL;
+	uint64_t lru_used = UINT64_MAX;
+	for (struct ethash_budget_reclaimer* r = reclaimers; r; r = r->next) {
+		uint64_t const used = r->oldest(r->ctx);
+		if (used < lru_used) {
+			lru = r;
+			lru_used = used;
+		}
+	}
+	bool const freed = lru && lru->evict(lru->ctx);
+	ethash_mutex_unlock(&reclaimers_lock);
+	if (freed) {
+		ethash_mutex_lock(&budget_lock);
+		budget_stats.evictions++;
+		ethash_mutex_unlock(&budget_lock);
+	}
+	return freed;
+}
+
+bool ethash_budget_reserve(uint64_t bytes)
+{
+	ethash_call_once(&budget_once, ethash_budget_init);
+	uint64_t const start = ethash_time_us();
+	bool waited = false;
+	ethash_mutex_lock(&budget_lock);
+	while (budget_max_bytes && budget_stats.reserved + bytes > budget_max_bytes) {
+		if (bytes > budget_max_bytes) {
+			goto reject;
+		}
+		// idle caches are freed before the deadline counts, even without any wait
+		ethash_mutex_unlock(&budget_lock);
+		bool const freed = ethash_budget_reclaim();
+		ethash_mutex_lock(&budget_lock);
+		if (freed || !budget_max_bytes || budget_stats.reserved + bytes <= budget_max_bytes) {
+			continue;
+		}
+		uint64_t const now = ethash_time_us();
+		if (now - start >= budget_max_wait_us) {
+			goto reject;
+		}
+		waited = true;
+		ethash_cond_timed_wait(&budget_released, &budget_lock, budget_max_wait_us - (now - start));
+	}
+	budget_stats.reserved += bytes;
+	if (budget_stats.reserved > budget_stats.peak) {
+		budget_stats.peak = budget_stats.reserved;
+	}
+	if (waited) {
+		budget_stats.waits++;
+	}
+	ethash_mutex_unlock(&budget_lock);
+	return true;
+
+reject:
+	budget_stats.rejected++;
+	ETHASH_CRITICAL(
+		"%" PRIu64 " bytes do not fit in the memory budget of %" PRIu64 " bytes with %" PRIu64 " in use.",
+		bytes, budget_max_bytes, budget_stats.reserved
+	);
+	ethash_mutex_unlock(&budget_lock);
+	return false;
+}
+
+void ethash_budget_release(uint64_t bytes)
+{
+	if (!bytes) {
+		return;
+	}
+	ethash_call_once(&budget_once, ethash_budget_init);
+	ethash_mutex_lock(&budget_lock);
+	budget_stats.reserved -= bytes;
+	ethash_cond_broadcast(&budget_released);
+	ethash_mutex_unlock(&budget_lock);
+}
+
+void ethash_budget_notify(void)
+{
+	ethash_call_once(&budget_once, ethash_budget_init);
+	ethash_mutex_lock(&budget_lock);
+	ethash_cond_broadcast(&budget_released);
+	ethash_mutex_unlock(&budget_lock);
+}
+
+void ethash_budget_add_reclaimer(struct ethash_budget_reclaimer* reclaimer)
+{
+	ethash_call_once(&budget_once, ethash_budget_init);
+	ethash_mutex_lock(&reclaimers_lock);
+	reclaimer->next = reclaimers;
+	reclaimers = reclaimer;
+	ethash_mutex_unlock(&reclaimers_lock);
+}
+
+void ethash_budget_remove_reclaimer(struct ethash_budget_reclaimer* reclaimer)
+{
+	ethash_call_once(&budget_once, ethash_budget_init);
+	ethash_mutex_lock(&reclaimers_lock);
+	struct ethash_budget_reclaimer** link = &reclaimers;
+	while (*link && *link != reclaimer) {
+		link = &(*link)->next;
+	}
+	if (*link) {
+		*link = reclaimer->next;
+	}
+	ethash_mutex_unlock(&reclaimers_lock);
+}
@@ -0,0 +1,80 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file memory_budget.h
+ * @date 2018
+ *
+ * The bytes reserved by the light and full handlers of the process, see
+ * @ref ethash_set_memory_budget(). The implementation lives in memory_budget.c
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Holders of handlers that can free some on request, like the light cache registries
+struct ethash_budget_reclaimer {
+	/// The last use of the least recently used handler @a evict would free,
+	/// from @ref ethash_budget_tick(), or UINT64_MAX if there is none
+	uint64_t (*oldest)(void* ctx);
+	/// Free that handler, false if there is none any more
+	bool (*evict)(void* ctx);
+	void* ctx;
+	struct ethash_budget_reclaimer* next;   ///< owned by memory_budget.c
+};
+
+/**
+ * Get the next value of a clock shared by all reclaimers, to order their uses by
+ */
+uint64_t ethash_budget_tick(void);
+
+/**
+ * Reserve @a bytes for a new handler or a region of one, freeing the least recently used handlers
+ * of the reclaimers or waiting for others to be freed while they do not fit
+ *
+ * Must not be called with the lock of a reclaimer held.
+ *
+ * @return               false if they did not fit in time or are larger than the budget
+ */
+bool ethash_budget_reserve(uint64_t bytes);
+
+/**
+ * Hand back @a bytes of @ref ethash_budget_reserve()
+ */
+void ethash_budget_release(uint64_t bytes);
+
+/**
+ * Wake the reservations waiting for memory, for a reclaimer with a handler it
+ * can free now
+ */
+void ethash_budget_notify(void);
+
+/**
+ * Offer the handlers of @a reclaimer for eviction, until ethash_budget_remove_reclaimer()
+ */
+void ethash_budget_add_reclaimer(struct ethash_budget_reclaimer* reclaimer);
+
+/**
+ * Withdraw @a reclaimer, waiting for an eviction from it in progress to finish
+ */
+void ethash_budget_remove_reclaimer(struct ethash_budget_reclaimer* reclaimer);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,150 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file memory_pool.c
+ * @date 2018
+ *
+ * Reuse of the anonymous memory of deleted light caches and DAGs, see
+ * @ref ethash_set_memory_pool()
+ */
+
+#include "memory.h"
+#include "threads.h"
+
+// at most a light cache and a DAG of two epochs each
+#define ETHASH_MEMORY_POOL_ENTRIES 4
+
+// the room allocations leave to grow into, a sixty-fourth of the size. The
+// cache and the DAG grow by less than 1% per epoch
+static size_t ethash_memory_pool_slack(size_t size)
+{
+	return size / 64;
+}
+
+static uint64_t volatile memory_pool_limit = 0;
+static ethash_once_t memory_pool_once = ETHASH_ONCE_INIT;
+static ethash_mutex_t memory_pool_lock;
+// protected by memory_pool_lock, oldest first
+static struct ethash_memory memory_pool_entries[ETHASH_MEMORY_POOL_ENTRIES];
+static unsigned memory_pool_count = 0;
+static uint64_t memory_pool_bytes = 0;
+
+static void ethash_memory_pool_init(void)
+{
+	ethash_mutex_init(&memory_pool_lock);
+}
+
+// the largest pages of a mode, in the order of enum ethash_huge_pages
+static enum ethash_huge_pages ethash_memory_pool_pages(enum ethash_page_mode mode)
+{
+	switch (mode) {
+	case ETHASH_PAGES_TRANSPARENT:
+		return ETHASH_HUGE_PAGES_TRANSPARENT;
+	case ETHASH_PAGES_HUGETLB_2MB:
+		return ETHASH_HUGE_PAGES_2MB;
+	case ETHASH_PAGES_HUGETLB_1GB:
+		return ETHASH_HUGE_PAGES_1GB;
+	default:
+		return ETHASH_HUGE_PAGES_OFF;
+	}
+}
+
+static void ethash_memory_pool_remove(unsigned i, struct ethash_memory* mem)
+{
+	*mem = memory_pool_entries[i];
+	memory_pool_bytes -= mem->size;
+	memory_pool_count--;
+	for (; i != memory_pool_count; ++i) {
+		memory_pool_entries[i] = memory_pool_entries[i + 1];
+	}
+}
+
+// release the oldest buffers until @a bytes more fit in @a limit and a slot
+// is free, the lock must be held
+static void ethash_memory_pool_trim(uint64_t limit, uint64_t bytes)
+{
+	while (memory_pool_count != 0 &&
+		(memory_pool_count == ETHASH_MEMORY_POOL_ENTRIES || memory_pool_bytes + bytes > limit)) {
+		struct ethash_memory oldest;
+		ethash_memory_pool_remove(0, &oldest);
+		ethash_memory_free(&oldest);
+	}
+}
+
+void ethash_set_memory_pool(uint64_t bytes)
+{
+	ethash_call_once(&memory_pool_once, ethash_memory_pool_init);
+	ethash_mutex_lock(&memory_pool_lock);
+	ethash_atomic_store_u64(&memory_pool_limit, bytes);
+	ethash_memory_pool_trim(bytes, 0);
+	ethash_mutex_unlock(&memory_pool_lock);
+}
+
+uint64_t ethash_get_memory_pool(void)
+{
+	return ethash_atomic_load_u64(&memory_pool_limit);
+}
+
+uint64_t ethash_memory_pool_size(void)
+{
+	ethash_call_once(&memory_pool_once, ethash_memory_pool_init);
+	ethash_mutex_lock(&memory_pool_lock);
+	uint64_t const bytes = memory_pool_bytes;
+	ethash_mutex_unlock(&memory_pool_lock);
+	return bytes;
+}
+
+bool ethash_memory_pool_alloc(struct ethash_memory* mem, size_t size, enum ethash_huge_pages policy)
+{
+	if (ethash_get_memory_pool() == 0 || size == 0) {
+		return ethash_memory_alloc(mem, size, policy);
+	}
+	ethash_call_once(&memory_pool_once, ethash_memory_pool_init);
+	ethash_mutex_lock(&memory_pool_lock);
+	// the smallest buffer that fits without wasting more than the slack of
+	// four allocations, with pages the policy allows
+	unsigned best = memory_pool_count;
+	for (unsigned i = 0; i != memory_pool_count; ++i) {
+		struct ethash_memory const* entry = &memory_pool_entries[i];
+		if (entry->size >= size && entry->size - size <= 4 * ethash_memory_pool_slack(size) &&
+			ethash_memory_pool_pages(entry->mode) <= policy &&
+			(best == memory_pool_count || entry->size < memory_pool_entries[best].size)) {
+			best = i;
+		}
+	}
+	bool const reused = best != memory_pool_count;
+	if (reused) {
+		ethash_memory_pool_remove(best, mem);
+	}
+	ethash_mutex_unlock(&memory_pool_lock);
+	return reused || ethash_memory_alloc(mem, size + ethash_memory_pool_slack(size), policy);
+}
+
+void ethash_memory_pool_free(struct ethash_memory* mem)
+{
+	uint64_t const limit = ethash_get_memory_pool();
+	if (!mem->base || mem->mode == ETHASH_PAGES_FILE || mem->provider || mem->size > limit) {
+		ethash_memory_free(mem);
+		return;
+	}
+	ethash_call_once(&memory_pool_once, ethash_memory_pool_init);
+	ethash_mutex_lock(&memory_pool_lock);
+	ethash_memory_pool_trim(limit, mem->size);
+	memory_pool_entries[memory_pool_count++] = *mem;
+	memory_pool_bytes += mem->size;
+	ethash_mutex_unlock(&memory_pool_lock);
+	mem->base = NULL;
+}
@@ -0,0 +1,259 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file memory_posix.c
+ * @date 2018
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "memory.h"
+#include "mmap.h"
+#include "numa.h"
+
+#if defined(__linux__) && !defined(MAP_HUGE_SHIFT)
+#define MAP_HUGE_SHIFT 26
+#endif
+
+#define ETHASH_2MB (2u << 20)
+#define ETHASH_1GB (1u << 30)
+
+static size_t round_up(size_t size, size_t page)
+{
+	return (size + page - 1) / page * page;
+}
+
+// only use pages that don't waste more than an eighth of the allocation
+static bool worth_it(size_t size, size_t page)
+{
+	return round_up(size, page) - size <= size / 8;
+}
+
+static void* map_anonymous(size_t size, int flags)
+{
+	void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+	return p == MAP_FAILED ? NULL : p;
+}
+
+#if defined(MAP_HUGETLB)
+static bool map_hugetlb(struct ethash_memory* mem, size_t size, size_t page, int log2_page, enum ethash_page_mode mode)
+{
+	if (!worth_it(size, page)) {
+		return false;
+	}
+	size_t const rounded = round_up(size, page);
+	void* p = map_anonymous(rounded, MAP_HUGETLB | (log2_page << MAP_HUGE_SHIFT));
+	if (!p) {
+		return false;
+	}
+	mem->base = p;
+	mem->size = rounded;
+	mem->mode = mode;
+	return true;
+}
+#endif
+
+#if defined(MADV_HUGEPAGE)
+// transparent huge pages need a 2 MB aligned range, so over-allocate and trim
+static bool map_transparent(struct ethash_memory* mem, size_t size)
+{
+	if (!worth_it(size, ETHASH_2MB)) {
+		return false;
+	}
+	size_t const rounded = round_up(size, ETHASH_2MB);
+	char* p = map_anonymous(rounded + ETHASH_2MB, 0);
+	if (!p) {
+		return false;
+	}
+	char* aligned = (char*)round_up((size_t)p, ETHASH_2MB);
+	if (aligned != p) {
+		munmap(p, (size_t)(aligned - p));
+	}
+	size_t const tail = (size_t)(p + rounded + ETHASH_2MB - (aligned + rounded));
+	if (tail) {
+		munmap(aligned + rounded, tail);
+	}
+	mem->base = aligned;
+	mem->size = rounded;
+	mem->mode = madvise(aligned, rounded, MADV_HUGEPAGE) == 0 ?
+		ETHASH_PAGES_TRANSPARENT : ETHASH_PAGES_DEFAULT;
+	return true;
+}
+#endif
+
+bool ethash_memory_alloc(struct ethash_memory* mem, size_t size, enum ethash_huge_pages policy)
+{
+	mem->base = NULL;
+	mem->size = 0;
+	mem->mode = ETHASH_PAGES_DEFAULT;
+	mem->provider = NULL;
+	if (size == 0) {
+		return false;
+	}
+#if defined(MAP_HUGETLB)
+	if (policy == ETHASH_HUGE_PAGES_1GB && map_hugetlb(mem, size, ETHASH_1GB, 30, ETHASH_PAGES_HUGETLB_1GB)) {
+		return true;
+	}
+	if (policy >= ETHASH_HUGE_PAGES_2MB && map_hugetlb(mem, size, ETHASH_2MB, 21, ETHASH_PAGES_HUGETLB_2MB)) {
+		return true;
+	}
+#endif
+#if defined(MADV_HUGEPAGE)
+	if (policy != ETHASH_HUGE_PAGES_OFF && map_transparent(mem, size)) {
+		return true;
+	}
+#endif
+	mem->base = map_anonymous(size, 0);
+	mem->size = size;
+	return mem->base != NULL;
+}
+
+bool ethash_memory_protect_exec(struct ethash_memory* mem)
+{
+	return mprotect(mem->base, mem->size, PROT_READ | PROT_EXEC) == 0;
+}
+
+void ethash_memory_free(struct ethash_memory* mem)
+{
+	if (mem->base && mem->provider) {
+		if (mem->provider->free) {
+			mem->provider->free(mem->provider->user, mem->base, mem->size);
+		}
+		mem->base = NULL;
+	} else if (mem->base) {
+		// could check that munmap(..) == 0 but even if it did not can't really do anything here
+		munmap(mem->base, mem->size);
+		mem->base = NULL;
+	}
+}
+
+bool ethash_memory_lock(void const* base, size_t size)
+{
+	if (mlock(base, size) == 0) {
+		return true;
+	}
+#if defined(RLIMIT_MEMLOCK)
+	// unprivileged processes may raise their soft limit up to the hard one
+	struct rlimit limit;
+	if ((errno == ENOMEM || errno == EPERM) &&
+		getrlimit(RLIMIT_MEMLOCK, &limit) == 0 &&
+		limit.rlim_cur != limit.rlim_max) {
+		limit.rlim_cur = limit.rlim_max;
+		return setrlimit(RLIMIT_MEMLOCK, &limit) == 0 && mlock(base, size) == 0;
+	}
+#endif
+	return false;
+}
+
+void ethash_memory_unlock(void const* base, size_t size)
+{
+	munlock(base, size);
+}
+
+#if defined(__linux__)
+// Sum the AnonHugePages of the mappings overlapping a range
+static uint64_t transparent_huge_bytes(void const* base, size_t size)
+{
+	FILE* f = fopen("/proc/self/smaps", "r");
+	if (!f) {
+		return 0;
+	}
+	unsigned long long const begin = (uintptr_t)base;
+	unsigned long long const end = begin + size;
+	uint64_t bytes = 0;
+	bool inside = false;
+	char line[256];
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long long from, to, kb;
+		// only the first line of a mapping starts with its address range
+		if (sscanf(line, "%llx-%llx ", &from, &to) == 2) {
+			inside = from < end && to > begin;
+		} else if (inside && sscanf(line, "AnonHugePages: %llu kB", &kb) == 1) {
+			bytes += kb * 1024;
+		}
+	}
+	fclose(f);
+	return bytes < size ? bytes : size;
+}
+typedef unsigned char mincore_vec_t;
+#else
+static uint64_t transparent_huge_bytes(void const* base, size_t size)
+{
+	(void)base;
+	(void)size;
+	return 0;
+}
+typedef char mincore_vec_t;
+#endif
+
+bool ethash_memory_add_info(
+	void const* base,
+	size_t size,
+	enum ethash_page_mode mode,
+	ethash_memory_info_t* info
+)
+{
+	if (!base || !size) {
+		return true;
+	}
+	info->allocated += size;
+	info->file_backed |= mode == ETHASH_PAGES_FILE;
+	if (mode == ETHASH_PAGES_HUGETLB_2MB || mode == ETHASH_PAGES_HUGETLB_1GB) {
+		info->huge_pages += size;
+	} else if (mode == ETHASH_PAGES_TRANSPARENT) {
+		info->huge_pages += transparent_huge_bytes(base, size);
+	}
+	// the pages spanned by the range, a page at a time of mincore
+	size_t const page = (size_t)sysconf(_SC_PAGESIZE);
+	uintptr_t const first = (uintptr_t)base / page * page;
+	size_t const span = round_up((uintptr_t)base + size - first, page);
+	mincore_vec_t vec[4096];
+	uint64_t resident = 0;
+	for (size_t offset = 0; offset < span; offset += sizeof(vec) * page) {
+		size_t const length = span - offset < sizeof(vec) * page ? span - offset : sizeof(vec) * page;
+		if (mincore((void*)(first + offset), length, vec) != 0) {
+			info->resident += size;
+			info->node_resident[0] += size;
+			return false;
+		}
+		for (size_t i = 0; i != length / page; ++i) {
+			resident += vec[i] & 1;
+		}
+	}
+	resident = resident * page < size ? resident * page : size;
+	info->resident += resident;
+	uint64_t nodes[ETHASH_NUMA_MAX_NODES] = { 0 };
+	if (ethash_numa_add_placement(base, size, page, nodes)) {
+		// whole pages, while a range of malloc() may only hold part of them
+		uint64_t placed = 0;
+		unsigned most = 0;
+		for (unsigned n = 0; n != ETHASH_NUMA_MAX_NODES; ++n) {
+			placed += nodes[n];
+			most = nodes[n] > nodes[most] ? n : most;
+		}
+		if (placed > resident) {
+			nodes[most] -= placed - resident < nodes[most] ? placed - resident : nodes[most];
+		}
+		for (unsigned n = 0; n != ETHASH_NUMA_MAX_NODES && n != ETHASH_MEMORY_INFO_NODES; ++n) {
+			info->node_resident[n] += nodes[n];
+		}
+	} else {
+		info->node_resident[0] += resident;
+	}
+	return true;
+}
@@ -0,0 +1,74 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file memory_provider.c
+ * @date 2018
+ *
+ * Memory of light caches and DAGs supplied by the application, see
+ * @ref ethash_memory_provider_t
+ */
+
+#include "memory.h"
+#include "mmap.h"
+
+bool ethash_memory_provider_alloc(
+	struct ethash_memory* mem,
+	ethash_memory_provider_t const* provider,
+	size_t size,
+	enum ethash_memory_use use
+)
+{
+	mem->base = size ? provider->alloc(provider->user, size, use) : NULL;
+	mem->size = size;
+	mem->mode = ETHASH_PAGES_DEFAULT;
+	mem->provider = mem->base ? provider : NULL;
+	return mem->base != NULL;
+}
+
+bool ethash_memory_provider_map_file(
+	struct ethash_memory* mem,
+	ethash_memory_provider_t const* provider,
+	int fd,
+	size_t size,
+	bool writable
+)
+{
+	mem->base = provider->map_file(provider->user, fd, size, writable);
+	mem->size = size;
+	mem->mode = ETHASH_PAGES_FILE;
+	mem->provider = mem->base ? provider : NULL;
+	return mem->base != NULL;
+}
+
+void ethash_memory_advise(
+	struct ethash_memory const* mem,
+	ethash_memory_provider_t const* provider,
+	enum ethash_memory_advice advice
+)
+{
+	if (!mem->base) {
+		return;
+	}
+	if (provider && provider->advise) {
+		provider->advise(provider->user, mem->base, mem->size, advice);
+		return;
+	}
+#ifdef MADV_WILLNEED
+	if (advice == ETHASH_MEMORY_ADVICE_WILLNEED) {
+		madvise(mem->base, mem->size, MADV_WILLNEED);
+	}
+#endif
+}
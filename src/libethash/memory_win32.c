@@ -0,0 +1,180 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file memory_win32.c
+ * @date 2018
+ *
+ * Large pages need the SeLockMemoryPrivilege on Windows. It is enabled on the
+ * first allocation with ETHASH_HUGE_PAGES_2MB or ETHASH_HUGE_PAGES_1GB, and
+ * without it, or for any other policy, memory has regular pages. There is
+ * nothing like transparent huge pages, and the large pages are always the
+ * minimum size of GetLargePageMinimum().
+ */
+
+#include "memory.h"
+#include "mmap.h"
+#include "threads.h"
+#include <windows.h>
+// QueryWorkingSetEx() from kernel32 rather than psapi.dll
+#define PSAPI_VERSION 2
+#include <psapi.h>
+
+// The size of large pages, 0 if the process may not allocate them
+static size_t large_page_size;
+static ethash_once_t large_pages_once = ETHASH_ONCE_INIT;
+
+static void ethash_large_pages_init(void)
+{
+	size_t const minimum = GetLargePageMinimum();
+	HANDLE token;
+	if (!minimum || !OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+		return;
+	}
+	TOKEN_PRIVILEGES privileges;
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	// succeeds with ERROR_NOT_ALL_ASSIGNED if the account does not hold the privilege
+	if (LookupPrivilegeValueA(NULL, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid) &&
+		AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) &&
+		GetLastError() == ERROR_SUCCESS) {
+		large_page_size = minimum;
+	}
+	CloseHandle(token);
+}
+
+// only use large pages that don't waste more than an eighth of the allocation
+static bool ethash_memory_alloc_large(struct ethash_memory* mem, size_t size)
+{
+	ethash_call_once(&large_pages_once, ethash_large_pages_init);
+	size_t const page = large_page_size;
+	if (!page) {
+		return false;
+	}
+	size_t const rounded = (size + page - 1) / page * page;
+	if (rounded - size > size / 8) {
+		return false;
+	}
+	void* const p = VirtualAlloc(NULL, rounded, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+	if (!p) {
+		return false;
+	}
+	mem->base = p;
+	mem->size = rounded;
+	mem->mode = page >= ((size_t)1 << 30) ? ETHASH_PAGES_HUGETLB_1GB : ETHASH_PAGES_HUGETLB_2MB;
+	return true;
+}
+
+bool ethash_memory_alloc(struct ethash_memory* mem, size_t size, enum ethash_huge_pages policy)
+{
+	mem->size = size;
+	mem->mode = ETHASH_PAGES_DEFAULT;
+	mem->provider = NULL;
+	if (size && policy >= ETHASH_HUGE_PAGES_2MB && ethash_memory_alloc_large(mem, size)) {
+		return true;
+	}
+	mem->base = size ? VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE) : NULL;
+	return mem->base != NULL;
+}
+
+bool ethash_memory_protect_exec(struct ethash_memory* mem)
+{
+	DWORD old;
+	if (!VirtualProtect(mem->base, mem->size, PAGE_EXECUTE_READ, &old)) {
+		return false;
+	}
+	return FlushInstructionCache(GetCurrentProcess(), mem->base, mem->size) != 0;
+}
+
+void ethash_memory_free(struct ethash_memory* mem)
+{
+	if (!mem->base) {
+		return;
+	}
+	if (mem->provider) {
+		if (mem->provider->free) {
+			mem->provider->free(mem->provider->user, mem->base, mem->size);
+		}
+	} else if (mem->mode == ETHASH_PAGES_FILE) {
+		munmap(mem->base, mem->size);
+	} else {
+		VirtualFree(mem->base, 0, MEM_RELEASE);
+	}
+	mem->base = NULL;
+}
+
+bool ethash_memory_lock(void const* base, size_t size)
+{
+	if (VirtualLock((LPVOID)base, size)) {
+		return true;
+	}
+	// locked pages count against the minimum working set, grow it by the region
+	SIZE_T min_size;
+	SIZE_T max_size;
+	HANDLE const process = GetCurrentProcess();
+	return GetLastError() == ERROR_WORKING_SET_QUOTA &&
+		GetProcessWorkingSetSize(process, &min_size, &max_size) &&
+		SetProcessWorkingSetSize(process, min_size + size, max_size + size) &&
+		VirtualLock((LPVOID)base, size);
+}
+
+void ethash_memory_unlock(void const* base, size_t size)
+{
+	VirtualUnlock((LPVOID)base, size);
+}
+
+bool ethash_memory_add_info(
+	void const* base,
+	size_t size,
+	enum ethash_page_mode mode,
+	ethash_memory_info_t* info
+)
+{
+	if (!base || !size) {
+		return true;
+	}
+	info->allocated += size;
+	info->file_backed |= mode == ETHASH_PAGES_FILE;
+	SYSTEM_INFO system;
+	GetSystemInfo(&system);
+	size_t const page = system.dwPageSize;
+	uintptr_t address = (uintptr_t)base / page * page;
+	uintptr_t const end = (uintptr_t)base + size;
+	// the host is a single NUMA node, see numa_win32.c
+	uint64_t resident = 0;
+	uint64_t large = 0;
+	PSAPI_WORKING_SET_EX_INFORMATION pages[1024];
+	while (address < end) {
+		DWORD count = 0;
+		for (; count != 1024 && address < end; ++count, address += page) {
+			pages[count].VirtualAddress = (PVOID)address;
+		}
+		if (!QueryWorkingSetEx(GetCurrentProcess(), pages, count * sizeof(pages[0]))) {
+			info->resident += size;
+			info->node_resident[0] += size;
+			return false;
+		}
+		for (DWORD i = 0; i != count; ++i) {
+			resident += pages[i].VirtualAttributes.Valid;
+			large += pages[i].VirtualAttributes.Valid && pages[i].VirtualAttributes.LargePage;
+		}
+	}
+	resident = resident * page < size ? resident * page : size;
+	large = large * page < size ? large * page : size;
+	info->resident += resident;
+	info->node_resident[0] += resident;
+	info->huge_pages += large;
+	return true;
+}
@@ -0,0 +1,370 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file merkle.c
+ * @date 2018
+ *
+ * The nodes of a tree are stored level by level from the leaves up, after a
+ * header of ETHASH_MERKLE_HEADER_SIZE bytes. Memory and file hold the same
+ * bytes, so a tree file is used by mapping it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "internal.h"
+#include "io.h"
+#include "mmap.h"
+#include "sha3.h"
+#include "threadpool.h"
+
+#define ETHASH_MERKLE_MAGIC 0x4d45524b4c453031ULL   ///< "MERKLE01"
+#define ETHASH_MERKLE_HEADER_SIZE 4096
+// nodes a thread claims at a time
+#define ETHASH_MERKLE_CHUNK 1024
+
+// the 64 bytes whose hash tells hash functions apart
+static char const merkle_probe[64] = "ethash Merkle tree hash function probe, 64 bytes like a pair....";
+
+struct ethash_merkle_header {
+	uint64_t magic;
+	uint64_t dag_size;
+	uint64_t leaf_size;
+	uint64_t leaf_count;
+	ethash_h256_t dag_id;        ///< SHA3-256 of the checksums of the DAG
+	ethash_h256_t hash_id;       ///< what the hash function makes of a fixed input
+};
+
+struct ethash_full_merkle {
+	struct ethash_memory memory;  ///< the header and the nodes, anonymous or the tree file
+	FILE* file;                   ///< the mapped tree file, NULL for a tree in memory
+	uint64_t size;                ///< the bytes of the header and the nodes
+	ethash_h256_t const* nodes;
+	unsigned depth;
+	uint64_t level_count[ETHASH_MERKLE_MAX_DEPTH + 1];
+	uint64_t level_offset[ETHASH_MERKLE_MAX_DEPTH + 1];
+};
+
+struct ethash_merkle_job {
+	uint8_t const* leaves;        ///< the DAG when hashing the leaves, else NULL
+	uint64_t leaf_size;
+	ethash_h256_t const* below;   ///< the level below when hashing inner nodes
+	uint64_t below_count;
+	ethash_h256_t* out;
+	uint64_t count;
+	ethash_merkle_hash_fn hash_fn;
+	void* user;
+	uint64_t volatile next;       ///< next unclaimed chunk
+};
+
+static void ethash_merkle_keccak(ethash_h256_t* out, void const* data, size_t size, void* user)
+{
+	(void)user;
+	SHA3_256(out, (uint8_t const*)data, size);
+}
+
+static void ethash_merkle_pair(
+	ethash_h256_t* out,
+	ethash_h256_t const* left,
+	ethash_h256_t const* right,
+	ethash_merkle_hash_fn hash_fn,
+	void* user
+)
+{
+	ethash_h256_t pair[2];
+	pair[0] = *left;
+	pair[1] = *right;
+	hash_fn(out, pair, sizeof(pair), user);
+}
+
+static void ethash_merkle_worker(void* arg)
+{
+	struct ethash_merkle_job* job = (struct ethash_merkle_job*)arg;
+	for (;;) {
+		uint64_t const begin = ethash_atomic_fetch_add_u64(&job->next, 1) * ETHASH_MERKLE_CHUNK;
+		if (begin >= job->count) {
+			break;
+		}
+		uint64_t const end = job->count - begin > ETHASH_MERKLE_CHUNK ? begin + ETHASH_MERKLE_CHUNK : job->count;
+		for (uint64_t i = begin; i != end; ++i) {
+			if (job->leaves) {
+				job->hash_fn(&job->out[i], job->leaves + i * job->leaf_size, (size_t)job->leaf_size, job->user);
+			} else if (2 * i + 1 < job->below_count) {
+				// the two children are adjacent
+				job->hash_fn(&job->out[i], &job->below[2 * i], 2 * sizeof(ethash_h256_t), job->user);
+			} else {
+				ethash_merkle_pair(&job->out[i], &job->below[2 * i], &job->below[2 * i], job->hash_fn, job->user);
+			}
+		}
+	}
+}
+
+// Hash one level of the tree, the leaves for @a level 0
+static void ethash_merkle_hash_level(
+	struct ethash_full_merkle* merkle,
+	unsigned level,
+	uint8_t const* dag,
+	uint64_t leaf_size,
+	ethash_merkle_hash_fn hash_fn,
+	void* user,
+	unsigned num_threads
+)
+{
+	struct ethash_merkle_job job;
+	job.leaves = level == 0 ? dag : NULL;
+	job.leaf_size = leaf_size;
+	job.below = level == 0 ? NULL : merkle->nodes + merkle->level_offset[level - 1];
+	job.below_count = level == 0 ? 0 : merkle->level_count[level - 1];
+	job.out = (ethash_h256_t*)merkle->nodes + merkle->level_offset[level];
+	job.count = merkle->level_count[level];
+	job.hash_fn = hash_fn;
+	job.user = user;
+	job.next = 0;
+	uint64_t const chunks = (job.count + ETHASH_MERKLE_CHUNK - 1) / ETHASH_MERKLE_CHUNK;
+	unsigned const threads = chunks < num_threads ? (unsigned)chunks : num_threads;
+	if (threads > 1) {
+		ethash_parallel_run(ethash_merkle_worker, &job, threads, ETHASH_THREAD_PRIORITY_LOW);
+	} else {
+		ethash_merkle_worker(&job);
+	}
+}
+
+// The shape of the tree of @a leaf_count leaves and its size in bytes, header included
+static uint64_t ethash_merkle_layout(struct ethash_full_merkle* merkle, uint64_t leaf_count)
+{
+	uint64_t count = leaf_count;
+	uint64_t offset = 0;
+	unsigned level = 0;
+	for (;;) {
+		merkle->level_count[level] = count;
+		merkle->level_offset[level] = offset;
+		offset += count;
+		if (count == 1) {
+			break;
+		}
+		count = (count + 1) / 2;
+		++level;
+	}
+	merkle->depth = level;
+	return ETHASH_MERKLE_HEADER_SIZE + offset * sizeof(ethash_h256_t);
+}
+
+// Map the tree file at @a path if it holds the tree described by @a header
+static bool ethash_merkle_map(
+	struct ethash_full_merkle* merkle,
+	char const* path,
+	struct ethash_merkle_header const* header,
+	uint64_t tree_size
+)
+{
+	FILE* f = ethash_fopen(path, "rb");
+	if (!f) {
+		return false;
+	}
+	struct ethash_merkle_header found;
+	size_t file_size;
+	if (fread(&found, sizeof(found), 1, f) != 1 ||
+		memcmp(&found, header, sizeof(found)) != 0 ||
+		!ethash_file_size(f, &file_size) ||
+		file_size != tree_size) {
+		fclose(f);
+		return false;
+	}
+	int const fd = ethash_fileno(f);
+	void* data = fd == -1 ? MAP_FAILED : mmap(NULL, (size_t)tree_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		fclose(f);
+		return false;
+	}
+	merkle->memory.base = data;
+	merkle->memory.size = (size_t)tree_size;
+	merkle->memory.mode = ETHASH_PAGES_FILE;
+	merkle->memory.provider = NULL;
+	merkle->file = f;
+	return true;
+}
+
+// Write a tree built in memory to @a path, through a temporary file
+static bool ethash_merkle_write(struct ethash_full_merkle const* merkle, char const* path)
+{
+	size_t const path_length = strlen(path);
+	char* tmpfile = malloc(path_length + 5);
+	if (!tmpfile) {
+		return false;
+	}
+	memcpy(tmpfile, path, path_length);
+	memcpy(tmpfile + path_length, ".tmp", 5);
+	FILE* f = ethash_fopen(tmpfile, "wb");
+	if (!f) {
+		goto fail_free;
+	}
+	bool const written = fwrite(merkle->memory.base, (size_t)merkle->size, 1, f) == 1;
+	if (fclose(f) != 0 || !written) {
+		goto fail_remove;
+	}
+#if defined(_WIN32)
+	// rename() does not replace existing files on Windows
+	remove(path);
+#endif
+	if (rename(tmpfile, path) != 0) {
+		goto fail_remove;
+	}
+	free(tmpfile);
+	return true;
+
+fail_remove:
+	remove(tmpfile);
+fail_free:
+	free(tmpfile);
+	return false;
+}
+
+ethash_full_merkle_t ethash_full_merkle_build(
+	ethash_full_t full,
+	uint64_t leaf_size,
+	ethash_merkle_hash_fn hash_fn,
+	void* user,
+	char const* path,
+	unsigned num_threads
+)
+{
+	if (leaf_size == 0) {
+		leaf_size = ETHASH_MIX_BYTES;
+	}
+	if (!hash_fn) {
+		hash_fn = ethash_merkle_keccak;
+	}
+	if (num_threads == 0) {
+		num_threads = ethash_hardware_concurrency();
+	}
+	uint8_t const* const dag = (uint8_t const*)ethash_full_dag(full);
+	if (full->file_size % leaf_size != 0) {
+		return NULL;
+	}
+	struct ethash_full_merkle* ret = calloc(1, sizeof(*ret));
+	if (!ret) {
+		return NULL;
+	}
+	uint64_t const tree_size = ethash_merkle_layout(ret, full->file_size / leaf_size);
+	ret->size = tree_size;
+
+	// identifies the tree of a file, the hash function by its hash of a fixed input
+	struct ethash_merkle_header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = ETHASH_MERKLE_MAGIC;
+	header.dag_size = full->file_size;
+	header.leaf_size = leaf_size;
+	header.leaf_count = ret->level_count[0];
+	SHA3_256(
+		&header.dag_id,
+		(uint8_t const*)full->checksums,
+		ethash_io_dag_checksum_count(full->file_size) * sizeof(ethash_h256_t)
+	);
+	hash_fn(&header.hash_id, merkle_probe, sizeof(merkle_probe), user);
+
+	if (path && ethash_merkle_map(ret, path, &header, tree_size)) {
+		ret->nodes = (ethash_h256_t const*)((uint8_t const*)ret->memory.base + ETHASH_MERKLE_HEADER_SIZE);
+		return ret;
+	}
+	if (!ethash_memory_alloc(&ret->memory, (size_t)tree_size, ETHASH_HUGE_PAGES_OFF)) {
+		ETHASH_CRITICAL("Could not allocate the Merkle tree of the DAG.");
+		goto fail_free;
+	}
+	memcpy(ret->memory.base, &header, sizeof(header));
+	ret->nodes = (ethash_h256_t const*)((uint8_t const*)ret->memory.base + ETHASH_MERKLE_HEADER_SIZE);
+	for (unsigned level = 0; level <= ret->depth; ++level) {
+		ethash_merkle_hash_level(ret, level, dag, leaf_size, hash_fn, user, num_threads);
+	}
+	if (path && !ethash_merkle_write(ret, path)) {
+		// not fatal, the tree is just built again next time
+		ETHASH_CRITICAL("Could not write the Merkle tree file \"%s\".", path);
+	}
+	return ret;
+
+fail_free:
+	free(ret);
+	return NULL;
+}
+
+ethash_h256_t ethash_full_merkle_root(ethash_full_merkle_t merkle)
+{
+	return merkle->nodes[merkle->level_offset[merkle->depth]];
+}
+
+uint64_t ethash_full_merkle_leaf_count(ethash_full_merkle_t merkle)
+{
+	return merkle->level_count[0];
+}
+
+unsigned ethash_full_merkle_depth(ethash_full_merkle_t merkle)
+{
+	return merkle->depth;
+}
+
+bool ethash_full_merkle_proof(
+	ethash_full_merkle_t merkle,
+	uint64_t index,
+	ethash_h256_t* leaf,
+	ethash_h256_t* siblings
+)
+{
+	if (index >= merkle->level_count[0]) {
+		return false;
+	}
+	*leaf = merkle->nodes[index];
+	for (unsigned level = 0; level != merkle->depth; ++level) {
+		uint64_t const sibling = (index ^ 1) < merkle->level_count[level] ? index ^ 1 : index;
+		siblings[level] = merkle->nodes[merkle->level_offset[level] + sibling];
+		index /= 2;
+	}
+	return true;
+}
+
+bool ethash_full_merkle_verify(
+	ethash_h256_t const* root,
+	ethash_h256_t const* leaf,
+	uint64_t index,
+	ethash_h256_t const* siblings,
+	unsigned depth,
+	ethash_merkle_hash_fn hash_fn,
+	void* user
+)
+{
+	if (!hash_fn) {
+		hash_fn = ethash_merkle_keccak;
+	}
+	if (depth < 64 && index >> depth != 0) {
+		return false;
+	}
+	ethash_h256_t node = *leaf;
+	for (unsigned level = 0; level != depth; ++level) {
+		if (index & 1) {
+			ethash_merkle_pair(&node, &siblings[level], &node, hash_fn, user);
+		} else {
+			ethash_merkle_pair(&node, &node, &siblings[level], hash_fn, user);
+		}
+		index /= 2;
+	}
+	return memcmp(&node, root, sizeof(node)) == 0;
+}
+
+void ethash_full_merkle_delete(ethash_full_merkle_t merkle)
+{
+	ethash_memory_free(&merkle->memory);
+	if (merkle->file) {
+		fclose(merkle->file);
+	}
+	free(merkle);
+}
@@ -0,0 +1,423 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file miner.c
+ * @date 2018
+ *
+ * Long running nonce searches, see ethash_miner_new(). The current work is
+ * published under a sequence lock and every change of it gets a new tag.
+ * The chunks left to a thread are a single word holding the low bits of the
+ * tag and the first and last chunk index, which the thread takes from the
+ * front and others steal from the back with a compare and exchange. Locks
+ * are only taken to wake idle threads and to report hits. The tag doubles as
+ * the generation of ethash_miner_generation(), and is looked at before every
+ * iteration of the hashing loop and again before reporting hits.
+ */
+
+#include <stdlib.h>
+#include "internal.h"
+#include "threads.h"
+#include "throttle.h"
+#include "probes.h"
+
+// The nonces hashed between two looks at the tag of the current work, one
+// iteration of ethash_full_search()
+#define ETHASH_MINER_BATCH ETHASH_HASH_BATCH
+
+#define ETHASH_MINER_RANGE(tag, first, last) \
+	(((uint64_t)((tag) & 0xFFFF) << 48) | ((uint64_t)(first) << 24) | (uint64_t)(last))
+#define ETHASH_MINER_RANGE_TAG(range) ((uint32_t)((range) >> 48))
+#define ETHASH_MINER_RANGE_FIRST(range) ((uint32_t)((range) >> 24) & 0xFFFFFF)
+#define ETHASH_MINER_RANGE_LAST(range) ((uint32_t)(range) & 0xFFFFFF)
+
+struct ethash_miner_work {
+	ethash_full_t full;          ///< NULL if there is nothing to hash
+	ethash_h256_t header_hash;
+	ethash_h256_t boundary;
+	uint64_t start_nonce;
+	uint64_t count;
+	uint64_t work_id;
+	uint32_t tag;
+};
+
+struct ethash_miner_worker {
+	struct ethash_miner* miner;
+	unsigned index;
+	ethash_thread_t thread;
+	uint64_t volatile range;     ///< the chunks left, see ETHASH_MINER_RANGE()
+	uint64_t volatile hashes;
+	uint32_t volatile seen;      ///< the tag of the work the thread uses
+	struct ethash_throttle_burst burst;
+	// keeps the ranges of neighbouring threads off each other's cache line
+	uint8_t padding[64];
+};
+
+struct ethash_miner {
+	unsigned num_threads;
+	ethash_miner_callback_t callback;
+	void* user;
+	uint32_t volatile stop;
+	uint32_t volatile tag;       ///< of the current work, stored once it's complete
+	uint32_t volatile sequence;  ///< odd while @a work is being written
+	struct ethash_miner_work work;
+	ethash_mutex_t write_lock;   ///< taken by the writers of @a work
+	ethash_mutex_t hit_lock;     ///< taken around the callback
+	ethash_mutex_t idle_lock;
+	ethash_cond_t idle_cond;     ///< signalled for new work
+	ethash_cond_t sync_cond;     ///< signalled as threads pick up work
+	uint32_t volatile idle;      ///< threads waiting on @a idle_cond
+	uint32_t volatile syncing;   ///< callers of ethash_miner_sync() waiting on @a sync_cond
+	uint64_t volatile stale_hits;
+	struct ethash_throttler throttler;
+	struct ethash_miner_worker* workers;
+};
+
+static void ethash_miner_load_work(struct ethash_miner* miner, struct ethash_miner_work* work)
+{
+	for (;;) {
+		uint32_t const sequence = ethash_atomic_load_u32(&miner->sequence);
+		if (sequence & 1) {
+			continue;
+		}
+		*work = miner->work;
+		ethash_atomic_fence();
+		if (ethash_atomic_load_u32(&miner->sequence) == sequence) {
+			return;
+		}
+	}
+}
+
+// Take the first chunk of @a worker if its range belongs to the work @a tag
+static bool ethash_miner_pop(struct ethash_miner_worker* worker, uint32_t tag, uint32_t* chunk)
+{
+	uint64_t range = ethash_atomic_load_u64(&worker->range);
+	for (;;) {
+		uint32_t const first = ETHASH_MINER_RANGE_FIRST(range);
+		uint32_t const last = ETHASH_MINER_RANGE_LAST(range);
+		if (ETHASH_MINER_RANGE_TAG(range) != (tag & 0xFFFF) || first >= last) {
+			return false;
+		}
+		if (ethash_atomic_compare_exchange_u64(&worker->range, &range, ETHASH_MINER_RANGE(tag, first + 1, last))) {
+			*chunk = first;
+			return true;
+		}
+	}
+}
+
+// Take the back half of what another thread has left of the work @a tag,
+// keeping all but the first chunk of it in the own, empty range
+static bool ethash_miner_steal(struct ethash_miner_worker* worker, uint32_t tag, uint32_t* chunk)
+{
+	struct ethash_miner* miner = worker->miner;
+	uint64_t own = ethash_atomic_load_u64(&worker->range);
+	for (unsigned i = 1; i < miner->num_threads; ++i) {
+		struct ethash_miner_worker* victim = &miner->workers[(worker->index + i) % miner->num_threads];
+		uint64_t range = ethash_atomic_load_u64(&victim->range);
+		for (;;) {
+			uint32_t const first = ETHASH_MINER_RANGE_FIRST(range);
+			uint32_t const last = ETHASH_MINER_RANGE_LAST(range);
+			if (ETHASH_MINER_RANGE_TAG(range) != (tag & 0xFFFF) || first >= last) {
+				break;
+			}
+			uint32_t const middle = last - (last - first + 1) / 2;
+			if (ethash_atomic_compare_exchange_u64(&victim->range, &range, ETHASH_MINER_RANGE(tag, first, middle))) {
+				// only new work changes an empty range, which makes the
+				// stolen chunks worthless anyway
+				ethash_atomic_compare_exchange_u64(&worker->range, &own, ETHASH_MINER_RANGE(tag, middle + 1, last));
+				*chunk = middle;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Sleep until there is work newer than @a tag
+static void ethash_miner_wait(struct ethash_miner* miner, uint32_t tag)
+{
+	// counted before looking at the tag, so set_work either sees the count or
+	// this thread sees the new tag
+	ethash_atomic_fetch_add_u32(&miner->idle, 1);
+	ethash_mutex_lock(&miner->idle_lock);
+	while (!ethash_atomic_load_u32(&miner->stop) && ethash_atomic_load_u32(&miner->tag) == tag) {
+		ethash_cond_wait(&miner->idle_cond, &miner->idle_lock);
+	}
+	ethash_mutex_unlock(&miner->idle_lock);
+	ethash_atomic_fetch_add_u32(&miner->idle, (uint32_t)-1);
+}
+
+static void ethash_miner_hash_chunk(
+	struct ethash_miner_worker* worker,
+	struct ethash_miner_work const* work,
+	uint32_t chunk
+)
+{
+	struct ethash_miner* miner = worker->miner;
+	uint64_t const begin = (uint64_t)chunk * ETHASH_MINER_CHUNK;
+	uint64_t const end = work->count - begin < ETHASH_MINER_CHUNK ? work->count : begin + ETHASH_MINER_CHUNK;
+	ethash_search_hit_t hits[ETHASH_MINER_BATCH];
+	for (uint64_t offset = begin; offset < end; offset += ETHASH_MINER_BATCH) {
+		if (ethash_atomic_load_u32(&miner->stop) || ethash_atomic_load_u32(&miner->tag) != work->tag) {
+			return;
+		}
+		uint64_t const count = end - offset < ETHASH_MINER_BATCH ? end - offset : ETHASH_MINER_BATCH;
+		size_t const found = ethash_full_search(
+			work->full, work->header_hash, work->start_nonce + offset, count, &work->boundary, hits, ETHASH_MINER_BATCH
+		);
+		ethash_atomic_fetch_add_u64(&worker->hashes, count);
+		ETHASH_PROBE4(miner__batch, work->work_id, work->start_nonce + offset, count, found);
+		ethash_throttle_account(&miner->throttler, &worker->burst, count);
+		if (found) {
+			ethash_mutex_lock(&miner->hit_lock);
+			// the header may have been replaced while hashing
+			if (ethash_atomic_load_u32(&miner->tag) == work->tag) {
+				for (size_t i = 0; i != found; ++i) {
+					miner->callback(work->work_id, &hits[i], miner->user);
+				}
+			} else {
+				ethash_atomic_fetch_add_u64(&miner->stale_hits, found);
+			}
+			ethash_mutex_unlock(&miner->hit_lock);
+		}
+	}
+}
+
+static void ethash_miner_worker(void* arg)
+{
+	struct ethash_miner_worker* worker = (struct ethash_miner_worker*)arg;
+	struct ethash_miner* miner = worker->miner;
+	// tag 0 is the missing work miners start with
+	struct ethash_miner_work work = { NULL };
+	while (!ethash_atomic_load_u32(&miner->stop)) {
+		if (ethash_atomic_load_u32(&miner->tag) != work.tag) {
+			ethash_miner_load_work(miner, &work);
+			ethash_atomic_store_u32(&worker->seen, work.tag);
+			if (ethash_atomic_load_u32(&miner->syncing)) {
+				ethash_mutex_lock(&miner->idle_lock);
+				ethash_cond_broadcast(&miner->sync_cond);
+				ethash_mutex_unlock(&miner->idle_lock);
+			}
+		}
+		uint32_t chunk;
+		if (work.full && (ethash_miner_pop(worker, work.tag, &chunk) || ethash_miner_steal(worker, work.tag, &chunk))) {
+			ethash_miner_hash_chunk(worker, &work, chunk);
+		} else {
+			ethash_miner_wait(miner, work.tag);
+			// idle time is no part of a burst
+			worker->burst.start_us = 0;
+		}
+	}
+}
+
+// Stop the first @a started threads of a miner and free it
+static void ethash_miner_free(struct ethash_miner* miner, unsigned started)
+{
+	ethash_atomic_store_u32(&miner->stop, 1);
+	ethash_mutex_lock(&miner->idle_lock);
+	ethash_cond_broadcast(&miner->idle_cond);
+	ethash_mutex_unlock(&miner->idle_lock);
+	ethash_throttler_interrupt(&miner->throttler);
+	for (unsigned i = 0; i != started; ++i) {
+		ethash_thread_join(miner->workers[i].thread);
+	}
+	ethash_throttler_destroy(&miner->throttler);
+	ethash_cond_destroy(&miner->sync_cond);
+	ethash_cond_destroy(&miner->idle_cond);
+	ethash_mutex_destroy(&miner->idle_lock);
+	ethash_mutex_destroy(&miner->hit_lock);
+	ethash_mutex_destroy(&miner->write_lock);
+	free(miner->workers);
+	free(miner);
+}
+
+ethash_miner_t ethash_miner_new(unsigned num_threads, ethash_miner_callback_t callback, void* user)
+{
+	if (num_threads == 0) {
+		num_threads = ethash_hardware_concurrency();
+	}
+	struct ethash_miner* miner = calloc(1, sizeof(*miner));
+	if (!miner) {
+		return NULL;
+	}
+	miner->workers = calloc(num_threads, sizeof(*miner->workers));
+	if (!miner->workers) {
+		goto fail_free_miner;
+	}
+	if (!ethash_mutex_init(&miner->write_lock)) {
+		goto fail_free_workers;
+	}
+	if (!ethash_mutex_init(&miner->hit_lock)) {
+		goto fail_destroy_write_lock;
+	}
+	if (!ethash_mutex_init(&miner->idle_lock)) {
+		goto fail_destroy_hit_lock;
+	}
+	if (!ethash_cond_init(&miner->idle_cond)) {
+		goto fail_destroy_idle_lock;
+	}
+	if (!ethash_cond_init(&miner->sync_cond)) {
+		goto fail_destroy_idle_cond;
+	}
+	if (!ethash_throttler_init(&miner->throttler, num_threads)) {
+		goto fail_destroy_sync_cond;
+	}
+	miner->num_threads = num_threads;
+	miner->callback = callback;
+	miner->user = user;
+	for (unsigned i = 0; i != num_threads; ++i) {
+		miner->workers[i].miner = miner;
+		miner->workers[i].index = i;
+		if (!ethash_thread_create(&miner->workers[i].thread, ethash_miner_worker, &miner->workers[i])) {
+			ethash_miner_free(miner, i);
+			return NULL;
+		}
+	}
+	return miner;
+
+fail_destroy_sync_cond:
+	ethash_cond_destroy(&miner->sync_cond);
+fail_destroy_idle_cond:
+	ethash_cond_destroy(&miner->idle_cond);
+fail_destroy_idle_lock:
+	ethash_mutex_destroy(&miner->idle_lock);
+fail_destroy_hit_lock:
+	ethash_mutex_destroy(&miner->hit_lock);
+fail_destroy_write_lock:
+	ethash_mutex_destroy(&miner->write_lock);
+fail_free_workers:
+	free(miner->workers);
+fail_free_miner:
+	free(miner);
+	return NULL;
+}
+
+// Publish @a work under a new tag and split its chunks between the threads.
+// Called with the write lock held
+static void ethash_miner_publish(struct ethash_miner* miner, struct ethash_miner_work const* work)
+{
+	uint32_t const tag = ethash_atomic_load_u32(&miner->tag) + 1;
+	// the sequence lock only has this writer, the threads just retry their copy
+	ethash_atomic_store_u32(&miner->sequence, miner->sequence + 1);
+	ethash_atomic_fence();
+	miner->work = *work;
+	miner->work.tag = tag;
+	ethash_atomic_fence();
+	ethash_atomic_store_u32(&miner->sequence, miner->sequence + 1);
+
+	uint32_t const chunks = work->full ? (uint32_t)((work->count + ETHASH_MINER_CHUNK - 1) / ETHASH_MINER_CHUNK) : 0;
+	uint32_t const share = chunks / miner->num_threads;
+	uint32_t const extra = chunks % miner->num_threads;
+	for (unsigned i = 0; i != miner->num_threads; ++i) {
+		uint32_t const first = i * share + (i < extra ? i : extra);
+		uint32_t const last = first + share + (i < extra ? 1 : 0);
+		ethash_atomic_store_u64(&miner->workers[i].range, ETHASH_MINER_RANGE(tag, first, last));
+	}
+	ethash_atomic_store_u32(&miner->tag, tag);
+	if (ethash_atomic_load_u32(&miner->idle)) {
+		ethash_mutex_lock(&miner->idle_lock);
+		ethash_cond_broadcast(&miner->idle_cond);
+		ethash_mutex_unlock(&miner->idle_lock);
+	}
+	if (ethash_atomic_load_u32(&miner->throttler.enabled)) {
+		// paused threads pick the work up right away
+		ethash_throttler_interrupt(&miner->throttler);
+	}
+}
+
+void ethash_miner_set_work(
+	ethash_miner_t miner,
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	ethash_h256_t const* boundary,
+	uint64_t start_nonce,
+	uint64_t count,
+	uint64_t work_id
+)
+{
+	struct ethash_miner_work work;
+	work.full = full;
+	work.header_hash = header_hash;
+	work.boundary = *boundary;
+	work.start_nonce = start_nonce;
+	work.count = count == 0 || count > ETHASH_MINER_MAX_NONCES ? ETHASH_MINER_MAX_NONCES : count;
+	work.work_id = work_id;
+	ethash_mutex_lock(&miner->write_lock);
+	ethash_miner_publish(miner, &work);
+	ethash_mutex_unlock(&miner->write_lock);
+}
+
+void ethash_miner_set_header(ethash_miner_t miner, ethash_h256_t const header_hash, uint64_t work_id)
+{
+	ethash_mutex_lock(&miner->write_lock);
+	// only writers change the work, so it needs no sequence check here
+	struct ethash_miner_work work = miner->work;
+	work.header_hash = header_hash;
+	work.work_id = work_id;
+	ethash_miner_publish(miner, &work);
+	ethash_mutex_unlock(&miner->write_lock);
+}
+
+void ethash_miner_set_throttle(ethash_miner_t miner, ethash_throttle_t const* throttle)
+{
+	ethash_throttler_set(&miner->throttler, throttle);
+}
+
+uint32_t ethash_miner_generation(ethash_miner_t miner)
+{
+	return ethash_atomic_load_u32(&miner->tag);
+}
+
+uint64_t ethash_miner_stale_hits(ethash_miner_t miner)
+{
+	return ethash_atomic_load_u64(&miner->stale_hits);
+}
+
+// Whether all threads went on to the work @a tag or a later one
+static bool ethash_miner_synced(struct ethash_miner* miner, uint32_t tag)
+{
+	for (unsigned i = 0; i != miner->num_threads; ++i) {
+		if (ethash_atomic_load_u32(&miner->workers[i].seen) - tag >= 0x80000000U) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void ethash_miner_sync(ethash_miner_t miner)
+{
+	uint32_t const tag = ethash_atomic_load_u32(&miner->tag);
+	ethash_atomic_fetch_add_u32(&miner->syncing, 1);
+	ethash_mutex_lock(&miner->idle_lock);
+	while (!ethash_miner_synced(miner, tag)) {
+		ethash_cond_wait(&miner->sync_cond, &miner->idle_lock);
+	}
+	ethash_mutex_unlock(&miner->idle_lock);
+	ethash_atomic_fetch_add_u32(&miner->syncing, (uint32_t)-1);
+}
+
+uint64_t ethash_miner_hashes(ethash_miner_t miner)
+{
+	uint64_t hashes = 0;
+	for (unsigned i = 0; i != miner->num_threads; ++i) {
+		hashes += ethash_atomic_load_u64(&miner->workers[i].hashes);
+	}
+	return hashes;
+}
+
+void ethash_miner_delete(ethash_miner_t miner)
+{
+	ethash_miner_free(miner, miner->num_threads);
+}
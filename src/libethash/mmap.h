@@ -38,8 +38,18 @@
 #define MAP_ANON      MAP_ANONYMOUS
 #define MAP_FAILED    ((void *) -1)
 
+#define MS_ASYNC      0x1
+#define MS_SYNC       0x4
+
+/* Only MADV_WILLNEED does anything, with PrefetchVirtualMemory() of Windows 8+ */
+#define MADV_NORMAL   0
+#define MADV_RANDOM   1
+#define MADV_WILLNEED 3
+
 void* mmap(void* start, size_t length, int prot, int flags, int fd, off_t offset);
 void munmap(void* addr, size_t length);
+int msync(void* addr, size_t length, int flags);
+int madvise(void* addr, size_t length, int advice);
 #else // posix, yay! ^_^
 #include <sys/mman.h>
 #endif
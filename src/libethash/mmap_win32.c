@@ -80,5 +80,40 @@ void munmap(void* addr, size_t length)
 	UnmapViewOfFile(addr);
 }
 
+int msync(void* addr, size_t length, int flags)
+{
+	if (!FlushViewOfFile(addr, length)) {
+		return -1;
+	}
+	// FlushViewOfFile() only starts the write back, the file handle is not at
+	// hand to wait for it with FlushFileBuffers()
+	(void)flags;
+	return 0;
+}
+
+// WIN32_MEMORY_RANGE_ENTRY, which the headers only declare for Windows 8+
+struct ethash_memory_range {
+	PVOID VirtualAddress;
+	SIZE_T NumberOfBytes;
+};
+
+typedef BOOL (WINAPI *ethash_prefetch_fn)(HANDLE, ULONG_PTR, struct ethash_memory_range*, ULONG);
+
+int madvise(void* addr, size_t length, int advice)
+{
+	if (advice != MADV_WILLNEED) {
+		return 0;
+	}
+	// looked up at run time so that Windows 7 still loads the library
+	ethash_prefetch_fn const prefetch = (ethash_prefetch_fn)GetProcAddress(
+		GetModuleHandleA("kernel32.dll"), "PrefetchVirtualMemory"
+	);
+	if (!prefetch) {
+		return -1;
+	}
+	struct ethash_memory_range range = { addr, length };
+	return prefetch(GetCurrentProcess(), 1, &range, 0) ? 0 : -1;
+}
+
 #undef DWORD_HI
 #undef DWORD_LO
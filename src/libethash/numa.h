@@ -0,0 +1,70 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file numa.h
+ * @date 2018
+ *
+ * Minimal NUMA support for placing the DAG. The implementations live in
+ * numa_posix.c, which talks to the Linux kernel directly so that no libnuma
+ * is needed, and numa_win32.c. Hosts without NUMA support report one node.
+ */
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Nodes above this are ignored for replicas and interleaving
+#define ETHASH_NUMA_MAX_NODES 64
+
+/**
+ * Get the number of NUMA nodes, i.e. the highest online node plus one
+ */
+unsigned ethash_numa_node_count(void);
+
+/**
+ * Get the NUMA node of the CPU the calling thread is running on
+ */
+unsigned ethash_numa_current_node(void);
+
+/**
+ * Spread the pages of a not yet touched range over all online nodes
+ *
+ * @return         true if the policy was applied
+ */
+bool ethash_numa_interleave(void* base, size_t size);
+
+/**
+ * Place the pages of a not yet touched range on node @a node
+ *
+ * @return         true if the policy was applied
+ */
+bool ethash_numa_bind(void* base, size_t size, unsigned node);
+
+/**
+ * Add the bytes of the resident pages of a range to the NUMA node they are on
+ *
+ * @param page     The size of the pages of the range
+ * @return         false if the placement could not be queried
+ */
+bool ethash_numa_add_placement(void const* base, size_t size, size_t page, uint64_t node_bytes[ETHASH_NUMA_MAX_NODES]);
+
+#ifdef __cplusplus
+}
+#endif
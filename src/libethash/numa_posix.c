@@ -0,0 +1,233 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file numa_posix.c
+ * @date 2018
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // sched_getcpu
+#endif
+#include "numa.h"
+#include "threads.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// from <numaif.h>, which is only there when libnuma is installed
+#define ETHASH_MPOL_BIND 2
+#define ETHASH_MPOL_INTERLEAVE 3
+
+#define NODE_MASK_WORDS (ETHASH_NUMA_MAX_NODES / (8 * sizeof(unsigned long)))
+/// CPUs above this find their node with the getcpu system call
+#define ETHASH_NUMA_MAX_CPUS 1024
+/// In cpu_nodes for the CPUs of no online node
+#define ETHASH_NUMA_NO_NODE 0xff
+
+static unsigned long online_nodes[NODE_MASK_WORDS];
+static unsigned node_count = 1;
+static uint8_t cpu_nodes[ETHASH_NUMA_MAX_CPUS];
+static ethash_once_t nodes_once = ETHASH_ONCE_INIT;
+
+// parse a "0-1,4" style list of the sysfs file @a path into @a add, false if there is none
+static bool ethash_numa_read_list(char const* path, unsigned limit, void (*add)(unsigned, void*), void* arg)
+{
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		return false;
+	}
+	unsigned first, last;
+	bool parsed = false;
+	while (fscanf(f, "%u", &first) == 1) {
+		last = first;
+		int c = fgetc(f);
+		if (c == '-') {
+			if (fscanf(f, "%u", &last) != 1) {
+				break;
+			}
+			c = fgetc(f);
+		}
+		for (unsigned n = first; n <= last && n < limit; ++n) {
+			add(n, arg);
+			parsed = true;
+		}
+		if (c != ',') {
+			break;
+		}
+	}
+	fclose(f);
+	return parsed;
+}
+
+static void ethash_numa_add_node(unsigned n, void* arg)
+{
+	unsigned long* nodes = (unsigned long*)arg;
+	nodes[n / (8 * sizeof(unsigned long))] |= 1UL << (n % (8 * sizeof(unsigned long)));
+}
+
+static void ethash_numa_add_cpu(unsigned cpu, void* arg)
+{
+	cpu_nodes[cpu] = (uint8_t)*(unsigned const*)arg;
+}
+
+static void ethash_numa_init(void)
+{
+	online_nodes[0] = 1;
+	memset(cpu_nodes, ETHASH_NUMA_NO_NODE, sizeof(cpu_nodes));
+	unsigned long nodes[NODE_MASK_WORDS] = { 0 };
+	if (!ethash_numa_read_list("/sys/devices/system/node/online", ETHASH_NUMA_MAX_NODES, ethash_numa_add_node, nodes)) {
+		return;
+	}
+	for (unsigned n = 0; n != ETHASH_NUMA_MAX_NODES; ++n) {
+		if (!(nodes[n / (8 * sizeof(unsigned long))] & (1UL << (n % (8 * sizeof(unsigned long)))))) {
+			continue;
+		}
+		node_count = n + 1;
+		char path[64];
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", n);
+		ethash_numa_read_list(path, ETHASH_NUMA_MAX_CPUS, ethash_numa_add_cpu, &n);
+	}
+	for (unsigned w = 0; w != NODE_MASK_WORDS; ++w) {
+		online_nodes[w] = nodes[w];
+	}
+}
+
+unsigned ethash_numa_node_count(void)
+{
+	ethash_call_once(&nodes_once, ethash_numa_init);
+	return node_count;
+}
+
+unsigned ethash_numa_current_node(void)
+{
+	// sched_getcpu() reads the CPU from the vDSO, without entering the kernel;
+	// it is only declared with _GNU_SOURCE, which CPU_SETSIZE shows
+#if defined(CPU_SETSIZE)
+	ethash_call_once(&nodes_once, ethash_numa_init);
+	int const cpu = sched_getcpu();
+	if (cpu >= 0 && cpu < ETHASH_NUMA_MAX_CPUS && cpu_nodes[cpu] != ETHASH_NUMA_NO_NODE) {
+		return cpu_nodes[cpu];
+	}
+#endif
+#if defined(SYS_getcpu)
+	unsigned cpu_index, node;
+	if (syscall(SYS_getcpu, &cpu_index, &node, NULL) == 0 && node < ETHASH_NUMA_MAX_NODES) {
+		return node;
+	}
+#endif
+	return 0;
+}
+
+static bool ethash_mbind(void* base, size_t size, int mode, unsigned long const* nodes)
+{
+#if defined(SYS_mbind)
+	// mbind wants a page aligned start, the allocations here always are
+	return syscall(SYS_mbind, base, size, mode, nodes, ETHASH_NUMA_MAX_NODES + 1, 0) == 0;
+#else
+	(void)base; (void)size; (void)mode; (void)nodes;
+	return false;
+#endif
+}
+
+bool ethash_numa_interleave(void* base, size_t size)
+{
+	if (ethash_numa_node_count() < 2) {
+		return false;
+	}
+	return ethash_mbind(base, size, ETHASH_MPOL_INTERLEAVE, online_nodes);
+}
+
+bool ethash_numa_bind(void* base, size_t size, unsigned node)
+{
+	if (node >= ethash_numa_node_count()) {
+		return false;
+	}
+	unsigned long nodes[NODE_MASK_WORDS] = { 0 };
+	nodes[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+	return ethash_mbind(base, size, ETHASH_MPOL_BIND, nodes);
+}
+
+bool ethash_numa_add_placement(void const* base, size_t size, size_t page, uint64_t node_bytes[ETHASH_NUMA_MAX_NODES])
+{
+#if defined(SYS_move_pages)
+	// without target nodes move_pages only tells where the pages are
+	void* pages[1024];
+	int status[1024];
+	uintptr_t address = (uintptr_t)base / page * page;
+	uintptr_t const end = (uintptr_t)base + size;
+	while (address < end) {
+		unsigned long count = 0;
+		for (; count != 1024 && address < end; ++count, address += page) {
+			pages[count] = (void*)address;
+		}
+		if (syscall(SYS_move_pages, 0, count, pages, NULL, status, 0) != 0) {
+			return false;
+		}
+		for (unsigned long i = 0; i != count; ++i) {
+			// negative for pages that are not resident
+			if (status[i] >= 0 && status[i] < ETHASH_NUMA_MAX_NODES) {
+				node_bytes[status[i]] += page;
+			}
+		}
+	}
+	return true;
+#else
+	(void)base; (void)size; (void)page; (void)node_bytes;
+	return false;
+#endif
+}
+
+#else // no NUMA support on other POSIX systems
+
+unsigned ethash_numa_node_count(void)
+{
+	return 1;
+}
+
+unsigned ethash_numa_current_node(void)
+{
+	return 0;
+}
+
+bool ethash_numa_interleave(void* base, size_t size)
+{
+	(void)base;
+	(void)size;
+	return false;
+}
+
+bool ethash_numa_bind(void* base, size_t size, unsigned node)
+{
+	(void)base;
+	(void)size;
+	return node == 0;
+}
+
+bool ethash_numa_add_placement(void const* base, size_t size, size_t page, uint64_t node_bytes[ETHASH_NUMA_MAX_NODES])
+{
+	(void)base;
+	(void)size;
+	(void)page;
+	(void)node_bytes;
+	return false;
+}
+
+#endif
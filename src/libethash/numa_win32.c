@@ -0,0 +1,58 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file numa_win32.c
+ * @date 2018
+ *
+ * Windows chooses the node of a page when VirtualAllocExNuma() maps it, so the
+ * placement functions below can't move memory from memory_win32.c and the
+ * host is treated as a single node
+ */
+
+#include "numa.h"
+
+unsigned ethash_numa_node_count(void)
+{
+	return 1;
+}
+
+unsigned ethash_numa_current_node(void)
+{
+	return 0;
+}
+
+bool ethash_numa_interleave(void* base, size_t size)
+{
+	(void)base;
+	(void)size;
+	return false;
+}
+
+bool ethash_numa_bind(void* base, size_t size, unsigned node)
+{
+	(void)base;
+	(void)size;
+	return node == 0;
+}
+
+bool ethash_numa_add_placement(void const* base, size_t size, size_t page, uint64_t node_bytes[ETHASH_NUMA_MAX_NODES])
+{
+	(void)base;
+	(void)size;
+	(void)page;
+	(void)node_bytes;
+	return false;
+}
@@ -0,0 +1,51 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file probes.h
+ * @date 2018
+ *
+ * Static tracepoints (USDT) of the provider "ethash", for perf, bpftrace and
+ * SystemTap on production hosts. They are compiled in with ETHASH_USDT
+ * defined, which cmake does for -DWANT_USDT=ON when <sys/sdt.h> exists, and
+ * go builds with CGO_CFLAGS=-DETHASH_USDT. A probe nothing is attached to
+ * is a single nop; without ETHASH_USDT they compile to nothing at all.
+ *
+ * The probes, "__" reading as "-" when attaching:
+ * - light_new__start(block_number), light_new__done(block_number, light)
+ * - cache__start(cache_size), cache__done(cache_size, light)
+ * - full_new__start(full_size, in_memory), full_new__done(full_size, full)
+ * - dag__start(first_node, end_node), dag__done(first_node, end_node, ok)
+ * - dag_chunk__start(first_node, nodes), dag_chunk__done(first_node, nodes)
+ * - io_prepare__start(dirname, file_size), io_prepare__done(result)
+ * - io_prepare__found(result) for an existing file, io_prepare__create(path)
+ * - search__batch(nonce, count, hits) and miner__batch(work_id, nonce, count, hits)
+ */
+#pragma once
+
+#if defined(ETHASH_USDT)
+#include <sys/sdt.h>
+#define ETHASH_PROBE(name) DTRACE_PROBE(ethash, name)
+#define ETHASH_PROBE1(name, a) DTRACE_PROBE1(ethash, name, a)
+#define ETHASH_PROBE2(name, a, b) DTRACE_PROBE2(ethash, name, a, b)
+#define ETHASH_PROBE3(name, a, b, c) DTRACE_PROBE3(ethash, name, a, b, c)
+#define ETHASH_PROBE4(name, a, b, c, d) DTRACE_PROBE4(ethash, name, a, b, c, d)
+#else
+#define ETHASH_PROBE(name) do {} while (0)
+#define ETHASH_PROBE1(name, a) do {} while (0)
+#define ETHASH_PROBE2(name, a, b) do {} while (0)
+#define ETHASH_PROBE3(name, a, b, c) do {} while (0)
+#define ETHASH_PROBE4(name, a, b, c, d) do {} while (0)
+#endif
@@ -30,7 +30,15 @@
 #include "fnv.h"
 #include "endian.h"
 #include "internal.h"
+#include "dispatch.h"
+#include "keccak_unrolled.h"
+#include "dag_memo.h"
+#include "memory_budget.h"
+#include "result_cache.h"
+#include "progpow_jit.h"
 #include "io.h"
+#include "stats.h"
+#include "access_stats.h"
 
 #ifdef WITH_CRYPTOPP
 
@@ -40,16 +48,6 @@
 #include "sha3.h"
 #endif // WITH_CRYPTOPP
 
-#define PROGPOW_LANES                   16
-#define PROGPOW_REGS                    32
-#define PROGPOW_DAG_LOADS                4
-#define PROGPOW_CACHE_BYTES             (16*1024)
-#define PROGPOW_CNT_DAG                 ETHASH_ACCESSES
-#define PROGPOW_CNT_CACHE               11
-#define PROGPOW_CNT_MATH                18
-#define PROGPOW_CACHE_WORDS  (PROGPOW_CACHE_BYTES / sizeof(uint32_t))
-#define PROGPOW_PERIOD                  10
-
 #define ROTL(x,n,w) (((x) << (n % w)) | ((x) >> ((w) - (n % w))))
 #define ROTL32(x,n) ROTL(x,n,32)	/* 32 bits word */
 
@@ -174,12 +172,46 @@ void keccak_f800_round(uint32_t st[25], const int r)
 	st[0] ^= keccakf_rndc[r];
 }
 
+// All 22 rounds of Keccak-f[800], the portable kernel of dispatch.c
+void keccak_f800(uint32_t st[25])
+{
+	for (int r = 0; r < 22; r++) {
+		keccak_f800_round(st, r);
+	}
+}
+
+#define XOR(x, y) ((x) ^ (y))
+#define ANDNOT(x, y) (~(x) & (y))
+#define ROL(x, s) ROTL32(x, s)
+#define KECCAK_RC(i) keccakf_rndc[i]
+
+// Keccak-f[800] unrolled over lanes in locals, without the tables and the
+// modulo of keccak_f800_round
+void keccak_f800_unrolled(uint32_t st[25])
+{
+	KECCAK_COMPLEMENT_LANES(st);
+	KECCAK_PERMUTE(uint32_t, st, 22, KECCAK_RC, KECCAK_CHI_IOTA_COMPLEMENTED);
+	KECCAK_COMPLEMENT_LANES(st);
+}
+
+#if defined(ETHASH_X86)
+// the unrolled rounds for hosts with andn and rorx
+ETHASH_TARGET("bmi,bmi2")
+void keccak_f800_bmi2(uint32_t st[25])
+{
+	KECCAK_PERMUTE(uint32_t, st, 22, KECCAK_RC, KECCAK_CHI_IOTA);
+}
+#endif
+
+#undef XOR
+#undef ANDNOT
+#undef ROL
+#undef KECCAK_RC
+
 // Implementation of the Keccak sponge construction (with padding omitted)
 // The width is 800, with a bitrate of 576, and a capacity of 224.
-hash32_t keccak_f800_progpow(hash32_t header, uint64_t seed, hash32_t digest)
+static void keccak_f800_progpow_absorb(uint32_t st[25], hash32_t header, uint64_t seed, hash32_t digest)
 {
-	uint32_t st[25];
-
 	for (int i = 0; i < 25; i++)
 		st[i] = 0;
 	for (int i = 0; i < 8; i++)
@@ -188,21 +220,25 @@ hash32_t keccak_f800_progpow(hash32_t header, uint64_t seed, hash32_t digest)
 	st[9] = seed >> 32;
 	for (int i = 0; i < 8; i++)
 		st[10+i] = digest.uint32s[i];
+}
 
-	for (int r = 0; r < 21; r++) {
-		keccak_f800_round(st, r);
-	}
-	// last round can be simplified due to partial output
-	keccak_f800_round(st, 21);
-
+static hash32_t keccak_f800_progpow_squeeze(uint32_t const st[25])
+{
 	hash32_t ret;
 	for (int i = 0; i < 8; i++) {
 		ret.uint32s[i] = st[i];
 	}
-
 	return ret;
 }
 
+hash32_t keccak_f800_progpow(hash32_t header, uint64_t seed, hash32_t digest)
+{
+	uint32_t st[25];
+	keccak_f800_progpow_absorb(st, header, seed, digest);
+	ethash_kernels()->keccakf800->permute(st);
+	return keccak_f800_progpow_squeeze(st);
+}
+
 typedef struct {
 	uint32_t z, w, jsr, jcong;
 } kiss99_t;
@@ -305,22 +341,112 @@ uint32_t progpowMath(uint32_t a, uint32_t b, uint32_t r)
 	return 0;
 }
 
-void progPowLoop(
-	const uint64_t prog_seed,
+void progpow_program_init(progpow_program_t* prog, uint64_t prog_seed)
+{
+	uint32_t mix_seq_dst_cnt = 0;
+	uint32_t mix_seq_src_cnt = 0;
+	kiss99_t prog_rnd = progPowInit(prog_seed, prog->mix_seq_dst, prog->mix_seq_src);
+	prog->prog_seed = prog_seed;
+
+	// Replay the KISS99 sequence of one loop iteration. It is the same for
+	// every iteration so the loop only has to run the resulting instructions.
+	int max_i;
+	if (PROGPOW_CNT_CACHE > PROGPOW_CNT_MATH)
+		max_i = PROGPOW_CNT_CACHE;
+	else
+		max_i = PROGPOW_CNT_MATH;
+
+	progpow_instruction_t* ins = prog->instructions;
+	for (int i = 0; i < max_i; i++)
+	{
+		if (i < PROGPOW_CNT_CACHE)
+		{
+			// Cached memory access
+			// lanes access random 32-bit locations within the first portion of the DAG
+			ins->op = PROGPOW_OP_CACHE;
+			ins->src1 = prog->mix_seq_src[(mix_seq_src_cnt++)%PROGPOW_REGS];
+			ins->src2 = 0;
+			ins->dst = prog->mix_seq_dst[(mix_seq_dst_cnt++)%PROGPOW_REGS];
+			ins->sel1 = 0;
+			ins->sel2 = kiss99(&prog_rnd);
+			ins++;
+		}
+		if (i < PROGPOW_CNT_MATH)
+		{
+			// Random Math
+			// Generate 2 unique sources
+			uint32_t src_rnd = kiss99(&prog_rnd) % (PROGPOW_REGS * (PROGPOW_REGS-1));
+			uint32_t src1 = src_rnd % PROGPOW_REGS; // 0 <= src1 < PROGPOW_REGS
+			uint32_t src2 = src_rnd / PROGPOW_REGS; // 0 <= src2 < PROGPOW_REGS - 1
+			if (src2 >= src1) ++src2; // src2 is now any reg other than src1
+			ins->op = PROGPOW_OP_MATH;
+			ins->src1 = (uint8_t)src1;
+			ins->src2 = (uint8_t)src2;
+			ins->sel1 = kiss99(&prog_rnd);
+			ins->dst = prog->mix_seq_dst[(mix_seq_dst_cnt++)%PROGPOW_REGS];
+			ins->sel2 = kiss99(&prog_rnd);
+			ins++;
+		}
+	}
+
+	// Always merge the global load data into mix[0] first to feed the offset calculation
+	for (int i = 0; i < PROGPOW_DAG_LOADS; i++)
+	{
+		prog->dag_dst[i] = (i==0) ? 0 : prog->mix_seq_dst[(mix_seq_dst_cnt++)%PROGPOW_REGS];
+		prog->dag_sel[i] = kiss99(&prog_rnd);
+	}
+}
+
+// The last program compiled by each thread. Consecutive hashes almost always
+// share a period so this turns the compilation into a single comparison.
+static ETHASH_THREAD_LOCAL progpow_program_t progpow_program_cache;
+static ETHASH_THREAD_LOCAL bool progpow_program_cache_valid = false;
+
+progpow_program_t const* progpow_program_get(uint64_t prog_seed)
+{
+	if (!progpow_program_cache_valid || progpow_program_cache.prog_seed != prog_seed) {
+		progpow_program_init(&progpow_program_cache, prog_seed);
+		progpow_program_cache_valid = true;
+	}
+	return &progpow_program_cache;
+}
+
+ethash_fastmod_t progpow_dag_entries(uint64_t full_size)
+{
+	uint32_t const dag_words = (unsigned)((uint32_t)full_size / PROGPOW_MIX_BYTES);
+	return ethash_fastmod_init(64 * dag_words / (PROGPOW_LANES*PROGPOW_DAG_LOADS));
+}
+
+uint32_t progpow_dag_entry(
 	const uint32_t loop,
-	ethash_light_t const light,
 	uint32_t mix[PROGPOW_LANES][PROGPOW_REGS],
-	const uint32_t *g_dag,
-	const uint32_t *c_dag,
-	const uint32_t dag_words)
+	ethash_fastmod_t const* dag_entries)
 {
 	// All lanes share a base address for the global load
 	// Global offset uses mix[0] to guarantee it depends on the load result
-	uint32_t offset_g = mix[loop%PROGPOW_LANES][0] % (64 * dag_words / (PROGPOW_LANES*PROGPOW_DAG_LOADS));
+	uint32_t const entry = ethash_fastmod(dag_entries, mix[loop%PROGPOW_LANES][0]);
+	ETHASH_ACCESS_RECORD(ETHASH_ACCESS_PROGPOW_DAG, (uint64_t)entry * PROGPOW_LANES * PROGPOW_DAG_LOADS * sizeof(uint32_t));
+	return entry;
+}
+
+void progpow_prefetch_dag(const uint32_t* g_dag, const uint32_t entry)
+{
+	if (!g_dag || !ethash_get_prefetch()) {
+		return;
+	}
+	uint32_t const* const p = &g_dag[entry * PROGPOW_LANES * PROGPOW_DAG_LOADS];
+	for (unsigned line = 0; line != PROGPOW_MIX_BYTES / 64; ++line) {
+		ETHASH_PREFETCH(p + line * 16);
+	}
+}
 
+void progpow_load_dag(
+	uint32_t dag_data[PROGPOW_LANES*PROGPOW_DAG_LOADS],
+	const uint32_t offset_g,
+	ethash_light_t const light,
+	const uint32_t *g_dag)
+{
 	// global load to sequential locations
-	uint32_t data_g[PROGPOW_LANES][PROGPOW_DAG_LOADS];
-	uint32_t dag_data[PROGPOW_LANES*PROGPOW_DAG_LOADS];
 	if (g_dag) {
 		for (int i = 0; i < PROGPOW_DAG_LOADS; i++) {
 			memcpy((void *)&dag_data[PROGPOW_LANES*i],
@@ -328,64 +454,51 @@ void progPowLoop(
 				PROGPOW_LANES*sizeof(uint32_t));
 		}
 	} else {
-		node tmp_node;
-		for (int i = 0; i < PROGPOW_DAG_LOADS; i++) {
-			uint64_t k = offset_g*PROGPOW_LANES*PROGPOW_DAG_LOADS + i*PROGPOW_LANES;
-			ethash_calculate_dag_item(&tmp_node, k / 16, light);
-			memcpy((void *)&dag_data[PROGPOW_LANES*i],
-				(void *)&tmp_node.words[0],
-				PROGPOW_LANES*sizeof(uint32_t));
-		}
+		// the PROGPOW_DAG_LOADS loads are the consecutive nodes starting at
+		// offset_g*PROGPOW_LANES*PROGPOW_DAG_LOADS / NODE_WORDS
+		ETHASH_ALIGNED(64) node tmp_nodes[PROGPOW_DAG_LOADS];
+		ethash_light_dag_items(tmp_nodes, offset_g * PROGPOW_DAG_LOADS, PROGPOW_DAG_LOADS, light);
+		memcpy((void *)dag_data, (void *)tmp_nodes, sizeof(tmp_nodes));
 	}
+}
 
-	//int max_i = max(PROGPOW_CNT_CACHE, PROGPOW_CNT_MATH);
-	int max_i;
-	if (PROGPOW_CNT_CACHE > PROGPOW_CNT_MATH)
-		max_i = PROGPOW_CNT_CACHE;
-	else
-		max_i = PROGPOW_CNT_MATH;
-
-	// Initialize the program seed and sequences
-	// When mining these are evaluated on the CPU and compiled away
-	uint32_t mix_seq_dst[PROGPOW_REGS];
-	uint32_t mix_seq_src[PROGPOW_REGS];
-	uint32_t mix_seq_dst_cnt = 0;
-	uint32_t mix_seq_src_cnt = 0;
-	kiss99_t prog_rnd = progPowInit(prog_seed, mix_seq_dst, mix_seq_src);
+void progPowLoop(
+	progpow_program_t const* prog,
+	const uint32_t loop,
+	ethash_light_t const light,
+	uint32_t mix[PROGPOW_LANES][PROGPOW_REGS],
+	const uint32_t *g_dag,
+	const uint32_t *c_dag,
+	ethash_fastmod_t const* dag_entries)
+{
+	uint32_t data_g[PROGPOW_LANES][PROGPOW_DAG_LOADS];
+	uint32_t dag_data[PROGPOW_LANES*PROGPOW_DAG_LOADS];
+	// the entry is known before the cache and math ops, so its load can start
+	// right away and only has to be complete at the end of the iteration
+	uint32_t const entry = progpow_dag_entry(loop, mix, dag_entries);
+	progpow_prefetch_dag(g_dag, entry);
 
-	for (int i = 0; i < max_i; i++)
+	for (int i = 0; i < PROGPOW_PROGRAM_LENGTH; i++)
 	{
-		if (i < PROGPOW_CNT_CACHE)
+		progpow_instruction_t const ins = prog->instructions[i];
+		if (ins.op == PROGPOW_OP_CACHE)
 		{
-			// Cached memory access
-			// lanes access random 32-bit locations within the first portion of the DAG
-			int src = mix_seq_src[(mix_seq_src_cnt++)%PROGPOW_REGS];
-			int dst = mix_seq_dst[(mix_seq_dst_cnt++)%PROGPOW_REGS];
-			int sel = kiss99(&prog_rnd);
 			for (int l = 0; l < PROGPOW_LANES; l++)
 			{
-				uint32_t offset = mix[l][src] % PROGPOW_CACHE_WORDS;
-				merge(&(mix[l][dst]), c_dag[offset], sel);
+				uint32_t offset = mix[l][ins.src1] % PROGPOW_CACHE_WORDS;
+				merge(&(mix[l][ins.dst]), c_dag[offset], ins.sel2);
 			}
 		}
-		if (i < PROGPOW_CNT_MATH)
+		else
 		{
-			// Random Math
-			// Generate 2 unique sources
-			int src_rnd = kiss99(&prog_rnd) % (PROGPOW_REGS * (PROGPOW_REGS-1));
-			int src1 = src_rnd % PROGPOW_REGS; // 0 <= src1 < PROGPOW_REGS
-			int src2 = src_rnd / PROGPOW_REGS; // 0 <= src2 < PROGPOW_REGS - 1
-			if (src2 >= src1) ++src2; // src2 is now any reg other than src1
-			int sel1 = kiss99(&prog_rnd);
-			int dst = mix_seq_dst[(mix_seq_dst_cnt++)%PROGPOW_REGS];
-			int sel2 = kiss99(&prog_rnd);
 			for (int l = 0; l < PROGPOW_LANES; l++)
 			{
-				uint32_t data = progpowMath(mix[l][src1], mix[l][src2], sel1);
-				merge(&(mix[l][dst]), data, sel2);
+				uint32_t data = progpowMath(mix[l][ins.src1], mix[l][ins.src2], ins.sel1);
+				merge(&(mix[l][ins.dst]), data, ins.sel2);
 			}
 		}
 	}
+	progpow_load_dag(dag_data, entry, light, g_dag);
 	for (int l = 0; l < PROGPOW_LANES; l++)
 	{
 		// global load to the 256 byte DAG entry
@@ -396,79 +509,84 @@ void progPowLoop(
 	}
 
 	// Consume the global load data at the very end of the loop to allow full latency hiding
-	// Always merge into mix[0] to feed the offset calculation
 	for (int i = 0; i < PROGPOW_DAG_LOADS; i++)
 	{
-		int dst = (i==0) ? 0 : mix_seq_dst[(mix_seq_dst_cnt++)%PROGPOW_REGS];
-		int sel = kiss99(&prog_rnd);
 		for (int l = 0; l < PROGPOW_LANES; l++)
-			merge(&(mix[l][dst]), data_g[l][i], sel);
+			merge(&(mix[l][prog->dag_dst[i]]), data_g[l][i], prog->dag_sel[i]);
 	}
 }
 
-static bool progpow_hash(
-	ethash_return_value_t* ret,
-	node const* full_nodes,
-	ethash_light_t const light,
-	uint64_t full_size,
-	ethash_h256_t const header_hash,
-	uint64_t const nonce,
-	uint64_t const block_number
-)
+// Compute the first PROGPOW_CACHE_WORDS words of the DAG from the light cache
+static void progpow_fill_cache(uint32_t c_dag[PROGPOW_CACHE_WORDS], ethash_light_t const light)
 {
-	uint32_t *g_dag = NULL;
+	ETHASH_ALIGNED(64) node tmp_nodes[PROGPOW_CACHE_WORDS / NODE_WORDS];
+	ethash_calculate_dag_items(tmp_nodes, 0, PROGPOW_CACHE_WORDS / NODE_WORDS, light);
+	memcpy((void *)c_dag, (void *)tmp_nodes, PROGPOW_CACHE_BYTES);
+}
 
-	const hash32_t header;
-	memcpy((void *)&header, (void *)&header_hash, sizeof(header_hash));
-	uint32_t c_dag[PROGPOW_CACHE_WORDS];
-	if (full_nodes) {
-		g_dag = (uint32_t *) full_nodes;
-		for(int l = 0; l < PROGPOW_LANES; l++)
-		{
-			// Load random data into the cache
-			// TODO: should be a new blob of data, not existing DAG data
-			for (uint32_t word = l*4; word < PROGPOW_CACHE_WORDS; word += PROGPOW_LANES*4)
-			{
-				c_dag[word + 0] = g_dag[word + 0];
-				c_dag[word + 1] = g_dag[word + 1];
-				c_dag[word + 2] = g_dag[word + 2];
-				c_dag[word + 3] = g_dag[word + 3];
-			}
-		}
-	} else {
-		node tmp_node;
-		for(int l = 0; l < PROGPOW_LANES; l++)
-		{
-			for (uint32_t word = l*NODE_WORDS; word < PROGPOW_CACHE_WORDS; word += PROGPOW_LANES*NODE_WORDS)
-			{
-				ethash_calculate_dag_item(&tmp_node, word / NODE_WORDS, light);
-				memcpy((void *)&c_dag[word], (void *)&tmp_node.words[0], sizeof(uint32_t) * NODE_WORDS);
-			}
-		}
+bool progpow_full_compute_cache(ethash_full_t full)
+{
+	// without a budget for it the hashes read the start of the DAG instead
+	if (!ethash_budget_reserve(PROGPOW_CACHE_BYTES)) {
+		return false;
+	}
+	// page aligned, so the cache lines of the cache are never shared
+	if (!ethash_memory_alloc(&full->progpow_cache, PROGPOW_CACHE_BYTES, ETHASH_HUGE_PAGES_OFF)) {
+		ethash_budget_release(PROGPOW_CACHE_BYTES);
+		return false;
 	}
+	full->budget_bytes += PROGPOW_CACHE_BYTES;
+	size_t const size = full->file_size < PROGPOW_CACHE_BYTES ? (size_t)full->file_size : PROGPOW_CACHE_BYTES;
+	memcpy(full->progpow_cache.base, full->data, size);
+	return true;
+}
 
-	uint32_t mix[PROGPOW_LANES][PROGPOW_REGS];
+bool progpow_light_compute_cache(ethash_light_t light)
+{
+	uint32_t* c_dag = malloc(PROGPOW_CACHE_BYTES);
+	if (!c_dag) {
+		return false;
+	}
+	progpow_fill_cache(c_dag, light);
+	light->progpow_cache = c_dag;
+	return true;
+}
+
+// the Keccak-f[800] state of keccak(header..nonce)
+static void progpow_seed_absorb(uint32_t st[25], hash32_t header, uint64_t nonce)
+{
 	hash32_t digest;
 	for (int i = 0; i < 8; i++)
 		digest.uint32s[i] = 0;
+	keccak_f800_progpow_absorb(st, header, nonce, digest);
+}
 
-	// keccak(header..nonce)
-	hash32_t seed_256 = keccak_f800_progpow(header, nonce, digest);
+// the seed of the mix and of the final hash from the permuted seed state
+static uint64_t progpow_seed_squeeze(uint32_t const st[25])
+{
+	hash32_t const seed_256 = keccak_f800_progpow_squeeze(st);
 	// endian swap so byte 0 of the hash is the MSB of the value
-	uint64_t seed = (uint64_t)ethash_swap_u32(seed_256.uint32s[0]) << 32 | ethash_swap_u32(seed_256.uint32s[1]);
+	return (uint64_t)ethash_swap_u32(seed_256.uint32s[0]) << 32 | ethash_swap_u32(seed_256.uint32s[1]);
+}
 
+// keccak(header..nonce), the seed of the mix and of the final hash
+static uint64_t progpow_seed(hash32_t header, uint64_t nonce)
+{
+	uint32_t st[25];
+	progpow_seed_absorb(st, header, nonce);
+	ethash_kernels()->keccakf800->permute(st);
+	return progpow_seed_squeeze(st);
+}
+
+void progPowFillMix(uint64_t seed, uint32_t mix[PROGPOW_LANES][PROGPOW_REGS])
+{
 	// initialize mix for all lanes
 	for (int l = 0; l < PROGPOW_LANES; l++)
 		fill_mix(seed, l, mix[l]);
+}
 
-	uint64_t prog_seed = block_number / PROGPOW_PERIOD;
-	uint32_t dagWords = (unsigned)((uint32_t)full_size / PROGPOW_MIX_BYTES);
-	// execute the randomly generated inner loop
-	for (int i = 0; i < PROGPOW_CNT_DAG; i++)
-	{
-		progPowLoop(prog_seed, i, light, mix, g_dag, c_dag, dagWords);
-	}
-
+void progPowReduceMix(uint32_t mix[PROGPOW_LANES][PROGPOW_REGS], uint32_t digest[8])
+{
 	// Reduce mix data to a single per-lane result
 	uint32_t lane_hash[PROGPOW_LANES];
 	for (int l = 0; l < PROGPOW_LANES; l++)
@@ -479,20 +597,168 @@ static bool progpow_hash(
 	}
 	// Reduce all lanes to a single 256-bit result
 	for (int i = 0; i < 8; i++)
-		digest.uint32s[i] = 0x811c9dc5;
+		digest[i] = 0x811c9dc5;
 
 	for (int l = 0; l < PROGPOW_LANES; l++)
-		fnv1a(&digest.uint32s[l%8], lane_hash[l]);
+		fnv1a(&digest[l%8], lane_hash[l]);
+}
 
+// Fill the mix of all lanes from the seed, with the kernel of the host
+static void progpow_fill_mix(uint64_t seed, uint32_t mix[PROGPOW_LANES][PROGPOW_REGS])
+{
+	ethash_kernels()->progpow_loop->fill_mix(seed, mix);
+}
+
+// Fill the mix of all lanes from the seed of the header and the nonce
+static uint64_t progpow_init_mix(hash32_t header, uint64_t nonce, uint32_t mix[PROGPOW_LANES][PROGPOW_REGS])
+{
+	uint64_t const seed = progpow_seed(header, nonce);
+	progpow_fill_mix(seed, mix);
+	return seed;
+}
+
+// Reduce the mix after the last iteration to the mix hash of @a ret,
+// returning it as the digest the final hash absorbs
+static hash32_t progpow_reduce_mix(ethash_return_value_t* ret, uint32_t mix[PROGPOW_LANES][PROGPOW_REGS])
+{
+	hash32_t digest;
+	ethash_kernels()->progpow_loop->reduce_mix(mix, digest.uint32s);
 	memset((void *)&ret->mix_hash, 0, sizeof(ret->mix_hash));
 	memcpy(&ret->mix_hash, (void *)&digest, sizeof(digest));
+	return digest;
+}
+
+// Reduce the mix after the last iteration and compute the final hash
+static void progpow_finish(ethash_return_value_t* ret, hash32_t header, uint64_t seed, uint32_t mix[PROGPOW_LANES][PROGPOW_REGS])
+{
+	hash32_t digest = progpow_reduce_mix(ret, mix);
 	memset((void *)&ret->result, 0, sizeof(ret->result));
 	digest = keccak_f800_progpow(header, seed, digest);
 	memcpy((void *)&ret->result, (void *)&digest, sizeof(ret->result));
+}
+
+static bool progpow_hash(
+	ethash_return_value_t* ret,
+	node const* full_nodes,
+	uint32_t const* full_cache,
+	ethash_light_t const light,
+	ethash_fastmod_t const* dag_entries,
+	ethash_h256_t const header_hash,
+	uint64_t const nonce,
+	uint64_t const prog_seed
+)
+{
+	uint32_t *g_dag = NULL;
+
+	const hash32_t header;
+	memcpy((void *)&header, (void *)&header_hash, sizeof(header_hash));
+	ETHASH_ALIGNED(64) uint32_t c_dag_buf[PROGPOW_CACHE_WORDS];
+	uint32_t const* c_dag = c_dag_buf;
+	if (full_nodes) {
+		g_dag = (uint32_t *) full_nodes;
+		// The cache is the start of the DAG
+		// TODO: should be a new blob of data, not existing DAG data
+		c_dag = full_cache ? full_cache : g_dag;
+	} else if (light->progpow_cache) {
+		c_dag = light->progpow_cache;
+	} else {
+		progpow_fill_cache(c_dag_buf, light);
+	}
+
+	ETHASH_ALIGNED(64) uint32_t mix[PROGPOW_LANES][PROGPOW_REGS];
+	uint64_t const seed = progpow_init_mix(header, nonce, mix);
+
+	progpow_program_t const* prog = progpow_program_get(prog_seed);
+	ethash_progpow_loop_fn const loop = ethash_kernels()->progpow_loop->loop;
+	progpow_jit_t* const jit = progpow_jit_acquire(prog);
+	// execute the randomly generated inner loop
+	for (int i = 0; i < PROGPOW_CNT_DAG; i++)
+	{
+		if (jit)
+			progpow_jit_loop(jit, i, light, mix, g_dag, c_dag, dag_entries);
+		else
+			loop(prog, i, light, mix, g_dag, c_dag, dag_entries);
+	}
+	progpow_jit_release(jit);
 
+	progpow_finish(ret, header, seed, mix);
+	ethash_stats_add(full_nodes ? ETHASH_STAT_PROGPOW_FULL_HASHES : ETHASH_STAT_PROGPOW_LIGHT_HASHES, 1);
 	return true;
 }
 
+// Hash up to ETHASH_HASH_BATCH nonces of a full DAG in lockstep. Every
+// iteration first prefetches the DAG entries of all the nonces and only then
+// runs the program on them, so the DRAM reads of the batch overlap
+static void progpow_hash_batch(
+	ethash_return_value_t* results,
+	ethash_full_t full,
+	progpow_program_t const* prog,
+	progpow_jit_t const* jit,
+	hash32_t header,
+	uint64_t const* nonces,
+	unsigned count
+)
+{
+	uint32_t const* g_dag = (uint32_t const*)ethash_full_local_data(full);
+	uint32_t const* c_dag = full->progpow_cache.base ? (uint32_t const*)full->progpow_cache.base : g_dag;
+	ethash_fastmod_t const* const dag_entries = &full->progpow_entries;
+	ethash_progpow_loop_fn const loop = ethash_kernels()->progpow_loop->loop;
+
+	// a DAG still being computed is read through its light handler
+	struct ethash_light view;
+	ethash_light_t light = NULL;
+	ETHASH_ALIGNED(64) uint32_t c_dag_buf[PROGPOW_CACHE_WORDS];
+	if (ethash_full_is_partial(full)) {
+		ethash_full_partial_view(full, &view);
+		light = &view;
+		g_dag = NULL;
+		c_dag = view.progpow_cache;
+		if (!c_dag) {
+			progpow_fill_cache(c_dag_buf, &view);
+			c_dag = c_dag_buf;
+		}
+	}
+
+	ethash_keccakf800_multi_kernel_t const* const keccak = ethash_kernels()->keccakf800_multi;
+
+	ETHASH_ALIGNED(64) uint32_t mix[ETHASH_HASH_BATCH][PROGPOW_LANES][PROGPOW_REGS];
+	uint64_t seeds[ETHASH_HASH_BATCH];
+	// the seed and final Keccak-f[800] of all nonces share permutations
+	uint32_t states[ETHASH_HASH_BATCH][25];
+	for (unsigned k = 0; k != count; ++k) {
+		progpow_seed_absorb(states[k], header, nonces[k]);
+	}
+	keccak->permute(states, count);
+	for (unsigned k = 0; k != count; ++k) {
+		seeds[k] = progpow_seed_squeeze(states[k]);
+		progpow_fill_mix(seeds[k], mix[k]);
+	}
+	for (uint32_t i = 0; i < PROGPOW_CNT_DAG; i++) {
+		for (unsigned k = 0; k != count; ++k) {
+			progpow_prefetch_dag(g_dag, progpow_dag_entry(i, mix[k], dag_entries));
+		}
+		for (unsigned k = 0; k != count; ++k) {
+			if (jit) {
+				progpow_jit_loop(jit, i, light, mix[k], g_dag, c_dag, dag_entries);
+			} else {
+				loop(prog, i, light, mix[k], g_dag, c_dag, dag_entries);
+			}
+		}
+	}
+	for (unsigned k = 0; k != count; ++k) {
+		hash32_t const digest = progpow_reduce_mix(&results[k], mix[k]);
+		keccak_f800_progpow_absorb(states[k], header, seeds[k], digest);
+	}
+	keccak->permute(states, count);
+	for (unsigned k = 0; k != count; ++k) {
+		hash32_t const digest = keccak_f800_progpow_squeeze(states[k]);
+		memset((void *)&results[k].result, 0, sizeof(results[k].result));
+		memcpy((void *)&results[k].result, (void *)&digest, sizeof(results[k].result));
+		results[k].success = true;
+	}
+	ethash_stats_add(ETHASH_STAT_PROGPOW_FULL_HASHES, count);
+}
+
 ethash_return_value_t progpow_light_compute_internal(
 	ethash_light_t light,
 	uint64_t full_size,
@@ -502,10 +768,16 @@ ethash_return_value_t progpow_light_compute_internal(
 )
 {
 	ethash_return_value_t ret;
+	uint64_t const prog_seed = block_number / ethash_light_progpow_period(light);
+	if (ethash_result_cache_lookup(light, full_size, prog_seed, &header_hash, nonce, &ret)) {
+		return ret;
+	}
 	ret.success = true;
-	if (!progpow_hash(&ret, NULL, light, full_size, header_hash, nonce, block_number)) {
+	ethash_fastmod_t const dag_entries = progpow_dag_entries(full_size);
+	if (!progpow_hash(&ret, NULL, NULL, light, &dag_entries, header_hash, nonce, prog_seed)) {
 		ret.success = false;
 	}
+	ethash_result_cache_store(light, full_size, prog_seed, &header_hash, nonce, &ret);
 	return ret;
 }
 
@@ -516,10 +788,27 @@ ethash_return_value_t progpow_light_compute(
 	uint64_t block_number
 )
 {
-	uint64_t full_size = ethash_get_datasize(block_number);
+	uint64_t full_size = light->full_size ? light->full_size : ethash_get_datasize(block_number);
 	return progpow_light_compute_internal(light, full_size, header_hash, nonce, block_number);
 }
 
+bool progpow_quick_check_difficulty(
+	ethash_h256_t const* header_hash,
+	uint64_t const nonce,
+	ethash_h256_t const* mix_hash,
+	ethash_h256_t const* boundary
+)
+{
+	hash32_t header;
+	hash32_t digest;
+	ethash_h256_t result;
+	memcpy(&header, header_hash, sizeof(header));
+	memcpy(&digest, mix_hash, sizeof(digest));
+	digest = keccak_f800_progpow(header, progpow_seed(header, nonce), digest);
+	memcpy(&result, &digest, sizeof(result));
+	return ethash_check_difficulty(&result, boundary);
+}
+
 ethash_return_value_t progpow_full_compute(
 	ethash_full_t full,
 	ethash_h256_t const header_hash,
@@ -527,17 +816,102 @@ ethash_return_value_t progpow_full_compute(
 	uint64_t block_number
 )
 {
+	ethash_full_wait_generated(full);
 	ethash_return_value_t ret;
 	ret.success = true;
+	if (ethash_full_is_partial(full)) {
+		struct ethash_light view;
+		ethash_full_partial_view(full, &view);
+		ret.success = progpow_hash(
+			&ret, NULL, NULL, &view, &full->progpow_entries, header_hash, nonce, block_number / ethash_full_progpow_period(full)
+		);
+		return ret;
+	}
 	if (!progpow_hash(
 		&ret,
-		(node const*)full->data,
+		ethash_full_local_data(full),
+		(uint32_t const*)full->progpow_cache.base,
 		NULL,
-		full->file_size,
+		&full->progpow_entries,
 		header_hash,
 		nonce,
-		block_number)) {
+		block_number / ethash_full_progpow_period(full))) {
 		ret.success = false;
 	}
 	return ret;
 }
+
+bool progpow_full_compute_batch(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	uint64_t const* nonces,
+	ethash_return_value_t* results,
+	size_t count,
+	uint64_t block_number
+)
+{
+	ethash_full_wait_generated(full);
+	hash32_t header;
+	memcpy(&header, &header_hash, sizeof(header));
+	progpow_program_t const* const prog = progpow_program_get(block_number / ethash_full_progpow_period(full));
+	progpow_jit_t* const jit = progpow_jit_acquire(prog);
+	for (size_t first = 0; first < count; first += ETHASH_HASH_BATCH) {
+		unsigned const n = count - first < ETHASH_HASH_BATCH ? (unsigned)(count - first) : ETHASH_HASH_BATCH;
+		progpow_hash_batch(results + first, full, prog, jit, header, nonces + first, n);
+	}
+	progpow_jit_release(jit);
+	return true;
+}
+
+uint64_t progpow_full_search_multi(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	uint64_t block_number,
+	uint64_t start_nonce,
+	uint64_t count,
+	ethash_search_target_t* targets,
+	size_t num_targets
+)
+{
+	ethash_full_wait_generated(full);
+	uint64_t hashed = 0;
+	bool open = ethash_search_targets_reset(targets, num_targets);
+	hash32_t header;
+	memcpy(&header, &header_hash, sizeof(header));
+	progpow_program_t const* const prog = progpow_program_get(block_number / ethash_full_progpow_period(full));
+	progpow_jit_t* const jit = progpow_jit_acquire(prog);
+	uint64_t nonces[ETHASH_HASH_BATCH];
+	ethash_return_value_t results[ETHASH_HASH_BATCH];
+	unsigned const batch = ethash_get_hash_batch();
+	// hash a batch at a time, the hits are still recorded in nonce order
+	while (open && hashed < count) {
+		unsigned const n = count - hashed < batch ? (unsigned)(count - hashed) : batch;
+		for (unsigned k = 0; k != n; ++k) {
+			nonces[k] = start_nonce + hashed + k;
+		}
+		progpow_hash_batch(results, full, prog, jit, header, nonces, n);
+		hashed += ethash_search_targets_record(targets, num_targets, nonces, results, n);
+		open = ethash_search_targets_open(targets, num_targets);
+	}
+	progpow_jit_release(jit);
+	return hashed;
+}
+
+size_t progpow_full_search(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	uint64_t block_number,
+	uint64_t start_nonce,
+	uint64_t count,
+	ethash_h256_t const* boundary,
+	ethash_search_hit_t* hits,
+	size_t max_hits
+)
+{
+	ethash_search_target_t target;
+	target.boundary = *boundary;
+	target.hits = hits;
+	target.max_hits = max_hits;
+	progpow_full_search_multi(full, header_hash, block_number, start_nonce, count, &target, 1);
+	return target.found;
+}
@@ -0,0 +1,541 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file progpow_jit.c
+ * @date 2018
+ *
+ * The program of a period is translated into x86-64 code running one lane
+ * of one loop iteration, from a fixed template per operation. The mix words
+ * of the lane stay in memory, so the code needs no register allocation and
+ * all the selector switches of @ref progpowMath() and @ref merge() are
+ * resolved when the code is generated.
+ *
+ * Registers of the generated code:
+ *   rdi   the PROGPOW_REGS mix words of the lane
+ *   rsi   the cache words
+ *   r8    the PROGPOW_DAG_LOADS words of the DAG entry read by the lane
+ *   eax   the second operand of the merges, and the result of the ops
+ *   ecx   the first operand of the merges, the second one of the math ops
+ *   edx, r9d, r11d  scratch, r10d holds -1 for the clz op
+ *
+ * With @ref ethash_progpow_set_jit_compiler() the same function is compiled
+ * from the C source of @ref progpow_program_source() instead, and loaded as
+ * a shared library.
+ */
+
+#include "progpow_jit.h"
+#include "cpu_features.h"
+#include "io.h"
+#include "memory.h"
+#include "threads.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define PROGPOW_JIT_X64 1
+#endif
+
+#if !defined(_WIN32)
+#include <dlfcn.h>
+#include <unistd.h>
+#define PROGPOW_JIT_CC 1
+#endif
+
+typedef void (*progpow_jit_fn)(uint32_t mix[PROGPOW_REGS], uint32_t const* c_dag, uint32_t const* lane_dag);
+
+struct progpow_jit {
+	uint64_t prog_seed;
+	progpow_jit_fn fn;          ///< The code of the lanes, NULL if the slot is free
+	struct ethash_memory code;  ///< The code generated from the templates
+	void* library;              ///< The shared library of compiled code, NULL for the templates
+	uint32_t volatile refs;     ///< Number of hashes using the code, changed without jit_mutex
+	uint64_t volatile ready;    ///< prog_seed + 1 while fn may be taken without jit_mutex, 0 otherwise
+	uint64_t volatile last_use; ///< Value of jit_clock when it was last acquired
+	bool compiling;             ///< The code of prog_seed is being generated outside jit_mutex
+};
+
+// the code of the most recent periods, evicted least recently used first
+#define PROGPOW_JIT_SLOTS 8
+// the longest template, the clz op, is 45 bytes
+#define PROGPOW_JIT_MAX_OP 64
+#define PROGPOW_JIT_CODE_SIZE 4096
+
+#if (PROGPOW_PROGRAM_LENGTH + PROGPOW_DAG_LOADS + 1) * PROGPOW_JIT_MAX_OP > PROGPOW_JIT_CODE_SIZE
+#error "the generated code may not fit in PROGPOW_JIT_CODE_SIZE"
+#endif
+
+static ethash_once_t jit_once = ETHASH_ONCE_INIT;
+static ethash_mutex_t jit_mutex;
+static struct progpow_jit jit_slots[PROGPOW_JIT_SLOTS];
+/// Advanced by the hashes that take jit_mutex, the others reuse it to mark their slot
+static uint64_t volatile jit_clock = 0;
+static uint32_t volatile jit_enabled = 0;
+/// The command of ethash_progpow_set_jit_compiler(), empty for the templates
+static char jit_compiler[256];
+/// The periods whose code could not be generated, not to try again for every hash
+static uint64_t jit_failed_seeds[PROGPOW_JIT_SLOTS];
+static unsigned jit_failed_count = 0;
+static unsigned jit_failed_next = 0;
+/// Changed with the compiler, code generated the old way is not kept
+static uint64_t jit_generation = 0;
+
+static void jit_init(void)
+{
+	ethash_mutex_init(&jit_mutex);
+}
+
+// Whether the host can run the code of the templates
+static bool jit_templates_supported(void)
+{
+#if defined(PROGPOW_JIT_X64)
+	return (ethash_cpu_features() & ETHASH_CPU_POPCNT) != 0;
+#else
+	return false;
+#endif
+}
+
+#if defined(PROGPOW_JIT_X64)
+
+typedef struct jit_writer {
+	uint8_t* p;
+} jit_writer_t;
+
+static void jit_emit(jit_writer_t* w, uint8_t const* bytes, size_t size)
+{
+	memcpy(w->p, bytes, size);
+	w->p += size;
+}
+
+#define JIT_EMIT(w, ...) \
+	jit_emit((w), (uint8_t const[]){ __VA_ARGS__ }, sizeof((uint8_t const[]){ __VA_ARGS__ }))
+
+#define JIT_U32(v) \
+	(uint8_t)(v), (uint8_t)((v) >> 8), (uint8_t)((v) >> 16), (uint8_t)((v) >> 24)
+
+// mov eax/ecx, [rdi + 4 * reg_index]
+static void jit_load_eax(jit_writer_t* w, uint32_t r)
+{
+	JIT_EMIT(w, 0x8b, 0x47, (uint8_t)(4 * r));
+}
+
+static void jit_load_ecx(jit_writer_t* w, uint32_t r)
+{
+	JIT_EMIT(w, 0x8b, 0x4f, (uint8_t)(4 * r));
+}
+
+// eax = progpowMath(eax, ecx, r)
+static void jit_math(jit_writer_t* w, uint32_t r)
+{
+	switch (r % 11) {
+	case 0: JIT_EMIT(w, 0x01, 0xc8); break;                   // add eax, ecx
+	case 1: JIT_EMIT(w, 0x0f, 0xaf, 0xc1); break;             // imul eax, ecx
+	case 2: JIT_EMIT(w, 0xf7, 0xe1, 0x89, 0xd0); break;       // mul ecx; mov eax, edx
+	case 3: JIT_EMIT(w, 0x39, 0xc8, 0x0f, 0x47, 0xc1); break; // cmp eax, ecx; cmova eax, ecx
+	case 4: JIT_EMIT(w, 0xd3, 0xc0); break;                   // rol eax, cl
+	case 5: JIT_EMIT(w, 0xd3, 0xc8); break;                   // ror eax, cl
+	case 6: JIT_EMIT(w, 0x21, 0xc8); break;                   // and eax, ecx
+	case 7: JIT_EMIT(w, 0x09, 0xc8); break;                   // or eax, ecx
+	case 8: JIT_EMIT(w, 0x31, 0xc8); break;                   // xor eax, ecx
+	case 9:
+		// bsr leaves the index of the highest set bit, -1 stands in for 0 so
+		// that clz(a) + clz(b) = 62 - bsr(a) - bsr(b)
+		JIT_EMIT(w,
+			0x44, 0x0f, 0xbd, 0xc8,  // bsr r9d, eax
+			0x45, 0x0f, 0x44, 0xca,  // cmovz r9d, r10d
+			0x44, 0x0f, 0xbd, 0xd9,  // bsr r11d, ecx
+			0x45, 0x0f, 0x44, 0xda,  // cmovz r11d, r10d
+			0xb8, JIT_U32(62),       // mov eax, 62
+			0x44, 0x29, 0xc8,        // sub eax, r9d
+			0x44, 0x29, 0xd8         // sub eax, r11d
+		);
+		break;
+	case 10:
+		JIT_EMIT(w,
+			0xf3, 0x0f, 0xb8, 0xc0,  // popcnt eax, eax
+			0xf3, 0x0f, 0xb8, 0xc9,  // popcnt ecx, ecx
+			0x01, 0xc8               // add eax, ecx
+		);
+		break;
+	}
+}
+
+// merge(&mix[dst], eax, r)
+static void jit_merge(jit_writer_t* w, uint32_t dst, uint32_t r)
+{
+	uint8_t const rot = (uint8_t)(((r >> 16) % 31) + 1);
+	jit_load_ecx(w, dst);
+	switch (r % 4) {
+	case 0: JIT_EMIT(w, 0x6b, 0xc9, 33, 0x01, 0xc1); break;       // imul ecx, ecx, 33; add ecx, eax
+	case 1: JIT_EMIT(w, 0x31, 0xc1, 0x6b, 0xc9, 33); break;       // xor ecx, eax; imul ecx, ecx, 33
+	case 2: JIT_EMIT(w, 0xc1, 0xc1, rot, 0x31, 0xc1); break;      // rol ecx, rot; xor ecx, eax
+	case 3: JIT_EMIT(w, 0xc1, 0xc9, rot, 0x31, 0xc1); break;      // ror ecx, rot; xor ecx, eax
+	}
+	JIT_EMIT(w, 0x89, 0x4f, (uint8_t)(4 * dst));                 // mov [rdi + 4 * dst], ecx
+}
+
+static void jit_generate(uint8_t* code, progpow_program_t const* prog)
+{
+	jit_writer_t w = { code };
+#if defined(_WIN32)
+	// the arguments come in rcx, rdx and r8, and rdi and rsi are callee saved
+	JIT_EMIT(&w, 0x57, 0x56, 0x48, 0x89, 0xcf, 0x48, 0x89, 0xd6); // push rdi; push rsi; mov rdi, rcx; mov rsi, rdx
+#else
+	JIT_EMIT(&w, 0x49, 0x89, 0xd0);                               // mov r8, rdx
+#endif
+	JIT_EMIT(&w, 0x41, 0xba, JIT_U32(0xffffffffu));               // mov r10d, -1
+
+	for (unsigned i = 0; i != PROGPOW_PROGRAM_LENGTH; ++i) {
+		progpow_instruction_t const ins = prog->instructions[i];
+		jit_load_eax(&w, ins.src1);
+		if (ins.op == PROGPOW_OP_CACHE) {
+			uint32_t const mask = (uint32_t)(PROGPOW_CACHE_WORDS - 1);
+			JIT_EMIT(&w, 0x25, JIT_U32(mask));                         // and eax, CACHE_WORDS - 1
+			JIT_EMIT(&w, 0x8b, 0x04, 0x86);                            // mov eax, [rsi + 4 * rax]
+		} else {
+			jit_load_ecx(&w, ins.src2);
+			jit_math(&w, ins.sel1);
+		}
+		jit_merge(&w, ins.dst, ins.sel2);
+	}
+	for (unsigned i = 0; i != PROGPOW_DAG_LOADS; ++i) {
+		JIT_EMIT(&w, 0x41, 0x8b, 0x40, (uint8_t)(4 * i));             // mov eax, [r8 + 4 * i]
+		jit_merge(&w, prog->dag_dst[i], prog->dag_sel[i]);
+	}
+
+#if defined(_WIN32)
+	JIT_EMIT(&w, 0x5e, 0x5f);                                      // pop rsi; pop rdi
+#endif
+	JIT_EMIT(&w, 0xc3);                                            // ret
+}
+
+static bool jit_compile_templates(struct progpow_jit* jit, progpow_program_t const* prog)
+{
+	if (!ethash_memory_alloc(&jit->code, PROGPOW_JIT_CODE_SIZE, ETHASH_HUGE_PAGES_OFF)) {
+		return false;
+	}
+	jit_generate((uint8_t*)jit->code.base, prog);
+	if (!ethash_memory_protect_exec(&jit->code)) {
+		ethash_memory_free(&jit->code);
+		return false;
+	}
+	jit->fn = (progpow_jit_fn)jit->code.base;
+	return true;
+}
+
+#endif // PROGPOW_JIT_X64
+
+#if defined(PROGPOW_JIT_CC)
+
+// Compile the C source of the program with jit_compiler in a directory of
+// its own and load the library
+static bool jit_compile_cc(struct progpow_jit* jit, progpow_program_t const* prog, char const* compiler)
+{
+	bool ret = false;
+	char* source = NULL;
+	char dir[1024];
+	char source_path[1100];
+	char library_path[1100];
+	char command[sizeof(jit_compiler) + 2 * sizeof(library_path) + 64];
+	char const* const tmp = getenv("TMPDIR");
+	int const n = snprintf(dir, sizeof(dir), "%s/ethash-progpow-XXXXXX", tmp && tmp[0] ? tmp : "/tmp");
+	if (n < 0 || (size_t)n >= sizeof(dir) || !mkdtemp(dir)) {
+		return false;
+	}
+	snprintf(source_path, sizeof(source_path), "%s/loop.c", dir);
+	snprintf(library_path, sizeof(library_path), "%s/loop.so", dir);
+
+	size_t const length = progpow_program_source(prog, PROGPOW_SOURCE_C, NULL, 0);
+	source = malloc(length + 1);
+	if (!source) {
+		goto cleanup;
+	}
+	progpow_program_source(prog, PROGPOW_SOURCE_C, source, length + 1);
+	FILE* f = fopen(source_path, "w");
+	if (!f) {
+		goto cleanup;
+	}
+	bool const written = fwrite(source, 1, length, f) == length;
+	if (fclose(f) != 0 || !written) {
+		goto cleanup;
+	}
+	snprintf(
+		command, sizeof(command), "%s -O2 -shared -fPIC -o \"%s\" \"%s\" >/dev/null 2>&1",
+		compiler, library_path, source_path
+	);
+	if (system(command) != 0) {
+		ETHASH_CRITICAL("\"%s\" could not compile the ProgPoW program %" PRIu64 ".", compiler, prog->prog_seed);
+		goto cleanup;
+	}
+	void* const library = dlopen(library_path, RTLD_NOW | RTLD_LOCAL);
+	if (!library) {
+		goto cleanup;
+	}
+	void* const fn = dlsym(library, "progpow_period_lane");
+	if (!fn) {
+		dlclose(library);
+		goto cleanup;
+	}
+	jit->library = library;
+	memcpy(&jit->fn, &fn, sizeof(fn));
+	ret = true;
+
+cleanup:
+	free(source);
+	// the loaded library stays mapped once its file is gone
+	remove(source_path);
+	remove(library_path);
+	rmdir(dir);
+	return ret;
+}
+
+#endif // PROGPOW_JIT_CC
+
+// Generate the code of a program into a slot that is not published yet
+static bool jit_compile(struct progpow_jit* jit, progpow_program_t const* prog, char const* compiler)
+{
+	bool compiled = false;
+#if defined(PROGPOW_JIT_CC)
+	if (compiler[0]) {
+		compiled = jit_compile_cc(jit, prog, compiler);
+	}
+#else
+	(void)compiler;
+#endif
+#if defined(PROGPOW_JIT_X64)
+	if (!compiled && jit_templates_supported()) {
+		compiled = jit_compile_templates(jit, prog);
+	}
+#endif
+	if (!compiled) {
+		return false;
+	}
+	jit->prog_seed = prog->prog_seed;
+	return true;
+}
+
+static void jit_free(struct progpow_jit* jit)
+{
+#if defined(PROGPOW_JIT_CC)
+	if (jit->library) {
+		dlclose(jit->library);
+		jit->library = NULL;
+	}
+#endif
+	ethash_memory_free(&jit->code);
+	jit->fn = NULL;
+}
+
+// Take the code of a slot away from the hashes not holding jit_mutex and free
+// it, false if a hash still uses it. Holds jit_mutex.
+static bool jit_retire(struct progpow_jit* jit)
+{
+	if (!jit->fn) {
+		return true;
+	}
+	uint64_t const ready = jit->ready;
+	// a hash counts itself before checking ready again, so once ready is 0
+	// either its count is seen here or it sees 0 and gives the code back
+	ethash_atomic_store_u64(&jit->ready, 0);
+	if (ethash_atomic_load_u32(&jit->refs) != 0) {
+		ethash_atomic_store_u64(&jit->ready, ready);
+		return false;
+	}
+	jit_free(jit);
+	return true;
+}
+
+// Free the code no hash uses, the rest is freed once replaced by a later period.
+// The code being generated is dropped when it is done.
+static void jit_free_unused(void)
+{
+	for (unsigned i = 0; i != PROGPOW_JIT_SLOTS; ++i) {
+		if (!jit_slots[i].compiling) {
+			jit_retire(&jit_slots[i]);
+		}
+	}
+	jit_failed_count = 0;
+	jit_generation++;
+}
+
+static bool jit_seed_failed(uint64_t prog_seed)
+{
+	for (unsigned i = 0; i != jit_failed_count; ++i) {
+		if (jit_failed_seeds[i] == prog_seed) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Remember a failed period, forgetting the oldest one once as many failed as there are slots
+static void jit_seed_fail(uint64_t prog_seed)
+{
+	jit_failed_seeds[jit_failed_next] = prog_seed;
+	jit_failed_next = (jit_failed_next + 1) % PROGPOW_JIT_SLOTS;
+	if (jit_failed_count < PROGPOW_JIT_SLOTS) {
+		jit_failed_count++;
+	}
+}
+
+// Take the code of a period without jit_mutex, NULL if it is not ready
+static struct progpow_jit* jit_lookup(uint64_t prog_seed)
+{
+	for (unsigned i = 0; i != PROGPOW_JIT_SLOTS; ++i) {
+		struct progpow_jit* const slot = &jit_slots[i];
+		if (ethash_atomic_load_u64(&slot->ready) != prog_seed + 1) {
+			continue;
+		}
+		ethash_atomic_fetch_add_u32(&slot->refs, 1);
+		if (ethash_atomic_load_u64(&slot->ready) != prog_seed + 1) {
+			// retired meanwhile
+			ethash_atomic_fetch_add_u32(&slot->refs, (uint32_t)-1);
+			return NULL;
+		}
+		// only written when it changes, so the hashes of a period share the line
+		uint64_t const now = ethash_atomic_load_u64(&jit_clock);
+		if (ethash_atomic_load_u64(&slot->last_use) != now) {
+			ethash_atomic_store_u64(&slot->last_use, now);
+		}
+		return slot;
+	}
+	return NULL;
+}
+
+progpow_jit_t* progpow_jit_acquire(progpow_program_t const* prog)
+{
+	if (!ethash_atomic_load_u32(&jit_enabled)) {
+		return NULL;
+	}
+	struct progpow_jit* found = jit_lookup(prog->prog_seed);
+	if (found) {
+		return found;
+	}
+	ethash_mutex_lock(&jit_mutex);
+	struct progpow_jit* victim = NULL;
+	for (unsigned i = 0; i != PROGPOW_JIT_SLOTS; ++i) {
+		struct progpow_jit* const slot = &jit_slots[i];
+		if ((slot->fn || slot->compiling) && slot->prog_seed == prog->prog_seed) {
+			found = slot;
+			break;
+		}
+		// code in use by other hashes or being generated can't be replaced
+		if (ethash_atomic_load_u32(&slot->refs) == 0 && !slot->compiling && (!victim || !slot->fn ||
+				(victim->fn && slot->last_use < victim->last_use))) {
+			victim = slot;
+		}
+	}
+	if (found && found->compiling) {
+		// another hash generates the code, this one uses the kernel meanwhile
+		found = NULL;
+	} else if (!found && victim && !jit_seed_failed(prog->prog_seed) && jit_retire(victim)) {
+		// the compiler may run for a while, without holding up the other periods
+		char compiler[sizeof(jit_compiler)];
+		strcpy(compiler, jit_compiler);
+		uint64_t const generation = jit_generation;
+		victim->prog_seed = prog->prog_seed;
+		victim->compiling = true;
+		ethash_mutex_unlock(&jit_mutex);
+		struct progpow_jit code;
+		memset(&code, 0, sizeof(code));
+		bool const compiled = jit_compile(&code, prog, compiler);
+		ethash_mutex_lock(&jit_mutex);
+		victim->compiling = false;
+		if (generation != jit_generation) {
+			jit_free(&code);
+		} else if (compiled) {
+			// hashes that raced with the retirement may still hold refs for a moment
+			victim->fn = code.fn;
+			victim->code = code.code;
+			victim->library = code.library;
+			found = victim;
+		} else {
+			jit_seed_fail(prog->prog_seed);
+		}
+	}
+	if (found) {
+		ethash_atomic_fetch_add_u32(&found->refs, 1);
+		ethash_atomic_store_u64(&found->last_use, ethash_atomic_fetch_add_u64(&jit_clock, 1) + 1);
+		ethash_atomic_store_u64(&found->ready, found->prog_seed + 1);
+	}
+	ethash_mutex_unlock(&jit_mutex);
+	return found;
+}
+
+void progpow_jit_release(progpow_jit_t* jit)
+{
+	if (!jit) {
+		return;
+	}
+	ethash_atomic_fetch_add_u32(&jit->refs, (uint32_t)-1);
+}
+
+void progpow_jit_loop(
+	progpow_jit_t const* jit,
+	const uint32_t loop,
+	ethash_light_t const light,
+	uint32_t mix[PROGPOW_LANES][PROGPOW_REGS],
+	const uint32_t* g_dag,
+	const uint32_t* c_dag,
+	ethash_fastmod_t const* dag_entries
+)
+{
+	uint32_t dag_data[PROGPOW_LANES*PROGPOW_DAG_LOADS];
+	// every lane merges the DAG data at the end of its own code, so it is
+	// needed before the first lane runs
+	uint32_t const entry = progpow_dag_entry(loop, mix, dag_entries);
+	progpow_prefetch_dag(g_dag, entry);
+	progpow_load_dag(dag_data, entry, light, g_dag);
+	// the lanes are independent, so each one runs the whole iteration at once
+	for (uint32_t l = 0; l < PROGPOW_LANES; l++) {
+		jit->fn(mix[l], c_dag, &dag_data[((l ^ loop) % PROGPOW_LANES) * PROGPOW_DAG_LOADS]);
+	}
+}
+
+bool ethash_progpow_set_jit(bool enable)
+{
+	ethash_call_once(&jit_once, jit_init);
+	ethash_mutex_lock(&jit_mutex);
+	if (enable && !jit_compiler[0] && !jit_templates_supported()) {
+		ethash_mutex_unlock(&jit_mutex);
+		return false;
+	}
+	ethash_atomic_store_u32(&jit_enabled, enable ? 1 : 0);
+	if (!enable) {
+		jit_free_unused();
+	}
+	ethash_mutex_unlock(&jit_mutex);
+	return true;
+}
+
+bool ethash_progpow_set_jit_compiler(char const* compiler)
+{
+#if defined(PROGPOW_JIT_CC)
+	if (compiler && strlen(compiler) >= sizeof(jit_compiler)) {
+		return false;
+	}
+	ethash_call_once(&jit_once, jit_init);
+	ethash_mutex_lock(&jit_mutex);
+	strcpy(jit_compiler, compiler ? compiler : "");
+	// the code of the periods is generated again the new way
+	jit_free_unused();
+	ethash_mutex_unlock(&jit_mutex);
+	return true;
+#else
+	return !compiler;
+#endif
+}
@@ -0,0 +1,66 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file progpow_jit.h
+ * @date 2018
+ *
+ * Machine code generated at runtime for the random program of a ProgPoW
+ * period, used instead of the progpow_loop kernel once enabled with
+ * @ref ethash_progpow_set_jit()
+ */
+#pragma once
+#include "internal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct progpow_jit progpow_jit_t;
+
+/**
+ * Get the generated code of a program, generating it if needed. Code that
+ * is already generated is taken without a lock.
+ *
+ * @param prog     The program of the period to hash
+ * @return         The code, to be given back with @ref progpow_jit_release(),
+ *                 or NULL if the JIT is disabled, not supported by the host or
+ *                 the code could not be generated. The progpow_loop kernel
+ *                 has to be used then.
+ */
+progpow_jit_t* progpow_jit_acquire(progpow_program_t const* prog);
+
+/**
+ * Give back code from @ref progpow_jit_acquire(). Does nothing for NULL.
+ */
+void progpow_jit_release(progpow_jit_t* jit);
+
+/**
+ * One iteration of the ProgPoW main loop with generated code, the same as
+ * @ref progPowLoop() with the program @a jit was generated from
+ */
+void progpow_jit_loop(
+	progpow_jit_t const* jit,
+	const uint32_t loop,
+	ethash_light_t const light,
+	uint32_t mix[PROGPOW_LANES][PROGPOW_REGS],
+	const uint32_t* g_dag,
+	const uint32_t* c_dag,
+	ethash_fastmod_t const* dag_entries
+);
+
+#ifdef __cplusplus
+}
+#endif
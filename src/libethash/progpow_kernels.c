@@ -0,0 +1,603 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file progpow_kernels.c
+ * @date 2018
+ *
+ * The instructions of a ProgPoW program select their operation with values
+ * that are the same for all lanes, so the selection is a scalar switch and
+ * only the operands are vectors. AVX2 and AVX-512F have no leading zero or
+ * population count instructions, so those are computed with shifts and masks.
+ * NEON has both, but no gathers, so its lanes are transposed in and out of
+ * registers 4 by 4 and the cache reads are scalar.
+ *
+ * fill_mix() runs KISS99 per lane, but the multiply-with-carry half of its
+ * state only depends on the seed, so the kernels compute that sequence once
+ * and the shift register and congruential halves of all lanes in vectors.
+ */
+
+#include "progpow_kernels.h"
+#include "fnv.h"
+
+#if defined(ETHASH_PROGPOW_SIMD) || defined(ETHASH_PROGPOW_NEON)
+#define PROGPOW_FNV_OFFSET 0x811c9dc5
+
+// The multiply-with-carry outputs of KISS99 for every register, shared by all
+// lanes, and the FNV hash of the seed the lane specific state starts from
+static inline uint32_t progpow_mix_seed(uint64_t seed, uint32_t mwc[PROGPOW_REGS])
+{
+	uint32_t z = (PROGPOW_FNV_OFFSET ^ (uint32_t)seed) * FNV_PRIME;
+	uint32_t w = (z ^ (uint32_t)(seed >> 32)) * FNV_PRIME;
+	uint32_t const hash = w;
+	for (unsigned i = 0; i != PROGPOW_REGS; ++i) {
+		z = 36969 * (z & 65535) + (z >> 16);
+		w = 18000 * (w & 65535) + (w >> 16);
+		mwc[i] = (z << 16) + w;
+	}
+	return hash;
+}
+#endif
+
+#if defined(ETHASH_PROGPOW_SIMD)
+#include <immintrin.h>
+
+// ProgPoW needs 16 lanes of 32 bit words: two AVX2 or one AVX-512 register
+#if PROGPOW_LANES != 16
+#error "the SIMD ProgPoW kernels assume 16 lanes"
+#endif
+
+ETHASH_TARGET("avx2")
+static inline __m256i progpow_popcount_avx2(__m256i v)
+{
+	v = _mm256_sub_epi32(v, _mm256_and_si256(_mm256_srli_epi32(v, 1), _mm256_set1_epi32(0x55555555)));
+	v = _mm256_add_epi32(
+		_mm256_and_si256(v, _mm256_set1_epi32(0x33333333)),
+		_mm256_and_si256(_mm256_srli_epi32(v, 2), _mm256_set1_epi32(0x33333333))
+	);
+	v = _mm256_and_si256(_mm256_add_epi32(v, _mm256_srli_epi32(v, 4)), _mm256_set1_epi32(0x0f0f0f0f));
+	return _mm256_srli_epi32(_mm256_mullo_epi32(v, _mm256_set1_epi32(0x01010101)), 24);
+}
+
+// 32 minus the number of bits at or below the highest set one, 32 for 0
+ETHASH_TARGET("avx2")
+static inline __m256i progpow_clz_avx2(__m256i v)
+{
+	v = _mm256_or_si256(v, _mm256_srli_epi32(v, 1));
+	v = _mm256_or_si256(v, _mm256_srli_epi32(v, 2));
+	v = _mm256_or_si256(v, _mm256_srli_epi32(v, 4));
+	v = _mm256_or_si256(v, _mm256_srli_epi32(v, 8));
+	v = _mm256_or_si256(v, _mm256_srli_epi32(v, 16));
+	return _mm256_sub_epi32(_mm256_set1_epi32(32), progpow_popcount_avx2(v));
+}
+
+// rotations by n % 32, variable shifts by 32 give 0 so n == 0 works too
+ETHASH_TARGET("avx2")
+static inline __m256i progpow_rotl_avx2(__m256i a, __m256i n)
+{
+	n = _mm256_and_si256(n, _mm256_set1_epi32(31));
+	return _mm256_or_si256(_mm256_sllv_epi32(a, n), _mm256_srlv_epi32(a, _mm256_sub_epi32(_mm256_set1_epi32(32), n)));
+}
+
+ETHASH_TARGET("avx2")
+static inline __m256i progpow_rotr_avx2(__m256i a, __m256i n)
+{
+	n = _mm256_and_si256(n, _mm256_set1_epi32(31));
+	return _mm256_or_si256(_mm256_srlv_epi32(a, n), _mm256_sllv_epi32(a, _mm256_sub_epi32(_mm256_set1_epi32(32), n)));
+}
+
+// progpowMath() on 8 lanes
+ETHASH_TARGET("avx2")
+static inline __m256i progpow_math_avx2(__m256i a, __m256i b, uint32_t r)
+{
+	switch (r % 11) {
+	default:
+	case 0: return _mm256_add_epi32(a, b);
+	case 1: return _mm256_mullo_epi32(a, b);
+	case 2: {
+		__m256i const even = _mm256_srli_epi64(_mm256_mul_epu32(a, b), 32);
+		__m256i const odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32));
+		return _mm256_blend_epi32(even, odd, 0xaa);
+	}
+	case 3: return _mm256_min_epu32(a, b);
+	case 4: return progpow_rotl_avx2(a, b);
+	case 5: return progpow_rotr_avx2(a, b);
+	case 6: return _mm256_and_si256(a, b);
+	case 7: return _mm256_or_si256(a, b);
+	case 8: return _mm256_xor_si256(a, b);
+	case 9: return _mm256_add_epi32(progpow_clz_avx2(a), progpow_clz_avx2(b));
+	case 10: return _mm256_add_epi32(progpow_popcount_avx2(a), progpow_popcount_avx2(b));
+	}
+}
+
+// merge() on 8 lanes
+ETHASH_TARGET("avx2")
+static inline __m256i progpow_merge_avx2(__m256i a, __m256i b, uint32_t r)
+{
+	__m256i const rot = _mm256_set1_epi32((int)(((r >> 16) % 31) + 1));
+	switch (r % 4) {
+	default:
+	case 0: return _mm256_add_epi32(_mm256_mullo_epi32(a, _mm256_set1_epi32(33)), b);
+	case 1: return _mm256_mullo_epi32(_mm256_xor_si256(a, b), _mm256_set1_epi32(33));
+	case 2: return _mm256_xor_si256(progpow_rotl_avx2(a, rot), b);
+	case 3: return _mm256_xor_si256(progpow_rotr_avx2(a, rot), b);
+	}
+}
+
+ETHASH_TARGET("avx2")
+void progPowLoop_avx2(
+	progpow_program_t const* prog,
+	const uint32_t loop,
+	ethash_light_t const light,
+	uint32_t mix[PROGPOW_LANES][PROGPOW_REGS],
+	const uint32_t* g_dag,
+	const uint32_t* c_dag,
+	ethash_fastmod_t const* dag_entries
+)
+{
+	uint32_t dag_data[PROGPOW_LANES*PROGPOW_DAG_LOADS];
+	uint32_t const entry = progpow_dag_entry(loop, mix, dag_entries);
+	progpow_prefetch_dag(g_dag, entry);
+
+	__m256i const cache_mask = _mm256_set1_epi32(PROGPOW_CACHE_WORDS - 1);
+	// the lanes are independent within an iteration, so run them 8 at a time
+	for (unsigned half = 0; half != 2; ++half) {
+		uint32_t (*const lanes)[PROGPOW_REGS] = &mix[half * 8];
+		__m256i const lane_offsets = _mm256_setr_epi32(
+			0, PROGPOW_REGS, 2 * PROGPOW_REGS, 3 * PROGPOW_REGS,
+			4 * PROGPOW_REGS, 5 * PROGPOW_REGS, 6 * PROGPOW_REGS, 7 * PROGPOW_REGS
+		);
+		__m256i m[PROGPOW_REGS];
+		for (unsigned r = 0; r != PROGPOW_REGS; ++r) {
+			m[r] = _mm256_i32gather_epi32((int const*)&lanes[0][r], lane_offsets, 4);
+		}
+
+		for (unsigned i = 0; i != PROGPOW_PROGRAM_LENGTH; ++i) {
+			progpow_instruction_t const ins = prog->instructions[i];
+			__m256i data;
+			if (ins.op == PROGPOW_OP_CACHE) {
+				__m256i const offset = _mm256_and_si256(m[ins.src1], cache_mask);
+				data = _mm256_i32gather_epi32((int const*)c_dag, offset, 4);
+			} else {
+				data = progpow_math_avx2(m[ins.src1], m[ins.src2], ins.sel1);
+			}
+			m[ins.dst] = progpow_merge_avx2(m[ins.dst], data, ins.sel2);
+		}
+		// the first half covers the latency of the prefetch
+		if (half == 0) {
+			progpow_load_dag(dag_data, entry, light, g_dag);
+		}
+
+		// lane l reads the words ((l ^ loop) % PROGPOW_LANES) * PROGPOW_DAG_LOADS + i
+		__m256i const lane_ids = _mm256_add_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32((int)half * 8));
+		__m256i const dag_offsets = _mm256_slli_epi32(
+			_mm256_and_si256(_mm256_xor_si256(lane_ids, _mm256_set1_epi32((int)loop)), _mm256_set1_epi32(PROGPOW_LANES - 1)),
+			2
+		);
+		for (unsigned i = 0; i != PROGPOW_DAG_LOADS; ++i) {
+			__m256i const data = _mm256_i32gather_epi32(
+				(int const*)dag_data, _mm256_add_epi32(dag_offsets, _mm256_set1_epi32((int)i)), 4
+			);
+			m[prog->dag_dst[i]] = progpow_merge_avx2(m[prog->dag_dst[i]], data, prog->dag_sel[i]);
+		}
+
+		for (unsigned r = 0; r != PROGPOW_REGS; ++r) {
+			uint32_t words[8];
+			_mm256_storeu_si256((__m256i*)words, m[r]);
+			for (unsigned l = 0; l != 8; ++l) {
+				lanes[l][r] = words[l];
+			}
+		}
+	}
+}
+
+ETHASH_TARGET("avx512f")
+static inline __m512i progpow_popcount_avx512(__m512i v)
+{
+	v = _mm512_sub_epi32(v, _mm512_and_si512(_mm512_srli_epi32(v, 1), _mm512_set1_epi32(0x55555555)));
+	v = _mm512_add_epi32(
+		_mm512_and_si512(v, _mm512_set1_epi32(0x33333333)),
+		_mm512_and_si512(_mm512_srli_epi32(v, 2), _mm512_set1_epi32(0x33333333))
+	);
+	v = _mm512_and_si512(_mm512_add_epi32(v, _mm512_srli_epi32(v, 4)), _mm512_set1_epi32(0x0f0f0f0f));
+	return _mm512_srli_epi32(_mm512_mullo_epi32(v, _mm512_set1_epi32(0x01010101)), 24);
+}
+
+ETHASH_TARGET("avx512f")
+static inline __m512i progpow_clz_avx512(__m512i v)
+{
+	v = _mm512_or_si512(v, _mm512_srli_epi32(v, 1));
+	v = _mm512_or_si512(v, _mm512_srli_epi32(v, 2));
+	v = _mm512_or_si512(v, _mm512_srli_epi32(v, 4));
+	v = _mm512_or_si512(v, _mm512_srli_epi32(v, 8));
+	v = _mm512_or_si512(v, _mm512_srli_epi32(v, 16));
+	return _mm512_sub_epi32(_mm512_set1_epi32(32), progpow_popcount_avx512(v));
+}
+
+// progpowMath() on 16 lanes, the rotations take their count modulo 32
+ETHASH_TARGET("avx512f")
+static inline __m512i progpow_math_avx512(__m512i a, __m512i b, uint32_t r)
+{
+	switch (r % 11) {
+	default:
+	case 0: return _mm512_add_epi32(a, b);
+	case 1: return _mm512_mullo_epi32(a, b);
+	case 2: {
+		__m512i const even = _mm512_srli_epi64(_mm512_mul_epu32(a, b), 32);
+		__m512i const odd = _mm512_mul_epu32(_mm512_srli_epi64(a, 32), _mm512_srli_epi64(b, 32));
+		return _mm512_mask_blend_epi32(0xaaaa, even, odd);
+	}
+	case 3: return _mm512_min_epu32(a, b);
+	case 4: return _mm512_rolv_epi32(a, b);
+	case 5: return _mm512_rorv_epi32(a, b);
+	case 6: return _mm512_and_si512(a, b);
+	case 7: return _mm512_or_si512(a, b);
+	case 8: return _mm512_xor_si512(a, b);
+	case 9: return _mm512_add_epi32(progpow_clz_avx512(a), progpow_clz_avx512(b));
+	case 10: return _mm512_add_epi32(progpow_popcount_avx512(a), progpow_popcount_avx512(b));
+	}
+}
+
+// merge() on 16 lanes
+ETHASH_TARGET("avx512f")
+static inline __m512i progpow_merge_avx512(__m512i a, __m512i b, uint32_t r)
+{
+	__m512i const rot = _mm512_set1_epi32((int)(((r >> 16) % 31) + 1));
+	switch (r % 4) {
+	default:
+	case 0: return _mm512_add_epi32(_mm512_mullo_epi32(a, _mm512_set1_epi32(33)), b);
+	case 1: return _mm512_mullo_epi32(_mm512_xor_si512(a, b), _mm512_set1_epi32(33));
+	case 2: return _mm512_xor_si512(_mm512_rolv_epi32(a, rot), b);
+	case 3: return _mm512_xor_si512(_mm512_rorv_epi32(a, rot), b);
+	}
+}
+
+ETHASH_TARGET("avx512f")
+void progPowLoop_avx512(
+	progpow_program_t const* prog,
+	const uint32_t loop,
+	ethash_light_t const light,
+	uint32_t mix[PROGPOW_LANES][PROGPOW_REGS],
+	const uint32_t* g_dag,
+	const uint32_t* c_dag,
+	ethash_fastmod_t const* dag_entries
+)
+{
+	uint32_t dag_data[PROGPOW_LANES*PROGPOW_DAG_LOADS];
+	uint32_t const entry = progpow_dag_entry(loop, mix, dag_entries);
+	progpow_prefetch_dag(g_dag, entry);
+
+	__m512i const lane_ids = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	__m512i const lane_offsets = _mm512_mullo_epi32(lane_ids, _mm512_set1_epi32(PROGPOW_REGS));
+	__m512i m[PROGPOW_REGS];
+	for (unsigned r = 0; r != PROGPOW_REGS; ++r) {
+		m[r] = _mm512_i32gather_epi32(lane_offsets, (int const*)&mix[0][r], 4);
+	}
+
+	__m512i const cache_mask = _mm512_set1_epi32(PROGPOW_CACHE_WORDS - 1);
+	for (unsigned i = 0; i != PROGPOW_PROGRAM_LENGTH; ++i) {
+		progpow_instruction_t const ins = prog->instructions[i];
+		__m512i data;
+		if (ins.op == PROGPOW_OP_CACHE) {
+			__m512i const offset = _mm512_and_si512(m[ins.src1], cache_mask);
+			data = _mm512_i32gather_epi32(offset, (int const*)c_dag, 4);
+		} else {
+			data = progpow_math_avx512(m[ins.src1], m[ins.src2], ins.sel1);
+		}
+		m[ins.dst] = progpow_merge_avx512(m[ins.dst], data, ins.sel2);
+	}
+	progpow_load_dag(dag_data, entry, light, g_dag);
+
+	// lane l reads the words ((l ^ loop) % PROGPOW_LANES) * PROGPOW_DAG_LOADS + i
+	__m512i const dag_offsets = _mm512_slli_epi32(
+		_mm512_and_si512(_mm512_xor_si512(lane_ids, _mm512_set1_epi32((int)loop)), _mm512_set1_epi32(PROGPOW_LANES - 1)),
+		2
+	);
+	for (unsigned i = 0; i != PROGPOW_DAG_LOADS; ++i) {
+		__m512i const data = _mm512_i32gather_epi32(
+			_mm512_add_epi32(dag_offsets, _mm512_set1_epi32((int)i)), (int const*)dag_data, 4
+		);
+		m[prog->dag_dst[i]] = progpow_merge_avx512(m[prog->dag_dst[i]], data, prog->dag_sel[i]);
+	}
+
+	for (unsigned r = 0; r != PROGPOW_REGS; ++r) {
+		_mm512_i32scatter_epi32((int*)&mix[0][r], lane_offsets, m[r], 4);
+	}
+}
+
+ETHASH_TARGET("avx2")
+void progPowFillMix_avx2(uint64_t seed, uint32_t mix[PROGPOW_LANES][PROGPOW_REGS])
+{
+	uint32_t mwc[PROGPOW_REGS];
+	__m256i const hash = _mm256_set1_epi32((int)progpow_mix_seed(seed, mwc));
+	__m256i const prime = _mm256_set1_epi32(FNV_PRIME);
+	for (unsigned half = 0; half != 2; ++half) {
+		uint32_t (*const lanes)[PROGPOW_REGS] = &mix[half * 8];
+		__m256i const lane_ids = _mm256_add_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32((int)half * 8));
+		__m256i jsr = _mm256_mullo_epi32(_mm256_xor_si256(hash, lane_ids), prime);
+		__m256i jcong = _mm256_mullo_epi32(_mm256_xor_si256(jsr, lane_ids), prime);
+		for (unsigned r = 0; r != PROGPOW_REGS; ++r) {
+			jsr = _mm256_xor_si256(jsr, _mm256_slli_epi32(jsr, 17));
+			jsr = _mm256_xor_si256(jsr, _mm256_srli_epi32(jsr, 13));
+			jsr = _mm256_xor_si256(jsr, _mm256_slli_epi32(jsr, 5));
+			jcong = _mm256_add_epi32(_mm256_mullo_epi32(jcong, _mm256_set1_epi32(69069)), _mm256_set1_epi32(1234567));
+			__m256i const v = _mm256_add_epi32(_mm256_xor_si256(_mm256_set1_epi32((int)mwc[r]), jcong), jsr);
+			uint32_t words[8];
+			_mm256_storeu_si256((__m256i*)words, v);
+			for (unsigned l = 0; l != 8; ++l) {
+				lanes[l][r] = words[l];
+			}
+		}
+	}
+}
+
+ETHASH_TARGET("avx2")
+void progPowReduceMix_avx2(uint32_t mix[PROGPOW_LANES][PROGPOW_REGS], uint32_t digest[8])
+{
+	__m256i const prime = _mm256_set1_epi32(FNV_PRIME);
+	__m256i const lane_offsets = _mm256_setr_epi32(
+		0, PROGPOW_REGS, 2 * PROGPOW_REGS, 3 * PROGPOW_REGS,
+		4 * PROGPOW_REGS, 5 * PROGPOW_REGS, 6 * PROGPOW_REGS, 7 * PROGPOW_REGS
+	);
+	// lanes l and l + 8 both go into digest word l
+	__m256i d = _mm256_set1_epi32((int)PROGPOW_FNV_OFFSET);
+	for (unsigned half = 0; half != 2; ++half) {
+		__m256i h = _mm256_set1_epi32((int)PROGPOW_FNV_OFFSET);
+		for (unsigned r = 0; r != PROGPOW_REGS; ++r) {
+			__m256i const v = _mm256_i32gather_epi32((int const*)&mix[half * 8][r], lane_offsets, 4);
+			h = _mm256_mullo_epi32(_mm256_xor_si256(h, v), prime);
+		}
+		d = _mm256_mullo_epi32(_mm256_xor_si256(d, h), prime);
+	}
+	_mm256_storeu_si256((__m256i*)digest, d);
+}
+
+ETHASH_TARGET("avx512f")
+void progPowFillMix_avx512(uint64_t seed, uint32_t mix[PROGPOW_LANES][PROGPOW_REGS])
+{
+	uint32_t mwc[PROGPOW_REGS];
+	__m512i const hash = _mm512_set1_epi32((int)progpow_mix_seed(seed, mwc));
+	__m512i const prime = _mm512_set1_epi32(FNV_PRIME);
+	__m512i const lane_ids = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	__m512i const lane_offsets = _mm512_mullo_epi32(lane_ids, _mm512_set1_epi32(PROGPOW_REGS));
+	__m512i jsr = _mm512_mullo_epi32(_mm512_xor_si512(hash, lane_ids), prime);
+	__m512i jcong = _mm512_mullo_epi32(_mm512_xor_si512(jsr, lane_ids), prime);
+	for (unsigned r = 0; r != PROGPOW_REGS; ++r) {
+		jsr = _mm512_xor_si512(jsr, _mm512_slli_epi32(jsr, 17));
+		jsr = _mm512_xor_si512(jsr, _mm512_srli_epi32(jsr, 13));
+		jsr = _mm512_xor_si512(jsr, _mm512_slli_epi32(jsr, 5));
+		jcong = _mm512_add_epi32(_mm512_mullo_epi32(jcong, _mm512_set1_epi32(69069)), _mm512_set1_epi32(1234567));
+		__m512i const v = _mm512_add_epi32(_mm512_xor_si512(_mm512_set1_epi32((int)mwc[r]), jcong), jsr);
+		_mm512_i32scatter_epi32((int*)&mix[0][r], lane_offsets, v, 4);
+	}
+}
+
+ETHASH_TARGET("avx512f")
+void progPowReduceMix_avx512(uint32_t mix[PROGPOW_LANES][PROGPOW_REGS], uint32_t digest[8])
+{
+	__m512i const prime = _mm512_set1_epi32(FNV_PRIME);
+	__m512i const lane_offsets = _mm512_mullo_epi32(
+		_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(PROGPOW_REGS)
+	);
+	__m512i h = _mm512_set1_epi32((int)PROGPOW_FNV_OFFSET);
+	for (unsigned r = 0; r != PROGPOW_REGS; ++r) {
+		__m512i const v = _mm512_i32gather_epi32(lane_offsets, (int const*)&mix[0][r], 4);
+		h = _mm512_mullo_epi32(_mm512_xor_si512(h, v), prime);
+	}
+	// lanes l and l + 8 both go into digest word l
+	__m256i const prime8 = _mm256_set1_epi32(FNV_PRIME);
+	__m256i d = _mm256_set1_epi32((int)PROGPOW_FNV_OFFSET);
+	d = _mm256_mullo_epi32(_mm256_xor_si256(d, _mm512_castsi512_si256(h)), prime8);
+	d = _mm256_mullo_epi32(_mm256_xor_si256(d, _mm512_extracti64x4_epi64(h, 1)), prime8);
+	_mm256_storeu_si256((__m256i*)digest, d);
+}
+
+#endif // ETHASH_PROGPOW_SIMD
+
+#if defined(ETHASH_PROGPOW_NEON)
+#include <arm_neon.h>
+
+#if PROGPOW_LANES != 16 || PROGPOW_REGS % 4 != 0 || PROGPOW_DAG_LOADS != 4
+#error "the NEON ProgPoW kernel assumes 16 lanes of 4 DAG words"
+#endif
+
+// Transpose the 4x4 words of v, rows becoming columns
+static inline void progpow_transpose_neon(uint32x4_t v[4])
+{
+	uint32x4x2_t const t01 = vtrnq_u32(v[0], v[1]);
+	uint32x4x2_t const t23 = vtrnq_u32(v[2], v[3]);
+	v[0] = vcombine_u32(vget_low_u32(t01.val[0]), vget_low_u32(t23.val[0]));
+	v[1] = vcombine_u32(vget_low_u32(t01.val[1]), vget_low_u32(t23.val[1]));
+	v[2] = vcombine_u32(vget_high_u32(t01.val[0]), vget_high_u32(t23.val[0]));
+	v[3] = vcombine_u32(vget_high_u32(t01.val[1]), vget_high_u32(t23.val[1]));
+}
+
+// rotations by n % 32. Register shifts by 32 or more in either direction
+// give 0, so n == 0 works too
+static inline uint32x4_t progpow_rotl_neon(uint32x4_t a, uint32x4_t n)
+{
+	int32x4_t const left = vreinterpretq_s32_u32(vandq_u32(n, vdupq_n_u32(31)));
+	return vorrq_u32(vshlq_u32(a, left), vshlq_u32(a, vsubq_s32(left, vdupq_n_s32(32))));
+}
+
+static inline uint32x4_t progpow_rotr_neon(uint32x4_t a, uint32x4_t n)
+{
+	int32x4_t const right = vreinterpretq_s32_u32(vandq_u32(n, vdupq_n_u32(31)));
+	return vorrq_u32(vshlq_u32(a, vnegq_s32(right)), vshlq_u32(a, vsubq_s32(vdupq_n_s32(32), right)));
+}
+
+static inline uint32x4_t progpow_popcount_neon(uint32x4_t v)
+{
+	return vpaddlq_u16(vpaddlq_u8(vcntq_u8(vreinterpretq_u8_u32(v))));
+}
+
+// progpowMath() on 4 lanes
+static inline uint32x4_t progpow_math_neon(uint32x4_t a, uint32x4_t b, uint32_t r)
+{
+	switch (r % 11) {
+	default:
+	case 0: return vaddq_u32(a, b);
+	case 1: return vmulq_u32(a, b);
+	case 2: {
+		uint64x2_t const low = vmull_u32(vget_low_u32(a), vget_low_u32(b));
+		uint64x2_t const high = vmull_u32(vget_high_u32(a), vget_high_u32(b));
+		return vcombine_u32(vshrn_n_u64(low, 32), vshrn_n_u64(high, 32));
+	}
+	case 3: return vminq_u32(a, b);
+	case 4: return progpow_rotl_neon(a, b);
+	case 5: return progpow_rotr_neon(a, b);
+	case 6: return vandq_u32(a, b);
+	case 7: return vorrq_u32(a, b);
+	case 8: return veorq_u32(a, b);
+	case 9: return vaddq_u32(vclzq_u32(a), vclzq_u32(b));
+	case 10: return vaddq_u32(progpow_popcount_neon(a), progpow_popcount_neon(b));
+	}
+}
+
+// merge() on 4 lanes
+static inline uint32x4_t progpow_merge_neon(uint32x4_t a, uint32x4_t b, uint32_t r)
+{
+	uint32x4_t const rot = vdupq_n_u32(((r >> 16) % 31) + 1);
+	switch (r % 4) {
+	default:
+	case 0: return vaddq_u32(vmulq_n_u32(a, 33), b);
+	case 1: return vmulq_n_u32(veorq_u32(a, b), 33);
+	case 2: return veorq_u32(progpow_rotl_neon(a, rot), b);
+	case 3: return veorq_u32(progpow_rotr_neon(a, rot), b);
+	}
+}
+
+void progPowLoop_neon(
+	progpow_program_t const* prog,
+	const uint32_t loop,
+	ethash_light_t const light,
+	uint32_t mix[PROGPOW_LANES][PROGPOW_REGS],
+	const uint32_t* g_dag,
+	const uint32_t* c_dag,
+	ethash_fastmod_t const* dag_entries
+)
+{
+	uint32_t dag_data[PROGPOW_LANES*PROGPOW_DAG_LOADS];
+	uint32_t const entry = progpow_dag_entry(loop, mix, dag_entries);
+	progpow_prefetch_dag(g_dag, entry);
+
+	// the lanes are independent within an iteration, so run them 4 at a time
+	for (unsigned quarter = 0; quarter != 4; ++quarter) {
+		uint32_t (*const lanes)[PROGPOW_REGS] = &mix[quarter * 4];
+		uint32x4_t m[PROGPOW_REGS];
+		for (unsigned r = 0; r != PROGPOW_REGS; r += 4) {
+			for (unsigned l = 0; l != 4; ++l) {
+				m[r + l] = vld1q_u32(&lanes[l][r]);
+			}
+			progpow_transpose_neon(&m[r]);
+		}
+
+		for (unsigned i = 0; i != PROGPOW_PROGRAM_LENGTH; ++i) {
+			progpow_instruction_t const ins = prog->instructions[i];
+			uint32x4_t data;
+			if (ins.op == PROGPOW_OP_CACHE) {
+				uint32_t offsets[4];
+				vst1q_u32(offsets, m[ins.src1]);
+				uint32_t const words[4] = {
+					c_dag[offsets[0] % PROGPOW_CACHE_WORDS], c_dag[offsets[1] % PROGPOW_CACHE_WORDS],
+					c_dag[offsets[2] % PROGPOW_CACHE_WORDS], c_dag[offsets[3] % PROGPOW_CACHE_WORDS]
+				};
+				data = vld1q_u32(words);
+			} else {
+				data = progpow_math_neon(m[ins.src1], m[ins.src2], ins.sel1);
+			}
+			m[ins.dst] = progpow_merge_neon(m[ins.dst], data, ins.sel2);
+		}
+		// the first quarter covers the latency of the prefetch
+		if (quarter == 0) {
+			progpow_load_dag(dag_data, entry, light, g_dag);
+		}
+
+		// lane l reads the words ((l ^ loop) % PROGPOW_LANES) * PROGPOW_DAG_LOADS + i
+		uint32x4_t words[PROGPOW_DAG_LOADS];
+		for (unsigned l = 0; l != 4; ++l) {
+			words[l] = vld1q_u32(&dag_data[((quarter * 4 + l) ^ loop) % PROGPOW_LANES * PROGPOW_DAG_LOADS]);
+		}
+		progpow_transpose_neon(words);
+		for (unsigned i = 0; i != PROGPOW_DAG_LOADS; ++i) {
+			m[prog->dag_dst[i]] = progpow_merge_neon(m[prog->dag_dst[i]], words[i], prog->dag_sel[i]);
+		}
+
+		for (unsigned r = 0; r != PROGPOW_REGS; r += 4) {
+			progpow_transpose_neon(&m[r]);
+			for (unsigned l = 0; l != 4; ++l) {
+				vst1q_u32(&lanes[l][r], m[r + l]);
+			}
+		}
+	}
+}
+
+void progPowFillMix_neon(uint64_t seed, uint32_t mix[PROGPOW_LANES][PROGPOW_REGS])
+{
+	uint32_t mwc[PROGPOW_REGS];
+	uint32x4_t const hash = vdupq_n_u32(progpow_mix_seed(seed, mwc));
+	uint32x4_t const prime = vdupq_n_u32(FNV_PRIME);
+	uint32_t const lane_words[4] = { 0, 1, 2, 3 };
+	for (unsigned quarter = 0; quarter != 4; ++quarter) {
+		uint32_t (*const lanes)[PROGPOW_REGS] = &mix[quarter * 4];
+		uint32x4_t const lane_ids = vaddq_u32(vld1q_u32(lane_words), vdupq_n_u32(quarter * 4));
+		uint32x4_t jsr = vmulq_u32(veorq_u32(hash, lane_ids), prime);
+		uint32x4_t jcong = vmulq_u32(veorq_u32(jsr, lane_ids), prime);
+		for (unsigned r = 0; r != PROGPOW_REGS; r += 4) {
+			uint32x4_t v[4];
+			for (unsigned i = 0; i != 4; ++i) {
+				jsr = veorq_u32(jsr, vshlq_n_u32(jsr, 17));
+				jsr = veorq_u32(jsr, vshrq_n_u32(jsr, 13));
+				jsr = veorq_u32(jsr, vshlq_n_u32(jsr, 5));
+				jcong = vmlaq_u32(vdupq_n_u32(1234567), jcong, vdupq_n_u32(69069));
+				v[i] = vaddq_u32(veorq_u32(vdupq_n_u32(mwc[r + i]), jcong), jsr);
+			}
+			progpow_transpose_neon(v);
+			for (unsigned l = 0; l != 4; ++l) {
+				vst1q_u32(&lanes[l][r], v[l]);
+			}
+		}
+	}
+}
+
+void progPowReduceMix_neon(uint32_t mix[PROGPOW_LANES][PROGPOW_REGS], uint32_t digest[8])
+{
+	uint32x4_t const prime = vdupq_n_u32(FNV_PRIME);
+	uint32x4_t lane_hash[4];
+	for (unsigned quarter = 0; quarter != 4; ++quarter) {
+		uint32_t (*const lanes)[PROGPOW_REGS] = &mix[quarter * 4];
+		uint32x4_t h = vdupq_n_u32(PROGPOW_FNV_OFFSET);
+		for (unsigned r = 0; r != PROGPOW_REGS; r += 4) {
+			uint32x4_t v[4];
+			for (unsigned l = 0; l != 4; ++l) {
+				v[l] = vld1q_u32(&lanes[l][r]);
+			}
+			progpow_transpose_neon(v);
+			for (unsigned i = 0; i != 4; ++i) {
+				h = vmulq_u32(veorq_u32(h, v[i]), prime);
+			}
+		}
+		lane_hash[quarter] = h;
+	}
+	// lanes l and l + 8 both go into digest word l
+	for (unsigned i = 0; i != 2; ++i) {
+		uint32x4_t d = vdupq_n_u32(PROGPOW_FNV_OFFSET);
+		d = vmulq_u32(veorq_u32(d, lane_hash[i]), prime);
+		d = vmulq_u32(veorq_u32(d, lane_hash[i + 2]), prime);
+		vst1q_u32(&digest[i * 4], d);
+	}
+}
+
+#endif // ETHASH_PROGPOW_NEON
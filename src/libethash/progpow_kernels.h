@@ -0,0 +1,85 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file progpow_kernels.h
+ * @date 2018
+ *
+ * SIMD implementations of one iteration of the ProgPoW main loop. They keep
+ * the mix as registers of all lanes, [PROGPOW_REGS][PROGPOW_LANES], and run
+ * every instruction of the program on all lanes at once. All of them give the
+ * same results as @ref progPowLoop(), which dispatch.c falls back to, and
+ * the fill and reduction kernels the results of @ref progPowFillMix() and
+ * @ref progPowReduceMix().
+ */
+#pragma once
+#include "internal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(ETHASH_X86)
+#define ETHASH_PROGPOW_SIMD 1
+
+/// Runs the 16 lanes as two halves of 8 lanes in AVX2 registers
+void progPowLoop_avx2(
+	progpow_program_t const* prog,
+	const uint32_t loop,
+	ethash_light_t const light,
+	uint32_t mix[PROGPOW_LANES][PROGPOW_REGS],
+	const uint32_t* g_dag,
+	const uint32_t* c_dag,
+	ethash_fastmod_t const* dag_entries
+);
+
+/// Runs the 16 lanes in one AVX-512 register per mix register
+void progPowLoop_avx512(
+	progpow_program_t const* prog,
+	const uint32_t loop,
+	ethash_light_t const light,
+	uint32_t mix[PROGPOW_LANES][PROGPOW_REGS],
+	const uint32_t* g_dag,
+	const uint32_t* c_dag,
+	ethash_fastmod_t const* dag_entries
+);
+
+void progPowFillMix_avx2(uint64_t seed, uint32_t mix[PROGPOW_LANES][PROGPOW_REGS]);
+void progPowReduceMix_avx2(uint32_t mix[PROGPOW_LANES][PROGPOW_REGS], uint32_t digest[8]);
+void progPowFillMix_avx512(uint64_t seed, uint32_t mix[PROGPOW_LANES][PROGPOW_REGS]);
+void progPowReduceMix_avx512(uint32_t mix[PROGPOW_LANES][PROGPOW_REGS], uint32_t digest[8]);
+#endif
+
+#if defined(ETHASH_ARM64)
+#define ETHASH_PROGPOW_NEON 1
+
+/// Runs the 16 lanes as four quarters of 4 lanes in NEON registers
+void progPowLoop_neon(
+	progpow_program_t const* prog,
+	const uint32_t loop,
+	ethash_light_t const light,
+	uint32_t mix[PROGPOW_LANES][PROGPOW_REGS],
+	const uint32_t* g_dag,
+	const uint32_t* c_dag,
+	ethash_fastmod_t const* dag_entries
+);
+
+void progPowFillMix_neon(uint64_t seed, uint32_t mix[PROGPOW_LANES][PROGPOW_REGS]);
+void progPowReduceMix_neon(uint32_t mix[PROGPOW_LANES][PROGPOW_REGS], uint32_t digest[8]);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
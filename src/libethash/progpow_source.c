@@ -0,0 +1,256 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file progpow_source.c
+ * @date 2018
+ *
+ * Source code of the main loop iteration of a ProgPoW period. The
+ * instructions of @ref progpow_program_init() are unrolled into straight-line
+ * statements with the selectors of @ref merge() and @ref progpowMath() folded
+ * into them, so that the compiler of the target sees no switches at all.
+ */
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include "internal.h"
+
+typedef struct progpow_source {
+	char* buf;
+	size_t size;
+	size_t length;          ///< The length of the whole source, even past size
+	enum progpow_source_target target;
+} progpow_source_t;
+
+static void progpow_source_append(progpow_source_t* src, char const* fmt, ...)
+{
+	size_t const room = src->length < src->size ? src->size - src->length : 0;
+	va_list args;
+	va_start(args, fmt);
+	int const n = vsnprintf(room ? src->buf + src->length : NULL, room, fmt, args);
+	va_end(args);
+	if (n > 0) {
+		src->length += (size_t)n;
+	}
+}
+
+// The 32 bit word type of the target
+static char const* progpow_source_word(progpow_source_t const* src)
+{
+	return src->target == PROGPOW_SOURCE_OPENCL ? "uint" : "uint32_t";
+}
+
+// The definitions the statements use, each only if the including source
+// does not have it yet
+static void progpow_source_prelude(progpow_source_t* src, uint64_t prog_seed)
+{
+	progpow_source_append(
+		src,
+		"// The ProgPoW main loop iteration of period %" PRIu64 ", generated by ethash\n",
+		prog_seed
+	);
+	if (src->target != PROGPOW_SOURCE_OPENCL) {
+		progpow_source_append(src, "#include <stdint.h>\n");
+	}
+	progpow_source_append(
+		src,
+		"#ifndef PROGPOW_LANES\n"
+		"#define PROGPOW_LANES %u\n"
+		"#define PROGPOW_REGS %u\n"
+		"#define PROGPOW_DAG_LOADS %u\n"
+		"#define PROGPOW_CACHE_WORDS %u\n"
+		"#endif\n"
+		"#ifndef ROTL32\n"
+		"#define ROTL32(x, n) (((x) << ((n) & 31)) | ((x) >> ((32 - ((n) & 31)) & 31)))\n"
+		"#define ROTR32(x, n) (((x) >> ((n) & 31)) | ((x) << ((32 - ((n) & 31)) & 31)))\n"
+		"#endif\n",
+		(unsigned)PROGPOW_LANES, (unsigned)PROGPOW_REGS,
+		(unsigned)PROGPOW_DAG_LOADS, (unsigned)PROGPOW_CACHE_WORDS
+	);
+	switch (src->target) {
+	case PROGPOW_SOURCE_OPENCL:
+		break;
+	case PROGPOW_SOURCE_CUDA:
+		progpow_source_append(
+			src,
+			"#define progpow_mul_hi(a, b) __umulhi(a, b)\n"
+			"#define progpow_min(a, b) min(a, b)\n"
+			"#define progpow_clz(a) ((uint32_t)__clz(a))\n"
+			"#define progpow_popcount(a) ((uint32_t)__popc(a))\n"
+		);
+		break;
+	case PROGPOW_SOURCE_C:
+		progpow_source_append(
+			src,
+			"#define progpow_mul_hi(a, b) ((uint32_t)(((uint64_t)(a) * (b)) >> 32))\n"
+			"#define progpow_min(a, b) ((a) < (b) ? (a) : (b))\n"
+			"#if defined(__GNUC__)\n"
+			"#define progpow_clz(a) ((a) ? (uint32_t)__builtin_clz(a) : 32U)\n"
+			"#define progpow_popcount(a) ((uint32_t)__builtin_popcount(a))\n"
+			"#else\n"
+			"static uint32_t progpow_clz(uint32_t a)\n"
+			"{\n"
+			"\tuint32_t n = 0;\n"
+			"\tfor (uint32_t bit = 1U << 31; bit && !(a & bit); bit >>= 1)\n"
+			"\t\tn++;\n"
+			"\treturn n;\n"
+			"}\n"
+			"static uint32_t progpow_popcount(uint32_t a)\n"
+			"{\n"
+			"\tuint32_t n = 0;\n"
+			"\tfor (; a; a &= a - 1)\n"
+			"\t\tn++;\n"
+			"\treturn n;\n"
+			"}\n"
+			"#endif\n"
+		);
+		break;
+	}
+}
+
+// The statement merging @a b into @a a, see merge()
+static void progpow_source_merge(progpow_source_t* src, char const* indent, char const* a, char const* b, uint32_t r)
+{
+	unsigned const rotation = ((r >> 16) % 31) + 1;
+	switch (r % 4) {
+	case 0: progpow_source_append(src, "%s%s = %s * 33 + %s;\n", indent, a, a, b); break;
+	case 1: progpow_source_append(src, "%s%s = (%s ^ %s) * 33;\n", indent, a, a, b); break;
+	case 2: progpow_source_append(src, "%s%s = ROTL32(%s, %uU) ^ %s;\n", indent, a, a, rotation, b); break;
+	case 3: progpow_source_append(src, "%s%s = ROTR32(%s, %uU) ^ %s;\n", indent, a, a, rotation, b); break;
+	}
+}
+
+// The expression of progpowMath()
+static void progpow_source_math(progpow_source_t* src, char const* a, char const* b, uint32_t r)
+{
+	// OpenCL has all of them as builtins
+	char const* const prefix = src->target == PROGPOW_SOURCE_OPENCL ? "" : "progpow_";
+	switch (r % 11) {
+	case 0: progpow_source_append(src, "%s + %s", a, b); break;
+	case 1: progpow_source_append(src, "%s * %s", a, b); break;
+	case 2: progpow_source_append(src, "%smul_hi(%s, %s)", prefix, a, b); break;
+	case 3: progpow_source_append(src, "%smin(%s, %s)", prefix, a, b); break;
+	case 4: progpow_source_append(src, "ROTL32(%s, %s)", a, b); break;
+	case 5: progpow_source_append(src, "ROTR32(%s, %s)", a, b); break;
+	case 6: progpow_source_append(src, "%s & %s", a, b); break;
+	case 7: progpow_source_append(src, "%s | %s", a, b); break;
+	case 8: progpow_source_append(src, "%s ^ %s", a, b); break;
+	case 9: progpow_source_append(src, "%sclz(%s) + %sclz(%s)", prefix, a, prefix, b); break;
+	case 10: progpow_source_append(src, "%spopcount(%s) + %spopcount(%s)", prefix, a, prefix, b); break;
+	}
+}
+
+// The statements of the cache and math instructions on the mix words of one
+// lane, @a mix followed by the word index
+static void progpow_source_instructions(progpow_source_t* src, char const* indent, char const* mix, char const* cache, progpow_program_t const* prog)
+{
+	char a[32];
+	char b[32];
+	for (int i = 0; i < PROGPOW_PROGRAM_LENGTH; i++) {
+		progpow_instruction_t const ins = prog->instructions[i];
+		snprintf(a, sizeof(a), "%s[%u]", mix, (unsigned)ins.src1);
+		snprintf(b, sizeof(b), "%s[%u]", mix, (unsigned)ins.src2);
+		if (ins.op == PROGPOW_OP_CACHE) {
+			progpow_source_append(src, "%sdata = %s[%s %% PROGPOW_CACHE_WORDS];\n", indent, cache, a);
+		} else {
+			progpow_source_append(src, "%sdata = ", indent);
+			progpow_source_math(src, a, b, ins.sel1);
+			progpow_source_append(src, ";\n");
+		}
+		snprintf(a, sizeof(a), "%s[%u]", mix, (unsigned)ins.dst);
+		progpow_source_merge(src, indent, a, "data", ins.sel2);
+	}
+}
+
+// progpow_period_loop() of the GPU targets, all the lanes of an iteration
+static void progpow_source_loop(progpow_source_t* src, progpow_program_t const* prog)
+{
+	char const* const word = progpow_source_word(src);
+	bool const opencl = src->target == PROGPOW_SOURCE_OPENCL;
+	progpow_source_append(
+		src,
+		"%svoid progpow_period_loop(%s loop, %s mix[PROGPOW_LANES][PROGPOW_REGS], %s%s const* dag, %s dag_entries)\n"
+		"{\n"
+		"\t%s const entry = mix[loop %% PROGPOW_LANES][0] %% dag_entries;\n"
+		"\tfor (%s l = 0; l < PROGPOW_LANES; l++) {\n"
+		"\t\t%s data;\n",
+		opencl ? "" : "__device__ __forceinline__ ", word, word, opencl ? "__global " : "", word, word,
+		word, word, word
+	);
+	progpow_source_instructions(src, "\t\t", "mix[l]", "dag", prog);
+	progpow_source_append(
+		src,
+		"\t\t%s const index = (entry * PROGPOW_LANES + (l ^ loop) %% PROGPOW_LANES) * PROGPOW_DAG_LOADS;\n",
+		word
+	);
+	for (int i = 0; i < PROGPOW_DAG_LOADS; i++) {
+		char a[32];
+		char b[32];
+		snprintf(a, sizeof(a), "mix[l][%u]", (unsigned)prog->dag_dst[i]);
+		snprintf(b, sizeof(b), "dag[index + %d]", i);
+		progpow_source_merge(src, "\t\t", a, b, prog->dag_sel[i]);
+	}
+	progpow_source_append(src, "\t}\n}\n");
+}
+
+// progpow_period_lane() of the C target, one lane of an iteration
+static void progpow_source_lane(progpow_source_t* src, progpow_program_t const* prog)
+{
+	progpow_source_append(
+		src,
+		"void progpow_period_lane(uint32_t mix[PROGPOW_REGS], uint32_t const* c_dag, uint32_t const* lane_dag)\n"
+		"{\n"
+		"\tuint32_t data;\n"
+	);
+	progpow_source_instructions(src, "\t", "mix", "c_dag", prog);
+	for (int i = 0; i < PROGPOW_DAG_LOADS; i++) {
+		char a[32];
+		char b[32];
+		snprintf(a, sizeof(a), "mix[%u]", (unsigned)prog->dag_dst[i]);
+		snprintf(b, sizeof(b), "lane_dag[%d]", i);
+		progpow_source_merge(src, "\t", a, b, prog->dag_sel[i]);
+	}
+	progpow_source_append(src, "}\n");
+}
+
+size_t progpow_program_source(
+	progpow_program_t const* prog,
+	enum progpow_source_target target,
+	char* buf,
+	size_t size
+)
+{
+	progpow_source_t src = { buf, size, 0, target };
+	progpow_source_prelude(&src, prog->prog_seed);
+	if (target == PROGPOW_SOURCE_C) {
+		progpow_source_lane(&src, prog);
+	} else {
+		progpow_source_loop(&src, prog);
+	}
+	return src.length;
+}
+
+size_t progpow_get_kernel_source(
+	uint64_t prog_seed,
+	enum progpow_source_target target,
+	char* buf,
+	size_t size
+)
+{
+	progpow_program_t prog;
+	progpow_program_init(&prog, prog_seed);
+	return progpow_program_source(&prog, target, buf, size);
+}
@@ -0,0 +1,193 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file result_cache.c
+ * @date 2018
+ *
+ * A direct mapped table of light hash results. The slot of a key is picked by
+ * a hash of it and guarded by one of ETHASH_RESULT_CACHE_LOCKS mutexes, picked
+ * by the same hash, so that verifiers on different threads seldom wait on each
+ * other. Tables have at least one entry per lock, so that the lock of a key
+ * is the one of its slot. Resizing takes all of them. The epoch of a key is the first node of
+ * the light cache, which differs for every seed, chain or test light alike.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ethash.h"
+#include "result_cache.h"
+#include "io.h"
+#include "threads.h"
+
+#define ETHASH_RESULT_CACHE_LOCKS 64
+
+typedef struct ethash_result_key {
+	ethash_h256_t header_hash;
+	ethash_h256_t epoch;             ///< the first 32 bytes of the light cache
+	uint64_t nonce;
+	uint64_t full_size;
+	uint64_t prog_seed;              ///< ETHASH_RESULT_CACHE_ETHASH for ethash
+} ethash_result_key_t;
+
+typedef struct ethash_result_entry {
+	ethash_result_key_t key;
+	ethash_h256_t result;
+	ethash_h256_t mix_hash;
+	bool used;
+} ethash_result_entry_t;
+
+static ethash_once_t result_cache_once = ETHASH_ONCE_INIT;
+static ethash_mutex_t result_cache_locks[ETHASH_RESULT_CACHE_LOCKS];
+static ethash_result_entry_t* result_cache_entries;   ///< guarded by all locks together
+static size_t result_cache_mask;                      ///< entries - 1, guarded like them
+static size_t volatile result_cache_size = 0;         ///< read without the locks to skip a disabled cache
+static uint64_t volatile result_cache_hits = 0;
+static uint64_t volatile result_cache_misses = 0;
+
+static void ethash_result_cache_init(void)
+{
+	for (unsigned i = 0; i != ETHASH_RESULT_CACHE_LOCKS; ++i) {
+		ethash_mutex_init(&result_cache_locks[i]);
+	}
+}
+
+static void ethash_result_key_init(
+	ethash_result_key_t* key,
+	ethash_light_t light,
+	uint64_t full_size,
+	uint64_t prog_seed,
+	ethash_h256_t const* header_hash,
+	uint64_t nonce
+)
+{
+	memset(key, 0, sizeof(*key));
+	key->header_hash = *header_hash;
+	memcpy(&key->epoch, light->cache, sizeof(key->epoch));
+	key->nonce = nonce;
+	key->full_size = full_size;
+	key->prog_seed = prog_seed;
+}
+
+// the header hash is already uniform, the rest tells apart the nonces and epochs of one header
+static uint64_t ethash_result_key_hash(ethash_result_key_t const* key)
+{
+	uint64_t header;
+	uint64_t epoch;
+	memcpy(&header, &key->header_hash, sizeof(header));
+	memcpy(&epoch, &key->epoch, sizeof(epoch));
+	uint64_t h = header ^ epoch ^ key->nonce * 0x9e3779b97f4a7c15ULL ^ key->prog_seed * 0xc2b2ae3d27d4eb4fULL;
+	h ^= h >> 31;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 29;
+	return h;
+}
+
+void ethash_set_result_cache(size_t entries)
+{
+	size_t size = 0;
+	if (entries) {
+		// smaller tables would give keys of one slot different locks
+		size = ETHASH_RESULT_CACHE_LOCKS;
+		while (size <= entries / 2) {
+			size *= 2;
+		}
+	}
+	ethash_result_entry_t* table = size ? calloc(size, sizeof(ethash_result_entry_t)) : NULL;
+	if (size && !table) {
+		ETHASH_CRITICAL("Could not allocate a result cache of %u entries", (unsigned)size);
+		size = 0;
+	}
+	ethash_call_once(&result_cache_once, ethash_result_cache_init);
+	for (unsigned i = 0; i != ETHASH_RESULT_CACHE_LOCKS; ++i) {
+		ethash_mutex_lock(&result_cache_locks[i]);
+	}
+	ethash_result_entry_t* const old = result_cache_entries;
+	result_cache_entries = table;
+	result_cache_mask = size ? size - 1 : 0;
+	result_cache_size = size;
+	for (unsigned i = ETHASH_RESULT_CACHE_LOCKS; i-- != 0; ) {
+		ethash_mutex_unlock(&result_cache_locks[i]);
+	}
+	free(old);
+}
+
+ethash_result_cache_stats_t ethash_get_result_cache_stats(void)
+{
+	ethash_result_cache_stats_t stats;
+	stats.hits = ethash_atomic_load_u64(&result_cache_hits);
+	stats.misses = ethash_atomic_load_u64(&result_cache_misses);
+	stats.entries = result_cache_size;
+	return stats;
+}
+
+bool ethash_result_cache_lookup(
+	ethash_light_t light,
+	uint64_t full_size,
+	uint64_t prog_seed,
+	ethash_h256_t const* header_hash,
+	uint64_t nonce,
+	ethash_return_value_t* ret
+)
+{
+	if (!result_cache_size) {
+		return false;
+	}
+	ethash_result_key_t key;
+	ethash_result_key_init(&key, light, full_size, prog_seed, header_hash, nonce);
+	uint64_t const h = ethash_result_key_hash(&key);
+	ethash_mutex_t* const lock = &result_cache_locks[h % ETHASH_RESULT_CACHE_LOCKS];
+	bool hit = false;
+	ethash_mutex_lock(lock);
+	if (result_cache_entries) {
+		ethash_result_entry_t const* entry = &result_cache_entries[h & result_cache_mask];
+		hit = entry->used && memcmp(&entry->key, &key, sizeof(key)) == 0;
+		if (hit) {
+			ret->result = entry->result;
+			ret->mix_hash = entry->mix_hash;
+			ret->success = true;
+		}
+	}
+	ethash_mutex_unlock(lock);
+	ethash_atomic_fetch_add_u64(hit ? &result_cache_hits : &result_cache_misses, 1);
+	return hit;
+}
+
+void ethash_result_cache_store(
+	ethash_light_t light,
+	uint64_t full_size,
+	uint64_t prog_seed,
+	ethash_h256_t const* header_hash,
+	uint64_t nonce,
+	ethash_return_value_t const* ret
+)
+{
+	if (!result_cache_size || !ret->success) {
+		return;
+	}
+	ethash_result_key_t key;
+	ethash_result_key_init(&key, light, full_size, prog_seed, header_hash, nonce);
+	uint64_t const h = ethash_result_key_hash(&key);
+	ethash_mutex_t* const lock = &result_cache_locks[h % ETHASH_RESULT_CACHE_LOCKS];
+	ethash_mutex_lock(lock);
+	if (result_cache_entries) {
+		ethash_result_entry_t* entry = &result_cache_entries[h & result_cache_mask];
+		entry->key = key;
+		entry->result = ret->result;
+		entry->mix_hash = ret->mix_hash;
+		entry->used = true;
+	}
+	ethash_mutex_unlock(lock);
+}
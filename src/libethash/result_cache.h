@@ -0,0 +1,65 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file result_cache.h
+ * @date 2018
+ *
+ * The results of light hashes kept by @ref ethash_set_result_cache(), looked
+ * up and stored by ethash_light_compute_internal() and
+ * progpow_light_compute_internal()
+ */
+#pragma once
+#include "internal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// The prog_seed argument of the result cache for ethash hashes
+#define ETHASH_RESULT_CACHE_ETHASH UINT64_MAX
+
+/**
+ * Find the result of a light hash of @a light in the result cache
+ *
+ * @param prog_seed      block_number / period of a ProgPoW hash, or
+ *                       ETHASH_RESULT_CACHE_ETHASH for an ethash hash
+ * @param[out] ret       The result, written on a hit
+ * @return               true on a hit, false on a miss or when there is no cache
+ */
+bool ethash_result_cache_lookup(
+	ethash_light_t light,
+	uint64_t full_size,
+	uint64_t prog_seed,
+	ethash_h256_t const* header_hash,
+	uint64_t nonce,
+	ethash_return_value_t* ret
+);
+
+/**
+ * Keep the successful result @a ret of a light hash, replacing the one in its slot
+ */
+void ethash_result_cache_store(
+	ethash_light_t light,
+	uint64_t full_size,
+	uint64_t prog_seed,
+	ethash_h256_t const* header_hash,
+	uint64_t nonce,
+	ethash_return_value_t const* ret
+);
+
+#ifdef __cplusplus
+}
+#endif
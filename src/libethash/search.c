@@ -0,0 +1,168 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file search.c
+ * @date 2018
+ *
+ * Nonce searches on background threads, see ethash_search_start(). Threads
+ * share nothing but the stop flag, the hash counter, the throttle and the hit.
+ */
+
+#include <stdlib.h>
+#include "ethash.h"
+#include "threads.h"
+#include "throttle.h"
+#include "probes.h"
+
+struct ethash_search_worker {
+	struct ethash_search* search;
+	unsigned index;
+	ethash_thread_t thread;
+};
+
+struct ethash_search {
+	ethash_full_t full;
+	ethash_h256_t header_hash;
+	ethash_h256_t boundary;
+	uint64_t start_nonce;
+	unsigned num_threads;
+	uint32_t volatile stop;
+	uint32_t volatile found;     ///< set once @a hit is written
+	uint64_t volatile hashes;
+	ethash_mutex_t lock;         ///< taken by the threads writing @a hit
+	ethash_search_hit_t hit;
+	struct ethash_throttler throttler;
+	struct ethash_search_worker* workers;
+};
+
+static void ethash_search_worker(void* arg)
+{
+	struct ethash_search_worker* worker = (struct ethash_search_worker*)arg;
+	struct ethash_search* search = worker->search;
+	uint64_t const stride = (uint64_t)search->num_threads * ETHASH_SEARCH_CHUNK;
+	uint64_t nonce = search->start_nonce + (uint64_t)worker->index * ETHASH_SEARCH_CHUNK;
+	ethash_search_hit_t hit;
+	struct ethash_throttle_burst burst = { 0 };
+	uint64_t done = 0;
+	while (!ethash_atomic_load_u32(&search->stop)) {
+		// a whole chunk at a time unless throttled
+		uint64_t const count = ethash_throttle_batch(&search->throttler, &burst, ETHASH_SEARCH_CHUNK - done);
+		size_t const found = ethash_full_search(
+			search->full, search->header_hash, nonce + done, count, &search->boundary, &hit, 1
+		);
+		ethash_atomic_fetch_add_u64(&search->hashes, count);
+		ETHASH_PROBE3(search__batch, nonce + done, count, found);
+		if (found) {
+			ethash_mutex_lock(&search->lock);
+			if (!ethash_atomic_load_u32(&search->found)) {
+				search->hit = hit;
+				ethash_atomic_store_u32(&search->found, 1);
+			}
+			ethash_mutex_unlock(&search->lock);
+			ethash_atomic_store_u32(&search->stop, 1);
+			break;
+		}
+		done += count;
+		if (done == ETHASH_SEARCH_CHUNK) {
+			nonce += stride;
+			done = 0;
+		}
+		ethash_throttle_account(&search->throttler, &burst, count);
+	}
+}
+
+// Stop the first @a started threads of a search and free it
+static void ethash_search_free(struct ethash_search* search, unsigned started)
+{
+	ethash_atomic_store_u32(&search->stop, 1);
+	ethash_throttler_interrupt(&search->throttler);
+	for (unsigned i = 0; i != started; ++i) {
+		ethash_thread_join(search->workers[i].thread);
+	}
+	ethash_throttler_destroy(&search->throttler);
+	ethash_mutex_destroy(&search->lock);
+	free(search->workers);
+	free(search);
+}
+
+ethash_search_t ethash_search_start(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	uint64_t start_nonce,
+	ethash_h256_t const* boundary,
+	unsigned num_threads
+)
+{
+	if (num_threads == 0) {
+		num_threads = ethash_hardware_concurrency();
+	}
+	struct ethash_search* search = calloc(1, sizeof(*search));
+	if (!search) {
+		return NULL;
+	}
+	search->workers = calloc(num_threads, sizeof(*search->workers));
+	if (!search->workers || !ethash_mutex_init(&search->lock)) {
+		free(search->workers);
+		free(search);
+		return NULL;
+	}
+	if (!ethash_throttler_init(&search->throttler, num_threads)) {
+		ethash_mutex_destroy(&search->lock);
+		free(search->workers);
+		free(search);
+		return NULL;
+	}
+	search->full = full;
+	search->header_hash = header_hash;
+	search->boundary = *boundary;
+	search->start_nonce = start_nonce;
+	search->num_threads = num_threads;
+	for (unsigned i = 0; i != num_threads; ++i) {
+		search->workers[i].search = search;
+		search->workers[i].index = i;
+		// a missing thread would leave its share of the nonces untried
+		if (!ethash_thread_create(&search->workers[i].thread, ethash_search_worker, &search->workers[i])) {
+			ethash_search_free(search, i);
+			return NULL;
+		}
+	}
+	return search;
+}
+
+bool ethash_search_result(ethash_search_t search, ethash_search_hit_t* hit)
+{
+	if (!ethash_atomic_load_u32(&search->found)) {
+		return false;
+	}
+	// written once, before found was set
+	*hit = search->hit;
+	return true;
+}
+
+void ethash_search_set_throttle(ethash_search_t search, ethash_throttle_t const* throttle)
+{
+	ethash_throttler_set(&search->throttler, throttle);
+}
+
+uint64_t ethash_search_hashes(ethash_search_t search)
+{
+	return ethash_atomic_load_u64(&search->hashes);
+}
+
+void ethash_search_delete(ethash_search_t search)
+{
+	ethash_search_free(search, search->num_threads);
+}
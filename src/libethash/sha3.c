@@ -7,6 +7,8 @@
 * but not liability.
 */
 #include "sha3.h"
+#include "dispatch.h"
+#include "keccak_unrolled.h"
 
 #include <stdint.h>
 #include <stdio.h>
@@ -78,6 +80,42 @@ static inline void keccakf(void* state) {
 	}
 }
 
+// the portable Keccak-f[1600] kernel of dispatch.c
+void ethash_keccakf1600(uint64_t state[25])
+{
+	keccakf(state);
+}
+
+/*** Unrolled Keccak-f[1600] ***/
+
+#define XOR(x, y) ((x) ^ (y))
+#define ANDNOT(x, y) (~(x) & (y))
+#define ROL(x, s) rol(x, s)
+#define KECCAK_RC(i) RC[i]
+
+// the unrolled kernel of hosts without BMI1
+void ethash_keccakf1600_opt64(uint64_t state[25])
+{
+	KECCAK_COMPLEMENT_LANES(state);
+	KECCAK_PERMUTE(uint64_t, state, 24, KECCAK_RC, KECCAK_CHI_IOTA_COMPLEMENTED);
+	KECCAK_COMPLEMENT_LANES(state);
+}
+
+#if defined(ETHASH_X86)
+// the same rounds with andn for chi and the non-destructive rorx for the
+// rotations, which are only emitted when the function targets BMI1 and BMI2
+ETHASH_TARGET("bmi,bmi2")
+void ethash_keccakf1600_bmi2(uint64_t state[25])
+{
+	KECCAK_PERMUTE(uint64_t, state, 24, KECCAK_RC, KECCAK_CHI_IOTA);
+}
+#endif
+
+#undef XOR
+#undef ANDNOT
+#undef ROL
+#undef KECCAK_RC
+
 /******** The FIPS202-defined functions. ********/
 
 /*** Some helper macros. ***/
@@ -101,7 +139,7 @@ static inline void keccakf(void* state) {
 mkapply_ds(xorin, dst[i] ^= src[i])  // xorin
 mkapply_sd(setout, dst[i] = src[i])  // setout
 
-#define P keccakf
+#define P(a) permute((uint64_t*)(a))
 #define Plen 200
 
 // Fold P*F over the full blocks of an input.
@@ -114,7 +152,8 @@ mkapply_sd(setout, dst[i] = src[i])  // setout
 	}
 
 /** The sponge-based hash construction. **/
-static inline int hash(uint8_t* out, size_t outlen,
+static inline int hash(ethash_keccakf1600_fn permute,
+		uint8_t* out, size_t outlen,
 		const uint8_t* in, size_t inlen,
 		size_t rate, uint8_t delim) {
 	if ((out == NULL) || ((in == NULL) && inlen != 0) || (rate >= Plen)) {
@@ -137,15 +176,59 @@ static inline int hash(uint8_t* out, size_t outlen,
 	return 0;
 }
 
-#define defsha3(bits)													\
+/**
+ * The sponge for an input shorter than the rate and an output that fits in
+ * it, which is every hash ethash does. With the lengths known at the call
+ * site the absorb and squeeze compile to a few whole-lane moves.
+ */
+static inline int hash_block(ethash_keccakf1600_fn permute,
+		uint8_t* out, size_t outlen,
+		const uint8_t* in, size_t inlen,
+		size_t rate, uint8_t delim) {
+	uint64_t a[25] = {0};
+	memcpy(a, in, inlen);
+	((uint8_t*)a)[inlen] ^= delim;
+	((uint8_t*)a)[rate - 1] ^= 0x80;
+	P(a);
+	memcpy(out, a, outlen);
+	return 0;
+}
+
+// the input lengths of the SHA3 calls of ethash and ProgPoW get their own
+// copies of hash_block
+#define sha3_block(bits, L)												\
+	case L:																\
+		return hash_block(kernel->permute, out, bits / 8, in, L, 200 - (bits / 4), 0x01)
+
+#define defsha3(bits, ...)												\
 	int sha3_##bits(uint8_t* out, size_t outlen,						\
 		const uint8_t* in, size_t inlen) {								\
+		ethash_keccakf1600_kernel_t const* const kernel = ethash_kernels()->keccakf1600; \
 		if (outlen > (bits/8)) {										\
 			return -1;                                                  \
 		}																\
-		return hash(out, outlen, in, inlen, 200 - (bits / 4), 0x01);	\
+		if (outlen == (bits / 8) && out != NULL && in != NULL) {		\
+			if (kernel->sha3_##bits) {									\
+				kernel->sha3_##bits(out, in, inlen);					\
+				return 0;												\
+			}															\
+			switch (inlen) {											\
+			__VA_ARGS__;												\
+			default:													\
+				break;													\
+			}															\
+		}																\
+		return hash(kernel->permute, out, outlen, in, inlen, 200 - (bits / 4), 0x01); \
 	}
 
 /*** FIPS202 SHA3 FOFs ***/
-defsha3(256)
-defsha3(512)
+defsha3(256, sha3_block(256, 32); sha3_block(256, 96))
+defsha3(512, sha3_block(512, 32); sha3_block(512, 40); sha3_block(512, 64))
+
+int ethash_sha3_permute(ethash_keccakf1600_fn permute, unsigned bits,
+		uint8_t* out, size_t outlen, const uint8_t* in, size_t inlen) {
+	if ((bits != 256 && bits != 512) || outlen > bits / 8) {
+		return -1;
+	}
+	return hash(permute, out, outlen, in, inlen, 200 - (bits / 4), 0x01);
+}
@@ -16,6 +16,13 @@ struct ethash_h256;
 decsha3(256)
 decsha3(512)
 
+/**
+ * sha3_256() or sha3_512(), for @a bits of 256 or 512, on the sponge of
+ * @a permute instead of the kernels selected in dispatch.c
+ */
+int ethash_sha3_permute(void (*permute)(uint64_t state[25]), unsigned bits,
+	uint8_t* out, size_t outlen, uint8_t const* in, size_t inlen);
+
 static inline void SHA3_256(struct ethash_h256 const* ret, uint8_t const* data, size_t const size)
 {
 	sha3_256((uint8_t*)ret, 32, data, size);
@@ -0,0 +1,424 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file sha3_multi.c
+ * @date 2018
+ *
+ * The SIMD kernels keep lane j of the Keccak state of every node in element k
+ * of register j, so each instruction advances all nodes at once. A 64 byte
+ * Keccak-512 input fills lanes 0..7 and a single block, which leaves the
+ * constant padding lane 8 and one permutation per hash.
+ */
+
+#include "sha3_multi.h"
+#include "cpu_features.h"
+#include "dispatch.h"
+#include "keccak_unrolled.h"
+#ifdef WITH_CRYPTOPP
+#include "sha3_cryptopp.h"
+#else
+#include "sha3.h"
+#endif
+
+#if defined(ETHASH_X86)
+#define ETHASH_SHA3_MULTI_SIMD 1
+#include <immintrin.h>
+#endif
+
+#if defined(ETHASH_ARM64)
+#define ETHASH_SHA3_MULTI_NEON 1
+#include <arm_neon.h>
+#endif
+
+static void sha3_512_nodes_generic(node* nodes, unsigned count)
+{
+	for (unsigned n = 0; n != count; ++n) {
+		SHA3_512(nodes[n].bytes, nodes[n].bytes, sizeof(node));
+	}
+}
+
+#if defined(ETHASH_SHA3_MULTI_SIMD) || defined(ETHASH_SHA3_MULTI_NEON)
+
+static const uint64_t keccak_multi_rc[24] = {
+	0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808aULL,
+	0x8000000080008000ULL, 0x000000000000808bULL, 0x0000000080000001ULL,
+	0x8000000080008081ULL, 0x8000000000008009ULL, 0x000000000000008aULL,
+	0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000aULL,
+	0x000000008000808bULL, 0x800000000000008bULL, 0x8000000000008089ULL,
+	0x8000000000008003ULL, 0x8000000000008002ULL, 0x8000000000000080ULL,
+	0x000000000000800aULL, 0x800000008000000aULL, 0x8000000080008081ULL,
+	0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL
+};
+
+// Keccak-512 pads a 64 byte message with 0x01 at byte 64 and 0x80 at byte 71
+#define KECCAK_512_NODE_PAD 0x8000000000000001ULL
+
+#endif
+
+#if defined(ETHASH_SHA3_MULTI_SIMD)
+
+// One round of Keccak-f[1600] on vectors of lanes. Needs a[25], b[25], c[5]
+// and d[5] of the vector type and XOR, ANDNOT(x, y) = ~x & y and a ROL taking
+// a constant rotation
+#define KECCAK_MULTI_ROUND(round_constant)								\
+	do {																\
+		for (int x = 0; x < 5; x++) {									\
+			c[x] = XOR(XOR(XOR(a[x], a[x + 5]), XOR(a[x + 10], a[x + 15])), a[x + 20]); \
+		}																\
+		for (int x = 0; x < 5; x++) {									\
+			d[x] = XOR(c[(x + 4) % 5], ROL(c[(x + 1) % 5], 1));		\
+		}																\
+		for (int i = 0; i < 25; i++) {									\
+			a[i] = XOR(a[i], d[i % 5]);								\
+		}																\
+		b[ 0] = a[ 0];													\
+		b[10] = ROL(a[ 1], 1);											\
+		b[20] = ROL(a[ 2], 62);											\
+		b[ 5] = ROL(a[ 3], 28);											\
+		b[15] = ROL(a[ 4], 27);											\
+		b[16] = ROL(a[ 5], 36);											\
+		b[ 1] = ROL(a[ 6], 44);											\
+		b[11] = ROL(a[ 7], 6);											\
+		b[21] = ROL(a[ 8], 55);											\
+		b[ 6] = ROL(a[ 9], 20);											\
+		b[ 7] = ROL(a[10], 3);											\
+		b[17] = ROL(a[11], 10);											\
+		b[ 2] = ROL(a[12], 43);											\
+		b[12] = ROL(a[13], 25);											\
+		b[22] = ROL(a[14], 39);											\
+		b[23] = ROL(a[15], 41);											\
+		b[ 8] = ROL(a[16], 45);											\
+		b[18] = ROL(a[17], 15);											\
+		b[ 3] = ROL(a[18], 21);											\
+		b[13] = ROL(a[19], 8);											\
+		b[14] = ROL(a[20], 18);											\
+		b[24] = ROL(a[21], 2);											\
+		b[ 9] = ROL(a[22], 61);											\
+		b[19] = ROL(a[23], 56);											\
+		b[ 4] = ROL(a[24], 14);											\
+		for (int y = 0; y < 25; y += 5) {								\
+			for (int x = 0; x < 5; x++) {								\
+				a[y + x] = XOR(b[y + x], ANDNOT(b[y + (x + 1) % 5], b[y + (x + 2) % 5])); \
+			}															\
+		}																\
+		a[0] = XOR(a[0], (round_constant));								\
+	} while (0)
+
+#define XOR(x, y) _mm256_xor_si256(x, y)
+#define ANDNOT(x, y) _mm256_andnot_si256(x, y)
+#define ROL(x, s) _mm256_or_si256(_mm256_slli_epi64(x, s), _mm256_srli_epi64(x, 64 - (s)))
+
+ETHASH_TARGET("avx2")
+static void keccakf1600_x4_avx2(__m256i a[25])
+{
+	__m256i b[25], c[5], d[5];
+	for (int r = 0; r < 24; r++) {
+		KECCAK_MULTI_ROUND(_mm256_set1_epi64x((long long)keccak_multi_rc[r]));
+	}
+}
+
+ETHASH_TARGET("avx2")
+static void sha3_512_nodes_avx2(node* nodes, unsigned count)
+{
+	unsigned n = 0;
+	for (; n + 4 <= count; n += 4) {
+		__m256i a[25];
+		node* const p = nodes + n;
+		for (int j = 0; j < 8; j++) {
+			a[j] = _mm256_set_epi64x(
+				(long long)p[3].double_words[j],
+				(long long)p[2].double_words[j],
+				(long long)p[1].double_words[j],
+				(long long)p[0].double_words[j]
+			);
+		}
+		a[8] = _mm256_set1_epi64x((long long)KECCAK_512_NODE_PAD);
+		for (int j = 9; j < 25; j++) {
+			a[j] = _mm256_setzero_si256();
+		}
+		keccakf1600_x4_avx2(a);
+		for (int j = 0; j < 8; j++) {
+			uint64_t lanes[4];
+			_mm256_storeu_si256((__m256i*)lanes, a[j]);
+			for (int k = 0; k < 4; k++) {
+				p[k].double_words[j] = lanes[k];
+			}
+		}
+	}
+	sha3_512_nodes_generic(nodes + n, count - n);
+}
+
+#undef XOR
+#undef ANDNOT
+#undef ROL
+
+#define XOR(x, y) _mm512_xor_si512(x, y)
+#define ANDNOT(x, y) _mm512_andnot_si512(x, y)
+#define ROL(x, s) _mm512_rol_epi64(x, s)
+
+ETHASH_TARGET("avx512f")
+static void keccakf1600_x8_avx512(__m512i a[25])
+{
+	__m512i b[25], c[5], d[5];
+	for (int r = 0; r < 24; r++) {
+		KECCAK_MULTI_ROUND(_mm512_set1_epi64((long long)keccak_multi_rc[r]));
+	}
+}
+
+ETHASH_TARGET("avx512f")
+static void sha3_512_nodes_avx512(node* nodes, unsigned count)
+{
+	unsigned n = 0;
+	// node k of the group starts 8 double words after node k - 1
+	__m512i const gather = _mm512_set_epi64(56, 48, 40, 32, 24, 16, 8, 0);
+	for (; n + 8 <= count; n += 8) {
+		__m512i a[25];
+		node* const p = nodes + n;
+		for (int j = 0; j < 8; j++) {
+			a[j] = _mm512_i64gather_epi64(gather, (void const*)&p[0].double_words[j], 8);
+		}
+		a[8] = _mm512_set1_epi64((long long)KECCAK_512_NODE_PAD);
+		for (int j = 9; j < 25; j++) {
+			a[j] = _mm512_setzero_si512();
+		}
+		keccakf1600_x8_avx512(a);
+		for (int j = 0; j < 8; j++) {
+			_mm512_i64scatter_epi64((void*)&p[0].double_words[j], gather, a[j], 8);
+		}
+	}
+	sha3_512_nodes_generic(nodes + n, count - n);
+}
+
+#undef XOR
+#undef ANDNOT
+#undef ROL
+#undef KECCAK_MULTI_ROUND
+
+#endif // ETHASH_SHA3_MULTI_SIMD
+
+#if defined(ETHASH_SHA3_MULTI_NEON)
+
+#define XOR(x, y) veorq_u64(x, y)
+#define ANDNOT(x, y) vbicq_u64(y, x)
+#define ROL(x, s) vorrq_u64(vshlq_n_u64(x, s), vshrq_n_u64(x, 64 - (s)))
+#define KECCAK_RC(i) vdupq_n_u64(keccak_multi_rc[i])
+
+// two nodes per permutation, in the 128 bit registers of NEON
+static void sha3_512_nodes_neon(node* nodes, unsigned count)
+{
+	unsigned n = 0;
+	for (; n + 2 <= count; n += 2) {
+		uint64x2_t a[25];
+		node* const p = nodes + n;
+		for (int j = 0; j < 8; j++) {
+			a[j] = vcombine_u64(vcreate_u64(p[0].double_words[j]), vcreate_u64(p[1].double_words[j]));
+		}
+		a[8] = vdupq_n_u64(KECCAK_512_NODE_PAD);
+		for (int j = 9; j < 25; j++) {
+			a[j] = vdupq_n_u64(0);
+		}
+		{
+			KECCAK_PERMUTE(uint64x2_t, a, 24, KECCAK_RC, KECCAK_CHI_IOTA);
+		}
+		for (int j = 0; j < 8; j++) {
+			p[0].double_words[j] = vgetq_lane_u64(a[j], 0);
+			p[1].double_words[j] = vgetq_lane_u64(a[j], 1);
+		}
+	}
+	sha3_512_nodes_generic(nodes + n, count - n);
+}
+
+#undef XOR
+#undef ANDNOT
+#undef ROL
+#undef KECCAK_RC
+
+#endif // ETHASH_SHA3_MULTI_NEON
+
+static void keccakf800_multi_generic(uint32_t (*states)[25], unsigned count)
+{
+	ethash_keccakf800_fn const permute = ethash_kernels()->keccakf800->permute;
+	for (unsigned n = 0; n != count; ++n) {
+		permute(states[n]);
+	}
+}
+
+#if defined(ETHASH_SHA3_MULTI_SIMD)
+
+// The Keccak-f[800] kernels keep lane j of state k in element k of register
+// j like the Keccak-512 ones, with the rounds of keccak_unrolled.h
+#define KECCAK_RC(i) SET1((int)keccakf_rndc[i])
+
+#define XOR(x, y) _mm256_xor_si256(x, y)
+#define ANDNOT(x, y) _mm256_andnot_si256(x, y)
+#define ROL(x, s) _mm256_or_si256(_mm256_slli_epi32(x, (s) % 32), _mm256_srli_epi32(x, 32 - (s) % 32))
+#define SET1(x) _mm256_set1_epi32(x)
+
+ETHASH_TARGET("avx2")
+static void keccakf800_multi_avx2(uint32_t (*states)[25], unsigned count)
+{
+	unsigned n = 0;
+	// state k of the group starts 25 words after state k - 1
+	__m256i const gather = _mm256_set_epi32(175, 150, 125, 100, 75, 50, 25, 0);
+	for (; n + 8 <= count; n += 8) {
+		__m256i a[25];
+		uint32_t* const p = states[n];
+		for (int j = 0; j < 25; j++) {
+			a[j] = _mm256_i32gather_epi32((int const*)(p + j), gather, 4);
+		}
+		{
+			KECCAK_PERMUTE(__m256i, a, 22, KECCAK_RC, KECCAK_CHI_IOTA);
+		}
+		for (int j = 0; j < 25; j++) {
+			uint32_t lanes[8];
+			_mm256_storeu_si256((__m256i*)lanes, a[j]);
+			for (int k = 0; k < 8; k++) {
+				states[n + k][j] = lanes[k];
+			}
+		}
+	}
+	keccakf800_multi_generic(states + n, count - n);
+}
+
+#undef XOR
+#undef ANDNOT
+#undef ROL
+#undef SET1
+
+#define XOR(x, y) _mm_xor_si128(x, y)
+#define ANDNOT(x, y) _mm_andnot_si128(x, y)
+#define ROL(x, s) _mm_or_si128(_mm_slli_epi32(x, (s) % 32), _mm_srli_epi32(x, 32 - (s) % 32))
+#define SET1(x) _mm_set1_epi32(x)
+
+ETHASH_TARGET("sse4.1")
+static void keccakf800_multi_sse41(uint32_t (*states)[25], unsigned count)
+{
+	unsigned n = 0;
+	for (; n + 4 <= count; n += 4) {
+		__m128i a[25];
+		uint32_t (*const p)[25] = states + n;
+		for (int j = 0; j < 25; j++) {
+			a[j] = _mm_set_epi32((int)p[3][j], (int)p[2][j], (int)p[1][j], (int)p[0][j]);
+		}
+		{
+			KECCAK_PERMUTE(__m128i, a, 22, KECCAK_RC, KECCAK_CHI_IOTA);
+		}
+		for (int j = 0; j < 25; j++) {
+			p[0][j] = (uint32_t)_mm_cvtsi128_si32(a[j]);
+			p[1][j] = (uint32_t)_mm_extract_epi32(a[j], 1);
+			p[2][j] = (uint32_t)_mm_extract_epi32(a[j], 2);
+			p[3][j] = (uint32_t)_mm_extract_epi32(a[j], 3);
+		}
+	}
+	keccakf800_multi_generic(states + n, count - n);
+}
+
+#undef XOR
+#undef ANDNOT
+#undef ROL
+#undef SET1
+#undef KECCAK_RC
+
+#endif // ETHASH_SHA3_MULTI_SIMD
+
+#if defined(ETHASH_SHA3_MULTI_NEON)
+
+#define XOR(x, y) veorq_u32(x, y)
+#define ANDNOT(x, y) vbicq_u32(y, x)
+#define ROL(x, s) vorrq_u32(vshlq_n_u32(x, (s) % 32), vshrq_n_u32(x, 32 - (s) % 32))
+#define KECCAK_RC(i) vdupq_n_u32(keccakf_rndc[i])
+
+static void keccakf800_multi_neon(uint32_t (*states)[25], unsigned count)
+{
+	unsigned n = 0;
+	for (; n + 4 <= count; n += 4) {
+		uint32x4_t a[25];
+		uint32_t (*const p)[25] = states + n;
+		for (int j = 0; j < 25; j++) {
+			uint32_t const lanes[4] = { p[0][j], p[1][j], p[2][j], p[3][j] };
+			a[j] = vld1q_u32(lanes);
+		}
+		{
+			KECCAK_PERMUTE(uint32x4_t, a, 22, KECCAK_RC, KECCAK_CHI_IOTA);
+		}
+		for (int j = 0; j < 25; j++) {
+			uint32_t lanes[4];
+			vst1q_u32(lanes, a[j]);
+			for (int k = 0; k < 4; k++) {
+				p[k][j] = lanes[k];
+			}
+		}
+	}
+	keccakf800_multi_generic(states + n, count - n);
+}
+
+#undef XOR
+#undef ANDNOT
+#undef ROL
+#undef KECCAK_RC
+
+#endif // ETHASH_SHA3_MULTI_NEON
+
+// widest first, the portable kernel has to stay last
+static ethash_sha3_multi_kernel_t const sha3_multi_kernels[] = {
+#if defined(ETHASH_SHA3_MULTI_SIMD)
+	{ "avx512x8", ETHASH_CPU_AVX512F, 8, sha3_512_nodes_avx512 },
+	{ "avx2x4", ETHASH_CPU_AVX2, 4, sha3_512_nodes_avx2 },
+#endif
+#if defined(ETHASH_SHA3_MULTI_NEON)
+	{ "neonx2", ETHASH_CPU_NEON, 2, sha3_512_nodes_neon },
+#endif
+	{ "generic", 0, 1, sha3_512_nodes_generic }
+};
+
+#define SHA3_MULTI_KERNEL_COUNT (sizeof(sha3_multi_kernels) / sizeof(sha3_multi_kernels[0]))
+
+ethash_sha3_multi_kernel_t const* ethash_sha3_multi_kernel_at(unsigned i)
+{
+	uint32_t const features = ethash_cpu_features();
+	for (unsigned k = 0; k != SHA3_MULTI_KERNEL_COUNT; ++k) {
+		uint32_t const required = sha3_multi_kernels[k].required_features;
+		if ((required & features) == required && i-- == 0) {
+			return &sha3_multi_kernels[k];
+		}
+	}
+	return NULL;
+}
+
+static ethash_keccakf800_multi_kernel_t const keccakf800_multi_kernels[] = {
+#if defined(ETHASH_SHA3_MULTI_SIMD)
+	{ "avx2x8", ETHASH_CPU_AVX2, 8, keccakf800_multi_avx2 },
+	{ "sse41x4", ETHASH_CPU_SSE41, 4, keccakf800_multi_sse41 },
+#endif
+#if defined(ETHASH_SHA3_MULTI_NEON)
+	{ "neonx4", ETHASH_CPU_NEON, 4, keccakf800_multi_neon },
+#endif
+	{ "generic", 0, 1, keccakf800_multi_generic }
+};
+
+#define KECCAKF800_MULTI_KERNEL_COUNT (sizeof(keccakf800_multi_kernels) / sizeof(keccakf800_multi_kernels[0]))
+
+ethash_keccakf800_multi_kernel_t const* ethash_keccakf800_multi_kernel_at(unsigned i)
+{
+	uint32_t const features = ethash_cpu_features();
+	for (unsigned k = 0; k != KECCAKF800_MULTI_KERNEL_COUNT; ++k) {
+		uint32_t const required = keccakf800_multi_kernels[k].required_features;
+		if ((required & features) == required && i-- == 0) {
+			return &keccakf800_multi_kernels[k];
+		}
+	}
+	return NULL;
+}
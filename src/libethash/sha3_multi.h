@@ -0,0 +1,85 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file sha3_multi.h
+ * @date 2018
+ *
+ * Multi-buffer Keccak-512 over independent 64 byte nodes, used to hash
+ * several DAG items with a single vectorised permutation, and multi-buffer
+ * Keccak-f[800] for the seeds and final hashes of batched ProgPoW nonces
+ */
+#pragma once
+#include "internal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ethash_sha3_multi_kernel {
+	/// Short name identifying the implementation, e.g. "avx2x4"
+	char const* name;
+	/// Mask of @ref ethash_cpu_feature values the implementation needs
+	uint32_t required_features;
+	/// Number of nodes hashed by one permutation
+	unsigned lanes;
+	/**
+	 * Replace each of @a count nodes by its SHA3_512 (Keccak-512) hash
+	 *
+	 * @a count does not have to be a multiple of @a lanes, the remaining
+	 * nodes are hashed one by one.
+	 */
+	void (*sha3_512_nodes)(node* nodes, unsigned count);
+} ethash_sha3_multi_kernel_t;
+
+/**
+ * Enumerate the multi-buffer Keccak kernels supported by the host, widest
+ * first
+ *
+ * @param i        The index of the kernel
+ * @return         The kernel or NULL if @a i is past the last supported one.
+ *                 The last kernel is always the portable one.
+ */
+ethash_sha3_multi_kernel_t const* ethash_sha3_multi_kernel_at(unsigned i);
+
+typedef struct ethash_keccakf800_multi_kernel {
+	/// Short name identifying the implementation, e.g. "avx2x8"
+	char const* name;
+	/// Mask of @ref ethash_cpu_feature values the implementation needs
+	uint32_t required_features;
+	/// Number of states advanced by one vectorised permutation
+	unsigned lanes;
+	/**
+	 * Apply all 22 rounds of Keccak-f[800] to each of @a count states
+	 *
+	 * @a count does not have to be a multiple of @a lanes, the remaining
+	 * states go through the selected single state kernel.
+	 */
+	void (*permute)(uint32_t (*states)[25], unsigned count);
+} ethash_keccakf800_multi_kernel_t;
+
+/**
+ * Enumerate the multi-buffer Keccak-f[800] kernels supported by the host,
+ * widest first
+ *
+ * @param i        The index of the kernel
+ * @return         The kernel or NULL if @a i is past the last supported one.
+ *                 The last kernel is always the portable one.
+ */
+ethash_keccakf800_multi_kernel_t const* ethash_keccakf800_multi_kernel_at(unsigned i);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,87 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file stats.c
+ * @date 2018
+ *
+ * Every thread adds to one of ETHASH_STATS_SLOTS sets of counters, picked
+ * round robin on its first update, and ethash_get_stats() sums all of them.
+ * Threads only share a set once there are more of them than sets.
+ */
+
+#include "stats.h"
+#include "ethash.h"
+#include "threads.h"
+
+#define ETHASH_STATS_SLOTS 64
+// counters per slot, rounded up to whole 64 byte cache lines so threads on
+// neighbouring slots don't share one
+#define ETHASH_STATS_SLOT_COUNTERS ((ETHASH_STAT_COUNT + 7) / 8 * 8)
+
+static uint64_t volatile stats_counters[ETHASH_STATS_SLOTS][ETHASH_STATS_SLOT_COUNTERS];
+static uint32_t volatile stats_enabled = 0;
+static uint32_t volatile stats_next_slot = 0;
+// one past the slot of the calling thread, 0 before its first update
+static ETHASH_THREAD_LOCAL uint32_t stats_slot = 0;
+
+void ethash_set_stats_enabled(bool enable)
+{
+	ethash_atomic_store_u32(&stats_enabled, enable ? 1 : 0);
+}
+
+bool ethash_get_stats_enabled(void)
+{
+	return ethash_atomic_load_u32(&stats_enabled) != 0;
+}
+
+void ethash_stats_add(enum ethash_stat stat, uint64_t value)
+{
+	if (!ethash_atomic_load_u32(&stats_enabled)) {
+		return;
+	}
+	uint32_t slot = stats_slot;
+	if (slot == 0) {
+		slot = ethash_atomic_fetch_add_u32(&stats_next_slot, 1) % ETHASH_STATS_SLOTS + 1;
+		stats_slot = slot;
+	}
+	ethash_atomic_fetch_add_u64(&stats_counters[slot - 1][stat], value);
+}
+
+static uint64_t ethash_stats_sum(enum ethash_stat stat)
+{
+	uint64_t sum = 0;
+	for (unsigned slot = 0; slot != ETHASH_STATS_SLOTS; ++slot) {
+		sum += ethash_atomic_load_u64(&stats_counters[slot][stat]);
+	}
+	return sum;
+}
+
+void ethash_get_stats(ethash_stats_t* stats)
+{
+	stats->light_hashes = ethash_stats_sum(ETHASH_STAT_LIGHT_HASHES);
+	stats->full_hashes = ethash_stats_sum(ETHASH_STAT_FULL_HASHES);
+	stats->progpow_light_hashes = ethash_stats_sum(ETHASH_STAT_PROGPOW_LIGHT_HASHES);
+	stats->progpow_full_hashes = ethash_stats_sum(ETHASH_STAT_PROGPOW_FULL_HASHES);
+	stats->dag_items = ethash_stats_sum(ETHASH_STAT_DAG_ITEMS);
+	stats->cache_builds = ethash_stats_sum(ETHASH_STAT_CACHE_BUILDS);
+	stats->cache_build_us = ethash_stats_sum(ETHASH_STAT_CACHE_BUILD_US);
+	stats->dag_build_us = ethash_stats_sum(ETHASH_STAT_DAG_BUILD_US);
+	stats->mapped_bytes = ethash_stats_sum(ETHASH_STAT_MAPPED_BYTES);
+	stats->read_bytes = ethash_stats_sum(ETHASH_STAT_READ_BYTES);
+	stats->written_bytes = ethash_stats_sum(ETHASH_STAT_WRITTEN_BYTES);
+	stats->verify_failures = ethash_stats_sum(ETHASH_STAT_VERIFY_FAILURES);
+	stats->memory_lock_failures = ethash_stats_sum(ETHASH_STAT_MEMORY_LOCK_FAILURES);
+}
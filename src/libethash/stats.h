@@ -0,0 +1,56 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file stats.h
+ * @date 2018
+ *
+ * The counters behind ethash_get_stats()
+ */
+#pragma once
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum ethash_stat {
+	ETHASH_STAT_LIGHT_HASHES,
+	ETHASH_STAT_FULL_HASHES,
+	ETHASH_STAT_PROGPOW_LIGHT_HASHES,
+	ETHASH_STAT_PROGPOW_FULL_HASHES,
+	ETHASH_STAT_DAG_ITEMS,
+	ETHASH_STAT_CACHE_BUILDS,
+	ETHASH_STAT_CACHE_BUILD_US,
+	ETHASH_STAT_DAG_BUILD_US,
+	ETHASH_STAT_MAPPED_BYTES,
+	ETHASH_STAT_READ_BYTES,
+	ETHASH_STAT_WRITTEN_BYTES,
+	ETHASH_STAT_VERIFY_FAILURES,
+	ETHASH_STAT_MEMORY_LOCK_FAILURES,
+	ETHASH_STAT_COUNT
+};
+
+/**
+ * Add @a value to a counter, if the counters are enabled
+ *
+ * Threads add to counters of their own, so the calls of different threads
+ * don't contend with each other.
+ */
+void ethash_stats_add(enum ethash_stat stat, uint64_t value);
+
+#ifdef __cplusplus
+}
+#endif
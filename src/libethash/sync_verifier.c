@@ -0,0 +1,262 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file sync_verifier.c
+ * @date 2018
+ *
+ * Verifies an ordered stream of headers while the caches of the next epochs
+ * are built by light futures, see @ref ethash_sync_verifier_new()
+ */
+
+#include <stdlib.h>
+#include "ethash.h"
+#include "internal.h"
+
+// a cache built ahead of the current epoch
+struct ethash_sync_epoch {
+	uint64_t epoch;
+	ethash_light_future_t future;    ///< NULL for a free slot
+};
+
+struct ethash_sync_verifier {
+	unsigned lookahead;
+	unsigned num_threads;
+	uint64_t cache_size;             ///< fixed cache size or 0 for the size of each epoch
+	uint64_t full_size;              ///< fixed DAG size or 0 for the size of each epoch
+
+	bool started;                    ///< whether a header has been pushed yet
+	uint64_t epoch;                  ///< the epoch of the last header pushed
+	ethash_light_t light;            ///< the cache of @a epoch, NULL if it could not be built
+	struct ethash_sync_epoch ahead[ETHASH_SYNC_MAX_LOOKAHEAD];
+};
+
+static bool ethash_sync_verifier_valid_epoch(ethash_sync_verifier_t verifier, uint64_t epoch)
+{
+	return verifier->full_size != 0 || epoch < ETHASH_MAX_EPOCHS;
+}
+
+static ethash_light_future_t ethash_sync_verifier_build(ethash_sync_verifier_t verifier, uint64_t epoch)
+{
+	uint64_t const block_number = epoch * ETHASH_EPOCH_LENGTH;
+	if (verifier->cache_size == 0) {
+		// goes through the light cache files
+		return ethash_light_new_async(block_number);
+	}
+	ethash_h256_t const seedhash = ethash_get_seedhash(block_number);
+	return ethash_light_new_async_internal(NULL, verifier->cache_size, &seedhash);
+}
+
+// make @a epoch the current one and start building the caches after it
+static void ethash_sync_verifier_enter(ethash_sync_verifier_t verifier, uint64_t epoch)
+{
+	if (verifier->started && verifier->epoch == epoch) {
+		return;
+	}
+	ethash_light_t light = NULL;
+	bool built = false;
+	for (unsigned i = 0; i != ETHASH_SYNC_MAX_LOOKAHEAD; ++i) {
+		struct ethash_sync_epoch* const slot = &verifier->ahead[i];
+		if (!slot->future) {
+			continue;
+		}
+		if (slot->epoch == epoch) {
+			light = ethash_light_future_wait(slot->future);
+			built = true;
+		} else if (slot->epoch < epoch || slot->epoch > epoch + verifier->lookahead) {
+			// skipped over, or left behind by a stream going backwards
+			ethash_light_future_cancel(slot->future);
+		} else {
+			continue;
+		}
+		slot->future = NULL;
+	}
+	if (!built && ethash_sync_verifier_valid_epoch(verifier, epoch)) {
+		ethash_light_future_t const future = ethash_sync_verifier_build(verifier, epoch);
+		if (future) {
+			light = ethash_light_future_wait(future);
+		}
+	}
+	// the headers of the previous epoch are all verified by now
+	if (verifier->light) {
+		ethash_light_delete(verifier->light);
+	}
+	verifier->light = light;
+	verifier->epoch = epoch;
+	verifier->started = true;
+
+	for (uint64_t next = epoch + 1; next <= epoch + verifier->lookahead; ++next) {
+		if (!ethash_sync_verifier_valid_epoch(verifier, next)) {
+			break;
+		}
+		struct ethash_sync_epoch* free_slot = NULL;
+		bool pending = false;
+		for (unsigned i = 0; i != ETHASH_SYNC_MAX_LOOKAHEAD; ++i) {
+			struct ethash_sync_epoch* const slot = &verifier->ahead[i];
+			if (!slot->future) {
+				free_slot = free_slot ? free_slot : slot;
+			} else if (slot->epoch == next) {
+				pending = true;
+			}
+		}
+		if (!pending && free_slot) {
+			free_slot->epoch = next;
+			free_slot->future = ethash_sync_verifier_build(verifier, next);
+		}
+	}
+}
+
+ethash_sync_verifier_t ethash_sync_verifier_new_internal(
+	unsigned lookahead,
+	unsigned num_threads,
+	uint64_t cache_size,
+	uint64_t full_size
+)
+{
+	struct ethash_sync_verifier* ret = calloc(1, sizeof(*ret));
+	if (!ret) {
+		return NULL;
+	}
+	ret->lookahead = lookahead < ETHASH_SYNC_MAX_LOOKAHEAD ? lookahead : ETHASH_SYNC_MAX_LOOKAHEAD;
+	ret->num_threads = num_threads;
+	ret->cache_size = cache_size;
+	ret->full_size = full_size;
+	return ret;
+}
+
+ethash_sync_verifier_t ethash_sync_verifier_new(unsigned lookahead, unsigned num_threads)
+{
+	return ethash_sync_verifier_new_internal(lookahead, num_threads, 0, 0);
+}
+
+void ethash_sync_verifier_delete(ethash_sync_verifier_t verifier)
+{
+	for (unsigned i = 0; i != ETHASH_SYNC_MAX_LOOKAHEAD; ++i) {
+		if (verifier->ahead[i].future) {
+			ethash_light_future_cancel(verifier->ahead[i].future);
+		}
+	}
+	if (verifier->light) {
+		ethash_light_delete(verifier->light);
+	}
+	free(verifier);
+}
+
+size_t ethash_sync_verifier_push(
+	ethash_sync_verifier_t verifier,
+	uint64_t const* block_numbers,
+	ethash_h256_t const* header_hashes,
+	uint64_t const* nonces,
+	ethash_h256_t const* mix_hashes,
+	ethash_h256_t const* boundaries,
+	bool* results,
+	size_t count
+)
+{
+	size_t valid = 0;
+	size_t begin = 0;
+	while (begin != count) {
+		// the batch of the headers up to the next epoch boundary
+		uint64_t const epoch = block_numbers[begin] / ETHASH_EPOCH_LENGTH;
+		size_t end = begin + 1;
+		while (end != count && block_numbers[end] / ETHASH_EPOCH_LENGTH == epoch) {
+			++end;
+		}
+		ethash_sync_verifier_enter(verifier, epoch);
+		if (verifier->light) {
+			uint64_t const full_size = verifier->full_size ?
+				verifier->full_size : ethash_get_datasize(epoch * ETHASH_EPOCH_LENGTH);
+			valid += ethash_light_verify_batch_internal(
+				verifier->light,
+				full_size,
+				header_hashes + begin,
+				nonces + begin,
+				mix_hashes + begin,
+				boundaries + begin,
+				results + begin,
+				end - begin,
+				verifier->num_threads
+			);
+		} else {
+			for (size_t i = begin; i != end; ++i) {
+				results[i] = false;
+			}
+		}
+		begin = end;
+	}
+	return valid;
+}
+
+size_t ethash_sync_verifier_push_headers(
+	ethash_sync_verifier_t verifier,
+	uint8_t const* headers,
+	size_t const* sizes,
+	bool* results,
+	size_t count
+)
+{
+	uint64_t* block_numbers = malloc(count * sizeof(*block_numbers));
+	ethash_h256_t* header_hashes = malloc(count * sizeof(*header_hashes));
+	uint64_t* nonces = malloc(count * sizeof(*nonces));
+	ethash_h256_t* mix_hashes = malloc(count * sizeof(*mix_hashes));
+	ethash_h256_t* boundaries = malloc(count * sizeof(*boundaries));
+	bool* decoded = malloc(count * sizeof(*decoded));
+	size_t valid = 0;
+	if (count && block_numbers && header_hashes && nonces && mix_hashes && boundaries && decoded) {
+		ethash_header_decode_batch(
+			headers, sizes, block_numbers, header_hashes, nonces, mix_hashes, boundaries, decoded, count
+		);
+		// leave the headers that could not be decoded out of the stream, so
+		// that their block numbers of 0 do not take it back to the first epoch
+		size_t n = 0;
+		for (size_t i = 0; i != count; ++i) {
+			if (decoded[i]) {
+				block_numbers[n] = block_numbers[i];
+				header_hashes[n] = header_hashes[i];
+				nonces[n] = nonces[i];
+				mix_hashes[n] = mix_hashes[i];
+				boundaries[n] = boundaries[i];
+				n++;
+			}
+		}
+		valid = ethash_sync_verifier_push(
+			verifier, block_numbers, header_hashes, nonces, mix_hashes, boundaries, results, n
+		);
+		// back to the positions of the headers, the last ones first as none moved forward
+		for (size_t i = count; i-- != 0;) {
+			results[i] = decoded[i] ? results[--n] : false;
+		}
+	} else {
+		for (size_t i = 0; i != count; ++i) {
+			results[i] = false;
+		}
+	}
+	free(block_numbers);
+	free(header_hashes);
+	free(nonces);
+	free(mix_hashes);
+	free(boundaries);
+	free(decoded);
+	return valid;
+}
+
+unsigned ethash_sync_verifier_pending(ethash_sync_verifier_t verifier)
+{
+	unsigned pending = 0;
+	for (unsigned i = 0; i != ETHASH_SYNC_MAX_LOOKAHEAD; ++i) {
+		pending += verifier->ahead[i].future != NULL;
+	}
+	return pending;
+}
@@ -0,0 +1,316 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file threadpool.c
+ * @date 2018
+ *
+ * Pools of threads running queued tasks, and the parallel work their helper
+ * tasks join. A helper holds a reference to the shared state of its work, so
+ * the caller of @ref ethash_parallel_run() only waits for helpers that run
+ * and never for queued ones.
+ */
+
+#include <stdlib.h>
+#include "threadpool.h"
+
+struct ethash_threadpool_task {
+	ethash_thread_fn fn;
+	void* arg;
+	struct ethash_threadpool_task* next;
+};
+
+struct ethash_threadpool {
+	uint64_t affinity_mask;
+	enum ethash_thread_priority priority;
+	ethash_mutex_t lock;
+	ethash_cond_t queued;        ///< signalled for new tasks and to stop
+	struct ethash_threadpool_task* head;
+	struct ethash_threadpool_task* tail;
+	bool stop;                   ///< set once the threads should return, protected by lock
+	unsigned num_threads;        ///< the number of started threads
+	ethash_thread_t* threads;
+};
+
+static void ethash_threadpool_worker(void* arg)
+{
+	struct ethash_threadpool* pool = (struct ethash_threadpool*)arg;
+	if (pool->affinity_mask) {
+		ethash_thread_set_affinity(pool->affinity_mask);
+	}
+	ethash_mutex_lock(&pool->lock);
+	for (;;) {
+		struct ethash_threadpool_task* task = pool->head;
+		if (!task) {
+			if (pool->stop) {
+				break;
+			}
+			ethash_cond_wait(&pool->queued, &pool->lock);
+			continue;
+		}
+		pool->head = task->next;
+		if (!pool->head) {
+			pool->tail = NULL;
+		}
+		ethash_mutex_unlock(&pool->lock);
+		task->fn(task->arg);
+		free(task);
+		ethash_mutex_lock(&pool->lock);
+	}
+	ethash_mutex_unlock(&pool->lock);
+}
+
+ethash_threadpool_t ethash_threadpool_new(
+	unsigned num_threads,
+	uint64_t affinity_mask,
+	enum ethash_thread_priority priority
+)
+{
+	if (num_threads == 0) {
+		num_threads = ethash_hardware_concurrency();
+	}
+	struct ethash_threadpool* pool = calloc(1, sizeof(*pool));
+	if (!pool) {
+		return NULL;
+	}
+	pool->threads = calloc(num_threads, sizeof(ethash_thread_t));
+	if (!pool->threads) {
+		goto fail_free_pool;
+	}
+	if (!ethash_mutex_init(&pool->lock)) {
+		goto fail_free_threads;
+	}
+	if (!ethash_cond_init(&pool->queued)) {
+		goto fail_destroy_lock;
+	}
+	pool->affinity_mask = affinity_mask;
+	pool->priority = priority;
+	// a smaller pool is better than none. Pools are started on first use,
+	// maybe by a lowered thread, so the threads get the priority of the pool
+	while (pool->num_threads != num_threads &&
+		ethash_thread_create_priority(
+			&pool->threads[pool->num_threads], ethash_threadpool_worker, pool, priority == ETHASH_THREAD_PRIORITY_LOW
+		)) {
+		pool->num_threads++;
+	}
+	if (pool->num_threads == 0) {
+		goto fail_destroy_cond;
+	}
+	return pool;
+
+fail_destroy_cond:
+	ethash_cond_destroy(&pool->queued);
+fail_destroy_lock:
+	ethash_mutex_destroy(&pool->lock);
+fail_free_threads:
+	free(pool->threads);
+fail_free_pool:
+	free(pool);
+	return NULL;
+}
+
+bool ethash_threadpool_spawn(ethash_threadpool_t pool, ethash_thread_fn fn, void* arg)
+{
+	struct ethash_threadpool_task* task = malloc(sizeof(*task));
+	if (!task) {
+		return false;
+	}
+	task->fn = fn;
+	task->arg = arg;
+	task->next = NULL;
+	ethash_mutex_lock(&pool->lock);
+	if (pool->tail) {
+		pool->tail->next = task;
+	} else {
+		pool->head = task;
+	}
+	pool->tail = task;
+	ethash_cond_broadcast(&pool->queued);
+	ethash_mutex_unlock(&pool->lock);
+	return true;
+}
+
+void ethash_threadpool_delete(ethash_threadpool_t pool)
+{
+	ethash_mutex_lock(&pool->lock);
+	pool->stop = true;
+	ethash_cond_broadcast(&pool->queued);
+	ethash_mutex_unlock(&pool->lock);
+	for (unsigned i = 0; i != pool->num_threads; ++i) {
+		ethash_thread_join(pool->threads[i]);
+	}
+	ethash_cond_destroy(&pool->queued);
+	ethash_mutex_destroy(&pool->lock);
+	free(pool->threads);
+	free(pool);
+}
+
+// The pools of ethash_parallel_run(), one per priority and started on first use
+static ethash_once_t threadpool_once = ETHASH_ONCE_INIT;
+static ethash_mutex_t threadpool_lock;
+static ethash_threadpool_t threadpool_pools[2];
+static unsigned threadpool_num_threads;
+static uint64_t threadpool_affinity_mask;
+static ethash_executor_t threadpool_executor;
+
+static void ethash_threadpool_init(void)
+{
+	ethash_mutex_init(&threadpool_lock);
+}
+
+void ethash_set_thread_pool(unsigned num_threads, uint64_t affinity_mask)
+{
+	ethash_call_once(&threadpool_once, ethash_threadpool_init);
+	ethash_mutex_lock(&threadpool_lock);
+	ethash_threadpool_t const normal = threadpool_pools[ETHASH_THREAD_PRIORITY_NORMAL];
+	ethash_threadpool_t const low = threadpool_pools[ETHASH_THREAD_PRIORITY_LOW];
+	threadpool_pools[ETHASH_THREAD_PRIORITY_NORMAL] = NULL;
+	threadpool_pools[ETHASH_THREAD_PRIORITY_LOW] = NULL;
+	threadpool_num_threads = num_threads;
+	threadpool_affinity_mask = affinity_mask;
+	ethash_mutex_unlock(&threadpool_lock);
+	// nothing queues tasks on the old pools any more, the ones already queued
+	// still run
+	if (normal) {
+		ethash_threadpool_delete(normal);
+	}
+	if (low) {
+		ethash_threadpool_delete(low);
+	}
+}
+
+void ethash_set_executor(ethash_executor_t const* executor)
+{
+	ethash_call_once(&threadpool_once, ethash_threadpool_init);
+	ethash_mutex_lock(&threadpool_lock);
+	if (executor) {
+		threadpool_executor = *executor;
+	} else {
+		threadpool_executor.spawn = NULL;
+		threadpool_executor.user = NULL;
+	}
+	ethash_mutex_unlock(&threadpool_lock);
+}
+
+// Start a helper with the executor or on the pool of @a priority
+static bool ethash_threadpool_spawn_helper(ethash_thread_fn fn, void* arg, enum ethash_thread_priority priority)
+{
+	ethash_call_once(&threadpool_once, ethash_threadpool_init);
+	ethash_mutex_lock(&threadpool_lock);
+	ethash_executor_t const executor = threadpool_executor;
+	bool spawned = false;
+	if (!executor.spawn) {
+		if (!threadpool_pools[priority]) {
+			threadpool_pools[priority] = ethash_threadpool_new(
+				threadpool_num_threads, threadpool_affinity_mask, priority
+			);
+		}
+		// queued while holding the lock, so the pool can't be replaced meanwhile
+		spawned = threadpool_pools[priority] && ethash_threadpool_spawn(threadpool_pools[priority], fn, arg);
+	}
+	ethash_mutex_unlock(&threadpool_lock);
+	if (executor.spawn) {
+		spawned = executor.spawn(executor.user, fn, arg, priority);
+	}
+	return spawned;
+}
+
+struct ethash_parallel_job {
+	ethash_thread_fn fn;
+	void* arg;
+	uint32_t volatile refs;      ///< the caller and every spawned helper
+	ethash_mutex_t lock;
+	ethash_cond_t idle;          ///< signalled when the last running helper returns
+	unsigned running;            ///< helpers in @a fn, protected by lock
+	bool done;                   ///< set once the caller is done, protected by lock
+};
+
+static void ethash_parallel_release(struct ethash_parallel_job* job)
+{
+	if (ethash_atomic_fetch_add_u32(&job->refs, (uint32_t)-1) == 1) {
+		ethash_cond_destroy(&job->idle);
+		ethash_mutex_destroy(&job->lock);
+		free(job);
+	}
+}
+
+static void ethash_parallel_helper(void* arg)
+{
+	struct ethash_parallel_job* job = (struct ethash_parallel_job*)arg;
+	ethash_mutex_lock(&job->lock);
+	// once the caller is done the work is and @a job->arg may be gone
+	bool const run = !job->done;
+	if (run) {
+		job->running++;
+	}
+	ethash_mutex_unlock(&job->lock);
+	if (run) {
+		job->fn(job->arg);
+		ethash_mutex_lock(&job->lock);
+		if (--job->running == 0) {
+			ethash_cond_broadcast(&job->idle);
+		}
+		ethash_mutex_unlock(&job->lock);
+	}
+	ethash_parallel_release(job);
+}
+
+void ethash_parallel_run(
+	ethash_thread_fn fn,
+	void* arg,
+	unsigned num_threads,
+	enum ethash_thread_priority priority
+)
+{
+	if (num_threads == 0) {
+		num_threads = ethash_hardware_concurrency();
+	}
+	struct ethash_parallel_job* job = num_threads > 1 ? calloc(1, sizeof(*job)) : NULL;
+	if (!job) {
+		fn(arg);
+		return;
+	}
+	if (!ethash_mutex_init(&job->lock)) {
+		goto fail_free_job;
+	}
+	if (!ethash_cond_init(&job->idle)) {
+		goto fail_destroy_lock;
+	}
+	job->fn = fn;
+	job->arg = arg;
+	job->refs = 1;
+	for (unsigned i = 1; i != num_threads; ++i) {
+		ethash_atomic_fetch_add_u32(&job->refs, 1);
+		if (!ethash_threadpool_spawn_helper(ethash_parallel_helper, job, priority)) {
+			ethash_atomic_fetch_add_u32(&job->refs, (uint32_t)-1);
+			break;
+		}
+	}
+	fn(arg);
+	ethash_mutex_lock(&job->lock);
+	job->done = true;
+	while (job->running) {
+		ethash_cond_wait(&job->idle, &job->lock);
+	}
+	ethash_mutex_unlock(&job->lock);
+	ethash_parallel_release(job);
+	return;
+
+fail_destroy_lock:
+	ethash_mutex_destroy(&job->lock);
+fail_free_job:
+	free(job);
+	fn(arg);
+}
@@ -0,0 +1,81 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file threadpool.h
+ * @date 2018
+ *
+ * The pools of threads parallel work of libethash borrows its helpers from,
+ * see @ref ethash_set_thread_pool(). The implementation lives in threadpool.c
+ */
+#pragma once
+#include "ethash.h"
+#include "threads.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ethash_threadpool;
+typedef struct ethash_threadpool* ethash_threadpool_t;
+
+/**
+ * Start a pool of threads
+ *
+ * @param num_threads    The number of threads, 0 for one per hardware thread
+ * @param affinity_mask  The logical processors the threads may run on, 0 for all
+ * @param priority       The priority the threads run at
+ * @return               The pool, or NULL if not even one thread could be started
+ */
+ethash_threadpool_t ethash_threadpool_new(
+	unsigned num_threads,
+	uint64_t affinity_mask,
+	enum ethash_thread_priority priority
+);
+
+/**
+ * Queue @a fn(@a arg) to run on the next free thread of @a pool
+ *
+ * @return               true if the task was queued, false if out of memory
+ */
+bool ethash_threadpool_spawn(ethash_threadpool_t pool, ethash_thread_fn fn, void* arg);
+
+/**
+ * Run the tasks left in the queue of @a pool, stop its threads and free it
+ */
+void ethash_threadpool_delete(ethash_threadpool_t pool);
+
+/**
+ * Run @a fn(@a arg) on the calling thread and up to @a num_threads - 1
+ * helpers at once, and wait for all of them
+ *
+ * The helpers come from the executor of @ref ethash_set_executor() or else
+ * from the pool of @a priority. @a fn must take its share of the work from
+ * state in @a arg it shares with the other calls, such that any one call can
+ * do all of it: helpers that only start once the calling thread ran out of
+ * work return without calling @a fn.
+ *
+ * @param num_threads    The number of threads in all, 0 for one per hardware thread
+ */
+void ethash_parallel_run(
+	ethash_thread_fn fn,
+	void* arg,
+	unsigned num_threads,
+	enum ethash_thread_priority priority
+);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,239 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file threads.h
+ * @date 2018
+ *
+ * Minimal cross-platform threading primitives used by the parallel parts of
+ * libethash. The implementations live in threads_posix.c and threads_win32.c
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "compiler.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32)
+typedef HANDLE ethash_thread_t;
+typedef CRITICAL_SECTION ethash_mutex_t;
+typedef CONDITION_VARIABLE ethash_cond_t;
+typedef INIT_ONCE ethash_once_t;
+#define ETHASH_ONCE_INIT INIT_ONCE_STATIC_INIT
+#else
+typedef pthread_t ethash_thread_t;
+typedef pthread_mutex_t ethash_mutex_t;
+typedef pthread_cond_t ethash_cond_t;
+typedef pthread_once_t ethash_once_t;
+#define ETHASH_ONCE_INIT PTHREAD_ONCE_INIT
+#endif
+
+/// Signature of a function run by @ref ethash_thread_create()
+typedef void (*ethash_thread_fn)(void*);
+
+/**
+ * Start a new thread running @a fn(@a arg)
+ *
+ * @param[out] thread     The handle of the started thread
+ * @param[in]  fn         The function to run
+ * @param[in]  arg        The argument to pass to @a fn
+ * @return                true if the thread was started and false otherwise
+ */
+bool ethash_thread_create(ethash_thread_t* thread, ethash_thread_fn fn, void* arg);
+
+/**
+ * Start a new thread running @a fn(@a arg) at a given priority
+ *
+ * Unlike with @ref ethash_thread_create() the thread does not take the
+ * priority of the caller, so a lowered thread can start threads of normal
+ * priority.
+ *
+ * @param[out] thread       The handle of the started thread
+ * @param[in]  fn           The function to run
+ * @param[in]  arg          The argument to pass to @a fn
+ * @param[in]  low_priority Whether the thread runs lowered as with
+ *                          @ref ethash_thread_lower_priority()
+ * @return                  true if the thread was started and false otherwise
+ */
+bool ethash_thread_create_priority(ethash_thread_t* thread, ethash_thread_fn fn, void* arg, bool low_priority);
+
+/**
+ * Wait for a thread started with @ref ethash_thread_create() to finish
+ */
+void ethash_thread_join(ethash_thread_t thread);
+
+/**
+ * Lower the scheduling priority of the calling thread to the lowest one
+ *
+ * Threads started with @ref ethash_thread_create() from a thread whose
+ * priority has been lowered start with a lowered priority as well.
+ */
+void ethash_thread_lower_priority(void);
+
+/**
+ * Restrict the calling thread to run on logical processor @a cpu only
+ *
+ * @param cpu     The index of the logical processor, below
+ *                @ref ethash_hardware_concurrency()
+ * @return        true if the thread was pinned and false if @a cpu is out of
+ *                range or pinning is not supported on this platform
+ */
+bool ethash_thread_pin(unsigned cpu);
+
+/**
+ * Restrict the calling thread to the logical processors of @a mask, bit n
+ * standing for processor n
+ *
+ * @return        true if the affinity was set and false if it is not
+ *                supported on this platform or none of the processors exists
+ */
+bool ethash_thread_set_affinity(uint64_t mask);
+
+/**
+ * Get the number of hardware threads of the host, or 1 if it can't be queried
+ */
+unsigned ethash_hardware_concurrency(void);
+
+/**
+ * Get a monotonic time in microseconds, for measuring durations
+ */
+uint64_t ethash_time_us(void);
+
+bool ethash_mutex_init(ethash_mutex_t* mutex);
+void ethash_mutex_destroy(ethash_mutex_t* mutex);
+void ethash_mutex_lock(ethash_mutex_t* mutex);
+void ethash_mutex_unlock(ethash_mutex_t* mutex);
+
+bool ethash_cond_init(ethash_cond_t* cond);
+void ethash_cond_destroy(ethash_cond_t* cond);
+/// Atomically unlock @a mutex and wait for @a cond to be signalled, then lock @a mutex again
+void ethash_cond_wait(ethash_cond_t* cond, ethash_mutex_t* mutex);
+/// Same as @ref ethash_cond_wait() for at most @a timeout_us microseconds, spurious wakeups included
+void ethash_cond_timed_wait(ethash_cond_t* cond, ethash_mutex_t* mutex, uint64_t timeout_us);
+void ethash_cond_broadcast(ethash_cond_t* cond);
+
+/**
+ * Run @a fn exactly once for a given @a once flag
+ *
+ * Callers racing with the first call block until @a fn has returned.
+ *
+ * @param once     A flag statically initialised with ETHASH_ONCE_INIT
+ * @param fn       The initialisation function
+ */
+void ethash_call_once(ethash_once_t* once, void (*fn)(void));
+
+// sequentially consistent atomic helpers for counters shared between threads
+#if defined(_MSC_VER)
+#include <intrin.h>
+static inline uint32_t ethash_atomic_fetch_add_u32(uint32_t volatile* ptr, uint32_t value)
+{
+	return (uint32_t)_InterlockedExchangeAdd((long volatile*)ptr, (long)value);
+}
+
+static inline uint64_t ethash_atomic_fetch_add_u64(uint64_t volatile* ptr, uint64_t value)
+{
+	return (uint64_t)_InterlockedExchangeAdd64((__int64 volatile*)ptr, (__int64)value);
+}
+
+static inline uint32_t ethash_atomic_load_u32(uint32_t volatile* ptr)
+{
+	return (uint32_t)_InterlockedOr((long volatile*)ptr, 0);
+}
+
+static inline void ethash_atomic_store_u32(uint32_t volatile* ptr, uint32_t value)
+{
+	_InterlockedExchange((long volatile*)ptr, (long)value);
+}
+
+static inline uint64_t ethash_atomic_load_u64(uint64_t volatile* ptr)
+{
+	return (uint64_t)_InterlockedCompareExchange64((__int64 volatile*)ptr, 0, 0);
+}
+
+static inline void ethash_atomic_store_u64(uint64_t volatile* ptr, uint64_t value)
+{
+	_InterlockedExchange64((__int64 volatile*)ptr, (__int64)value);
+}
+
+static inline bool ethash_atomic_compare_exchange_u64(uint64_t volatile* ptr, uint64_t* expected, uint64_t desired)
+{
+	uint64_t const old = (uint64_t)_InterlockedCompareExchange64((__int64 volatile*)ptr, (__int64)desired, (__int64)*expected);
+	if (old == *expected) {
+		return true;
+	}
+	*expected = old;
+	return false;
+}
+
+static inline void ethash_atomic_fence(void)
+{
+	MemoryBarrier();
+}
+#else
+static inline uint32_t ethash_atomic_fetch_add_u32(uint32_t volatile* ptr, uint32_t value)
+{
+	return __atomic_fetch_add(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+static inline uint64_t ethash_atomic_fetch_add_u64(uint64_t volatile* ptr, uint64_t value)
+{
+	return __atomic_fetch_add(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t ethash_atomic_load_u32(uint32_t volatile* ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+static inline void ethash_atomic_store_u32(uint32_t volatile* ptr, uint32_t value)
+{
+	__atomic_store_n(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+static inline uint64_t ethash_atomic_load_u64(uint64_t volatile* ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+static inline void ethash_atomic_store_u64(uint64_t volatile* ptr, uint64_t value)
+{
+	__atomic_store_n(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+/// Replace *@a ptr with @a desired if it equals *@a expected, else store what it holds into *@a expected
+static inline bool ethash_atomic_compare_exchange_u64(uint64_t volatile* ptr, uint64_t* expected, uint64_t desired)
+{
+	return __atomic_compare_exchange_n(ptr, expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+/// Keep plain loads and stores from moving across this point, in either direction
+static inline void ethash_atomic_fence(void)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
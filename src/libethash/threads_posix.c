@@ -0,0 +1,259 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file threads_posix.c
+ * @date 2018
+ */
+
+#include "threads.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+struct ethash_thread_start {
+	ethash_thread_fn fn;
+	void* arg;
+	bool low_priority;
+};
+
+// set by ethash_thread_lower_priority() and passed on to new threads
+static ETHASH_THREAD_LOCAL bool thread_low_priority = false;
+
+// A thread of normal priority the launcher starts for a lowered thread
+struct ethash_thread_request {
+	struct ethash_thread_start* start;
+	ethash_thread_t* thread;
+	bool done;                   ///< set by the launcher, protected by launcher_lock
+	bool started;
+	struct ethash_thread_request* next;
+};
+
+// The launcher is started by the first thread lowering its priority, before
+// it does. New threads inherit the nice value of Linux threads and raising it
+// needs privileges, so lowered threads have the launcher start their threads
+// of normal priority.
+static pthread_mutex_t launcher_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t launcher_cond = PTHREAD_COND_INITIALIZER;   ///< signalled for new and for started requests
+static bool launcher_running = false;
+static struct ethash_thread_request* launcher_requests = NULL;
+
+static void* ethash_thread_trampoline(void* arg)
+{
+	struct ethash_thread_start start = *(struct ethash_thread_start*)arg;
+	free(arg);
+	if (start.low_priority) {
+		ethash_thread_lower_priority();
+	}
+	start.fn(start.arg);
+	return NULL;
+}
+
+static void* ethash_thread_launcher(void* arg)
+{
+	(void)arg;
+	pthread_mutex_lock(&launcher_lock);
+	for (;;) {
+		struct ethash_thread_request* request = launcher_requests;
+		if (!request) {
+			pthread_cond_wait(&launcher_cond, &launcher_lock);
+			continue;
+		}
+		launcher_requests = request->next;
+		request->started = pthread_create(request->thread, NULL, ethash_thread_trampoline, request->start) == 0;
+		request->done = true;
+		pthread_cond_broadcast(&launcher_cond);
+	}
+	return NULL;
+}
+
+bool ethash_thread_create(ethash_thread_t* thread, ethash_thread_fn fn, void* arg)
+{
+	return ethash_thread_create_priority(thread, fn, arg, thread_low_priority);
+}
+
+bool ethash_thread_create_priority(ethash_thread_t* thread, ethash_thread_fn fn, void* arg, bool low_priority)
+{
+	struct ethash_thread_start* start = malloc(sizeof(*start));
+	if (!start) {
+		return false;
+	}
+	start->fn = fn;
+	start->arg = arg;
+	start->low_priority = low_priority;
+	if (thread_low_priority && !low_priority) {
+		struct ethash_thread_request request = { start, thread, false, false, NULL };
+		pthread_mutex_lock(&launcher_lock);
+		if (launcher_running) {
+			request.next = launcher_requests;
+			launcher_requests = &request;
+			pthread_cond_broadcast(&launcher_cond);
+			while (!request.done) {
+				pthread_cond_wait(&launcher_cond, &launcher_lock);
+			}
+		}
+		pthread_mutex_unlock(&launcher_lock);
+		if (request.done) {
+			if (!request.started) {
+				free(start);
+			}
+			return request.started;
+		}
+		// without a launcher the thread inherits the lowered priority
+	}
+	if (pthread_create(thread, NULL, ethash_thread_trampoline, start) != 0) {
+		free(start);
+		return false;
+	}
+	return true;
+}
+
+void ethash_thread_join(ethash_thread_t thread)
+{
+	pthread_join(thread, NULL);
+}
+
+void ethash_thread_lower_priority(void)
+{
+	if (!thread_low_priority) {
+		pthread_mutex_lock(&launcher_lock);
+		pthread_t launcher;
+		if (!launcher_running && pthread_create(&launcher, NULL, ethash_thread_launcher, NULL) == 0) {
+			pthread_detach(launcher);
+			launcher_running = true;
+		}
+		pthread_mutex_unlock(&launcher_lock);
+	}
+	thread_low_priority = true;
+#if defined(__linux__)
+	// Linux keeps a nice value per thread, addressed by the thread id
+	setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+#else
+	struct sched_param param;
+	int policy;
+	if (pthread_getschedparam(pthread_self(), &policy, &param) == 0) {
+		param.sched_priority = sched_get_priority_min(policy);
+		pthread_setschedparam(pthread_self(), policy, &param);
+	}
+#endif
+}
+
+bool ethash_thread_pin(unsigned cpu)
+{
+#if defined(__linux__)
+	// the raw system call spares pulling cpu_set_t in via _GNU_SOURCE
+	unsigned long mask[1024 / (8 * sizeof(unsigned long))] = {0};
+	unsigned const bits = 8 * sizeof(unsigned long);
+	if (cpu >= sizeof(mask) * 8) {
+		return false;
+	}
+	mask[cpu / bits] = 1UL << (cpu % bits);
+	return syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask) == 0;
+#else
+	(void)cpu;
+	return false;
+#endif
+}
+
+bool ethash_thread_set_affinity(uint64_t mask)
+{
+#if defined(__linux__)
+	unsigned long bits[64 / (8 * sizeof(unsigned long))];
+	for (unsigned i = 0; i != sizeof(bits) / sizeof(bits[0]); ++i) {
+		bits[i] = (unsigned long)(mask >> (i * 8 * sizeof(unsigned long)));
+	}
+	return syscall(SYS_sched_setaffinity, 0, sizeof(bits), bits) == 0;
+#else
+	(void)mask;
+	return false;
+#endif
+}
+
+unsigned ethash_hardware_concurrency(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (unsigned)n : 1;
+}
+
+uint64_t ethash_time_us(void)
+{
+	struct timespec ts;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+		return 0;
+	}
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+bool ethash_mutex_init(ethash_mutex_t* mutex)
+{
+	return pthread_mutex_init(mutex, NULL) == 0;
+}
+
+void ethash_mutex_destroy(ethash_mutex_t* mutex)
+{
+	pthread_mutex_destroy(mutex);
+}
+
+void ethash_mutex_lock(ethash_mutex_t* mutex)
+{
+	pthread_mutex_lock(mutex);
+}
+
+void ethash_mutex_unlock(ethash_mutex_t* mutex)
+{
+	pthread_mutex_unlock(mutex);
+}
+
+bool ethash_cond_init(ethash_cond_t* cond)
+{
+	return pthread_cond_init(cond, NULL) == 0;
+}
+
+void ethash_cond_destroy(ethash_cond_t* cond)
+{
+	pthread_cond_destroy(cond);
+}
+
+void ethash_cond_wait(ethash_cond_t* cond, ethash_mutex_t* mutex)
+{
+	pthread_cond_wait(cond, mutex);
+}
+
+void ethash_cond_timed_wait(ethash_cond_t* cond, ethash_mutex_t* mutex, uint64_t timeout_us)
+{
+	// condition variables wait on the realtime clock by default
+	struct timespec ts;
+	if (clock_gettime(CLOCK_REALTIME, &ts) != 0) {
+		return;
+	}
+	uint64_t const nsec = (uint64_t)ts.tv_nsec + (timeout_us % 1000000) * 1000;
+	ts.tv_sec += (time_t)(timeout_us / 1000000 + nsec / 1000000000);
+	ts.tv_nsec = (long)(nsec % 1000000000);
+	pthread_cond_timedwait(cond, mutex, &ts);
+}
+
+void ethash_cond_broadcast(ethash_cond_t* cond)
+{
+	pthread_cond_broadcast(cond);
+}
+
+void ethash_call_once(ethash_once_t* once, void (*fn)(void))
+{
+	pthread_once(once, fn);
+}
@@ -0,0 +1,170 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file threads_win32.c
+ * @date 2018
+ */
+
+#include "threads.h"
+#include <stdlib.h>
+
+struct ethash_thread_start {
+	ethash_thread_fn fn;
+	void* arg;
+	bool low_priority;
+};
+
+// set by ethash_thread_lower_priority() and passed on to new threads
+static ETHASH_THREAD_LOCAL bool thread_low_priority = false;
+
+static DWORD WINAPI ethash_thread_trampoline(LPVOID arg)
+{
+	struct ethash_thread_start start = *(struct ethash_thread_start*)arg;
+	free(arg);
+	if (start.low_priority) {
+		ethash_thread_lower_priority();
+	}
+	start.fn(start.arg);
+	return 0;
+}
+
+bool ethash_thread_create(ethash_thread_t* thread, ethash_thread_fn fn, void* arg)
+{
+	return ethash_thread_create_priority(thread, fn, arg, thread_low_priority);
+}
+
+// new threads start at normal priority on Windows, whatever the priority of the caller
+bool ethash_thread_create_priority(ethash_thread_t* thread, ethash_thread_fn fn, void* arg, bool low_priority)
+{
+	struct ethash_thread_start* start = malloc(sizeof(*start));
+	if (!start) {
+		return false;
+	}
+	start->fn = fn;
+	start->arg = arg;
+	start->low_priority = low_priority;
+	*thread = CreateThread(NULL, 0, ethash_thread_trampoline, start, 0, NULL);
+	if (*thread == NULL) {
+		free(start);
+		return false;
+	}
+	return true;
+}
+
+void ethash_thread_join(ethash_thread_t thread)
+{
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+
+void ethash_thread_lower_priority(void)
+{
+	thread_low_priority = true;
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+}
+
+bool ethash_thread_pin(unsigned cpu)
+{
+	if (cpu >= sizeof(DWORD_PTR) * 8) {
+		return false;
+	}
+	return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+}
+
+bool ethash_thread_set_affinity(uint64_t mask)
+{
+	return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)mask) != 0;
+}
+
+unsigned ethash_hardware_concurrency(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (unsigned)info.dwNumberOfProcessors : 1;
+}
+
+uint64_t ethash_time_us(void)
+{
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 +
+		(uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / (uint64_t)frequency.QuadPart;
+}
+
+bool ethash_mutex_init(ethash_mutex_t* mutex)
+{
+	InitializeCriticalSection(mutex);
+	return true;
+}
+
+void ethash_mutex_destroy(ethash_mutex_t* mutex)
+{
+	DeleteCriticalSection(mutex);
+}
+
+void ethash_mutex_lock(ethash_mutex_t* mutex)
+{
+	EnterCriticalSection(mutex);
+}
+
+void ethash_mutex_unlock(ethash_mutex_t* mutex)
+{
+	LeaveCriticalSection(mutex);
+}
+
+bool ethash_cond_init(ethash_cond_t* cond)
+{
+	InitializeConditionVariable(cond);
+	return true;
+}
+
+void ethash_cond_destroy(ethash_cond_t* cond)
+{
+	// condition variables hold no resources on Windows
+	(void)cond;
+}
+
+void ethash_cond_wait(ethash_cond_t* cond, ethash_mutex_t* mutex)
+{
+	SleepConditionVariableCS(cond, mutex, INFINITE);
+}
+
+void ethash_cond_timed_wait(ethash_cond_t* cond, ethash_mutex_t* mutex, uint64_t timeout_us)
+{
+	// rounded up, so that a wait is never cut to no wait at all
+	uint64_t const ms = (timeout_us + 999) / 1000;
+	SleepConditionVariableCS(cond, mutex, ms >= INFINITE ? INFINITE - 1 : (DWORD)ms);
+}
+
+void ethash_cond_broadcast(ethash_cond_t* cond)
+{
+	WakeAllConditionVariable(cond);
+}
+
+static BOOL CALLBACK ethash_once_trampoline(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	(void)once;
+	(void)context;
+	((void (*)(void))param)();
+	return TRUE;
+}
+
+void ethash_call_once(ethash_once_t* once, void (*fn)(void))
+{
+	InitOnceExecuteOnce(once, ethash_once_trampoline, (PVOID)fn, NULL);
+}
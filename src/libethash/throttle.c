@@ -0,0 +1,148 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file throttle.c
+ * @date 2018
+ *
+ * Duty cycles of hashing threads. A thread hashes for a burst of about
+ * ETHASH_THROTTLE_BURST_US, then pauses for the longest of what its
+ * utilization and its share of the hash rate budget leave of the burst, on a
+ * condition variable so that new work ends the pause.
+ */
+
+#include "throttle.h"
+
+bool ethash_throttler_init(struct ethash_throttler* throttler, unsigned num_threads)
+{
+	if (!ethash_mutex_init(&throttler->lock)) {
+		return false;
+	}
+	if (!ethash_cond_init(&throttler->wake)) {
+		ethash_mutex_destroy(&throttler->lock);
+		return false;
+	}
+	throttler->enabled = 0;
+	throttler->interrupts = 0;
+	throttler->num_threads = num_threads;
+	return true;
+}
+
+void ethash_throttler_destroy(struct ethash_throttler* throttler)
+{
+	ethash_cond_destroy(&throttler->wake);
+	ethash_mutex_destroy(&throttler->lock);
+}
+
+void ethash_throttler_set(struct ethash_throttler* throttler, ethash_throttle_t const* throttle)
+{
+	ethash_mutex_lock(&throttler->lock);
+	bool const enabled = throttle && (
+		(throttle->utilization != 0 && throttle->utilization < 100) ||
+		throttle->max_hash_rate != 0 ||
+		throttle->utilization_fn
+	);
+	if (enabled) {
+		throttler->settings = *throttle;
+	}
+	ethash_atomic_store_u32(&throttler->enabled, enabled);
+	// pauses of the old limits don't outlast them
+	ethash_atomic_fetch_add_u32(&throttler->interrupts, 1);
+	ethash_cond_broadcast(&throttler->wake);
+	ethash_mutex_unlock(&throttler->lock);
+}
+
+void ethash_throttler_interrupt(struct ethash_throttler* throttler)
+{
+	ethash_mutex_lock(&throttler->lock);
+	ethash_atomic_fetch_add_u32(&throttler->interrupts, 1);
+	ethash_cond_broadcast(&throttler->wake);
+	ethash_mutex_unlock(&throttler->lock);
+}
+
+uint64_t ethash_throttle_batch(
+	struct ethash_throttler* throttler,
+	struct ethash_throttle_burst const* burst,
+	uint64_t max
+)
+{
+	if (!ethash_atomic_load_u32(&throttler->enabled) || !burst->start_us || !burst->ns_per_hash) {
+		return max;
+	}
+	uint64_t const busy_us = ethash_time_us() - burst->start_us;
+	if (busy_us >= ETHASH_THROTTLE_BURST_US) {
+		return 1;
+	}
+	uint64_t const left = (ETHASH_THROTTLE_BURST_US - busy_us) * 1000 / burst->ns_per_hash;
+	return left == 0 ? 1 : left < max ? left : max;
+}
+
+void ethash_throttle_account(
+	struct ethash_throttler* throttler,
+	struct ethash_throttle_burst* burst,
+	uint64_t hashes
+)
+{
+	if (!ethash_atomic_load_u32(&throttler->enabled)) {
+		burst->start_us = 0;
+		return;
+	}
+	uint64_t const now = ethash_time_us();
+	if (!burst->start_us) {
+		burst->start_us = now;
+		burst->hashes = 0;
+		return;
+	}
+	burst->hashes += hashes;
+	uint64_t const busy_us = now - burst->start_us;
+	if (busy_us < ETHASH_THROTTLE_BURST_US) {
+		return;
+	}
+	if (burst->hashes) {
+		burst->ns_per_hash = busy_us * 1000 / burst->hashes;
+	}
+
+	ethash_mutex_lock(&throttler->lock);
+	ethash_throttle_t const settings = throttler->settings;
+	uint32_t const interrupts = throttler->interrupts;
+	ethash_mutex_unlock(&throttler->lock);
+	unsigned utilization = settings.utilization_fn ? settings.utilization_fn(settings.user) : settings.utilization;
+	if (utilization == 0 || utilization > 100) {
+		utilization = 100;
+	}
+	// the burst is utilization percent of itself and the pause together
+	uint64_t pause_us = busy_us * (100 - utilization) / utilization;
+	if (settings.max_hash_rate) {
+		// the time the share of the budget of this thread allows the burst
+		uint64_t const allowed_us = burst->hashes * 1000000 * throttler->num_threads / settings.max_hash_rate;
+		if (allowed_us > busy_us && allowed_us - busy_us > pause_us) {
+			pause_us = allowed_us - busy_us;
+		}
+	}
+	if (pause_us) {
+		uint64_t const deadline = now + pause_us;
+		ethash_mutex_lock(&throttler->lock);
+		for (;;) {
+			uint64_t const time = ethash_time_us();
+			if (throttler->interrupts != interrupts || time >= deadline) {
+				break;
+			}
+			ethash_cond_timed_wait(&throttler->wake, &throttler->lock, deadline - time);
+		}
+		ethash_mutex_unlock(&throttler->lock);
+	}
+	burst->start_us = ethash_time_us();
+	burst->hashes = 0;
+}
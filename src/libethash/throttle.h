@@ -0,0 +1,88 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file throttle.h
+ * @date 2018
+ *
+ * The duty cycle of the hashing threads of searches and miners, see
+ * @ref ethash_throttle_t. The implementation lives in throttle.c
+ */
+#pragma once
+#include "ethash.h"
+#include "threads.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// How long a throttled thread hashes before it considers pausing
+#define ETHASH_THROTTLE_BURST_US 5000
+
+struct ethash_throttler {
+	ethash_mutex_t lock;
+	ethash_cond_t wake;          ///< signalled by ethash_throttler_interrupt()
+	ethash_throttle_t settings;  ///< protected by lock
+	uint32_t volatile enabled;
+	uint32_t volatile interrupts;
+	unsigned num_threads;
+};
+
+/// The burst of one thread, owned by that thread
+struct ethash_throttle_burst {
+	uint64_t start_us;           ///< 0 before the first batch of a burst
+	uint64_t hashes;
+	uint64_t ns_per_hash;        ///< measured over the last burst, 0 before any
+};
+
+bool ethash_throttler_init(struct ethash_throttler* throttler, unsigned num_threads);
+void ethash_throttler_destroy(struct ethash_throttler* throttler);
+
+/**
+ * Replace the limits of @a throttler, NULL to lift them
+ */
+void ethash_throttler_set(struct ethash_throttler* throttler, ethash_throttle_t const* throttle);
+
+/**
+ * Cut the pauses going on short, for new work or stopping
+ */
+void ethash_throttler_interrupt(struct ethash_throttler* throttler);
+
+/**
+ * Get the number of nonces the thread of @a burst should hash next, up to
+ * @a max, so that its burst ends about on time
+ */
+uint64_t ethash_throttle_batch(
+	struct ethash_throttler* throttler,
+	struct ethash_throttle_burst const* burst,
+	uint64_t max
+);
+
+/**
+ * Count @a hashes towards the burst of the calling thread, and pause it if
+ * the burst is over and the limits ask for it
+ *
+ * Cheap when there are no limits. Returns early once
+ * @ref ethash_throttler_interrupt() is called.
+ */
+void ethash_throttle_account(
+	struct ethash_throttler* throttler,
+	struct ethash_throttle_burst* burst,
+	uint64_t hashes
+);
+
+#ifdef __cplusplus
+}
+#endif
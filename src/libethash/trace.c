@@ -0,0 +1,87 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file trace.c
+ * @date 2018
+ */
+
+#include "trace.h"
+#include "threads.h"
+
+static ethash_once_t trace_once = ETHASH_ONCE_INIT;
+static ethash_mutex_t trace_lock;
+// protected by trace_lock, trace_enabled tells whether callback is set
+static ethash_event_callback_t trace_callback = NULL;
+static void* trace_user = NULL;
+static uint32_t volatile trace_enabled = 0;
+
+static void ethash_trace_init(void)
+{
+	ethash_mutex_init(&trace_lock);
+}
+
+void ethash_set_event_callback(ethash_event_callback_t callback, void* user)
+{
+	ethash_call_once(&trace_once, ethash_trace_init);
+	ethash_mutex_lock(&trace_lock);
+	trace_callback = callback;
+	trace_user = user;
+	ethash_atomic_store_u32(&trace_enabled, callback ? 1 : 0);
+	ethash_mutex_unlock(&trace_lock);
+}
+
+void ethash_trace(
+	enum ethash_event_type type,
+	uint64_t epoch,
+	uint64_t size,
+	uint64_t duration_us,
+	enum ethash_dag_file dag_file
+)
+{
+	if (!ethash_atomic_load_u32(&trace_enabled)) {
+		return;
+	}
+	ethash_event_t const event = { type, ethash_time_us(), epoch, size, duration_us, dag_file };
+	ethash_mutex_lock(&trace_lock);
+	ethash_event_callback_t const callback = trace_callback;
+	void* const user = trace_user;
+	ethash_mutex_unlock(&trace_lock);
+	// outside of the lock so that the callback may set another one
+	if (callback) {
+		callback(&event, user);
+	}
+}
+
+char const* ethash_event_type_name(enum ethash_event_type type)
+{
+	switch (type) {
+	case ETHASH_EVENT_CACHE_BUILD_START:
+		return "cache_build_start";
+	case ETHASH_EVENT_CACHE_BUILD_END:
+		return "cache_build_end";
+	case ETHASH_EVENT_DAG_FILE_CHECKED:
+		return "dag_file_checked";
+	case ETHASH_EVENT_DAG_MAPPED:
+		return "dag_mapped";
+	case ETHASH_EVENT_DAG_MAGIC_WRITTEN:
+		return "dag_magic_written";
+	case ETHASH_EVENT_DAG_DELETED:
+		return "dag_deleted";
+	case ETHASH_EVENT_DAG_FILE_REMOVED:
+		return "dag_file_removed";
+	}
+	return "unknown";
+}
@@ -0,0 +1,42 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file trace.h
+ * @date 2018
+ *
+ * Delivery of the events of ethash_set_event_callback()
+ */
+#pragma once
+#include "ethash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Give an event stamped with the current time to the event callback, if any
+ */
+void ethash_trace(
+	enum ethash_event_type type,
+	uint64_t epoch,
+	uint64_t size,
+	uint64_t duration_us,
+	enum ethash_dag_file dag_file
+);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,10 +1,14 @@
+#define PY_SSIZE_T_CLEAN
 #include <Python.h>
 #include <alloca.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include "../libethash/ethash.h"
 #include "../libethash/internal.h"
+#include "../libethash/io.h"
+#include "../libethash/threads.h"
 
 #if PY_MAJOR_VERSION >= 3
 #define PY_STRING_FORMAT "y#"
@@ -14,57 +18,134 @@
 #define PY_CONST_STRING_FORMAT "s"
 #endif
 
-#define MIX_WORDS (ETHASH_MIX_BYTES/4)
+// caches of the previous, current and next epoch survive between calls
+static ethash_light_registry_t light_registry;
 
-static PyObject *
-mkcache_bytes(PyObject *self, PyObject *args) {
-    unsigned long block_number;
-    unsigned long cache_size;
+static bool
+parse_hash(PyObject *obj, ethash_h256_t *out, char const *what) {
+    Py_buffer view;
+    if (PyObject_GetBuffer(obj, &view, PyBUF_SIMPLE) < 0)
+        return false;
+    bool const ok = view.len == 32;
+    if (ok)
+        memcpy(out, view.buf, 32);
+    else
+        PyErr_Format(PyExc_ValueError, "%s must be 32 bytes long (was %zd)", what, view.len);
+    PyBuffer_Release(&view);
+    return ok;
+}
 
-    if (!PyArg_ParseTuple(args, "k", &block_number))
-        return 0;
+// parses a sequence of count hashes, or a single hash repeated count times
+static ethash_h256_t *
+parse_hashes(PyObject *obj, Py_ssize_t count, char const *what) {
+    ethash_h256_t *hashes;
+    if (PyObject_CheckBuffer(obj)) {
+        hashes = PyMem_Malloc((count ? count : 1) * sizeof(*hashes));
+        if (!hashes)
+            return (ethash_h256_t *) PyErr_NoMemory();
+        if (!parse_hash(obj, &hashes[0], what)) {
+            PyMem_Free(hashes);
+            return NULL;
+        }
+        for (Py_ssize_t i = 1; i < count; i++)
+            hashes[i] = hashes[0];
+        return hashes;
+    }
+    PyObject *seq = PySequence_Fast(obj, "expected a sequence of 32 byte strings");
+    if (!seq)
+        return NULL;
+    Py_ssize_t const n = PySequence_Fast_GET_SIZE(seq);
+    if (n != count) {
+        PyErr_Format(PyExc_ValueError, "expected %zd %ss (got %zd)", count, what, n);
+        Py_DECREF(seq);
+        return NULL;
+    }
+    hashes = PyMem_Malloc((n ? n : 1) * sizeof(*hashes));
+    if (!hashes) {
+        Py_DECREF(seq);
+        return (ethash_h256_t *) PyErr_NoMemory();
+    }
+    for (Py_ssize_t i = 0; i < n; i++) {
+        if (!parse_hash(PySequence_Fast_GET_ITEM(seq, i), &hashes[i], what)) {
+            PyMem_Free(hashes);
+            Py_DECREF(seq);
+            return NULL;
+        }
+    }
+    Py_DECREF(seq);
+    return hashes;
+}
 
-    ethash_light_t L = ethash_light_new(block_number);
-    PyObject * val = Py_BuildValue(PY_STRING_FORMAT, L->cache, L->cache_size);
-    free(L->cache);
-    return val;
+static uint64_t *
+parse_nonces(PyObject *obj, Py_ssize_t *count) {
+    PyObject *seq = PySequence_Fast(obj, "expected a sequence of nonces");
+    if (!seq)
+        return NULL;
+    Py_ssize_t const n = PySequence_Fast_GET_SIZE(seq);
+    uint64_t *nonces = PyMem_Malloc((n ? n : 1) * sizeof(*nonces));
+    if (!nonces) {
+        Py_DECREF(seq);
+        return (uint64_t *) PyErr_NoMemory();
+    }
+    for (Py_ssize_t i = 0; i < n; i++) {
+        nonces[i] = PyLong_AsUnsignedLongLong(PySequence_Fast_GET_ITEM(seq, i));
+        if (nonces[i] == (uint64_t) -1 && PyErr_Occurred()) {
+            PyMem_Free(nonces);
+            Py_DECREF(seq);
+            return NULL;
+        }
+    }
+    Py_DECREF(seq);
+    *count = n;
+    return nonces;
 }
 
-/*
 static PyObject *
-calc_dataset_bytes(PyObject *self, PyObject *args) {
-    char *cache_bytes;
-    unsigned long full_size;
-    int cache_size;
+build_result(ethash_return_value_t const *out) {
+    return Py_BuildValue("{" PY_CONST_STRING_FORMAT ":" PY_STRING_FORMAT "," PY_CONST_STRING_FORMAT ":" PY_STRING_FORMAT "}",
+                         "mix digest", (char const *) &out->mix_hash, (Py_ssize_t) 32,
+                         "result", (char const *) &out->result, (Py_ssize_t) 32);
+}
 
-    if (!PyArg_ParseTuple(args, "k" PY_STRING_FORMAT, &full_size, &cache_bytes, &cache_size))
-        return 0;
+static PyObject *
+build_results(ethash_return_value_t const *out, Py_ssize_t count) {
+    PyObject *list = PyList_New(count);
+    for (Py_ssize_t i = 0; list && i < count; i++) {
+        if (!out[i].success) {
+            Py_DECREF(list);
+            PyErr_SetString(PyExc_ValueError, "Invalid DAG size");
+            return 0;
+        }
+        PyObject *item = build_result(&out[i]);
+        if (!item) {
+            Py_DECREF(list);
+            return 0;
+        }
+        PyList_SET_ITEM(list, i, item);
+    }
+    return list;
+}
 
-    if (full_size % MIX_WORDS != 0) {
-        char error_message[1024];
-        sprintf(error_message, "The size of data set must be a multiple of %i bytes (was %lu)", MIX_WORDS, full_size);
-        PyErr_SetString(PyExc_ValueError, error_message);
+static PyObject *
+mkcache_bytes(PyObject *self, PyObject *args) {
+    unsigned long block_number;
+
+    if (!PyArg_ParseTuple(args, "k", &block_number))
         return 0;
-    }
 
-    if (cache_size % ETHASH_HASH_BYTES != 0) {
-        char error_message[1024];
-        sprintf(error_message, "The size of the cache must be a multiple of %i bytes (was %i)", ETHASH_HASH_BYTES, cache_size);
-        PyErr_SetString(PyExc_ValueError, error_message);
+    if (!light_registry)
+        light_registry = ethash_light_registry_new(3);
+    if (!light_registry)
+        return PyErr_NoMemory();
+    ethash_light_t L = ethash_light_registry_acquire(light_registry, block_number);
+    if (!L) {
+        PyErr_SetString(PyExc_ValueError, "Could not create the cache for this block number");
         return 0;
     }
-
-    ethash_params params;
-    params.cache_size = (size_t) cache_size;
-    params.full_size = (size_t) full_size;
-    ethash_cache cache;
-    cache.mem = (void *) cache_bytes;
-    void *mem = malloc(params.full_size);
-    ethash_compute_full_data(mem, &params, &cache);
-    PyObject * val = Py_BuildValue(PY_STRING_FORMAT, (char *) mem, full_size);
-    free(mem);
+    PyObject * val = Py_BuildValue(PY_STRING_FORMAT, L->cache, (Py_ssize_t) L->cache_size);
+    ethash_light_registry_release(light_registry, L);
     return val;
-}*/
+}
 
 // hashimoto_light(full_size, cache, header, nonce)
 static PyObject *
@@ -73,130 +154,634 @@ hashimoto_light(PyObject *self, PyObject *args) {
     char *header;
     unsigned long block_number;
     unsigned long long nonce;
-    int cache_size, header_size;
+    Py_ssize_t cache_size, header_size;
     if (!PyArg_ParseTuple(args, "k" PY_STRING_FORMAT PY_STRING_FORMAT "K", &block_number, &cache_bytes, &cache_size, &header, &header_size, &nonce))
         return 0;
     if (header_size != 32) {
         char error_message[1024];
-        sprintf(error_message, "Seed must be 32 bytes long (was %i)", header_size);
+        sprintf(error_message, "Seed must be 32 bytes long (was %zd)", header_size);
         PyErr_SetString(PyExc_ValueError, error_message);
         return 0;
     }
-    struct ethash_light *s;
-    s = calloc(sizeof(*s), 1);
-    s->cache = cache_bytes;
-    s->cache_size = cache_size;
-    s->block_number = block_number;
-    struct ethash_h256 *h;
-    h = calloc(sizeof(*h), 1);
-    for (int i = 0; i < 32; i++) h->b[i] = header[i];
-    struct ethash_return_value out = ethash_light_compute(s, *h, nonce);
-    return Py_BuildValue("{" PY_CONST_STRING_FORMAT ":" PY_STRING_FORMAT "," PY_CONST_STRING_FORMAT ":" PY_STRING_FORMAT "}",
-                         "mix digest", &out.mix_hash, 32,
-                         "result", &out.result, 32);
+    struct ethash_light s = { 0 };
+    s.cache = cache_bytes;
+    s.cache_size = cache_size;
+    s.num_parent_nodes = ethash_fastmod_init((uint32_t) (cache_size / ETHASH_HASH_BYTES));
+    s.block_number = block_number;
+    ethash_h256_t h;
+    memcpy(&h, header, 32);
+    struct ethash_return_value out;
+    Py_BEGIN_ALLOW_THREADS
+    out = ethash_light_compute(&s, h, nonce);
+    Py_END_ALLOW_THREADS
+    return build_result(&out);
 }
-/*
-// hashimoto_full(dataset, header, nonce)
+//get_seedhash(block_number)
+// quick_check(header, nonce, mix_digest, boundary) and its ProgPoW twin
 static PyObject *
-hashimoto_full(PyObject *self, PyObject *args) {
-    char *full_bytes;
-    char *header;
+quick_check_with(PyObject *args, bool (*check)(ethash_h256_t const*, uint64_t const, ethash_h256_t const*, ethash_h256_t const*)) {
+    char *header, *mix_digest, *boundary;
     unsigned long long nonce;
-    int full_size, header_size;
+    Py_ssize_t header_size, mix_digest_size, boundary_size;
+    if (!PyArg_ParseTuple(args, PY_STRING_FORMAT "K" PY_STRING_FORMAT PY_STRING_FORMAT, &header, &header_size, &nonce, &mix_digest, &mix_digest_size, &boundary, &boundary_size))
+        return 0;
+    if (header_size != 32 || mix_digest_size != 32 || boundary_size != 32) {
+        PyErr_SetString(PyExc_ValueError, "Header, mix digest and boundary must be 32 bytes long");
+        return 0;
+    }
+    ethash_h256_t h, m, b;
+    memcpy(&h, header, 32);
+    memcpy(&m, mix_digest, 32);
+    memcpy(&b, boundary, 32);
+    return PyBool_FromLong(check(&h, nonce, &m, &b));
+}
+
+static PyObject *
+quick_check(PyObject *self, PyObject *args) {
+    return quick_check_with(args, ethash_quick_check_difficulty);
+}
 
-    if (!PyArg_ParseTuple(args, PY_STRING_FORMAT PY_STRING_FORMAT "K", &full_bytes, &full_size, &header, &header_size, &nonce))
+static PyObject *
+progpow_quick_check(PyObject *self, PyObject *args) {
+    return quick_check_with(args, progpow_quick_check_difficulty);
+}
+
+// boundary(difficulty)
+static PyObject *
+boundary(PyObject *self, PyObject *args) {
+    char *difficulty;
+    Py_ssize_t difficulty_size;
+    if (!PyArg_ParseTuple(args, PY_STRING_FORMAT, &difficulty, &difficulty_size))
         return 0;
+    if (difficulty_size != 32) {
+        PyErr_SetString(PyExc_ValueError, "Difficulty must be 32 bytes long");
+        return 0;
+    }
+    ethash_h256_t d, b;
+    memcpy(&d, difficulty, 32);
+    if (!ethash_boundary_from_difficulty(&b, &d)) {
+        PyErr_SetString(PyExc_ValueError, "Difficulty must not be 0");
+        return 0;
+    }
+    return Py_BuildValue(PY_STRING_FORMAT, (char *) &b, (Py_ssize_t) 32);
+}
 
-    if (full_size % MIX_WORDS != 0) {
+static PyObject *
+get_seedhash(PyObject *self, PyObject *args) {
+    unsigned long block_number;
+    if (!PyArg_ParseTuple(args, "k", &block_number))
+        return 0;
+    if (block_number >= ETHASH_EPOCH_LENGTH * ETHASH_MAX_EPOCHS) {
         char error_message[1024];
-        sprintf(error_message, "The size of data set must be a multiple of %i bytes (was %i)", MIX_WORDS, full_size);
+        sprintf(error_message, "Block number must be less than %u (was %lu)", ETHASH_EPOCH_LENGTH * ETHASH_MAX_EPOCHS, block_number);
+
         PyErr_SetString(PyExc_ValueError, error_message);
         return 0;
     }
+    ethash_h256_t seedhash = ethash_get_seedhash(block_number);
+    return Py_BuildValue(PY_STRING_FORMAT, (char *) &seedhash, (Py_ssize_t) 32);
+}
 
-    if (header_size != 32) {
-        char error_message[1024];
-        sprintf(error_message, "Header must be 32 bytes long (was %i)", header_size);
-        PyErr_SetString(PyExc_ValueError, error_message);
+// the callable of set_event_callback(), NULL if none
+static PyObject *event_callback;
+
+static void
+forward_event(ethash_event_t const *event, void *user) {
+    static char const *const dag_files[] = { "none", "match", "mismatch", "size_mismatch" };
+    PyGILState_STATE const state = PyGILState_Ensure();
+    PyObject *callback = event_callback;
+    if (callback) {
+        Py_INCREF(callback);
+        PyObject *epoch = event->epoch == ETHASH_EVENT_NO_EPOCH ? (Py_INCREF(Py_None), Py_None) : PyLong_FromUnsignedLongLong(event->epoch);
+        PyObject *result = epoch ? PyObject_CallFunction(callback, "{s:s,s:K,s:N,s:K,s:K,s:s}",
+                "type", ethash_event_type_name(event->type),
+                "time_us", (unsigned long long) event->time_us,
+                "epoch", epoch,
+                "size", (unsigned long long) event->size,
+                "duration_us", (unsigned long long) event->duration_us,
+                "dag_file", dag_files[event->dag_file]) : NULL;
+        if (result)
+            Py_DECREF(result);
+        else
+            PyErr_WriteUnraisable(callback);
+        Py_DECREF(callback);
+    }
+    PyGILState_Release(state);
+}
+
+static PyObject *
+set_event_callback(PyObject *self, PyObject *args) {
+    PyObject *callback;
+    if (!PyArg_ParseTuple(args, "O", &callback))
+        return 0;
+    if (callback != Py_None && !PyCallable_Check(callback)) {
+        PyErr_SetString(PyExc_TypeError, "The event callback must be callable or None");
+        return 0;
+    }
+    PyObject *previous = event_callback;
+    if (callback == Py_None) {
+        event_callback = NULL;
+        ethash_set_event_callback(NULL, NULL);
+    } else {
+        Py_INCREF(callback);
+        event_callback = callback;
+        ethash_set_event_callback(forward_event, NULL);
+    }
+    Py_XDECREF(previous);
+    Py_RETURN_NONE;
+}
+
+// Light and Full objects keep their cache or DAG between calls, release the
+// GIL while hashing and expose their memory through the buffer protocol
+
+#if PY_MAJOR_VERSION >= 3
+#define BUFFER_TPFLAGS 0
+#else
+#define BUFFER_TPFLAGS Py_TPFLAGS_HAVE_NEWBUFFER
+#endif
+
+// the object memory_info() of Light and Full return
+static PyObject *
+memory_info_object(ethash_memory_info_t const *info, bool exact) {
+    unsigned nodes = 1;
+    for (unsigned n = 1; n != ETHASH_MEMORY_INFO_NODES; n++)
+        if (info->node_resident[n])
+            nodes = n + 1;
+    PyObject *node_resident = PyList_New(nodes);
+    if (!node_resident)
+        return 0;
+    for (unsigned n = 0; n != nodes; n++)
+        PyList_SET_ITEM(node_resident, n, PyLong_FromUnsignedLongLong(info->node_resident[n]));
+    return Py_BuildValue("{" PY_CONST_STRING_FORMAT ":K, " PY_CONST_STRING_FORMAT ":K, " PY_CONST_STRING_FORMAT ":K, "
+            PY_CONST_STRING_FORMAT ":O, " PY_CONST_STRING_FORMAT ":K, " PY_CONST_STRING_FORMAT ":N, "
+            PY_CONST_STRING_FORMAT ":O}",
+            "allocated", (unsigned long long) info->allocated,
+            "resident", (unsigned long long) info->resident,
+            "huge pages", (unsigned long long) info->huge_pages,
+            "file backed", info->file_backed ? Py_True : Py_False,
+            "locked", (unsigned long long) info->locked,
+            "node resident", node_resident,
+            "exact", exact ? Py_True : Py_False);
+}
+
+typedef struct {
+    PyObject_HEAD
+    ethash_light_t light;
+} LightObject;
+
+static PyObject *
+Light_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    unsigned long block_number;
+    if (!PyArg_ParseTuple(args, "k", &block_number))
+        return 0;
+    if (!light_registry)
+        light_registry = ethash_light_registry_new(3);
+    if (!light_registry)
+        return PyErr_NoMemory();
+    LightObject *self = (LightObject *) type->tp_alloc(type, 0);
+    if (!self)
+        return 0;
+    Py_BEGIN_ALLOW_THREADS
+    self->light = ethash_light_registry_acquire(light_registry, block_number);
+    Py_END_ALLOW_THREADS
+    if (!self->light) {
+        Py_DECREF(self);
+        PyErr_SetString(PyExc_ValueError, "Could not create the cache for this block number");
         return 0;
     }
+    return (PyObject *) self;
+}
 
+static void
+Light_dealloc(LightObject *self) {
+    if (self->light)
+        ethash_light_registry_release(light_registry, self->light);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
 
-    ethash_return_value out;
-    ethash_params params;
-    params.full_size = (size_t) full_size;
-    ethash_full(&out, (void *) full_bytes, &params, (ethash_h256_t *) header, nonce);
-    return Py_BuildValue("{" PY_CONST_STRING_FORMAT ":" PY_STRING_FORMAT ", " PY_CONST_STRING_FORMAT ":" PY_STRING_FORMAT "}",
-                         "mix digest", &out.mix_hash, 32,
-                         "result", &out.result, 32);
+static int
+Light_getbuffer(LightObject *self, Py_buffer *view, int flags) {
+    return PyBuffer_FillInfo(view, (PyObject *) self, self->light->cache, (Py_ssize_t) self->light->cache_size, 1, flags);
 }
 
-// mine(dataset_bytes, header, difficulty_bytes)
 static PyObject *
-mine(PyObject *self, PyObject *args) {
-    char *full_bytes;
-    char *header;
-    char *difficulty;
-    srand(time(0));
-    uint64_t nonce = ((uint64_t) rand()) << 32 | rand();
-    int full_size, header_size, difficulty_size;
+Light_hashimoto(LightObject *self, PyObject *args) {
+    PyObject *header_obj;
+    unsigned long long nonce;
+    ethash_h256_t header;
+    if (!PyArg_ParseTuple(args, "OK", &header_obj, &nonce) || !parse_hash(header_obj, &header, "Header"))
+        return 0;
+    ethash_return_value_t out;
+    Py_BEGIN_ALLOW_THREADS
+    out = ethash_light_compute(self->light, header, nonce);
+    Py_END_ALLOW_THREADS
+    if (!out.success) {
+        PyErr_SetString(PyExc_ValueError, "Invalid DAG size");
+        return 0;
+    }
+    return build_result(&out);
+}
 
-    if (!PyArg_ParseTuple(args, PY_STRING_FORMAT PY_STRING_FORMAT PY_STRING_FORMAT, &full_bytes, &full_size, &header, &header_size, &difficulty, &difficulty_size))
+static PyObject *
+Light_hashimoto_batch(LightObject *self, PyObject *args) {
+    PyObject *headers_obj, *nonces_obj, *ret = 0;
+    if (!PyArg_ParseTuple(args, "OO", &headers_obj, &nonces_obj))
         return 0;
+    Py_ssize_t count = 0;
+    uint64_t *nonces = parse_nonces(nonces_obj, &count);
+    if (!nonces)
+        return 0;
+    ethash_h256_t *headers = parse_hashes(headers_obj, count, "header");
+    ethash_return_value_t *out = headers ? PyMem_Malloc((count ? count : 1) * sizeof(*out)) : NULL;
+    if (headers && !out)
+        PyErr_NoMemory();
+    if (out) {
+        Py_BEGIN_ALLOW_THREADS
+        for (Py_ssize_t i = 0; i < count; i++)
+            out[i] = ethash_light_compute(self->light, headers[i], nonces[i]);
+        Py_END_ALLOW_THREADS
+        ret = build_results(out, count);
+    }
+    PyMem_Free(out);
+    PyMem_Free(headers);
+    PyMem_Free(nonces);
+    return ret;
+}
 
-    if (full_size % MIX_WORDS != 0) {
-        char error_message[1024];
-        sprintf(error_message, "The size of data set must be a multiple of %i bytes (was %i)", MIX_WORDS, full_size);
-        PyErr_SetString(PyExc_ValueError, error_message);
+static PyObject *
+Light_verify_batch(LightObject *self, PyObject *args) {
+    PyObject *headers_obj, *nonces_obj, *mix_obj, *boundaries_obj, *ret = 0;
+    unsigned num_threads = 0;
+    if (!PyArg_ParseTuple(args, "OOOO|I", &headers_obj, &nonces_obj, &mix_obj, &boundaries_obj, &num_threads))
         return 0;
+    Py_ssize_t count = 0;
+    uint64_t *nonces = parse_nonces(nonces_obj, &count);
+    if (!nonces)
+        return 0;
+    ethash_h256_t *headers = parse_hashes(headers_obj, count, "header");
+    ethash_h256_t *mix_hashes = headers ? parse_hashes(mix_obj, count, "mix digest") : NULL;
+    ethash_h256_t *boundaries = mix_hashes ? parse_hashes(boundaries_obj, count, "boundary") : NULL;
+    bool *valid = boundaries ? PyMem_Malloc(count ? count : 1) : NULL;
+    if (boundaries && !valid)
+        PyErr_NoMemory();
+    if (valid) {
+        Py_BEGIN_ALLOW_THREADS
+        ethash_light_verify_batch(self->light, headers, nonces, mix_hashes, boundaries, valid, (size_t) count, num_threads);
+        Py_END_ALLOW_THREADS
+        ret = PyList_New(count);
+        for (Py_ssize_t i = 0; ret && i < count; i++)
+            PyList_SET_ITEM(ret, i, PyBool_FromLong(valid[i]));
     }
+    PyMem_Free(valid);
+    PyMem_Free(boundaries);
+    PyMem_Free(mix_hashes);
+    PyMem_Free(headers);
+    PyMem_Free(nonces);
+    return ret;
+}
 
-    if (header_size != 32) {
-        char error_message[1024];
-        sprintf(error_message, "Header must be 32 bytes long (was %i)", header_size);
-        PyErr_SetString(PyExc_ValueError, error_message);
+static PyObject *
+Light_memory_info(LightObject *self, PyObject *args) {
+    ethash_memory_info_t info;
+    bool exact;
+    Py_BEGIN_ALLOW_THREADS
+    exact = ethash_light_memory_info(self->light, &info);
+    Py_END_ALLOW_THREADS
+    return memory_info_object(&info, exact);
+}
+
+static PyMethodDef Light_methods[] = {
+        {"memory_info", (PyCFunction) Light_memory_info, METH_NOARGS,
+                "memory_info()\n\n"
+                        "Tells the bytes allocated for the cache, how many of them are resident, on which NUMA nodes and in huge pages. Returns an object with the byte counts, the resident bytes per NUMA node, whether the memory is file backed and whether the residency could be queried exactly."},
+        {"hashimoto", (PyCFunction) Light_hashimoto, METH_VARARGS,
+                "hashimoto(header, nonce)\n\n"
+                        "Same as hashimoto_light with the cache of this object."},
+        {"hashimoto_batch", (PyCFunction) Light_hashimoto_batch, METH_VARARGS,
+                "hashimoto_batch(headers, nonces)\n\n"
+                        "Hashes every nonce with its header, or with the same header if headers is a single 32 byte string. Returns a list of the objects hashimoto returns."},
+        {"verify_batch", (PyCFunction) Light_verify_batch, METH_VARARGS,
+                "verify_batch(headers, nonces, mix_digests, boundaries, num_threads=0)\n\n"
+                        "Tells for every nonce whether it hashes to its mix digest and to a result of at most its boundary. Single 32 byte strings apply to all the nonces. The nonces are split between num_threads threads, 0 for all hardware threads."},
+        {NULL, NULL, 0, NULL}
+};
+
+static PyBufferProcs Light_as_buffer = {
+        .bf_getbuffer = (getbufferproc) Light_getbuffer,
+};
+
+static PyTypeObject LightType = {
+        PyVarObject_HEAD_INIT(NULL, 0)
+        .tp_name = "pyethash.Light",
+        .tp_basicsize = sizeof(LightObject),
+        .tp_dealloc = (destructor) Light_dealloc,
+        .tp_as_buffer = &Light_as_buffer,
+        .tp_flags = Py_TPFLAGS_DEFAULT | BUFFER_TPFLAGS,
+        .tp_doc = "Light(block_number)\n\n"
+                "The cache of the epoch of block_number, shared with the other Light objects of the epoch. Its bytes are readable without a copy through the buffer protocol, e.g. memoryview(light).",
+        .tp_methods = Light_methods,
+        .tp_new = Light_new,
+};
+
+typedef struct {
+    PyObject_HEAD
+    ethash_full_t full;
+} FullObject;
+
+// the progress callback of the DAG build in progress. ethash_callback_t has no
+// user argument, so the builds with a callback take turns
+static ethash_mutex_t progress_lock;
+static PyObject *progress_callback;
+static PyObject *progress_error[3];
+
+static int
+forward_progress(unsigned progress) {
+    PyGILState_STATE const state = PyGILState_Ensure();
+    int stop = 1;
+    if (!progress_error[0]) {
+        PyObject *result = PyObject_CallFunction(progress_callback, "I", progress);
+        stop = result ? PyObject_IsTrue(result) : -1;
+        Py_XDECREF(result);
+        if (stop < 0) {
+            PyErr_Fetch(&progress_error[0], &progress_error[1], &progress_error[2]);
+            stop = 1;
+        }
+    }
+    PyGILState_Release(state);
+    return stop;
+}
+
+// builds the DAG of light on num_threads threads in the DAG file of dirname,
+// or in memory if dirname is NULL, calling callback (if not None) with the
+// progress in percent. A true return value of the callback stops the build.
+static FullObject *
+build_full(PyTypeObject *type, ethash_light_t light, char const *dirname, uint64_t full_size, unsigned num_threads, PyObject *callback) {
+    if (callback == Py_None)
+        callback = NULL;
+    if (callback && !PyCallable_Check(callback)) {
+        PyErr_SetString(PyExc_TypeError, "The progress callback must be callable or None");
         return 0;
     }
+    FullObject *self = (FullObject *) type->tp_alloc(type, 0);
+    if (!self)
+        return 0;
+    if (callback) {
+        Py_BEGIN_ALLOW_THREADS
+        ethash_mutex_lock(&progress_lock);
+        Py_END_ALLOW_THREADS
+        progress_callback = callback;
+    }
+    ethash_callback_t const forward = callback ? forward_progress : NULL;
+    Py_BEGIN_ALLOW_THREADS
+    if (dirname)
+        self->full = ethash_full_new_parallel_internal(dirname, ethash_get_seedhash(light->block_number), full_size, light, num_threads, forward);
+    else
+        self->full = ethash_full_new_memory_internal(full_size, light, num_threads, forward);
+    Py_END_ALLOW_THREADS
+    PyObject *error[3] = { NULL, NULL, NULL };
+    if (callback) {
+        memcpy(error, progress_error, sizeof(error));
+        memset(progress_error, 0, sizeof(progress_error));
+        progress_callback = NULL;
+        ethash_mutex_unlock(&progress_lock);
+    }
+    if (error[0] || !self->full) {
+        Py_DECREF(self);
+        if (error[0])
+            PyErr_Restore(error[0], error[1], error[2]);
+        else
+            PyErr_SetString(PyExc_RuntimeError, callback ? "Could not create the DAG, or the callback stopped it" : "Could not create the DAG");
+        return 0;
+    }
+    return self;
+}
 
-    if (difficulty_size != 32) {
-        char error_message[1024];
-        sprintf(error_message, "Difficulty must be an array of 32 bytes (only had %i)", difficulty_size);
-        PyErr_SetString(PyExc_ValueError, error_message);
+static PyObject *
+Full_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = { "light", "callback", "num_threads", "dirname", NULL };
+    LightObject *light;
+    PyObject *callback = Py_None;
+    unsigned num_threads = 0;
+    char const *dirname = NULL;
+    char strbuf[256];
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!|OIz", kwlist, &LightType, &light, &callback, &num_threads, &dirname))
         return 0;
+    if (!dirname) {
+        if (!ethash_get_default_dirname(strbuf, sizeof(strbuf))) {
+            PyErr_SetString(PyExc_RuntimeError, "Could not find the default DAG directory");
+            return 0;
+        }
+        dirname = strbuf;
     }
+    return (PyObject *) build_full(type, light->light, dirname, ethash_get_datasize(light->light->block_number), num_threads, callback);
+}
+
+static void
+Full_dealloc(FullObject *self) {
+    if (self->full)
+        ethash_full_delete(self->full);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
 
-    ethash_return_value out;
-    ethash_params params;
-    params.full_size = (size_t) full_size;
+static int
+Full_getbuffer(FullObject *self, Py_buffer *view, int flags) {
+    return PyBuffer_FillInfo(view, (PyObject *) self, (void *) ethash_full_dag(self->full),
+                             (Py_ssize_t) ethash_full_dag_size(self->full), 1, flags);
+}
 
-    // TODO: Multi threading?
-    do {
-        ethash_full(&out, (void *) full_bytes, &params, (const ethash_h256_t *) header, nonce++);
-        // TODO: disagrees with the spec https://github.com/ethereum/wiki/wiki/Ethash#mining
-    } while (!ethash_check_difficulty(&out.result, (const ethash_h256_t *) difficulty));
+static PyObject *
+full_hashimoto(FullObject *self, PyObject *header_obj, unsigned long long nonce) {
+    ethash_h256_t header;
+    if (!parse_hash(header_obj, &header, "Header"))
+        return 0;
+    ethash_return_value_t out;
+    Py_BEGIN_ALLOW_THREADS
+    out = ethash_full_compute(self->full, header, nonce);
+    Py_END_ALLOW_THREADS
+    if (!out.success) {
+        PyErr_SetString(PyExc_ValueError, "Invalid DAG size");
+        return 0;
+    }
+    return build_result(&out);
+}
 
+static PyObject *
+Full_hashimoto(FullObject *self, PyObject *args) {
+    PyObject *header_obj;
+    unsigned long long nonce;
+    if (!PyArg_ParseTuple(args, "OK", &header_obj, &nonce))
+        return 0;
+    return full_hashimoto(self, header_obj, nonce);
+}
+
+static PyObject *
+Full_hashimoto_batch(FullObject *self, PyObject *args) {
+    PyObject *headers_obj, *nonces_obj, *ret = 0;
+    if (!PyArg_ParseTuple(args, "OO", &headers_obj, &nonces_obj))
+        return 0;
+    Py_ssize_t count = 0;
+    uint64_t *nonces = parse_nonces(nonces_obj, &count);
+    if (!nonces)
+        return 0;
+    bool const same_header = PyObject_CheckBuffer(headers_obj);
+    ethash_h256_t *headers = parse_hashes(headers_obj, count, "header");
+    ethash_return_value_t *out = headers ? PyMem_Malloc((count ? count : 1) * sizeof(*out)) : NULL;
+    if (headers && !out)
+        PyErr_NoMemory();
+    if (out) {
+        Py_BEGIN_ALLOW_THREADS
+        if (same_header && count) {
+            // the nonces of a header advance in lockstep with overlapping DAG reads
+            ethash_full_compute_batch(self->full, headers[0], nonces, out, (size_t) count);
+        } else {
+            for (Py_ssize_t i = 0; i < count; i++)
+                out[i] = ethash_full_compute(self->full, headers[i], nonces[i]);
+        }
+        Py_END_ALLOW_THREADS
+        ret = build_results(out, count);
+    }
+    PyMem_Free(out);
+    PyMem_Free(headers);
+    PyMem_Free(nonces);
+    return ret;
+}
+
+static PyObject *
+full_mine(FullObject *self, PyObject *header_obj, PyObject *boundary_obj, unsigned num_threads) {
+    ethash_h256_t header, boundary;
+    if (!parse_hash(header_obj, &header, "Header") || !parse_hash(boundary_obj, &boundary, "Boundary"))
+        return 0;
+    srand(time(0));
+    uint64_t const start_nonce = ((uint64_t) rand()) << 32 | rand();
+    ethash_search_t search = ethash_search_start(self->full, header, start_nonce, &boundary, num_threads);
+    if (!search)
+        return PyErr_NoMemory();
+    ethash_search_hit_t hit;
+    bool found = false;
+    // the search threads run without the GIL, we only take it back to check for signals
+    while (!found) {
+        Py_BEGIN_ALLOW_THREADS
+        found = ethash_search_result(search, &hit);
+        if (!found) {
+            struct timespec const poll = { 0, 10 * 1000 * 1000 };
+            nanosleep(&poll, NULL);
+        }
+        Py_END_ALLOW_THREADS
+        if (!found && PyErr_CheckSignals() < 0) {
+            ethash_search_delete(search);
+            return 0;
+        }
+    }
+    ethash_search_delete(search);
     return Py_BuildValue("{" PY_CONST_STRING_FORMAT ":" PY_STRING_FORMAT ", " PY_CONST_STRING_FORMAT ":" PY_STRING_FORMAT ", " PY_CONST_STRING_FORMAT ":K}",
-            "mix digest", &out.mix_hash, 32,
-            "result", &out.result, 32,
-            "nonce", nonce);
+            "mix digest", (char const *) &hit.mix_hash, (Py_ssize_t) 32,
+            "result", (char const *) &hit.result, (Py_ssize_t) 32,
+            "nonce", (unsigned long long) hit.nonce);
 }
-*/
 
-//get_seedhash(block_number)
 static PyObject *
-get_seedhash(PyObject *self, PyObject *args) {
-    unsigned long block_number;
-    if (!PyArg_ParseTuple(args, "k", &block_number))
+Full_mine(FullObject *self, PyObject *args) {
+    PyObject *header_obj, *boundary_obj;
+    unsigned num_threads = 0;
+    if (!PyArg_ParseTuple(args, "OO|I", &header_obj, &boundary_obj, &num_threads))
         return 0;
-    if (block_number >= ETHASH_EPOCH_LENGTH * 2048) {
-        char error_message[1024];
-        sprintf(error_message, "Block number must be less than %i (was %lu)", ETHASH_EPOCH_LENGTH * 2048, block_number);
+    return full_mine(self, header_obj, boundary_obj, num_threads);
+}
 
-        PyErr_SetString(PyExc_ValueError, error_message);
+static PyObject *
+Full_memory_info(FullObject *self, PyObject *args) {
+    ethash_memory_info_t info;
+    bool exact;
+    Py_BEGIN_ALLOW_THREADS
+    exact = ethash_full_memory_info(self->full, &info);
+    Py_END_ALLOW_THREADS
+    return memory_info_object(&info, exact);
+}
+
+static PyMethodDef Full_methods[] = {
+        {"memory_info", (PyCFunction) Full_memory_info, METH_NOARGS,
+                "memory_info()\n\n"
+                        "Same as Light.memory_info for the DAG, its NUMA replicas and its ProgPoW cache."},
+        {"hashimoto", (PyCFunction) Full_hashimoto, METH_VARARGS,
+                "hashimoto(header, nonce)\n\n"
+                        "Runs the hashimoto hashing function on the DAG. Returns an object containing the mix digest and hash result."},
+        {"hashimoto_batch", (PyCFunction) Full_hashimoto_batch, METH_VARARGS,
+                "hashimoto_batch(headers, nonces)\n\n"
+                        "Hashes every nonce with its header, or with the same header if headers is a single 32 byte string. Returns a list of the objects hashimoto returns."},
+        {"mine", (PyCFunction) Full_mine, METH_VARARGS,
+                "mine(header, boundary, num_threads=0)\n\n"
+                        "Searches from a random nonce for a result of at most boundary (2^256 / difficulty, big endian) on num_threads threads, 0 for all hardware threads. Returns an object containing the mix digest, hash result and nonce."},
+        {NULL, NULL, 0, NULL}
+};
+
+static PyBufferProcs Full_as_buffer = {
+        .bf_getbuffer = (getbufferproc) Full_getbuffer,
+};
+
+static PyTypeObject FullType = {
+        PyVarObject_HEAD_INIT(NULL, 0)
+        .tp_name = "pyethash.Full",
+        .tp_basicsize = sizeof(FullObject),
+        .tp_dealloc = (destructor) Full_dealloc,
+        .tp_as_buffer = &Full_as_buffer,
+        .tp_flags = Py_TPFLAGS_DEFAULT | BUFFER_TPFLAGS,
+        .tp_doc = "Full(light, callback=None, num_threads=0, dirname=None)\n\n"
+                "The DAG of the epoch of a Light object, memory mapped from its DAG file in dirname, by default the default DAG directory. A missing or invalid DAG file is generated on num_threads threads, 0 for all hardware threads, calling callback with the progress in percent from the generating threads. A true return value of the callback stops the generation. The DAG bytes are readable without a copy through the buffer protocol, e.g. memoryview(full).",
+        .tp_methods = Full_methods,
+        .tp_new = Full_new,
+};
+
+// calc_dataset_bytes(full_size, cache_bytes, callback=None, num_threads=0)
+static PyObject *
+calc_dataset_bytes(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = { "full_size", "cache_bytes", "callback", "num_threads", NULL };
+    char *cache_bytes;
+    unsigned long long full_size;
+    Py_ssize_t cache_size;
+    PyObject *callback = Py_None;
+    unsigned num_threads = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "K" PY_STRING_FORMAT "|OI", kwlist, &full_size, &cache_bytes, &cache_size, &callback, &num_threads))
+        return 0;
+
+    if (full_size == 0 || full_size % ETHASH_MIX_BYTES != 0) {
+        PyErr_Format(PyExc_ValueError, "The size of data set must be a multiple of %d bytes (was %llu)", ETHASH_MIX_BYTES, full_size);
         return 0;
     }
-    ethash_h256_t seedhash = ethash_get_seedhash(block_number);
-    return Py_BuildValue(PY_STRING_FORMAT, (char *) &seedhash, 32);
+
+    if (cache_size == 0 || cache_size % ETHASH_HASH_BYTES != 0) {
+        PyErr_Format(PyExc_ValueError, "The size of the cache must be a multiple of %d bytes (was %zd)", ETHASH_HASH_BYTES, cache_size);
+        return 0;
+    }
+
+    // the DAG does not outlive the build's need of the cache
+    struct ethash_light light = { 0 };
+    light.cache = cache_bytes;
+    light.cache_size = cache_size;
+    light.num_parent_nodes = ethash_fastmod_init((uint32_t) (cache_size / ETHASH_HASH_BYTES));
+    light.epoch = ETHASH_EVENT_NO_EPOCH;
+    return (PyObject *) build_full(&FullType, &light, NULL, full_size, num_threads, callback);
+}
+
+// hashimoto_full(dataset, header, nonce)
+static PyObject *
+hashimoto_full(PyObject *self, PyObject *args) {
+    FullObject *full;
+    PyObject *header;
+    unsigned long long nonce;
+    if (!PyArg_ParseTuple(args, "O!OK", &FullType, &full, &header, &nonce))
+        return 0;
+    return full_hashimoto(full, header, nonce);
+}
+
+// mine(dataset, header, difficulty_bytes)
+static PyObject *
+mine(PyObject *self, PyObject *args) {
+    FullObject *full;
+    PyObject *header, *difficulty;
+    if (!PyArg_ParseTuple(args, "O!OO", &FullType, &full, &header, &difficulty))
+        return 0;
+    return full_mine(full, header, difficulty, 0);
 }
 
 static PyMethodDef PyethashMethods[] =
@@ -207,18 +792,30 @@ static PyMethodDef PyethashMethods[] =
                 {"mkcache_bytes", mkcache_bytes, METH_VARARGS,
                         "mkcache_bytes(block_number)\n\n"
                                 "Makes a byte array for the cache for given block number\n"},
-                /*{"calc_dataset_bytes", calc_dataset_bytes, METH_VARARGS,
-                        "calc_dataset_bytes(full_size, cache_bytes)\n\n"
-                                "Makes a byte array for the dataset for a given size given cache bytes"},*/
+                {"calc_dataset_bytes", (PyCFunction) calc_dataset_bytes, METH_VARARGS | METH_KEYWORDS,
+                        "calc_dataset_bytes(full_size, cache_bytes, callback=None, num_threads=0)\n\n"
+                                "Makes the dataset of a given size from cache bytes, in memory and without a DAG file. Returns a Full object, whose bytes are readable through the buffer protocol. callback and num_threads are the same as for Full."},
+                {"boundary", boundary, METH_VARARGS,
+                        "boundary(difficulty)\n\n"
+                                "Computes the boundary (2^256 / difficulty) of a 32 byte big endian difficulty, as the 32 byte big endian string quick_check, verify and mine take, saturating at 2^256 - 1. Meant to be called once per job."},
+                {"quick_check", quick_check, METH_VARARGS,
+                        "quick_check(header, nonce, mix_digest, boundary)\n\n"
+                                "Checks that the Ethash result computed from the claimed mix digest is at most the boundary (2^256 / difficulty, big endian), without any cache. Cheap rejection of invalid blocks before hashimoto_light."},
+                {"progpow_quick_check", progpow_quick_check, METH_VARARGS,
+                        "progpow_quick_check(header, nonce, mix_digest, boundary)\n\n"
+                                "Same as quick_check for ProgPoW."},
+                {"set_event_callback", set_event_callback, METH_VARARGS,
+                        "set_event_callback(callback)\n\n"
+                                "Calls callback with a dict for every cache and DAG lifecycle event of the library: type (e.g. 'cache_build_end'), time_us (monotonic clock), epoch (None past epoch 2047), size, duration_us and dag_file ('match', 'mismatch' or 'size_mismatch' for the 'dag_file_checked' event, 'none' otherwise). None stops the calls."},
                 {"hashimoto_light", hashimoto_light, METH_VARARGS,
                         "hashimoto_light(block_number, cache_bytes, header, nonce)\n\n"
                                 "Runs the hashimoto hashing function just using cache bytes. Takes an int (full_size), byte array (cache_bytes), another byte array (header), and an int (nonce). Returns an object containing the mix digest, and hash result."},
-                /*{"hashimoto_full", hashimoto_full, METH_VARARGS,
-                        "hashimoto_full(dataset_bytes, header, nonce)\n\n"
-                                "Runs the hashimoto hashing function using the dataset bytes. Useful for testing. Returns an object containing the mix digest (byte array), and hash result (another byte array)."},
+                {"hashimoto_full", hashimoto_full, METH_VARARGS,
+                        "hashimoto_full(dataset, header, nonce)\n\n"
+                                "Runs the hashimoto hashing function using the dataset, a Full object. Useful for testing. Returns an object containing the mix digest (byte array), and hash result (another byte array)."},
                 {"mine", mine, METH_VARARGS,
-                        "mine(dataset_bytes, header, difficulty_bytes)\n\n"
-                                "Mine for an adequate header. Returns an object containing the mix digest (byte array), hash result (another byte array) and nonce (an int)."},*/
+                        "mine(dataset, header, difficulty_bytes)\n\n"
+                                "Mine for an adequate header with the dataset, a Full object, on all hardware threads. difficulty_bytes is the boundary (2^256 / difficulty, big endian). Returns an object containing the mix digest (byte array), hash result (another byte array) and nonce (an int)."},
                 {NULL, NULL, 0, NULL}
         };
 
@@ -232,7 +829,17 @@ static struct PyModuleDef PyethashModule = {
 };
 
 PyMODINIT_FUNC PyInit_pyethash(void) {
+    if (PyType_Ready(&LightType) < 0 || PyType_Ready(&FullType) < 0)
+        return NULL;
+    if (!ethash_mutex_init(&progress_lock))
+        return NULL;
     PyObject *module =  PyModule_Create(&PyethashModule);
+    if (!module)
+        return NULL;
+    Py_INCREF(&LightType);
+    PyModule_AddObject(module, "Light", (PyObject *) &LightType);
+    Py_INCREF(&FullType);
+    PyModule_AddObject(module, "Full", (PyObject *) &FullType);
     // Following Spec: https://github.com/ethereum/wiki/wiki/Ethash#definitions
     PyModule_AddIntConstant(module, "REVISION", (long) ETHASH_REVISION);
     PyModule_AddIntConstant(module, "DATASET_BYTES_INIT", (long) ETHASH_DATASET_BYTES_INIT);
@@ -250,7 +857,17 @@ PyMODINIT_FUNC PyInit_pyethash(void) {
 #else
 PyMODINIT_FUNC
 initpyethash(void) {
+    if (PyType_Ready(&LightType) < 0 || PyType_Ready(&FullType) < 0)
+        return;
+    if (!ethash_mutex_init(&progress_lock))
+        return;
     PyObject *module = Py_InitModule("pyethash", PyethashMethods);
+    if (!module)
+        return;
+    Py_INCREF(&LightType);
+    PyModule_AddObject(module, "Light", (PyObject *) &LightType);
+    Py_INCREF(&FullType);
+    PyModule_AddObject(module, "Full", (PyObject *) &FullType);
     // Following Spec: https://github.com/ethereum/wiki/wiki/Ethash#definitions
     PyModule_AddIntConstant(module, "REVISION", (long) ETHASH_REVISION);
     PyModule_AddIntConstant(module, "DATASET_BYTES_INIT", (long) ETHASH_DATASET_BYTES_INIT);
@@ -0,0 +1,532 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file verifyd.cpp
+ * @date 2018
+ *
+ * A long running service verifying the shares of a mining pool against one
+ * full DAG per active epoch, so the pool's processes neither build light
+ * caches nor hold DAGs of their own. Clients send batches of shares over a
+ * Unix socket, see verifyd_protocol.h, and every batch is checked with
+ * ethash_full_verify_batch() on the threads of libethash.
+ *
+ * The DAGs come from an ethash_epoch_manager_t, which builds the next one
+ * ahead of the epoch boundary. The DAG of the epoch before the newest one is
+ * kept as well, for the shares of miners still working on it. Only a share of
+ * the epoch after the newest one moves the table on, so that a few shares of
+ * far future blocks can't build DAGs nobody mines on and drop the live one.
+ * Shares of older or later epochs are answered ETHASH_VERIFYD_UNAVAILABLE.
+ * Run with --help for the options.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <libethash/ethash.h>
+#include <libethash/internal.h>
+#include <libethash/io.h>
+#include "verifyd_protocol.h"
+
+using std::chrono::steady_clock;
+
+namespace
+{
+
+/// requests whose latency the percentiles of the stats are taken over
+size_t const latency_window = 4096;
+
+struct options
+{
+	std::string socket_path = "/tmp/ethash-verifyd.sock";
+	std::string dir;                 ///< empty for the default directory
+	bool in_memory = false;
+	unsigned threads = 0;            ///< per request, 0 for all hardware threads
+	unsigned build_threads = 0;
+	uint64_t prefetch_blocks = ETHASH_EPOCH_PREFETCH_BLOCKS;
+	uint64_t warm_block = UINT64_MAX;  ///< block whose DAG is built before serving
+	uint64_t cache_size = 0;         ///< 0 for the sizes of the epochs
+	uint64_t full_size = 0;
+};
+
+volatile sig_atomic_t g_stop = 0;
+
+void on_signal(int)
+{
+	g_stop = 1;
+}
+
+uint64_t elapsed_us(steady_clock::time_point start)
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(steady_clock::now() - start).count();
+}
+
+// The newest DAG of the manager and the one before it, shared with the
+// requests hashing them. A DAG goes back to the manager once the last request
+// using it is done
+class dag_table
+{
+public:
+	typedef std::shared_ptr<struct ethash_full> dag_ptr;
+
+	explicit dag_table(ethash_epoch_manager_t manager): m_manager(manager) {}
+
+	~dag_table()
+	{
+		m_current.reset();
+		m_previous.reset();
+		ethash_epoch_manager_delete(m_manager);
+	}
+
+	// the DAG of the epoch of @a block_number, nullptr if it is not kept or could not be built
+	dag_ptr acquire(uint64_t block_number)
+	{
+		uint64_t const epoch = block_number / ETHASH_EPOCH_LENGTH;
+		bool poke = false;
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			if (m_current && epoch == m_current_epoch) {
+				// the manager starts the next DAG once it hears of a block close to it
+				if (block_number <= m_top_block) {
+					return m_current;
+				}
+				m_top_block = block_number;
+				poke = true;
+			} else if (m_previous && epoch == m_previous_epoch) {
+				return m_previous;
+			} else if (m_current && (epoch < m_current_epoch || epoch > m_current_epoch + 1)) {
+				return nullptr;
+			}
+		}
+		if (poke) {
+			ethash_full_t const full = ethash_epoch_manager_acquire(m_manager, block_number);
+			if (full) {
+				ethash_epoch_manager_release(m_manager, full);
+			}
+			std::lock_guard<std::mutex> lock(m_lock);
+			return m_current;
+		}
+		// a new epoch, built or switched to by one request while the others wait
+		std::lock_guard<std::mutex> rotating(m_rotate_lock);
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			if (m_current && epoch == m_current_epoch) {
+				return m_current;
+			}
+			if (m_current && epoch < m_current_epoch) {
+				return epoch == m_previous_epoch ? m_previous : nullptr;
+			}
+			if (m_current && epoch > m_current_epoch + 1) {
+				return nullptr;
+			}
+		}
+		ethash_full_t const full = ethash_epoch_manager_acquire(m_manager, block_number);
+		if (!full) {
+			return nullptr;
+		}
+		ethash_epoch_manager_t const manager = m_manager;
+		dag_ptr const dag(full, [manager](ethash_full_t f) { ethash_epoch_manager_release(manager, f); });
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_previous = m_current;
+		m_previous_epoch = m_current_epoch;
+		m_current = dag;
+		m_current_epoch = epoch;
+		m_top_block = block_number;
+		return dag;
+	}
+
+	uint64_t current_epoch()
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		return m_current ? m_current_epoch : UINT64_MAX;
+	}
+
+private:
+	ethash_epoch_manager_t m_manager;
+	std::mutex m_lock;               ///< protects the fields below
+	std::mutex m_rotate_lock;        ///< held while a new epoch is acquired
+	dag_ptr m_current;
+	dag_ptr m_previous;
+	uint64_t m_current_epoch = 0;
+	uint64_t m_previous_epoch = UINT64_MAX;
+	uint64_t m_top_block = 0;        ///< the highest block asked for in the current epoch
+};
+
+class service_stats
+{
+public:
+	void record(size_t shares, size_t valid, size_t unavailable, uint64_t latency_us)
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_stats.requests++;
+		m_stats.shares += shares;
+		m_stats.valid += valid;
+		m_stats.unavailable += unavailable;
+		if (m_latencies.size() < latency_window) {
+			m_latencies.push_back(latency_us);
+		} else {
+			m_latencies[m_next] = latency_us;
+		}
+		m_next = (m_next + 1) % latency_window;
+	}
+
+	ethash_verifyd_stats_t get(uint64_t current_epoch)
+	{
+		std::vector<uint64_t> latencies;
+		ethash_verifyd_stats_t ret;
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			ret = m_stats;
+			latencies = m_latencies;
+		}
+		ret.current_epoch = current_epoch;
+		std::sort(latencies.begin(), latencies.end());
+		if (!latencies.empty()) {
+			ret.p50_us = latencies[latencies.size() / 2];
+			ret.p99_us = latencies[latencies.size() * 99 / 100];
+			ret.max_us = latencies.back();
+		}
+		return ret;
+	}
+
+private:
+	std::mutex m_lock;
+	ethash_verifyd_stats_t m_stats = ethash_verifyd_stats_t();
+	std::vector<uint64_t> m_latencies;  ///< of the last latency_window requests
+	size_t m_next = 0;
+};
+
+bool read_all(int fd, void* buf, size_t size)
+{
+	uint8_t* p = (uint8_t*)buf;
+	while (size) {
+		ssize_t const n = read(fd, p, size);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		size -= (size_t)n;
+	}
+	return true;
+}
+
+bool write_all(int fd, void const* buf, size_t size)
+{
+	uint8_t const* p = (uint8_t const*)buf;
+	while (size) {
+		ssize_t const n = send(fd, p, size, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		size -= (size_t)n;
+	}
+	return true;
+}
+
+struct service
+{
+	options const& opts;
+	dag_table& dags;
+	service_stats stats;
+};
+
+// verify the shares of one request, the ones of each epoch together
+void verify(
+	service& svc,
+	std::vector<ethash_verifyd_share_t> const& shares,
+	std::vector<uint8_t>& statuses,
+	ethash_verifyd_response_t& response
+)
+{
+	std::map<uint64_t, std::vector<size_t>> by_epoch;
+	for (size_t i = 0; i != shares.size(); ++i) {
+		by_epoch[shares[i].block_number / ETHASH_EPOCH_LENGTH].push_back(i);
+	}
+	statuses.assign(shares.size(), ETHASH_VERIFYD_UNAVAILABLE);
+	for (auto const& group: by_epoch) {
+		std::vector<size_t> const& indices = group.second;
+		uint64_t top_block = 0;
+		for (size_t i: indices) {
+			top_block = std::max(top_block, shares[i].block_number);
+		}
+		steady_clock::time_point const wait_start = steady_clock::now();
+		dag_table::dag_ptr const dag = svc.dags.acquire(top_block);
+		response.dag_wait_us += elapsed_us(wait_start);
+		if (!dag) {
+			continue;
+		}
+		size_t const n = indices.size();
+		std::vector<ethash_h256_t> header_hashes(n);
+		std::vector<uint64_t> nonces(n);
+		std::vector<ethash_h256_t> mix_hashes(n);
+		std::vector<ethash_h256_t> boundaries(n);
+		std::unique_ptr<bool[]> results(new bool[n]);
+		for (size_t k = 0; k != n; ++k) {
+			ethash_verifyd_share_t const& share = shares[indices[k]];
+			memcpy(&header_hashes[k], share.header_hash, 32);
+			nonces[k] = share.nonce;
+			memcpy(&mix_hashes[k], share.mix_hash, 32);
+			memcpy(&boundaries[k], share.boundary, 32);
+		}
+		steady_clock::time_point const verify_start = steady_clock::now();
+		response.valid += (uint32_t)ethash_full_verify_batch(
+			dag.get(), header_hashes.data(), nonces.data(), mix_hashes.data(), boundaries.data(),
+			results.get(), n, svc.opts.threads
+		);
+		response.verify_us += elapsed_us(verify_start);
+		for (size_t k = 0; k != n; ++k) {
+			statuses[indices[k]] = results[k] ? ETHASH_VERIFYD_VALID : ETHASH_VERIFYD_INVALID;
+		}
+	}
+}
+
+void serve_connection(service& svc, int fd)
+{
+	std::vector<ethash_verifyd_share_t> shares;
+	std::vector<uint8_t> statuses;
+	ethash_verifyd_request_t request;
+	while (read_all(fd, &request, sizeof(request))) {
+		if (request.magic != ETHASH_VERIFYD_MAGIC || request.version != ETHASH_VERIFYD_VERSION ||
+			request.count > ETHASH_VERIFYD_MAX_SHARES) {
+			break;
+		}
+		ethash_verifyd_response_t response;
+		memset(&response, 0, sizeof(response));
+		response.magic = ETHASH_VERIFYD_MAGIC;
+		response.version = ETHASH_VERIFYD_VERSION;
+		response.type = request.type;
+		response.id = request.id;
+		if (request.type == ETHASH_VERIFYD_STATS && request.count == 0) {
+			ethash_verifyd_stats_t const stats = svc.stats.get(svc.dags.current_epoch());
+			if (!write_all(fd, &response, sizeof(response)) || !write_all(fd, &stats, sizeof(stats))) {
+				break;
+			}
+			continue;
+		}
+		if (request.type != ETHASH_VERIFYD_VERIFY) {
+			break;
+		}
+		shares.resize(request.count);
+		if (!read_all(fd, shares.data(), shares.size() * sizeof(ethash_verifyd_share_t))) {
+			break;
+		}
+		steady_clock::time_point const start = steady_clock::now();
+		verify(svc, shares, statuses, response);
+		response.count = request.count;
+		size_t const unavailable = (size_t)std::count(statuses.begin(), statuses.end(), ETHASH_VERIFYD_UNAVAILABLE);
+		svc.stats.record(shares.size(), response.valid, unavailable, elapsed_us(start));
+		if (!write_all(fd, &response, sizeof(response)) || !write_all(fd, statuses.data(), statuses.size())) {
+			break;
+		}
+	}
+}
+
+int listen_on(std::string const& path)
+{
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "the socket path \"%s\" is too long\n", path.c_str());
+		return -1;
+	}
+	memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+	int const fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+	// the socket of an earlier run that did not shut down
+	unlink(path.c_str());
+	if (bind(fd, (sockaddr const*)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+		perror(path.c_str());
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+void usage(char const* name)
+{
+	printf(
+		"usage: %s [options]\n"
+		"  --socket PATH          the Unix socket to listen on (default /tmp/ethash-verifyd.sock)\n"
+		"  --dir DIR              the directory of the DAG files (default the ethash directory)\n"
+		"  --in-memory            keep the DAGs in memory only, without DAG files\n"
+		"  --threads N            threads verifying each request, 0 for all (default 0)\n"
+		"  --build-threads N      threads building each DAG, 0 for all (default 0)\n"
+		"  --prefetch-blocks N    build the next DAG this many blocks ahead of its epoch,\n"
+		"                         0 to build it on its first share (default %u)\n"
+		"  --block N              build the DAG of block N before accepting requests\n"
+		"  --cache-size BYTES     override the cache size of the epochs, for tests\n"
+		"  --full-size BYTES      override the DAG size of the epochs, for tests\n",
+		name,
+		(unsigned)ETHASH_EPOCH_PREFETCH_BLOCKS
+	);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	options opts;
+	for (int i = 1; i < argc; ++i) {
+		std::string const arg(argv[i]);
+		char const* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		bool valid = true;
+		if (arg == "--in-memory") {
+			opts.in_memory = true;
+			continue;
+		} else if (arg == "--help" || arg == "-h") {
+			usage(argv[0]);
+			return 0;
+		} else if (!value) {
+			valid = false;
+		} else if (arg == "--socket") {
+			opts.socket_path = value;
+		} else if (arg == "--dir") {
+			opts.dir = value;
+		} else if (arg == "--threads") {
+			opts.threads = (unsigned)strtoul(value, nullptr, 10);
+		} else if (arg == "--build-threads") {
+			opts.build_threads = (unsigned)strtoul(value, nullptr, 10);
+		} else if (arg == "--prefetch-blocks") {
+			opts.prefetch_blocks = strtoull(value, nullptr, 10);
+		} else if (arg == "--block") {
+			opts.warm_block = strtoull(value, nullptr, 10);
+		} else if (arg == "--cache-size") {
+			opts.cache_size = strtoull(value, nullptr, 10);
+		} else if (arg == "--full-size") {
+			opts.full_size = strtoull(value, nullptr, 10);
+		} else {
+			valid = false;
+		}
+		if (!valid) {
+			usage(argv[0]);
+			return 1;
+		}
+		++i;
+	}
+	if ((opts.cache_size == 0) != (opts.full_size == 0)) {
+		fprintf(stderr, "--cache-size and --full-size go together\n");
+		return 1;
+	}
+
+	char default_dir[256];
+	char const* dirname = nullptr;
+	if (!opts.in_memory) {
+		if (!opts.dir.empty()) {
+			dirname = opts.dir.c_str();
+		} else if (ethash_get_default_dirname(default_dir, sizeof(default_dir))) {
+			dirname = default_dir;
+		} else {
+			fprintf(stderr, "no default ethash directory, use --dir or --in-memory\n");
+			return 1;
+		}
+	}
+	ethash_epoch_manager_t const manager = ethash_epoch_manager_new_internal(
+		dirname, opts.prefetch_blocks, opts.build_threads, opts.cache_size, opts.full_size, nullptr
+	);
+	if (!manager) {
+		fprintf(stderr, "could not create the epoch manager\n");
+		return 1;
+	}
+	dag_table dags(manager);
+	if (opts.warm_block != UINT64_MAX && !dags.acquire(opts.warm_block)) {
+		fprintf(stderr, "could not build the DAG of block %llu\n", (unsigned long long)opts.warm_block);
+		return 1;
+	}
+
+	int const listen_fd = listen_on(opts.socket_path);
+	if (listen_fd < 0) {
+		return 1;
+	}
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = on_signal;
+	// without SA_RESTART, so that accept() returns on a signal
+	sigaction(SIGINT, &action, nullptr);
+	sigaction(SIGTERM, &action, nullptr);
+	signal(SIGPIPE, SIG_IGN);
+	printf("listening on %s\n", opts.socket_path.c_str());
+	fflush(stdout);
+
+	service svc{opts, dags, {}};
+	// the connections being served, each by a detached thread that is only
+	// waited for on shutdown, so that finished ones are not kept around
+	std::mutex connections_lock;
+	std::condition_variable connections_closed;
+	std::set<int> connections;
+	while (!g_stop) {
+		int const fd = accept(listen_fd, nullptr, nullptr);
+		if (fd < 0) {
+			if (errno != EINTR) {
+				perror("accept");
+			}
+			continue;
+		}
+		std::lock_guard<std::mutex> lock(connections_lock);
+		connections.insert(fd);
+		try {
+			std::thread([&svc, &connections_lock, &connections_closed, &connections, fd]() {
+				serve_connection(svc, fd);
+				// closed with the lock held, so that accept() can't reuse the
+				// descriptor while it's still in the set
+				std::lock_guard<std::mutex> lock(connections_lock);
+				connections.erase(fd);
+				close(fd);
+				connections_closed.notify_all();
+			}).detach();
+		} catch (std::system_error const& e) {
+			fprintf(stderr, "could not serve a connection: %s\n", e.what());
+			connections.erase(fd);
+			close(fd);
+		}
+	}
+	close(listen_fd);
+	unlink(opts.socket_path.c_str());
+	{
+		// the requests in progress are answered, then the connections end
+		std::unique_lock<std::mutex> lock(connections_lock);
+		for (int fd: connections) {
+			shutdown(fd, SHUT_RD);
+		}
+		connections_closed.wait(lock, [&connections]() { return connections.empty(); });
+	}
+	return 0;
+}
@@ -0,0 +1,96 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file verifyd_protocol.h
+ * @date 2018
+ *
+ * The messages of ethash-verifyd, for its clients. A client connects to the
+ * Unix stream socket of the service and sends requests, each answered by one
+ * response in order. All fields are in the byte order of the host, which the
+ * client shares with the service.
+ *
+ * A verify request is an ethash_verifyd_request_t followed by @a count
+ * ethash_verifyd_share_t. Its response is an ethash_verifyd_response_t
+ * followed by @a count bytes of ethash_verifyd_status values, one per share.
+ * A stats request has no shares, its response is an ethash_verifyd_response_t
+ * followed by an ethash_verifyd_stats_t. The service closes connections that
+ * send anything else.
+ */
+#pragma once
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ETHASH_VERIFYD_MAGIC 0x44565445U   // "ETVD"
+#define ETHASH_VERIFYD_VERSION 1
+/// The most shares of one verify request
+#define ETHASH_VERIFYD_MAX_SHARES 65536
+
+enum ethash_verifyd_type {
+	ETHASH_VERIFYD_VERIFY = 1,   ///< Verify the shares of the request
+	ETHASH_VERIFYD_STATS = 2     ///< Get the ethash_verifyd_stats_t of the service
+};
+
+enum ethash_verifyd_status {
+	ETHASH_VERIFYD_INVALID = 0,      ///< The proof of work does not meet the boundary
+	ETHASH_VERIFYD_VALID = 1,
+	ETHASH_VERIFYD_UNAVAILABLE = 2   ///< The epoch is older than the ones kept, later than the one after the newest, or its DAG could not be built
+};
+
+typedef struct ethash_verifyd_request {
+	uint32_t magic;              ///< ETHASH_VERIFYD_MAGIC
+	uint16_t version;            ///< ETHASH_VERIFYD_VERSION
+	uint16_t type;               ///< an ethash_verifyd_type
+	uint32_t count;              ///< the shares following, 0 for stats
+	uint32_t reserved;           ///< 0
+	uint64_t id;                 ///< echoed in the response
+} ethash_verifyd_request_t;
+
+typedef struct ethash_verifyd_share {
+	uint64_t block_number;       ///< picks the epoch
+	uint64_t nonce;
+	uint8_t header_hash[32];     ///< without the nonce
+	uint8_t mix_hash[32];        ///< claimed by the miner
+	uint8_t boundary[32];        ///< 2^256 / share difficulty, big endian
+} ethash_verifyd_share_t;
+
+typedef struct ethash_verifyd_response {
+	uint32_t magic;              ///< ETHASH_VERIFYD_MAGIC
+	uint16_t version;            ///< ETHASH_VERIFYD_VERSION
+	uint16_t type;               ///< the type of the request
+	uint32_t count;              ///< the status bytes following
+	uint32_t valid;              ///< the shares found valid
+	uint64_t id;                 ///< the id of the request
+	uint64_t dag_wait_us;        ///< time spent waiting for DAGs to be built or switched to
+	uint64_t verify_us;          ///< time spent hashing
+} ethash_verifyd_response_t;
+
+typedef struct ethash_verifyd_stats {
+	uint64_t requests;           ///< verify requests answered
+	uint64_t shares;
+	uint64_t valid;
+	uint64_t unavailable;
+	uint64_t current_epoch;      ///< the newest epoch with a DAG, UINT64_MAX before the first
+	uint64_t p50_us;             ///< median time from a request read to its response, over recent requests
+	uint64_t p99_us;
+	uint64_t max_us;
+} ethash_verifyd_stats_t;
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,8 +1,16 @@
 #include <iomanip>
+#include <libethash/cpu_features.h>
 #include <libethash/fnv.h>
+#include <libethash/dispatch.h>
 #include <libethash/ethash.h>
+#include <libethash/ethash.hpp>
 #include <libethash/internal.h>
 #include <libethash/io.h>
+#include <libethash/mmap.h>
+#include <libethash/progpow_jit.h>
+#include <libethash/threads.h>
+#include <libethash/threadpool.h>
+#include <libethash-cl/ethash_cl.h>
 
 #ifdef WITH_CRYPTOPP
 
@@ -16,12 +24,22 @@
 #include <windows.h>
 #include <Shlobj.h>
 #endif
+#if defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 #define BOOST_TEST_MODULE Daggerhashimoto
 #define BOOST_TEST_MAIN
 
 #include <iostream>
 #include <fstream>
+#include <numeric>
+#include <thread>
+#include <atomic>
+#include <map>
+#include <set>
 #include <vector>
 #include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
@@ -200,15 +218,62 @@ BOOST_AUTO_TEST_CASE(ethash_check_difficulty_check) {
 			// "\nexpected \"" << hash << "\" to have more difficulty than \"" << target << "\"\n");
 }
 
+BOOST_AUTO_TEST_CASE(boundary_from_difficulty_divides_2_256) {
+	ethash_h256_t difficulty;
+	ethash_h256_t boundary;
+	ethash_h256_t expected;
+	memset(&difficulty, 0, 32);
+	BOOST_REQUIRE(!ethash_boundary_from_difficulty(&boundary, &difficulty));
+
+	difficulty.b[31] = 1;
+	memset(&expected, 0xff, 32);
+	BOOST_REQUIRE(ethash_boundary_from_difficulty(&boundary, &difficulty));
+	BOOST_REQUIRE(memcmp(&boundary, &expected, 32) == 0);
+
+	difficulty.b[31] = 3;
+	memset(&expected, 0x55, 32);
+	BOOST_REQUIRE(ethash_boundary_from_difficulty(&boundary, &difficulty));
+	BOOST_REQUIRE(memcmp(&boundary, &expected, 32) == 0);
+
+	// 2^256 / 0x10000000000000001 carries across the words
+	memset(&difficulty, 0, 32);
+	difficulty.b[23] = 1;
+	difficulty.b[31] = 1;
+	memset(&expected, 0, 32);
+	uint8_t const quotient[24] = {
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+	};
+	memcpy(&expected.b[8], quotient, 24);
+	BOOST_REQUIRE(ethash_boundary_from_difficulty(&boundary, &difficulty));
+	BOOST_REQUIRE(memcmp(&boundary, &expected, 32) == 0);
+
+	memset(&difficulty, 0xff, 32);
+	memset(&expected, 0, 32);
+	expected.b[31] = 1;
+	BOOST_REQUIRE(ethash_boundary_from_difficulty(&boundary, &difficulty));
+	BOOST_REQUIRE(memcmp(&boundary, &expected, 32) == 0);
+
+	// the results at and around the boundary
+	ethash_h256_t result = expected;
+	BOOST_REQUIRE(ethash_check_boundary(&result, &expected));
+	result.b[31] = 2;
+	BOOST_REQUIRE(!ethash_check_boundary(&result, &expected));
+	result.b[31] = 0;
+	result.b[0] = 1;
+	BOOST_REQUIRE(!ethash_check_boundary(&result, &expected));
+	memset(&result, 0, 32);
+	BOOST_REQUIRE(ethash_check_boundary(&result, &expected));
+}
+
 BOOST_AUTO_TEST_CASE(test_ethash_io_mutable_name) {
 	char mutable_name[DAG_MUTABLE_NAME_MAX_SIZE];
 	// should have at least 8 bytes provided since this is what we test :)
 	ethash_h256_t seed1 = ethash_h256_static_init(0, 10, 65, 255, 34, 55, 22, 8);
 	ethash_io_mutable_name(1, &seed1, mutable_name);
-	BOOST_REQUIRE_EQUAL(0, strcmp(mutable_name, "full-R1-000a41ff22371608"));
+	BOOST_REQUIRE_EQUAL(0, strcmp(mutable_name, "dag-R1-000a41ff22371608"));
 	ethash_h256_t seed2 = ethash_h256_static_init(0, 0, 0, 0, 0, 0, 0, 0);
 	ethash_io_mutable_name(44, &seed2, mutable_name);
-	BOOST_REQUIRE_EQUAL(0, strcmp(mutable_name, "full-R44-0000000000000000"));
+	BOOST_REQUIRE_EQUAL(0, strcmp(mutable_name, "dag-R44-0000000000000000"));
 }
 
 BOOST_AUTO_TEST_CASE(test_ethash_dir_creation) {
@@ -569,6 +634,80 @@ BOOST_AUTO_TEST_CASE(failing_full_client_callback) {
 	fs::remove_all("./test_ethash_directory/");
 }
 
+static unsigned g_parallel_calls = 0;
+static unsigned g_parallel_prev_progress = 0;
+static int test_parallel_callback(unsigned _progress)
+{
+	++g_parallel_calls;
+	BOOST_CHECK(_progress >= g_parallel_prev_progress);
+	g_parallel_prev_progress = _progress;
+	return 0;
+}
+
+BOOST_AUTO_TEST_CASE(parallel_full_client_matches_sequential) {
+	uint64_t full_size;
+	uint64_t cache_size;
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+
+	cache_size = 1024;
+	full_size = 1024 * 32;
+
+	fs::remove_all("./test_ethash_directory/");
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	ethash_full_t full = ethash_full_new_parallel_internal(
+		"./test_ethash_directory/",
+		seed,
+		full_size,
+		light,
+		4,
+		test_parallel_callback
+	);
+	BOOST_ASSERT(full);
+	BOOST_CHECK(g_parallel_calls > 0);
+	BOOST_REQUIRE_EQUAL(g_parallel_prev_progress, 100);
+	for (uint32_t i = 0; i < full_size / sizeof(node); ++i) {
+		node expected_node;
+		ethash_calculate_dag_item(&expected_node, i, light);
+		BOOST_REQUIRE_MESSAGE(memcmp(&expected_node, &full->data[i], sizeof(node)) == 0,
+				"\nnode " << i << " differs from the sequential computation\n");
+	}
+
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+BOOST_AUTO_TEST_CASE(failing_parallel_full_client_callback) {
+	uint64_t full_size;
+	uint64_t cache_size;
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+
+	cache_size = 1024;
+	full_size = 1024 * 32;
+
+	fs::remove_all("./test_ethash_directory/");
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	ethash_full_t full = ethash_full_new_parallel_internal(
+		"./test_ethash_directory/",
+		seed,
+		full_size,
+		light,
+		4,
+		test_full_callback_create_incomplete_dag
+	);
+	BOOST_ASSERT(!full);
+	FILE *f = NULL;
+	// an aborted parallel build must not leave a finalized DAG behind
+	BOOST_REQUIRE_EQUAL(
+		ETHASH_IO_MEMO_SIZE_MISMATCH,
+		ethash_io_prepare("./test_ethash_directory/", seed, &f, full_size, false)
+	);
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
 BOOST_AUTO_TEST_CASE(test_incomplete_dag_file) {
 	uint64_t full_size;
 	uint64_t cache_size;
@@ -667,3 +806,3646 @@ BOOST_AUTO_TEST_CASE(full_dag_test) {
 	ethash_full_delete(full);
 }
 #endif
+
+struct test_miner_hits {
+	std::vector<std::pair<uint64_t, ethash_search_hit_t>> hits;
+	std::atomic<unsigned> counts[5];
+};
+
+static void test_miner_record(uint64_t work_id, ethash_search_hit_t const* hit, void* user) {
+	test_miner_hits* recorded = static_cast<test_miner_hits*>(user);
+	recorded->hits.push_back(std::make_pair(work_id, *hit));
+	recorded->counts[work_id]++;
+}
+
+BOOST_AUTO_TEST_CASE(miner_hashes_every_nonce_of_its_work_once) {
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	ethash_h256_t other_hash;
+	ethash_h256_t boundary;
+	memcpy(&seed, "9410b944535a83d9adf6bbdcc80e051f", 32);
+	memcpy(&hash, "c9149cc0386e689d789a1c2f3d5d169a", 32);
+	memcpy(&other_hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	ethash_full_t full = ethash_full_new_memory_internal(1024 * 32, light, 1, NULL);
+	BOOST_REQUIRE(full);
+	// every nonce is a hit
+	memset(&boundary, 0xff, 32);
+
+	test_miner_hits recorded;
+	for (auto& count: recorded.counts) {
+		count = 0;
+	}
+	ethash_miner_t miner = ethash_miner_new(3, test_miner_record, &recorded);
+	BOOST_REQUIRE(miner);
+	ethash_miner_set_work(miner, full, hash, &boundary, 1000, 1000, 1);
+	while (recorded.counts[1] < 1000) {
+		std::this_thread::yield();
+	}
+	ethash_miner_set_work(miner, full, other_hash, &boundary, UINT64_MAX - 100, 301, 2);
+	while (recorded.counts[2] < 301) {
+		std::this_thread::yield();
+	}
+	// an endless work is dropped as soon as the next one comes
+	ethash_miner_set_work(miner, full, hash, &boundary, 0, 0, 3);
+	ethash_miner_set_work(miner, full, hash, &boundary, 5000, 10, 4);
+	ethash_miner_sync(miner);
+	while (recorded.counts[4] < 10) {
+		std::this_thread::yield();
+	}
+	BOOST_REQUIRE(ethash_miner_hashes(miner) >= 1311);
+	ethash_miner_delete(miner);
+
+	std::map<uint64_t, std::set<uint64_t>> nonces;
+	for (auto const& entry: recorded.hits) {
+		uint64_t const nonce = entry.second.nonce;
+		BOOST_REQUIRE(nonces[entry.first].insert(nonce).second);
+		ethash_return_value_t const ret = ethash_full_compute(full, entry.first == 2 ? other_hash : hash, nonce);
+		BOOST_REQUIRE(memcmp(&entry.second.result, &ret.result, 32) == 0);
+		BOOST_REQUIRE(memcmp(&entry.second.mix_hash, &ret.mix_hash, 32) == 0);
+	}
+	BOOST_REQUIRE_EQUAL(nonces[1].size(), 1000u);
+	BOOST_REQUIRE_EQUAL(*nonces[1].begin(), 1000u);
+	BOOST_REQUIRE_EQUAL(*nonces[1].rbegin(), 1999u);
+	// the nonces wrap around
+	BOOST_REQUIRE_EQUAL(nonces[2].size(), 301u);
+	BOOST_REQUIRE_EQUAL(*nonces[2].begin(), 0u);
+	BOOST_REQUIRE_EQUAL(*nonces[2].rbegin(), UINT64_MAX);
+	BOOST_REQUIRE_EQUAL(nonces[4].size(), 10u);
+	BOOST_REQUIRE_EQUAL(*nonces[4].begin(), 5000u);
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(miner_set_header_restarts_the_nonces) {
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	ethash_h256_t other_hash;
+	ethash_h256_t boundary;
+	memcpy(&seed, "9410b944535a83d9adf6bbdcc80e051f", 32);
+	memcpy(&hash, "c9149cc0386e689d789a1c2f3d5d169a", 32);
+	memcpy(&other_hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	ethash_full_t full = ethash_full_new_memory_internal(1024 * 32, light, 1, NULL);
+	BOOST_REQUIRE(full);
+	memset(&boundary, 0xff, 32);
+
+	test_miner_hits recorded;
+	for (auto& count: recorded.counts) {
+		count = 0;
+	}
+	ethash_miner_t miner = ethash_miner_new(2, test_miner_record, &recorded);
+	BOOST_REQUIRE(miner);
+	BOOST_REQUIRE_EQUAL(ethash_miner_generation(miner), 0u);
+	ethash_miner_set_work(miner, full, hash, &boundary, 7, 300, 1);
+	while (recorded.counts[1] < 300) {
+		std::this_thread::yield();
+	}
+	// the same nonces again, with the new header
+	ethash_miner_set_header(miner, other_hash, 2);
+	BOOST_REQUIRE_EQUAL(ethash_miner_generation(miner), 2u);
+	while (recorded.counts[2] < 300) {
+		std::this_thread::yield();
+	}
+	// an endless work preempted right away
+	ethash_miner_set_work(miner, full, hash, &boundary, 0, 0, 3);
+	ethash_miner_set_header(miner, other_hash, 4);
+	while (recorded.counts[4] < 100) {
+		std::this_thread::yield();
+	}
+	ethash_miner_set_work(miner, NULL, hash, &boundary, 0, 0, 0);
+	ethash_miner_sync(miner);
+	BOOST_REQUIRE_EQUAL(ethash_miner_generation(miner), 5u);
+	ethash_miner_delete(miner);
+
+	std::map<uint64_t, std::set<uint64_t>> nonces;
+	for (auto const& entry: recorded.hits) {
+		BOOST_REQUIRE(nonces[entry.first].insert(entry.second.nonce).second);
+		bool const other = entry.first == 2 || entry.first == 4;
+		ethash_return_value_t const ret = ethash_full_compute(full, other ? other_hash : hash, entry.second.nonce);
+		BOOST_REQUIRE(memcmp(&entry.second.result, &ret.result, 32) == 0);
+	}
+	BOOST_REQUIRE(nonces[1] == nonces[2]);
+	BOOST_REQUIRE_EQUAL(*nonces[2].begin(), 7u);
+	BOOST_REQUIRE_EQUAL(*nonces[2].rbegin(), 306u);
+	BOOST_REQUIRE(nonces[0].empty());
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+}
+
+static void test_count_task(void* arg) {
+	(*static_cast<std::atomic<unsigned>*>(arg))++;
+}
+
+static bool test_executor_spawn(void* user, void (*task)(void*), void* arg, enum ethash_thread_priority priority) {
+	BOOST_CHECK(priority == ETHASH_THREAD_PRIORITY_LOW);
+	(*static_cast<std::atomic<unsigned>*>(user))++;
+	std::thread(task, arg).detach();
+	return true;
+}
+
+BOOST_AUTO_TEST_CASE(parallel_work_runs_on_pools_or_an_executor) {
+	std::atomic<unsigned> tasks(0);
+	ethash_threadpool_t pool = ethash_threadpool_new(2, 0, ETHASH_THREAD_PRIORITY_LOW);
+	BOOST_REQUIRE(pool);
+	for (int i = 0; i != 100; ++i) {
+		BOOST_REQUIRE(ethash_threadpool_spawn(pool, test_count_task, &tasks));
+	}
+	// the queued tasks still run
+	ethash_threadpool_delete(pool);
+	BOOST_REQUIRE_EQUAL(tasks, 100u);
+
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	uint64_t const full_size = 1024 * 32;
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	ethash_full_t expected = ethash_full_new_memory_internal(full_size, light, 1, NULL);
+	BOOST_REQUIRE(expected);
+
+	// pools restricted to the first processor
+	ethash_set_thread_pool(2, 1);
+	ethash_full_t full = ethash_full_new_memory_internal(full_size, light, 4, NULL);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE(memcmp(ethash_full_dag(full), ethash_full_dag(expected), full_size) == 0);
+	ethash_full_delete(full);
+	ethash_set_thread_pool(0, 0);
+
+	std::atomic<unsigned> spawned(0);
+	ethash_executor_t executor = { test_executor_spawn, &spawned };
+	ethash_set_executor(&executor);
+	full = ethash_full_new_memory_internal(full_size, light, 4, NULL);
+	ethash_set_executor(NULL);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE(spawned >= 3u);
+	BOOST_REQUIRE(memcmp(ethash_full_dag(full), ethash_full_dag(expected), full_size) == 0);
+	ethash_full_delete(full);
+	ethash_full_delete(expected);
+	ethash_light_delete(light);
+}
+
+#if defined(__linux__)
+struct test_nice_job {
+	std::thread::id caller;
+	std::atomic<unsigned> entered;
+	std::atomic<int> helper_nice;
+};
+
+static void test_record_nice(void* arg) {
+	test_nice_job* job = static_cast<test_nice_job*>(arg);
+	if (std::this_thread::get_id() != job->caller) {
+		job->helper_nice = getpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid));
+	}
+	// the caller waits for the helper, so that it runs the work too
+	job->entered++;
+	for (int i = 0; i != 5000 && job->entered < 2; ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(normal_pool_threads_do_not_inherit_lowered_priority) {
+	int const normal = getpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid));
+	// fresh pools, the first use of the normal one being from a lowered thread
+	ethash_set_thread_pool(0, 0);
+	test_nice_job job;
+	job.entered = 0;
+	job.helper_nice = -100;
+	std::thread lowered([&job] {
+		job.caller = std::this_thread::get_id();
+		ethash_thread_lower_priority();
+		ethash_parallel_run(test_record_nice, &job, 2, ETHASH_THREAD_PRIORITY_NORMAL);
+	});
+	lowered.join();
+	BOOST_REQUIRE_EQUAL(job.helper_nice, normal);
+
+	job.caller = std::this_thread::get_id();
+	job.entered = 0;
+	job.helper_nice = -100;
+	ethash_parallel_run(test_record_nice, &job, 2, ETHASH_THREAD_PRIORITY_NORMAL);
+	BOOST_REQUIRE_EQUAL(job.helper_nice, normal);
+
+	// and the low pool is lowered whoever starts it
+	job.entered = 0;
+	job.helper_nice = -100;
+	ethash_parallel_run(test_record_nice, &job, 2, ETHASH_THREAD_PRIORITY_LOW);
+	BOOST_REQUIRE_EQUAL(job.helper_nice, 19);
+	ethash_set_thread_pool(0, 0);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(lazy_dag_hashes_while_it_is_generated) {
+	ethash_h256_t seed;
+	ethash_h256_t header;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&header, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	uint64_t const full_size = 1024 * 256;
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	ethash_full_t expected = ethash_full_new_memory_internal(full_size, light, 1, NULL);
+	BOOST_REQUIRE(expected);
+	ethash_full_t full = ethash_full_new_lazy_internal(full_size, light, 2);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE_EQUAL(ethash_full_dag_size(full), full_size);
+
+	// the same hashes however much of the DAG is there yet
+	uint64_t nonces[20];
+	ethash_return_value_t results[20];
+	for (uint64_t nonce = 0; nonce != 20; ++nonce) {
+		nonces[nonce] = nonce;
+		ethash_return_value_t const ret = ethash_full_compute(full, header, nonce);
+		ethash_return_value_t const want = ethash_full_compute(expected, header, nonce);
+		BOOST_REQUIRE(ret.success);
+		BOOST_REQUIRE(ethash_check_difficulty(&ret.result, &want.result));
+		BOOST_REQUIRE(ethash_check_difficulty(&want.result, &ret.result));
+		BOOST_REQUIRE(memcmp(&ret.mix_hash, &want.mix_hash, 32) == 0);
+	}
+	BOOST_REQUIRE(ethash_full_compute_batch(full, header, nonces, results, 20));
+	for (unsigned k = 0; k != 20; ++k) {
+		ethash_return_value_t const want = ethash_full_compute(expected, header, nonces[k]);
+		BOOST_REQUIRE(memcmp(&results[k].mix_hash, &want.mix_hash, 32) == 0);
+	}
+	BOOST_REQUIRE(ethash_full_generated_size(full) <= full_size);
+
+	// waits for the rest of the DAG
+	BOOST_REQUIRE(memcmp(ethash_full_dag(full), ethash_full_dag(expected), full_size) == 0);
+	BOOST_REQUIRE_EQUAL(ethash_full_generated_size(full), full_size);
+	BOOST_REQUIRE(ethash_full_verify(full, 1));
+	ethash_full_delete(full);
+
+	// deleted long before it is complete
+	full = ethash_full_new_lazy_internal(full_size, light, 1);
+	BOOST_REQUIRE(full);
+	ethash_full_delete(full);
+	ethash_full_delete(expected);
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(full_search_finds_hits_below_boundary) {
+	uint64_t full_size;
+	uint64_t cache_size;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	ethash_h256_t boundary;
+	memcpy(&seed, "9410b944535a83d9adf6bbdcc80e051f", 32);
+	memcpy(&hash, "c9149cc0386e689d789a1c2f3d5d169a", 32);
+
+	cache_size = 1024;
+	full_size = 1024 * 32;
+
+	fs::remove_all("./test_ethash_directory/");
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	ethash_full_t full = ethash_full_new_internal(
+		"./test_ethash_directory/",
+		seed,
+		full_size,
+		light,
+		NULL
+	);
+	BOOST_ASSERT(full);
+
+	// roughly one in 16 nonces passes this boundary
+	memset(&boundary, 0, 32);
+	ethash_h256_set(&boundary, 0, 0x0f);
+	memset(((uint8_t*)&boundary) + 1, 0xff, 31);
+
+	uint64_t const start_nonce = 0x7c7c597c;
+	uint64_t const count = 256;
+	ethash_search_hit_t hits[256];
+	size_t found = ethash_full_search(full, hash, start_nonce, count, &boundary, hits, 256);
+	size_t expected = 0;
+	for (uint64_t nonce = start_nonce; nonce != start_nonce + count; ++nonce) {
+		ethash_return_value_t ret = ethash_full_compute(full, hash, nonce);
+		BOOST_REQUIRE(ret.success);
+		if (!ethash_check_difficulty(&ret.result, &boundary)) {
+			continue;
+		}
+		BOOST_REQUIRE(expected < found);
+		BOOST_REQUIRE_EQUAL(hits[expected].nonce, nonce);
+		BOOST_REQUIRE(memcmp(&hits[expected].result, &ret.result, 32) == 0);
+		BOOST_REQUIRE(memcmp(&hits[expected].mix_hash, &ret.mix_hash, 32) == 0);
+		expected++;
+	}
+	BOOST_REQUIRE_EQUAL(found, expected);
+	BOOST_REQUIRE(found > 1);
+
+	// stopping at the first hit
+	ethash_search_hit_t first;
+	BOOST_REQUIRE_EQUAL(ethash_full_search(full, hash, start_nonce, count, &boundary, &first, 1), 1);
+	BOOST_REQUIRE_EQUAL(first.nonce, hits[0].nonce);
+
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+BOOST_AUTO_TEST_CASE(multi_target_search_matches_single_searches) {
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "9410b944535a83d9adf6bbdcc80e051f", 32);
+	memcpy(&hash, "c9149cc0386e689d789a1c2f3d5d169a", 32);
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	ethash_full_t full = ethash_full_new_memory_internal(1024 * 32, light, 1, NULL);
+	BOOST_REQUIRE(full);
+
+	// roughly one in 16 nonces is a share and one in 256 a block
+	ethash_h256_t share_boundary;
+	ethash_h256_t block_boundary;
+	memset(&share_boundary, 0xff, 32);
+	ethash_h256_set(&share_boundary, 0, 0x0f);
+	memset(&block_boundary, 0xff, 32);
+	ethash_h256_set(&block_boundary, 0, 0x00);
+	uint64_t const start_nonce = 0x7c7c597c;
+	uint64_t const count = 2048;
+	std::vector<ethash_search_hit_t> share_hits(count);
+	std::vector<ethash_search_hit_t> block_hits(count);
+	std::vector<ethash_search_hit_t> expected(count);
+	for (bool progpow: {false, true}) {
+		ethash_search_target_t targets[2];
+		targets[0].boundary = share_boundary;
+		targets[0].hits = share_hits.data();
+		targets[0].max_hits = count;
+		targets[1].boundary = block_boundary;
+		targets[1].hits = block_hits.data();
+		targets[1].max_hits = count;
+		uint64_t const hashed = progpow ?
+			progpow_full_search_multi(full, hash, 12345, start_nonce, count, targets, 2) :
+			ethash_full_search_multi(full, hash, start_nonce, count, targets, 2);
+		BOOST_REQUIRE_EQUAL(hashed, count);
+		for (ethash_search_target_t const& target: targets) {
+			size_t const found = progpow ?
+				progpow_full_search(full, hash, 12345, start_nonce, count, &target.boundary, expected.data(), count) :
+				ethash_full_search(full, hash, start_nonce, count, &target.boundary, expected.data(), count);
+			BOOST_REQUIRE_EQUAL(target.found, found);
+			BOOST_REQUIRE(found > 1);
+			BOOST_REQUIRE(memcmp(target.hits, expected.data(), found * sizeof(ethash_search_hit_t)) == 0);
+		}
+		BOOST_REQUIRE(targets[1].found < targets[0].found);
+
+		// stops after the nonce that fills the last target, the first block here
+		targets[0].max_hits = 1;
+		targets[1].max_hits = 1;
+		uint64_t const first = progpow ?
+			progpow_full_search_multi(full, hash, 12345, start_nonce, count, targets, 2) :
+			ethash_full_search_multi(full, hash, start_nonce, count, targets, 2);
+		BOOST_REQUIRE_EQUAL(targets[0].found, 1U);
+		BOOST_REQUIRE_EQUAL(targets[1].found, 1U);
+		BOOST_REQUIRE(share_hits[0].nonce <= block_hits[0].nonce);
+		BOOST_REQUIRE_EQUAL(first, block_hits[0].nonce - start_nonce + 1);
+	}
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(background_search_splits_the_nonces) {
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	ethash_h256_t boundary;
+	memcpy(&seed, "9410b944535a83d9adf6bbdcc80e051f", 32);
+	memcpy(&hash, "c9149cc0386e689d789a1c2f3d5d169a", 32);
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	ethash_full_t full = ethash_full_new_memory_internal(1024 * 32, light, 1, NULL);
+	BOOST_REQUIRE(full);
+
+	// roughly one in 65536 nonces, so that most searches span several chunks
+	memset(&boundary, 0, 32);
+	memset(((uint8_t*)&boundary) + 2, 0xff, 30);
+	uint64_t const start_nonce = 0x7c7c597c;
+	ethash_search_hit_t first;
+	BOOST_REQUIRE_EQUAL(ethash_full_search(full, hash, start_nonce, 1U << 22, &boundary, &first, 1), 1);
+
+	unsigned const thread_counts[] = {1, 3, 0};
+	for (unsigned num_threads: thread_counts) {
+		ethash_search_t search = ethash_search_start(full, hash, start_nonce, &boundary, num_threads);
+		BOOST_REQUIRE(search);
+		ethash_search_hit_t hit;
+		while (!ethash_search_result(search, &hit)) {
+			std::this_thread::yield();
+		}
+		BOOST_REQUIRE(ethash_search_hashes(search) >= ETHASH_SEARCH_CHUNK);
+		ethash_search_delete(search);
+		ethash_return_value_t const ret = ethash_full_compute(full, hash, hit.nonce);
+		BOOST_REQUIRE(memcmp(&hit.result, &ret.result, 32) == 0);
+		BOOST_REQUIRE(memcmp(&hit.mix_hash, &ret.mix_hash, 32) == 0);
+		BOOST_REQUIRE(ethash_check_difficulty(&hit.result, &boundary));
+		if (num_threads == 1) {
+			// a single thread tries the nonces in order
+			BOOST_REQUIRE_EQUAL(hit.nonce, first.nonce);
+		}
+	}
+
+	// deleting stops a search that has not found anything yet
+	memset(&boundary, 0, 32);
+	ethash_search_t search = ethash_search_start(full, hash, start_nonce, &boundary, 2);
+	BOOST_REQUIRE(search);
+	ethash_search_hit_t hit;
+	BOOST_REQUIRE(!ethash_search_result(search, &hit));
+	ethash_search_delete(search);
+
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(throttled_search_keeps_to_its_budget) {
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	ethash_h256_t boundary;
+	memcpy(&seed, "9410b944535a83d9adf6bbdcc80e051f", 32);
+	memcpy(&hash, "c9149cc0386e689d789a1c2f3d5d169a", 32);
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	ethash_full_t full = ethash_full_new_memory_internal(1024 * 32, light, 1, NULL);
+	BOOST_REQUIRE(full);
+	memset(&boundary, 0, 32);
+
+	// a budget of 1000 hashes a second pauses the thread for seconds after
+	// its first burst, which deleting the search cuts short
+	ethash_throttle_t throttle = {0, 1000, NULL, NULL};
+	ethash_search_t search = ethash_search_start(full, hash, 0, &boundary, 1);
+	BOOST_REQUIRE(search);
+	ethash_search_set_throttle(search, &throttle);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	uint64_t const throttled = ethash_search_hashes(search);
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	uint64_t const paused = ethash_search_hashes(search) - throttled;
+	BOOST_REQUIRE_MESSAGE(paused < 1000, "\n" << paused << " hashes while paused\n");
+	auto const start = std::chrono::steady_clock::now();
+	ethash_search_delete(search);
+	BOOST_REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+
+	// without limits hashing goes on at full speed
+	search = ethash_search_start(full, hash, 0, &boundary, 1);
+	BOOST_REQUIRE(search);
+	ethash_search_set_throttle(search, &throttle);
+	ethash_search_set_throttle(search, NULL);
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	BOOST_REQUIRE(ethash_search_hashes(search) > paused + 2 * ETHASH_SEARCH_CHUNK);
+	ethash_search_delete(search);
+
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(opencl_search_matches_full_search) {
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	ethash_h256_t boundary;
+	memcpy(&seed, "9410b944535a83d9adf6bbdcc80e051f", 32);
+	memcpy(&hash, "c9149cc0386e689d789a1c2f3d5d169a", 32);
+	uint64_t const full_size = 1024 * 32;
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	ethash_full_t full = ethash_full_new_memory_internal(full_size, light, 1, NULL);
+	BOOST_REQUIRE(full);
+
+	// hosts without an OpenCL runtime have no devices
+	unsigned const count = ethash_cl_device_count();
+	BOOST_REQUIRE(!ethash_cl_new(light, full_size, count));
+
+	// roughly one in 16 nonces passes this boundary
+	memset(&boundary, 0, 32);
+	ethash_h256_set(&boundary, 0, 0x0f);
+	memset(((uint8_t*)&boundary) + 1, 0xff, 31);
+	uint64_t const start_nonce = 0x7c7c597c;
+	ethash_search_hit_t expected[64];
+	ethash_search_hit_t hits[64];
+	for (unsigned device = 0; device != count; ++device) {
+		ethash_cl_t cl = ethash_cl_new(light, full_size, device);
+		BOOST_REQUIRE(cl);
+		BOOST_TEST_MESSAGE("OpenCL device " << ethash_cl_device_name(cl));
+		size_t found = ethash_full_search(full, hash, start_nonce, 1024, &boundary, expected, 64);
+		BOOST_REQUIRE_EQUAL(ethash_cl_search(cl, hash, start_nonce, 1024, &boundary, hits, 64), found);
+		for (size_t i = 0; i != found; ++i) {
+			BOOST_REQUIRE_EQUAL(hits[i].nonce, expected[i].nonce);
+			BOOST_REQUIRE(memcmp(&hits[i].result, &expected[i].result, 32) == 0);
+		}
+		found = progpow_full_search(full, hash, 12345, start_nonce, 256, &boundary, expected, 64);
+		BOOST_REQUIRE_EQUAL(progpow_cl_search(cl, hash, 12345, start_nonce, 256, &boundary, hits, 64), found);
+		for (size_t i = 0; i != found; ++i) {
+			BOOST_REQUIRE_EQUAL(hits[i].nonce, expected[i].nonce);
+			BOOST_REQUIRE(memcmp(&hits[i].result, &expected[i].result, 32) == 0);
+		}
+		ethash_cl_delete(cl);
+	}
+
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(fnv_kernels_match_generic) {
+	ethash_h256_t seed;
+	memcpy(&seed, "9410b944535a83d9adf6bbdcc80e051f", 32);
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	node const* cache_nodes = (node const*)light->cache;
+	uint32_t const num_parent_nodes = 1024 / sizeof(node);
+	BOOST_REQUIRE_EQUAL(light->num_parent_nodes.divisor, num_parent_nodes);
+
+	unsigned count = 0;
+	while (ethash_fnv_kernel_at(count)) {
+		count++;
+	}
+	BOOST_REQUIRE(count > 0);
+	ethash_fnv_kernel_t const* generic = ethash_fnv_kernel_at(count - 1);
+	BOOST_REQUIRE_EQUAL(std::string(generic->name), "generic");
+	BOOST_REQUIRE(ethash_kernels()->fnv == ethash_fnv_kernel_at(0));
+
+	for (unsigned k = 0; k != count; ++k) {
+		ethash_fnv_kernel_t const* kernel = ethash_fnv_kernel_at(k);
+		for (uint32_t index = 0; index != 64; ++index) {
+			node expected = cache_nodes[index % num_parent_nodes];
+			node actual = expected;
+			generic->dag_item_parents(&expected, index, cache_nodes, &light->num_parent_nodes);
+			kernel->dag_item_parents(&actual, index, cache_nodes, &light->num_parent_nodes);
+			BOOST_REQUIRE_MESSAGE(memcmp(&expected, &actual, sizeof(node)) == 0,
+					"\n" << kernel->name << " dag item " << index << " differs from the generic kernel\n");
+		}
+
+		// interleaved chains give the items of the one at a time kernel
+		for (unsigned chains = 1; chains <= ETHASH_FNV_CHAINS; ++chains) {
+			uint32_t const first = 61;
+			node expected[ETHASH_FNV_CHAINS];
+			node actual[ETHASH_FNV_CHAINS];
+			for (unsigned c = 0; c != chains; ++c) {
+				expected[c] = actual[c] = cache_nodes[(first + c) % num_parent_nodes];
+				generic->dag_item_parents(&expected[c], first + c, cache_nodes, &light->num_parent_nodes);
+			}
+			kernel->dag_items_parents(actual, first, chains, cache_nodes, &light->num_parent_nodes);
+			BOOST_REQUIRE_MESSAGE(memcmp(expected, actual, chains * sizeof(node)) == 0,
+					"\n" << kernel->name << " " << chains << " interleaved dag items differ from the generic kernel\n");
+		}
+
+		node expected[MIX_NODES];
+		node actual[MIX_NODES];
+		memcpy(expected, cache_nodes, sizeof(expected));
+		memcpy(actual, cache_nodes, sizeof(actual));
+		generic->mix(expected, cache_nodes + 3, MIX_NODES);
+		kernel->mix(actual, cache_nodes + 3, MIX_NODES);
+		BOOST_REQUIRE_MESSAGE(memcmp(expected, actual, sizeof(expected)) == 0,
+				"\n" << kernel->name << " mix differs from the generic kernel\n");
+	}
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(progpow_loop_kernels_match_generic) {
+	ethash_h256_t seed;
+	memcpy(&seed, "9410b944535a83d9adf6bbdcc80e051f", 32);
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+
+	unsigned count = 0;
+	while (ethash_progpow_loop_kernel_at(count)) {
+		count++;
+	}
+	BOOST_REQUIRE(count > 0);
+	ethash_progpow_loop_kernel_t const* generic = ethash_progpow_loop_kernel_at(count - 1);
+	BOOST_REQUIRE_EQUAL(std::string(generic->name), "generic");
+
+	// a synthetic DAG of 64 PROGPOW_MIX_BYTES entries and a cache, both from a
+	// fixed generator
+	uint32_t const dag_words = 64;
+	ethash_fastmod_t const dag_entries = progpow_dag_entries(dag_words * PROGPOW_MIX_BYTES);
+	BOOST_REQUIRE_EQUAL(dag_entries.divisor, dag_words);
+	std::vector<uint32_t> g_dag(dag_words * PROGPOW_LANES * PROGPOW_DAG_LOADS);
+	std::vector<uint32_t> c_dag(PROGPOW_CACHE_WORDS);
+	uint32_t x = 0x9e3779b9;
+	for (uint32_t& w : g_dag) {
+		x = x * 1664525 + 1013904223;
+		w = x;
+	}
+	for (uint32_t& w : c_dag) {
+		x = x * 1664525 + 1013904223;
+		w = x;
+	}
+
+	for (unsigned k = 0; k != count; ++k) {
+		ethash_progpow_loop_kernel_t const* kernel = ethash_progpow_loop_kernel_at(k);
+		for (uint64_t prog_seed = 0; prog_seed != 8; ++prog_seed) {
+			progpow_program_t prog;
+			progpow_program_init(&prog, prog_seed * 7919);
+			for (uint32_t loop = 0; loop != 4; ++loop) {
+				uint32_t expected[PROGPOW_LANES][PROGPOW_REGS];
+				for (auto& lane : expected) {
+					for (uint32_t& w : lane) {
+						x = x * 1664525 + 1013904223;
+						// some zero words exercise the clz and rotation edge cases
+						w = (x >> 28) == 0 ? 0 : x;
+					}
+				}
+				uint32_t actual[PROGPOW_LANES][PROGPOW_REGS];
+				memcpy(actual, expected, sizeof(actual));
+				generic->loop(&prog, loop, light, expected, g_dag.data(), c_dag.data(), &dag_entries);
+				kernel->loop(&prog, loop, light, actual, g_dag.data(), c_dag.data(), &dag_entries);
+				BOOST_REQUIRE_MESSAGE(memcmp(expected, actual, sizeof(expected)) == 0,
+						"\n" << kernel->name << " loop " << loop << " of program " << prog_seed << " differs from the generic kernel\n");
+
+				// light mode, the DAG items come from the cache
+				generic->loop(&prog, loop, light, expected, NULL, c_dag.data(), &dag_entries);
+				kernel->loop(&prog, loop, light, actual, NULL, c_dag.data(), &dag_entries);
+				BOOST_REQUIRE_MESSAGE(memcmp(expected, actual, sizeof(expected)) == 0,
+						"\n" << kernel->name << " light loop " << loop << " of program " << prog_seed << " differs from the generic kernel\n");
+			}
+		}
+
+		// the seeds of the first and last words, and lanes hashing to the same digest word
+		for (uint64_t const mix_seed : {UINT64_C(0), UINT64_MAX, UINT64_C(0x0123456789abcdef), UINT64_C(0xffffffff)}) {
+			uint32_t expected[PROGPOW_LANES][PROGPOW_REGS];
+			uint32_t actual[PROGPOW_LANES][PROGPOW_REGS];
+			generic->fill_mix(mix_seed, expected);
+			kernel->fill_mix(mix_seed, actual);
+			BOOST_REQUIRE_MESSAGE(memcmp(expected, actual, sizeof(expected)) == 0,
+					"\n" << kernel->name << " mix of seed " << mix_seed << " differs from the generic kernel\n");
+
+			expected[3][PROGPOW_REGS - 1] ^= (uint32_t)mix_seed;
+			uint32_t expected_digest[8];
+			uint32_t actual_digest[8];
+			generic->reduce_mix(expected, expected_digest);
+			kernel->reduce_mix(expected, actual_digest);
+			BOOST_REQUIRE_MESSAGE(memcmp(expected_digest, actual_digest, sizeof(expected_digest)) == 0,
+					"\n" << kernel->name << " digest of seed " << mix_seed << " differs from the generic kernel\n");
+		}
+	}
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(active_kernels_are_reported) {
+	ethash_kernels_t const* kernels = ethash_kernels();
+	BOOST_REQUIRE(kernels == ethash_kernels());
+	BOOST_REQUIRE(kernels->keccakf1600 == ethash_keccakf1600_kernel_at(0));
+	BOOST_REQUIRE(kernels->keccakf800 == ethash_keccakf800_kernel_at(0));
+	BOOST_REQUIRE(kernels->keccakf800_multi == ethash_keccakf800_multi_kernel_at(0));
+	BOOST_REQUIRE(kernels->sha3_multi == ethash_sha3_multi_kernel_at(0));
+	BOOST_REQUIRE(kernels->progpow_loop == ethash_progpow_loop_kernel_at(0));
+
+	std::string const active = ethash_get_active_kernels();
+	BOOST_REQUIRE(active.find(std::string("keccakf1600=") + kernels->keccakf1600->name) != std::string::npos);
+	BOOST_REQUIRE(active.find(std::string("keccakf800=") + kernels->keccakf800->name) != std::string::npos);
+	BOOST_REQUIRE(active.find(std::string("keccakf800_multi=") + kernels->keccakf800_multi->name) != std::string::npos);
+	BOOST_REQUIRE(active.find(std::string("fnv=") + kernels->fnv->name) != std::string::npos);
+	BOOST_REQUIRE(active.find(std::string("progpow_loop=") + kernels->progpow_loop->name) != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(sha3_multi_kernels_match_generic) {
+	node input[19];
+	for (unsigned n = 0; n != 19; ++n) {
+		for (unsigned w = 0; w != NODE_WORDS; ++w) {
+			input[n].words[w] = n * 0x9e3779b9u ^ w;
+		}
+	}
+	node expected[19];
+	memcpy(expected, input, sizeof(input));
+	for (unsigned n = 0; n != 19; ++n) {
+		SHA3_512(expected[n].bytes, expected[n].bytes, sizeof(node));
+	}
+
+	for (unsigned k = 0; ethash_sha3_multi_kernel_at(k); ++k) {
+		ethash_sha3_multi_kernel_t const* kernel = ethash_sha3_multi_kernel_at(k);
+		node actual[19];
+		memcpy(actual, input, sizeof(input));
+		kernel->sha3_512_nodes(actual, 19);
+		for (unsigned n = 0; n != 19; ++n) {
+			BOOST_REQUIRE_MESSAGE(memcmp(&expected[n], &actual[n], sizeof(node)) == 0,
+					"\n" << kernel->name << " node " << n << " differs from SHA3_512\n");
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(keccakf1600_kernels_match_generic) {
+	unsigned count = 0;
+	while (ethash_keccakf1600_kernel_at(count)) {
+		++count;
+	}
+	BOOST_REQUIRE(count > 0);
+	ethash_keccakf1600_kernel_t const* generic = ethash_keccakf1600_kernel_at(count - 1);
+	if (!generic->permute) {
+		return; // SHA3 comes from CryptoPP
+	}
+
+	uint64_t seed = 0x0123456789abcdefULL;
+	for (unsigned round = 0; round != 64; ++round) {
+		uint64_t input[25];
+		for (unsigned w = 0; w != 25; ++w) {
+			seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+			input[w] = round == 0 ? 0 : seed;
+		}
+		uint64_t expected[25];
+		memcpy(expected, input, sizeof(input));
+		generic->permute(expected);
+		for (unsigned k = 0; k + 1 < count; ++k) {
+			ethash_keccakf1600_kernel_t const* kernel = ethash_keccakf1600_kernel_at(k);
+			uint64_t actual[25];
+			memcpy(actual, input, sizeof(input));
+			kernel->permute(actual);
+			BOOST_REQUIRE_MESSAGE(memcmp(expected, actual, sizeof(actual)) == 0,
+					"\n" << kernel->name << " differs from " << generic->name << " in round " << round << "\n");
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(keccak_benchmark_selects_a_passing_backend) {
+	for (unsigned k = 0; ethash_keccakf1600_kernel_at(k); ++k) {
+		ethash_keccakf1600_kernel_t const* kernel = ethash_keccakf1600_kernel_at(k);
+		BOOST_REQUIRE_MESSAGE(ethash_keccakf1600_kernel_check(kernel), "\n" << kernel->name << " fails its self-test\n");
+	}
+	ethash_keccakf1600_kernel_t broken = *ethash_keccakf1600_kernel_at(0);
+	broken.sha3_256 = [](uint8_t* out, uint8_t const*, size_t) { memset(out, 0, 32); };
+	broken.sha3_512 = [](uint8_t* out, uint8_t const*, size_t) { memset(out, 0, 64); };
+	BOOST_REQUIRE(!ethash_keccakf1600_kernel_check(&broken));
+
+	ethash_keccak_backend_t results[8];
+	size_t const count = ethash_keccak_benchmark(40, results, 8);
+	BOOST_REQUIRE(count > 0 && count <= 8);
+	uint64_t best = 0;
+	std::string best_name;
+	for (size_t i = 0; i != count; ++i) {
+		BOOST_REQUIRE_EQUAL(results[i].name, ethash_keccakf1600_kernel_at((unsigned)i)->name);
+		BOOST_REQUIRE(results[i].passed);
+		BOOST_REQUIRE(results[i].hash_rate > 0);
+		if (results[i].hash_rate > best) {
+			best = results[i].hash_rate;
+			best_name = results[i].name;
+		}
+	}
+	BOOST_REQUIRE_EQUAL(ethash_kernels()->keccakf1600->name, best_name);
+
+	// the selected backend hashes like any other
+	uint8_t input[64], out[64];
+	memcpy(input, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 64);
+	SHA3_512(out, input, 64);
+	BOOST_REQUIRE_EQUAL(bytesToHexString(out, 64), "0be8a1d334b4655fe58c6b38789f984bb13225684e86b20517a55ab2386c7b61c306f25e0627c60064cecd6d80cd67a82b3890bd1289b7ceb473aad56a359405");
+	BOOST_REQUIRE(ethash_set_kernel("keccakf1600", NULL));
+}
+
+BOOST_AUTO_TEST_CASE(sha3_block_lengths_match_the_sponge) {
+	uint8_t input[200];
+	for (unsigned i = 0; i != sizeof(input); ++i) {
+		input[i] = (uint8_t)(i * 167 + 13);
+	}
+	// a shorter output always goes through the byte-wise sponge
+	for (size_t len = 0; len <= sizeof(input); ++len) {
+		uint8_t fast[64], sponge[64];
+		BOOST_REQUIRE(sha3_256(fast, 32, input, len) == 0);
+		BOOST_REQUIRE(sha3_256(sponge, 31, input, len) == 0);
+		BOOST_REQUIRE_MESSAGE(memcmp(fast, sponge, 31) == 0, "\nsha3_256 of " << len << " bytes\n");
+		BOOST_REQUIRE(sha3_512(fast, 64, input, len) == 0);
+		BOOST_REQUIRE(sha3_512(sponge, 63, input, len) == 0);
+		BOOST_REQUIRE_MESSAGE(memcmp(fast, sponge, 63) == 0, "\nsha3_512 of " << len << " bytes\n");
+	}
+}
+
+BOOST_AUTO_TEST_CASE(calculate_dag_items_matches_single_items) {
+	ethash_h256_t seed;
+	memcpy(&seed, "9410b944535a83d9adf6bbdcc80e051f", 32);
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+
+	node items[21];
+	ethash_calculate_dag_items(items, 5, 21, light);
+	for (uint32_t i = 0; i != 21; ++i) {
+		node expected;
+		ethash_calculate_dag_item(&expected, 5 + i, light);
+		BOOST_REQUIRE_MESSAGE(memcmp(&expected, &items[i], sizeof(node)) == 0,
+				"\nitem " << 5 + i << " differs from ethash_calculate_dag_item\n");
+	}
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(seedhash_table_matches_hash_chain) {
+	ethash_h256_t expected;
+	ethash_h256_reset(&expected);
+	for (uint64_t epoch = 0; epoch != 2050; ++epoch) {
+		ethash_h256_t const seedhash = ethash_get_seedhash(epoch * ETHASH_EPOCH_LENGTH + epoch % ETHASH_EPOCH_LENGTH);
+		BOOST_REQUIRE_MESSAGE(memcmp(&seedhash, &expected, 32) == 0,
+				"\nseedhash of epoch " << epoch << " differs from the hash chain\n");
+		uint64_t found = 0;
+		if (epoch < 2048) {
+			BOOST_REQUIRE(ethash_get_epoch_from_seedhash(seedhash, &found));
+			BOOST_REQUIRE_EQUAL(found, epoch);
+		} else {
+			BOOST_REQUIRE(!ethash_get_epoch_from_seedhash(seedhash, &found));
+		}
+		SHA3_256(&expected, (uint8_t*)&expected, 32);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(huge_page_full_client_matches_file_mapping) {
+	uint64_t full_size;
+	uint64_t cache_size;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+
+	cache_size = 1024;
+	full_size = 1024 * 32;
+
+	fs::remove_all("./test_ethash_directory/");
+	BOOST_REQUIRE_EQUAL(ethash_get_huge_pages(), ETHASH_HUGE_PAGES_OFF);
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE_EQUAL(ethash_light_page_mode(light), ETHASH_PAGES_DEFAULT);
+	ethash_full_t file_full = ethash_full_new_internal("./test_ethash_directory/", seed, full_size, light, NULL);
+	BOOST_ASSERT(file_full);
+	BOOST_REQUIRE_EQUAL(ethash_full_page_mode(file_full), ETHASH_PAGES_FILE);
+	BOOST_REQUIRE_EQUAL(std::string(ethash_page_mode_name(ETHASH_PAGES_FILE)), "file");
+
+	enum ethash_huge_pages const policies[] = {
+		ETHASH_HUGE_PAGES_TRANSPARENT, ETHASH_HUGE_PAGES_2MB, ETHASH_HUGE_PAGES_1GB
+	};
+	for (enum ethash_huge_pages policy: policies) {
+		ethash_set_huge_pages(policy);
+		ethash_light_t huge_light = ethash_light_new_internal(cache_size, &seed);
+		BOOST_REQUIRE(memcmp(huge_light->cache, light->cache, cache_size) == 0);
+		BOOST_REQUIRE(ethash_light_page_mode(huge_light) != ETHASH_PAGES_FILE);
+
+		// once generating the DAG and writing it, once loading the written file
+		for (int pass = 0; pass != 2; ++pass) {
+			if (pass == 0) {
+				fs::remove_all("./test_ethash_directory/");
+			}
+			ethash_full_t full = ethash_full_new_internal("./test_ethash_directory/", seed, full_size, huge_light, NULL);
+			BOOST_ASSERT(full);
+			BOOST_REQUIRE(ethash_full_page_mode(full) != ETHASH_PAGES_FILE);
+			BOOST_REQUIRE(memcmp(ethash_full_dag(full), ethash_full_dag(file_full), full_size) == 0);
+			ethash_return_value_t expected = ethash_full_compute(file_full, hash, 5);
+			ethash_return_value_t actual = ethash_full_compute(full, hash, 5);
+			BOOST_REQUIRE(memcmp(&expected.result, &actual.result, 32) == 0);
+			ethash_full_delete(full);
+		}
+		ethash_light_delete(huge_light);
+	}
+	ethash_set_huge_pages(ETHASH_HUGE_PAGES_OFF);
+
+	ethash_full_delete(file_full);
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+BOOST_AUTO_TEST_CASE(memory_pool_hands_buffers_to_the_next_epoch) {
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	// both grow by less than a sixty-fourth, like from one epoch to the next
+	uint64_t const cache_size = 64 * 1024;
+	uint64_t const full_size = 128 * 1024;
+	uint64_t const next_cache_size = cache_size + 512;
+	uint64_t const next_full_size = full_size + 1024;
+	BOOST_REQUIRE_EQUAL(ethash_get_memory_pool(), 0u);
+	ethash_light_t expected = ethash_light_new_internal(next_cache_size, &seed);
+	ethash_full_t expected_full = ethash_full_new_memory_internal(next_full_size, expected, 1, NULL);
+	BOOST_REQUIRE(expected_full);
+
+	ethash_set_memory_pool(1 << 20);
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	ethash_full_t full = ethash_full_new_memory_internal(full_size, light, 1, NULL);
+	BOOST_REQUIRE(full);
+	void const* const cache = light->cache;
+	void const* const dag = ethash_full_dag(full);
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+	BOOST_REQUIRE(ethash_memory_pool_size() >= cache_size + full_size);
+
+	// the slightly bigger cache and DAG of the next epoch take over the buffers
+	light = ethash_light_new_internal(next_cache_size, &seed);
+	BOOST_REQUIRE_EQUAL(light->cache, cache);
+	BOOST_REQUIRE(memcmp(light->cache, expected->cache, next_cache_size) == 0);
+	full = ethash_full_new_memory_internal(next_full_size, light, 1, NULL);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE_EQUAL(ethash_full_dag(full), dag);
+	BOOST_REQUIRE_EQUAL(ethash_memory_pool_size(), 0u);
+	BOOST_REQUIRE(memcmp(ethash_full_dag(full), ethash_full_dag(expected_full), next_full_size) == 0);
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+
+	// lowering the limit releases what no longer fits
+	BOOST_REQUIRE(ethash_memory_pool_size() != 0);
+	ethash_set_memory_pool(0);
+	BOOST_REQUIRE_EQUAL(ethash_memory_pool_size(), 0u);
+	ethash_full_delete(expected_full);
+	ethash_light_delete(expected);
+}
+
+struct test_memory_provider {
+	unsigned allocs[2];
+	unsigned maps;
+	unsigned frees;
+	unsigned advice[2];
+};
+
+static void* test_provider_alloc(void* user, size_t size, enum ethash_memory_use use) {
+	static_cast<test_memory_provider*>(user)->allocs[use]++;
+	void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return p == MAP_FAILED ? NULL : p;
+}
+
+static void* test_provider_map_file(void* user, int fd, size_t size, bool writable) {
+	static_cast<test_memory_provider*>(user)->maps++;
+	void* p = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	return p == MAP_FAILED ? NULL : p;
+}
+
+static void test_provider_free(void* user, void* base, size_t size) {
+	static_cast<test_memory_provider*>(user)->frees++;
+	munmap(base, size);
+}
+
+static void test_provider_advise(void* user, void* base, size_t size, enum ethash_memory_advice advice) {
+	(void)base;
+	(void)size;
+	static_cast<test_memory_provider*>(user)->advice[advice]++;
+}
+
+static uint64_t test_node_resident(ethash_memory_info_t const& info)
+{
+	uint64_t sum = 0;
+	for (unsigned n = 0; n != ETHASH_MEMORY_INFO_NODES; ++n) {
+		sum += info.node_resident[n];
+	}
+	return sum;
+}
+
+BOOST_AUTO_TEST_CASE(memory_info_reports_what_handlers_hold) {
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	uint64_t const full_size = 1024 * 32;
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	ethash_memory_info_t info;
+	BOOST_REQUIRE(ethash_light_memory_info(light, &info));
+	BOOST_REQUIRE(info.allocated >= 1024u);
+	BOOST_REQUIRE(info.resident > 0 && info.resident <= info.allocated);
+	BOOST_REQUIRE_EQUAL(test_node_resident(info), info.resident);
+	BOOST_REQUIRE(!info.file_backed);
+	BOOST_REQUIRE(ethash_light_set_dag_prefix(light, full_size, 1));
+	ethash_memory_info_t prefixed;
+	BOOST_REQUIRE(ethash_light_memory_info(light, &prefixed));
+	BOOST_REQUIRE(prefixed.allocated >= info.allocated + full_size);
+
+	// a generated DAG is all resident
+	ethash_full_t full = ethash_full_new_memory_internal(full_size, light, 1, NULL);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE(ethash_full_memory_info(full, &info));
+	BOOST_REQUIRE(info.allocated >= full_size);
+	BOOST_REQUIRE(info.resident >= full_size);
+	BOOST_REQUIRE(info.resident <= info.allocated);
+	BOOST_REQUIRE_EQUAL(test_node_resident(info), info.resident);
+	BOOST_REQUIRE(!info.file_backed);
+	ethash_full_delete(full);
+
+	fs::remove_all("./test_ethash_directory/");
+	full = ethash_full_new_internal("./test_ethash_directory/", seed, full_size, light, NULL);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE(ethash_full_memory_info(full, &info));
+	BOOST_REQUIRE(info.file_backed == (ethash_full_page_mode(full) == ETHASH_PAGES_FILE));
+	BOOST_REQUIRE(info.allocated >= full_size);
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+BOOST_AUTO_TEST_CASE(memory_lock_pins_handlers_or_reports_why_not) {
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	uint64_t const full_size = 1024 * 32;
+	bool const stats_enabled = ethash_get_stats_enabled();
+	ethash_set_stats_enabled(true);
+	ethash_stats_t before;
+	ethash_get_stats(&before);
+	BOOST_REQUIRE(!ethash_get_memory_lock());
+	ethash_set_memory_lock(true);
+	BOOST_REQUIRE(ethash_get_memory_lock());
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	BOOST_REQUIRE(light);
+	BOOST_REQUIRE(ethash_light_set_dag_prefix(light, 4096, 1));
+	ethash_full_t full = ethash_full_new_memory_internal(full_size, light, 1, NULL);
+	BOOST_REQUIRE(full);
+	ethash_set_memory_lock(false);
+
+	ethash_memory_info_t light_info;
+	ethash_memory_info_t full_info;
+	BOOST_REQUIRE(ethash_light_memory_info(light, &light_info));
+	BOOST_REQUIRE(ethash_full_memory_info(full, &full_info));
+	ethash_stats_t after;
+	ethash_get_stats(&after);
+	// 6 regions: the cache, both ProgPoW caches, the DAG prefix and the DAG
+	uint64_t const failures = after.memory_lock_failures - before.memory_lock_failures;
+	BOOST_REQUIRE(failures <= 5);
+	if (failures == 0) {
+		BOOST_REQUIRE(light_info.locked >= 1024 + PROGPOW_CACHE_BYTES + 4096);
+		BOOST_REQUIRE(full_info.locked >= full_size + PROGPOW_CACHE_BYTES);
+	}
+	BOOST_REQUIRE(light_info.locked <= light_info.allocated + PROGPOW_CACHE_BYTES);
+	BOOST_REQUIRE(full_info.locked <= full_info.allocated);
+
+	// handlers created with the option off are not locked
+	ethash_full_t unlocked = ethash_full_new_memory_internal(full_size, light, 1, NULL);
+	BOOST_REQUIRE(unlocked);
+	BOOST_REQUIRE(ethash_full_memory_info(unlocked, &full_info));
+	BOOST_REQUIRE_EQUAL(full_info.locked, 0);
+	ethash_full_delete(unlocked);
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+	ethash_set_stats_enabled(stats_enabled);
+}
+
+BOOST_AUTO_TEST_CASE(memory_provider_supplies_caches_and_dags) {
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	ethash_light_t expected = ethash_light_new_internal(cache_size, &seed);
+	ethash_full_t expected_full = ethash_full_new_memory_internal(full_size, expected, 1, NULL);
+	BOOST_REQUIRE(expected_full);
+
+	test_memory_provider counts = {};
+	ethash_memory_provider_t provider = {
+		test_provider_alloc, test_provider_free, NULL, test_provider_advise, &counts
+	};
+	ethash_light_t light = ethash_light_new_provided_internal(cache_size, &seed, &provider);
+	BOOST_REQUIRE(light);
+	BOOST_REQUIRE_EQUAL(counts.allocs[ETHASH_MEMORY_LIGHT_CACHE], 1u);
+	BOOST_REQUIRE(memcmp(light->cache, expected->cache, cache_size) == 0);
+
+	// without map_file the DAG is generated into memory of the provider and written once
+	fs::remove_all("./test_ethash_directory/");
+	ethash_full_t full = ethash_full_new_provided_internal(
+		"./test_ethash_directory/", seed, full_size, light, 2, NULL, &provider
+	);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE_EQUAL(counts.allocs[ETHASH_MEMORY_DAG], 1u);
+	BOOST_REQUIRE_EQUAL(counts.advice[ETHASH_MEMORY_ADVICE_RANDOM], 1u);
+	BOOST_REQUIRE(memcmp(ethash_full_dag(full), ethash_full_dag(expected_full), full_size) == 0);
+	ethash_full_delete(full);
+	BOOST_REQUIRE_EQUAL(counts.frees, 1u);
+
+	// with map_file the DAG file written above is mapped by the provider
+	provider.map_file = test_provider_map_file;
+	ethash_set_dag_load_mode(ETHASH_DAG_LOAD_PREFAULT);
+	full = ethash_full_new_provided_internal("./test_ethash_directory/", seed, full_size, light, 2, NULL, &provider);
+	ethash_set_dag_load_mode(ETHASH_DAG_LOAD_LAZY);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE_EQUAL(counts.maps, 1u);
+	BOOST_REQUIRE_EQUAL(counts.allocs[ETHASH_MEMORY_DAG], 1u);
+	BOOST_REQUIRE_EQUAL(counts.advice[ETHASH_MEMORY_ADVICE_WILLNEED], 1u);
+	BOOST_REQUIRE_EQUAL(ethash_full_page_mode(full), ETHASH_PAGES_FILE);
+	BOOST_REQUIRE(memcmp(ethash_full_dag(full), ethash_full_dag(expected_full), full_size) == 0);
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+	BOOST_REQUIRE_EQUAL(counts.frees, 3u);
+
+	fs::remove_all("./test_ethash_directory/");
+	ethash_full_delete(expected_full);
+	ethash_light_delete(expected);
+}
+
+BOOST_AUTO_TEST_CASE(computed_caches_and_dags_are_cache_line_aligned) {
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+
+	BOOST_REQUIRE_EQUAL(ethash_get_huge_pages(), ETHASH_HUGE_PAGES_OFF);
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	BOOST_ASSERT(light);
+	BOOST_REQUIRE_EQUAL((uintptr_t)light->cache % 64, 0u);
+	ethash_full_t full = ethash_full_new_memory_internal(1024 * 32, light, 2, NULL);
+	BOOST_ASSERT(full);
+	BOOST_REQUIRE_EQUAL((uintptr_t)ethash_full_dag(full) % 64, 0u);
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(mapped_caches_and_dags_are_cache_line_aligned) {
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+
+	fs::remove_all("./test_ethash_directory/");
+	ethash_light_t computed = ethash_light_new_persistent_internal("./test_ethash_directory/", 1024, &seed);
+	BOOST_ASSERT(computed);
+	ethash_light_t loaded = ethash_light_new_persistent_internal("./test_ethash_directory/", 1024, &seed);
+	BOOST_ASSERT(loaded);
+	BOOST_REQUIRE_EQUAL(ethash_light_page_mode(loaded), ETHASH_PAGES_FILE);
+	BOOST_REQUIRE_EQUAL((uintptr_t)loaded->cache % 64, 0u);
+	for (int pass = 0; pass != 2; ++pass) {
+		ethash_full_t full = ethash_full_new_internal("./test_ethash_directory/", seed, 1024 * 32, loaded, NULL);
+		BOOST_ASSERT(full);
+		BOOST_REQUIRE_EQUAL(ethash_full_page_mode(full), ETHASH_PAGES_FILE);
+		BOOST_REQUIRE_EQUAL((uintptr_t)ethash_full_dag(full) % 64, 0u);
+		ethash_full_delete(full);
+	}
+	ethash_light_delete(loaded);
+	ethash_light_delete(computed);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+BOOST_AUTO_TEST_CASE(memory_full_client_does_not_touch_disk) {
+	uint64_t full_size;
+	uint64_t cache_size;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+
+	cache_size = 1024;
+	full_size = 1024 * 32;
+
+	fs::remove_all("./test_ethash_directory/");
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	ethash_full_t full = ethash_full_new_memory_internal(full_size, light, 2, NULL);
+	BOOST_ASSERT(full);
+	BOOST_REQUIRE(!fs::exists("./test_ethash_directory/"));
+	BOOST_REQUIRE_EQUAL(ethash_full_dag_size(full), full_size);
+	BOOST_REQUIRE(ethash_full_page_mode(full) != ETHASH_PAGES_FILE);
+
+	node const* dag = (node const*)ethash_full_dag(full);
+	for (uint32_t i = 0; i < full_size / sizeof(node); ++i) {
+		node expected_node;
+		ethash_calculate_dag_item(&expected_node, i, light);
+		BOOST_REQUIRE_MESSAGE(memcmp(&expected_node, &dag[i], sizeof(node)) == 0,
+				"\nnode " << i << " differs from the light computation\n");
+	}
+	ethash_return_value_t light_ret = ethash_light_compute_internal(light, full_size, hash, 5);
+	ethash_return_value_t full_ret = ethash_full_compute(full, hash, 5);
+	BOOST_REQUIRE(memcmp(&light_ret.result, &full_ret.result, 32) == 0);
+
+	ethash_full_delete(full);
+	BOOST_REQUIRE(!ethash_full_new_memory_internal(full_size, light, 1, test_full_callback_that_fails));
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(numa_modes_keep_dag_consistent) {
+	uint64_t full_size;
+	uint64_t cache_size;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+
+	cache_size = 1024;
+	full_size = 1024 * 32;
+
+	unsigned const nodes = ethash_numa_node_count();
+	BOOST_REQUIRE(nodes >= 1);
+	BOOST_REQUIRE(ethash_numa_current_node() < nodes);
+
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	ethash_return_value_t light_ret = ethash_light_compute_internal(light, full_size, hash, 5);
+	enum ethash_numa_mode const modes[] = {ETHASH_NUMA_INTERLEAVE, ETHASH_NUMA_REPLICATE};
+	for (enum ethash_numa_mode mode: modes) {
+		ethash_set_numa_mode(mode);
+		BOOST_REQUIRE_EQUAL(ethash_get_numa_mode(), mode);
+		ethash_full_t full = ethash_full_new_memory_internal(full_size, light, 2, NULL);
+		BOOST_ASSERT(full);
+		unsigned const replicas = ethash_full_replica_count(full);
+		BOOST_REQUIRE(replicas >= 1 && replicas <= nodes);
+		// hashes only look up their node when there are replicas to pick from
+		BOOST_REQUIRE_EQUAL(full->replicated, replicas > 1);
+		if (mode != ETHASH_NUMA_REPLICATE) {
+			BOOST_REQUIRE_EQUAL(replicas, 1U);
+		}
+		ethash_return_value_t full_ret = ethash_full_compute(full, hash, 5);
+		BOOST_REQUIRE(memcmp(&light_ret.result, &full_ret.result, 32) == 0);
+		ethash_full_delete(full);
+	}
+	ethash_set_numa_mode(ETHASH_NUMA_OFF);
+	ethash_light_delete(light);
+}
+
+#if defined(__linux__)
+BOOST_AUTO_TEST_CASE(numa_current_node_matches_the_kernel) {
+	cpu_set_t allowed;
+	BOOST_REQUIRE(sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+	unsigned checked = 0;
+	for (int cpu = 0; cpu != CPU_SETSIZE && checked != 8; ++cpu) {
+		if (!CPU_ISSET(cpu, &allowed)) {
+			continue;
+		}
+		unsigned node = 0;
+		unsigned kernel_node = 0;
+		std::thread([&] {
+			cpu_set_t one;
+			CPU_ZERO(&one);
+			CPU_SET(cpu, &one);
+			if (sched_setaffinity(0, sizeof(one), &one) == 0) {
+				unsigned kernel_cpu;
+				node = ethash_numa_current_node();
+				syscall(SYS_getcpu, &kernel_cpu, &kernel_node, NULL);
+			}
+		}).join();
+		BOOST_REQUIRE_EQUAL(node, kernel_node);
+		++checked;
+	}
+	BOOST_REQUIRE(checked > 0);
+}
+#endif
+
+static bool test_matches_light(ethash_full_t full, uint64_t epoch, uint64_t cache_size, uint64_t full_size) {
+	ethash_h256_t hash;
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_h256_t seed = ethash_get_seedhash(epoch * ETHASH_EPOCH_LENGTH);
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	ethash_return_value_t light_ret = ethash_light_compute_internal(light, full_size, hash, 5);
+	ethash_return_value_t full_ret = ethash_full_compute(full, hash, 5);
+	ethash_light_delete(light);
+	return memcmp(&light_ret.result, &full_ret.result, 32) == 0;
+}
+
+BOOST_AUTO_TEST_CASE(epoch_manager_prefetches_next_epoch) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	ethash_epoch_manager_t manager = ethash_epoch_manager_new_internal(NULL, 100, 2, cache_size, full_size, NULL);
+	BOOST_REQUIRE(manager);
+
+	ethash_full_t full0 = ethash_epoch_manager_acquire(manager, 0);
+	BOOST_REQUIRE(full0);
+	BOOST_REQUIRE(test_matches_light(full0, 0, cache_size, full_size));
+	BOOST_REQUIRE(ethash_epoch_manager_wait(manager));
+	BOOST_REQUIRE_EQUAL(ethash_epoch_manager_upcoming_epoch(manager), UINT64_MAX);
+
+	// entering the prefetch window starts building epoch 1 in the background
+	BOOST_REQUIRE(ethash_epoch_manager_acquire(manager, ETHASH_EPOCH_LENGTH - 50) == full0);
+	BOOST_REQUIRE(ethash_epoch_manager_wait(manager));
+	BOOST_REQUIRE_EQUAL(ethash_epoch_manager_upcoming_epoch(manager), 1U);
+
+	ethash_full_t full1 = ethash_epoch_manager_acquire(manager, ETHASH_EPOCH_LENGTH);
+	BOOST_REQUIRE(full1 && full1 != full0);
+	BOOST_REQUIRE_EQUAL(ethash_epoch_manager_upcoming_epoch(manager), UINT64_MAX);
+	BOOST_REQUIRE(test_matches_light(full1, 1, cache_size, full_size));
+	// the old DAG stays valid until its last holder releases it
+	BOOST_REQUIRE(test_matches_light(full0, 0, cache_size, full_size));
+	ethash_epoch_manager_release(manager, full0);
+	ethash_epoch_manager_release(manager, full0);
+	ethash_epoch_manager_release(manager, full1);
+
+	ethash_epoch_manager_delete(manager);
+
+	manager = ethash_epoch_manager_new_internal(NULL, 100, 1, cache_size, full_size, test_full_callback_that_fails);
+	BOOST_REQUIRE(manager);
+	BOOST_REQUIRE(!ethash_epoch_manager_acquire(manager, 0));
+	BOOST_REQUIRE(!ethash_epoch_manager_wait(manager));
+	ethash_epoch_manager_delete(manager);
+}
+
+struct test_registry_job {
+	ethash_light_registry_t registry;
+	ethash_light_t light;
+};
+
+static void test_registry_acquire(void* arg) {
+	test_registry_job* job = (test_registry_job*)arg;
+	job->light = ethash_light_registry_acquire(job->registry, 5 * ETHASH_EPOCH_LENGTH);
+}
+
+BOOST_AUTO_TEST_CASE(light_registry_shares_and_evicts_caches) {
+	uint64_t const cache_size = 1024;
+	ethash_light_registry_t registry = ethash_light_registry_new_internal(2, cache_size);
+	BOOST_REQUIRE(registry);
+
+	ethash_light_t light0 = ethash_light_registry_acquire(registry, 0);
+	BOOST_REQUIRE(light0);
+	BOOST_REQUIRE(ethash_light_registry_acquire(registry, ETHASH_EPOCH_LENGTH - 1) == light0);
+	BOOST_REQUIRE_EQUAL(ethash_light_registry_size(registry), 1U);
+	ethash_h256_t seed = ethash_get_seedhash(0);
+	ethash_light_t expected = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE_EQUAL(light0->cache_size, expected->cache_size);
+	BOOST_REQUIRE(memcmp(light0->cache, expected->cache, cache_size) == 0);
+	ethash_light_delete(expected);
+
+	// concurrent requests for the same epoch share a single build
+	test_registry_job jobs[4];
+	ethash_thread_t threads[4];
+	for (unsigned i = 0; i != 4; ++i) {
+		jobs[i].registry = registry;
+		BOOST_REQUIRE(ethash_thread_create(&threads[i], test_registry_acquire, &jobs[i]));
+	}
+	for (unsigned i = 0; i != 4; ++i) {
+		ethash_thread_join(threads[i]);
+		BOOST_REQUIRE(jobs[i].light && jobs[i].light == jobs[0].light);
+	}
+	BOOST_REQUIRE_EQUAL(jobs[0].light->block_number, 5 * ETHASH_EPOCH_LENGTH);
+	BOOST_REQUIRE_EQUAL(ethash_light_registry_size(registry), 2U);
+
+	// caches in use are never evicted, even beyond the capacity
+	ethash_light_t light1 = ethash_light_registry_acquire(registry, ETHASH_EPOCH_LENGTH);
+	BOOST_REQUIRE(light1);
+	BOOST_REQUIRE_EQUAL(ethash_light_registry_size(registry), 3U);
+	for (unsigned i = 0; i != 4; ++i) {
+		ethash_light_registry_release(registry, jobs[i].light);
+	}
+	BOOST_REQUIRE_EQUAL(ethash_light_registry_size(registry), 2U);
+	ethash_light_registry_release(registry, light0);
+	ethash_light_registry_release(registry, light0);
+	ethash_light_registry_release(registry, light1);
+	BOOST_REQUIRE_EQUAL(ethash_light_registry_size(registry), 2U);
+
+	ethash_light_registry_delete(registry);
+}
+
+struct test_budget_job {
+	ethash_light_registry_t registry;
+	ethash_light_t light;
+};
+
+static void test_budget_release_later(void* arg) {
+	test_budget_job* job = (test_budget_job*)arg;
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	ethash_light_registry_release(job->registry, job->light);
+}
+
+BOOST_AUTO_TEST_CASE(memory_budget_evicts_idle_caches_and_queues_builds) {
+	uint64_t const cache_size = 1024;
+	// every light handler holds its ProgPoW cache too
+	uint64_t const light_bytes = cache_size + PROGPOW_CACHE_BYTES;
+	ethash_memory_budget_stats_t const before = ethash_get_memory_budget_stats();
+	ethash_light_registry_t registry = ethash_light_registry_new_internal(8, cache_size);
+	BOOST_REQUIRE(registry);
+	ethash_set_memory_budget(before.reserved + 3 * light_bytes, 20);
+	BOOST_REQUIRE_EQUAL(ethash_get_memory_budget(), before.reserved + 3 * light_bytes);
+
+	ethash_light_t lights[3];
+	for (unsigned i = 0; i != 3; ++i) {
+		lights[i] = ethash_light_registry_acquire(registry, i * ETHASH_EPOCH_LENGTH);
+		BOOST_REQUIRE(lights[i]);
+	}
+	BOOST_REQUIRE_EQUAL(ethash_get_memory_budget_stats().reserved, before.reserved + 3 * light_bytes);
+	// the least recently used idle cache makes room, the registry stays under its capacity
+	ethash_light_registry_release(registry, lights[1]);
+	ethash_light_registry_release(registry, lights[0]);
+	ethash_light_t const light3 = ethash_light_registry_acquire(registry, 3 * ETHASH_EPOCH_LENGTH);
+	BOOST_REQUIRE(light3);
+	BOOST_REQUIRE_EQUAL(ethash_light_registry_size(registry), 3U);
+	BOOST_REQUIRE_EQUAL(ethash_get_memory_budget_stats().evictions, before.evictions + 1);
+	BOOST_REQUIRE(ethash_light_registry_acquire(registry, 0) == lights[0]);
+
+	// with every cache held, builds fail once they waited long enough
+	ethash_h256_t seed = ethash_get_seedhash(0);
+	BOOST_REQUIRE(!ethash_light_new_internal(cache_size, &seed));
+	BOOST_REQUIRE(!ethash_light_new_internal(4 * cache_size, &seed));
+	BOOST_REQUIRE_EQUAL(ethash_get_memory_budget_stats().rejected, before.rejected + 2);
+
+	// and succeed when another cache is freed meanwhile
+	ethash_set_memory_budget(before.reserved + 3 * light_bytes, 10000);
+	test_budget_job job;
+	job.registry = registry;
+	job.light = light3;
+	ethash_thread_t thread;
+	BOOST_REQUIRE(ethash_thread_create(&thread, test_budget_release_later, &job));
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	ethash_thread_join(thread);
+	BOOST_REQUIRE(light);
+	ethash_memory_budget_stats_t const after = ethash_get_memory_budget_stats();
+	BOOST_REQUIRE_EQUAL(after.waits, before.waits + 1);
+	BOOST_REQUIRE_EQUAL(after.evictions, before.evictions + 2);
+	BOOST_REQUIRE(after.peak >= before.reserved + 3 * light_bytes);
+	ethash_light_delete(light);
+
+	ethash_set_memory_budget(0, 0);
+	ethash_light_registry_release(registry, lights[0]);
+	ethash_light_registry_release(registry, lights[2]);
+	ethash_light_registry_delete(registry);
+	BOOST_REQUIRE_EQUAL(ethash_get_memory_budget_stats().reserved, before.reserved);
+}
+
+BOOST_AUTO_TEST_CASE(memory_budget_evicts_without_waiting) {
+	uint64_t const cache_size = 1024;
+	uint64_t const light_bytes = cache_size + PROGPOW_CACHE_BYTES;
+	ethash_memory_budget_stats_t const before = ethash_get_memory_budget_stats();
+	ethash_light_registry_t registry = ethash_light_registry_new_internal(8, cache_size);
+	BOOST_REQUIRE(registry);
+	ethash_set_memory_budget(before.reserved + light_bytes, 0);
+	ethash_light_t const light0 = ethash_light_registry_acquire(registry, 0);
+	BOOST_REQUIRE(light0);
+	ethash_light_registry_release(registry, light0);
+
+	// a wait of 0 still frees the idle cache before giving up
+	ethash_light_t const light1 = ethash_light_registry_acquire(registry, ETHASH_EPOCH_LENGTH);
+	BOOST_REQUIRE(light1);
+	ethash_memory_budget_stats_t const after = ethash_get_memory_budget_stats();
+	BOOST_REQUIRE_EQUAL(after.evictions, before.evictions + 1);
+	BOOST_REQUIRE_EQUAL(after.rejected, before.rejected);
+	BOOST_REQUIRE_EQUAL(after.waits, before.waits);
+
+	ethash_set_memory_budget(0, 0);
+	ethash_light_registry_release(registry, light1);
+	ethash_light_registry_delete(registry);
+	BOOST_REQUIRE_EQUAL(ethash_get_memory_budget_stats().reserved, before.reserved);
+}
+
+BOOST_AUTO_TEST_CASE(memory_budget_counts_dag_prefix_and_memo) {
+	uint64_t const cache_size = 1024;
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_memory_budget_stats_t const before = ethash_get_memory_budget_stats();
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(light);
+	uint64_t reserved = before.reserved + cache_size + PROGPOW_CACHE_BYTES;
+	BOOST_REQUIRE_EQUAL(ethash_get_memory_budget_stats().reserved, reserved);
+
+	BOOST_REQUIRE(ethash_light_set_dag_prefix(light, 8192, 1));
+	reserved += 8192;
+	BOOST_REQUIRE_EQUAL(ethash_get_memory_budget_stats().reserved, reserved);
+	BOOST_REQUIRE(ethash_light_set_memo(light, 64 * 1024));
+	uint64_t const memo_bytes = ethash_get_memory_budget_stats().reserved - reserved;
+	BOOST_REQUIRE(memo_bytes > 0 && memo_bytes <= 64 * 1024 + 4096);
+	reserved += memo_bytes;
+
+	// with no room left neither grows, and both can still be dropped
+	ethash_set_memory_budget(reserved, 0);
+	BOOST_REQUIRE(!ethash_light_set_dag_prefix(light, 16384, 1));
+	BOOST_REQUIRE_EQUAL(ethash_light_dag_prefix_size(light), 8192U);
+	BOOST_REQUIRE(!ethash_light_set_memo(light, 128 * 1024));
+	BOOST_REQUIRE_EQUAL(ethash_get_memory_budget_stats().reserved, reserved);
+	BOOST_REQUIRE(ethash_light_set_dag_prefix(light, 0, 1));
+	BOOST_REQUIRE(ethash_light_set_memo(light, 0));
+	BOOST_REQUIRE_EQUAL(ethash_get_memory_budget_stats().reserved, reserved - 8192 - memo_bytes);
+
+	ethash_set_memory_budget(0, 0);
+	BOOST_REQUIRE(ethash_light_set_memo(light, 64 * 1024));
+	ethash_light_delete(light);
+	BOOST_REQUIRE_EQUAL(ethash_get_memory_budget_stats().reserved, before.reserved);
+
+	// a DAG counts its ProgPoW cache, and is built without one that does not fit
+	uint64_t const full_size = 1024 * 32;
+	light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(light);
+	reserved = before.reserved + cache_size + PROGPOW_CACHE_BYTES;
+	ethash_full_t full = ethash_full_new_memory_internal(full_size, light, 1, NULL);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE(full->progpow_cache.base);
+	BOOST_REQUIRE_EQUAL(ethash_get_memory_budget_stats().reserved, reserved + full_size + PROGPOW_CACHE_BYTES);
+	ethash_h256_t hash;
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_return_value_t const expected = progpow_full_compute(full, hash, 0x1234, 0);
+	ethash_full_delete(full);
+	ethash_set_memory_budget(reserved + full_size, 0);
+	full = ethash_full_new_memory_internal(full_size, light, 1, NULL);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE(!full->progpow_cache.base);
+	ethash_return_value_t const actual = progpow_full_compute(full, hash, 0x1234, 0);
+	BOOST_REQUIRE(memcmp(&actual.result, &expected.result, 32) == 0);
+	ethash_full_delete(full);
+	ethash_set_memory_budget(0, 0);
+	ethash_light_delete(light);
+	BOOST_REQUIRE_EQUAL(ethash_get_memory_budget_stats().reserved, before.reserved);
+}
+
+BOOST_AUTO_TEST_CASE(light_cache_file_is_written_and_reloaded) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	char mutable_name[CACHE_MUTABLE_NAME_MAX_SIZE];
+	BOOST_REQUIRE(ethash_io_cache_name(ETHASH_REVISION, &seed, mutable_name));
+	fs::path const cache_file = fs::path("./test_ethash_directory/") / mutable_name;
+
+	fs::remove_all("./test_ethash_directory/");
+	ethash_light_t computed = ethash_light_new_persistent_internal("./test_ethash_directory/", cache_size, &seed);
+	BOOST_REQUIRE(computed);
+	BOOST_REQUIRE(ethash_light_page_mode(computed) != ETHASH_PAGES_FILE);
+	BOOST_REQUIRE(fs::exists(cache_file));
+	BOOST_REQUIRE_EQUAL(fs::file_size(cache_file), cache_size + ETHASH_CACHE_HEADER_SIZE);
+
+	ethash_light_t loaded = ethash_light_new_persistent_internal("./test_ethash_directory/", cache_size, &seed);
+	BOOST_REQUIRE(loaded);
+	BOOST_REQUIRE_EQUAL(ethash_light_page_mode(loaded), ETHASH_PAGES_FILE);
+	BOOST_REQUIRE_EQUAL(loaded->cache_size, cache_size);
+	BOOST_REQUIRE(memcmp(loaded->cache, computed->cache, cache_size) == 0);
+	ethash_return_value_t computed_ret = ethash_light_compute_internal(computed, full_size, hash, 5);
+	ethash_return_value_t loaded_ret = ethash_light_compute_internal(loaded, full_size, hash, 5);
+	BOOST_REQUIRE(memcmp(&computed_ret.result, &loaded_ret.result, 32) == 0);
+	computed_ret = progpow_light_compute_internal(computed, full_size, hash, 5, 0);
+	loaded_ret = progpow_light_compute_internal(loaded, full_size, hash, 5, 0);
+	BOOST_REQUIRE(memcmp(&computed_ret.result, &loaded_ret.result, 32) == 0);
+	ethash_light_delete(loaded);
+
+	// a file with the wrong size or magic number is ignored and rewritten
+	ethash_h256_t checksum;
+	fs::resize_file(cache_file, cache_size);
+	BOOST_REQUIRE(!ethash_io_open_cache("./test_ethash_directory/", seed, cache_size, &checksum));
+	loaded = ethash_light_new_persistent_internal("./test_ethash_directory/", cache_size, &seed);
+	BOOST_REQUIRE(loaded);
+	BOOST_REQUIRE(ethash_light_page_mode(loaded) != ETHASH_PAGES_FILE);
+	BOOST_REQUIRE(memcmp(loaded->cache, computed->cache, cache_size) == 0);
+	FILE* f = ethash_io_open_cache("./test_ethash_directory/", seed, cache_size, &checksum);
+	BOOST_REQUIRE(f);
+	fclose(f);
+	ethash_light_delete(loaded);
+
+	// so is one whose nodes do not match the checksum of its header
+	f = fopen(cache_file.string().c_str(), "r+b");
+	BOOST_REQUIRE(f);
+	BOOST_REQUIRE_EQUAL(fseek(f, ETHASH_CACHE_HEADER_SIZE + 100, SEEK_SET), 0);
+	uint8_t const flipped = (uint8_t)(((uint8_t const*)computed->cache)[100] ^ 1);
+	BOOST_REQUIRE_EQUAL(fwrite(&flipped, 1, 1, f), 1U);
+	fclose(f);
+	BOOST_REQUIRE(!ethash_light_attach_internal("./test_ethash_directory/", cache_size, &seed));
+	loaded = ethash_light_new_persistent_internal("./test_ethash_directory/", cache_size, &seed);
+	BOOST_REQUIRE(loaded);
+	BOOST_REQUIRE(ethash_light_page_mode(loaded) != ETHASH_PAGES_FILE);
+	BOOST_REQUIRE(memcmp(loaded->cache, computed->cache, cache_size) == 0);
+	ethash_light_delete(loaded);
+	loaded = ethash_light_attach_internal("./test_ethash_directory/", cache_size, &seed);
+	BOOST_REQUIRE(loaded);
+	ethash_light_delete(loaded);
+
+	// and one of another seedhash with the same first 8 bytes
+	ethash_h256_t other_seed = seed;
+	other_seed.b[31] ^= 1;
+	BOOST_REQUIRE(!ethash_io_open_cache("./test_ethash_directory/", other_seed, cache_size, &checksum));
+	ethash_light_delete(computed);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+BOOST_AUTO_TEST_CASE(light_new_async_matches_light_new) {
+	uint64_t const cache_size = 1024 * 256;
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+
+	ethash_light_future_t future = ethash_light_new_async_internal(NULL, cache_size, &seed);
+	BOOST_REQUIRE(future);
+	while (!ethash_light_future_poll(future)) {
+		BOOST_REQUIRE(ethash_light_future_progress(future) <= 100);
+	}
+	BOOST_REQUIRE_EQUAL(ethash_light_future_progress(future), 100U);
+	ethash_light_t light = ethash_light_future_wait(future);
+	BOOST_REQUIRE(light);
+	ethash_light_t expected = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE_EQUAL(light->cache_size, cache_size);
+	BOOST_REQUIRE(memcmp(light->cache, expected->cache, cache_size) == 0);
+	BOOST_REQUIRE(memcmp(light->progpow_cache, expected->progpow_cache, PROGPOW_CACHE_BYTES) == 0);
+	ethash_light_delete(expected);
+	ethash_light_delete(light);
+
+	// a cancelled future stops early and leaves nothing behind
+	future = ethash_light_new_async_internal(NULL, cache_size * 64, &seed);
+	BOOST_REQUIRE(future);
+	ethash_light_future_cancel(future);
+}
+
+BOOST_AUTO_TEST_CASE(full_new_async_builds_and_cancels) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+
+	fs::remove_all("./test_ethash_directory/");
+	char const* const dirs[] = {NULL, "./test_ethash_directory/"};
+	for (char const* dir: dirs) {
+		ethash_full_future_t future = ethash_full_new_async_internal(dir, seed, full_size, light, 2, NULL);
+		BOOST_REQUIRE(future);
+		while (!ethash_full_future_poll(future)) {
+			BOOST_REQUIRE(ethash_full_future_progress(future) <= full_size);
+		}
+		BOOST_REQUIRE_EQUAL(ethash_full_future_progress(future), full_size);
+		ethash_full_t full = ethash_full_future_wait(future);
+		BOOST_REQUIRE(full);
+		BOOST_REQUIRE_EQUAL(ethash_full_dag_size(full), full_size);
+		node const* dag = (node const*)ethash_full_dag(full);
+		for (uint32_t i = 0; i < full_size / sizeof(node); ++i) {
+			node expected_node;
+			ethash_calculate_dag_item(&expected_node, i, light);
+			BOOST_REQUIRE_MESSAGE(memcmp(&expected_node, &dag[i], sizeof(node)) == 0,
+					"\nnode " << i << " differs from the light computation\n");
+		}
+		ethash_full_delete(full);
+	}
+	BOOST_REQUIRE(fs::exists("./test_ethash_directory/"));
+
+	// a cancelled build stops early and leaves nothing behind
+	ethash_full_future_t future = ethash_full_new_async_internal(NULL, seed, full_size * 1024, light, 2, NULL);
+	BOOST_REQUIRE(future);
+	ethash_full_future_cancel(future);
+
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+static std::atomic<bool> test_partial_release;
+
+// holds the build halfway until the test lets it go on
+static int test_full_callback_pause_halfway(unsigned _progress)
+{
+	while (_progress >= 50 && !test_partial_release) {
+		std::this_thread::yield();
+	}
+	return 0;
+}
+
+BOOST_AUTO_TEST_CASE(partial_dag_hashes_like_the_finished_one) {
+	ethash_h256_t seed;
+	ethash_h256_t header;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&header, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	uint64_t const full_size = 1024 * 64;
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	ethash_full_t expected = ethash_full_new_memory_internal(full_size, light, 1, NULL);
+	BOOST_REQUIRE(expected);
+
+	test_partial_release = false;
+	ethash_full_future_t future = ethash_full_new_async_internal(
+		NULL, seed, full_size, light, 1, test_full_callback_pause_halfway
+	);
+	BOOST_REQUIRE(future);
+	while (ethash_full_future_progress(future) < full_size / 2) {
+		std::this_thread::yield();
+	}
+	ethash_full_t const partial = ethash_full_future_partial(future);
+	BOOST_REQUIRE(partial);
+	uint64_t const generated = ethash_full_generated_size(partial);
+	BOOST_REQUIRE(generated > 0);
+	BOOST_REQUIRE(generated < full_size);
+
+	uint64_t nonces[10];
+	ethash_return_value_t results[10];
+	for (uint64_t nonce = 0; nonce != 10; ++nonce) {
+		nonces[nonce] = nonce;
+		ethash_return_value_t const ret = ethash_full_compute(partial, header, nonce);
+		ethash_return_value_t const want = ethash_full_compute(expected, header, nonce);
+		BOOST_REQUIRE(ret.success);
+		BOOST_REQUIRE(memcmp(&ret.result, &want.result, 32) == 0);
+		BOOST_REQUIRE(memcmp(&ret.mix_hash, &want.mix_hash, 32) == 0);
+		ethash_return_value_t const p = progpow_full_compute(partial, header, nonce, 0);
+		ethash_return_value_t const p_want = progpow_full_compute(expected, header, nonce, 0);
+		BOOST_REQUIRE(p.success);
+		BOOST_REQUIRE(memcmp(&p.result, &p_want.result, 32) == 0);
+	}
+	BOOST_REQUIRE(progpow_full_compute_batch(partial, header, nonces, results, 10, 0));
+	for (unsigned k = 0; k != 10; ++k) {
+		ethash_return_value_t const want = progpow_full_compute(expected, header, nonces[k], 0);
+		BOOST_REQUIRE(memcmp(&results[k].mix_hash, &want.mix_hash, 32) == 0);
+	}
+	BOOST_REQUIRE(ethash_full_compute_batch(partial, header, nonces, results, 10));
+	for (unsigned k = 0; k != 10; ++k) {
+		ethash_return_value_t const want = ethash_full_compute(expected, header, nonces[k]);
+		BOOST_REQUIRE(memcmp(&results[k].mix_hash, &want.mix_hash, 32) == 0);
+	}
+	// still the nodes of the first half only
+	BOOST_REQUIRE_EQUAL(ethash_full_generated_size(partial), generated);
+
+	test_partial_release = true;
+	ethash_full_t full = ethash_full_future_wait(future);
+	BOOST_REQUIRE_EQUAL(full, partial);
+	BOOST_REQUIRE_EQUAL(ethash_full_generated_size(full), full_size);
+	BOOST_REQUIRE(memcmp(ethash_full_dag(full), ethash_full_dag(expected), full_size) == 0);
+	ethash_full_delete(full);
+	ethash_full_delete(expected);
+	ethash_light_delete(light);
+}
+
+static unsigned test_lowest_progress;
+
+static int test_full_callback_record_lowest(unsigned _progress)
+{
+	if (_progress < test_lowest_progress) {
+		test_lowest_progress = _progress;
+	}
+	return 0;
+}
+
+// turn a finished DAG file back into an unfinished one, as if the process
+// had been killed before completing the header
+static void test_unfinish_dag_file(ethash_h256_t const& seed, uint64_t full_size, uint32_t checkpoint) {
+	char mutable_name[DAG_MUTABLE_NAME_MAX_SIZE];
+	BOOST_REQUIRE(ethash_io_mutable_name(ETHASH_REVISION, &seed, mutable_name));
+	FILE* f = fopen((fs::path("./test_ethash_directory/") / mutable_name).string().c_str(), "rb+");
+	BOOST_REQUIRE(f);
+	BOOST_REQUIRE(ethash_io_write_dag_header(f, seed, full_size, NULL));
+	fclose(f);
+	BOOST_REQUIRE(ethash_io_write_checkpoint("./test_ethash_directory/", seed, full_size, checkpoint));
+}
+
+BOOST_AUTO_TEST_CASE(dag_file_header_tells_the_state_of_the_file) {
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seed;
+	ethash_h256_t other_seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&other_seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~X", 32);
+	fs::remove_all("./test_ethash_directory/");
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	ethash_full_t full = ethash_full_new_internal("./test_ethash_directory/", seed, full_size, light, NULL);
+	BOOST_REQUIRE(full);
+	ethash_full_delete(full);
+
+	char mutable_name[DAG_MUTABLE_NAME_MAX_SIZE];
+	BOOST_REQUIRE(ethash_io_mutable_name(ETHASH_REVISION, &seed, mutable_name));
+	FILE* f = fopen((fs::path("./test_ethash_directory/") / mutable_name).string().c_str(), "rb+");
+	BOOST_REQUIRE(f);
+	struct ethash_io_dag_header header;
+	BOOST_REQUIRE_EQUAL(ethash_io_read_dag_header(f, seed, full_size, &header), ETHASH_IO_DAG_COMPLETE);
+	BOOST_REQUIRE_EQUAL(header.revision, (uint32_t)ETHASH_REVISION);
+	BOOST_REQUIRE_EQUAL(header.epoch, ETHASH_EVENT_NO_EPOCH);
+	BOOST_REQUIRE_EQUAL(header.file_size, full_size);
+	BOOST_REQUIRE_EQUAL(header.checksum_count, 1u);
+	BOOST_REQUIRE_EQUAL(ethash_io_read_dag_header(f, other_seed, full_size, NULL), ETHASH_IO_DAG_INVALID);
+	BOOST_REQUIRE_EQUAL(ethash_io_read_dag_header(f, seed, full_size - 128, NULL), ETHASH_IO_DAG_INVALID);
+	ethash_h256_t checksums[1];
+	BOOST_REQUIRE(ethash_io_read_checksums(f, full_size, checksums));
+
+	// a trailer that does not match the header is rejected
+	checksums[0].b[0] ^= 1;
+	BOOST_REQUIRE(ethash_io_write_checksums(f, full_size, checksums));
+	BOOST_REQUIRE(!ethash_io_read_checksums(f, full_size, checksums));
+
+	// a header of another revision makes the file stale
+	header.revision = ETHASH_REVISION - 1;
+	BOOST_REQUIRE_EQUAL(fseek(f, 0, SEEK_SET), 0);
+	BOOST_REQUIRE_EQUAL(fwrite(&header, sizeof(header), 1, f), 1U);
+	BOOST_REQUIRE_EQUAL(fflush(f), 0);
+	BOOST_REQUIRE_EQUAL(ethash_io_read_dag_header(f, seed, full_size, NULL), ETHASH_IO_DAG_INVALID);
+	BOOST_REQUIRE(ethash_io_write_dag_header(f, seed, full_size, NULL));
+	BOOST_REQUIRE_EQUAL(ethash_io_read_dag_header(f, seed, full_size, NULL), ETHASH_IO_DAG_UNFINISHED);
+	fclose(f);
+
+	// neither is taken for a complete DAG, the file is generated again
+	full = ethash_full_new_internal("./test_ethash_directory/", seed, full_size, light, test_full_callback_that_fails);
+	BOOST_REQUIRE(!full);
+	full = ethash_full_new_internal("./test_ethash_directory/", seed, full_size, light, NULL);
+	BOOST_REQUIRE(full);
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+BOOST_AUTO_TEST_CASE(unfinished_dag_file_resumes_from_checkpoint) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	uint32_t const num_nodes = (uint32_t)(full_size / sizeof(node));
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	fs::remove_all("./test_ethash_directory/");
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	ethash_full_t full = ethash_full_new_internal("./test_ethash_directory/", seed, full_size, light, NULL);
+	BOOST_REQUIRE(full);
+	ethash_full_delete(full);
+
+	// all nodes are on disk, so nothing is computed and the callback never gets to fail
+	test_unfinish_dag_file(seed, full_size, num_nodes);
+	full = ethash_full_new_internal("./test_ethash_directory/", seed, full_size, light, test_full_callback_that_fails);
+	BOOST_REQUIRE(full);
+	ethash_full_delete(full);
+	uint32_t checkpoint;
+	BOOST_REQUIRE(!ethash_io_open_checkpoint("./test_ethash_directory/", seed, full_size, &checkpoint));
+	FILE* f = NULL;
+	BOOST_REQUIRE_EQUAL(
+		ETHASH_IO_MEMO_MATCH,
+		ethash_io_prepare("./test_ethash_directory/", seed, &f, full_size, false)
+	);
+	fclose(f);
+
+	// only the second half is computed
+	test_unfinish_dag_file(seed, full_size, num_nodes / 2);
+	test_lowest_progress = 100;
+	full = ethash_full_new_parallel_internal("./test_ethash_directory/", seed, full_size, light, 2, test_full_callback_record_lowest);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE(test_lowest_progress >= 50);
+	node const* dag = (node const*)ethash_full_dag(full);
+	for (uint32_t i = 0; i < num_nodes; ++i) {
+		node expected_node;
+		ethash_calculate_dag_item(&expected_node, i, light);
+		BOOST_REQUIRE_MESSAGE(memcmp(&expected_node, &dag[i], sizeof(node)) == 0,
+				"\nnode " << i << " differs from the light computation\n");
+	}
+	ethash_full_delete(full);
+
+	// a checkpoint that does not match the file is not trusted
+	test_unfinish_dag_file(seed, full_size, num_nodes / 2);
+	{
+		char mutable_name[DAG_MUTABLE_NAME_MAX_SIZE];
+		ethash_io_mutable_name(ETHASH_REVISION, &seed, mutable_name);
+		fs::resize_file(fs::path("./test_ethash_directory/") / mutable_name, 0);
+		fs::resize_file(fs::path("./test_ethash_directory/") / mutable_name, ethash_io_dag_file_size(full_size));
+	}
+	BOOST_REQUIRE(!ethash_full_new_internal("./test_ethash_directory/", seed, full_size, light, test_full_callback_that_fails));
+	test_lowest_progress = 100;
+	full = ethash_full_new_parallel_internal("./test_ethash_directory/", seed, full_size, light, 2, test_full_callback_record_lowest);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE_EQUAL(test_lowest_progress, 0U);
+	ethash_full_delete(full);
+
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+static bool test_dag_matches_light(ethash_full_t full, ethash_light_t light, uint32_t num_nodes) {
+	node const* dag = (node const*)ethash_full_dag(full);
+	for (uint32_t i = 0; i < num_nodes; ++i) {
+		node expected_node;
+		ethash_calculate_dag_item(&expected_node, i, light);
+		if (memcmp(&expected_node, &dag[i], sizeof(node)) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+BOOST_AUTO_TEST_CASE(streamed_dag_file_matches_mapped_one) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	uint32_t const num_nodes = (uint32_t)(full_size / sizeof(node));
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	fs::remove_all("./test_ethash_directory/");
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	ethash_set_dag_write_mode(ETHASH_DAG_WRITE_STREAM);
+	BOOST_REQUIRE_EQUAL(ethash_get_dag_write_mode(), ETHASH_DAG_WRITE_STREAM);
+
+	ethash_full_t full = ethash_full_new_parallel_internal("./test_ethash_directory/", seed, full_size, light, 2, NULL);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE_EQUAL(ethash_full_page_mode(full), ETHASH_PAGES_FILE);
+	BOOST_REQUIRE(test_dag_matches_light(full, light, num_nodes));
+	ethash_full_delete(full);
+	FILE* f = NULL;
+	BOOST_REQUIRE_EQUAL(
+		ETHASH_IO_MEMO_MATCH,
+		ethash_io_prepare("./test_ethash_directory/", seed, &f, full_size, false)
+	);
+	fclose(f);
+
+	// a streamed DAG resumes from its checkpoint too
+	test_unfinish_dag_file(seed, full_size, num_nodes / 2);
+	test_lowest_progress = 100;
+	full = ethash_full_new_internal("./test_ethash_directory/", seed, full_size, light, test_full_callback_record_lowest);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE(test_lowest_progress >= 50);
+	BOOST_REQUIRE(test_dag_matches_light(full, light, num_nodes));
+	BOOST_REQUIRE(ethash_full_verify(full, 2));
+	ethash_full_delete(full);
+	uint32_t checkpoint;
+	BOOST_REQUIRE(!ethash_io_open_checkpoint("./test_ethash_directory/", seed, full_size, &checkpoint));
+
+	// a failing callback leaves an unfinished file behind
+	fs::remove_all("./test_ethash_directory/");
+	BOOST_REQUIRE(!ethash_full_new_internal("./test_ethash_directory/", seed, full_size, light, test_full_callback_that_fails));
+	BOOST_REQUIRE_EQUAL(
+		ETHASH_IO_MEMO_SIZE_MISMATCH,
+		ethash_io_prepare("./test_ethash_directory/", seed, &f, full_size, false)
+	);
+
+	ethash_set_dag_write_mode(ETHASH_DAG_WRITE_MMAP);
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+BOOST_AUTO_TEST_CASE(prefaulted_dag_file_matches_light) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	uint32_t const num_nodes = (uint32_t)(full_size / sizeof(node));
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	fs::remove_all("./test_ethash_directory/");
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	ethash_full_t full = ethash_full_new_internal("./test_ethash_directory/", seed, full_size, light, NULL);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE(ethash_full_load_time_us(full) > 0);
+	ethash_full_delete(full);
+
+	ethash_set_dag_load_mode(ETHASH_DAG_LOAD_PREFAULT);
+	BOOST_REQUIRE_EQUAL(ethash_get_dag_load_mode(), ETHASH_DAG_LOAD_PREFAULT);
+	unsigned const thread_counts[] = {0, 1, 3};
+	for (unsigned num_threads: thread_counts) {
+		// the callback fails, so the DAG must come from the file
+		full = ethash_full_new_parallel_internal("./test_ethash_directory/", seed, full_size, light, num_threads, test_full_callback_that_fails);
+		BOOST_REQUIRE(full);
+		BOOST_REQUIRE_EQUAL(ethash_full_page_mode(full), ETHASH_PAGES_FILE);
+		BOOST_REQUIRE(test_dag_matches_light(full, light, num_nodes));
+		ethash_return_value_t const light_ret = ethash_light_compute_internal(light, full_size, hash, 5);
+		ethash_return_value_t const full_ret = ethash_full_compute(full, hash, 5);
+		BOOST_REQUIRE(memcmp(&light_ret.result, &full_ret.result, 32) == 0);
+		ethash_full_delete(full);
+	}
+	ethash_set_dag_load_mode(ETHASH_DAG_LOAD_LAZY);
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+BOOST_AUTO_TEST_CASE(read_dag_file_loads_into_anonymous_memory) {
+	uint64_t const cache_size = 1024;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	// the second size leaves a tail that direct reads can not take
+	uint64_t const full_sizes[] = {1024 * 32, 1024 * 32 + 3 * 128};
+	unsigned const thread_counts[] = {0, 1, 3};
+	for (uint64_t full_size: full_sizes) {
+		fs::remove_all("./test_ethash_directory/");
+		ethash_full_t full = ethash_full_new_internal("./test_ethash_directory/", seed, full_size, light, NULL);
+		BOOST_REQUIRE(full);
+		ethash_full_delete(full);
+
+		ethash_set_dag_load_mode(ETHASH_DAG_LOAD_READ);
+		for (unsigned num_threads: thread_counts) {
+			// the callback fails, so the DAG must come from the file
+			full = ethash_full_new_parallel_internal("./test_ethash_directory/", seed, full_size, light, num_threads, test_full_callback_that_fails);
+			BOOST_REQUIRE(full);
+			BOOST_REQUIRE(full->file == NULL);
+			BOOST_REQUIRE(ethash_full_page_mode(full) != ETHASH_PAGES_FILE);
+			BOOST_REQUIRE(test_dag_matches_light(full, light, (uint32_t)(full_size / sizeof(node))));
+			BOOST_REQUIRE(ethash_full_verify(full, 1));
+			ethash_return_value_t const light_ret = ethash_light_compute_internal(light, full_size, hash, 5);
+			ethash_return_value_t const full_ret = ethash_full_compute(full, hash, 5);
+			BOOST_REQUIRE(memcmp(&light_ret.result, &full_ret.result, 32) == 0);
+			ethash_full_delete(full);
+		}
+		ethash_set_dag_load_mode(ETHASH_DAG_LOAD_LAZY);
+	}
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+BOOST_AUTO_TEST_CASE(dag_checksums_detect_corruption) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	fs::remove_all("./test_ethash_directory/");
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+
+	ethash_full_t full = ethash_full_new_memory_internal(full_size, light, 2, NULL);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE(ethash_full_verify(full, 2));
+	((uint8_t*)ethash_full_dag(full))[full_size / 2] ^= 1;
+	BOOST_REQUIRE(!ethash_full_verify(full, 2));
+	ethash_full_delete(full);
+
+	full = ethash_full_new_internal("./test_ethash_directory/", seed, full_size, light, NULL);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE(ethash_full_verify(full, 1));
+	ethash_full_delete(full);
+	char mutable_name[DAG_MUTABLE_NAME_MAX_SIZE];
+	BOOST_REQUIRE(ethash_io_mutable_name(ETHASH_REVISION, &seed, mutable_name));
+	fs::path const dag_file = fs::path("./test_ethash_directory/") / mutable_name;
+	BOOST_REQUIRE_EQUAL(fs::file_size(dag_file), ethash_io_dag_file_size(full_size));
+
+	// loading the file does not notice, verifying does
+	FILE* f = fopen(dag_file.string().c_str(), "rb+");
+	BOOST_REQUIRE(f);
+	BOOST_REQUIRE_EQUAL(fseek(f, ETHASH_DAG_HEADER_SIZE + 100, SEEK_SET), 0);
+	BOOST_REQUIRE_EQUAL(fputc(0x5a, f), 0x5a);
+	fclose(f);
+	full = ethash_full_new_internal("./test_ethash_directory/", seed, full_size, light, test_full_callback_that_fails);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE(!ethash_full_verify(full, 0));
+	ethash_full_delete(full);
+
+	// the same goes for a DAG loaded into anonymous memory
+	ethash_set_huge_pages(ETHASH_HUGE_PAGES_TRANSPARENT);
+	full = ethash_full_new_internal("./test_ethash_directory/", seed, full_size, light, test_full_callback_that_fails);
+	ethash_set_huge_pages(ETHASH_HUGE_PAGES_OFF);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE(!ethash_full_verify(full, 0));
+	ethash_full_delete(full);
+
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+BOOST_AUTO_TEST_CASE(light_verify_batch_matches_single_verification) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	size_t const count = 12;
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(light);
+
+	std::vector<ethash_h256_t> headers(count);
+	std::vector<uint64_t> nonces(count);
+	std::vector<ethash_h256_t> mix_hashes(count);
+	std::vector<ethash_h256_t> boundaries(count);
+	for (size_t i = 0; i != count; ++i) {
+		memcpy(&headers[i], "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+		ethash_h256_set(&headers[i], 0, (uint8_t)i);
+		nonces[i] = 0x7c7c597c + i;
+		ethash_return_value_t const ret = ethash_light_compute_internal(light, full_size, headers[i], nonces[i]);
+		BOOST_REQUIRE(ret.success);
+		mix_hashes[i] = ret.mix_hash;
+		memset(&boundaries[i], 0xff, 32);
+	}
+	// a wrong mix hash, a wrong nonce and a boundary below the result
+	ethash_h256_set(&mix_hashes[3], 7, ethash_h256_get(&mix_hashes[3], 7) ^ 1);
+	nonces[5] += 1000;
+	ethash_h256_reset(&boundaries[8]);
+
+	for (unsigned threads: {1u, 3u, 0u}) {
+		bool results[count];
+		size_t const valid = ethash_light_verify_batch_internal(
+			light, full_size, headers.data(), nonces.data(), mix_hashes.data(), boundaries.data(),
+			results, count, threads
+		);
+		BOOST_REQUIRE_EQUAL(valid, count - 3);
+		for (size_t i = 0; i != count; ++i) {
+			BOOST_REQUIRE_EQUAL(results[i], i != 3 && i != 5 && i != 8);
+		}
+	}
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(full_verify_batch_matches_light_verification) {
+	uint64_t const full_size = 1024 * 32;
+	size_t const count = 21;
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	BOOST_REQUIRE(light);
+	ethash_full_t full = ethash_full_new_memory_internal(full_size, light, 1, NULL);
+	BOOST_REQUIRE(full);
+
+	std::vector<ethash_h256_t> headers(count);
+	std::vector<uint64_t> nonces(count);
+	std::vector<ethash_h256_t> mix_hashes(count);
+	std::vector<ethash_h256_t> boundaries(count);
+	for (size_t i = 0; i != count; ++i) {
+		memcpy(&headers[i], "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+		ethash_h256_set(&headers[i], 0, (uint8_t)i);
+		nonces[i] = 0x7c7c597c + i;
+		ethash_return_value_t const ret = ethash_light_compute_internal(light, full_size, headers[i], nonces[i]);
+		BOOST_REQUIRE(ret.success);
+		mix_hashes[i] = ret.mix_hash;
+		memset(&boundaries[i], 0xff, 32);
+	}
+	// a wrong mix hash, a wrong nonce and a boundary below the result
+	ethash_h256_set(&mix_hashes[3], 7, ethash_h256_get(&mix_hashes[3], 7) ^ 1);
+	nonces[10] += 1000;
+	ethash_h256_reset(&boundaries[20]);
+
+	unsigned const hash_batch = ethash_get_hash_batch();
+	for (unsigned batch: {1u, 4u, (unsigned)ETHASH_MAX_HASH_BATCH}) {
+		ethash_set_hash_batch(batch);
+		for (unsigned threads: {1u, 3u, 0u}) {
+			bool results[count];
+			size_t const valid = ethash_full_verify_batch(
+				full, headers.data(), nonces.data(), mix_hashes.data(), boundaries.data(),
+				results, count, threads
+			);
+			BOOST_REQUIRE_EQUAL(valid, count - 3);
+			for (size_t i = 0; i != count; ++i) {
+				BOOST_REQUIRE_EQUAL(results[i], i != 3 && i != 10 && i != 20);
+			}
+		}
+	}
+	ethash_set_hash_batch(hash_batch);
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(interleaved_light_hashes_match_single_hashes) {
+	uint64_t const full_size = 1024 * 32;
+	size_t const count = 19;
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	BOOST_REQUIRE(light);
+
+	std::vector<ethash_h256_t> headers(count);
+	std::vector<uint64_t> nonces(count);
+	std::vector<ethash_return_value_t> expected(count);
+	for (size_t i = 0; i != count; ++i) {
+		memcpy(&headers[i], "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+		ethash_h256_set(&headers[i], 0, (uint8_t)(i / 2));
+		nonces[i] = 0x7c7c597c + i;
+		expected[i] = ethash_light_compute_internal(light, full_size, headers[i], nonces[i]);
+		BOOST_REQUIRE(expected[i].success);
+	}
+	// plain, then with some items in the DAG prefix and the rest going through a memo
+	for (int pass = 0; pass != 2; ++pass) {
+		if (pass == 1) {
+			BOOST_REQUIRE(ethash_light_set_dag_prefix(light, 4096, 1));
+			BOOST_REQUIRE(ethash_light_set_memo(light, 1 << 16));
+		}
+		for (unsigned lanes: {1u, 3u, 8u, 16u}) {
+			ethash_set_light_interleave(lanes);
+			BOOST_REQUIRE_EQUAL(ethash_get_light_interleave(), lanes);
+			std::vector<ethash_return_value_t> results(count);
+			ethash_light_compute_interleaved_internal(light, full_size, headers.data(), nonces.data(), results.data(), count);
+			for (size_t i = 0; i != count; ++i) {
+				BOOST_REQUIRE(results[i].success);
+				BOOST_REQUIRE(memcmp(&results[i].mix_hash, &expected[i].mix_hash, 32) == 0);
+				BOOST_REQUIRE(memcmp(&results[i].result, &expected[i].result, 32) == 0);
+			}
+		}
+	}
+	ethash_set_light_interleave(0);
+	BOOST_REQUIRE_EQUAL(ethash_get_light_interleave(), 1U);
+	ethash_set_light_interleave(100);
+	BOOST_REQUIRE_EQUAL(ethash_get_light_interleave(), 16U);
+	ethash_set_light_interleave(8);
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(quick_checks_match_light_results) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	uint64_t const nonce = 0x7c7c597c;
+	uint64_t const block_number = 30000;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(light);
+
+	ethash_return_value_t const ethash = ethash_light_compute_internal(light, full_size, hash, nonce);
+	ethash_return_value_t const progpow = progpow_light_compute_internal(light, full_size, hash, nonce, block_number);
+	BOOST_REQUIRE(ethash.success && progpow.success);
+
+	// a boundary equal to the result passes, one just below it does not
+	ethash_h256_t boundary = ethash.result;
+	BOOST_REQUIRE(ethash_quick_check_difficulty(&hash, nonce, &ethash.mix_hash, &boundary));
+	ethash_h256_t below = boundary;
+	BOOST_REQUIRE(ethash_h256_get(&below, 31) != 0);
+	ethash_h256_set(&below, 31, ethash_h256_get(&below, 31) - 1);
+	BOOST_REQUIRE(!ethash_quick_check_difficulty(&hash, nonce, &ethash.mix_hash, &below));
+
+	boundary = progpow.result;
+	BOOST_REQUIRE(progpow_quick_check_difficulty(&hash, nonce, &progpow.mix_hash, &boundary));
+	below = boundary;
+	BOOST_REQUIRE(ethash_h256_get(&below, 31) != 0);
+	ethash_h256_set(&below, 31, ethash_h256_get(&below, 31) - 1);
+	BOOST_REQUIRE(!progpow_quick_check_difficulty(&hash, nonce, &progpow.mix_hash, &below));
+
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(progpow_jit_gives_the_same_hashes) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(light);
+	BOOST_REQUIRE(ethash_progpow_set_jit(false));
+	// more periods than the generated code is kept for
+	std::vector<ethash_return_value_t> expected;
+	for (uint64_t period = 0; period != 12; ++period) {
+		expected.push_back(progpow_light_compute_internal(light, full_size, hash, period, period * PROGPOW_PERIOD));
+	}
+	if (!ethash_progpow_set_jit(true)) {
+		ethash_light_delete(light);
+		BOOST_TEST_MESSAGE("the ProgPoW JIT is not supported on this host");
+		return;
+	}
+	for (int round = 0; round != 2; ++round) {
+		for (uint64_t period = 0; period != 12; ++period) {
+			ethash_return_value_t const p = progpow_light_compute_internal(light, full_size, hash, period, period * PROGPOW_PERIOD);
+			BOOST_REQUIRE_MESSAGE(memcmp(&p.mix_hash, &expected[period].mix_hash, 32) == 0,
+					"\nthe generated code of period " << period << " gives another mix hash\n");
+			BOOST_REQUIRE(memcmp(&p.result, &expected[period].result, 32) == 0);
+		}
+	}
+
+	// single iterations with random mixes, which reach all the ops more often
+	std::vector<uint32_t> c_dag(PROGPOW_CACHE_WORDS);
+	uint32_t x = 0x2545f491;
+	for (uint32_t& w : c_dag) {
+		x = x * 1664525 + 1013904223;
+		w = x;
+	}
+	ethash_progpow_loop_kernel_t const* generic = NULL;
+	for (unsigned k = 0; ethash_progpow_loop_kernel_at(k); ++k) {
+		generic = ethash_progpow_loop_kernel_at(k);
+	}
+	ethash_fastmod_t const dag_entries = progpow_dag_entries(full_size);
+	for (uint64_t prog_seed = 0; prog_seed != 16; ++prog_seed) {
+		progpow_program_t prog;
+		progpow_program_init(&prog, prog_seed * 104729);
+		progpow_jit_t* const jit = progpow_jit_acquire(&prog);
+		BOOST_REQUIRE(jit);
+		for (uint32_t loop = 0; loop != 4; ++loop) {
+			uint32_t expected_mix[PROGPOW_LANES][PROGPOW_REGS];
+			for (auto& lane : expected_mix) {
+				for (uint32_t& w : lane) {
+					x = x * 1664525 + 1013904223;
+					w = (x >> 28) == 0 ? 0 : x;
+				}
+			}
+			uint32_t actual[PROGPOW_LANES][PROGPOW_REGS];
+			memcpy(actual, expected_mix, sizeof(actual));
+			generic->loop(&prog, loop, light, expected_mix, NULL, c_dag.data(), &dag_entries);
+			progpow_jit_loop(jit, loop, light, actual, NULL, c_dag.data(), &dag_entries);
+			BOOST_REQUIRE_MESSAGE(memcmp(expected_mix, actual, sizeof(actual)) == 0,
+					"\nthe generated code of program " << prog_seed << " differs at loop " << loop << "\n");
+		}
+		progpow_jit_release(jit);
+	}
+
+	BOOST_REQUIRE(ethash_progpow_set_jit(false));
+	BOOST_REQUIRE(!progpow_jit_acquire(progpow_program_get(0)));
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(progpow_jit_is_shared_by_threads) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(light);
+	BOOST_REQUIRE(ethash_progpow_set_jit(false));
+	std::vector<ethash_return_value_t> expected;
+	for (uint64_t period = 0; period != 12; ++period) {
+		expected.push_back(progpow_light_compute_internal(light, full_size, hash, period, period * PROGPOW_PERIOD));
+	}
+	if (!ethash_progpow_set_jit(true)) {
+		ethash_light_delete(light);
+		BOOST_TEST_MESSAGE("the ProgPoW JIT is not supported on this host");
+		return;
+	}
+	// more periods than slots, so code is evicted while other threads take it
+	std::atomic<unsigned> mismatches(0);
+	std::vector<std::thread> threads;
+	for (unsigned t = 0; t != 4; ++t) {
+		threads.emplace_back([&, t] {
+			for (unsigned i = 0; i != 120; ++i) {
+				uint64_t const period = (i / (2 + t) + t) % 12;
+				ethash_return_value_t const p = progpow_light_compute_internal(light, full_size, hash, period, period * PROGPOW_PERIOD);
+				if (memcmp(&p.mix_hash, &expected[period].mix_hash, 32) != 0) {
+					mismatches++;
+				}
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	BOOST_REQUIRE_EQUAL(mismatches.load(), 0U);
+	BOOST_REQUIRE(ethash_progpow_set_jit(false));
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(progpow_kernel_source_is_generated_per_period) {
+	enum progpow_source_target const targets[] = {PROGPOW_SOURCE_OPENCL, PROGPOW_SOURCE_CUDA, PROGPOW_SOURCE_C};
+	char const* const functions[] = {"void progpow_period_loop(", "__device__", "void progpow_period_lane("};
+	for (unsigned t = 0; t != 3; ++t) {
+		size_t const length = progpow_get_kernel_source(1234, targets[t], NULL, 0);
+		BOOST_REQUIRE(length > 0);
+		std::string source(length + 1, 'x');
+		BOOST_REQUIRE_EQUAL(progpow_get_kernel_source(1234, targets[t], &source[0], source.size()), length);
+		BOOST_REQUIRE_EQUAL(source[length], '\0');
+		source.resize(length);
+		BOOST_REQUIRE(source.find(functions[t]) != std::string::npos);
+
+		// a short buffer gets the start of the source
+		char start[16];
+		BOOST_REQUIRE_EQUAL(progpow_get_kernel_source(1234, targets[t], start, sizeof(start)), length);
+		BOOST_REQUIRE_EQUAL(std::string(start), source.substr(0, sizeof(start) - 1));
+
+		std::string other(progpow_get_kernel_source(1235, targets[t], NULL, 0) + 1, '\0');
+		progpow_get_kernel_source(1235, targets[t], &other[0], other.size());
+		BOOST_REQUIRE(other.c_str() != source);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(progpow_jit_compiler_gives_the_same_code) {
+	if (system("cc --version >/dev/null 2>&1") != 0 || !ethash_progpow_set_jit_compiler("cc")) {
+		BOOST_TEST_MESSAGE("no C compiler to generate the ProgPoW code with");
+		return;
+	}
+	BOOST_REQUIRE(ethash_progpow_set_jit(true));
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	BOOST_REQUIRE(light);
+	std::vector<uint32_t> c_dag(PROGPOW_CACHE_WORDS);
+	uint32_t x = 0x2545f491;
+	for (uint32_t& w : c_dag) {
+		x = x * 1664525 + 1013904223;
+		w = x;
+	}
+	ethash_progpow_loop_kernel_t const* generic = NULL;
+	for (unsigned k = 0; ethash_progpow_loop_kernel_at(k); ++k) {
+		generic = ethash_progpow_loop_kernel_at(k);
+	}
+	ethash_fastmod_t const dag_entries = progpow_dag_entries(1024 * 32);
+	for (uint64_t prog_seed = 0; prog_seed != 3; ++prog_seed) {
+		progpow_program_t prog;
+		progpow_program_init(&prog, prog_seed * 7919);
+		progpow_jit_t* const jit = progpow_jit_acquire(&prog);
+		BOOST_REQUIRE(jit);
+		for (uint32_t loop = 0; loop != 4; ++loop) {
+			uint32_t expected_mix[PROGPOW_LANES][PROGPOW_REGS];
+			for (auto& lane : expected_mix) {
+				for (uint32_t& w : lane) {
+					x = x * 1664525 + 1013904223;
+					w = (x >> 28) == 0 ? 0 : x;
+				}
+			}
+			uint32_t actual[PROGPOW_LANES][PROGPOW_REGS];
+			memcpy(actual, expected_mix, sizeof(actual));
+			generic->loop(&prog, loop, light, expected_mix, NULL, c_dag.data(), &dag_entries);
+			progpow_jit_loop(jit, loop, light, actual, NULL, c_dag.data(), &dag_entries);
+			BOOST_REQUIRE_MESSAGE(memcmp(expected_mix, actual, sizeof(actual)) == 0,
+					"\nthe compiled code of program " << prog_seed << " differs at loop " << loop << "\n");
+		}
+		progpow_jit_release(jit);
+	}
+
+	// a compiler that fails leaves the templates, where there are any
+	BOOST_REQUIRE(ethash_progpow_set_jit_compiler("false"));
+	progpow_jit_t* const jit = progpow_jit_acquire(progpow_program_get(3));
+#if defined(__x86_64__) || defined(_M_X64)
+	BOOST_REQUIRE(jit || !(ethash_cpu_features() & ETHASH_CPU_POPCNT));
+#endif
+	progpow_jit_release(jit);
+
+	BOOST_REQUIRE(ethash_progpow_set_jit_compiler(NULL));
+	BOOST_REQUIRE(ethash_progpow_set_jit(false));
+	ethash_light_delete(light);
+}
+
+#if !defined(_WIN32)
+BOOST_AUTO_TEST_CASE(progpow_jit_does_not_wait_for_the_compiler) {
+	// a compiler that takes a second and fails
+	BOOST_REQUIRE(ethash_progpow_set_jit_compiler("sleep 1; false"));
+	BOOST_REQUIRE(ethash_progpow_set_jit(true));
+	progpow_program_t prog;
+	progpow_program_init(&prog, 104723);
+	std::atomic<bool> started(false);
+	progpow_jit_t* compiled = NULL;
+	std::thread compiling([&] {
+		started = true;
+		compiled = progpow_jit_acquire(&prog);
+	});
+	while (!started) {
+		std::this_thread::yield();
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+	// the period being compiled falls back to the kernel, another one is not held up
+	auto const begin = std::chrono::steady_clock::now();
+	BOOST_REQUIRE(!progpow_jit_acquire(&prog));
+	ethash_progpow_set_jit_compiler(NULL);
+	progpow_program_t other;
+	progpow_program_init(&other, 104729);
+	progpow_jit_t* const jit = progpow_jit_acquire(&other);
+	auto const waited = std::chrono::steady_clock::now() - begin;
+	BOOST_REQUIRE(waited < std::chrono::milliseconds(500));
+	progpow_jit_release(jit);
+
+	compiling.join();
+	// generated with a compiler that is no longer set, so not kept
+	BOOST_REQUIRE(!compiled);
+	BOOST_REQUIRE(ethash_progpow_set_jit(false));
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(progpow_full_cache_is_kept_with_the_dag) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(light);
+	ethash_full_t full = ethash_full_new_memory_internal(full_size, light, 1, NULL);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE(full->progpow_cache.base);
+	BOOST_REQUIRE_EQUAL((uintptr_t)full->progpow_cache.base % 64, 0U);
+	BOOST_REQUIRE(memcmp(full->progpow_cache.base, ethash_full_dag(full), PROGPOW_CACHE_BYTES) == 0);
+	for (uint64_t nonce = 0; nonce != 4; ++nonce) {
+		ethash_return_value_t const l = progpow_light_compute_internal(light, full_size, hash, nonce, 30000);
+		ethash_return_value_t const f = progpow_full_compute(full, hash, nonce, 30000);
+		BOOST_REQUIRE(memcmp(&l.mix_hash, &f.mix_hash, 32) == 0);
+		BOOST_REQUIRE(memcmp(&l.result, &f.result, 32) == 0);
+	}
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(full_compute_batch_matches_single_hashes) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(light);
+	ethash_full_t full = ethash_full_new_memory_internal(full_size, light, 1, NULL);
+	BOOST_REQUIRE(full);
+
+	// not a multiple of the batch, and nonces in no particular order
+	std::vector<uint64_t> nonces;
+	for (uint64_t i = 0; i != 2 * ETHASH_HASH_BATCH + 3; ++i) {
+		nonces.push_back(i * 0x9e3779b97f4a7c15ULL);
+	}
+	std::vector<ethash_return_value_t> results(nonces.size());
+	BOOST_REQUIRE(ethash_full_compute_batch(full, hash, nonces.data(), results.data(), nonces.size()));
+	for (size_t i = 0; i != nonces.size(); ++i) {
+		ethash_return_value_t const expected = ethash_full_compute(full, hash, nonces[i]);
+		BOOST_REQUIRE(results[i].success);
+		BOOST_REQUIRE(memcmp(&results[i].mix_hash, &expected.mix_hash, 32) == 0);
+		BOOST_REQUIRE(memcmp(&results[i].result, &expected.result, 32) == 0);
+	}
+	BOOST_REQUIRE(progpow_full_compute_batch(full, hash, nonces.data(), results.data(), nonces.size(), 30000));
+	for (size_t i = 0; i != nonces.size(); ++i) {
+		ethash_return_value_t const expected = progpow_full_compute(full, hash, nonces[i], 30000);
+		BOOST_REQUIRE(results[i].success);
+		BOOST_REQUIRE(memcmp(&results[i].mix_hash, &expected.mix_hash, 32) == 0);
+		BOOST_REQUIRE(memcmp(&results[i].result, &expected.result, 32) == 0);
+	}
+	BOOST_REQUIRE(ethash_full_compute_batch(full, hash, nonces.data(), results.data(), 0));
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(dag_prefetch_does_not_change_hashes) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(light);
+	ethash_full_t full = ethash_full_new_memory_internal(full_size, light, 1, NULL);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE(ethash_get_prefetch());
+	for (uint64_t nonce = 0; nonce != 4; ++nonce) {
+		ethash_return_value_t const e = ethash_full_compute(full, hash, nonce);
+		ethash_return_value_t const p = progpow_full_compute(full, hash, nonce, 30000);
+		ethash_set_prefetch(false);
+		BOOST_REQUIRE(!ethash_get_prefetch());
+		ethash_return_value_t const e_off = ethash_full_compute(full, hash, nonce);
+		ethash_return_value_t const p_off = progpow_full_compute(full, hash, nonce, 30000);
+		ethash_set_prefetch(true);
+		BOOST_REQUIRE(memcmp(&e.result, &e_off.result, 32) == 0);
+		BOOST_REQUIRE(memcmp(&p.result, &p_off.result, 32) == 0);
+		BOOST_REQUIRE(memcmp(&p.mix_hash, &p_off.mix_hash, 32) == 0);
+	}
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(light_memo_gives_the_same_hashes) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(light);
+	std::vector<ethash_return_value_t> expected;
+	for (uint64_t nonce = 0; nonce != 4; ++nonce) {
+		expected.push_back(ethash_light_compute_internal(light, full_size, hash, nonce));
+		expected.push_back(progpow_light_compute_internal(light, full_size, hash, nonce, 30000));
+	}
+
+	BOOST_REQUIRE(!ethash_light_set_memo(light, 64));
+	BOOST_REQUIRE_EQUAL(ethash_light_memo_stats(light).entries, 0U);
+	BOOST_REQUIRE(ethash_light_set_memo(light, 1 << 20));
+	ethash_light_memo_stats_t stats = ethash_light_memo_stats(light);
+	BOOST_REQUIRE(stats.entries > 0 && stats.entries <= (1 << 20) / sizeof(node));
+	for (int round = 0; round != 2; ++round) {
+		for (uint64_t nonce = 0; nonce != 4; ++nonce) {
+			ethash_return_value_t const e = ethash_light_compute_internal(light, full_size, hash, nonce);
+			ethash_return_value_t const p = progpow_light_compute_internal(light, full_size, hash, nonce, 30000);
+			BOOST_REQUIRE(memcmp(&e.mix_hash, &expected[2 * nonce].mix_hash, 32) == 0);
+			BOOST_REQUIRE(memcmp(&e.result, &expected[2 * nonce].result, 32) == 0);
+			BOOST_REQUIRE(memcmp(&p.mix_hash, &expected[2 * nonce + 1].mix_hash, 32) == 0);
+			BOOST_REQUIRE(memcmp(&p.result, &expected[2 * nonce + 1].result, 32) == 0);
+		}
+		ethash_light_memo_stats_t const now = ethash_light_memo_stats(light);
+		if (round == 0) {
+			BOOST_REQUIRE(now.misses > 0);
+		} else {
+			// the DAG of the test is small enough to be remembered whole
+			BOOST_REQUIRE_EQUAL(now.misses, stats.misses);
+			BOOST_REQUIRE(now.hits > stats.hits);
+		}
+		stats = now;
+	}
+
+	BOOST_REQUIRE(ethash_light_set_memo(light, 0));
+	BOOST_REQUIRE_EQUAL(ethash_light_memo_stats(light).hits, 0U);
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(result_cache_answers_repeated_light_hashes) {
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seeds[2];
+	ethash_h256_t hash;
+	memcpy(&seeds[0], "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&seeds[1], "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~X", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t lights[2] = { ethash_light_new_internal(1024, &seeds[0]), ethash_light_new_internal(1024, &seeds[1]) };
+	BOOST_REQUIRE(lights[0] && lights[1]);
+	// for both epochs the ethash hash and the ProgPoW hashes of two periods of every nonce
+	std::vector<ethash_return_value_t> expected;
+	for (unsigned l = 0; l != 2; ++l) {
+		for (uint64_t nonce = 0; nonce != 4; ++nonce) {
+			expected.push_back(ethash_light_compute_internal(lights[l], full_size, hash, nonce));
+			expected.push_back(progpow_light_compute_internal(lights[l], full_size, hash, nonce, 49));
+			expected.push_back(progpow_light_compute_internal(lights[l], full_size, hash, nonce, 50));
+		}
+	}
+	BOOST_REQUIRE(memcmp(&expected[1].result, &expected[2].result, 32) != 0);
+
+	ethash_result_cache_stats_t stats = ethash_get_result_cache_stats();
+	BOOST_REQUIRE_EQUAL(stats.entries, 0U);
+	ethash_set_result_cache(1000);
+	BOOST_REQUIRE_EQUAL(ethash_get_result_cache_stats().entries, 512U);
+	for (int round = 0; round != 2; ++round) {
+		for (unsigned l = 0; l != 2; ++l) {
+			for (uint64_t nonce = 0; nonce != 4; ++nonce) {
+				ethash_return_value_t const got[3] = {
+					ethash_light_compute_internal(lights[l], full_size, hash, nonce),
+					progpow_light_compute_internal(lights[l], full_size, hash, nonce, 49),
+					progpow_light_compute_internal(lights[l], full_size, hash, nonce, 50)
+				};
+				for (unsigned k = 0; k != 3; ++k) {
+					ethash_return_value_t const& want = expected[(l * 4 + nonce) * 3 + k];
+					BOOST_REQUIRE(got[k].success);
+					BOOST_REQUIRE(memcmp(&got[k].mix_hash, &want.mix_hash, 32) == 0);
+					BOOST_REQUIRE(memcmp(&got[k].result, &want.result, 32) == 0);
+				}
+			}
+		}
+		ethash_result_cache_stats_t const now = ethash_get_result_cache_stats();
+		// the first round misses every hash, the second finds them all
+		BOOST_REQUIRE_EQUAL(now.misses - stats.misses, round == 0 ? 24U : 0U);
+		BOOST_REQUIRE_EQUAL(now.hits - stats.hits, round == 0 ? 0U : 24U);
+		stats = now;
+	}
+
+	ethash_set_result_cache(0);
+	ethash_light_compute_internal(lights[0], full_size, hash, 0);
+	BOOST_REQUIRE_EQUAL(ethash_get_result_cache_stats().hits, stats.hits);
+	BOOST_REQUIRE_EQUAL(ethash_get_result_cache_stats().misses, stats.misses);
+	ethash_light_delete(lights[0]);
+	ethash_light_delete(lights[1]);
+}
+
+BOOST_AUTO_TEST_CASE(result_cache_of_few_entries_is_shared_by_threads) {
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	BOOST_REQUIRE(light);
+	// more nonces than entries, so the threads keep replacing each other's
+	std::vector<ethash_return_value_t> expected;
+	for (uint64_t nonce = 0; nonce != 256; ++nonce) {
+		expected.push_back(ethash_light_compute_internal(light, full_size, hash, nonce));
+	}
+	// a table this small still has one entry per lock
+	ethash_set_result_cache(4);
+	BOOST_REQUIRE_EQUAL(ethash_get_result_cache_stats().entries, 64U);
+	std::atomic<unsigned> mismatches(0);
+	std::vector<std::thread> threads;
+	for (unsigned t = 0; t != 4; ++t) {
+		threads.emplace_back([&, t] {
+			for (unsigned round = 0; round != 8; ++round) {
+				for (uint64_t i = 0; i != 256; ++i) {
+					uint64_t const nonce = (i * (2 * t + 1) + round) % 256;
+					ethash_return_value_t const got = ethash_light_compute_internal(light, full_size, hash, nonce);
+					if (memcmp(&got.mix_hash, &expected[nonce].mix_hash, 32) != 0 ||
+							memcmp(&got.result, &expected[nonce].result, 32) != 0) {
+						mismatches++;
+					}
+				}
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	ethash_set_result_cache(0);
+	BOOST_REQUIRE_EQUAL(mismatches.load(), 0U);
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(light_dag_prefix_gives_the_same_hashes) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(light);
+	std::vector<ethash_return_value_t> expected;
+	for (uint64_t nonce = 0; nonce != 4; ++nonce) {
+		expected.push_back(ethash_light_compute_internal(light, full_size, hash, nonce));
+		expected.push_back(progpow_light_compute_internal(light, full_size, hash, nonce, 30000));
+	}
+
+	// half of the DAG, then more than all of it and not in whole DAG items
+	for (uint64_t prefix: {full_size / 2, full_size + 100}) {
+		BOOST_REQUIRE(ethash_light_set_dag_prefix(light, prefix, 2));
+		BOOST_REQUIRE_EQUAL(ethash_light_dag_prefix_size(light), prefix / sizeof(node) * sizeof(node));
+		node const* dag = (node const*)light->dag_prefix.base;
+		for (uint32_t i = 0; i != light->dag_prefix_nodes; ++i) {
+			node expected_node;
+			ethash_calculate_dag_item(&expected_node, i, light);
+			BOOST_REQUIRE(memcmp(&expected_node, &dag[i], sizeof(node)) == 0);
+		}
+		for (uint64_t nonce = 0; nonce != 4; ++nonce) {
+			ethash_return_value_t const e = ethash_light_compute_internal(light, full_size, hash, nonce);
+			ethash_return_value_t const p = progpow_light_compute_internal(light, full_size, hash, nonce, 30000);
+			BOOST_REQUIRE(memcmp(&e.mix_hash, &expected[2 * nonce].mix_hash, 32) == 0);
+			BOOST_REQUIRE(memcmp(&e.result, &expected[2 * nonce].result, 32) == 0);
+			BOOST_REQUIRE(memcmp(&p.mix_hash, &expected[2 * nonce + 1].mix_hash, 32) == 0);
+			BOOST_REQUIRE(memcmp(&p.result, &expected[2 * nonce + 1].result, 32) == 0);
+		}
+	}
+	BOOST_REQUIRE(ethash_light_set_dag_prefix(light, 0, 1));
+	BOOST_REQUIRE_EQUAL(ethash_light_dag_prefix_size(light), 0U);
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(fastmod_matches_the_remainder) {
+	uint32_t const divisors[] = {1, 2, 3, 7, 64, 255, 256, 1000003, 8388593, 0x7fffffff, 0x80000000, 0xffffffff};
+	uint32_t const values[] = {0, 1, 2, 63, 64, 65, 1000002, 0x7fffffff, 0x80000000, 0xfffffffe, 0xffffffff};
+	for (uint32_t d : divisors) {
+		ethash_fastmod_t const mod = ethash_fastmod_init(d);
+		ethash::fast_mod32 const mod32(d);
+		BOOST_REQUIRE_EQUAL(mod32.divisor(), d);
+		for (uint32_t x : values) {
+			BOOST_REQUIRE_EQUAL(ethash_fastmod(&mod, x), x % d);
+			BOOST_REQUIRE_EQUAL(mod32(x), x % d);
+		}
+		uint32_t x = d;
+		for (unsigned i = 0; i != 10000; ++i) {
+			x = x * 1664525 + 1013904223;
+			BOOST_REQUIRE_EQUAL(ethash_fastmod(&mod, x), x % d);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(templated_hashes_match_the_c_functions) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(light);
+	ethash_full_t full = ethash_full_new_memory_internal(full_size, light, 1, NULL);
+	BOOST_REQUIRE(full);
+	node const* const dag = (node const*)ethash_full_dag(full);
+
+	ethash::ethash_hasher<ethash::ethash_default> const ethash_light(light, NULL, full_size);
+	ethash::ethash_hasher<ethash::ethash_default> const ethash_full(NULL, dag, full_size);
+	ethash::progpow_hasher<ethash::progpow_default> const progpow_light(light, NULL, full_size);
+	ethash::progpow_hasher<ethash::progpow_default> const progpow_full(NULL, dag, full_size);
+	BOOST_REQUIRE(ethash_light.valid() && ethash_full.valid() && progpow_light.valid() && progpow_full.valid());
+	for (uint64_t nonce = 0; nonce != 4; ++nonce) {
+		uint64_t const block_number = nonce * 7 * PROGPOW_PERIOD;
+		ethash_return_value_t const e = ethash_light_compute_internal(light, full_size, hash, nonce);
+		ethash_return_value_t const p = progpow_light_compute_internal(light, full_size, hash, nonce, block_number);
+		ethash_return_value_t const results[] = {
+			ethash_light(hash, nonce),
+			ethash_full(hash, nonce),
+		};
+		for (ethash_return_value_t const& r : results) {
+			BOOST_REQUIRE(r.success);
+			BOOST_REQUIRE(memcmp(&r.mix_hash, &e.mix_hash, 32) == 0);
+			BOOST_REQUIRE(memcmp(&r.result, &e.result, 32) == 0);
+		}
+		ethash::progpow_program<ethash::progpow_default> const prog(block_number / PROGPOW_PERIOD);
+		ethash_return_value_t const progpow_results[] = {
+			progpow_light(hash, nonce, block_number),
+			progpow_full(hash, nonce, block_number),
+			progpow_full(prog, hash, nonce),
+		};
+		for (ethash_return_value_t const& r : progpow_results) {
+			BOOST_REQUIRE(r.success);
+			BOOST_REQUIRE(memcmp(&r.mix_hash, &p.mix_hash, 32) == 0);
+			BOOST_REQUIRE(memcmp(&r.result, &p.result, 32) == 0);
+		}
+	}
+
+	// the C program is the one of the default parameters, 0.9.2 is another one
+	progpow_program_t expected;
+	progpow_program_init(&expected, 100);
+	ethash::progpow_program<ethash::progpow_0_9_3> const prog_0_9_3(100);
+	ethash::progpow_program<ethash::progpow_0_9_2> const prog_0_9_2(100);
+	BOOST_REQUIRE(memcmp(prog_0_9_3.instructions, expected.instructions, sizeof(expected.instructions)) == 0);
+	BOOST_REQUIRE(memcmp(prog_0_9_3.dag_dst, expected.dag_dst, sizeof(expected.dag_dst)) == 0);
+	BOOST_REQUIRE(memcmp(prog_0_9_3.dag_sel, expected.dag_sel, sizeof(expected.dag_sel)) == 0);
+	unsigned cache_ops = 0;
+	for (progpow_instruction_t const& ins : prog_0_9_2.instructions) {
+		cache_ops += ins.op == PROGPOW_OP_CACHE;
+	}
+	BOOST_REQUIRE_EQUAL(cache_ops, 12U);
+
+	// other parameter sets hash the same handlers, with their own results
+	ethash::progpow_hasher<ethash::progpow_0_9_2> const progpow_0_9_2(light, NULL, full_size);
+	ethash::ethash_hasher<ethash::ethash_params<256, 32> > const ethash_wide(NULL, dag, full_size);
+	ethash_return_value_t const p = progpow_light_compute_internal(light, full_size, hash, 1, 0);
+	ethash_return_value_t const e = ethash_light_compute_internal(light, full_size, hash, 1);
+	ethash_return_value_t const p_0_9_2 = progpow_0_9_2(hash, 1, 0);
+	ethash_return_value_t const e_wide = ethash_wide(hash, 1);
+	BOOST_REQUIRE(p_0_9_2.success && e_wide.success);
+	BOOST_REQUIRE(memcmp(&p_0_9_2.result, &p.result, 32) != 0);
+	BOOST_REQUIRE(memcmp(&e_wide.result, &e.result, 32) != 0);
+	BOOST_REQUIRE(!ethash::ethash_hasher<ethash::ethash_default>(NULL, dag, 64).valid());
+
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(cpp_handlers_own_and_batch_like_the_c_api) {
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	ethash_h256_t boundary;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memset(&boundary, 0xff, 32);
+	ethash::light light = ethash::light::adopt(ethash_light_new_internal(1024, &seed));
+	BOOST_REQUIRE(light);
+	ethash::full full = ethash::full::adopt(ethash_full_new_memory_internal(full_size, light.get(), 1, NULL));
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE_EQUAL(full.dag_size(), full_size);
+
+	std::vector<uint64_t> const nonces = { 3, 1, 4, 1, 5 };
+	ethash_return_value_t results[5];
+	ethash_return_value_t progpow_results[5];
+	BOOST_REQUIRE(full.compute_batch(hash, nonces, results));
+	BOOST_REQUIRE(full.progpow_compute_batch(hash, nonces, progpow_results, 0));
+	for (size_t i = 0; i != nonces.size(); ++i) {
+		ethash_return_value_t e;
+		ethash_return_value_t p;
+		full.compute(hash, nonces[i], e);
+		full.progpow_compute(hash, nonces[i], 0, p);
+		BOOST_REQUIRE(e.success && p.success);
+		BOOST_REQUIRE(memcmp(&results[i].result, &e.result, 32) == 0);
+		BOOST_REQUIRE(memcmp(&progpow_results[i].result, &p.result, 32) == 0);
+	}
+
+	// the hits are bounded by the span
+	ethash_search_hit_t hits[2];
+	BOOST_REQUIRE_EQUAL(full.search(hash, 10, 100, boundary, hits), 2U);
+	BOOST_REQUIRE_EQUAL(hits[0].nonce, 10U);
+	BOOST_REQUIRE_EQUAL(full.progpow_search(hash, 0, 10, 100, boundary, ethash::span<ethash_search_hit_t>(hits, 1)), 1U);
+
+	// spans of different lengths are refused before the cache is read
+	bool valid[1];
+	ethash::span<ethash_h256_t const> const one(&hash, 1);
+	BOOST_REQUIRE_EQUAL(light.verify_batch(one, nonces, one, one, valid), 0U);
+
+	// moving hands the handlers over, a context keeps them while shared
+	ethash_full_t const full_handle = full.get();
+	ethash::full moved(std::move(full));
+	BOOST_REQUIRE(!full && moved.get() == full_handle);
+	ethash::epoch_context_ptr context = ethash::make_epoch_context(std::move(light), std::move(moved));
+	BOOST_REQUIRE(context && !light && !moved);
+	ethash::epoch_context_ptr const other = context;
+	context.reset();
+	BOOST_REQUIRE_EQUAL(other.use_count(), 1);
+	BOOST_REQUIRE(other->full.get() == full_handle);
+	ethash_return_value_t r;
+	other->full.compute(hash, nonces[0], r);
+	BOOST_REQUIRE(memcmp(&r.result, &results[0].result, 32) == 0);
+	BOOST_REQUIRE(!ethash::make_epoch_context(ethash::light()));
+}
+
+BOOST_AUTO_TEST_CASE(sync_verifier_checks_headers_across_epochs) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	uint64_t const block_numbers[] = {
+		1, 2, ETHASH_EPOCH_LENGTH, 2 * ETHASH_EPOCH_LENGTH, 2 * ETHASH_EPOCH_LENGTH + 5, 2 * ETHASH_EPOCH_LENGTH + 6
+	};
+	size_t const count = sizeof(block_numbers) / sizeof(block_numbers[0]);
+	ethash_h256_t header_hashes[count];
+	uint64_t nonces[count];
+	ethash_h256_t mix_hashes[count];
+	ethash_h256_t boundaries[count];
+	for (size_t i = 0; i != count; ++i) {
+		ethash_h256_t const seedhash = ethash_get_seedhash(block_numbers[i]);
+		ethash_light_t light = ethash_light_new_internal(cache_size, &seedhash);
+		BOOST_REQUIRE(light);
+		memset(&header_hashes[i], (int)i, 32);
+		nonces[i] = i * 11;
+		memset(&boundaries[i], 0xff, 32);
+		mix_hashes[i] = ethash_light_compute_internal(light, full_size, header_hashes[i], nonces[i]).mix_hash;
+		ethash_light_delete(light);
+	}
+	// the last header claims the mix hash of another one
+	mix_hashes[count - 1] = mix_hashes[count - 2];
+
+	ethash_sync_verifier_t verifier = ethash_sync_verifier_new_internal(2, 2, cache_size, full_size);
+	BOOST_REQUIRE(verifier);
+	bool results[count];
+	BOOST_REQUIRE_EQUAL(
+		ethash_sync_verifier_push(verifier, block_numbers, header_hashes, nonces, mix_hashes, boundaries, results, 2),
+		2U
+	);
+	// epochs 1 and 2 are being built while epoch 0 is verified
+	BOOST_REQUIRE_EQUAL(ethash_sync_verifier_pending(verifier), 2U);
+	BOOST_REQUIRE_EQUAL(
+		ethash_sync_verifier_push(
+			verifier, block_numbers + 2, header_hashes + 2, nonces + 2, mix_hashes + 2, boundaries + 2, results + 2, count - 2
+		),
+		count - 3
+	);
+	for (size_t i = 0; i != count; ++i) {
+		BOOST_REQUIRE_EQUAL(results[i], i != count - 1);
+	}
+	BOOST_REQUIRE_EQUAL(ethash_sync_verifier_pending(verifier), 2U);
+
+	// going back builds the cache again instead of failing the headers
+	BOOST_REQUIRE_EQUAL(
+		ethash_sync_verifier_push(verifier, block_numbers, header_hashes, nonces, mix_hashes, boundaries, results, 1),
+		1U
+	);
+	BOOST_REQUIRE(results[0]);
+	ethash_sync_verifier_delete(verifier);
+}
+
+static bytes rlp_encode(bytes const& payload, uint8_t base)
+{
+	bytes ret;
+	if (payload.size() < 56) {
+		ret.push_back((uint8_t)(base + payload.size()));
+	} else {
+		bytes length;
+		for (size_t l = payload.size(); l; l >>= 8) {
+			length.insert(length.begin(), (uint8_t)l);
+		}
+		ret.push_back((uint8_t)(base + 55 + length.size()));
+		ret.insert(ret.end(), length.begin(), length.end());
+	}
+	ret.insert(ret.end(), payload.begin(), payload.end());
+	return ret;
+}
+
+static bytes rlp_string(bytes const& s)
+{
+	return s.size() == 1 && s[0] < 0x80 ? s : rlp_encode(s, 0x80);
+}
+
+static bytes rlp_list(std::vector<bytes> const& items)
+{
+	bytes payload;
+	for (bytes const& item : items) {
+		payload.insert(payload.end(), item.begin(), item.end());
+	}
+	return rlp_encode(payload, 0xc0);
+}
+
+// the fields of the mainnet genesis header
+static std::vector<bytes> genesis_header_fields()
+{
+	std::string const empty_root = "56e81f171bcc55a6ff8345e692c0f86e5b48e01b996cadc001622fb5e363b421";
+	return {
+		rlp_string(bytes(32, 0)),
+		rlp_string(hexStringToBytes("1dcc4de8dec75d7aab85b567b6ccd41ad312451b948a7413f0a142fd40d49347")),
+		rlp_string(bytes(20, 0)),
+		rlp_string(hexStringToBytes("d7f8974fb5ac78d9ac099b9ad5018bedc2ce0a72dad1827a1709da30580f0544")),
+		rlp_string(hexStringToBytes(empty_root)),
+		rlp_string(hexStringToBytes(empty_root)),
+		rlp_string(bytes(256, 0)),
+		rlp_string(hexStringToBytes("0400000000")),
+		rlp_string(bytes()),
+		rlp_string(hexStringToBytes("1388")),
+		rlp_string(bytes()),
+		rlp_string(bytes()),
+		rlp_string(hexStringToBytes("11bbe8db4e347b4e8c937c1c8370e4b5ed33adb3db69cbdb7a38e1e50b1b82fa")),
+		rlp_string(bytes(32, 0)),
+		rlp_string(hexStringToBytes("0000000000000042"))
+	};
+}
+
+BOOST_AUTO_TEST_CASE(header_seal_hash_matches_go_ethereum) {
+	std::vector<bytes> fields = genesis_header_fields();
+	bytes const genesis = rlp_list(fields);
+	ethash_h256_t hash;
+	SHA3_256(&hash, genesis.data(), genesis.size());
+	BOOST_REQUIRE_EQUAL(blockhashToHexString(&hash), "d4e56740f876aef8c010b86a40d5f56745a118d0906a34e69aec8c0db1cb8fa3");
+
+	// HashNoNonce() and SealHash() of go-ethereum
+	BOOST_REQUIRE(ethash_header_seal_hash(&hash, genesis.data(), genesis.size()));
+	BOOST_REQUIRE_EQUAL(blockhashToHexString(&hash), "7e9138a374ba53679e790e26faefea71fd67cba3a74deeb48c8bf9fbd4ee9c22");
+	fields.push_back(rlp_string(hexStringToBytes("3b9aca00")));
+	bytes const london = rlp_list(fields);
+	BOOST_REQUIRE(ethash_header_seal_hash(&hash, london.data(), london.size()));
+	BOOST_REQUIRE_EQUAL(blockhashToHexString(&hash), "680db844731d5bd58b016cf7dfd223000336202b78747baa64f39dd115207181");
+
+	BOOST_REQUIRE(!ethash_header_seal_hash(&hash, genesis.data(), genesis.size() - 1));
+	fields.resize(14);
+	bytes const short_header = rlp_list(fields);
+	BOOST_REQUIRE(!ethash_header_seal_hash(&hash, short_header.data(), short_header.size()));
+
+	bytes headers = genesis;
+	headers.insert(headers.end(), short_header.begin(), short_header.end());
+	headers.insert(headers.end(), london.begin(), london.end());
+	size_t const sizes[] = {genesis.size(), short_header.size(), london.size()};
+	uint64_t block_numbers[3];
+	ethash_h256_t header_hashes[3];
+	uint64_t nonces[3];
+	ethash_h256_t mix_hashes[3];
+	ethash_h256_t boundaries[3];
+	bool decoded[3];
+	BOOST_REQUIRE_EQUAL(
+		ethash_header_decode_batch(
+			headers.data(), sizes, block_numbers, header_hashes, nonces, mix_hashes, boundaries, decoded, 3
+		),
+		2U
+	);
+	BOOST_REQUIRE(decoded[0] && !decoded[1] && decoded[2]);
+	BOOST_REQUIRE_EQUAL(blockhashToHexString(&header_hashes[0]), "7e9138a374ba53679e790e26faefea71fd67cba3a74deeb48c8bf9fbd4ee9c22");
+	BOOST_REQUIRE_EQUAL(blockhashToHexString(&header_hashes[2]), "680db844731d5bd58b016cf7dfd223000336202b78747baa64f39dd115207181");
+	BOOST_REQUIRE_EQUAL(block_numbers[0], 0U);
+	BOOST_REQUIRE_EQUAL(nonces[0], 0x42U);
+	BOOST_REQUIRE_EQUAL(blockhashToHexString(&mix_hashes[0]), std::string(64, '0'));
+	// 2^256 / 2^34
+	BOOST_REQUIRE_EQUAL(blockhashToHexString(&boundaries[0]), "0000000040" + std::string(54, '0'));
+	BOOST_REQUIRE_EQUAL(blockhashToHexString(&boundaries[1]), std::string(64, '0'));
+}
+
+BOOST_AUTO_TEST_CASE(sync_verifier_checks_rlp_headers) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	uint64_t const block_numbers[] = {1, 2, ETHASH_EPOCH_LENGTH + 1};
+	bytes headers;
+	std::vector<size_t> sizes;
+	for (size_t i = 0; i != 3; ++i) {
+		std::vector<bytes> fields = genesis_header_fields();
+		fields[7] = rlp_string(bytes(1, 1));
+		fields[8] = rlp_string(hexStringToBytes(i == 2 ? "7531" : i == 1 ? "02" : "01"));
+		fields[14] = rlp_string(bytes(8, (uint8_t)i));
+		ethash_h256_t seal_hash;
+		bytes header = rlp_list(fields);
+		BOOST_REQUIRE(ethash_header_seal_hash(&seal_hash, header.data(), header.size()));
+
+		// the mix hash is not part of the seal hash
+		ethash_h256_t const seedhash = ethash_get_seedhash(block_numbers[i]);
+		ethash_light_t light = ethash_light_new_internal(cache_size, &seedhash);
+		BOOST_REQUIRE(light);
+		uint64_t const nonce = 0x0101010101010101ULL * i;
+		ethash_h256_t const mix_hash = ethash_light_compute_internal(light, full_size, seal_hash, nonce).mix_hash;
+		ethash_light_delete(light);
+		fields[13] = rlp_string(bytes(mix_hash.b, mix_hash.b + 32));
+		header = rlp_list(fields);
+		headers.insert(headers.end(), header.begin(), header.end());
+		sizes.push_back(header.size());
+		if (i == 0) {
+			// a header that is not a list, which must not take the stream anywhere
+			headers.push_back(0x80);
+			sizes.push_back(1);
+		}
+	}
+	// the last header claims a wrong mix hash
+	headers[headers.size() - 9 - 1] ^= 1;
+
+	ethash_sync_verifier_t verifier = ethash_sync_verifier_new_internal(0, 2, cache_size, full_size);
+	BOOST_REQUIRE(verifier);
+	bool results[4];
+	BOOST_REQUIRE_EQUAL(ethash_sync_verifier_push_headers(verifier, headers.data(), sizes.data(), results, 4), 2U);
+	BOOST_REQUIRE(results[0]);
+	BOOST_REQUIRE(!results[1]);
+	BOOST_REQUIRE(results[2]);
+	BOOST_REQUIRE(!results[3]);
+	ethash_sync_verifier_delete(verifier);
+}
+
+BOOST_AUTO_TEST_CASE(sizes_past_the_tables_are_computed) {
+	// the sizes of the last tabulated epoch and the ones after it, from the
+	// GetCacheSizes and GetDataSizes of data_sizes.h
+	BOOST_REQUIRE_EQUAL(ethash_get_cachesize(2047 * ETHASH_EPOCH_LENGTH), 285081536U);
+	BOOST_REQUIRE_EQUAL(ethash_get_datasize(2047 * ETHASH_EPOCH_LENGTH), 18245220736U);
+	BOOST_REQUIRE_EQUAL(ethash_get_cachesize(2048 * ETHASH_EPOCH_LENGTH), 285211712U);
+	BOOST_REQUIRE_EQUAL(ethash_get_datasize(2048 * ETHASH_EPOCH_LENGTH + 29999), 18253610624U);
+	BOOST_REQUIRE_EQUAL(ethash_get_cachesize(10000 * ETHASH_EPOCH_LENGTH), 1327494976U);
+	BOOST_REQUIRE_EQUAL(ethash_get_datasize(10000 * ETHASH_EPOCH_LENGTH), 84959820416U);
+	uint64_t const last = (ETHASH_MAX_EPOCHS - 1) * (uint64_t)ETHASH_EPOCH_LENGTH;
+	BOOST_REQUIRE_EQUAL(ethash_get_cachesize(last), 4294836032U);
+	BOOST_REQUIRE_EQUAL(ethash_get_datasize(last), 274869514624U);
+	// the DAG of the next epoch has more pages than 32-bit indices address
+	BOOST_REQUIRE_EQUAL(ethash_get_cachesize(last + ETHASH_EPOCH_LENGTH), 0U);
+	BOOST_REQUIRE_EQUAL(ethash_get_datasize(last + ETHASH_EPOCH_LENGTH), 0U);
+	// remembered, so asking again gives the same sizes
+	BOOST_REQUIRE_EQUAL(ethash_get_datasize(10000 * ETHASH_EPOCH_LENGTH), 84959820416U);
+
+	ethash_h256_t expected = ethash_get_seedhash(2047 * ETHASH_EPOCH_LENGTH);
+	for (uint64_t epoch = 2048; epoch != 2100; ++epoch) {
+		SHA3_256(&expected, (uint8_t*)&expected, 32);
+		ethash_h256_t const seed = ethash_get_seedhash(epoch * ETHASH_EPOCH_LENGTH);
+		BOOST_REQUIRE(memcmp(&seed, &expected, 32) == 0);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(chain_params_size_and_hash_other_chains) {
+	ethash_chain_params_t params = ethash_chain_params_ethereum();
+	ethash_chain_t ethereum = ethash_chain_new(&params);
+	BOOST_REQUIRE(ethereum);
+	for (uint64_t epoch = 0; epoch != ETHASH_TABULATED_EPOCHS; ++epoch) {
+		uint64_t const block_number = epoch * ETHASH_EPOCH_LENGTH + 7;
+		BOOST_REQUIRE_EQUAL(ethash_chain_get_cachesize(ethereum, block_number), ethash_get_cachesize(block_number));
+		BOOST_REQUIRE_EQUAL(ethash_chain_get_datasize(ethereum, block_number), ethash_get_datasize(block_number));
+	}
+	ethash_h256_t const seed = ethash_chain_get_seedhash(ethereum, 3 * ETHASH_EPOCH_LENGTH);
+	ethash_h256_t const expected_seed = ethash_get_seedhash(3 * ETHASH_EPOCH_LENGTH);
+	BOOST_REQUIRE(memcmp(&seed, &expected_seed, 32) == 0);
+	ethash_chain_delete(ethereum);
+
+	params.cache_bytes_init = 1000;
+	BOOST_REQUIRE(!ethash_chain_new(&params));
+
+	// a small chain with short epochs and ProgPoW programs
+	params.epoch_length = 100;
+	params.cache_bytes_init = 1024;
+	params.cache_bytes_growth = 128;
+	params.dataset_bytes_init = 1024 * 32;
+	params.dataset_bytes_growth = 1024;
+	params.progpow_period = 5;
+	ethash_chain_t chain = ethash_chain_new(&params);
+	BOOST_REQUIRE(chain);
+	uint64_t const block_number = 250;
+	BOOST_REQUIRE_EQUAL(ethash_chain_get_epoch(chain, block_number), 2U);
+	// 1024 + 2 * 128 bytes are 20 hashes, 19 is prime
+	uint64_t const cache_size = ethash_chain_get_cachesize(chain, block_number);
+	BOOST_REQUIRE_EQUAL(cache_size, 19U * ETHASH_HASH_BYTES);
+	uint64_t const full_size = ethash_chain_get_datasize(chain, block_number);
+	BOOST_REQUIRE_EQUAL(full_size % ETHASH_MIX_BYTES, 0U);
+	BOOST_REQUIRE(full_size < 1024 * 34);
+
+	ethash_light_t light = ethash_light_new_for_chain(chain, block_number);
+	BOOST_REQUIRE(light);
+	ethash_h256_t const seedhash = ethash_chain_get_seedhash(chain, block_number);
+	ethash_light_t reference = ethash_light_new_internal(cache_size, &seedhash);
+	BOOST_REQUIRE(reference);
+	ethash_full_t full = ethash_full_new_memory(light, NULL);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE_EQUAL(ethash_full_dag_size(full), full_size);
+
+	ethash_h256_t hash;
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_return_value_t const e = ethash_light_compute_internal(reference, full_size, hash, 5);
+	// block 250 runs program 50 of the chain, the one of block 500 on Ethereum
+	ethash_return_value_t const p = progpow_light_compute_internal(
+		reference, full_size, hash, 5, block_number / 5 * PROGPOW_PERIOD
+	);
+	ethash_return_value_t const results[] = {
+		ethash_light_compute(light, hash, 5),
+		ethash_full_compute(full, hash, 5),
+	};
+	for (ethash_return_value_t const& r : results) {
+		BOOST_REQUIRE(r.success);
+		BOOST_REQUIRE(memcmp(&r.result, &e.result, 32) == 0);
+	}
+	ethash_return_value_t const progpow_results[] = {
+		progpow_light_compute(light, hash, 5, block_number),
+		progpow_full_compute(full, hash, 5, block_number),
+	};
+	for (ethash_return_value_t const& r : progpow_results) {
+		BOOST_REQUIRE(r.success);
+		BOOST_REQUIRE(memcmp(&r.result, &p.result, 32) == 0);
+	}
+
+	ethash_full_delete(full);
+	ethash_light_delete(reference);
+	ethash_light_delete(light);
+	ethash_chain_delete(chain);
+}
+
+BOOST_AUTO_TEST_CASE(stats_count_the_work_done) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	BOOST_REQUIRE(!ethash_get_stats_enabled());
+
+	ethash_stats_t before;
+	ethash_get_stats(&before);
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(light);
+	ethash_light_compute_internal(light, full_size, hash, 0);
+	ethash_stats_t after;
+	ethash_get_stats(&after);
+	BOOST_REQUIRE(memcmp(&before, &after, sizeof(after)) == 0);
+
+	ethash_set_stats_enabled(true);
+	BOOST_REQUIRE(ethash_get_stats_enabled());
+	ethash_light_delete(light);
+	light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(light);
+	ethash_full_t full = ethash_full_new_memory_internal(full_size, light, 1, NULL);
+	BOOST_REQUIRE(full);
+	std::vector<uint64_t> nonces(ETHASH_HASH_BATCH + 1, 7);
+	std::vector<ethash_return_value_t> results(nonces.size());
+	BOOST_REQUIRE(ethash_full_compute_batch(full, hash, nonces.data(), results.data(), nonces.size()));
+	ethash_full_compute(full, hash, 0);
+	progpow_full_compute(full, hash, 0, 0);
+	ethash_return_value_t const valid = ethash_light_compute_internal(light, full_size, hash, 0);
+	progpow_light_compute_internal(light, full_size, hash, 0, 0);
+
+	// one good header and one with a wrong nonce
+	ethash_h256_t headers[2] = {hash, hash};
+	uint64_t verify_nonces[2] = {0, 1};
+	ethash_h256_t mix_hashes[2] = {valid.mix_hash, valid.mix_hash};
+	ethash_h256_t boundaries[2];
+	memset(boundaries, 0xff, sizeof(boundaries));
+	bool verified[2];
+	BOOST_REQUIRE_EQUAL(ethash_light_verify_batch_internal(
+		light, full_size, headers, verify_nonces, mix_hashes, boundaries, verified, 2, 1
+	), 1);
+	ethash_set_stats_enabled(false);
+	ethash_get_stats(&after);
+
+	BOOST_REQUIRE_EQUAL(after.cache_builds - before.cache_builds, 1);
+	BOOST_REQUIRE_EQUAL(after.full_hashes - before.full_hashes, ETHASH_HASH_BATCH + 2);
+	// the boundary lets both headers past the quick check to a light hash
+	BOOST_REQUIRE_EQUAL(after.light_hashes - before.light_hashes, 3);
+	BOOST_REQUIRE_EQUAL(after.progpow_full_hashes - before.progpow_full_hashes, 1);
+	BOOST_REQUIRE_EQUAL(after.progpow_light_hashes - before.progpow_light_hashes, 1);
+	BOOST_REQUIRE_EQUAL(after.verify_failures - before.verify_failures, 1);
+	// the DAG and the ProgPoW caches of the light and full clients
+	BOOST_REQUIRE(after.dag_items - before.dag_items >= full_size / sizeof(node));
+	BOOST_REQUIRE_EQUAL(after.mapped_bytes, before.mapped_bytes);
+
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(access_stats_sample_dag_and_cache_reads) {
+	std::string const path = "./test_access_stats.csv";
+	if (!ethash_access_stats_enabled()) {
+		std::vector<uint64_t> counts(1);
+		BOOST_REQUIRE_EQUAL(ethash_access_stats_get(ETHASH_ACCESS_DAG, counts.data(), counts.size()), 0);
+		BOOST_REQUIRE(!ethash_access_stats_export(path.c_str()));
+		return;
+	}
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	BOOST_REQUIRE(light);
+	ethash_full_t full = ethash_full_new_memory_internal(full_size, light, 1, NULL);
+	BOOST_REQUIRE(full);
+	ethash_access_stats_reset();
+	for (uint64_t nonce = 0; nonce != 64; ++nonce) {
+		ethash_full_compute(full, hash, nonce);
+		progpow_full_compute(full, hash, nonce, 0);
+	}
+	ethash_light_compute_internal(light, full_size, hash, 0);
+
+	// the accesses of the hashes, all within the DAG or cache
+	size_t const dag_buckets = full_size / ETHASH_ACCESS_BUCKET_BYTES;
+	uint64_t const reads[ETHASH_ACCESS_KIND_COUNT] = {
+		64 * ETHASH_ACCESSES + ETHASH_ACCESSES, 64 * PROGPOW_CNT_DAG, ETHASH_ACCESSES * MIX_NODES * ETHASH_DATASET_PARENTS
+	};
+	for (unsigned kind = 0; kind != ETHASH_ACCESS_KIND_COUNT; ++kind) {
+		std::vector<uint64_t> counts(dag_buckets + 1);
+		size_t const used = ethash_access_stats_get((enum ethash_access_kind)kind, counts.data(), counts.size());
+		BOOST_REQUIRE(used > 0 && used <= dag_buckets);
+		uint64_t const sampled = std::accumulate(counts.begin(), counts.end(), (uint64_t)0);
+		BOOST_REQUIRE(sampled * ETHASH_ACCESS_SAMPLE <= reads[kind] + ETHASH_ACCESS_SAMPLE);
+		BOOST_REQUIRE(sampled * ETHASH_ACCESS_SAMPLE + 3 * ETHASH_ACCESS_SAMPLE >= reads[kind]);
+	}
+
+	BOOST_REQUIRE(ethash_access_stats_export(path.c_str()));
+	std::ifstream csv(path);
+	std::string line;
+	unsigned rows = 0;
+	while (std::getline(csv, line)) {
+		rows += line[0] != '#' && line.find(",dag,") != std::string::npos;
+	}
+	BOOST_REQUIRE(rows > 0);
+	fs::remove(path);
+	ethash_access_stats_reset();
+	std::vector<uint64_t> counts(dag_buckets);
+	BOOST_REQUIRE_EQUAL(ethash_access_stats_get(ETHASH_ACCESS_DAG, counts.data(), counts.size()), 0);
+
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+}
+
+static void test_merkle_counted_keccak(ethash_h256_t* out, void const* data, size_t size, void* user)
+{
+	++*static_cast<std::atomic<unsigned>*>(user);
+	SHA3_256(out, static_cast<uint8_t const*>(data), size);
+}
+
+BOOST_AUTO_TEST_CASE(merkle_tree_proves_dag_elements) {
+	std::string const path = "./test_merkle_tree";
+	fs::remove(path);
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	uint64_t const full_size = 1024 * 24;
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	BOOST_REQUIRE(light);
+	ethash_full_t full = ethash_full_new_memory_internal(full_size, light, 1, NULL);
+	BOOST_REQUIRE(full);
+	uint8_t const* dag = static_cast<uint8_t const*>(ethash_full_dag(full));
+
+	ethash_full_merkle_t merkle = ethash_full_merkle_build(full, 0, NULL, NULL, NULL, 2);
+	BOOST_REQUIRE(merkle);
+	BOOST_REQUIRE_EQUAL(ethash_full_merkle_leaf_count(merkle), full_size / ETHASH_MIX_BYTES);
+	BOOST_REQUIRE_EQUAL(ethash_full_merkle_depth(merkle), 8);
+	std::vector<ethash_h256_t> siblings(ETHASH_MERKLE_MAX_DEPTH);
+	ethash_h256_t const root = ethash_full_merkle_root(merkle);
+	for (uint64_t index : {0, 1, 100, 190, 191}) {
+		ethash_h256_t leaf;
+		BOOST_REQUIRE(ethash_full_merkle_proof(merkle, index, &leaf, siblings.data()));
+		ethash_h256_t expected;
+		SHA3_256(&expected, dag + index * ETHASH_MIX_BYTES, ETHASH_MIX_BYTES);
+		BOOST_REQUIRE(memcmp(&leaf, &expected, sizeof(leaf)) == 0);
+		BOOST_REQUIRE(ethash_full_merkle_verify(&root, &leaf, index, siblings.data(), 8, NULL, NULL));
+		BOOST_REQUIRE(!ethash_full_merkle_verify(&root, &leaf, index ^ 2, siblings.data(), 8, NULL, NULL));
+		siblings[3].b[0] ^= 1;
+		BOOST_REQUIRE(!ethash_full_merkle_verify(&root, &leaf, index, siblings.data(), 8, NULL, NULL));
+	}
+	ethash_h256_t leaf;
+	BOOST_REQUIRE(!ethash_full_merkle_proof(merkle, full_size / ETHASH_MIX_BYTES, &leaf, siblings.data()));
+
+	// a level of odd length pairs its last node with itself
+	ethash_full_merkle_t odd = ethash_full_merkle_build(full, 8192, NULL, NULL, NULL, 1);
+	BOOST_REQUIRE(odd);
+	BOOST_REQUIRE_EQUAL(ethash_full_merkle_leaf_count(odd), 3);
+	BOOST_REQUIRE_EQUAL(ethash_full_merkle_depth(odd), 2);
+	BOOST_REQUIRE(ethash_full_merkle_proof(odd, 2, &leaf, siblings.data()));
+	BOOST_REQUIRE(memcmp(&leaf, &siblings[0], sizeof(leaf)) == 0);
+	ethash_h256_t const odd_root = ethash_full_merkle_root(odd);
+	BOOST_REQUIRE(ethash_full_merkle_verify(&odd_root, &leaf, 2, siblings.data(), 2, NULL, NULL));
+	ethash_full_merkle_delete(odd);
+	BOOST_REQUIRE(!ethash_full_merkle_build(full, 1000, NULL, NULL, NULL, 1));
+
+	// the tree file is mapped by later builds instead of hashing again
+	std::atomic<unsigned> hashes(0);
+	ethash_full_merkle_t saved = ethash_full_merkle_build(full, 0, test_merkle_counted_keccak, &hashes, path.c_str(), 1);
+	BOOST_REQUIRE(saved);
+	BOOST_REQUIRE(fs::exists(path));
+	// the probe of the hash function, the leaves and the inner nodes
+	BOOST_REQUIRE_EQUAL(hashes.load(), 1 + 192 + 96 + 48 + 24 + 12 + 6 + 3 + 2 + 1);
+	ethash_h256_t const saved_root = ethash_full_merkle_root(saved);
+	BOOST_REQUIRE(memcmp(&saved_root, &root, sizeof(root)) == 0);
+	ethash_full_merkle_delete(saved);
+	hashes = 0;
+	ethash_full_merkle_t mapped = ethash_full_merkle_build(full, 0, test_merkle_counted_keccak, &hashes, path.c_str(), 1);
+	BOOST_REQUIRE(mapped);
+	BOOST_REQUIRE_EQUAL(hashes.load(), 1);
+	ethash_h256_t const mapped_root = ethash_full_merkle_root(mapped);
+	BOOST_REQUIRE(memcmp(&mapped_root, &root, sizeof(root)) == 0);
+	BOOST_REQUIRE(ethash_full_merkle_proof(mapped, 100, &leaf, siblings.data()));
+	BOOST_REQUIRE(ethash_full_merkle_verify(&root, &leaf, 100, siblings.data(), 8, NULL, NULL));
+	ethash_full_merkle_delete(mapped);
+
+	ethash_full_merkle_delete(merkle);
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+	fs::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(autotune_picks_settings_and_keeps_them) {
+	std::string const dirname = "./test_autotune/";
+	fs::remove_all(dirname);
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	ethash_light_t light = ethash_light_new_internal(1024, &seed);
+	BOOST_REQUIRE(light);
+	ethash_full_t full = ethash_full_new_memory_internal(1024 * 32, light, 1, NULL);
+	BOOST_REQUIRE(full);
+
+	ethash_tuning_t tuning;
+	BOOST_REQUIRE(ethash_autotune_internal(full, 200, dirname.c_str(), &tuning));
+	BOOST_REQUIRE(tuning.hash_rate > 0);
+	BOOST_REQUIRE(tuning.num_threads >= 1 && tuning.num_threads <= ethash_hardware_concurrency());
+	BOOST_REQUIRE_EQUAL(ethash_get_hash_batch(), tuning.hash_batch);
+	std::string const active = ethash_get_active_kernels();
+	BOOST_REQUIRE(active.find(std::string("fnv=") + tuning.fnv_kernel) != std::string::npos);
+	BOOST_REQUIRE(active.find(std::string("progpow_loop=") + tuning.progpow_loop_kernel) != std::string::npos);
+
+	// the same host loads the file instead of measuring again
+	ethash_tuning_t loaded;
+	BOOST_REQUIRE(ethash_autotune_internal(full, 200, dirname.c_str(), &loaded));
+	BOOST_REQUIRE_EQUAL(loaded.hash_rate, 0);
+	BOOST_REQUIRE_EQUAL(loaded.num_threads, tuning.num_threads);
+	BOOST_REQUIRE_EQUAL(loaded.hash_batch, tuning.hash_batch);
+	BOOST_REQUIRE_EQUAL(std::string(loaded.fnv_kernel), tuning.fnv_kernel);
+
+	// any batch size finds the same hits
+	ethash_h256_t boundary;
+	memset(&boundary, 0, sizeof(boundary));
+	boundary.b[0] = 0x10;
+	std::vector<ethash_search_hit_t> hits(64);
+	ethash_set_hash_batch(ETHASH_MAX_HASH_BATCH);
+	size_t const found = ethash_full_search(full, seed, 0, 500, &boundary, hits.data(), hits.size());
+	ethash_set_hash_batch(3);
+	BOOST_REQUIRE_EQUAL(ethash_get_hash_batch(), 3);
+	std::vector<ethash_search_hit_t> odd_hits(64);
+	BOOST_REQUIRE_EQUAL(ethash_full_search(full, seed, 0, 500, &boundary, odd_hits.data(), odd_hits.size()), found);
+	for (size_t i = 0; i != found; ++i) {
+		BOOST_REQUIRE_EQUAL(odd_hits[i].nonce, hits[i].nonce);
+	}
+
+	BOOST_REQUIRE(!ethash_set_kernel("fnv", "no-such-kernel"));
+	BOOST_REQUIRE(!ethash_set_kernel("no-such-family", NULL));
+	BOOST_REQUIRE(ethash_set_kernel("fnv", NULL));
+	BOOST_REQUIRE(ethash_set_kernel("progpow_loop", NULL));
+	ethash_set_hash_batch(ETHASH_MAX_HASH_BATCH);
+	fs::remove_all(dirname);
+	ethash_full_delete(full);
+	ethash_light_delete(light);
+}
+
+static void test_collect_event(ethash_event_t const* event, void* user)
+{
+	static_cast<std::vector<ethash_event_t>*>(user)->push_back(*event);
+}
+
+BOOST_AUTO_TEST_CASE(events_follow_the_cache_and_dag_lifecycle) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t const seed = ethash_get_seedhash(ETHASH_EPOCH_LENGTH * 3);
+	std::vector<ethash_event_t> events;
+	fs::remove_all("./test_ethash_directory/");
+	ethash_set_event_callback(test_collect_event, &events);
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(light);
+	ethash_full_t full = ethash_full_new_internal("./test_ethash_directory/", seed, full_size, light, NULL);
+	BOOST_REQUIRE(full);
+	ethash_full_delete(full);
+	// the second time the DAG comes from the file
+	full = ethash_full_new_internal("./test_ethash_directory/", seed, full_size, light, NULL);
+	BOOST_REQUIRE(full);
+	ethash_full_delete(full);
+	ethash_set_event_callback(NULL, NULL);
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+
+	enum ethash_event_type const types[] = {
+		ETHASH_EVENT_CACHE_BUILD_START, ETHASH_EVENT_CACHE_BUILD_END,
+		ETHASH_EVENT_DAG_FILE_CHECKED, ETHASH_EVENT_DAG_MAPPED, ETHASH_EVENT_DAG_MAGIC_WRITTEN, ETHASH_EVENT_DAG_DELETED,
+		ETHASH_EVENT_DAG_FILE_CHECKED, ETHASH_EVENT_DAG_MAPPED, ETHASH_EVENT_DAG_DELETED
+	};
+	BOOST_REQUIRE_EQUAL(events.size(), sizeof(types) / sizeof(types[0]));
+	for (size_t i = 0; i != events.size(); ++i) {
+		BOOST_REQUIRE_EQUAL(events[i].type, types[i]);
+		BOOST_REQUIRE_EQUAL(events[i].epoch, 3);
+		BOOST_REQUIRE(i == 0 || events[i].time_us >= events[i - 1].time_us);
+	}
+	BOOST_REQUIRE_EQUAL(events[0].size, cache_size);
+	BOOST_REQUIRE(events[1].duration_us <= events[1].time_us - events[0].time_us);
+	BOOST_REQUIRE_EQUAL(events[2].dag_file, ETHASH_DAG_FILE_MISMATCH);
+	BOOST_REQUIRE_EQUAL(events[3].size, full_size + ETHASH_DAG_HEADER_SIZE);
+	BOOST_REQUIRE_EQUAL(events[4].size, full_size);
+	BOOST_REQUIRE_EQUAL(events[6].dag_file, ETHASH_DAG_FILE_MATCH);
+	BOOST_REQUIRE_EQUAL(events[7].dag_file, ETHASH_DAG_FILE_NONE);
+	BOOST_REQUIRE_EQUAL(ethash_event_type_name(ETHASH_EVENT_DAG_MAPPED), std::string("dag_mapped"));
+}
+
+static std::string test_dag_file_name(uint32_t revision, uint64_t epoch)
+{
+	ethash_h256_t const seed = ethash_get_seedhash(epoch * ETHASH_EPOCH_LENGTH);
+	char name[DAG_MUTABLE_NAME_MAX_SIZE];
+	ethash_io_mutable_name(revision, &seed, name);
+	return std::string("./test_ethash_directory/") + name;
+}
+
+BOOST_AUTO_TEST_CASE(dag_directory_keeps_the_newest_epochs) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	fs::remove_all("./test_ethash_directory/");
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(light);
+	// the DAG contents do not matter here, only the files
+	for (uint64_t epoch = 0; epoch != 3; ++epoch) {
+		ethash_full_t full = ethash_full_new_internal(
+			"./test_ethash_directory/", ethash_get_seedhash(epoch * ETHASH_EPOCH_LENGTH), full_size, light, NULL
+		);
+		BOOST_REQUIRE(full);
+		ethash_full_delete(full);
+		BOOST_REQUIRE_EQUAL(fs::file_size(test_dag_file_name(ETHASH_REVISION, epoch)), ethash_io_dag_file_size(full_size));
+	}
+	std::ofstream(test_dag_file_name(ETHASH_REVISION - 1, 4)) << "stale";
+	std::ofstream(test_dag_file_name(ETHASH_REVISION, 0) + ".checkpoint") << "old";
+	std::ofstream("./test_ethash_directory/dag-R23-not-a-dag") << "unrelated";
+	// a DAG of the original layout of epoch 0, left to the programs reading it
+	ethash_h256_t const seed0 = ethash_get_seedhash(0);
+	char original_name[64];
+	snprintf(original_name, sizeof(original_name), "full-R%u-%016" PRIx64, ETHASH_REVISION, ethash_io_seed_name_hash(&seed0));
+	std::string const original = std::string("./test_ethash_directory/") + original_name;
+	std::ofstream(original) << "original";
+
+	// nothing is removed without limits
+	BOOST_REQUIRE_EQUAL(ethash_get_dag_keep_epochs(), 0U);
+	BOOST_REQUIRE_EQUAL(ethash_get_dag_disk_budget(), 0U);
+	ethash_full_t full = ethash_full_new_internal(
+		"./test_ethash_directory/", ethash_get_seedhash(3 * ETHASH_EPOCH_LENGTH), full_size, light, NULL
+	);
+	BOOST_REQUIRE(full);
+	ethash_full_delete(full);
+	for (uint64_t epoch = 0; epoch != 4; ++epoch) {
+		BOOST_REQUIRE(fs::exists(test_dag_file_name(ETHASH_REVISION, epoch)));
+	}
+
+	// regenerating epoch 1 keeps it and the newest other one
+	fs::remove(test_dag_file_name(ETHASH_REVISION, 1));
+	ethash_set_dag_keep_epochs(2);
+	full = ethash_full_new_internal(
+		"./test_ethash_directory/", ethash_get_seedhash(1 * ETHASH_EPOCH_LENGTH), full_size, light, NULL
+	);
+	BOOST_REQUIRE(full);
+	ethash_full_delete(full);
+	ethash_set_dag_keep_epochs(0);
+	BOOST_REQUIRE(!fs::exists(test_dag_file_name(ETHASH_REVISION, 0)));
+	BOOST_REQUIRE(!fs::exists(test_dag_file_name(ETHASH_REVISION, 0) + ".checkpoint"));
+	BOOST_REQUIRE(fs::exists(test_dag_file_name(ETHASH_REVISION, 1)));
+	BOOST_REQUIRE(!fs::exists(test_dag_file_name(ETHASH_REVISION, 2)));
+	BOOST_REQUIRE(fs::exists(test_dag_file_name(ETHASH_REVISION, 3)));
+	BOOST_REQUIRE(!fs::exists(test_dag_file_name(ETHASH_REVISION - 1, 4)));
+	BOOST_REQUIRE(fs::exists("./test_ethash_directory/dag-R23-not-a-dag"));
+	BOOST_REQUIRE(fs::exists(original));
+
+	// a budget of one DAG file leaves only the one in use
+	ethash_set_dag_disk_budget(ethash_io_dag_file_size(full_size));
+	BOOST_REQUIRE_EQUAL(ethash_dag_dir_collect("./test_ethash_directory/", ethash_get_seedhash(3 * ETHASH_EPOCH_LENGTH)), ethash_io_dag_file_size(full_size));
+	ethash_set_dag_disk_budget(0);
+	BOOST_REQUIRE(!fs::exists(test_dag_file_name(ETHASH_REVISION, 1)));
+	BOOST_REQUIRE(fs::exists(test_dag_file_name(ETHASH_REVISION, 3)));
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+BOOST_AUTO_TEST_CASE(mapped_light_uses_the_cache_file) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	fs::remove_all("./test_ethash_directory/");
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(light);
+
+	// written on the first call, mapped on both
+	for (int pass = 0; pass != 2; ++pass) {
+		ethash_light_t mapped = ethash_light_new_mapped_internal("./test_ethash_directory/", cache_size, &seed);
+		BOOST_REQUIRE(mapped);
+		BOOST_REQUIRE_EQUAL(mapped->cache_memory.mode, ETHASH_PAGES_FILE);
+		BOOST_REQUIRE(memcmp(mapped->cache, light->cache, cache_size) == 0);
+		ethash_return_value_t const expected = ethash_light_compute_internal(light, full_size, hash, 5);
+		ethash_return_value_t const ret = ethash_light_compute_internal(mapped, full_size, hash, 5);
+		BOOST_REQUIRE(memcmp(&expected.result, &ret.result, 32) == 0);
+		ethash_light_delete(mapped);
+	}
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+BOOST_AUTO_TEST_CASE(attach_maps_the_files_of_another_process) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	fs::remove_all("./test_ethash_directory/");
+	BOOST_REQUIRE(!ethash_full_attach_internal("./test_ethash_directory/", seed, full_size));
+	BOOST_REQUIRE(!ethash_light_attach_internal("./test_ethash_directory/", cache_size, &seed));
+
+	ethash_light_t light = ethash_light_new_persistent_internal("./test_ethash_directory/", cache_size, &seed);
+	BOOST_REQUIRE(light);
+	ethash_full_t full = ethash_full_new_internal("./test_ethash_directory/", seed, full_size, light, NULL);
+	BOOST_REQUIRE(full);
+	ethash_full_delete(full);
+
+	ethash_light_t attached_light = ethash_light_attach_internal("./test_ethash_directory/", cache_size, &seed);
+	BOOST_REQUIRE(attached_light);
+	BOOST_REQUIRE(memcmp(attached_light->cache, light->cache, cache_size) == 0);
+	ethash_full_t attached = ethash_full_attach_internal("./test_ethash_directory/", seed, full_size);
+	BOOST_REQUIRE(attached);
+	BOOST_REQUIRE_EQUAL(ethash_full_page_mode(attached), ETHASH_PAGES_FILE);
+	BOOST_REQUIRE(ethash_full_verify(attached, 1));
+	ethash_return_value_t const light_ret = ethash_light_compute_internal(attached_light, full_size, hash, 5);
+	ethash_return_value_t const full_ret = ethash_full_compute(attached, hash, 5);
+	BOOST_REQUIRE(memcmp(&light_ret.result, &full_ret.result, 32) == 0);
+	ethash_return_value_t const progpow_light = progpow_light_compute_internal(light, full_size, hash, 5, 0);
+	ethash_return_value_t const progpow_full = progpow_full_compute(attached, hash, 5, 0);
+	BOOST_REQUIRE(memcmp(&progpow_light.result, &progpow_full.result, 32) == 0);
+	ethash_full_delete(attached);
+	ethash_light_delete(attached_light);
+
+	// a DAG of another size or with a corrupted first chunk is not attached to
+	BOOST_REQUIRE(!ethash_full_attach_internal("./test_ethash_directory/", seed, full_size * 2));
+	char name[DAG_MUTABLE_NAME_MAX_SIZE];
+	ethash_io_mutable_name(ETHASH_REVISION, &seed, name);
+	{
+		std::fstream file((std::string("./test_ethash_directory/") + name).c_str(), std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(ETHASH_DAG_HEADER_SIZE + 100);
+		file.put('x');
+	}
+	BOOST_REQUIRE(!ethash_full_attach_internal("./test_ethash_directory/", seed, full_size));
+
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+BOOST_AUTO_TEST_CASE(seed_package_provisions_the_dag) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	fs::remove_all("./test_ethash_directory/");
+	fs::create_directories("./test_ethash_directory/");
+	char const* const package = "./test_ethash_directory/epoch.seed";
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(light);
+	BOOST_REQUIRE(ethash_light_export_seed_package_internal(light, &seed, full_size, package));
+	BOOST_REQUIRE_EQUAL(fs::file_size(package), sizeof(struct ethash_io_seed_package) + cache_size);
+	// its sizes are not the ones of block 0
+	BOOST_REQUIRE(!ethash_light_import_seed_package(package));
+
+	ethash_h256_t imported_seed;
+	uint64_t imported_size = 0;
+	ethash_light_t imported = ethash_light_import_seed_package_internal(package, "./test_ethash_directory/", &imported_seed, &imported_size);
+	BOOST_REQUIRE(imported);
+	BOOST_REQUIRE(memcmp(&imported_seed, &seed, 32) == 0);
+	BOOST_REQUIRE_EQUAL(imported_size, full_size);
+	BOOST_REQUIRE(memcmp(imported->cache, light->cache, cache_size) == 0);
+	ethash_light_delete(imported);
+	// the cache file was written for later light handlers
+	imported = ethash_light_attach_internal("./test_ethash_directory/", cache_size, &seed);
+	BOOST_REQUIRE(imported);
+	ethash_light_delete(imported);
+
+	ethash_full_future_t future = ethash_full_import_seed_package_async_internal(package, "./test_ethash_directory/", 2, NULL);
+	BOOST_REQUIRE(future);
+	ethash_return_value_t const light_ret = ethash_light_compute_internal(ethash_full_future_light(future), full_size, hash, 5);
+	ethash_full_t full = ethash_full_future_wait(future);
+	BOOST_REQUIRE(full);
+	std::vector<uint8_t> expected(full_size);
+	BOOST_REQUIRE(ethash_compute_full_data(&expected[0], full_size, light, NULL));
+	BOOST_REQUIRE(memcmp(ethash_full_dag(full), &expected[0], full_size) == 0);
+	ethash_return_value_t const full_ret = ethash_full_compute(full, hash, 5);
+	BOOST_REQUIRE(memcmp(&light_ret.result, &full_ret.result, 32) == 0);
+	ethash_full_delete(full);
+
+	// a package with a flipped bit is refused
+	{
+		std::fstream file(package, std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(-100, std::ios::end);
+		file.put('x');
+	}
+	BOOST_REQUIRE(!ethash_light_import_seed_package_internal(package, NULL, &imported_seed, &imported_size));
+	BOOST_REQUIRE(!ethash_full_import_seed_package_async_internal(package, NULL, 1, NULL));
+
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+}
+
+BOOST_AUTO_TEST_CASE(dag_slices_of_several_hosts_are_gathered) {
+	uint64_t const cache_size = 1024;
+	uint64_t const full_size = 1024 * 32;
+	unsigned const num_ranks = 3;
+	ethash_h256_t seed;
+	ethash_h256_t other_seed;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&other_seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~X", 32);
+	fs::remove_all("./test_ethash_directory/");
+	fs::remove_all("./test_ethash_slices/");
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	ethash_light_t other_light = ethash_light_new_internal(cache_size, &other_seed);
+	BOOST_REQUIRE(light && other_light);
+
+	BOOST_REQUIRE(!ethash_full_generate_slice_internal("./test_ethash_slices/", seed, full_size, light, num_ranks, num_ranks, 1, NULL));
+	for (unsigned rank = 0; rank != num_ranks; ++rank) {
+		// the last slice is not there yet
+		BOOST_REQUIRE(!ethash_full_new_from_slices_internal("./test_ethash_directory/", "./test_ethash_slices/", seed, full_size, light, num_ranks, 1));
+		BOOST_REQUIRE(ethash_full_generate_slice_internal("./test_ethash_slices/", seed, full_size, light, rank, num_ranks, 2, NULL));
+	}
+	ethash_full_t full = ethash_full_new_from_slices_internal("./test_ethash_directory/", "./test_ethash_slices/", seed, full_size, light, num_ranks, 1);
+	BOOST_REQUIRE(full);
+	std::vector<uint8_t> expected(full_size);
+	BOOST_REQUIRE(ethash_compute_full_data(&expected[0], full_size, light, NULL));
+	BOOST_REQUIRE(memcmp(ethash_full_dag(full), &expected[0], full_size) == 0);
+	BOOST_REQUIRE(ethash_full_verify(full, 1));
+	ethash_full_delete(full);
+
+	// a slice with a flipped bit, or computed from another cache, is refused
+	char name[DAG_MUTABLE_NAME_MAX_SIZE];
+	ethash_io_mutable_name(ETHASH_REVISION, &seed, name);
+	std::string const slice = std::string("./test_ethash_slices/") + name + ".slice-1-of-3";
+	{
+		std::fstream file(slice.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(-100, std::ios::end);
+		file.put('x');
+	}
+	fs::remove_all("./test_ethash_directory/");
+	BOOST_REQUIRE(!ethash_full_new_from_slices_internal("./test_ethash_directory/", "./test_ethash_slices/", seed, full_size, light, num_ranks, 1));
+	BOOST_REQUIRE(ethash_full_generate_slice_internal("./test_ethash_slices/", seed, full_size, other_light, 1, num_ranks, 1, NULL));
+	BOOST_REQUIRE(!ethash_full_new_from_slices_internal("./test_ethash_directory/", "./test_ethash_slices/", seed, full_size, light, num_ranks, 1));
+	BOOST_REQUIRE(ethash_full_generate_slice_internal("./test_ethash_slices/", seed, full_size, light, 1, num_ranks, 1, NULL));
+	full = ethash_full_new_from_slices_internal("./test_ethash_directory/", "./test_ethash_slices/", seed, full_size, light, num_ranks, 1);
+	BOOST_REQUIRE(full);
+	BOOST_REQUIRE(memcmp(ethash_full_dag(full), &expected[0], full_size) == 0);
+	ethash_full_delete(full);
+
+	ethash_light_delete(other_light);
+	ethash_light_delete(light);
+	fs::remove_all("./test_ethash_directory/");
+	fs::remove_all("./test_ethash_slices/");
+}
@@ -0,0 +1,473 @@
+// Differential checks of every kernel and every batched path against the
+// portable scalar code. Each configuration hashes the same random headers and
+// nonces, on small test caches and on light caches of sampled real epochs,
+// and must give exactly the results of the reference configuration.
+//
+// ETHASH_EQUIVALENCE_SEED repeats the inputs of an earlier run, it is printed
+// at the start of every run. ETHASH_EQUIVALENCE_EPOCHS is the number of real
+// epochs sampled, 1 by default and 0 for none.
+
+#include <libethash/dispatch.h>
+#include <libethash/ethash.h>
+#include <libethash/internal.h>
+#include <libethash/progpow_jit.h>
+#include <libethash-cl/ethash_cl.h>
+
+#ifdef WITH_CRYPTOPP
+
+#include <libethash/sha3_cryptopp.h>
+
+#else
+#include <libethash/sha3.h>
+#endif // WITH_CRYPTOPP
+
+#define BOOST_TEST_MODULE Equivalence
+#define BOOST_TEST_MAIN
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+// nonces of each workload, and DAG items computed on their own
+#define EQUIVALENCE_NONCES 24
+#define EQUIVALENCE_REAL_NONCES 4
+#define EQUIVALENCE_ITEMS 16
+// the real epochs are sampled below this one, whose cache takes about a second
+#define EQUIVALENCE_MAX_EPOCH 128
+
+typedef char const* (*kernel_name_at)(unsigned i);
+
+struct kernel_family {
+	char const* name;
+	kernel_name_at at;
+};
+
+#define KERNEL_FAMILY(field, at_fn)										\
+	{ #field, [](unsigned i) -> char const* { auto k = at_fn(i); return k ? k->name : nullptr; } }
+
+static kernel_family const kernel_families[] = {
+	KERNEL_FAMILY(keccakf1600, ethash_keccakf1600_kernel_at),
+	KERNEL_FAMILY(sha3_multi, ethash_sha3_multi_kernel_at),
+	KERNEL_FAMILY(keccakf800, ethash_keccakf800_kernel_at),
+	KERNEL_FAMILY(keccakf800_multi, ethash_keccakf800_multi_kernel_at),
+	KERNEL_FAMILY(fnv, ethash_fnv_kernel_at),
+	KERNEL_FAMILY(progpow_loop, ethash_progpow_loop_kernel_at),
+};
+
+static vector<string> kernel_names(kernel_family const& family)
+{
+	vector<string> names;
+	for (unsigned i = 0; family.at(i); ++i) {
+		names.push_back(family.at(i));
+	}
+	return names;
+}
+
+static uint64_t env_or(char const* name, uint64_t fallback)
+{
+	char const* value = getenv(name);
+	return value && *value ? strtoull(value, nullptr, 0) : fallback;
+}
+
+static uint64_t run_seed()
+{
+	static uint64_t const seed = env_or("ETHASH_EQUIVALENCE_SEED", (uint64_t)time(nullptr));
+	return seed;
+}
+
+// A setting of every kernel family and of the batched paths
+struct config {
+	string name;
+	vector<pair<string, string>> kernels;  ///< families not using the portable kernel
+	unsigned hash_batch;
+	unsigned light_interleave;
+	bool jit;
+};
+
+static config reference_config()
+{
+	return config{ "reference", {}, 1, 1, false };
+}
+
+// the portable kernel of every family, then the overrides of @a c
+static bool apply(config const& c)
+{
+	for (kernel_family const& family: kernel_families) {
+		vector<string> const names = kernel_names(family);
+		if (!ethash_set_kernel(family.name, names.back().c_str())) {
+			return false;
+		}
+	}
+	for (auto const& kernel: c.kernels) {
+		if (!ethash_set_kernel(kernel.first.c_str(), kernel.second.c_str())) {
+			return false;
+		}
+	}
+	ethash_set_hash_batch(c.hash_batch);
+	ethash_set_light_interleave(c.light_interleave);
+	return ethash_progpow_set_jit(c.jit) || !c.jit;
+}
+
+static void restore_defaults()
+{
+	for (kernel_family const& family: kernel_families) {
+		ethash_set_kernel(family.name, nullptr);
+	}
+	ethash_set_hash_batch(ETHASH_MAX_HASH_BATCH);
+	ethash_set_light_interleave(8);
+	ethash_progpow_set_jit(false);
+}
+
+// every configuration differing from the reference in one setting, then the
+// one every host picks by default
+static vector<config> configs()
+{
+	vector<config> ret;
+	for (kernel_family const& family: kernel_families) {
+		vector<string> const names = kernel_names(family);
+		for (size_t i = 0; i + 1 < names.size(); ++i) {
+			ret.push_back(config{
+				string(family.name) + "=" + names[i], { { family.name, names[i] } }, 1, 1, false
+			});
+		}
+	}
+	for (unsigned batch: {2u, 4u, (unsigned)ETHASH_MAX_HASH_BATCH}) {
+		ret.push_back(config{ "hash_batch=" + to_string(batch), {}, batch, 1, false });
+	}
+	for (unsigned lanes: {2u, 8u, (unsigned)ETHASH_MAX_LIGHT_INTERLEAVE}) {
+		ret.push_back(config{ "light_interleave=" + to_string(lanes), {}, 1, lanes, false });
+	}
+	if (ethash_progpow_set_jit(true)) {
+		ret.push_back(config{ "jit", {}, 1, 1, true });
+	}
+	ethash_progpow_set_jit(false);
+	config fastest{ "default", {}, ETHASH_MAX_HASH_BATCH, 8, false };
+	for (kernel_family const& family: kernel_families) {
+		fastest.kernels.emplace_back(family.name, family.at(0));
+	}
+	ret.push_back(fastest);
+	return ret;
+}
+
+// The inputs of one light cache, with its DAG for the test sizes
+struct workload {
+	string name;
+	ethash_light_t light;
+	ethash_full_t full;
+	uint64_t full_size;
+	vector<ethash_h256_t> headers;
+	vector<uint64_t> nonces;
+	vector<uint64_t> block_numbers;
+	vector<uint32_t> item_indices;
+	vector<hash32_t> digests;
+	vector<vector<uint8_t>> messages;
+};
+
+static void fill_inputs(workload& w, mt19937_64& rng, size_t nonces)
+{
+	for (size_t i = 0; i != nonces; ++i) {
+		ethash_h256_t header;
+		for (unsigned b = 0; b != 32; ++b) {
+			ethash_h256_set(&header, b, (uint8_t)rng());
+		}
+		hash32_t digest;
+		for (unsigned k = 0; k != 8; ++k) {
+			digest.uint32s[k] = (uint32_t)rng();
+		}
+		w.headers.push_back(header);
+		w.nonces.push_back(rng());
+		w.block_numbers.push_back(rng() % (1000 * PROGPOW_PERIOD));
+		w.digests.push_back(digest);
+	}
+	uint32_t const num_items = (uint32_t)(w.full_size / sizeof(node));
+	for (size_t i = 0; i != EQUIVALENCE_ITEMS; ++i) {
+		w.item_indices.push_back((uint32_t)(rng() % num_items));
+	}
+	// every padding case of both Keccak rates
+	for (size_t size = 0; size <= 3 * 136 + 1; size += 1 + rng() % 7) {
+		vector<uint8_t> message(size);
+		for (uint8_t& byte: message) {
+			byte = (uint8_t)rng();
+		}
+		w.messages.push_back(message);
+	}
+}
+
+static workload small_workload(mt19937_64& rng, uint64_t cache_size, uint64_t full_size)
+{
+	workload w;
+	ethash_h256_t seed;
+	for (unsigned b = 0; b != 32; ++b) {
+		ethash_h256_set(&seed, b, (uint8_t)rng());
+	}
+	w.name = "test cache of " + to_string(cache_size) + " bytes";
+	w.light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(w.light);
+	w.full_size = full_size;
+	w.full = ethash_full_new_memory_internal(full_size, w.light, 1, nullptr);
+	BOOST_REQUIRE(w.full);
+	fill_inputs(w, rng, EQUIVALENCE_NONCES);
+	return w;
+}
+
+static workload real_workload(mt19937_64& rng, uint64_t epoch)
+{
+	workload w;
+	uint64_t const block_number = epoch * ETHASH_EPOCH_LENGTH;
+	w.name = "epoch " + to_string(epoch);
+	w.light = ethash_light_new(block_number);
+	BOOST_REQUIRE(w.light);
+	w.full = nullptr;
+	w.full_size = ethash_get_datasize(block_number);
+	fill_inputs(w, rng, EQUIVALENCE_REAL_NONCES);
+	return w;
+}
+
+static vector<workload> workloads()
+{
+	mt19937_64 rng(run_seed());
+	vector<workload> ret;
+	ret.push_back(small_workload(rng, 1024, 1024 * 32));
+	ret.push_back(small_workload(rng, 1024 * 3 + 64, 1024 * 40 + 128));
+	uint64_t const epochs = env_or("ETHASH_EQUIVALENCE_EPOCHS", 1);
+	for (uint64_t i = 0; i != epochs; ++i) {
+		ret.push_back(real_workload(rng, rng() % EQUIVALENCE_MAX_EPOCH));
+	}
+	return ret;
+}
+
+static void delete_workloads(vector<workload>& ws)
+{
+	for (workload& w: ws) {
+		if (w.full) {
+			ethash_full_delete(w.full);
+		}
+		ethash_light_delete(w.light);
+	}
+}
+
+// What a configuration computes for a workload, labelled for the reports
+struct outputs {
+	vector<pair<string, ethash_return_value_t>> hashes;
+	vector<pair<string, node>> items;
+	vector<pair<string, hash32_t>> f800;
+	vector<pair<string, vector<uint8_t>>> digests;
+};
+
+static void add_hashes(outputs& out, string const& what, ethash_return_value_t const* rets, size_t count)
+{
+	for (size_t i = 0; i != count; ++i) {
+		out.hashes.emplace_back(what + " #" + to_string(i), rets[i]);
+	}
+}
+
+static outputs compute(workload const& w)
+{
+	outputs out;
+	size_t const n = w.nonces.size();
+	vector<ethash_return_value_t> rets(n);
+
+	for (size_t i = 0; i != n; ++i) {
+		rets[i] = ethash_light_compute_internal(w.light, w.full_size, w.headers[i], w.nonces[i]);
+	}
+	add_hashes(out, "ethash light", rets.data(), n);
+	ethash_light_compute_interleaved_internal(w.light, w.full_size, w.headers.data(), w.nonces.data(), rets.data(), n);
+	add_hashes(out, "ethash light interleaved", rets.data(), n);
+	for (size_t i = 0; i != n; ++i) {
+		rets[i] = progpow_light_compute_internal(w.light, w.full_size, w.headers[i], w.nonces[i], w.block_numbers[i]);
+	}
+	add_hashes(out, "progpow light", rets.data(), n);
+	if (w.full) {
+		for (size_t i = 0; i != n; ++i) {
+			rets[i] = ethash_full_compute(w.full, w.headers[i], w.nonces[i]);
+		}
+		add_hashes(out, "ethash full", rets.data(), n);
+		BOOST_REQUIRE(ethash_full_compute_batch(w.full, w.headers[0], w.nonces.data(), rets.data(), n));
+		add_hashes(out, "ethash full batch", rets.data(), n);
+		for (size_t i = 0; i != n; ++i) {
+			rets[i] = progpow_full_compute(w.full, w.headers[i], w.nonces[i], w.block_numbers[i]);
+		}
+		add_hashes(out, "progpow full", rets.data(), n);
+		BOOST_REQUIRE(progpow_full_compute_batch(w.full, w.headers[0], w.nonces.data(), rets.data(), n, w.block_numbers[0]));
+		add_hashes(out, "progpow full batch", rets.data(), n);
+	}
+
+	size_t const items = w.item_indices.size();
+	vector<node> nodes(items);
+	for (size_t i = 0; i != items; ++i) {
+		ethash_calculate_dag_item(&nodes[i], w.item_indices[i], w.light);
+		out.items.emplace_back("DAG item " + to_string(w.item_indices[i]), nodes[i]);
+	}
+	uint32_t const first = w.item_indices[0] - w.item_indices[0] % items;
+	ethash_calculate_dag_items(nodes.data(), first, (uint32_t)items, w.light);
+	for (size_t i = 0; i != items; ++i) {
+		out.items.emplace_back("DAG items from " + to_string(first) + " #" + to_string(i), nodes[i]);
+	}
+	ethash_calculate_dag_items_at(nodes.data(), w.item_indices.data(), (uint32_t)items, w.light);
+	for (size_t i = 0; i != items; ++i) {
+		out.items.emplace_back("DAG items at #" + to_string(i), nodes[i]);
+	}
+
+	for (size_t i = 0; i != n; ++i) {
+		hash32_t header;
+		memcpy(&header, &w.headers[i], sizeof(header));
+		out.f800.emplace_back("keccak_f800_progpow #" + to_string(i), keccak_f800_progpow(header, w.nonces[i], w.digests[i]));
+	}
+
+	for (vector<uint8_t> const& message: w.messages) {
+		vector<uint8_t> digest(32 + 64);
+		SHA3_256((ethash_h256_t*)digest.data(), message.data(), message.size());
+		SHA3_512(digest.data() + 32, message.data(), message.size());
+		out.digests.emplace_back("Keccak of " + to_string(message.size()) + " bytes", digest);
+	}
+	return out;
+}
+
+static bool same_hash(ethash_return_value_t const& a, ethash_return_value_t const& b)
+{
+	return a.success == b.success &&
+		memcmp(&a.result, &b.result, 32) == 0 &&
+		memcmp(&a.mix_hash, &b.mix_hash, 32) == 0;
+}
+
+// report the first difference of every kind, the rest usually follow from it
+static void check_same(outputs const& expected, outputs const& actual, string const& context)
+{
+	BOOST_REQUIRE_EQUAL(expected.hashes.size(), actual.hashes.size());
+	for (size_t i = 0; i != expected.hashes.size(); ++i) {
+		if (!same_hash(expected.hashes[i].second, actual.hashes[i].second)) {
+			BOOST_ERROR(context << ": " << actual.hashes[i].first << " differs");
+			break;
+		}
+	}
+	BOOST_REQUIRE_EQUAL(expected.items.size(), actual.items.size());
+	for (size_t i = 0; i != expected.items.size(); ++i) {
+		if (memcmp(&expected.items[i].second, &actual.items[i].second, sizeof(node)) != 0) {
+			BOOST_ERROR(context << ": " << actual.items[i].first << " differs");
+			break;
+		}
+	}
+	BOOST_REQUIRE_EQUAL(expected.f800.size(), actual.f800.size());
+	for (size_t i = 0; i != expected.f800.size(); ++i) {
+		if (memcmp(&expected.f800[i].second, &actual.f800[i].second, sizeof(hash32_t)) != 0) {
+			BOOST_ERROR(context << ": " << actual.f800[i].first << " differs");
+			break;
+		}
+	}
+	BOOST_REQUIRE_EQUAL(expected.digests.size(), actual.digests.size());
+	for (size_t i = 0; i != expected.digests.size(); ++i) {
+		if (expected.digests[i].second != actual.digests[i].second) {
+			BOOST_ERROR(context << ": " << actual.digests[i].first << " differs");
+			break;
+		}
+	}
+}
+
+// the labels of the hashes computed by one path of compute()
+static vector<ethash_return_value_t> hashes_of(outputs const& out, string const& what)
+{
+	vector<ethash_return_value_t> ret;
+	for (auto const& hash: out.hashes) {
+		if (hash.first.compare(0, what.size() + 2, what + " #") == 0) {
+			ret.push_back(hash.second);
+		}
+	}
+	return ret;
+}
+
+BOOST_AUTO_TEST_CASE(reference_paths_agree) {
+	BOOST_TEST_MESSAGE("ETHASH_EQUIVALENCE_SEED=" << run_seed());
+	vector<workload> ws = workloads();
+	BOOST_REQUIRE(apply(reference_config()));
+	for (workload const& w: ws) {
+		outputs const out = compute(w);
+		string const context = w.name + ", seed " + to_string(run_seed());
+		vector<ethash_return_value_t> const light = hashes_of(out, "ethash light");
+		vector<ethash_return_value_t> const interleaved = hashes_of(out, "ethash light interleaved");
+		BOOST_REQUIRE_EQUAL(light.size(), w.nonces.size());
+		for (size_t i = 0; i != light.size(); ++i) {
+			BOOST_CHECK_MESSAGE(light[i].success, context << ": ethash light #" << i << " failed");
+			BOOST_CHECK_MESSAGE(same_hash(light[i], interleaved[i]), context << ": ethash light interleaved #" << i << " differs");
+		}
+		if (!w.full) {
+			continue;
+		}
+		vector<ethash_return_value_t> const full = hashes_of(out, "ethash full");
+		vector<ethash_return_value_t> const full_batch = hashes_of(out, "ethash full batch");
+		vector<ethash_return_value_t> const progpow_light = hashes_of(out, "progpow light");
+		vector<ethash_return_value_t> const progpow_full = hashes_of(out, "progpow full");
+		vector<ethash_return_value_t> const progpow_batch = hashes_of(out, "progpow full batch");
+		for (size_t i = 0; i != light.size(); ++i) {
+			BOOST_CHECK_MESSAGE(same_hash(light[i], full[i]), context << ": ethash full #" << i << " differs");
+			BOOST_CHECK_MESSAGE(same_hash(progpow_light[i], progpow_full[i]), context << ": progpow full #" << i << " differs");
+			// the batches hash every nonce with the first header and block number
+			BOOST_CHECK_MESSAGE(
+				same_hash(full_batch[i], ethash_light_compute_internal(w.light, w.full_size, w.headers[0], w.nonces[i])),
+				context << ": ethash full batch #" << i << " differs"
+			);
+			BOOST_CHECK_MESSAGE(
+				same_hash(progpow_batch[i], progpow_light_compute_internal(w.light, w.full_size, w.headers[0], w.nonces[i], w.block_numbers[0])),
+				context << ": progpow full batch #" << i << " differs"
+			);
+		}
+	}
+	restore_defaults();
+	delete_workloads(ws);
+}
+
+BOOST_AUTO_TEST_CASE(every_kernel_matches_the_reference) {
+	vector<workload> ws = workloads();
+	BOOST_REQUIRE(apply(reference_config()));
+	vector<outputs> expected;
+	for (workload const& w: ws) {
+		expected.push_back(compute(w));
+	}
+	for (config const& c: configs()) {
+		BOOST_TEST_MESSAGE("checking " << c.name);
+		BOOST_REQUIRE_MESSAGE(apply(c), "could not select " << c.name);
+		for (size_t i = 0; i != ws.size(); ++i) {
+			check_same(expected[i], compute(ws[i]), c.name + " on " + ws[i].name + ", seed " + to_string(run_seed()));
+		}
+	}
+	restore_defaults();
+	delete_workloads(ws);
+}
+
+BOOST_AUTO_TEST_CASE(opencl_devices_match_the_host) {
+	mt19937_64 rng(run_seed());
+	workload w = small_workload(rng, 1024, 1024 * 32);
+	// roughly one in 16 nonces passes this boundary
+	ethash_h256_t boundary;
+	memset(&boundary, 0xff, 32);
+	ethash_h256_set(&boundary, 0, 0x0f);
+	ethash_search_hit_t expected[128];
+	ethash_search_hit_t hits[128];
+	for (unsigned device = 0; device != ethash_cl_device_count(); ++device) {
+		ethash_cl_t cl = ethash_cl_new(w.light, w.full_size, device);
+		BOOST_REQUIRE(cl);
+		BOOST_TEST_MESSAGE("checking OpenCL device " << ethash_cl_device_name(cl));
+		for (size_t i = 0; i != 4; ++i) {
+			size_t found = ethash_full_search(w.full, w.headers[i], w.nonces[i], 1024, &boundary, expected, 128);
+			BOOST_REQUIRE_EQUAL(ethash_cl_search(cl, w.headers[i], w.nonces[i], 1024, &boundary, hits, 128), found);
+			for (size_t h = 0; h != found; ++h) {
+				BOOST_REQUIRE_EQUAL(hits[h].nonce, expected[h].nonce);
+			}
+			found = progpow_full_search(w.full, w.headers[i], w.block_numbers[i], w.nonces[i], 256, &boundary, expected, 128);
+			BOOST_REQUIRE_EQUAL(progpow_cl_search(cl, w.headers[i], w.block_numbers[i], w.nonces[i], 256, &boundary, hits, 128), found);
+			for (size_t h = 0; h != found; ++h) {
+				BOOST_REQUIRE_EQUAL(hits[h].nonce, expected[h].nonce);
+			}
+		}
+		ethash_cl_delete(cl);
+	}
+	ethash_full_delete(w.full);
+	ethash_light_delete(w.light);
+}
@@ -3,6 +3,7 @@
 #include <libethash/ethash.h>
 #include <libethash/internal.h>
 #include <libethash/io.h>
+#include <libethash/dispatch.h>
 
 #ifdef WITH_CRYPTOPP
 
@@ -235,6 +236,42 @@ BOOST_AUTO_TEST_CASE(test_progpow_keccak_f800) {
 	}
 }
 
+BOOST_AUTO_TEST_CASE(test_progpow_keccak_f800_kernels) {
+	// every kernel of both families against the round by round reference
+	uint32_t input[19][25];
+	uint32_t expected[19][25];
+	uint32_t seed = 0x9e3779b9u;
+	for (unsigned n = 0; n != 19; ++n) {
+		for (unsigned i = 0; i != 25; ++i) {
+			seed = seed * 1664525u + 1013904223u;
+			input[n][i] = n == 0 ? 0 : seed;
+		}
+		memcpy(expected[n], input[n], sizeof(input[n]));
+		ethash_keccakf800(expected[n]);
+	}
+
+	for (unsigned k = 0; ethash_keccakf800_kernel_at(k); ++k) {
+		ethash_keccakf800_kernel_t const* kernel = ethash_keccakf800_kernel_at(k);
+		for (unsigned n = 0; n != 19; ++n) {
+			uint32_t actual[25];
+			memcpy(actual, input[n], sizeof(actual));
+			kernel->permute(actual);
+			BOOST_REQUIRE_MESSAGE(memcmp(actual, expected[n], sizeof(actual)) == 0,
+					"\n" << kernel->name << " state " << n << " differs from keccak_f800_round\n");
+		}
+	}
+	for (unsigned k = 0; ethash_keccakf800_multi_kernel_at(k); ++k) {
+		ethash_keccakf800_multi_kernel_t const* kernel = ethash_keccakf800_multi_kernel_at(k);
+		uint32_t actual[19][25];
+		memcpy(actual, input, sizeof(actual));
+		kernel->permute(actual, 19);
+		for (unsigned n = 0; n != 19; ++n) {
+			BOOST_REQUIRE_MESSAGE(memcmp(actual[n], expected[n], sizeof(actual[n])) == 0,
+					"\n" << kernel->name << " state " << n << " differs from keccak_f800_round\n");
+		}
+	}
+}
+
 BOOST_AUTO_TEST_CASE(test_progpow_full_client_checks) {
 	uint64_t full_size = ethash_get_datasize(0);
 	uint64_t cache_size = ethash_get_cachesize(0);
@@ -312,6 +349,62 @@ BOOST_AUTO_TEST_CASE(test_progpow_light_client_checks) {
 	ethash_light_delete(light);
 }
 
+BOOST_AUTO_TEST_CASE(test_progpow_light_cache_matches_dag) {
+	uint64_t full_size = 1024 * 32;
+	uint64_t cache_size = 1024;
+	ethash_h256_t seed;
+	ethash_h256_t hash;
+	memcpy(&seed, "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+	memcpy(&hash, "~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~~~", 32);
+
+	ethash_light_t light = ethash_light_new_internal(cache_size, &seed);
+	BOOST_REQUIRE(light->progpow_cache);
+	for (uint32_t n = 0; n < PROGPOW_CACHE_WORDS / NODE_WORDS; ++n) {
+		node expected_node;
+		ethash_calculate_dag_item(&expected_node, n, light);
+		BOOST_REQUIRE(memcmp(&expected_node, &light->progpow_cache[n * NODE_WORDS], sizeof(node)) == 0);
+	}
+
+	// the precomputed cache must give the same results as rebuilding it per hash
+	ethash_return_value_t cached = progpow_light_compute_internal(light, full_size, hash, 5, 0);
+	uint32_t* progpow_cache = light->progpow_cache;
+	light->progpow_cache = NULL;
+	ethash_return_value_t uncached = progpow_light_compute_internal(light, full_size, hash, 5, 0);
+	light->progpow_cache = progpow_cache;
+	BOOST_REQUIRE_EQUAL(blockhashToHexString(&cached.result), blockhashToHexString(&uncached.result));
+	BOOST_REQUIRE_EQUAL(blockhashToHexString(&cached.mix_hash), blockhashToHexString(&uncached.mix_hash));
+
+	ethash_light_delete(light);
+}
+
+BOOST_AUTO_TEST_CASE(test_progpow_program) {
+	progpow_program_t prog;
+	progpow_program_init(&prog, 100);
+	int cache_ops = 0, math_ops = 0;
+	for (int i = 0; i < PROGPOW_PROGRAM_LENGTH; ++i) {
+		progpow_instruction_t const& ins = prog.instructions[i];
+		BOOST_REQUIRE(ins.dst < PROGPOW_REGS && ins.src1 < PROGPOW_REGS && ins.src2 < PROGPOW_REGS);
+		if (ins.op == PROGPOW_OP_CACHE) {
+			++cache_ops;
+		} else {
+			BOOST_REQUIRE_EQUAL(ins.op, PROGPOW_OP_MATH);
+			BOOST_REQUIRE(ins.src1 != ins.src2);
+			++math_ops;
+		}
+	}
+	BOOST_REQUIRE_EQUAL(cache_ops, PROGPOW_CNT_CACHE);
+	BOOST_REQUIRE_EQUAL(math_ops, PROGPOW_CNT_MATH);
+	BOOST_REQUIRE_EQUAL(prog.dag_dst[0], 0);
+
+	// the per-thread cache hands out the same program
+	progpow_program_t const* cached = progpow_program_get(100);
+	BOOST_REQUIRE(memcmp(cached->instructions, prog.instructions, sizeof(prog.instructions)) == 0);
+	BOOST_REQUIRE(memcmp(cached->dag_dst, prog.dag_dst, sizeof(prog.dag_dst)) == 0);
+	BOOST_REQUIRE(memcmp(cached->dag_sel, prog.dag_sel, sizeof(prog.dag_sel)) == 0);
+	cached = progpow_program_get(101);
+	BOOST_REQUIRE_EQUAL(cached->prog_seed, 101);
+}
+
 /// Defines a test case for ProgPoW hash() function. (from chfast/ethash/test/unittests/progpow_test_vectors.hpp)
 struct progpow_hash_test_case
 {
@@ -0,0 +1,249 @@
+// Requests to a running ethash-verifyd over its socket. The service is started
+// on test sized caches and DAGs, its path is the argument after "--".
+
+#include <libethash/ethash.h>
+#include <libethash/internal.h>
+#include <verifyd/verifyd_protocol.h>
+
+#define BOOST_TEST_MODULE VerifyD
+#define BOOST_TEST_MAIN
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+#define VERIFYD_CACHE_SIZE 1024
+#define VERIFYD_FULL_SIZE 32768
+
+namespace {
+
+// the service, stopped and waited for when leaving the test
+class verifyd_process
+{
+public:
+	verifyd_process(string const& path, string const& socket_path): m_socket_path(socket_path)
+	{
+		unlink(socket_path.c_str());
+		m_pid = fork();
+		if (m_pid == 0) {
+			execl(
+				path.c_str(), path.c_str(),
+				"--in-memory",
+				"--cache-size", to_string(VERIFYD_CACHE_SIZE).c_str(),
+				"--full-size", to_string(VERIFYD_FULL_SIZE).c_str(),
+				"--prefetch-blocks", "0",
+				"--block", "1",
+				"--socket", socket_path.c_str(),
+				(char*)nullptr
+			);
+			_exit(127);
+		}
+	}
+
+	~verifyd_process()
+	{
+		if (m_pid > 0 && !m_waited) {
+			kill(m_pid, SIGKILL);
+			waitpid(m_pid, nullptr, 0);
+		}
+		unlink(m_socket_path.c_str());
+	}
+
+	// a connection to the service, -1 if it did not listen in time
+	int connect_to()
+	{
+		sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, m_socket_path.c_str(), sizeof(addr.sun_path) - 1);
+		for (unsigned tries = 0; tries != 500; ++tries) {
+			int const fd = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (fd < 0) {
+				return -1;
+			}
+			if (connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) {
+				return fd;
+			}
+			close(fd);
+			int status;
+			if (waitpid(m_pid, &status, WNOHANG) == m_pid) {
+				m_waited = true;
+				return -1;
+			}
+			usleep(20000);
+		}
+		return -1;
+	}
+
+	// the exit status after SIGTERM, -1 if it did not exit normally
+	int stop()
+	{
+		int status;
+		kill(m_pid, SIGTERM);
+		if (waitpid(m_pid, &status, 0) != m_pid) {
+			return -1;
+		}
+		m_waited = true;
+		return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+	}
+
+private:
+	string m_socket_path;
+	pid_t m_pid = -1;
+	bool m_waited = false;
+};
+
+bool send_all(int fd, void const* buf, size_t size)
+{
+	uint8_t const* p = (uint8_t const*)buf;
+	while (size) {
+		ssize_t const n = write(fd, p, size);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		size -= (size_t)n;
+	}
+	return true;
+}
+
+bool recv_all(int fd, void* buf, size_t size)
+{
+	uint8_t* p = (uint8_t*)buf;
+	while (size) {
+		ssize_t const n = read(fd, p, size);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		size -= (size_t)n;
+	}
+	return true;
+}
+
+ethash_verifyd_request_t make_request(uint16_t type, uint32_t count, uint64_t id)
+{
+	ethash_verifyd_request_t ret;
+	memset(&ret, 0, sizeof(ret));
+	ret.magic = ETHASH_VERIFYD_MAGIC;
+	ret.version = ETHASH_VERIFYD_VERSION;
+	ret.type = type;
+	ret.count = count;
+	ret.id = id;
+	return ret;
+}
+
+// a share of @a block_number meeting any boundary, with the mix of the test sizes
+ethash_verifyd_share_t make_share(uint64_t block_number, uint64_t nonce)
+{
+	ethash_verifyd_share_t ret;
+	memset(&ret, 0, sizeof(ret));
+	ret.block_number = block_number;
+	ret.nonce = nonce;
+	for (unsigned i = 0; i != 32; ++i) {
+		ret.header_hash[i] = (uint8_t)(i * 7 + block_number);
+	}
+	memset(ret.boundary, 0xff, sizeof(ret.boundary));
+	ethash_h256_t const seedhash = ethash_get_seedhash(block_number);
+	ethash_light_t const light = ethash_light_new_internal(VERIFYD_CACHE_SIZE, &seedhash);
+	BOOST_REQUIRE(light);
+	ethash_h256_t header_hash;
+	memcpy(&header_hash, ret.header_hash, 32);
+	ethash_return_value_t const r = ethash_light_compute_internal(light, VERIFYD_FULL_SIZE, header_hash, nonce);
+	BOOST_REQUIRE(r.success);
+	memcpy(ret.mix_hash, &r.mix_hash, 32);
+	ethash_light_delete(light);
+	return ret;
+}
+
+// send a verify request and get the status of each share
+vector<uint8_t> verify(int fd, vector<ethash_verifyd_share_t> const& shares, uint64_t id, uint32_t* valid)
+{
+	ethash_verifyd_request_t const request = make_request(ETHASH_VERIFYD_VERIFY, (uint32_t)shares.size(), id);
+	BOOST_REQUIRE(send_all(fd, &request, sizeof(request)));
+	BOOST_REQUIRE(send_all(fd, shares.data(), shares.size() * sizeof(shares[0])));
+	ethash_verifyd_response_t response;
+	BOOST_REQUIRE(recv_all(fd, &response, sizeof(response)));
+	BOOST_REQUIRE_EQUAL(response.magic, ETHASH_VERIFYD_MAGIC);
+	BOOST_REQUIRE_EQUAL(response.type, ETHASH_VERIFYD_VERIFY);
+	BOOST_REQUIRE_EQUAL(response.id, id);
+	BOOST_REQUIRE_EQUAL(response.count, shares.size());
+	vector<uint8_t> ret(shares.size());
+	BOOST_REQUIRE(recv_all(fd, ret.data(), ret.size()));
+	*valid = response.valid;
+	return ret;
+}
+
+string verifyd_path()
+{
+	int const argc = boost::unit_test::framework::master_test_suite().argc;
+	char** const argv = boost::unit_test::framework::master_test_suite().argv;
+	BOOST_REQUIRE_MESSAGE(argc > 1, "pass the path of ethash-verifyd after --");
+	return argv[argc - 1];
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(verifyd_answers_verify_and_stats_requests) {
+	string const socket_path = "/tmp/ethash-verifyd-test-" + to_string(getpid()) + ".sock";
+	verifyd_process service(verifyd_path(), socket_path);
+	int const fd = service.connect_to();
+	BOOST_REQUIRE_MESSAGE(fd >= 0, "ethash-verifyd did not listen on " << socket_path);
+
+	ethash_verifyd_share_t const valid0 = make_share(1, 0x1234);
+	ethash_verifyd_share_t wrong_mix = valid0;
+	wrong_mix.mix_hash[0] ^= 1;
+	ethash_verifyd_share_t zero_boundary = valid0;
+	memset(zero_boundary.boundary, 0, sizeof(zero_boundary.boundary));
+	// two epochs ahead of the one built at start, never built for a share
+	ethash_verifyd_share_t const far_future = make_share(2 * ETHASH_EPOCH_LENGTH + 1, 0x1234);
+
+	uint32_t valid;
+	vector<uint8_t> statuses = verify(fd, {valid0, wrong_mix, zero_boundary, far_future}, 7, &valid);
+	BOOST_REQUIRE_EQUAL(valid, 1U);
+	BOOST_REQUIRE_EQUAL(statuses[0], ETHASH_VERIFYD_VALID);
+	BOOST_REQUIRE_EQUAL(statuses[1], ETHASH_VERIFYD_INVALID);
+	BOOST_REQUIRE_EQUAL(statuses[2], ETHASH_VERIFYD_INVALID);
+	BOOST_REQUIRE_EQUAL(statuses[3], ETHASH_VERIFYD_UNAVAILABLE);
+
+	// the next epoch moves the table on and the one before stays verifiable
+	ethash_verifyd_share_t const valid1 = make_share(ETHASH_EPOCH_LENGTH + 1, 0x5678);
+	statuses = verify(fd, {valid1, valid0}, 8, &valid);
+	BOOST_REQUIRE_EQUAL(valid, 2U);
+	BOOST_REQUIRE_EQUAL(statuses[0], ETHASH_VERIFYD_VALID);
+	BOOST_REQUIRE_EQUAL(statuses[1], ETHASH_VERIFYD_VALID);
+
+	ethash_verifyd_request_t const request = make_request(ETHASH_VERIFYD_STATS, 0, 9);
+	BOOST_REQUIRE(send_all(fd, &request, sizeof(request)));
+	ethash_verifyd_response_t response;
+	BOOST_REQUIRE(recv_all(fd, &response, sizeof(response)));
+	BOOST_REQUIRE_EQUAL(response.type, ETHASH_VERIFYD_STATS);
+	BOOST_REQUIRE_EQUAL(response.id, 9U);
+	ethash_verifyd_stats_t stats;
+	BOOST_REQUIRE(recv_all(fd, &stats, sizeof(stats)));
+	BOOST_REQUIRE_EQUAL(stats.requests, 2U);
+	BOOST_REQUIRE_EQUAL(stats.shares, 6U);
+	BOOST_REQUIRE_EQUAL(stats.valid, 3U);
+	BOOST_REQUIRE_EQUAL(stats.unavailable, 1U);
+	BOOST_REQUIRE_EQUAL(stats.current_epoch, 1U);
+	BOOST_REQUIRE(stats.max_us >= stats.p50_us);
+
+	close(fd);
+	BOOST_REQUIRE_EQUAL(service.stop(), 0);
+}
@@ -65,6 +65,30 @@ def int_to_bytes(i):
     b.reverse()
     return "".join(b)
 
+def test_light_object_matches_hashimoto_light():
+    cache = pyethash.mkcache_bytes(0)
+    light = pyethash.Light(0)
+    assert memoryview(light).tobytes() == cache
+    header = "~~~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~"
+    result = light.hashimoto(header, 0)
+    assert result == pyethash.hashimoto_light(0, cache, header, 0)
+    assert light.hashimoto_batch(header, [0, 1]) == [result, light.hashimoto(header, 1)]
+    mix = result["mix digest"]
+    easy_difficulty = int_to_bytes(2**256 - 1)
+    assert light.verify_batch(header, [0, 1], [mix, mix], easy_difficulty) == [True, False]
+
+def test_dataset_reports_progress_and_mines():
+    cache = pyethash.mkcache_bytes(0)
+    progress = []
+    dataset = pyethash.calc_dataset_bytes(1024 * 32, cache, callback=progress.append)
+    assert len(memoryview(dataset).tobytes()) == 1024 * 32
+    assert progress[-1] == 100
+    header = "~~~~~X~~~~~~~~~~~~~~~~~~~~~~~~~~"
+    found = pyethash.mine(dataset, header, int_to_bytes(2**256 // 100))
+    result = pyethash.hashimoto_full(dataset, header, found["nonce"])
+    assert result["result"] == found["result"]
+    assert result["mix digest"] == found["mix digest"]
+
 def test_mining_basic():
     easy_difficulty = int_to_bytes(2**256 - 1)
     assert easy_difficulty.encode('hex') == 'f' * 64